@@ -16,17 +16,24 @@ G_DECLARE_INTERFACE (PhocAnimatable, phoc_animatable, PHOC, ANIMATABLE, GObject)
 /**
  * PhocFrameCallback:
  * @self: The animatable
- * @last_frame: Time of the last frame in us
+ * @last_frame: Predicted presentation time of the last frame in us
+ * @frame_time: Predicted presentation time of the upcoming frame in us
  * @user_data: User data passed when registering the callback
  *
  * Callback type for adding a function to update animations. See
  * phoc_animatable_add_frame_callback().
  *
+ * Both times are in the `CLOCK_MONOTONIC` domain of
+ * g_get_monotonic_time(). Animations should advance to @frame_time
+ * rather than sampling the clock themselves so all animations on an
+ * output move in step with what ends up on screen.
+ *
  * Returns: G_SOURCE_CONTINUE if the frame callback should continue to
  *  or G_SOURCE_REMOVE if the frame callback should be removed.
  */
 typedef gboolean (*PhocFrameCallback) (PhocAnimatable *self,
                                        guint64         last_frame,
+                                       guint64         frame_time,
                                        gpointer        user_data);
 
 struct _PhocAnimatableInterface
@@ -416,3 +416,64 @@ phoc_easing_ease (PhocEasing self,
     g_assert_not_reached ();
   }
 }
+
+
+#define PHOC_EASING_LUT_SEGMENTS 512
+
+/* Lazily filled lookup tables, one per easing function */
+static float *easing_luts[PHOC_EASING_EASE_IN_OUT_BOUNCE + 1];
+
+
+static float *
+get_lut (PhocEasing self)
+{
+  float *lut;
+
+  g_assert (self <= PHOC_EASING_EASE_IN_OUT_BOUNCE);
+
+  lut = easing_luts[self];
+  if (G_LIKELY (lut))
+    return lut;
+
+  /* One extra entry so interpolation at 1.0 stays in bounds */
+  lut = g_new (float, PHOC_EASING_LUT_SEGMENTS + 1);
+  for (int i = 0; i <= PHOC_EASING_LUT_SEGMENTS; i++)
+    lut[i] = phoc_easing_ease (self, (double) i / PHOC_EASING_LUT_SEGMENTS);
+
+  easing_luts[self] = lut;
+  return lut;
+}
+
+/**
+ * phoc_easing_ease_lut:
+ * @self: a `PhocEasing`
+ * @value: a value to ease
+ *
+ * Like [func@easing_ease] but approximates the easing function by
+ * linearly interpolating a table of precomputed values. This avoids
+ * the transcendental functions used by e.g. the sine, expo and elastic
+ * easings at the cost of an absolute error that stays below 0.5%.
+ *
+ * @value must be in the [0, 1] range.
+ *
+ * Returns: the approximated easing for @value
+ */
+double
+phoc_easing_ease_lut (PhocEasing self,
+                      double     value)
+{
+  const float *lut;
+  double pos, frac;
+  int i;
+
+  /* Linear needs no table and the ends are exact */
+  if (self == PHOC_EASING_NONE || value <= 0.0 || value >= 1.0)
+    return phoc_easing_ease (self, CLAMP (value, 0.0, 1.0));
+
+  lut = get_lut (self);
+  pos = value * PHOC_EASING_LUT_SEGMENTS;
+  i = (int)pos;
+  frac = pos - i;
+
+  return lut[i] + (lut[i + 1] - lut[i]) * frac;
+}
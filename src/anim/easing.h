@@ -13,6 +13,7 @@
 
 G_BEGIN_DECLS
 
-double phoc_easing_ease (PhocEasing self, double value);
+double phoc_easing_ease     (PhocEasing self, double value);
+double phoc_easing_ease_lut (PhocEasing self, double value);
 
 G_END_DECLS
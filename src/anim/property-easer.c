@@ -10,6 +10,8 @@
 
 #include "phoc-config.h"
 
+#include <float.h>
+
 #include "easing.h"
 #include "property-easer.h"
 
@@ -20,6 +22,7 @@ enum {
   PROP_PROGRESS,
   PROP_PROPERTIES,
   PROP_EASING,
+  PROP_USE_LUT,
   PROP_LAST_PROP
 };
 static GParamSpec *props[PROP_LAST_PROP];
@@ -29,6 +32,9 @@ typedef struct _PhocEaseProp {
   GParamSpec *pspec;
   float start;
   float end;
+  /* The last value set on the target */
+  GValue      value;
+  gboolean    valid;
 } PhocEaseProp;
 
 
@@ -69,8 +75,9 @@ struct _PhocPropertyEaser {
   float           progress;
   GObject        *target;
   PhocEasing      easing;
+  gboolean        use_lut;
 
-  GHashTable     *ease_props;
+  GArray         *ease_props;
 };
 G_DEFINE_TYPE (PhocPropertyEaser, phoc_property_easer, G_TYPE_OBJECT)
 
@@ -96,24 +103,39 @@ phoc_lerp (double a, double b, double t)
 
 
 static void
-phoc_ease_prop_free (PhocEaseProp *ease_prop)
+phoc_ease_prop_clear (PhocEaseProp *ease_prop)
 {
-  g_free (ease_prop);
+  g_value_unset (&ease_prop->value);
 }
 
 
-static PhocEaseProp *
-phoc_ease_prop_new (GParamSpec *pspec, float start, float end)
+static void
+add_ease_prop (PhocPropertyEaser *self, GParamSpec *pspec, float start, float end)
 {
-  PhocEaseProp *ease_prop = g_new0 (PhocEaseProp, 1);
+  PhocEaseProp *ease_prop = NULL;
 
   g_assert (G_IS_PARAM_SPEC (pspec));
 
-  ease_prop->pspec = pspec;
+  /* Setting a property again replaces its interval */
+  for (guint i = 0; i < self->ease_props->len; i++) {
+    PhocEaseProp *prop = &g_array_index (self->ease_props, PhocEaseProp, i);
+
+    if (prop->pspec == pspec) {
+      ease_prop = prop;
+      break;
+    }
+  }
+
+  if (ease_prop == NULL) {
+    g_array_set_size (self->ease_props, self->ease_props->len + 1);
+    ease_prop = &g_array_index (self->ease_props, PhocEaseProp, self->ease_props->len - 1);
+    ease_prop->pspec = pspec;
+    g_value_init (&ease_prop->value, G_PARAM_SPEC_VALUE_TYPE (pspec));
+  }
+
   ease_prop->start = start;
   ease_prop->end = end;
-
-  return ease_prop;
+  ease_prop->valid = FALSE;
 }
 
 
@@ -159,9 +181,7 @@ set_props_variant (PhocPropertyEaser *self, GVariant *variant)
       continue;
     }
 
-    ease_prop = phoc_ease_prop_new (pspec, start, end);
-    g_hash_table_insert (self->ease_props, g_strdup (name), ease_prop);
-
+    add_ease_prop (self, pspec, start, end);
     n_params++;
   }
 
@@ -193,6 +213,9 @@ phoc_property_easer_set_property (GObject      *object,
   case PROP_EASING:
     phoc_property_easer_set_easing (self, g_value_get_enum (value));
     break;
+  case PROP_USE_LUT:
+    phoc_property_easer_set_use_lut (self, g_value_get_boolean (value));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -218,6 +241,9 @@ phoc_property_easer_get_property (GObject    *object,
   case PROP_EASING:
     g_value_set_enum (value, phoc_property_easer_get_easing (self));
     break;
+  case PROP_USE_LUT:
+    g_value_set_boolean (value, phoc_property_easer_get_use_lut (self));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -231,7 +257,7 @@ phoc_property_easer_dispose (GObject *object)
   PhocPropertyEaser *self = PHOC_PROPERTY_EASER(object);
 
   set_target (self, NULL);
-  g_clear_pointer (&self->ease_props, g_hash_table_destroy);
+  g_clear_pointer (&self->ease_props, g_array_unref);
 
   G_OBJECT_CLASS (phoc_property_easer_parent_class)->dispose (object);
 }
@@ -286,6 +312,16 @@ phoc_property_easer_class_init (PhocPropertyEaserClass *klass)
                        PHOC_TYPE_EASING,
                        PHOC_EASING_NONE,
                        G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  /**
+   * PhocPropertyEaser:use-lut:
+   *
+   * Whether to approximate the easing function via a lookup table
+   * instead of evaluating it analytically. See [func@easing_ease_lut].
+   */
+  props[PROP_USE_LUT] =
+    g_param_spec_boolean ("use-lut", "", "",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
 
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 }
@@ -294,8 +330,8 @@ phoc_property_easer_class_init (PhocPropertyEaserClass *klass)
 static void
 phoc_property_easer_init (PhocPropertyEaser *self)
 {
-  self->ease_props = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
-                                            (GDestroyNotify)phoc_ease_prop_free);
+  self->ease_props = g_array_new (FALSE, TRUE, sizeof (PhocEaseProp));
+  g_array_set_clear_func (self->ease_props, (GDestroyNotify)phoc_ease_prop_clear);
 }
 
 
@@ -313,40 +349,51 @@ phoc_property_easer_new (GObject *target)
  * @progress: The current progress
  *
  * Sets the current progress and updates the target objects properties according
- * to the set easing function.
+ * to the set easing function. In between the start and end of the
+ * interval properties whose value didn't change since the last update
+ * (e.g. integer properties between two frames) aren't set again.
  */
 void
 phoc_property_easer_set_progress (PhocPropertyEaser *self, float progress)
 {
-  GHashTableIter iter;
-  PhocEaseProp *ease_prop;
+  g_auto (GValue) val = G_VALUE_INIT;
+  gboolean force;
+  float t;
 
   /* target disposed, nothing to do */
   if (self->target == NULL)
     return;
 
-  g_return_if_fail (g_hash_table_size (self->ease_props));
   g_return_if_fail (PHOC_IS_PROPERTY_EASER (self));
+  g_return_if_fail (self->ease_props->len);
   g_return_if_fail (progress >= 0.0 && progress <= 1.0);
 
   self->progress = progress;
+  if (self->use_lut)
+    t = phoc_easing_ease_lut (self->easing, progress);
+  else
+    t = phoc_easing_ease (self->easing, progress);
+  /* Always apply the interval's ends in case the target got modified by someone else */
+  force = G_APPROX_VALUE (progress, 0.0, FLT_EPSILON) || G_APPROX_VALUE (progress, 1.0, FLT_EPSILON);
+  g_value_init (&val, G_TYPE_FLOAT);
 
   g_object_freeze_notify (self->target);
-  g_hash_table_iter_init (&iter, self->ease_props);
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &ease_prop)) {
-    float t = phoc_easing_ease (self->easing, progress);
-    g_auto (GValue) val = G_VALUE_INIT;
+  for (guint i = 0; i < self->ease_props->len; i++) {
+    PhocEaseProp *ease_prop = &g_array_index (self->ease_props, PhocEaseProp, i);
     g_auto (GValue) target = G_VALUE_INIT;
 
-    g_value_init (&val, G_TYPE_FLOAT);
-    g_value_init (&target, G_PARAM_SPEC_VALUE_TYPE (ease_prop->pspec));
-
+    g_value_init (&target, G_VALUE_TYPE (&ease_prop->value));
     g_value_set_float (&val, phoc_lerp (ease_prop->start, ease_prop->end, t));
     g_value_transform (&val, &target);
 
-    g_object_set_property (self->target,
-                           ease_prop->pspec->name,
-                           &target);
+    if (!force && ease_prop->valid &&
+        g_param_values_cmp (ease_prop->pspec, &target, &ease_prop->value) == 0)
+      continue;
+
+    g_value_copy (&target, &ease_prop->value);
+    ease_prop->valid = TRUE;
+
+    g_object_set_property (self->target, ease_prop->pspec->name, &target);
   }
   g_object_thaw_notify (self->target);
 
@@ -386,6 +433,30 @@ phoc_property_easer_get_easing (PhocPropertyEaser *self)
 }
 
 
+void
+phoc_property_easer_set_use_lut (PhocPropertyEaser *self, gboolean use_lut)
+{
+  g_return_if_fail (PHOC_IS_PROPERTY_EASER (self));
+
+  use_lut = !!use_lut;
+  if (self->use_lut == use_lut)
+    return;
+
+  self->use_lut = use_lut;
+
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_USE_LUT]);
+}
+
+
+gboolean
+phoc_property_easer_get_use_lut (PhocPropertyEaser *self)
+{
+  g_return_val_if_fail (PHOC_IS_PROPERTY_EASER (self), FALSE);
+
+  return self->use_lut;
+}
+
+
 static guint
 phoc_property_easer_set_props_valist (PhocPropertyEaser *self,
                                       const gchar       *first_property_name,
@@ -397,7 +468,6 @@ phoc_property_easer_set_props_valist (PhocPropertyEaser *self,
   name = first_property_name;
   do {
     GParamSpec *pspec;
-    PhocEaseProp *ease_prop;
     float start, end;
 
     pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (self->target), name);
@@ -421,9 +491,7 @@ phoc_property_easer_set_props_valist (PhocPropertyEaser *self,
       continue;
     }
 
-    ease_prop = phoc_ease_prop_new (pspec, start, end);
-    g_hash_table_insert (self->ease_props, g_strdup (name), ease_prop);
-
+    add_ease_prop (self, pspec, start, end);
     n_params++;
   } while ((name = va_arg (var_args, const gchar *)));
 
@@ -456,3 +524,25 @@ phoc_property_easer_set_props (PhocPropertyEaser *self,
   va_end (var_args);
   return n;
 }
+
+/**
+ * phoc_property_easer_reset:
+ * @self: The property easer
+ * @target:(nullable): The new target
+ *
+ * Drops all eased properties and makes @self ease properties of
+ * @target instead. This allows to reuse an easer for a different
+ * object instead of creating a new one. Easing and LUT usage are
+ * reset to their defaults.
+ */
+void
+phoc_property_easer_reset (PhocPropertyEaser *self, GObject *target)
+{
+  g_return_if_fail (PHOC_IS_PROPERTY_EASER (self));
+
+  set_target (self, target);
+  g_array_set_size (self->ease_props, 0);
+  self->progress = 0.0;
+  phoc_property_easer_set_easing (self, PHOC_EASING_NONE);
+  phoc_property_easer_set_use_lut (self, FALSE);
+}
@@ -23,8 +23,13 @@ float                 phoc_property_easer_get_progress     (PhocPropertyEaser  *
 void                  phoc_property_easer_set_easing       (PhocPropertyEaser  *self,
                                                             PhocEasing          easing);
 PhocEasing            phoc_property_easer_get_easing       (PhocPropertyEaser  *self);
+void                  phoc_property_easer_set_use_lut      (PhocPropertyEaser  *self,
+                                                            gboolean            use_lut);
+gboolean              phoc_property_easer_get_use_lut      (PhocPropertyEaser  *self);
 guint                 phoc_property_easer_set_props        (PhocPropertyEaser  *self,
                                                             const gchar        *first_property_name,
                                                             ...) G_GNUC_NULL_TERMINATED;
+void                  phoc_property_easer_reset            (PhocPropertyEaser  *self,
+                                                            GObject            *target);
 
 G_END_DECLS
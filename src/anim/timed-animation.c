@@ -23,6 +23,7 @@ enum {
   PROP_DURATION,
   PROP_DISPOSE_ON_DONE,
   PROP_STATE,
+  PROP_MAX_FPS,
   PROP_LAST_PROP
 };
 static GParamSpec *props[PROP_LAST_PROP];
@@ -50,8 +51,14 @@ struct _PhocTimedAnimation {
   gint64               elapsed_ms;
   int                  duration;
   PhocAnimationState   state;
-  guint                frame_callback_id;
+  gboolean             ticking;
   gboolean             dispose_on_done;
+  int                  max_fps;
+  gint64               last_tick_us;
+  /* Latched when starting to play so durations don't change midway */
+  gboolean             power_saving;
+  /* Owned by the pool while in use, see phoc_timed_animation_acquire() */
+  gboolean             pooled;
 };
 
 struct _PhocTimedAnimationClass {
@@ -60,6 +67,35 @@ struct _PhocTimedAnimationClass {
 
 G_DEFINE_TYPE (PhocTimedAnimation, phoc_timed_animation, G_TYPE_OBJECT)
 
+/*
+ * All animations driven by the same animatable share a single frame
+ * callback so they are advanced in one pass using the same frame
+ * time instead of each one registering (and removing) its own.
+ */
+typedef struct _PhocAnimationClock {
+  PhocAnimatable *animatable;
+  GPtrArray      *animations;
+  guint           frame_callback_id;
+  gboolean        in_tick;
+} PhocAnimationClock;
+
+#define PHOC_ANIMATION_CLOCK_KEY "phoc-animation-clock"
+
+/* When saving power animations are shorter and tick less often */
+#define POWER_SAVING_DURATION_SCALE 0.5
+#define POWER_SAVING_MAX_FPS 30
+/* What animations pick up when they start playing */
+static gboolean power_saving_default;
+
+/* Frame times sit on vblanks, don't skip a frame due to the refresh interval's rounding */
+#define TICK_INTERVAL_SLACK_US 1000
+
+/* Finished pooled animations waiting to be reused, holds a ref on each */
+#define POOL_MAX_SIZE 8
+static GPtrArray *pool;
+
+static void tick (PhocTimedAnimation *self, guint64 now, guint64 last_frame);
+
 
 static void
 set_animatable (PhocTimedAnimation *self, PhocAnimatable *animatable)
@@ -73,17 +109,41 @@ set_animatable (PhocTimedAnimation *self, PhocAnimatable *animatable)
 }
 
 
+static int
+get_effective_duration (PhocTimedAnimation *self)
+{
+  if (G_UNLIKELY (self->power_saving))
+    return self->duration * POWER_SAVING_DURATION_SCALE;
+
+  return self->duration;
+}
+
+
+/* The minimum time between two ticks, 0 to tick on every frame */
+static gint64
+get_tick_interval_us (PhocTimedAnimation *self)
+{
+  int max_fps = self->max_fps;
+
+  if (G_UNLIKELY (self->power_saving) && (max_fps == 0 || max_fps > POWER_SAVING_MAX_FPS))
+    max_fps = POWER_SAVING_MAX_FPS;
+
+  return max_fps ? G_USEC_PER_SEC / max_fps : 0;
+}
+
+
 static void
 update_properties (PhocTimedAnimation *self, guint t)
 {
+  int duration = get_effective_duration (self);
   double progress;
 
   g_assert (PHOC_IS_PROPERTY_EASER (self->prop_easer));
 
-  if (self->duration == 0)
+  if (duration == 0)
     return phoc_property_easer_set_progress (self->prop_easer, 0.0);
 
-  progress = (double) t / self->duration;
+  progress = (double) t / duration;
 
   if (progress > 1.0)
     progress = 1.0;
@@ -121,29 +181,190 @@ set_dispose_on_done (PhocTimedAnimation *self, gboolean dispose_on_done)
 
 
 static void
-stop_animation (PhocTimedAnimation *self)
+phoc_animation_clock_free (PhocAnimationClock *clock)
 {
-  if (self->frame_callback_id) {
-    phoc_animatable_remove_frame_callback (self->animatable, self->frame_callback_id);
-    self->frame_callback_id = 0;
+  /* The animatable is gone so the remaining animations can't tick anymore */
+  for (guint i = 0; i < clock->animations->len; i++) {
+    PhocTimedAnimation *anim = g_ptr_array_index (clock->animations, i);
+
+    if (anim == NULL)
+      continue;
+
+    anim->ticking = FALSE;
+    /* Nobody else would finish them and hand them back to the pool */
+    if (anim->pooled)
+      phoc_timed_animation_skip (anim);
   }
+
+  g_ptr_array_free (clock->animations, TRUE);
+  g_free (clock);
+}
+
+
+static PhocAnimationClock *
+phoc_animation_clock_get (PhocAnimatable *animatable, gboolean create)
+{
+  PhocAnimationClock *clock;
+
+  clock = g_object_get_data (G_OBJECT (animatable), PHOC_ANIMATION_CLOCK_KEY);
+  if (clock || !create)
+    return clock;
+
+  clock = g_new0 (PhocAnimationClock, 1);
+  clock->animatable = animatable;
+  clock->animations = g_ptr_array_new ();
+  g_object_set_data_full (G_OBJECT (animatable),
+                          PHOC_ANIMATION_CLOCK_KEY,
+                          clock,
+                          (GDestroyNotify)phoc_animation_clock_free);
+  return clock;
 }
 
 
 static gboolean
-on_frame_callback (PhocAnimatable *animatable,
-                   guint64         last_frame,
-                   gpointer        user_data)
+on_clock_frame_callback (PhocAnimatable *animatable,
+                         guint64         last_frame,
+                         guint64         frame_time,
+                         gpointer        user_data)
+{
+  PhocAnimationClock *clock = user_data;
+  guint64 now = frame_time;
+  guint n_animations = clock->animations->len;
+  guint j = 0;
+
+  clock->in_tick = TRUE;
+  /* Animations started from a tick handler first tick on the next frame */
+  for (guint i = 0; i < n_animations; i++) {
+    PhocTimedAnimation *anim = g_ptr_array_index (clock->animations, i);
+    guint64 since = last_frame;
+    gint64 interval_us;
+
+    /* Removed by a previous animation's handler */
+    if (anim == NULL)
+      continue;
+
+    /* Capped animations skip frames, these still count towards their progress */
+    interval_us = get_tick_interval_us (anim);
+    if (interval_us && anim->last_tick_us) {
+      if (now - anim->last_tick_us + TICK_INTERVAL_SLACK_US < interval_us)
+        continue;
+      /* Don't catch up on time without frames, e.g. while the output was dormant */
+      since = MAX ((guint64)anim->last_tick_us, last_frame - interval_us);
+    }
+    /* Ticking might drop the last ref */
+    anim->last_tick_us = now;
+
+    tick (anim, now, since);
+  }
+  clock->in_tick = FALSE;
+
+  /* Compact the array, removals during the tick only cleared their slot */
+  for (guint i = 0; i < clock->animations->len; i++) {
+    gpointer anim = g_ptr_array_index (clock->animations, i);
+
+    if (anim)
+      clock->animations->pdata[j++] = anim;
+  }
+  g_ptr_array_set_size (clock->animations, j);
+
+  if (clock->animations->len)
+    return G_SOURCE_CONTINUE;
+
+  clock->frame_callback_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+phoc_animation_clock_add (PhocAnimationClock *clock, PhocTimedAnimation *anim)
+{
+  g_ptr_array_add (clock->animations, anim);
+
+  if (clock->frame_callback_id)
+    return;
+
+  clock->frame_callback_id = phoc_animatable_add_frame_callback (clock->animatable,
+                                                                 on_clock_frame_callback,
+                                                                 clock,
+                                                                 NULL);
+}
+
+
+static void
+phoc_animation_clock_remove (PhocAnimationClock *clock, PhocTimedAnimation *anim)
+{
+  guint index;
+
+  if (!g_ptr_array_find (clock->animations, anim, &index))
+    return;
+
+  if (clock->in_tick) {
+    /* Compacted once the tick is over */
+    clock->animations->pdata[index] = NULL;
+    return;
+  }
+
+  g_ptr_array_remove_index (clock->animations, index);
+  if (clock->animations->len || clock->frame_callback_id == 0)
+    return;
+
+  phoc_animatable_remove_frame_callback (clock->animatable, clock->frame_callback_id);
+  clock->frame_callback_id = 0;
+}
+
+
+static void
+stop_animation (PhocTimedAnimation *self)
+{
+  PhocAnimationClock *clock;
+
+  if (!self->ticking)
+    return;
+
+  self->ticking = FALSE;
+  /* Animatable is gone and took the clock with it */
+  if (self->animatable == NULL)
+    return;
+
+  clock = phoc_animation_clock_get (self->animatable, FALSE);
+  if (clock)
+    phoc_animation_clock_remove (clock, self);
+}
+
+
+static void
+release_to_pool (PhocTimedAnimation *self)
+{
+  self->pooled = FALSE;
+
+  /* Drop everything the last user set up */
+  g_signal_handlers_disconnect_matched (self, G_SIGNAL_MATCH_ID, signals[TICK], 0, NULL, NULL, NULL);
+  g_signal_handlers_disconnect_matched (self, G_SIGNAL_MATCH_ID, signals[DONE], 0, NULL, NULL, NULL);
+  self->state = PHOC_TIMED_ANIMATION_IDLE;
+  set_animatable (self, NULL);
+  phoc_property_easer_reset (self->prop_easer, NULL);
+  self->max_fps = 0;
+
+  if (pool == NULL)
+    pool = g_ptr_array_new_with_free_func (g_object_unref);
+
+  /* Hand the pool's ref back */
+  if (pool->len < POOL_MAX_SIZE)
+    g_ptr_array_add (pool, self);
+  else
+    g_object_unref (self);
+}
+
+
+static void
+tick (PhocTimedAnimation *self, guint64 now, guint64 last_frame)
 {
-  PhocTimedAnimation *self = PHOC_TIMED_ANIMATION (user_data);
-  guint64 now = g_get_monotonic_time ();
   guint t = self->elapsed_ms + ((now - last_frame) / 1000);
 
   g_debug ("t: %d/%d", t, self->duration);
-  if (self->elapsed_ms > self->duration) {
-    self->frame_callback_id = 0;
+  if (self->elapsed_ms > get_effective_duration (self)) {
     phoc_timed_animation_skip (self);
-    return G_SOURCE_REMOVE;
+    return;
   }
 
   update_properties (self, t);
@@ -151,7 +372,6 @@ on_frame_callback (PhocAnimatable *animatable,
   g_signal_emit (self, signals[TICK], 0);
 
   self->elapsed_ms = t;
-  return G_SOURCE_CONTINUE;
 }
 
 
@@ -169,14 +389,14 @@ play (PhocTimedAnimation *self)
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_STATE]);
 
   self->elapsed_ms = 0;
+  self->last_tick_us = 0;
+  self->power_saving = power_saving_default;
 
-  if (self->frame_callback_id)
+  if (self->ticking)
     return;
 
-  self->frame_callback_id = phoc_animatable_add_frame_callback (PHOC_ANIMATABLE (self->animatable),
-                                                                on_frame_callback,
-                                                                self,
-                                                                NULL);
+  self->ticking = TRUE;
+  phoc_animation_clock_add (phoc_animation_clock_get (self->animatable, TRUE), self);
 }
 
 
@@ -201,6 +421,9 @@ phoc_timed_animation_set_property (GObject      *object,
   case PROP_DISPOSE_ON_DONE:
     set_dispose_on_done (self, g_value_get_boolean (value));
     break;
+  case PROP_MAX_FPS:
+    phoc_timed_animation_set_max_fps (self, g_value_get_int (value));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -232,6 +455,9 @@ phoc_timed_animation_get_property (GObject    *object,
   case PROP_STATE:
     g_value_set_enum (value, phoc_timed_animation_get_state (self));
     break;
+  case PROP_MAX_FPS:
+    g_value_set_int (value, self->max_fps);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -317,6 +543,22 @@ phoc_timed_animation_class_init (PhocTimedAnimationClass *klass)
                           "",
                           FALSE,
                           G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  /**
+   * PhocTimedAnimation:max-fps:
+   *
+   * The maximum number of times per second the animation updates,
+   * `0` updates it on every output frame. Slow fades don't need the
+   * output's full refresh rate and skipped frames don't damage the
+   * output.
+   */
+  props[PROP_MAX_FPS] =
+    g_param_spec_int ("max-fps",
+                      "",
+                      "",
+                      0,
+                      G_MAXINT,
+                      0,
+                      G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
   /**
    * PhocAnimation::state:
    *
@@ -374,6 +616,71 @@ phoc_timed_animation_new (void)
   return g_object_new (PHOC_TYPE_TIMED_ANIMATION, NULL);
 }
 
+/**
+ * phoc_timed_animation_acquire:
+ * @animatable: The animatable driving the animation
+ * @target: The object whose properties get eased
+ * @easing: The easing function
+ * @duration: The duration in milliseconds
+ *
+ * Gets an animation for a short lived effect that is played once and
+ * forgotten. Such animations (and their property easers) are taken
+ * from a pool and put back once done instead of creating new objects
+ * for every effect.
+ *
+ * The caller sets the properties to ease on the animation's
+ * [type@PropertyEaser], connects to its signals and plays it but
+ * doesn't own a reference. Signal handlers, the animatable, the
+ * target and the eased properties are dropped after
+ * [signal@TimedAnimation::done] was emitted or once @animatable
+ * goes away.
+ *
+ * The pool holds the reference on the animation while it's in use.
+ *
+ * Returns:(transfer none): The animation
+ */
+PhocTimedAnimation *
+phoc_timed_animation_acquire (PhocAnimatable *animatable,
+                              GObject        *target,
+                              PhocEasing      easing,
+                              int             duration)
+{
+  PhocTimedAnimation *self;
+
+  g_assert (PHOC_IS_ANIMATABLE (animatable));
+
+  /* Either way the ref is owned by the pool until the animation is done */
+  if (pool && pool->len) {
+    self = g_ptr_array_steal_index_fast (pool, pool->len - 1);
+  } else {
+    g_autoptr (PhocPropertyEaser) easer = phoc_property_easer_new (NULL);
+
+    self = g_object_new (PHOC_TYPE_TIMED_ANIMATION, "property-easer", easer, NULL);
+  }
+
+  self->pooled = TRUE;
+  set_animatable (self, animatable);
+  phoc_property_easer_reset (self->prop_easer, target);
+  phoc_property_easer_set_easing (self->prop_easer, easing);
+  phoc_timed_animation_set_duration (self, duration);
+
+  return self;
+}
+
+/**
+ * phoc_timed_animation_clear_pool:
+ *
+ * Frees the animations waiting in the pool to be reused by
+ * [func@TimedAnimation.acquire]. Animations still in use go back to
+ * the pool once done so call this at shutdown once all animatables
+ * are gone.
+ */
+void
+phoc_timed_animation_clear_pool (void)
+{
+  g_clear_pointer (&pool, g_ptr_array_unref);
+}
+
 
 /**
  * phoc_timed_animation_get_property_easer:
@@ -413,6 +720,29 @@ phoc_timed_animation_get_duration (PhocTimedAnimation *self)
 }
 
 
+void
+phoc_timed_animation_set_max_fps (PhocTimedAnimation *self, int max_fps)
+{
+  g_assert (PHOC_IS_TIMED_ANIMATION (self));
+
+  if (self->max_fps == max_fps)
+    return;
+
+  self->max_fps = max_fps;
+
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_MAX_FPS]);
+}
+
+
+int
+phoc_timed_animation_get_max_fps (PhocTimedAnimation *self)
+{
+  g_assert (PHOC_IS_TIMED_ANIMATION (self));
+
+  return self->max_fps;
+}
+
+
 /**
  * phoc_timed_animation_get_animatable:
  * @self: a `PhocTimedAnimation`
@@ -480,13 +810,15 @@ phoc_timed_animation_skip (PhocTimedAnimation *self)
 
   stop_animation (self);
 
-  update_properties (self, self->duration);
+  update_properties (self, get_effective_duration (self));
   self->elapsed_ms = 0;
 
   g_object_thaw_notify (G_OBJECT (self));
 
   g_signal_emit (self, signals[DONE], 0);
-  if (self->dispose_on_done) {
+  if (self->pooled) {
+    release_to_pool (self);
+  } else if (self->dispose_on_done) {
     /* Only do this once */
     self->dispose_on_done = FALSE;
     g_object_unref (self);
@@ -557,3 +889,34 @@ phoc_timed_animation_reset (PhocTimedAnimation *self)
 
   g_object_thaw_notify (G_OBJECT (self));
 }
+
+/**
+ * phoc_timed_animation_set_power_saving:
+ * @enable: Whether to save power
+ *
+ * When saving power animations are shortened and ticked at a lower
+ * frame rate than the output's refresh rate. Each animation picks
+ * this up when it starts playing so running animations keep their
+ * duration and frame rate.
+ */
+void
+phoc_timed_animation_set_power_saving (gboolean enable)
+{
+  power_saving_default = enable;
+}
+
+/**
+ * phoc_timed_animation_get_power_saving:
+ * @self: The animation
+ *
+ * Returns: Whether the animation saves power. This is latched when
+ *   the animation starts playing, see
+ *   [func@TimedAnimation.set_power_saving].
+ */
+gboolean
+phoc_timed_animation_get_power_saving (PhocTimedAnimation *self)
+{
+  g_assert (PHOC_IS_TIMED_ANIMATION (self));
+
+  return self->power_saving;
+}
@@ -21,16 +21,25 @@ G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE (PhocTimedAnimation, phoc_timed_animation, PHOC, TIMED_ANIMATION, GObject)
 
 PhocTimedAnimation   *phoc_timed_animation_new              (void);
+PhocTimedAnimation   *phoc_timed_animation_acquire          (PhocAnimatable     *animatable,
+                                                             GObject            *target,
+                                                             PhocEasing          easing,
+                                                             int                 duration);
+void                  phoc_timed_animation_clear_pool       (void);
 PhocAnimatable       *phoc_timed_animation_get_animatable   (PhocTimedAnimation *self);
 void                  phoc_timed_animation_set_property_easer (PhocTimedAnimation *self,
                                                              PhocPropertyEaser  *prop_easer);
 PhocPropertyEaser    *phoc_timed_animation_get_property_easer (PhocTimedAnimation *self);
 void                  phoc_timed_animation_set_duration     (PhocTimedAnimation *self, int duration);
 int                   phoc_timed_animation_get_duration     (PhocTimedAnimation *self);
+void                  phoc_timed_animation_set_max_fps      (PhocTimedAnimation *self, int max_fps);
+int                   phoc_timed_animation_get_max_fps      (PhocTimedAnimation *self);
 PhocAnimationState    phoc_timed_animation_get_state        (PhocTimedAnimation *self);
 gboolean              phoc_timed_animation_get_dispose_on_done (PhocTimedAnimation *self);
 void                  phoc_timed_animation_play             (PhocTimedAnimation *self);
 void                  phoc_timed_animation_skip             (PhocTimedAnimation *self);
 void                  phoc_timed_animation_reset            (PhocTimedAnimation *self);
+void                  phoc_timed_animation_set_power_saving (gboolean enable);
+gboolean              phoc_timed_animation_get_power_saving (PhocTimedAnimation *self);
 
 G_END_DECLS
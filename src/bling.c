@@ -96,3 +96,18 @@ phoc_bling_is_mapped (PhocBling *self)
 
   return iface->is_mapped (self);
 }
+
+
+gboolean
+phoc_bling_get_rect (PhocBling *self, struct wlr_render_color *color)
+{
+  PhocBlingInterface *iface;
+
+  g_assert (PHOC_IS_BLING (self));
+
+  iface = PHOC_BLING_GET_IFACE (self);
+  if (!iface->get_rect)
+    return FALSE;
+
+  return iface->get_rect (self, color);
+}
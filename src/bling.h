@@ -61,6 +61,18 @@ struct _PhocBlingInterface
    * Returns: %TRUE if the bling is mapped, otherwise %FALSE.
    */
    gboolean      (*is_mapped)  (PhocBling *self);
+  /**
+   * PhocBlingInterface::get_rect:
+   * @self: A bling
+   * @color:(out): The premultiplied color of the rectangle
+   *
+   * Optional. Check whether the bling is a single solid rectangle
+   * filling its box. Such blings don't need to be rendered one by one
+   * but can be batched with other rectangles of the same color.
+   *
+   * Returns: %TRUE if the bling is a solid rectangle, otherwise %FALSE.
+   */
+  gboolean      (*get_rect)   (PhocBling *self, struct wlr_render_color *color);
 };
 
 void                    phoc_bling_render                        (PhocBling    *self,
@@ -69,5 +81,7 @@ PhocBox                 phoc_bling_get_box                       (PhocBling    *
 void                    phoc_bling_map                           (PhocBling    *self);
 void                    phoc_bling_unmap                         (PhocBling    *self);
 gboolean                phoc_bling_is_mapped                     (PhocBling    *self);
+gboolean                phoc_bling_get_rect                      (PhocBling    *self,
+                                                                  struct wlr_render_color *color);
 
 G_END_DECLS
@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-client-budget"
+
+#include "phoc-config.h"
+
+#include "client-budget.h"
+#include "utils.h"
+
+#include <sys/types.h>
+
+#define RATE_INTERVAL_US G_USEC_PER_SEC
+
+/**
+ * PhocClientBudget:
+ *
+ * Limits the compositor side resources a single client can make phoc
+ * allocate: the rate of thumbnail requests, the number of keyboard
+ * event and layer surface effect objects and the memory of the
+ * thumbnails rendered for it. Without limits a misbehaving client can
+ * keep the compositor busy rendering and reading back thumbnails or
+ * grow its memory use without bounds.
+ *
+ * Callers acquire budget before allocating and release it when the
+ * object goes away. When a client is over budget the request is
+ * refused, the caller decides how to tell the client. Rates are
+ * measured over one second intervals like in [class@CommitStats]. A
+ * limit of `0` means unlimited.
+ */
+struct _PhocClientBudget {
+  GObject               parent;
+
+  guint64               limits[PHOC_CLIENT_RESOURCE_LAST];
+  /* wl_client → PhocClientBudgetClient */
+  GHashTable           *clients;
+};
+
+G_DEFINE_TYPE (PhocClientBudget, phoc_client_budget, G_TYPE_OBJECT)
+
+typedef struct {
+  PhocClientBudget      *budget;
+  struct wl_client      *wl_client;
+  struct wl_listener     destroy;
+  char                  *name;
+  pid_t                  pid;
+
+  guint64                usage[PHOC_CLIENT_RESOURCE_LAST];
+  guint64                refused[PHOC_CLIENT_RESOURCE_LAST];
+  gint64                 interval_start_us;
+} PhocClientBudgetClient;
+
+
+static const char *
+resource_to_string (PhocClientResource resource)
+{
+  switch (resource) {
+  case PHOC_CLIENT_RESOURCE_THUMBNAILS:
+    return "thumbnails";
+  case PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS:
+    return "subscriptions";
+  case PHOC_CLIENT_RESOURCE_THUMBNAIL_MEMORY:
+    return "thumbnail-memory";
+  case PHOC_CLIENT_RESOURCE_LAST:
+  default:
+    g_assert_not_reached ();
+  }
+}
+
+
+static gboolean
+resource_is_rate (PhocClientResource resource)
+{
+  return resource == PHOC_CLIENT_RESOURCE_THUMBNAILS;
+}
+
+
+static void
+handle_client_destroy (struct wl_listener *listener, void *data)
+{
+  PhocClientBudgetClient *client = wl_container_of (listener, client, destroy);
+
+  g_hash_table_remove (client->budget->clients, client->wl_client);
+}
+
+
+static void
+phoc_client_budget_client_free (PhocClientBudgetClient *client)
+{
+  wl_list_remove (&client->destroy.link);
+  g_free (client->name);
+  g_free (client);
+}
+
+
+static PhocClientBudgetClient *
+get_client (PhocClientBudget *self, struct wl_client *wl_client)
+{
+  PhocClientBudgetClient *client;
+
+  client = g_hash_table_lookup (self->clients, wl_client);
+  if (client)
+    return client;
+
+  client = g_new0 (PhocClientBudgetClient, 1);
+  client->budget = self;
+  client->wl_client = wl_client;
+  client->name = phoc_utils_get_client_name (wl_client);
+  wl_client_get_credentials (wl_client, &client->pid, NULL, NULL);
+
+  client->destroy.notify = handle_client_destroy;
+  wl_client_add_destroy_listener (wl_client, &client->destroy);
+
+  g_hash_table_insert (self->clients, wl_client, client);
+  return client;
+}
+
+
+static void
+update_rates (PhocClientBudgetClient *client)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (now - client->interval_start_us < RATE_INTERVAL_US)
+    return;
+
+  for (int i = 0; i < PHOC_CLIENT_RESOURCE_LAST; i++) {
+    if (resource_is_rate (i))
+      client->usage[i] = 0;
+  }
+  client->interval_start_us = now;
+}
+
+/**
+ * phoc_client_budget_acquire:
+ * @self: The client budget
+ * @wl_client: The client
+ * @resource: The resource to acquire
+ * @amount: How much of @resource to acquire
+ *
+ * Accounts @amount of @resource to @wl_client unless that would exceed
+ * the client's limit. Resources that aren't rates need to be given
+ * back via [method@ClientBudget.release] when freed.
+ *
+ * Returns: %TRUE if the client was within its budget, %FALSE if the
+ *   request should be refused
+ */
+gboolean
+phoc_client_budget_acquire (PhocClientBudget   *self,
+                            struct wl_client   *wl_client,
+                            PhocClientResource  resource,
+                            guint64             amount)
+{
+  PhocClientBudgetClient *client;
+  guint64 limit;
+
+  g_assert (PHOC_IS_CLIENT_BUDGET (self));
+  g_assert (resource < PHOC_CLIENT_RESOURCE_LAST);
+
+  client = get_client (self, wl_client);
+  update_rates (client);
+
+  limit = self->limits[resource];
+  if (limit && client->usage[resource] + amount > limit) {
+    /* Only warn once per client and resource, refusals can come in bursts */
+    if (client->refused[resource] == 0) {
+      g_warning ("Client %s (pid %d) exceeds its %s budget of %" G_GUINT64_FORMAT,
+                 client->name ?: "unknown", client->pid, resource_to_string (resource), limit);
+    }
+    client->refused[resource]++;
+    return FALSE;
+  }
+
+  client->usage[resource] += amount;
+  return TRUE;
+}
+
+/**
+ * phoc_client_budget_release:
+ * @self: The client budget
+ * @wl_client: The client
+ * @resource: The resource to release
+ * @amount: How much of @resource to release
+ *
+ * Gives back budget acquired via [method@ClientBudget.acquire]. It's
+ * fine to call this while the client is being destroyed.
+ */
+void
+phoc_client_budget_release (PhocClientBudget   *self,
+                            struct wl_client   *wl_client,
+                            PhocClientResource  resource,
+                            guint64             amount)
+{
+  PhocClientBudgetClient *client;
+
+  g_assert (PHOC_IS_CLIENT_BUDGET (self));
+  g_assert (resource < PHOC_CLIENT_RESOURCE_LAST);
+
+  if (resource_is_rate (resource))
+    return;
+
+  /* The client's budget is dropped before its resources are destroyed */
+  client = g_hash_table_lookup (self->clients, wl_client);
+  if (!client)
+    return;
+
+  g_return_if_fail (client->usage[resource] >= amount);
+  client->usage[resource] -= amount;
+}
+
+/**
+ * phoc_client_budget_get_usage:
+ * @self: The client budget
+ * @wl_client: The client
+ * @resource: The resource
+ *
+ * Returns: How much of @resource @wl_client currently holds, for
+ *   rates the usage in the current interval
+ */
+guint64
+phoc_client_budget_get_usage (PhocClientBudget   *self,
+                              struct wl_client   *wl_client,
+                              PhocClientResource  resource)
+{
+  PhocClientBudgetClient *client;
+
+  g_assert (PHOC_IS_CLIENT_BUDGET (self));
+  g_assert (resource < PHOC_CLIENT_RESOURCE_LAST);
+
+  client = g_hash_table_lookup (self->clients, wl_client);
+  if (!client)
+    return 0;
+
+  update_rates (client);
+  return client->usage[resource];
+}
+
+/**
+ * phoc_client_budget_to_variant:
+ * @self: The client budget
+ *
+ * Serializes the budget as `a{sv}` with the `limits` (`a{st}`) and
+ * the `clients` (`aa{sv}`). Each client has a `name` (`s`), `pid`
+ * (`i`), its `usage` (`a{st}`) and how many requests got `refused`
+ * (`a{st}`), both keyed by resource name.
+ *
+ * Returns: (transfer floating): The budget
+ */
+GVariant *
+phoc_client_budget_to_variant (PhocClientBudget *self)
+{
+  PhocClientBudgetClient *client;
+  GVariantBuilder builder, clients, dict;
+  GHashTableIter iter;
+
+  g_assert (PHOC_IS_CLIENT_BUDGET (self));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  g_variant_builder_init (&dict, G_VARIANT_TYPE ("a{st}"));
+  for (int i = 0; i < PHOC_CLIENT_RESOURCE_LAST; i++)
+    g_variant_builder_add (&dict, "{st}", resource_to_string (i), self->limits[i]);
+  g_variant_builder_add (&builder, "{sv}", "limits", g_variant_builder_end (&dict));
+
+  g_variant_builder_init (&clients, G_VARIANT_TYPE ("aa{sv}"));
+  g_hash_table_iter_init (&iter, self->clients);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&client)) {
+    update_rates (client);
+
+    g_variant_builder_open (&clients, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_builder_add (&clients, "{sv}", "name", g_variant_new_string (client->name ?: ""));
+    g_variant_builder_add (&clients, "{sv}", "pid", g_variant_new_int32 (client->pid));
+
+    g_variant_builder_init (&dict, G_VARIANT_TYPE ("a{st}"));
+    for (int i = 0; i < PHOC_CLIENT_RESOURCE_LAST; i++)
+      g_variant_builder_add (&dict, "{st}", resource_to_string (i), client->usage[i]);
+    g_variant_builder_add (&clients, "{sv}", "usage", g_variant_builder_end (&dict));
+
+    g_variant_builder_init (&dict, G_VARIANT_TYPE ("a{st}"));
+    for (int i = 0; i < PHOC_CLIENT_RESOURCE_LAST; i++)
+      g_variant_builder_add (&dict, "{st}", resource_to_string (i), client->refused[i]);
+    g_variant_builder_add (&clients, "{sv}", "refused", g_variant_builder_end (&dict));
+
+    g_variant_builder_close (&clients);
+  }
+  g_variant_builder_add (&builder, "{sv}", "clients", g_variant_builder_end (&clients));
+
+  return g_variant_builder_end (&builder);
+}
+
+
+static void
+phoc_client_budget_finalize (GObject *object)
+{
+  PhocClientBudget *self = PHOC_CLIENT_BUDGET (object);
+
+  g_clear_pointer (&self->clients, g_hash_table_destroy);
+
+  G_OBJECT_CLASS (phoc_client_budget_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_client_budget_class_init (PhocClientBudgetClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_client_budget_finalize;
+}
+
+
+static void
+phoc_client_budget_init (PhocClientBudget *self)
+{
+  self->clients = g_hash_table_new_full (g_direct_hash,
+                                         g_direct_equal,
+                                         NULL,
+                                         (GDestroyNotify)phoc_client_budget_client_free);
+}
+
+/**
+ * phoc_client_budget_new:
+ * @max_thumbnail_rate: Thumbnails a client may request per second
+ * @max_subscriptions: Keyboard event and layer surface effect objects
+ *   a client may hold
+ * @max_thumbnail_memory: Bytes of thumbnails a client may hold
+ *
+ * Limits of `0` disable the corresponding limit.
+ *
+ * Returns: (transfer full): A new client budget
+ */
+PhocClientBudget *
+phoc_client_budget_new (guint   max_thumbnail_rate,
+                        guint   max_subscriptions,
+                        guint64 max_thumbnail_memory)
+{
+  PhocClientBudget *self = g_object_new (PHOC_TYPE_CLIENT_BUDGET, NULL);
+
+  self->limits[PHOC_CLIENT_RESOURCE_THUMBNAILS] = max_thumbnail_rate;
+  self->limits[PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS] = max_subscriptions;
+  self->limits[PHOC_CLIENT_RESOURCE_THUMBNAIL_MEMORY] = max_thumbnail_memory;
+
+  return self;
+}
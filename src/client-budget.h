@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <wayland-server-core.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PhocClientResource:
+ * @PHOC_CLIENT_RESOURCE_THUMBNAILS: Thumbnail requests per second
+ * @PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS: Live keyboard event and layer
+ *   surface effect objects
+ * @PHOC_CLIENT_RESOURCE_THUMBNAIL_MEMORY: Bytes of thumbnail buffers
+ *   rendered on behalf of the client, be it into shared memory or
+ *   dmabufs
+ * @PHOC_CLIENT_RESOURCE_LAST: The number of resources
+ *
+ * The resources a client is budgeted for. Thumbnails are a rate, the
+ * others are held until released.
+ */
+typedef enum {
+  PHOC_CLIENT_RESOURCE_THUMBNAILS = 0,
+  PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS,
+  PHOC_CLIENT_RESOURCE_THUMBNAIL_MEMORY,
+  PHOC_CLIENT_RESOURCE_LAST,
+} PhocClientResource;
+
+#define PHOC_TYPE_CLIENT_BUDGET (phoc_client_budget_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocClientBudget, phoc_client_budget, PHOC, CLIENT_BUDGET, GObject)
+
+PhocClientBudget *phoc_client_budget_new       (guint               max_thumbnail_rate,
+                                                guint               max_subscriptions,
+                                                guint64             max_thumbnail_memory);
+gboolean          phoc_client_budget_acquire   (PhocClientBudget   *self,
+                                                struct wl_client   *wl_client,
+                                                PhocClientResource  resource,
+                                                guint64             amount);
+void              phoc_client_budget_release   (PhocClientBudget   *self,
+                                                struct wl_client   *wl_client,
+                                                PhocClientResource  resource,
+                                                guint64             amount);
+guint64           phoc_client_budget_get_usage (PhocClientBudget   *self,
+                                                struct wl_client   *wl_client,
+                                                PhocClientResource  resource);
+GVariant         *phoc_client_budget_to_variant (PhocClientBudget  *self);
+
+G_END_DECLS
@@ -190,16 +190,14 @@ bling_render (PhocBling *bling, PhocRenderContext *ctx)
   struct wlr_box box = self->box;
   box.x -= ctx->output->lx;
   box.y -= ctx->output->ly;
-  phoc_utils_scale_box (&box, ctx->output->wlr_output->scale);
+  phoc_utils_scale_box (&box, ctx->scale);
+  phoc_output_transform_box (ctx->output, &box);
 
-  if (!phoc_utils_is_damaged (&box, ctx->damage, NULL, &damage)) {
+  if (!phoc_utils_is_damaged (&box, ctx->buffer_damage, NULL, &damage)) {
     pixman_region32_fini (&damage);
     return;
   }
 
-  phoc_output_transform_damage (ctx->output, &damage);
-  phoc_output_transform_box (ctx->output, &box);
-
   wlr_render_pass_add_rect (ctx->render_pass, &(struct wlr_render_rect_options){
       .box = box,
       .color = {
@@ -252,6 +250,25 @@ bling_is_mapped (PhocBling *bling)
 }
 
 
+static gboolean
+bling_get_rect (PhocBling *bling, struct wlr_render_color *color)
+{
+  PhocColorRect *self = PHOC_COLOR_RECT (bling);
+
+  if (!self->mapped)
+    return FALSE;
+
+  *color = (struct wlr_render_color) {
+    .r = self->color.red * self->color.alpha,
+    .g = self->color.green * self->color.alpha,
+    .b = self->color.blue * self->color.alpha,
+    .a = self->color.alpha,
+  };
+
+  return TRUE;
+}
+
+
 static void
 bling_interface_init (PhocBlingInterface *iface)
 {
@@ -260,6 +277,7 @@ bling_interface_init (PhocBlingInterface *iface)
   iface->map = bling_map;
   iface->unmap = bling_unmap;
   iface->is_mapped = bling_is_mapped;
+  iface->get_rect = bling_get_rect;
 }
 
 
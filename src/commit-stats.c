@@ -0,0 +1,581 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-commit-stats"
+
+#include "phoc-config.h"
+
+#include "commit-stats.h"
+#include "layer-surface.h"
+#include "output.h"
+#include "server.h"
+#include "utils.h"
+#include "view.h"
+
+#include <sys/types.h>
+#include <wlr/types/wlr_buffer.h>
+
+#define COMMIT_RATE_INTERVAL_US G_USEC_PER_SEC
+
+/**
+ * PhocCommitStats:
+ *
+ * Counts commits per client and per surface owner like views and
+ * layer surfaces to find clients that commit or damage more than
+ * needed and so drain the battery.
+ *
+ * For each commit the buffer damage is accounted and whether it
+ * covered the whole buffer. Commit rates are measured over one
+ * second intervals like memory upload rates in
+ * [class@MemoryStats]. Owners are fed from their surface commit
+ * handlers so only the toplevel surface of a view is accounted.
+ *
+ * For each client it's also measured how long committed buffers are
+ * held until they're released. SHM buffers are released as soon as
+ * their content got copied into a texture while e.g. dmabufs are held
+ * until they're replaced and no longer on screen. Long hold times
+ * force clients to allocate more buffers.
+ */
+struct _PhocCommitStats {
+  GObject               parent;
+
+  /* wl_client → PhocCommitStatsClient */
+  GHashTable           *clients;
+  /* view or layer surface (weak) → PhocCommitStatsCounter */
+  GHashTable           *owners;
+};
+
+G_DEFINE_TYPE (PhocCommitStats, phoc_commit_stats, G_TYPE_OBJECT)
+
+typedef struct {
+  guint64             commits;
+  guint64             damaged_pixels;
+  guint64             full_damage_commits;
+  guint32             buffer_width;
+  guint32             buffer_height;
+
+  guint               commit_rate;
+  guint               interval_commits;
+  gint64              interval_start_us;
+} PhocCommitStatsCounter;
+
+typedef struct {
+  PhocCommitStats        *stats;
+  struct wl_client       *wl_client;
+  struct wl_listener      destroy;
+  char                   *name;
+  pid_t                   pid;
+
+  PhocCommitStatsCounter  counter;
+
+  /* PhocCommitStatsHeldBuffer::link */
+  struct wl_list          held_buffers;
+  guint64                 released_buffers;
+  gint64                  hold_total_us;
+  gint64                  hold_max_us;
+} PhocCommitStatsClient;
+
+/* A committed buffer that wasn't released yet */
+typedef struct {
+  PhocCommitStatsClient  *client;
+  struct wlr_buffer      *buffer;
+  struct wl_listener      release;
+  struct wl_listener      destroy;
+  struct wl_list          link;
+  gint64                  commit_us;
+} PhocCommitStatsHeldBuffer;
+
+
+static void
+counter_record (PhocCommitStatsCounter *counter, struct wlr_surface *surface, gint64 now)
+{
+  struct wlr_client_buffer *buffer = surface->buffer;
+  gint64 elapsed_us;
+  guint64 damaged;
+
+  if (!counter->interval_start_us)
+    counter->interval_start_us = now;
+
+  counter->commits++;
+  counter->interval_commits++;
+
+  if (buffer) {
+    counter->buffer_width = buffer->base.width;
+    counter->buffer_height = buffer->base.height;
+  }
+
+  if (surface->current.committed & WLR_SURFACE_STATE_BUFFER) {
+    guint64 buffer_area = (guint64)counter->buffer_width * counter->buffer_height;
+
+    damaged = phoc_utils_region_area (&surface->buffer_damage);
+    counter->damaged_pixels += damaged;
+    if (buffer_area && damaged >= buffer_area)
+      counter->full_damage_commits++;
+  }
+
+  elapsed_us = now - counter->interval_start_us;
+  if (elapsed_us < COMMIT_RATE_INTERVAL_US)
+    return;
+
+  /* A client that stopped committing for several intervals is idle */
+  if (elapsed_us > 2 * COMMIT_RATE_INTERVAL_US)
+    counter->commit_rate = 0;
+  else
+    counter->commit_rate = counter->interval_commits * G_USEC_PER_SEC / elapsed_us;
+
+  counter->interval_commits = 0;
+  counter->interval_start_us = now;
+}
+
+
+static void
+counter_get_info (PhocCommitStatsCounter *counter, PhocCommitStatsInfo *info)
+{
+  gint64 elapsed_us = g_get_monotonic_time () - counter->interval_start_us;
+
+  *info = (PhocCommitStatsInfo) {
+    .commits = counter->commits,
+    /* Don't report a stale rate for clients that stopped committing */
+    .commit_rate = elapsed_us > 2 * COMMIT_RATE_INTERVAL_US ? 0 : counter->commit_rate,
+    .damage_per_commit = counter->commits ? counter->damaged_pixels / counter->commits : 0,
+    .full_damage_percent = counter->commits ?
+      counter->full_damage_commits * 100 / counter->commits : 0,
+    .buffer_width = counter->buffer_width,
+    .buffer_height = counter->buffer_height,
+  };
+}
+
+
+static void
+info_to_variant (GVariantBuilder *builder, PhocCommitStatsInfo *info)
+{
+  g_variant_builder_add (builder, "{sv}", "commits", g_variant_new_uint64 (info->commits));
+  g_variant_builder_add (builder, "{sv}", "commit-rate", g_variant_new_uint32 (info->commit_rate));
+  g_variant_builder_add (builder, "{sv}", "damage-per-commit",
+                         g_variant_new_uint64 (info->damage_per_commit));
+  g_variant_builder_add (builder, "{sv}", "full-damage-percent",
+                         g_variant_new_uint32 (info->full_damage_percent));
+  g_variant_builder_add (builder, "{sv}", "buffer-width", g_variant_new_uint32 (info->buffer_width));
+  g_variant_builder_add (builder, "{sv}", "buffer-height",
+                         g_variant_new_uint32 (info->buffer_height));
+}
+
+
+static void
+held_buffer_free (PhocCommitStatsHeldBuffer *held)
+{
+  wl_list_remove (&held->release.link);
+  wl_list_remove (&held->destroy.link);
+  wl_list_remove (&held->link);
+  g_free (held);
+}
+
+
+static void
+client_add_hold_time (PhocCommitStatsClient *client, gint64 hold_us)
+{
+  client->released_buffers++;
+  client->hold_total_us += hold_us;
+  client->hold_max_us = MAX (client->hold_max_us, hold_us);
+}
+
+
+static void
+handle_held_buffer_release (struct wl_listener *listener, void *data)
+{
+  PhocCommitStatsHeldBuffer *held = wl_container_of (listener, held, release);
+
+  client_add_hold_time (held->client, g_get_monotonic_time () - held->commit_us);
+  held_buffer_free (held);
+}
+
+
+static void
+handle_held_buffer_destroy (struct wl_listener *listener, void *data)
+{
+  PhocCommitStatsHeldBuffer *held = wl_container_of (listener, held, destroy);
+
+  held_buffer_free (held);
+}
+
+
+static void
+client_track_buffer (PhocCommitStatsClient *client, struct wlr_surface *surface, gint64 now)
+{
+  PhocCommitStatsHeldBuffer *held;
+  struct wlr_buffer *buffer;
+
+  if (!(surface->current.committed & WLR_SURFACE_STATE_BUFFER) || !surface->buffer)
+    return;
+
+  /* SHM buffers got released right after the upload already */
+  buffer = surface->buffer->source;
+  if (!buffer || buffer->n_locks == 0) {
+    client_add_hold_time (client, 0);
+    return;
+  }
+
+  wl_list_for_each (held, &client->held_buffers, link) {
+    if (held->buffer == buffer)
+      return;
+  }
+
+  held = g_new0 (PhocCommitStatsHeldBuffer, 1);
+  held->client = client;
+  held->buffer = buffer;
+  held->commit_us = now;
+  held->release.notify = handle_held_buffer_release;
+  wl_signal_add (&buffer->events.release, &held->release);
+  held->destroy.notify = handle_held_buffer_destroy;
+  wl_signal_add (&buffer->events.destroy, &held->destroy);
+  wl_list_insert (&client->held_buffers, &held->link);
+}
+
+
+static void
+handle_client_destroy (struct wl_listener *listener, void *data)
+{
+  PhocCommitStatsClient *client = wl_container_of (listener, client, destroy);
+
+  g_hash_table_remove (client->stats->clients, client->wl_client);
+}
+
+
+static void
+phoc_commit_stats_client_free (PhocCommitStatsClient *client)
+{
+  PhocCommitStatsHeldBuffer *held, *tmp;
+
+  wl_list_for_each_safe (held, tmp, &client->held_buffers, link)
+    held_buffer_free (held);
+  wl_list_remove (&client->destroy.link);
+  g_free (client->name);
+  g_free (client);
+}
+
+
+static PhocCommitStatsClient *
+get_client (PhocCommitStats *self, struct wl_client *wl_client)
+{
+  PhocCommitStatsClient *client;
+
+  client = g_hash_table_lookup (self->clients, wl_client);
+  if (client)
+    return client;
+
+  client = g_new0 (PhocCommitStatsClient, 1);
+  client->stats = self;
+  client->wl_client = wl_client;
+  client->name = phoc_utils_get_client_name (wl_client);
+  wl_client_get_credentials (wl_client, &client->pid, NULL, NULL);
+  wl_list_init (&client->held_buffers);
+
+  client->destroy.notify = handle_client_destroy;
+  wl_client_add_destroy_listener (wl_client, &client->destroy);
+
+  g_hash_table_insert (self->clients, wl_client, client);
+  return client;
+}
+
+
+static void
+on_owner_finalized (gpointer data, GObject *where_the_object_was)
+{
+  PhocCommitStats *self = PHOC_COMMIT_STATS (data);
+
+  g_hash_table_remove (self->owners, where_the_object_was);
+}
+
+
+static PhocCommitStatsCounter *
+get_owner_counter (PhocCommitStats *self, GObject *owner)
+{
+  PhocCommitStatsCounter *counter;
+
+  counter = g_hash_table_lookup (self->owners, owner);
+  if (counter)
+    return counter;
+
+  counter = g_new0 (PhocCommitStatsCounter, 1);
+  g_object_weak_ref (owner, on_owner_finalized, self);
+  g_hash_table_insert (self->owners, owner, counter);
+
+  return counter;
+}
+
+/**
+ * phoc_commit_stats_record:
+ * @self: The commit stats
+ * @surface: The surface that got committed
+ * @owner: (nullable): The view or layer surface @surface belongs to
+ *
+ * Accounts a commit of @surface to its client and @owner.
+ */
+void
+phoc_commit_stats_record (PhocCommitStats *self, struct wlr_surface *surface, GObject *owner)
+{
+  PhocTimelineTrace *timeline = phoc_server_get_timeline_trace (phoc_server_get_default ());
+  PhocCommitStatsClient *client;
+  gint64 now = g_get_monotonic_time ();
+
+  g_assert (PHOC_IS_COMMIT_STATS (self));
+
+  client = get_client (self, wl_resource_get_client (surface->resource));
+  counter_record (&client->counter, surface, now);
+  client_track_buffer (client, surface, now);
+  if (G_UNLIKELY (timeline))
+    phoc_timeline_trace_add_instant (timeline, "commits", client->name, now);
+
+  if (owner)
+    counter_record (get_owner_counter (self, owner), surface, now);
+}
+
+/**
+ * phoc_commit_stats_get_owner_info:
+ * @self: The commit stats
+ * @owner: The view or layer surface
+ * @info: (out): The commit statistics
+ *
+ * Returns: %TRUE if @owner committed before and @info was filled in
+ */
+gboolean
+phoc_commit_stats_get_owner_info (PhocCommitStats     *self,
+                                  GObject             *owner,
+                                  PhocCommitStatsInfo *info)
+{
+  PhocCommitStatsCounter *counter;
+
+  g_assert (PHOC_IS_COMMIT_STATS (self));
+
+  counter = g_hash_table_lookup (self->owners, owner);
+  if (!counter)
+    return FALSE;
+
+  counter_get_info (counter, info);
+  return TRUE;
+}
+
+/**
+ * phoc_commit_stats_get_client_info:
+ * @self: The commit stats
+ * @wl_client: The client
+ * @info: (out): The commit statistics
+ *
+ * Returns: %TRUE if @wl_client committed before and @info was filled in
+ */
+gboolean
+phoc_commit_stats_get_client_info (PhocCommitStats     *self,
+                                   struct wl_client    *wl_client,
+                                   PhocCommitStatsInfo *info)
+{
+  PhocCommitStatsClient *client;
+
+  g_assert (PHOC_IS_COMMIT_STATS (self));
+
+  client = g_hash_table_lookup (self->clients, wl_client);
+  if (!client)
+    return FALSE;
+
+  counter_get_info (&client->counter, info);
+  return TRUE;
+}
+
+
+/**
+ * phoc_commit_stats_reset:
+ * @self: The commit stats
+ *
+ * Drops the statistics of all clients, views and layer surfaces.
+ */
+void
+phoc_commit_stats_reset (PhocCommitStats *self)
+{
+  PhocCommitStatsCounter *counter;
+  PhocCommitStatsClient *client;
+  GHashTableIter iter;
+
+  g_assert (PHOC_IS_COMMIT_STATS (self));
+
+  g_hash_table_iter_init (&iter, self->clients);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&client)) {
+    client->counter = (PhocCommitStatsCounter) { 0 };
+    client->released_buffers = 0;
+    client->hold_total_us = 0;
+    client->hold_max_us = 0;
+  }
+
+  g_hash_table_iter_init (&iter, self->owners);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&counter))
+    *counter = (PhocCommitStatsCounter) { 0 };
+}
+
+
+static GVariant *
+clients_to_variant (PhocCommitStats *self)
+{
+  PhocCommitStatsClient *client;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+
+  g_hash_table_iter_init (&iter, self->clients);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&client)) {
+    PhocCommitStatsInfo info;
+
+    counter_get_info (&client->counter, &info);
+
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_builder_add (&builder, "{sv}", "name", g_variant_new_string (client->name ?: ""));
+    g_variant_builder_add (&builder, "{sv}", "pid", g_variant_new_int32 (client->pid));
+    info_to_variant (&builder, &info);
+    g_variant_builder_add (&builder, "{sv}", "buffer-hold-avg-us",
+                           g_variant_new_int64 (client->released_buffers ?
+                                                client->hold_total_us / client->released_buffers : 0));
+    g_variant_builder_add (&builder, "{sv}", "buffer-hold-max-us",
+                           g_variant_new_int64 (client->hold_max_us));
+    g_variant_builder_add (&builder, "{sv}", "held-buffers",
+                           g_variant_new_uint32 (wl_list_length (&client->held_buffers)));
+    g_variant_builder_close (&builder);
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+
+static GVariant *
+views_to_variant (PhocCommitStats *self, PhocDesktop *desktop)
+{
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+
+  for (GList *l = phoc_desktop_get_views (desktop)->head; l; l = l->next) {
+    PhocView *view = PHOC_VIEW (l->data);
+    PhocCommitStatsInfo info;
+
+    if (!phoc_commit_stats_get_owner_info (self, G_OBJECT (view), &info))
+      continue;
+
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_builder_add (&builder, "{sv}", "app-id",
+                           g_variant_new_string (phoc_view_get_app_id (view) ?: ""));
+    info_to_variant (&builder, &info);
+    g_variant_builder_close (&builder);
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+
+static GVariant *
+layer_surfaces_to_variant (PhocCommitStats *self, PhocDesktop *desktop)
+{
+  GVariantBuilder builder;
+  PhocOutput *output;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+
+  wl_list_for_each (output, &desktop->outputs, link) {
+    PhocLayerSurface *layer_surface;
+
+    wl_list_for_each (layer_surface, &output->layer_surfaces, link) {
+      PhocCommitStatsInfo info;
+
+      if (!phoc_commit_stats_get_owner_info (self, G_OBJECT (layer_surface), &info))
+        continue;
+
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{sv}"));
+      g_variant_builder_add (&builder, "{sv}", "namespace",
+                             g_variant_new_string (phoc_layer_surface_get_namespace (layer_surface) ?: ""));
+      g_variant_builder_add (&builder, "{sv}", "output",
+                             g_variant_new_string (output->wlr_output->name));
+      info_to_variant (&builder, &info);
+      g_variant_builder_close (&builder);
+    }
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * phoc_commit_stats_to_variant:
+ * @self: The commit stats
+ *
+ * Serializes the statistics as `a{sv}` with `clients`, `views` and
+ * `layer-surfaces` (`aa{sv}`). Each entry holds `commits` (`t`),
+ * `commit-rate` (`u`) in commits per second, `damage-per-commit`
+ * (`t`) in pixels, `full-damage-percent` (`u`) and the last buffer
+ * size as `buffer-width` and `buffer-height` (`u`). Clients
+ * additionally have a `name` (`s`) and `pid` (`i`), views an `app-id`
+ * (`s`) and layer surfaces a `namespace` (`s`) and `output` (`s`).
+ *
+ * Returns: (transfer floating): The statistics
+ */
+GVariant *
+phoc_commit_stats_to_variant (PhocCommitStats *self)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  GVariantBuilder builder;
+
+  g_assert (PHOC_IS_COMMIT_STATS (self));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "clients", clients_to_variant (self));
+  g_variant_builder_add (&builder, "{sv}", "views", views_to_variant (self, desktop));
+  g_variant_builder_add (&builder, "{sv}", "layer-surfaces",
+                         layer_surfaces_to_variant (self, desktop));
+
+  return g_variant_builder_end (&builder);
+}
+
+
+static void
+phoc_commit_stats_finalize (GObject *object)
+{
+  PhocCommitStats *self = PHOC_COMMIT_STATS (object);
+  GHashTableIter iter;
+  GObject *owner;
+
+  g_hash_table_iter_init (&iter, self->owners);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&owner, NULL))
+    g_object_weak_unref (owner, on_owner_finalized, self);
+  g_clear_pointer (&self->owners, g_hash_table_destroy);
+  g_clear_pointer (&self->clients, g_hash_table_destroy);
+
+  G_OBJECT_CLASS (phoc_commit_stats_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_commit_stats_class_init (PhocCommitStatsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_commit_stats_finalize;
+}
+
+
+static void
+phoc_commit_stats_init (PhocCommitStats *self)
+{
+  self->clients = g_hash_table_new_full (g_direct_hash,
+                                         g_direct_equal,
+                                         NULL,
+                                         (GDestroyNotify)phoc_commit_stats_client_free);
+  self->owners = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+}
+
+/**
+ * phoc_commit_stats_new:
+ *
+ * Returns: (transfer full): A new commit statistics object
+ */
+PhocCommitStats *
+phoc_commit_stats_new (void)
+{
+  return g_object_new (PHOC_TYPE_COMMIT_STATS, NULL);
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <wlr/types/wlr_compositor.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PhocCommitStatsInfo:
+ * @commits: The number of commits
+ * @commit_rate: Commits per second over the last interval
+ * @damage_per_commit: Average damaged buffer pixels per commit
+ * @full_damage_percent: Percentage of commits that damaged the whole buffer
+ * @buffer_width: The width of the last committed buffer
+ * @buffer_height: The height of the last committed buffer
+ *
+ * Commit statistics of a client or a surface owner like a view.
+ */
+typedef struct _PhocCommitStatsInfo {
+  guint64 commits;
+  guint   commit_rate;
+  guint64 damage_per_commit;
+  guint   full_damage_percent;
+  guint32 buffer_width;
+  guint32 buffer_height;
+} PhocCommitStatsInfo;
+
+#define PHOC_TYPE_COMMIT_STATS (phoc_commit_stats_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocCommitStats, phoc_commit_stats, PHOC, COMMIT_STATS, GObject)
+
+PhocCommitStats *phoc_commit_stats_new            (void);
+void             phoc_commit_stats_record         (PhocCommitStats     *self,
+                                                   struct wlr_surface  *surface,
+                                                   GObject             *owner);
+gboolean         phoc_commit_stats_get_owner_info (PhocCommitStats     *self,
+                                                   GObject             *owner,
+                                                   PhocCommitStatsInfo *info);
+gboolean         phoc_commit_stats_get_client_info (PhocCommitStats    *self,
+                                                    struct wl_client   *wl_client,
+                                                    PhocCommitStatsInfo *info);
+void             phoc_commit_stats_reset          (PhocCommitStats     *self);
+GVariant        *phoc_commit_stats_to_variant     (PhocCommitStats     *self);
+
+G_END_DECLS
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-cursor-image-cache"
+
+#include "phoc-config.h"
+
+#include "cursor-image-cache.h"
+
+#include <drm_fourcc.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/xcursor.h>
+
+/**
+ * PhocCursorImageCache:
+ *
+ * Keeps the buffers of the theme cursors that were shown so far,
+ * keyed by cursor name and scale. Without it every change of the
+ * cursor shape, every frame of an animated cursor and every move to
+ * an output with a different scale wraps the theme's pixels into a
+ * new buffer that then needs to be uploaded again.
+ *
+ * The buffers reference the pixel data of the cursor theme so the
+ * cache needs to be cleared before the theme goes away.
+ */
+struct _PhocCursorImageCache {
+  GHashTable *images;
+};
+
+typedef struct {
+  struct wlr_buffer         base;
+  struct wlr_xcursor_image *image; /* unowned */
+} PhocCursorBuffer;
+
+
+static void
+cursor_buffer_destroy (struct wlr_buffer *wlr_buffer)
+{
+  PhocCursorBuffer *buffer = wl_container_of (wlr_buffer, buffer, base);
+
+  g_free (buffer);
+}
+
+
+static bool
+cursor_buffer_begin_data_ptr_access (struct wlr_buffer *wlr_buffer,
+                                     uint32_t           flags,
+                                     void             **data,
+                                     uint32_t          *format,
+                                     size_t            *stride)
+{
+  PhocCursorBuffer *buffer = wl_container_of (wlr_buffer, buffer, base);
+
+  /* The pixels belong to the cursor theme */
+  if (flags & WLR_BUFFER_DATA_PTR_ACCESS_WRITE)
+    return false;
+
+  *data = buffer->image->buffer;
+  *format = DRM_FORMAT_ARGB8888;
+  *stride = buffer->image->width * 4;
+
+  return true;
+}
+
+
+static void
+cursor_buffer_end_data_ptr_access (struct wlr_buffer *wlr_buffer)
+{
+}
+
+
+static const struct wlr_buffer_impl cursor_buffer_impl = {
+  .destroy = cursor_buffer_destroy,
+  .begin_data_ptr_access = cursor_buffer_begin_data_ptr_access,
+  .end_data_ptr_access = cursor_buffer_end_data_ptr_access,
+};
+
+
+static struct wlr_buffer *
+cursor_buffer_new (struct wlr_xcursor_image *image)
+{
+  PhocCursorBuffer *buffer = g_new0 (PhocCursorBuffer, 1);
+
+  wlr_buffer_init (&buffer->base, &cursor_buffer_impl, image->width, image->height);
+  buffer->image = image;
+
+  return &buffer->base;
+}
+
+
+static void
+cursor_image_free (PhocCursorImage *image)
+{
+  for (guint i = 0; i < image->n_frames; i++)
+    wlr_buffer_drop (image->frames[i].buffer);
+
+  g_free (image->frames);
+  g_free (image);
+}
+
+
+static PhocCursorImage *
+cursor_image_new (struct wlr_xcursor *xcursor, float scale)
+{
+  PhocCursorImage *image = g_new0 (PhocCursorImage, 1);
+
+  image->scale = scale;
+  image->n_frames = xcursor->image_count;
+  image->frames = g_new0 (PhocCursorFrame, image->n_frames);
+
+  for (guint i = 0; i < image->n_frames; i++) {
+    struct wlr_xcursor_image *xcursor_image = xcursor->images[i];
+
+    image->frames[i] = (PhocCursorFrame) {
+      .buffer = cursor_buffer_new (xcursor_image),
+      .hotspot_x = xcursor_image->hotspot_x,
+      .hotspot_y = xcursor_image->hotspot_y,
+      .delay_ms = xcursor_image->delay,
+    };
+  }
+
+  return image;
+}
+
+
+PhocCursorImageCache *
+phoc_cursor_image_cache_new (void)
+{
+  PhocCursorImageCache *self = g_new0 (PhocCursorImageCache, 1);
+
+  self->images = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify) cursor_image_free);
+
+  return self;
+}
+
+
+void
+phoc_cursor_image_cache_free (PhocCursorImageCache *self)
+{
+  g_hash_table_destroy (self->images);
+  g_free (self);
+}
+
+/**
+ * phoc_cursor_image_cache_clear:
+ * @self: The cursor image cache
+ *
+ * Drop all cached images. This must be called before the cursor theme
+ * the images were loaded from is destroyed.
+ */
+void
+phoc_cursor_image_cache_clear (PhocCursorImageCache *self)
+{
+  g_hash_table_remove_all (self->images);
+}
+
+/**
+ * phoc_cursor_image_cache_lookup:
+ * @self: The cursor image cache
+ * @manager: The cursor theme manager
+ * @name: The cursor's name
+ * @scale: The scale of the output the cursor is shown on
+ *
+ * Look up a cursor from the theme, loading it on first use.
+ *
+ * Returns:(nullable): The cursor image or %NULL if the theme lacks the cursor
+ */
+const PhocCursorImage *
+phoc_cursor_image_cache_lookup (PhocCursorImageCache       *self,
+                                struct wlr_xcursor_manager *manager,
+                                const char                 *name,
+                                float                       scale)
+{
+  g_autofree char *key = g_strdup_printf ("%s@%.3f", name, scale);
+  struct wlr_xcursor *xcursor;
+  PhocCursorImage *image;
+
+  image = g_hash_table_lookup (self->images, key);
+  if (image)
+    return image;
+
+  /* No-op if the theme is loaded at that scale already */
+  if (!wlr_xcursor_manager_load (manager, scale))
+    return NULL;
+
+  xcursor = wlr_xcursor_manager_get_xcursor (manager, name, scale);
+  if (xcursor == NULL || xcursor->image_count == 0)
+    return NULL;
+
+  image = cursor_image_new (xcursor, scale);
+  g_hash_table_insert (self->images, g_steal_pointer (&key), image);
+
+  return image;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_xcursor_manager.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PhocCursorFrame:
+ * @buffer: The frame's image
+ * @hotspot_x: The hotspot's x coordinate in buffer pixels
+ * @hotspot_y: The hotspot's y coordinate in buffer pixels
+ * @delay_ms: How long to show the frame in animated cursors
+ *
+ * A single frame of a cursor image.
+ */
+typedef struct _PhocCursorFrame {
+  struct wlr_buffer *buffer;
+  int32_t            hotspot_x;
+  int32_t            hotspot_y;
+  guint              delay_ms;
+} PhocCursorFrame;
+
+/**
+ * PhocCursorImage:
+ * @scale: The scale the images were loaded for
+ * @n_frames: The number of frames, more than one for animated cursors
+ * @frames: The frames
+ *
+ * A cursor from the cursor theme at a given scale.
+ */
+typedef struct _PhocCursorImage {
+  float            scale;
+  guint            n_frames;
+  PhocCursorFrame *frames;
+} PhocCursorImage;
+
+typedef struct _PhocCursorImageCache PhocCursorImageCache;
+
+PhocCursorImageCache  *phoc_cursor_image_cache_new    (void);
+void                   phoc_cursor_image_cache_free   (PhocCursorImageCache       *self);
+void                   phoc_cursor_image_cache_clear  (PhocCursorImageCache       *self);
+const PhocCursorImage *phoc_cursor_image_cache_lookup (PhocCursorImageCache       *self,
+                                                       struct wlr_xcursor_manager *manager,
+                                                       const char                 *name,
+                                                       float                       scale);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocCursorImageCache, phoc_cursor_image_cache_free)
+
+G_END_DECLS
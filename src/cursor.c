@@ -8,12 +8,15 @@
 #define G_LOG_DOMAIN "phoc-cursor"
 
 #include "phoc-config.h"
+#include "phoc-tracing.h"
 #include "color-rect.h"
+#include "cursor-image-cache.h"
 #include "server.h"
 #include "timed-animation.h"
 #include "gesture.h"
 #include "gesture-drag.h"
 #include "gesture-swipe.h"
+#include "gesture-zoom.h"
 #include "layer-shell-effects.h"
 
 #define _XOPEN_SOURCE 700
@@ -29,12 +32,18 @@
 #include "cursor.h"
 #include "desktop.h"
 #include "input-method-relay.h"
+#include "log.h"
 #include "utils.h"
 #include "view.h"
 
 #define PHOC_ANIM_SUGGEST_STATE_CHANGE_COLOR    (PhocColor){0.0f, 0.6f, 1.0f, 0.5f}
 #define PHOC_ANIM_DURATION_SUGGEST_STATE_CHANGE 200
 
+/* Don't extrapolate from samples further apart than this */
+#define PHOC_TOUCH_RESAMPLE_MAX_GAP_MS     20
+/* Don't predict further ahead than this */
+#define PHOC_TOUCH_RESAMPLE_MAX_PREDICT_MS 8
+
 enum {
   PROP_0,
   PROP_SEAT,
@@ -42,16 +51,54 @@ enum {
 };
 static GParamSpec *props[PROP_LAST_PROP];
 
+/* Touch screens track at most 10 fingers, further touch points are ignored */
+#define PHOC_CURSOR_MAX_TOUCH_POINTS 10
+#define PHOC_CURSOR_TOUCH_SLOTS_FULL ((1u << PHOC_CURSOR_MAX_TOUCH_POINTS) - 1)
+
+/* Touch motion waiting for the next output frame */
+typedef struct {
+  struct wlr_touch_motion_event event;
+  /* The previous sample within the same frame, used for resampling */
+  double                        prev_x, prev_y;
+  guint32                       prev_time_msec;
+  gboolean                      has_prev;
+} PhocPendingTouchMotion;
+
 typedef struct _PhocCursorPrivate {
   /* Would be good to store on the surface itself */
   PhocDraggableLayerSurface *drag_surface;
   GSList                    *gestures;
 
-  /* The compositor tracked touch points */
-  GHashTable                *touch_points;
+  /* The compositor tracked touch points, used slots are set in the bitmap */
+  PhocTouchPoint             touch_points[PHOC_CURSOR_MAX_TOUCH_POINTS];
+  guint32                    touch_points_active;
+
+  /* Touch motion coalesced until the next output frame */
+  PhocTouchMotionMode        touch_motion_mode;
+  GArray                    *pending_motions;
+  PhocOutput                *touch_flush_output;
+  guint                      touch_flush_id;
+  /* Clients got touch down or up since the last touch frame */
+  gboolean                   touch_frame_needed;
+  /* A touch frame is held back until pending motion is flushed */
+  gboolean                   touch_frame_deferred;
 
   gboolean                   has_pointer_motion;
 
+  /* Pointer focus updates coalesced until the next output frame */
+  PhocPointerMotionMode      pointer_motion_mode;
+  gboolean                   pointer_update_pending;
+  guint32                    pointer_update_time;
+  PhocOutput                *pointer_flush_output;
+  guint                      pointer_flush_id;
+  /* Clients got button or axis events since the last pointer frame */
+  gboolean                   pointer_frame_needed;
+  /* A pointer frame is held back until the pending update is flushed */
+  gboolean                   pointer_frame_deferred;
+
+  /* Magnifier zoom level when the pinch gesture began */
+  double                     magnifier_zoom_begin;
+
   /* State of the animated view when cursor touches a screen edge */
   struct {
     PhocColorRect         *rect;
@@ -62,6 +109,9 @@ typedef struct _PhocCursorPrivate {
     PhocTimedAnimation    *anim;
   } view_state;
 
+  /* The view moved by the current move grab */
+  PhocView                  *move_view;
+
   /* The cursor */
   PhocCursorMode              mode;
   struct wl_client           *image_client;
@@ -71,6 +121,12 @@ typedef struct _PhocCursorPrivate {
   int32_t                     hotspot_x;
   int32_t                     hotspot_y;
   struct wlr_xcursor_manager *xcursor_manager;
+  PhocCursorImageCache       *image_cache;
+  /* The theme cursor currently shown */
+  char                       *xcursor_name;
+  const PhocCursorImage      *xcursor_image;
+  guint                       xcursor_frame;
+  guint                       xcursor_frame_id;
   GSettings                  *interface_settings;
 } PhocCursorPrivate;
 
@@ -88,6 +144,100 @@ static void handle_touch_frame (struct wl_listener *listener, void *data);
 
 /* {{{ Cursor image */
 
+static void
+phoc_cursor_show_xcursor_frame (PhocCursor *self);
+
+
+static gboolean
+on_xcursor_frame_timeout (gpointer data)
+{
+  PhocCursor *self = PHOC_CURSOR (data);
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+
+  priv->xcursor_frame_id = 0;
+  priv->xcursor_frame = (priv->xcursor_frame + 1) % priv->xcursor_image->n_frames;
+  phoc_cursor_show_xcursor_frame (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+phoc_cursor_show_xcursor_frame (PhocCursor *self)
+{
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  const PhocCursorImage *image = priv->xcursor_image;
+  const PhocCursorFrame *frame = &image->frames[priv->xcursor_frame];
+
+  /* The hotspot is in logical coordinates */
+  wlr_cursor_set_buffer (self->cursor, frame->buffer,
+                         frame->hotspot_x / image->scale,
+                         frame->hotspot_y / image->scale,
+                         image->scale);
+
+  g_clear_handle_id (&priv->xcursor_frame_id, g_source_remove);
+  if (image->n_frames > 1 && frame->delay_ms)
+    priv->xcursor_frame_id = g_timeout_add (frame->delay_ms, on_xcursor_frame_timeout, self);
+}
+
+
+static void
+phoc_cursor_clear_xcursor (PhocCursor *self)
+{
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+
+  g_clear_handle_id (&priv->xcursor_frame_id, g_source_remove);
+  g_clear_pointer (&priv->xcursor_name, g_free);
+  priv->xcursor_image = NULL;
+}
+
+
+static float
+phoc_cursor_get_output_scale (PhocCursor *self)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocOutput *output = phoc_desktop_layout_get_output (desktop, self->cursor->x, self->cursor->y);
+
+  return output ? phoc_output_get_scale (output) : 1.0;
+}
+
+/*
+ * Show the theme cursor @name with the images matching the scale of
+ * the output the cursor is on. Images come from the cache so neither
+ * switching cursors nor animating them creates new buffers.
+ */
+static void
+phoc_cursor_show_xcursor (PhocCursor *self, const char *name)
+{
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  float scale = phoc_cursor_get_output_scale (self);
+  const PhocCursorImage *image;
+  g_autofree char *new_name = NULL;
+
+  if (priv->xcursor_image && priv->xcursor_image->scale == scale &&
+      g_strcmp0 (priv->xcursor_name, name) == 0) {
+    return;
+  }
+
+  /* @name might be the current name */
+  new_name = g_strdup (name);
+  phoc_cursor_clear_xcursor (self);
+
+  image = phoc_cursor_image_cache_lookup (priv->image_cache, priv->xcursor_manager, new_name,
+                                          scale);
+  if (image == NULL) {
+    g_debug ("Cursor '%s' not found in theme", new_name);
+    wlr_cursor_unset_image (self->cursor);
+    return;
+  }
+
+  priv->xcursor_name = g_steal_pointer (&new_name);
+  priv->xcursor_image = image;
+  priv->xcursor_frame = 0;
+  phoc_cursor_show_xcursor_frame (self);
+}
+
+
 static void
 phoc_cursor_show (PhocCursor *self)
 {
@@ -414,6 +564,31 @@ send_pointer_clear_focus (PhocSeat           *seat,
 }
 
 
+static void
+track_input_latency (struct wlr_surface *surface, uint32_t time)
+{
+  PhocInputLatency *latency = phoc_server_get_input_latency (phoc_server_get_default ());
+
+  if (G_UNLIKELY (latency))
+    phoc_input_latency_input_sent (latency, surface, time);
+}
+
+
+static void
+trace_input (PhocInputTraceEventType type,
+             guint32                 time_msec,
+             guint32                 code,
+             guint16                 state,
+             double                  x,
+             double                  y)
+{
+  PhocInputTrace *trace = phoc_server_get_input_trace (phoc_server_get_default ());
+
+  if (G_UNLIKELY (trace))
+    phoc_input_trace_add (trace, type, time_msec, code, state, x, y);
+}
+
+
 static void
 send_pointer_motion (PhocSeat           *seat,
                      struct wlr_surface *surface,
@@ -421,6 +596,8 @@ send_pointer_motion (PhocSeat           *seat,
                      double              sx,
                      double              sy)
 {
+  track_input_latency (surface, time);
+
   if (should_ignore_pointer_grab (seat, surface)) {
     wlr_seat_pointer_send_motion (seat->seat, time, sx, sy);
     return;
@@ -438,6 +615,8 @@ send_pointer_button (PhocSeat             *seat,
 {
   uint32_t serial;
 
+  track_input_latency (surface, time);
+
   if (should_ignore_pointer_grab (seat, surface)) {
     serial = wlr_seat_pointer_send_button (seat->seat, time, button, state);
     phoc_seat_update_last_button_serial (seat, serial);
@@ -476,6 +655,8 @@ send_touch_down (PhocSeat                    *seat,
 {
   uint32_t serial;
 
+  track_input_latency (surface, event->time_msec);
+
   if (should_ignore_touch_grab (seat, surface)) {
     // currently wlr_seat_touch_send_* functions don't work, so temporarily
     // restore grab to the default one and use notify_* instead
@@ -502,6 +683,8 @@ send_touch_motion (PhocSeat                      *seat,
                    double                         sx,
                    double                         sy)
 {
+  track_input_latency (surface, event->time_msec);
+
   if (should_ignore_touch_grab (seat, surface)) {
     // currently wlr_seat_touch_send_* functions don't work, so temporarily
     // restore grab to the default one and use notify_* instead
@@ -558,25 +741,48 @@ send_touch_cancel (PhocSeat                  *seat,
 }
 
 
+static int
+find_touch_slot (PhocCursorPrivate *priv, int touch_id)
+{
+  for (int slot = g_bit_nth_lsf (priv->touch_points_active, -1);
+       slot >= 0;
+       slot = g_bit_nth_lsf (priv->touch_points_active, slot)) {
+    if (priv->touch_points[slot].touch_id == touch_id)
+      return slot;
+  }
+
+  return -1;
+}
+
+
 static PhocTouchPoint *
 phoc_cursor_add_touch_point (PhocCursor *self, struct wlr_touch_down_event *event)
 {
-  PhocTouchPoint *touch_point = g_new0 (PhocTouchPoint, 1);
   PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  PhocTouchPoint *touch_point;
   double lx, ly;
+  int slot;
+
+  slot = find_touch_slot (priv, event->touch_id);
+  if (slot >= 0) {
+    g_critical ("Touch point %d already tracked, ignoring", event->touch_id);
+  } else {
+    slot = g_bit_nth_lsf (~priv->touch_points_active & PHOC_CURSOR_TOUCH_SLOTS_FULL, -1);
+    if (slot < 0) {
+      g_warning ("More than %d touch points, ignoring %d", PHOC_CURSOR_MAX_TOUCH_POINTS,
+                 event->touch_id);
+      return NULL;
+    }
+    priv->touch_points_active |= 1u << slot;
+  }
 
   wlr_cursor_absolute_to_layout_coords (self->cursor, &event->touch->base,
                                         event->x, event->y, &lx, &ly);
+  touch_point = &priv->touch_points[slot];
   touch_point->touch_id = event->touch_id;
   touch_point->lx = lx;
   touch_point->ly = ly;
 
-  if (!g_hash_table_insert (priv->touch_points,
-                            GINT_TO_POINTER (event->touch_id),
-                            touch_point)) {
-    g_critical ("Touch point %d already tracked, ignoring", event->touch_id);
-  }
-
   return touch_point;
 }
 
@@ -584,17 +790,21 @@ phoc_cursor_add_touch_point (PhocCursor *self, struct wlr_touch_down_event *even
 static PhocTouchPoint *
 phoc_cursor_update_touch_point (PhocCursor *self, struct wlr_touch_motion_event *event)
 {
-  PhocTouchPoint *touch_point;
   PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  PhocTouchPoint *touch_point;
   double lx, ly;
+  int slot;
 
-  touch_point = g_hash_table_lookup (priv->touch_points, GINT_TO_POINTER (event->touch_id));
-  if (touch_point == NULL) {
-    g_critical ("Touch point %d does not exist", event->touch_id);
+  /* Touch points beyond the slots got ignored on touch down already */
+  slot = find_touch_slot (priv, event->touch_id);
+  if (slot < 0) {
+    g_debug ("Ignoring motion of untracked touch point %d", event->touch_id);
     return NULL;
   }
+
   wlr_cursor_absolute_to_layout_coords (self->cursor, &event->touch->base,
                                         event->x, event->y, &lx, &ly);
+  touch_point = &priv->touch_points[slot];
   touch_point->lx = lx;
   touch_point->ly = ly;
 
@@ -606,9 +816,14 @@ static void
 phoc_cursor_remove_touch_point (PhocCursor *self, int touch_id)
 {
   PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  int slot = find_touch_slot (priv, touch_id);
 
-  if (!g_hash_table_remove (priv->touch_points, GINT_TO_POINTER (touch_id)))
+  if (slot < 0) {
     g_critical ("Touch point %d didn't exist", touch_id);
+    return;
+  }
+
+  priv->touch_points_active &= ~(1u << slot);
 }
 
 
@@ -616,8 +831,9 @@ static PhocTouchPoint *
 phoc_cursor_get_touch_point (PhocCursor *self, int touch_id)
 {
   PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  int slot = find_touch_slot (priv, touch_id);
 
-  return g_hash_table_lookup (priv->touch_points, GINT_TO_POINTER (touch_id));
+  return slot < 0 ? NULL : &priv->touch_points[slot];
 }
 
 
@@ -671,17 +887,28 @@ handle_gestures_for_event_at (PhocCursor   *self,
                               gpointer      wlr_event,
                               gsize         size)
 {
-  g_autoptr (PhocEvent) event = phoc_event_new (type, wlr_event, size);
   GSList *gestures = phoc_cursor_get_gestures (self);
+  PhocTimelineTrace *timeline = phoc_server_get_timeline_trace (phoc_server_get_default ());
+  gint64 start_us = 0;
+  PhocEvent event;
 
-  if (gestures == NULL)
-    return;
+  /* Gestures copy what they need so the event can live on the stack */
+  phoc_event_init (&event, type, wlr_event, size);
+  DTRACE_PROBE2 (phoc, input_dispatch_start, type, phoc_event_get_time (&event));
+  if (G_UNLIKELY (timeline))
+    start_us = g_get_monotonic_time ();
 
   for (GSList *elem = gestures; elem; elem = elem->next) {
     PhocGesture *gesture = PHOC_GESTURE (elem->data);
 
     g_assert (PHOC_IS_GESTURE (gesture));
-    phoc_gesture_handle_event (gesture, event, lx, ly);
+    phoc_gesture_handle_event (gesture, &event, lx, ly);
+  }
+
+  DTRACE_PROBE1 (phoc, input_dispatch_end, type);
+  if (G_UNLIKELY (timeline)) {
+    phoc_timeline_trace_add_span (timeline, "input", "input-dispatch", start_us,
+                                  g_get_monotonic_time (), "type", type);
   }
 }
 
@@ -788,8 +1015,7 @@ phoc_handle_shell_reveal (struct wlr_surface *surface, double lx, double ly, int
   if (!output)
     return false;
 
-  struct wlr_box output_box;
-  wlr_output_layout_get_box (desktop->layout, output->wlr_output, &output_box);
+  struct wlr_box output_box = output->layout_box;
 
   PhocLayerSurface *layer_surface;
   bool left = false, right = false, top = false, bottom = false;
@@ -955,7 +1181,12 @@ phoc_cursor_finalize (GObject *object)
   PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
 
   phoc_cursor_clear_view_state_change (self);
-  g_clear_pointer (&priv->touch_points, g_hash_table_destroy);
+  g_clear_weak_pointer (&priv->move_view);
+  if (priv->touch_flush_id)
+    phoc_output_remove_frame_callback (priv->touch_flush_output, priv->touch_flush_id);
+  if (priv->pointer_flush_id)
+    phoc_output_remove_frame_callback (priv->pointer_flush_output, priv->pointer_flush_id);
+  g_clear_pointer (&priv->pending_motions, g_array_unref);
   g_clear_pointer (&priv->gestures, free_gestures);
 
   g_clear_object (&priv->interface_settings);
@@ -983,6 +1214,8 @@ phoc_cursor_finalize (GObject *object)
   wl_list_remove (&self->tool_button.link);
   wl_list_remove (&self->focus_change.link);
 
+  phoc_cursor_clear_xcursor (self);
+  g_clear_pointer (&priv->image_cache, phoc_cursor_image_cache_free);
   g_clear_pointer (&priv->xcursor_manager, wlr_xcursor_manager_destroy);
   g_clear_pointer (&self->cursor, wlr_cursor_destroy);
 
@@ -1141,19 +1374,84 @@ on_swipe (PhocGestureSwipe *swipe_gesture, double vx, double vy, gpointer data)
 }
 
 
+/* The magnifier zooms into the center of the pinch */
+static PhocOutput *
+get_zoom_gesture_focus (PhocCursor *self, PhocGesture *gesture, double *lx, double *ly)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocEventSequence *sequences[2];
+  guint n_sequences;
+
+  *lx = self->cursor->x;
+  *ly = self->cursor->y;
+
+  n_sequences = phoc_gesture_get_active_sequences (gesture, sequences, G_N_ELEMENTS (sequences));
+  if (n_sequences == 2) {
+    double x1, y1, x2, y2;
+
+    if (phoc_gesture_get_point (gesture, sequences[0], &x1, &y1) &&
+        phoc_gesture_get_point (gesture, sequences[1], &x2, &y2)) {
+      *lx = (x1 + x2) / 2;
+      *ly = (y1 + y2) / 2;
+    }
+  }
+
+  return phoc_desktop_layout_get_output (desktop, *lx, *ly);
+}
+
+
+static void
+on_zoom_begin (PhocGesture *gesture, gpointer sequence, PhocCursor *self)
+{
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  PhocOutput *output;
+  double lx, ly;
+
+  output = get_zoom_gesture_focus (self, gesture, &lx, &ly);
+  priv->magnifier_zoom_begin = output ? phoc_output_get_magnifier_zoom (output) : 1.0;
+}
+
+
+static void
+on_zoom_scale_changed (PhocGestureZoom *zoom_gesture, double scale, PhocCursor *self)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  PhocOutput *output;
+  double lx, ly;
+
+  if (!phoc_desktop_get_magnifier_enabled (desktop))
+    return;
+
+  output = get_zoom_gesture_focus (self, PHOC_GESTURE (zoom_gesture), &lx, &ly);
+  if (!output)
+    return;
+
+  phoc_output_set_magnifier_focus (output, lx, ly);
+  /* Pinching out completely still keeps the magnifier on */
+  phoc_output_set_magnifier_zoom (output, MAX (priv->magnifier_zoom_begin * scale, 1.01));
+}
+
+
 static void
 phoc_cursor_init (PhocCursor *self)
 {
   g_autoptr (PhocGestureDrag) drag_gesture = NULL;
   g_autoptr (PhocGestureSwipe) swipe_gesture = NULL;
+  g_autoptr (PhocGestureZoom) zoom_gesture = NULL;
   PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  PhocConfig *config;
 
   self->cursor = wlr_cursor_create ();
+  priv->image_cache = phoc_cursor_image_cache_new ();
+
+  priv->pending_motions = g_array_new (FALSE, FALSE, sizeof (PhocPendingTouchMotion));
+  config = phoc_server_get_config (phoc_server_get_default ());
+  if (config) {
+    priv->touch_motion_mode = config->touch_motion;
+    priv->pointer_motion_mode = config->pointer_motion;
+  }
 
-  priv->touch_points = g_hash_table_new_full (g_direct_hash,
-                                              g_direct_equal,
-                                              NULL,
-                                              g_free);
   /*
    * Drag gesture starting at the current cursor position
    */
@@ -1169,6 +1467,16 @@ phoc_cursor_init (PhocCursor *self)
   swipe_gesture = phoc_gesture_swipe_new ();
   g_signal_connect (swipe_gesture, "swipe", G_CALLBACK (on_swipe), self);
   phoc_cursor_add_gesture (self, PHOC_GESTURE (swipe_gesture));
+
+  /*
+   * Pinch to adjust the magnifier's zoom level
+   */
+  zoom_gesture = phoc_gesture_zoom_new ();
+  g_object_connect (zoom_gesture,
+                    "signal::begin", on_zoom_begin, self,
+                    "signal::scale-changed", on_zoom_scale_changed, self,
+                    NULL);
+  phoc_cursor_add_gesture (self, PHOC_GESTURE (zoom_gesture));
 }
 
 
@@ -1190,6 +1498,17 @@ phoc_cursor_update_position (PhocCursor *self, uint32_t time)
   PhocSeat *seat = self->seat;
   PhocView *view;
 
+  /* Pick the theme images matching the output's scale */
+  if (priv->xcursor_name)
+    phoc_cursor_show_xcursor (self, priv->xcursor_name);
+
+  if (phoc_desktop_get_magnifier_enabled (desktop)) {
+    PhocOutput *output = phoc_desktop_layout_get_output (desktop, self->cursor->x, self->cursor->y);
+
+    if (output)
+      phoc_output_set_magnifier_focus (output, self->cursor->x, self->cursor->y);
+  }
+
   switch (priv->mode) {
   case PHOC_CURSOR_PASSTHROUGH:
     phoc_passthrough_cursor (self, time);
@@ -1228,8 +1547,12 @@ phoc_cursor_update_position (PhocCursor *self, uint32_t time)
       } else {
         phoc_cursor_clear_view_state_change (self);
         phoc_view_restore (view);
-        phoc_view_move (view, self->view_x + dx - geom.x * phoc_view_get_scale (view),
-                        self->view_y + dy - geom.y * phoc_view_get_scale (view));
+        if (priv->move_view && priv->move_view != view)
+          phoc_view_end_interactive_move (priv->move_view);
+        g_set_weak_pointer (&priv->move_view, view);
+        phoc_view_move_interactive (view,
+                                    self->view_x + dx - geom.x * phoc_view_get_scale (view),
+                                    self->view_y + dy - geom.y * phoc_view_get_scale (view));
       }
     }
     break;
@@ -1324,7 +1647,7 @@ phoc_cursor_press_button (PhocCursor              *self,
     if (state == WLR_BUTTON_RELEASED && priv->mode != PHOC_CURSOR_PASSTHROUGH) {
       if (priv->view_state.view)
         phoc_cursor_submit_pending_view_state_change (self);
-      priv->mode = PHOC_CURSOR_PASSTHROUGH;
+      phoc_cursor_set_mode (self, PHOC_CURSOR_PASSTHROUGH);
       phoc_cursor_update_focus (self);
     }
 
@@ -1348,6 +1671,93 @@ phoc_cursor_press_button (PhocCursor              *self,
 }
 
 
+static void
+send_pointer_frame (PhocCursor *self)
+{
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+
+  priv->pointer_frame_needed = FALSE;
+  priv->pointer_frame_deferred = FALSE;
+
+  wlr_seat_pointer_notify_frame (self->seat->seat);
+
+  // make sure to always send frame events when necessary even when bypassing seat grabs
+  wlr_seat_pointer_send_frame (self->seat->seat);
+}
+
+
+static void
+phoc_cursor_flush_pointer_motion (PhocCursor *self)
+{
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+
+  if (!priv->pointer_update_pending)
+    return;
+
+  priv->pointer_update_pending = FALSE;
+  phoc_cursor_update_position (self, priv->pointer_update_time);
+
+  if (priv->pointer_frame_deferred)
+    send_pointer_frame (self);
+}
+
+
+static gboolean
+on_pointer_flush_frame_callback (PhocAnimatable *animatable,
+                                 guint64         last_frame,
+                                 guint64         frame_time,
+                                 gpointer        user_data)
+{
+  PhocCursor *self = PHOC_CURSOR (user_data);
+
+  phoc_cursor_flush_pointer_motion (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+on_pointer_flush_frame_callback_done (gpointer user_data)
+{
+  PhocCursor *self = PHOC_CURSOR (user_data);
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+
+  priv->pointer_flush_id = 0;
+  priv->pointer_flush_output = NULL;
+}
+
+/*
+ * Defer the hit test and focus update to the next frame of the output
+ * the cursor is on.
+ */
+static void
+phoc_cursor_queue_update_position (PhocCursor *self, uint32_t time)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  PhocOutput *output;
+
+  priv->pointer_update_pending = TRUE;
+  priv->pointer_update_time = time;
+
+  if (priv->pointer_flush_id)
+    return;
+
+  output = phoc_desktop_layout_get_output (desktop, self->cursor->x, self->cursor->y);
+  if (!output) {
+    phoc_cursor_flush_pointer_motion (self);
+    return;
+  }
+
+  priv->pointer_flush_output = output;
+  priv->pointer_flush_id = phoc_output_add_frame_callback (output,
+                                                           PHOC_ANIMATABLE (output),
+                                                           on_pointer_flush_frame_callback,
+                                                           self,
+                                                           on_pointer_flush_frame_callback_done);
+}
+
+
 static void
 phoc_cursor_pointer_motion (PhocCursor              *self,
                             struct wlr_input_device *device,
@@ -1392,6 +1802,13 @@ phoc_cursor_pointer_motion (PhocCursor              *self,
   }
 
   wlr_cursor_move (self->cursor, device, dx, dy);
+
+  /* Constrained pointers need up to date focus for the confinement above */
+  if (priv->pointer_motion_mode == PHOC_POINTER_MOTION_COALESCE && !self->active_constraint) {
+    phoc_cursor_queue_update_position (self, time_msec);
+    return;
+  }
+
   phoc_cursor_update_position (self, time_msec);
 }
 
@@ -1404,6 +1821,8 @@ handle_pointer_motion_relative (struct wl_listener *listener, void *data)
   double dx = event->delta_x;
   double dy = event->delta_y;
 
+  trace_input (PHOC_INPUT_TRACE_EVENT_POINTER_MOTION, event->time_msec, 0, 0, dx, dy);
+
   phoc_cursor_pointer_motion (self,
                               &event->pointer->base,
                               dx,
@@ -1421,6 +1840,8 @@ handle_pointer_motion_absolute (struct wl_listener *listener, void *data)
   struct wlr_pointer_motion_absolute_event *event = data;
   double dx, dy, lx, ly;
 
+  trace_input (PHOC_INPUT_TRACE_EVENT_POINTER_MOTION_ABSOLUTE, event->time_msec, 0, 0,
+               event->x, event->y);
   wlr_cursor_absolute_to_layout_coords (self->cursor,
                                         &event->pointer->base,
                                         event->x, event->y,
@@ -1440,12 +1861,19 @@ handle_pointer_button (struct wl_listener *listener, void *data)
 {
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
   PhocCursor *self = wl_container_of (listener, self, button);
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
   struct wlr_pointer_button_event *event = data;
   PhocEventType type;
   bool is_touch = event->pointer->base.type == WLR_INPUT_DEVICE_TOUCH;
 
+  trace_input (PHOC_INPUT_TRACE_EVENT_POINTER_BUTTON, event->time_msec, event->button,
+               event->state, 0, 0);
   phoc_desktop_notify_activity (desktop, self->seat);
-  g_debug ("%s %d is_touch: %d", __func__, __LINE__, is_touch);
+  /* Make sure the button goes to the surface under the pointer */
+  phoc_cursor_flush_pointer_motion (self);
+  priv->pointer_frame_needed = TRUE;
+
+  phoc_debug_hot (PHOC_LOG_HOT_INPUT, "%s %d is_touch: %d", __func__, __LINE__, is_touch);
   if (!is_touch) {
     type = event->state ? PHOC_EVENT_BUTTON_PRESS : PHOC_EVENT_BUTTON_RELEASE;
     handle_gestures_for_event_at (self, self->cursor->x, self->cursor->y, type, event, sizeof (*event));
@@ -1489,6 +1917,8 @@ handle_pointer_axis (struct wl_listener *listener, void *data)
     phoc_cursor_show (self);
   }
   phoc_desktop_notify_activity (desktop, self->seat);
+  phoc_cursor_flush_pointer_motion (self);
+  priv->pointer_frame_needed = TRUE;
 
   send_pointer_axis (self->seat, self->seat->seat->pointer_state.focused_surface, event->time_msec,
                      event->orientation, event->delta, event->delta_discrete, event->source);
@@ -1500,12 +1930,17 @@ handle_pointer_frame (struct wl_listener *listener, void *data)
 {
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
   PhocCursor *self = wl_container_of (listener, self, frame);
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
 
   phoc_desktop_notify_activity (desktop, self->seat);
-  wlr_seat_pointer_notify_frame (self->seat->seat);
 
-  // make sure to always send frame events when necessary even when bypassing seat grabs
-  wlr_seat_pointer_send_frame (self->seat->seat);
+  /* Only motion is pending so the flush will send the frame */
+  if (priv->pointer_update_pending && !priv->pointer_frame_needed) {
+    priv->pointer_frame_deferred = TRUE;
+    return;
+  }
+
+  send_pointer_frame (self);
 }
 
 
@@ -1521,7 +1956,16 @@ phoc_cursor_handle_touch_down (PhocCursor                  *self,
   PhocTouchPoint *touch_point;
   double lx, ly;
 
+  trace_input (PHOC_INPUT_TRACE_EVENT_TOUCH_DOWN, event->time_msec, event->touch_id, 0,
+               event->x, event->y);
+
+  /* Keep the event order intact for clients */
+  phoc_cursor_flush_touch_motions (self);
+  priv->touch_frame_needed = TRUE;
+
   touch_point = phoc_cursor_add_touch_point (self, event);
+  if (!touch_point)
+    return;
   lx = touch_point->lx;
   ly = touch_point->ly;
   handle_gestures_for_event_at (self, lx, ly, PHOC_EVENT_TOUCH_BEGIN, event, sizeof (*event));
@@ -1560,8 +2004,7 @@ phoc_cursor_handle_touch_down (PhocCursor                  *self,
     PhocOutput *output;
     wl_list_for_each (output, &desktop->outputs, link) {
       if (wlr_output_layout_contains_point (desktop->layout, output->wlr_output, lx, ly)) {
-        double ox = lx, oy = ly;
-        wlr_output_layout_output_coords (desktop->layout, output->wlr_output, &ox, &oy);
+        double ox = lx - output->layout_box.x, oy = ly - output->layout_box.y;
         struct wlr_box box = {
           .x = ox,
           .y = oy,
@@ -1588,6 +2031,12 @@ phoc_cursor_handle_touch_up (PhocCursor                *self,
   g_assert (PHOC_IS_CURSOR (self));
   priv = phoc_cursor_get_instance_private (self);
 
+  trace_input (PHOC_INPUT_TRACE_EVENT_TOUCH_UP, event->time_msec, event->touch_id, 0, 0, 0);
+
+  /* Keep the event order intact for clients */
+  phoc_cursor_flush_touch_motions (self);
+  priv->touch_frame_needed = TRUE;
+
   touch_point = phoc_cursor_get_touch_point (self, event->touch_id);
 
   /* Don't process unknown touch points */
@@ -1609,7 +2058,7 @@ phoc_cursor_handle_touch_up (PhocCursor                *self,
     if (priv->view_state.view)
       phoc_cursor_submit_pending_view_state_change (self);
 
-    priv->mode = PHOC_CURSOR_PASSTHROUGH;
+    phoc_cursor_set_mode (self, PHOC_CURSOR_PASSTHROUGH);
     phoc_cursor_update_focus (self);
   }
 
@@ -1617,9 +2066,8 @@ phoc_cursor_handle_touch_up (PhocCursor                *self,
 }
 
 
-void
-phoc_cursor_handle_touch_motion (PhocCursor                    *self,
-                                 struct wlr_touch_motion_event *event)
+static void
+process_touch_motion (PhocCursor *self, struct wlr_touch_motion_event *event)
 {
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
   PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
@@ -1628,7 +2076,8 @@ phoc_cursor_handle_touch_motion (PhocCursor                    *self,
   double lx, ly;
 
   touch_point = phoc_cursor_update_touch_point (self, event);
-  g_return_if_fail (touch_point);
+  if (!touch_point)
+    return;
   lx = touch_point->lx;
   ly = touch_point->ly;
   handle_gestures_for_event_at (self, lx, ly, PHOC_EVENT_TOUCH_UPDATE, event, sizeof (*event));
@@ -1654,8 +2103,7 @@ phoc_cursor_handle_touch_motion (PhocCursor                    *self,
     struct wlr_layer_surface_v1 *wlr_layer_surface = wlr_layer_surface_v1_try_from_wlr_surface (root);
     if (wlr_layer_surface) {
 
-      struct wlr_box output_box;
-      wlr_output_layout_get_box (desktop->layout, output->wlr_output, &output_box);
+      struct wlr_box output_box = output->layout_box;
 
       PhocLayerSurface *layer_surface;
       wl_list_for_each_reverse (layer_surface, &output->layer_surfaces, link)
@@ -1729,18 +2177,204 @@ phoc_cursor_handle_touch_motion (PhocCursor                    *self,
 
 
 static void
-handle_touch_frame (struct wl_listener *listener, void *data)
+send_touch_frame (PhocCursor *self)
 {
-  PhocCursor *self = PHOC_CURSOR (wl_container_of (listener, self, touch_frame));
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
   struct wlr_seat *wlr_seat = self->seat->seat;
 
-  wlr_seat_touch_notify_frame(wlr_seat);
+  priv->touch_frame_needed = FALSE;
+  priv->touch_frame_deferred = FALSE;
+
+  wlr_seat_touch_notify_frame (wlr_seat);
 
   // make sure to always send frame events when necessary even when bypassing seat grabs
   wlr_seat_touch_send_frame (wlr_seat);
 }
 
 
+static PhocPendingTouchMotion *
+find_pending_touch_motion (PhocCursor *self, int touch_id)
+{
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+
+  for (guint i = 0; i < priv->pending_motions->len; i++) {
+    PhocPendingTouchMotion *pending = &g_array_index (priv->pending_motions,
+                                                      PhocPendingTouchMotion, i);
+    if (pending->event.touch_id == touch_id)
+      return pending;
+  }
+
+  return NULL;
+}
+
+/*
+ * Extrapolate the motion linearly from the last two samples to the
+ * time the frame will hit the screen.
+ */
+static void
+resample_touch_motion (PhocPendingTouchMotion *pending, PhocOutput *output)
+{
+  struct wlr_touch_motion_event *event = &pending->event;
+  gint64 present_us;
+  gint32 dt_ms, ahead_ms;
+
+  if (!pending->has_prev || !output)
+    return;
+
+  present_us = phoc_output_get_next_present_us (output);
+  if (!present_us)
+    return;
+
+  /* Event times are truncated to 32 bit so compare via differences */
+  dt_ms = (gint32)(event->time_msec - pending->prev_time_msec);
+  if (dt_ms <= 0 || dt_ms > PHOC_TOUCH_RESAMPLE_MAX_GAP_MS)
+    return;
+
+  ahead_ms = (gint32)((guint32)(present_us / 1000) - event->time_msec);
+  ahead_ms = CLAMP (ahead_ms, 0, PHOC_TOUCH_RESAMPLE_MAX_PREDICT_MS);
+  if (!ahead_ms)
+    return;
+
+  event->x += (event->x - pending->prev_x) * ahead_ms / dt_ms;
+  event->y += (event->y - pending->prev_y) * ahead_ms / dt_ms;
+  event->x = CLAMP (event->x, 0.0, 1.0);
+  event->y = CLAMP (event->y, 0.0, 1.0);
+  event->time_msec += ahead_ms;
+}
+
+/**
+ * phoc_cursor_flush_touch_motions:
+ * @self: The cursor
+ *
+ * Forward all touch motion held back for the next output frame to
+ * clients. This is a noop when touch motion isn't coalesced.
+ */
+void
+phoc_cursor_flush_touch_motions (PhocCursor *self)
+{
+  PhocCursorPrivate *priv;
+
+  g_assert (PHOC_IS_CURSOR (self));
+  priv = phoc_cursor_get_instance_private (self);
+
+  if (!priv->pending_motions->len)
+    return;
+
+  for (guint i = 0; i < priv->pending_motions->len; i++) {
+    PhocPendingTouchMotion *pending = &g_array_index (priv->pending_motions,
+                                                      PhocPendingTouchMotion, i);
+
+    /* The touch point might have been canceled in the meantime */
+    if (!phoc_cursor_is_active_touch_id (self, pending->event.touch_id))
+      continue;
+
+    if (priv->touch_motion_mode == PHOC_TOUCH_MOTION_RESAMPLE)
+      resample_touch_motion (pending, priv->touch_flush_output);
+
+    process_touch_motion (self, &pending->event);
+  }
+  g_array_set_size (priv->pending_motions, 0);
+
+  if (priv->touch_frame_deferred)
+    send_touch_frame (self);
+}
+
+
+static gboolean
+on_touch_flush_frame_callback (PhocAnimatable *animatable,
+                               guint64         last_frame,
+                               guint64         frame_time,
+                               gpointer        user_data)
+{
+  PhocCursor *self = PHOC_CURSOR (user_data);
+
+  phoc_cursor_flush_touch_motions (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+on_touch_flush_frame_callback_done (gpointer user_data)
+{
+  PhocCursor *self = PHOC_CURSOR (user_data);
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+
+  priv->touch_flush_id = 0;
+  priv->touch_flush_output = NULL;
+}
+
+
+void
+phoc_cursor_handle_touch_motion (PhocCursor                    *self,
+                                 struct wlr_touch_motion_event *event)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  PhocPendingTouchMotion *pending;
+  PhocTouchPoint *touch_point;
+  PhocOutput *output;
+
+  trace_input (PHOC_INPUT_TRACE_EVENT_TOUCH_MOTION, event->time_msec, event->touch_id, 0,
+               event->x, event->y);
+
+  if (priv->touch_motion_mode == PHOC_TOUCH_MOTION_IMMEDIATE) {
+    process_touch_motion (self, event);
+    return;
+  }
+
+  /* Don't queue motion of unknown touch points */
+  touch_point = phoc_cursor_get_touch_point (self, event->touch_id);
+  if (!touch_point)
+    return;
+
+  pending = find_pending_touch_motion (self, event->touch_id);
+  if (pending) {
+    pending->prev_x = pending->event.x;
+    pending->prev_y = pending->event.y;
+    pending->prev_time_msec = pending->event.time_msec;
+    pending->has_prev = TRUE;
+    pending->event = *event;
+  } else {
+    PhocPendingTouchMotion new_pending = { .event = *event };
+
+    g_array_append_val (priv->pending_motions, new_pending);
+  }
+
+  if (priv->touch_flush_id)
+    return;
+
+  output = phoc_desktop_layout_get_output (desktop, touch_point->lx, touch_point->ly);
+  if (!output) {
+    phoc_cursor_flush_touch_motions (self);
+    return;
+  }
+
+  priv->touch_flush_output = output;
+  priv->touch_flush_id = phoc_output_add_frame_callback (output,
+                                                         PHOC_ANIMATABLE (output),
+                                                         on_touch_flush_frame_callback,
+                                                         self,
+                                                         on_touch_flush_frame_callback_done);
+}
+
+
+static void
+handle_touch_frame (struct wl_listener *listener, void *data)
+{
+  PhocCursor *self = PHOC_CURSOR (wl_container_of (listener, self, touch_frame));
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+
+  /* Only motion is pending so the flush will send the frame */
+  if (priv->pending_motions->len && !priv->touch_frame_needed) {
+    priv->touch_frame_deferred = TRUE;
+    return;
+  }
+
+  send_touch_frame (self);
+}
+
+
 void
 phoc_cursor_handle_tool_axis (PhocCursor                        *self,
                               struct wlr_tablet_tool_axis_event *event)
@@ -1798,8 +2432,8 @@ phoc_cursor_handle_focus_change (PhocCursor                                 *sel
   double lx = self->cursor->x;
   double ly = self->cursor->y;
 
-  g_debug ("entered surface %p, lx: %f, ly: %f, sx: %f, sy: %f",
-           event->new_surface, lx, ly, sx, sy);
+  phoc_debug_hot (PHOC_LOG_HOT_INPUT, "entered surface %p, lx: %f, ly: %f, sx: %f, sy: %f",
+                  event->new_surface, lx, ly, sx, sy);
 
   phoc_cursor_constrain (self,
                          wlr_pointer_constraints_v1_constraint_for_surface (
@@ -1950,7 +2584,7 @@ phoc_cursor_is_active_touch_id (PhocCursor *self, int touch_id)
 {
   PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
 
-  return !!g_hash_table_lookup (priv->touch_points, GINT_TO_POINTER (touch_id));
+  return find_touch_slot (priv, touch_id) >= 0;
 }
 
 /**
@@ -1976,16 +2610,18 @@ phoc_cursor_set_name (PhocCursor *self, struct wl_client *client, const char *na
 
   /* Seat does not have a usable pointing device */
   if (!phoc_seat_has_pointer (self->seat) || !priv->has_pointer_motion) {
+    phoc_cursor_clear_xcursor (self);
     wlr_cursor_unset_image (self->cursor);
     return;
   }
 
   if (!priv->image_name) {
+    phoc_cursor_clear_xcursor (self);
     wlr_cursor_unset_image (self->cursor);
     return;
   }
 
-  wlr_cursor_set_xcursor (self->cursor, priv->xcursor_manager, priv->image_name);
+  phoc_cursor_show_xcursor (self, priv->image_name);
 }
 
 /**
@@ -2017,6 +2653,8 @@ phoc_cursor_set_image (PhocCursor         *self,
   priv->hotspot_y = hotspot_y;
   priv->image_client = client;
 
+  phoc_cursor_clear_xcursor (self);
+
   /* Seat does not have a usable pointing device */
   if (!phoc_seat_has_pointer (self->seat) || !priv->has_pointer_motion)
     return;
@@ -2039,6 +2677,12 @@ phoc_cursor_set_mode (PhocCursor *self, PhocCursorMode mode)
   g_assert (PHOC_IS_CURSOR (self));
   priv = phoc_cursor_get_instance_private (self);
 
+  /* Tell the client where the view ended up */
+  if (mode != PHOC_CURSOR_MOVE && priv->move_view) {
+    phoc_view_end_interactive_move (priv->move_view);
+    g_clear_weak_pointer (&priv->move_view);
+  }
+
   priv->mode = mode;
 }
 
@@ -2076,6 +2720,9 @@ phoc_cursor_set_xcursor_theme (PhocCursor *self, const char *theme, uint32_t siz
   g_assert (PHOC_IS_CURSOR (self));
   priv = phoc_cursor_get_instance_private (self);
 
+  /* Cached images point into the old theme */
+  phoc_cursor_clear_xcursor (self);
+  phoc_cursor_image_cache_clear (priv->image_cache);
   g_clear_pointer (&priv->xcursor_manager, wlr_xcursor_manager_destroy);
   priv->xcursor_manager = wlr_xcursor_manager_create (theme, size);
   g_assert (priv->xcursor_manager);
@@ -2111,3 +2758,22 @@ phoc_cursor_configure_xcursor (PhocCursor *self)
   phoc_cursor_set_name (self, NULL, PHOC_XCURSOR_DEFAULT);
   wlr_cursor_warp (self->cursor, NULL, self->cursor->x, self->cursor->y);
 }
+
+/**
+ * phoc_cursor_get_xcursor_size:
+ * @self: The cursor
+ *
+ * Get the size of the loaded cursor theme images.
+ *
+ * Returns: The size in bytes
+ */
+gsize
+phoc_cursor_get_xcursor_size (PhocCursor *self)
+{
+  PhocCursorPrivate *priv;
+
+  g_assert (PHOC_IS_CURSOR (self));
+  priv = phoc_cursor_get_instance_private (self);
+
+  return phoc_utils_xcursor_manager_get_size (priv->xcursor_manager);
+}
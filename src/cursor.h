@@ -118,6 +118,7 @@ void        phoc_cursor_handle_touch_up (PhocCursor
                                          struct wlr_touch_up_event                       *event);
 void        phoc_cursor_handle_touch_motion (PhocCursor                                  *self,
                                              struct wlr_touch_motion_event               *event);
+void        phoc_cursor_flush_touch_motions (PhocCursor                                  *self);
 void        phoc_cursor_handle_tool_axis (PhocCursor                                     *self,
                                           struct wlr_tablet_tool_axis_event              *event);
 void        phoc_cursor_handle_tool_tip (PhocCursor                                      *self,
@@ -154,5 +155,6 @@ PhocCursorMode phoc_cursor_get_mode (PhocCursor *self);
 void        phoc_cursor_set_mode (PhocCursor *self, PhocCursorMode mode);
 void        phoc_cursor_set_xcursor_theme (PhocCursor *self, const char *theme, uint32_t size);
 void        phoc_cursor_configure_xcursor (PhocCursor *self);
+gsize       phoc_cursor_get_xcursor_size (PhocCursor *self);
 
 G_END_DECLS
@@ -16,15 +16,18 @@
 
 #include <gmobile.h>
 #include <cairo/cairo.h>
-#include <drm_fourcc.h>
 
-G_DEFINE_AUTOPTR_CLEANUP_FUNC (cairo_t, cairo_destroy)
-G_DEFINE_AUTOPTR_CLEANUP_FUNC (cairo_surface_t, cairo_surface_destroy)
+/* Give up on the rounded corners after that many failed attempts */
+#define CORNER_MAX_ATTEMPTS 3
 
 /**
  * PhocCutoutsOverlay:
  *
- * An overlay texture to render a devices cutouts.
+ * An overlay to render a devices cutouts.
+ *
+ * The corner mask is drawn via the renderer's [class@RasterPool] so
+ * adding an output doesn't block on cairo. The corners show up once
+ * the mask is ready, see [signal@CutoutsOverlay::changed].
  */
 
 enum {
@@ -34,11 +37,22 @@ enum {
 };
 static GParamSpec *props[PROP_LAST_PROP];
 
+enum {
+  CHANGED,
+  N_SIGNALS
+};
+static guint signals[N_SIGNALS];
+
 struct _PhocCutoutsOverlay {
   GObject          parent;
 
   GStrv            compatibles;
   GmDisplayPanel  *panel;
+  /* Mask of the top left rounded corner */
+  struct wlr_texture *corner;
+  gboolean         corner_requested;
+  guint            corner_attempts;
+  GCancellable    *cancellable;
 };
 G_DEFINE_TYPE (PhocCutoutsOverlay, phoc_cutouts_overlay, G_TYPE_OBJECT)
 
@@ -112,8 +126,11 @@ phoc_cutouts_overlay_finalize (GObject *object)
 {
   PhocCutoutsOverlay *self = PHOC_CUTOUTS_OVERLAY(object);
 
+  g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
   g_clear_object (&self->panel);
   g_clear_pointer (&self->compatibles, g_strfreev);
+  g_clear_pointer (&self->corner, wlr_texture_destroy);
 
   G_OBJECT_CLASS (phoc_cutouts_overlay_parent_class)->finalize (object);
 }
@@ -134,6 +151,19 @@ phoc_cutouts_overlay_class_init (PhocCutoutsOverlayClass *klass)
                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
 
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+
+  /**
+   * PhocCutoutsOverlay::changed:
+   * @self: The cutouts overlay
+   *
+   * Emitted when the overlay's content changed and it needs to be
+   * rendered again, e.g. when the corner mask got drawn.
+   */
+  signals[CHANGED] = g_signal_new ("changed",
+                                   G_TYPE_FROM_CLASS (klass),
+                                   G_SIGNAL_RUN_LAST,
+                                   0, NULL, NULL, NULL,
+                                   G_TYPE_NONE, 0);
 }
 
 
@@ -152,71 +182,166 @@ phoc_cutouts_overlay_new (const char * const *compatibles)
 }
 
 
-struct wlr_texture *
-phoc_cutouts_overlay_get_cutouts_texture (PhocCutoutsOverlay *self, PhocOutput *output)
+/* Premultiplied translucent magenta */
+#define CUTOUTS_COLOR ((struct wlr_render_color){0.25f, 0.0f, 0.25f, 0.5f})
+
+/* Runs in the raster pool */
+static void
+draw_corner (cairo_t *cr, int width, int height, gpointer data)
+{
+  int radius = width;
+
+  cairo_set_source_rgba (cr, 0.5f, 0.0f, 0.5f, 0.5f);
+
+  /* top left, the other corners are drawn transformed */
+  cairo_move_to (cr, 0, 0);
+  cairo_arc (cr, radius, radius, radius, M_PI, 1.5 * M_PI);
+  cairo_close_path (cr);
+  cairo_fill (cr);
+}
+
+
+static void
+on_corner_drawn (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  PhocRasterPool *pool = PHOC_RASTER_POOL (source_object);
+  PhocCutoutsOverlay *self;
+  g_autoptr (GError) err = NULL;
+  struct wlr_texture *corner;
+
+  corner = phoc_raster_pool_draw_finish (pool, res, &err);
+  if (corner == NULL && g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  self = PHOC_CUTOUTS_OVERLAY (user_data);
+  g_clear_object (&self->cancellable);
+
+  if (corner == NULL) {
+    if (self->corner_attempts >= CORNER_MAX_ATTEMPTS) {
+      g_warning ("Failed to draw cutouts corner: %s", err->message);
+      return;
+    }
+
+    /* Try again on the next frame */
+    g_debug ("Failed to draw cutouts corner, retrying: %s", err->message);
+    self->corner_requested = FALSE;
+    g_signal_emit (self, signals[CHANGED], 0);
+    return;
+  }
+
+  self->corner = corner;
+
+  g_signal_emit (self, signals[CHANGED], 0);
+}
+
+
+static void
+request_corner_texture (PhocCutoutsOverlay *self, int radius)
+{
+  PhocRenderer *renderer = phoc_server_get_renderer (phoc_server_get_default ());
+
+  self->corner_requested = TRUE;
+  self->corner_attempts++;
+  self->cancellable = g_cancellable_new ();
+  phoc_raster_pool_draw_async (phoc_renderer_get_raster_pool (renderer),
+                               radius, radius,
+                               draw_corner, NULL, NULL,
+                               self->cancellable,
+                               on_corner_drawn,
+                               self);
+}
+
+/**
+ * phoc_cutouts_overlay_render:
+ * @self: The cutouts overlay
+ * @ctx: The render context
+ *
+ * Renders the panel's cutouts as solid rectangles and its rounded
+ * corners using a small corner mask. Only the damaged area is
+ * painted so the translucent overlay doesn't accumulate on parts of
+ * the buffer that didn't get repainted.
+ */
+void
+phoc_cutouts_overlay_render (PhocCutoutsOverlay *self, PhocRenderContext *ctx)
 {
-  int width, height, radius, stride;
+  int width, height, radius;
   GListModel *cutouts;
-  unsigned char *data;
-  PhocServer *server = phoc_server_get_default ();
-  PhocRenderer *renderer = phoc_server_get_renderer (server);
-  struct wlr_texture *texture;
-  g_autoptr (cairo_surface_t) surface = NULL;
-  g_autoptr (cairo_t) cr = NULL;
+  pixman_region32_t clip;
 
-  g_return_val_if_fail (PHOC_IS_CUTOUTS_OVERLAY (self), NULL);
+  g_return_if_fail (PHOC_IS_CUTOUTS_OVERLAY (self));
 
   if (self->panel == NULL)
-    return NULL;
+    return;
+
+  /* Panel coordinates match the untransformed buffer */
+  pixman_region32_init (&clip);
+  pixman_region32_copy (&clip, ctx->buffer_damage);
+  if (!pixman_region32_not_empty (&clip))
+    goto out;
 
   width = gm_display_panel_get_x_res (self->panel);
   height = gm_display_panel_get_y_res (self->panel);
   radius = gm_display_panel_get_border_radius (self->panel);
 
-  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
-  cr = cairo_create (surface);
-  cairo_set_line_width (cr, 5.0);
-  cairo_set_source_rgba (cr, 0.5f, 0.0f, 0.5f, 0.5f);
-
   cutouts = gm_display_panel_get_cutouts (self->panel);
   for (int i = 0; i < g_list_model_get_n_items (cutouts); i++) {
     g_autoptr (GmCutout) cutout = g_list_model_get_item (cutouts, i);
     const GmRect *bounds = gm_cutout_get_bounds (cutout);
 
-    cairo_rectangle (cr, bounds->x, bounds->y, bounds->width, bounds->height);
-    cairo_fill (cr);
+    wlr_render_pass_add_rect (ctx->render_pass, &(struct wlr_render_rect_options){
+        .box = { bounds->x, bounds->y, bounds->width, bounds->height },
+        .color = CUTOUTS_COLOR,
+        .clip = &clip,
+      });
   }
 
-  /* top left */
-  cairo_move_to (cr, 0, 0);
-  cairo_arc (cr, radius, radius, radius, M_PI, 1.5 * M_PI);
-  cairo_close_path (cr);
-  cairo_fill (cr);
-
-  /* top right */
-  cairo_move_to (cr, width, 0);
-  cairo_arc (cr, width - radius, radius, radius, 1.5 * M_PI, 2 * M_PI);
-  cairo_close_path (cr);
-  cairo_fill (cr);
-
-  /* bottom right */
-  cairo_move_to (cr, width, height);
-  cairo_arc (cr, width - radius, height - radius, radius, 0, 0.5 * M_PI);
-  cairo_close_path (cr);
-  cairo_fill (cr);
+  if (radius <= 0)
+    goto out;
+
+  if (!self->corner_requested)
+    request_corner_texture (self, radius);
+  if (self->corner == NULL)
+    goto out;
+
+  struct {
+    int x, y;
+    enum wl_output_transform transform;
+  } corners[] = {
+    { 0, 0, WL_OUTPUT_TRANSFORM_NORMAL },
+    { width - radius, 0, WL_OUTPUT_TRANSFORM_FLIPPED },
+    { width - radius, height - radius, WL_OUTPUT_TRANSFORM_180 },
+    { 0, height - radius, WL_OUTPUT_TRANSFORM_FLIPPED_180 },
+  };
+
+  for (int i = 0; i < G_N_ELEMENTS (corners); i++) {
+    wlr_render_pass_add_texture (ctx->render_pass, &(struct wlr_render_texture_options) {
+        .texture = self->corner,
+        .dst_box = { corners[i].x, corners[i].y, radius, radius },
+        .transform = corners[i].transform,
+        .clip = &clip,
+      });
+  }
 
-  /* bottom left */
-  cairo_move_to (cr, 0, height);
-  cairo_arc (cr, radius, height - radius, radius, 0.5 * M_PI, M_PI);
-  cairo_close_path (cr);
-  cairo_fill (cr);
+ out:
+  pixman_region32_fini (&clip);
+}
 
-  cairo_surface_flush (surface);
-  data = cairo_image_surface_get_data (surface);
-  stride = cairo_image_surface_get_stride (surface);
+/**
+ * phoc_cutouts_overlay_get_texture_size:
+ * @self: The cutouts overlay
+ *
+ * Get the size of the textures held by the overlay.
+ *
+ * Returns: The size in bytes
+ */
+gsize
+phoc_cutouts_overlay_get_texture_size (PhocCutoutsOverlay *self)
+{
+  g_assert (PHOC_IS_CUTOUTS_OVERLAY (self));
 
-  texture = wlr_texture_from_pixels (phoc_renderer_get_wlr_renderer (renderer),
-                                     DRM_FORMAT_ARGB8888, stride, width, height, data);
+  if (!self->corner)
+    return 0;
 
-  return texture;
+  /* The corner mask is ARGB8888 */
+  return (gsize)self->corner->width * self->corner->height * 4;
 }
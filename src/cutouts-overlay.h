@@ -7,6 +7,7 @@
 #pragma once
 
 #include "output.h"
+#include "render.h"
 
 #include <glib-object.h>
 
@@ -17,7 +18,8 @@ G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE (PhocCutoutsOverlay, phoc_cutouts_overlay, PHOC, CUTOUTS_OVERLAY, GObject)
 
 PhocCutoutsOverlay *phoc_cutouts_overlay_new                 (const char * const *compatibles);
-struct wlr_texture *phoc_cutouts_overlay_get_cutouts_texture (PhocCutoutsOverlay *self,
-                                                              PhocOutput         *output);
+void                phoc_cutouts_overlay_render              (PhocCutoutsOverlay *self,
+                                                              PhocRenderContext  *ctx);
+gsize               phoc_cutouts_overlay_get_texture_size    (PhocCutoutsOverlay *self);
 
 G_END_DECLS
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-damage-heatmap"
+
+#include "phoc-config.h"
+
+#include "damage-heatmap.h"
+#include "output.h"
+
+#include <gio/gio.h>
+#include <wlr/render/pass.h>
+
+#define HEATMAP_ALPHA 0.4f
+
+/**
+ * PhocDamageHeatmap:
+ *
+ * Counts per tile of an output how often it got damaged. Unlike
+ * damage tracking debugging this doesn't force full output damage so
+ * the damage a client causes can be observed as is. Tiles damaged
+ * often show up red in the overlay, rarely damaged ones blue, to find
+ * clients that damage more than they change.
+ *
+ * The overlay is only drawn within the frame's damage, so parts of
+ * the output that don't get repainted keep showing older counts.
+ * [method@DamageHeatmap.save] exports all counts as a grayscale
+ * image with one pixel per tile.
+ *
+ * Tiles are in the coordinates of the output's damage ring: physical
+ * pixels of the output with its transform applied, so a rotated
+ * output's heatmap is rotated as well. The overlay converts tiles to
+ * buffer coordinates when drawing them.
+ */
+struct _PhocDamageHeatmap {
+  int      width, height;
+  int      cols, rows;
+  /* Per tile damage count */
+  guint32 *counts;
+  /* Per tile frame it was last counted in */
+  guint   *stamps;
+  guint    n_frames;
+  guint32  max;
+};
+
+
+PhocDamageHeatmap *
+phoc_damage_heatmap_new (void)
+{
+  return g_new0 (PhocDamageHeatmap, 1);
+}
+
+
+void
+phoc_damage_heatmap_free (PhocDamageHeatmap *self)
+{
+  g_free (self->counts);
+  g_free (self->stamps);
+  g_free (self);
+}
+
+
+static void
+heatmap_resize (PhocDamageHeatmap *self, int width, int height)
+{
+  self->width = width;
+  self->height = height;
+  self->cols = (width + PHOC_DAMAGE_HEATMAP_TILE_SIZE - 1) / PHOC_DAMAGE_HEATMAP_TILE_SIZE;
+  self->rows = (height + PHOC_DAMAGE_HEATMAP_TILE_SIZE - 1) / PHOC_DAMAGE_HEATMAP_TILE_SIZE;
+
+  g_free (self->counts);
+  g_free (self->stamps);
+  self->counts = g_new0 (guint32, self->cols * self->rows);
+  self->stamps = g_new0 (guint, self->cols * self->rows);
+  self->n_frames = 0;
+  self->max = 0;
+}
+
+/**
+ * phoc_damage_heatmap_add_damage:
+ * @self: The heatmap
+ * @damage: A frame's damage in transformed output coordinates
+ * @width: The output's transformed width in physical pixels
+ * @height: The output's transformed height in physical pixels
+ *
+ * Counts the tiles covered by @damage. Each tile is counted at most
+ * once per call. If the output's size changed the counts are reset.
+ */
+void
+phoc_damage_heatmap_add_damage (PhocDamageHeatmap       *self,
+                                const pixman_region32_t *damage,
+                                int                      width,
+                                int                      height)
+{
+  const pixman_box32_t *rects;
+  int nrects;
+
+  g_assert (self);
+
+  if (width <= 0 || height <= 0)
+    return;
+
+  if (width != self->width || height != self->height)
+    heatmap_resize (self, width, height);
+
+  self->n_frames++;
+
+  rects = pixman_region32_rectangles ((pixman_region32_t *)damage, &nrects);
+  for (int i = 0; i < nrects; i++) {
+    int x1 = CLAMP (rects[i].x1, 0, width) / PHOC_DAMAGE_HEATMAP_TILE_SIZE;
+    int y1 = CLAMP (rects[i].y1, 0, height) / PHOC_DAMAGE_HEATMAP_TILE_SIZE;
+    int x2 = (CLAMP (rects[i].x2, 0, width) + PHOC_DAMAGE_HEATMAP_TILE_SIZE - 1) /
+      PHOC_DAMAGE_HEATMAP_TILE_SIZE;
+    int y2 = (CLAMP (rects[i].y2, 0, height) + PHOC_DAMAGE_HEATMAP_TILE_SIZE - 1) /
+      PHOC_DAMAGE_HEATMAP_TILE_SIZE;
+
+    for (int y = y1; y < y2; y++) {
+      for (int x = x1; x < x2; x++) {
+        int idx = y * self->cols + x;
+
+        /* Overlapping rects count once per frame */
+        if (self->stamps[idx] == self->n_frames)
+          continue;
+
+        self->stamps[idx] = self->n_frames;
+        self->counts[idx]++;
+        self->max = MAX (self->max, self->counts[idx]);
+      }
+    }
+  }
+}
+
+/**
+ * phoc_damage_heatmap_get_count:
+ * @self: The heatmap
+ * @x: The x coordinate in transformed output pixels
+ * @y: The y coordinate in transformed output pixels
+ *
+ * Returns: How often the tile containing @x, @y got damaged
+ */
+guint32
+phoc_damage_heatmap_get_count (PhocDamageHeatmap *self, int x, int y)
+{
+  g_assert (self);
+
+  if (x < 0 || y < 0 || x >= self->width || y >= self->height)
+    return 0;
+
+  return self->counts[(y / PHOC_DAMAGE_HEATMAP_TILE_SIZE) * self->cols +
+                      x / PHOC_DAMAGE_HEATMAP_TILE_SIZE];
+}
+
+/**
+ * phoc_damage_heatmap_get_frames:
+ * @self: The heatmap
+ *
+ * Returns: The number of frames damage was added for
+ */
+guint
+phoc_damage_heatmap_get_frames (PhocDamageHeatmap *self)
+{
+  g_assert (self);
+
+  return self->n_frames;
+}
+
+/**
+ * phoc_damage_heatmap_render:
+ * @self: The heatmap
+ * @ctx: The render context of the frame to draw the overlay in
+ *
+ * Draws the tiles that got damaged so far, colored by how often
+ * they got damaged, clipped to the frame's damage.
+ */
+void
+phoc_damage_heatmap_render (PhocDamageHeatmap *self, PhocRenderContext *ctx)
+{
+  pixman_region32_t clip;
+  pixman_box32_t *extents;
+  int x1, y1, x2, y2;
+
+  g_assert (self);
+
+  if (!self->max || !pixman_region32_not_empty (ctx->damage))
+    return;
+
+  extents = pixman_region32_extents (ctx->damage);
+  x1 = CLAMP (extents->x1, 0, self->width) / PHOC_DAMAGE_HEATMAP_TILE_SIZE;
+  y1 = CLAMP (extents->y1, 0, self->height) / PHOC_DAMAGE_HEATMAP_TILE_SIZE;
+  x2 = (CLAMP (extents->x2, 0, self->width) + PHOC_DAMAGE_HEATMAP_TILE_SIZE - 1) /
+    PHOC_DAMAGE_HEATMAP_TILE_SIZE;
+  y2 = (CLAMP (extents->y2, 0, self->height) + PHOC_DAMAGE_HEATMAP_TILE_SIZE - 1) /
+    PHOC_DAMAGE_HEATMAP_TILE_SIZE;
+
+  pixman_region32_init (&clip);
+  pixman_region32_copy (&clip, ctx->buffer_damage);
+
+  for (int y = y1; y < y2; y++) {
+    for (int x = x1; x < x2; x++) {
+      guint32 count = self->counts[y * self->cols + x];
+      struct wlr_box box;
+      float heat;
+
+      if (!count)
+        continue;
+
+      box = (struct wlr_box) {
+        .x = x * PHOC_DAMAGE_HEATMAP_TILE_SIZE,
+        .y = y * PHOC_DAMAGE_HEATMAP_TILE_SIZE,
+        .width = PHOC_DAMAGE_HEATMAP_TILE_SIZE,
+        .height = PHOC_DAMAGE_HEATMAP_TILE_SIZE,
+      };
+      phoc_output_transform_box (ctx->output, &box);
+
+      heat = (float)count / self->max;
+      wlr_render_pass_add_rect (ctx->render_pass, &(struct wlr_render_rect_options){
+          .box = box,
+          /* Premultiplied, from blue to red */
+          .color = { heat * HEATMAP_ALPHA, 0.0, (1.0 - heat) * HEATMAP_ALPHA, HEATMAP_ALPHA },
+          .clip = &clip,
+        });
+    }
+  }
+
+  pixman_region32_fini (&clip);
+}
+
+/**
+ * phoc_damage_heatmap_save:
+ * @self: The heatmap
+ * @path: The file to save the heatmap to
+ * @error: Return location for an error
+ *
+ * Saves the damage counts as binary PGM image with one pixel per tile.
+ * The most often damaged tile is white.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+phoc_damage_heatmap_save (PhocDamageHeatmap *self, const char *path, GError **error)
+{
+  g_autoptr (GString) data = NULL;
+  int n_tiles;
+
+  g_assert (self);
+  n_tiles = self->cols * self->rows;
+
+  if (!n_tiles) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED, "No damage recorded yet");
+    return FALSE;
+  }
+
+  data = g_string_sized_new (n_tiles + 32);
+  g_string_printf (data, "P5\n%d %d\n255\n", self->cols, self->rows);
+  for (int i = 0; i < n_tiles; i++) {
+    guint8 value = self->max ? (guint64)self->counts[i] * 255 / self->max : 0;
+
+    g_string_append_c (data, value);
+  }
+
+  return g_file_set_contents (path, data->str, data->len, error);
+}
+
+/**
+ * phoc_damage_heatmap_reset:
+ * @self: The heatmap
+ *
+ * Drops all damage counts.
+ */
+void
+phoc_damage_heatmap_reset (PhocDamageHeatmap *self)
+{
+  g_assert (self);
+
+  heatmap_resize (self, self->width, self->height);
+}
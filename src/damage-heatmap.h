@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "render.h"
+
+#include <glib.h>
+#include <pixman.h>
+
+G_BEGIN_DECLS
+
+/* Size of a heatmap tile in transformed output pixels */
+#define PHOC_DAMAGE_HEATMAP_TILE_SIZE 32
+
+typedef struct _PhocDamageHeatmap PhocDamageHeatmap;
+
+PhocDamageHeatmap *phoc_damage_heatmap_new        (void);
+void               phoc_damage_heatmap_free       (PhocDamageHeatmap       *self);
+void               phoc_damage_heatmap_add_damage (PhocDamageHeatmap       *self,
+                                                   const pixman_region32_t *damage,
+                                                   int                      width,
+                                                   int                      height);
+guint32            phoc_damage_heatmap_get_count  (PhocDamageHeatmap       *self,
+                                                   int                      x,
+                                                   int                      y);
+guint              phoc_damage_heatmap_get_frames (PhocDamageHeatmap       *self);
+void               phoc_damage_heatmap_render     (PhocDamageHeatmap       *self,
+                                                   PhocRenderContext       *ctx);
+gboolean           phoc_damage_heatmap_save       (PhocDamageHeatmap       *self,
+                                                   const char              *path,
+                                                   GError                 **error);
+void               phoc_damage_heatmap_reset      (PhocDamageHeatmap       *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocDamageHeatmap, phoc_damage_heatmap_free)
+
+G_END_DECLS
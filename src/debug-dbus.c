@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-debug-dbus"
+
+#include "phoc-config.h"
+
+#include "commit-stats.h"
+#include "damage-heatmap.h"
+#include "debug-dbus.h"
+#include "frame-stats.h"
+#include "input-latency.h"
+#include "input-trace.h"
+#include "memory-stats.h"
+#include "output.h"
+#include "server.h"
+#include "timeline-trace.h"
+
+#include <gio/gio.h>
+
+#define PHOC_DEBUG_DBUS_OBJECT_PATH "/mobi/phosh/Phoc/Debug"
+#define PHOC_DEBUG_DBUS_INTERFACE   "mobi.phosh.Phoc.Debug"
+
+static const char introspection_xml[] =
+  "<node>"
+  "  <interface name='" PHOC_DEBUG_DBUS_INTERFACE "'>"
+  "    <method name='GetFrameStats'>"
+  "      <arg type='a{sa{sv}}' name='stats' direction='out'/>"
+  "    </method>"
+  "    <method name='ResetFrameStats'/>"
+  "    <method name='GetInputLatency'>"
+  "      <arg type='a{sa{sv}}' name='clients' direction='out'/>"
+  "    </method>"
+  "    <method name='GetStartupPhases'>"
+  "      <arg type='a(sx)' name='phases' direction='out'/>"
+  "    </method>"
+  "    <method name='StartInputTrace'/>"
+  "    <method name='StopInputTrace'>"
+  "      <arg type='s' name='path' direction='in'/>"
+  "    </method>"
+  "    <method name='StartTimelineTrace'/>"
+  "    <method name='StopTimelineTrace'>"
+  "      <arg type='s' name='path' direction='in'/>"
+  "    </method>"
+  "    <method name='GetMemoryStats'>"
+  "      <arg type='a{sv}' name='stats' direction='out'/>"
+  "    </method>"
+  "    <method name='SetMemoryWarnThreshold'>"
+  "      <arg type='t' name='threshold' direction='in'/>"
+  "    </method>"
+  "    <method name='ReleaseMemory'>"
+  "      <arg type='t' name='released' direction='out'/>"
+  "    </method>"
+  "    <method name='SaveDamageHeatmap'>"
+  "      <arg type='s' name='output' direction='in'/>"
+  "      <arg type='s' name='path' direction='in'/>"
+  "    </method>"
+  "    <method name='GetCommitStats'>"
+  "      <arg type='a{sv}' name='stats' direction='out'/>"
+  "    </method>"
+  "    <method name='ResetCommitStats'/>"
+  "    <method name='GetClientBudgets'>"
+  "      <arg type='a{sv}' name='budgets' direction='out'/>"
+  "    </method>"
+  "  </interface>"
+  "</node>";
+
+/**
+ * PhocDebugDBus:
+ *
+ * Exposes compositor internal statistics on the session bus so they
+ * can be collected on devices without a tracing enabled build:
+ *
+ * ```sh
+ * gdbus call --session --dest mobi.phosh.Phoc \
+ *   --object-path /mobi/phosh/Phoc/Debug \
+ *   --method mobi.phosh.Phoc.Debug.GetFrameStats
+ * ```
+ *
+ * `GetStartupPhases` returns when startup phases like the first
+ * presented frame or the shell coming up were reached.
+ *
+ * `StartInputTrace` starts recording input events, `StopInputTrace`
+ * saves them as [struct@InputTrace] to the given path for replay.
+ *
+ * `StartTimelineTrace` starts recording the compositor's timeline,
+ * `StopTimelineTrace` saves it as Chrome JSON trace to the given path,
+ * see [struct@TimelineTrace].
+ *
+ * `GetMemoryStats` returns the buffer memory held per client and view
+ * as well as thumbnails, cutouts and cursor images, see
+ * [method@MemoryStats.to_variant]. `SetMemoryWarnThreshold` sets the
+ * per client warning threshold in bytes. `ReleaseMemory` releases
+ * caches like on memory pressure and returns the number of bytes freed.
+ *
+ * `SaveDamageHeatmap` saves the damage heatmap of the named output
+ * as PGM image to the given path, see [struct@DamageHeatmap]. This
+ * needs the `damage-heatmap` debug flag.
+ *
+ * `GetCommitStats` returns commit rates, damage per commit and buffer
+ * sizes per client, view and layer surface as well as how long clients'
+ * buffers are held, see [method@CommitStats.to_variant].
+ * `ResetCommitStats` drops them.
+ *
+ * `GetClientBudgets` returns the resource limits of clients, their
+ * current usage and refused requests, see
+ * [method@ClientBudget.to_variant].
+ */
+struct _PhocDebugDBus {
+  GObject          parent;
+
+  guint            owner_id;
+  guint            registration_id;
+  GDBusConnection *connection;
+  GDBusNodeInfo   *node_info;
+};
+
+G_DEFINE_TYPE (PhocDebugDBus, phoc_debug_dbus, G_TYPE_OBJECT)
+
+
+static GVariant *
+get_frame_stats (PhocDebugDBus *self)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  GVariantBuilder builder;
+  PhocOutput *output;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+
+  wl_list_for_each (output, &desktop->outputs, link) {
+    PhocFrameStats *stats = phoc_output_get_frame_stats (output);
+
+    g_variant_builder_add (&builder, "{s@a{sv}}",
+                           phoc_output_get_name (output),
+                           phoc_frame_stats_to_variant (stats));
+  }
+
+  return g_variant_new ("(a{sa{sv}})", &builder);
+}
+
+
+static void
+reset_frame_stats (PhocDebugDBus *self)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocInputLatency *latency = phoc_server_get_input_latency (server);
+  PhocOutput *output;
+
+  wl_list_for_each (output, &desktop->outputs, link)
+    phoc_frame_stats_reset (phoc_output_get_frame_stats (output));
+
+  if (latency)
+    phoc_input_latency_reset (latency);
+}
+
+
+static void
+get_input_latency (PhocDebugDBus *self, GDBusMethodInvocation *invocation)
+{
+  PhocInputLatency *latency = phoc_server_get_input_latency (phoc_server_get_default ());
+
+  if (!latency) {
+    g_dbus_method_invocation_return_error (invocation,
+                                           G_DBUS_ERROR,
+                                           G_DBUS_ERROR_NOT_SUPPORTED,
+                                           "Input latency tracking not enabled");
+    return;
+  }
+
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(@a{sa{sv}})",
+                                                        phoc_input_latency_clients_to_variant (latency)));
+}
+
+
+static void
+stop_input_trace (PhocDebugDBus *self, GVariant *parameters, GDBusMethodInvocation *invocation)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocInputTrace *trace = phoc_server_get_input_trace (server);
+  g_autoptr (GError) err = NULL;
+  const char *path;
+
+  if (!trace) {
+    g_dbus_method_invocation_return_error (invocation,
+                                           G_DBUS_ERROR,
+                                           G_DBUS_ERROR_FAILED,
+                                           "Input trace not started");
+    return;
+  }
+
+  g_variant_get (parameters, "(&s)", &path);
+  if (!phoc_input_trace_save (trace, path, &err)) {
+    g_dbus_method_invocation_return_gerror (invocation, err);
+    return;
+  }
+
+  phoc_server_set_input_trace (server, NULL);
+  g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+
+static void
+stop_timeline_trace (PhocDebugDBus *self, GVariant *parameters, GDBusMethodInvocation *invocation)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocTimelineTrace *trace = phoc_server_get_timeline_trace (server);
+  g_autoptr (GError) err = NULL;
+  const char *path;
+
+  if (!trace) {
+    g_dbus_method_invocation_return_error (invocation,
+                                           G_DBUS_ERROR,
+                                           G_DBUS_ERROR_FAILED,
+                                           "Timeline trace not started");
+    return;
+  }
+
+  g_variant_get (parameters, "(&s)", &path);
+  if (!phoc_timeline_trace_save (trace, path, &err)) {
+    g_dbus_method_invocation_return_gerror (invocation, err);
+    return;
+  }
+
+  phoc_server_set_timeline_trace (server, NULL);
+  g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+
+static void
+save_damage_heatmap (PhocDebugDBus *self, GVariant *parameters, GDBusMethodInvocation *invocation)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocDamageHeatmap *heatmap = NULL;
+  g_autoptr (GError) err = NULL;
+  const char *name, *path;
+  PhocOutput *output;
+
+  g_variant_get (parameters, "(&s&s)", &name, &path);
+
+  wl_list_for_each (output, &desktop->outputs, link) {
+    if (g_strcmp0 (output->wlr_output->name, name) == 0) {
+      heatmap = phoc_output_get_damage_heatmap (output);
+      break;
+    }
+  }
+
+  if (!heatmap) {
+    g_dbus_method_invocation_return_error (invocation,
+                                           G_DBUS_ERROR,
+                                           G_DBUS_ERROR_FAILED,
+                                           "No damage heatmap for output '%s'", name);
+    return;
+  }
+
+  if (!phoc_damage_heatmap_save (heatmap, path, &err)) {
+    g_dbus_method_invocation_return_gerror (invocation, err);
+    return;
+  }
+
+  g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+
+static void
+handle_method_call (GDBusConnection       *connection,
+                    const char            *sender,
+                    const char            *object_path,
+                    const char            *interface_name,
+                    const char            *method_name,
+                    GVariant              *parameters,
+                    GDBusMethodInvocation *invocation,
+                    gpointer               user_data)
+{
+  PhocDebugDBus *self = PHOC_DEBUG_DBUS (user_data);
+
+  if (g_strcmp0 (method_name, "GetFrameStats") == 0) {
+    g_dbus_method_invocation_return_value (invocation, get_frame_stats (self));
+  } else if (g_strcmp0 (method_name, "ResetFrameStats") == 0) {
+    reset_frame_stats (self);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+  } else if (g_strcmp0 (method_name, "GetInputLatency") == 0) {
+    get_input_latency (self, invocation);
+  } else if (g_strcmp0 (method_name, "GetStartupPhases") == 0) {
+    PhocServer *server = phoc_server_get_default ();
+
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new ("(@a(sx))",
+                                                          phoc_server_startup_phases_to_variant (server)));
+  } else if (g_strcmp0 (method_name, "StartInputTrace") == 0) {
+    phoc_server_set_input_trace (phoc_server_get_default (), phoc_input_trace_new ());
+    g_dbus_method_invocation_return_value (invocation, NULL);
+  } else if (g_strcmp0 (method_name, "StopInputTrace") == 0) {
+    stop_input_trace (self, parameters, invocation);
+  } else if (g_strcmp0 (method_name, "StartTimelineTrace") == 0) {
+    phoc_server_set_timeline_trace (phoc_server_get_default (), phoc_timeline_trace_new ());
+    g_dbus_method_invocation_return_value (invocation, NULL);
+  } else if (g_strcmp0 (method_name, "StopTimelineTrace") == 0) {
+    stop_timeline_trace (self, parameters, invocation);
+  } else if (g_strcmp0 (method_name, "GetMemoryStats") == 0) {
+    PhocMemoryStats *stats = phoc_server_get_memory_stats (phoc_server_get_default ());
+
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new ("(@a{sv})",
+                                                          phoc_memory_stats_to_variant (stats)));
+  } else if (g_strcmp0 (method_name, "SetMemoryWarnThreshold") == 0) {
+    PhocMemoryStats *stats = phoc_server_get_memory_stats (phoc_server_get_default ());
+    guint64 threshold;
+
+    g_variant_get (parameters, "(t)", &threshold);
+    phoc_memory_stats_set_warn_threshold (stats, threshold);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+  } else if (g_strcmp0 (method_name, "ReleaseMemory") == 0) {
+    PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new ("(t)",
+                                                          phoc_desktop_release_memory (desktop)));
+  } else if (g_strcmp0 (method_name, "SaveDamageHeatmap") == 0) {
+    save_damage_heatmap (self, parameters, invocation);
+  } else if (g_strcmp0 (method_name, "GetCommitStats") == 0) {
+    PhocCommitStats *stats = phoc_server_get_commit_stats (phoc_server_get_default ());
+
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new ("(@a{sv})",
+                                                          phoc_commit_stats_to_variant (stats)));
+  } else if (g_strcmp0 (method_name, "ResetCommitStats") == 0) {
+    phoc_commit_stats_reset (phoc_server_get_commit_stats (phoc_server_get_default ()));
+    g_dbus_method_invocation_return_value (invocation, NULL);
+  } else if (g_strcmp0 (method_name, "GetClientBudgets") == 0) {
+    PhocClientBudget *budget = phoc_server_get_client_budget (phoc_server_get_default ());
+
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new ("(@a{sv})",
+                                                          phoc_client_budget_to_variant (budget)));
+  } else {
+    g_dbus_method_invocation_return_error (invocation,
+                                           G_DBUS_ERROR,
+                                           G_DBUS_ERROR_UNKNOWN_METHOD,
+                                           "Unknown method %s", method_name);
+  }
+}
+
+
+static const GDBusInterfaceVTable interface_vtable = {
+  .method_call = handle_method_call,
+};
+
+
+static void
+on_bus_acquired (GDBusConnection *connection, const char *name, gpointer user_data)
+{
+  PhocDebugDBus *self = PHOC_DEBUG_DBUS (user_data);
+  g_autoptr (GError) err = NULL;
+
+  self->registration_id = g_dbus_connection_register_object (connection,
+                                                             PHOC_DEBUG_DBUS_OBJECT_PATH,
+                                                             self->node_info->interfaces[0],
+                                                             &interface_vtable,
+                                                             self,
+                                                             NULL,
+                                                             &err);
+  if (!self->registration_id) {
+    g_warning ("Failed to export debug interface: %s", err->message);
+    return;
+  }
+
+  self->connection = g_object_ref (connection);
+}
+
+
+static void
+on_name_lost (GDBusConnection *connection, const char *name, gpointer user_data)
+{
+  /* Not having a session bus is fine (e.g. in tests) */
+  g_debug ("Lost or failed to acquire name %s", name);
+}
+
+
+static void
+phoc_debug_dbus_dispose (GObject *object)
+{
+  PhocDebugDBus *self = PHOC_DEBUG_DBUS (object);
+
+  if (self->registration_id) {
+    g_dbus_connection_unregister_object (self->connection, self->registration_id);
+    self->registration_id = 0;
+  }
+  g_clear_object (&self->connection);
+  g_clear_handle_id (&self->owner_id, g_bus_unown_name);
+  g_clear_pointer (&self->node_info, g_dbus_node_info_unref);
+
+  G_OBJECT_CLASS (phoc_debug_dbus_parent_class)->dispose (object);
+}
+
+
+static void
+phoc_debug_dbus_class_init (PhocDebugDBusClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = phoc_debug_dbus_dispose;
+}
+
+
+static void
+phoc_debug_dbus_init (PhocDebugDBus *self)
+{
+  self->node_info = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+  g_assert (self->node_info);
+
+  self->owner_id = g_bus_own_name (G_BUS_TYPE_SESSION,
+                                   PHOC_APP_ID,
+                                   G_BUS_NAME_OWNER_FLAGS_NONE,
+                                   on_bus_acquired,
+                                   NULL,
+                                   on_name_lost,
+                                   self,
+                                   NULL);
+}
+
+
+PhocDebugDBus *
+phoc_debug_dbus_new (void)
+{
+  return g_object_new (PHOC_TYPE_DEBUG_DBUS, NULL);
+}
@@ -0,0 +1,19 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_DEBUG_DBUS (phoc_debug_dbus_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocDebugDBus, phoc_debug_dbus, PHOC, DEBUG_DBUS, GObject)
+
+PhocDebugDBus *phoc_debug_dbus_new (void);
+
+G_END_DECLS
@@ -5,6 +5,7 @@
 #define _POSIX_C_SOURCE 200112L
 #include <assert.h>
 #include <math.h>
+#include <malloc.h>
 #include <stdlib.h>
 #include <time.h>
 #include <wlr/config.h>
@@ -24,6 +25,7 @@
 #include <wlr/types/wlr_server_decoration.h>
 #include <wlr/types/wlr_single_pixel_buffer_v1.h>
 #include <wlr/types/wlr_tablet_v2.h>
+#include <wlr/types/wlr_tearing_control_v1.h>
 #include <wlr/types/wlr_viewporter.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_xdg_foreign_registry.h>
@@ -33,6 +35,7 @@
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/box.h>
 
+#include "bling.h"
 #include "cursor.h"
 #include "device-state.h"
 #include "idle-inhibit.h"
@@ -62,6 +65,7 @@
 #define PHOC_ANIM_ALWAYS_ON_TOP_COLOR_ON  (PhocColor){0.5f, 0.0f, 0.3f, 0.5f}
 #define PHOC_ANIM_ALWAYS_ON_TOP_COLOR_OFF (PhocColor){0.3f, 0.5f, 0.3f, 0.5f}
 #define PHOC_ANIM_ALWAYS_ON_TOP_WIDTH     10
+#define PHOC_ANIM_ALWAYS_ON_TOP_MAX_FPS   30
 
 /**
  * PhocDesktop:
@@ -76,19 +80,63 @@ enum {
 };
 static GParamSpec *props[PROP_LAST_PROP];
 
+/* Same as wlroots' default xdg-activation token timeout */
+#define PHOC_ACTIVATION_TOKEN_TIMEOUT_SEC 30
+
+typedef struct _PhocPendingActivation {
+  PhocView *view;
+  guint     timeout_id;
+} PhocPendingActivation;
+
 
 typedef struct _PhocDesktopPrivate {
   GQueue                *views;
+  /* Last always-on-top view in views */
+  GList                 *last_on_top;
 
   PhocIdleInhibit       *idle_inhibit;
+  PhocSessionLock       *session_lock;
 
   gboolean               enable_animations;
+  gboolean               magnifier_enabled;
+
+  /* Bumped whenever outputs get added, removed or moved */
+  guint                  layout_serial;
 
   GSettings             *settings;
   GSettings             *interface_settings;
+  GSettings             *a11y_settings;
+  GSettings             *magnifier_settings;
+  GMemoryMonitor        *memory_monitor;
+  GPowerProfileMonitor  *power_profile_monitor;
+  gboolean               power_saver;
+  PhocOutputStateCache  *output_state_cache;
+  PhocLayoutTransaction *layout_transaction;
+  PhocScene             *scene; /* (nullable): Only when using the scene graph */
+
+  /* Built-in output disabled while the lid is closed and where it was */
+  gboolean               lid_closed;
+  PhocOutput            *lid_disabled_output;
+  int                    lid_disabled_x, lid_disabled_y;
+
+  /* munged app-id → GSettings (weak) shared by the app's views */
+  GHashTable            *app_settings;
+  /* GSettings with changes not yet applied to views */
+  GHashTable            *pending_app_settings;
+  guint                  apply_app_settings_id;
+
+  /* activation token → PhocPendingActivation */
+  GHashTable            *pending_activations;
+
+  /* wl_client → PhocDesktopClient caching the client's role */
+  GHashTable            *clients;
+  /* Bumped whenever a client's role might have changed */
+  guint                  client_roles_serial;
 
   /* Protocols from wlroots */
   struct wlr_data_control_manager_v1 *data_control_manager_v1;
+  struct wlr_tearing_control_manager_v1 *tearing_control_manager_v1;
+  struct wlr_content_type_manager_v1 *content_type_manager_v1;
   struct wlr_idle_notifier_v1 *idle_notifier_v1;
   struct wlr_screencopy_manager_v1 *screencopy_manager_v1;
   struct wl_listener gamma_control_set_gamma;
@@ -105,6 +153,34 @@ typedef struct _PhocDesktopPrivate {
 G_DEFINE_TYPE_WITH_PRIVATE (PhocDesktop, phoc_desktop, G_TYPE_OBJECT);
 
 
+typedef struct {
+  PhocDesktop        *desktop;
+  struct wl_client   *wl_client;
+  struct wl_listener  destroy;
+  guint               serial;
+  gboolean            is_shell;
+} PhocDesktopClient;
+
+
+static void
+phoc_desktop_client_free (PhocDesktopClient *client)
+{
+  wl_list_remove (&client->destroy.link);
+  g_free (client);
+}
+
+
+static void
+handle_client_destroy (struct wl_listener *listener, void *data)
+{
+  PhocDesktopClient *client = wl_container_of (listener, client, destroy);
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (client->desktop);
+
+  /* Frees client */
+  g_hash_table_remove (priv->clients, client->wl_client);
+}
+
+
 static void
 phoc_desktop_set_property (GObject      *object,
                            guint         property_id,
@@ -148,6 +224,7 @@ view_at (PhocView *view, double lx, double ly, struct wlr_surface **surface, dou
 {
   double _sx, _sy;
   struct wlr_surface *_surface;
+  struct wlr_box bounds;
 
   if (!phoc_view_is_mapped (view))
     return false;
@@ -155,6 +232,11 @@ view_at (PhocView *view, double lx, double ly, struct wlr_surface **surface, dou
   double view_sx = lx / phoc_view_get_scale (view) - view->box.x;
   double view_sy = ly / phoc_view_get_scale (view) - view->box.y;
 
+  /* Cheap check before walking the surface tree */
+  if (phoc_view_get_input_bounds (view, &bounds) &&
+      !wlr_box_contains_point (&bounds, view_sx, view_sy))
+    return false;
+
   _surface = phoc_view_get_wlr_surface_at (view, view_sx, view_sy, &_sx, &_sy);
   if (_surface != NULL) {
     if (sx)
@@ -247,12 +329,34 @@ phoc_desktop_wlr_surface_at (PhocDesktop *desktop,
 {
   struct wlr_surface *surface = NULL;
   PhocOutput *output = phoc_desktop_layout_get_output (desktop, lx, ly);
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (desktop);
   double ox = lx, oy = ly;
   if (view)
     *view = NULL;
 
-  if (output)
-    wlr_output_layout_output_coords (desktop->layout, output->wlr_output, &ox, &oy);
+  if (output) {
+    ox -= output->layout_box.x;
+    oy -= output->layout_box.y;
+  }
+
+  /* Nothing but the lock screen while locked */
+  if (G_UNLIKELY (phoc_session_lock_is_locked (priv->session_lock))) {
+    if (!output)
+      return NULL;
+
+    surface = phoc_session_lock_get_surface (priv->session_lock, output);
+    if (!surface)
+      return NULL;
+
+    return wlr_surface_surface_at (surface, ox, oy, sx, sy);
+  }
+
+  /* Input should hit what the magnifier shows at that point */
+  if (output) {
+    phoc_output_magnifier_map_point (output, &lx, &ly);
+    ox = lx - output->layout_box.x;
+    oy = ly - output->layout_box.y;
+  }
 
   /* Layers above regular views */
   if (output) {
@@ -364,11 +468,18 @@ handle_layout_change (struct wl_listener *listener, void *data)
   PhocOutput *output;
 
   self = wl_container_of (listener, self, layout_change);
+  priv = phoc_desktop_get_instance_private (self);
+  priv->layout_serial++;
+
+  wl_list_for_each (output, &self->outputs, link)
+    phoc_output_update_layout_box (output);
+  if (priv->idle_inhibit)
+    phoc_idle_inhibit_queue_update (priv->idle_inhibit);
+
   center_output = wlr_output_layout_get_center_output (self->layout);
   if (center_output == NULL)
     return;
 
-  priv = phoc_desktop_get_instance_private (self);
   wlr_output_layout_get_box (self->layout, center_output, &center_output_box);
   center_x = center_output_box.x + center_output_box.width / 2;
   center_y = center_output_box.y + center_output_box.height / 2;
@@ -477,6 +588,268 @@ on_enable_animations_changed (PhocDesktop *self,
 }
 
 
+static void
+on_magnifier_changed (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+  PhocOutput *output;
+  double zoom;
+
+  priv->magnifier_enabled = g_settings_get_boolean (priv->a11y_settings,
+                                                    "screen-magnifier-enabled");
+  zoom = priv->magnifier_enabled ? g_settings_get_double (priv->magnifier_settings, "mag-factor") : 1.0;
+
+  wl_list_for_each (output, &self->outputs, link)
+    phoc_output_set_magnifier_zoom (output, zoom);
+}
+
+
+static gchar *
+munge_app_id (const gchar *app_id)
+{
+  gchar *id = g_strdup (app_id);
+  gint i;
+
+  g_strcanon (id,
+              "0123456789"
+              "abcdefghijklmnopqrstuvwxyz"
+              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+              "-",
+              '-');
+  for (i = 0; id[i] != '\0'; i++)
+    id[i] = g_ascii_tolower (id[i]);
+
+  return id;
+}
+
+
+static void
+pending_activation_free (gpointer data)
+{
+  PhocPendingActivation *pending = data;
+
+  g_clear_handle_id (&pending->timeout_id, g_source_remove);
+  g_free (pending);
+}
+
+
+static gboolean
+on_pending_activation_timeout (gpointer data)
+{
+  PhocPendingActivation *pending = data;
+
+  pending->timeout_id = 0;
+  g_debug ("Activation token of view %p expired", pending->view);
+  /* Untracks the token, freeing pending */
+  phoc_view_set_activation_token (pending->view, NULL, -1);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+on_apply_app_settings (gpointer data)
+{
+  PhocDesktop *self = PHOC_DESKTOP (data);
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+
+  priv->apply_app_settings_id = 0;
+
+  for (GList *l = priv->views->head; l; l = l->next) {
+    PhocView *view = PHOC_VIEW (l->data);
+    GSettings *settings = phoc_view_get_app_settings (view);
+
+    if (!settings || !g_hash_table_contains (priv->pending_app_settings, settings))
+      continue;
+
+    phoc_view_set_scale_to_fit (view, g_settings_get_boolean (settings, "scale-to-fit"));
+  }
+
+  g_hash_table_remove_all (priv->pending_app_settings);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+on_app_settings_changed (PhocDesktop *self, const char *key, GSettings *settings)
+{
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+
+  g_hash_table_add (priv->pending_app_settings, g_object_ref (settings));
+
+  if (priv->apply_app_settings_id)
+    return;
+
+  /* Apply once for all views and a burst of changes */
+  priv->apply_app_settings_id = g_idle_add (on_apply_app_settings, self);
+  g_source_set_name_by_id (priv->apply_app_settings_id, "[phoc] apply app settings");
+}
+
+
+static gboolean
+app_settings_is (gpointer key, gpointer value, gpointer user_data)
+{
+  return value == user_data;
+}
+
+
+static void
+on_app_settings_finalized (gpointer data, GObject *where_the_object_was)
+{
+  PhocDesktop *self = PHOC_DESKTOP (data);
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+
+  g_hash_table_foreach_remove (priv->app_settings, app_settings_is, where_the_object_was);
+}
+
+
+static void
+on_low_memory_warning (PhocDesktop                *self,
+                       GMemoryMonitorWarningLevel  level,
+                       GMemoryMonitor             *monitor)
+{
+  guint64 released;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+
+  released = phoc_desktop_release_memory (self);
+  g_message ("Low memory warning (level %d), released %" G_GUINT64_FORMAT " KiB",
+             level, released / 1024);
+}
+
+
+/*
+ * Follow power-profiles-daemon's power saver mode. That's also what
+ * it switches to on low battery if configured so battery levels
+ * don't need to be tracked separately.
+ */
+static void
+on_power_saver_changed (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+  PhocServer *server = phoc_server_get_default ();
+  PhocOutput *output;
+  gboolean power_saver;
+
+  power_saver = g_power_profile_monitor_get_power_saver_enabled (priv->power_profile_monitor);
+  if (priv->power_saver == power_saver)
+    return;
+
+  g_debug ("Power saver %s", power_saver ? "enabled" : "disabled");
+  priv->power_saver = power_saver;
+
+  phoc_timed_animation_set_power_saving (power_saver);
+  phoc_server_set_power_saver (server, power_saver);
+
+  wl_list_for_each (output, &self->outputs, link) {
+    phoc_output_set_power_saver (output, power_saver);
+    /* Add or remove the debug overlays */
+    phoc_output_damage_whole (output);
+  }
+}
+
+
+static gboolean
+has_external_output (PhocDesktop *self)
+{
+  PhocOutput *output;
+
+  wl_list_for_each (output, &self->outputs, link) {
+    if (phoc_output_is_builtin (output) || !output->wlr_output->enabled)
+      continue;
+
+    /* Outputs being destroyed are already gone from the layout */
+    if (wlr_output_layout_get (self->layout, output->wlr_output))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/**
+ * phoc_desktop_update_lid_policy:
+ * @self: The desktop
+ *
+ * With the lid closed and an external display attached nobody can see
+ * the built-in panel so disable it. This frees the GPU for the external
+ * display and moves the views off the panel as it leaves the layout.
+ *
+ * Needs to be called whenever outputs get enabled or disabled.
+ */
+void
+phoc_desktop_update_lid_policy (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv;
+  struct wlr_output_state pending;
+  PhocOutput *builtin;
+  gboolean enable;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  if (priv->lid_disabled_output) {
+    if (priv->lid_closed && has_external_output (self))
+      return;
+
+    builtin = priv->lid_disabled_output;
+    g_clear_weak_pointer (&priv->lid_disabled_output);
+    /* Someone else enabled it meanwhile */
+    if (builtin->wlr_output->enabled)
+      return;
+
+    enable = TRUE;
+  } else {
+    if (!priv->lid_closed || !has_external_output (self))
+      return;
+
+    builtin = phoc_desktop_get_builtin_output (self);
+    if (builtin == NULL || !builtin->wlr_output->enabled)
+      return;
+
+    enable = FALSE;
+  }
+
+  g_debug ("Lid %s, %s built-in output %s", priv->lid_closed ? "closed" : "opened",
+           enable ? "enabling" : "disabling", builtin->wlr_output->name);
+
+  wlr_output_state_init (&pending);
+  wlr_output_state_set_enabled (&pending, enable);
+
+  if (enable) {
+    wlr_output_layout_add (self->layout, builtin->wlr_output,
+                           priv->lid_disabled_x, priv->lid_disabled_y);
+  } else {
+    priv->lid_disabled_x = builtin->lx;
+    priv->lid_disabled_y = builtin->ly;
+    wlr_output_layout_remove (self->layout, builtin->wlr_output);
+  }
+
+  if (!wlr_output_commit_state (builtin->wlr_output, &pending)) {
+    g_warning ("Failed to %s built-in output %s", enable ? "enable" : "disable",
+               builtin->wlr_output->name);
+    if (!enable) {
+      wlr_output_layout_add (self->layout, builtin->wlr_output,
+                             priv->lid_disabled_x, priv->lid_disabled_y);
+    }
+    wlr_output_state_finish (&pending);
+    return;
+  }
+  wlr_output_state_finish (&pending);
+
+  if (!enable)
+    g_set_weak_pointer (&priv->lid_disabled_output, builtin);
+}
+
+/* All views resized, show them in one go */
+static void
+on_layout_transaction_done (PhocDesktop *self)
+{
+  PhocOutput *output;
+
+  wl_list_for_each (output, &self->outputs, link)
+    phoc_output_damage_whole (output);
+}
 
 #ifdef PHOC_XWAYLAND
 static const char *atom_map[XWAYLAND_ATOM_LAST] = {
@@ -484,6 +857,30 @@ static const char *atom_map[XWAYLAND_ATOM_LAST] = {
         "_NET_WM_WINDOW_TYPE_DIALOG"
 };
 
+/*
+ * Loading the cursor theme is expensive so only do it once Xwayland
+ * started up which it does lazily when the first X client connects.
+ */
+static void
+set_xwayland_cursor (PhocDesktop *self)
+{
+  struct wlr_xcursor *xcursor;
+
+  if (!wlr_xcursor_manager_load (self->xcursor_manager, 1)) {
+    g_critical ("Cannot load XWayland XCursor theme");
+    return;
+  }
+
+  xcursor = wlr_xcursor_manager_get_xcursor (self->xcursor_manager, PHOC_XCURSOR_DEFAULT, 1);
+  if (xcursor != NULL) {
+    struct wlr_xcursor_image *image = xcursor->images[0];
+    wlr_xwayland_set_cursor (self->xwayland, image->buffer,
+                             image->width * 4, image->width, image->height, image->hotspot_x,
+                             image->hotspot_y);
+  }
+}
+
+
 static void
 handle_xwayland_ready (struct wl_listener *listener,
                        void               *data)
@@ -525,6 +922,7 @@ handle_xwayland_ready (struct wl_listener *listener,
   if (desktop->xwayland != NULL) {
     PhocSeat *xwayland_seat = phoc_input_get_seat (input, PHOC_CONFIG_DEFAULT_SEAT_NAME);
     wlr_xwayland_set_seat (desktop->xwayland, xwayland_seat->seat);
+    set_xwayland_cursor (desktop);
   }
 #endif
 
@@ -563,26 +961,23 @@ handle_xwayland_surface (struct wl_listener *listener, void *data)
 static void
 on_output_destroyed (PhocDesktop *self, PhocOutput *destroyed_output)
 {
-  PhocOutput *output;
-  char *input_name;
-  GHashTableIter iter;
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
 
   g_assert (PHOC_IS_DESKTOP (self));
   g_assert (PHOC_IS_OUTPUT (destroyed_output));
 
   wlr_output_layout_remove (self->layout, phoc_output_get_wlr_output (destroyed_output));
+  phoc_session_lock_remove_output (priv->session_lock, destroyed_output);
+
+  /* Only the devices mapped to the output need a new mapping */
+  for (GSList *elem = input ? phoc_input_get_seats (input) : NULL; elem; elem = elem->next)
+    phoc_seat_remove_output_mappings (PHOC_SEAT (elem->data), destroyed_output);
 
-  g_hash_table_iter_init (&iter, self->input_output_map);
-  while (g_hash_table_iter_next (&iter, (gpointer) &input_name,
-                                 (gpointer) &output)) {
-    if (destroyed_output == output) {
-      g_debug ("Removing mapping for input device '%s' to output '%s'",
-               input_name, output->wlr_output->name);
-      g_hash_table_remove (self->input_output_map, input_name);
-      break;
-    }
-  }
   g_object_unref (destroyed_output);
+
+  /* The external display might be gone */
+  phoc_desktop_update_lid_policy (self);
 }
 
 static void
@@ -590,6 +985,7 @@ handle_new_output (struct wl_listener *listener, void *data)
 {
   g_autoptr (GError) error = NULL;
   PhocDesktop *self = wl_container_of (listener, self, new_output);
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
   PhocOutput *output = phoc_output_new (self, (struct wlr_output *)data, &error);
 
   if (output == NULL) {
@@ -600,6 +996,14 @@ handle_new_output (struct wl_listener *listener, void *data)
   g_signal_connect_swapped (output, "output-destroyed",
                             G_CALLBACK (on_output_destroyed),
                             self);
+
+  phoc_output_set_power_saver (output, priv->power_saver);
+  if (priv->magnifier_enabled) {
+    phoc_output_set_magnifier_zoom (output, g_settings_get_double (priv->magnifier_settings,
+                                                                   "mag-factor"));
+  }
+
+  phoc_desktop_update_lid_policy (self);
 }
 
 
@@ -607,7 +1011,6 @@ static void
 phoc_desktop_setup_xwayland (PhocDesktop *self)
 {
 #ifdef PHOC_XWAYLAND
-  const char *cursor_default = PHOC_XCURSOR_DEFAULT;
   PhocServer *server = phoc_server_get_default ();
   PhocConfig *config = phoc_server_get_config (server);
 
@@ -617,10 +1020,28 @@ phoc_desktop_setup_xwayland (PhocDesktop *self)
   if (config->xwayland) {
     struct wl_display *wl_display = phoc_server_get_wl_display (server);
     struct wlr_compositor *wlr_compositor = phoc_server_get_compositor (server);
+    struct wlr_xwayland_server_options options = {
+      .lazy = config->xwayland_lazy,
+      .enable_wm = true,
+      /*
+       * Only a lazily started server gets started again on demand. A
+       * delay of 0 keeps it running.
+       */
+      .terminate_delay = config->xwayland_lazy ? config->xwayland_idle_timeout : 0,
+    };
+
+    self->xwayland_server = wlr_xwayland_server_create (wl_display, &options);
+    if (!self->xwayland_server) {
+      g_critical ("Failed to initialize Xwayland server");
+      g_unsetenv ("DISPLAY");
+      return;
+    }
 
-    self->xwayland = wlr_xwayland_create (wl_display, wlr_compositor, config->xwayland_lazy);
+    self->xwayland = wlr_xwayland_create_with_server (wl_display, wlr_compositor,
+                                                      self->xwayland_server);
     if (!self->xwayland) {
       g_critical ("Failed to initialize Xwayland");
+      g_clear_pointer (&self->xwayland_server, wlr_xwayland_server_destroy);
       g_unsetenv ("DISPLAY");
       return;
     }
@@ -635,19 +1056,6 @@ phoc_desktop_setup_xwayland (PhocDesktop *self)
     self->xwayland_remove_startup_id.notify = handle_xwayland_remove_startup_id;
 
     g_setenv ("DISPLAY", self->xwayland->display_name, true);
-
-    if (!wlr_xcursor_manager_load (self->xcursor_manager, 1))
-      g_critical ("Cannot load XWayland XCursor theme");
-
-    struct wlr_xcursor *xcursor = wlr_xcursor_manager_get_xcursor (self->xcursor_manager,
-                                                                   cursor_default,
-                                                                   1);
-    if (xcursor != NULL) {
-      struct wlr_xcursor_image *image = xcursor->images[0];
-      wlr_xwayland_set_cursor (self->xwayland, image->buffer,
-                               image->width * 4, image->width, image->height, image->hotspot_x,
-                               image->hotspot_y);
-    }
   }
 #endif
 }
@@ -661,6 +1069,8 @@ phoc_desktop_constructed (GObject *object)
   PhocServer *server = phoc_server_get_default ();
   struct wl_display *wl_display = phoc_server_get_wl_display (server);
   struct wlr_backend *wlr_backend = phoc_server_get_backend (server);
+  PhocConfig *config = phoc_server_get_config (server);
+  g_autofree char *state_path = NULL;
 
   G_OBJECT_CLASS (phoc_desktop_parent_class)->constructed (object);
 
@@ -709,6 +1119,7 @@ phoc_desktop_constructed (GObject *object)
 
   priv->idle_notifier_v1 = wlr_idle_notifier_v1_create (wl_display);
   priv->idle_inhibit = phoc_idle_inhibit_create ();
+  priv->session_lock = phoc_session_lock_new (wl_display);
 
   priv->gtk_shell = phoc_gtk_shell_create (self, wl_display);
   priv->phosh = phoc_phosh_private_new ();
@@ -763,6 +1174,8 @@ phoc_desktop_constructed (GObject *object)
                  &self->output_power_manager_set_mode);
 
   priv->data_control_manager_v1 = wlr_data_control_manager_v1_create (wl_display);
+  priv->tearing_control_manager_v1 = wlr_tearing_control_manager_v1_create (wl_display, 1);
+  priv->content_type_manager_v1 = wlr_content_type_manager_v1_create (wl_display, 1);
 
   /* sm.puri.phoc settings */
   priv->settings = g_settings_new ("sm.puri.phoc");
@@ -771,6 +1184,39 @@ phoc_desktop_constructed (GObject *object)
   auto_maximize_changed_cb (self, "auto-maximize", priv->settings);
   g_settings_bind (priv->settings, "scale-to-fit", self, "scale-to-fit", G_SETTINGS_BIND_DEFAULT);
 
+  priv->app_settings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  priv->pending_app_settings = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                      g_object_unref, NULL);
+  priv->clients = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                         (GDestroyNotify)phoc_desktop_client_free);
+  priv->pending_activations = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                     g_free, pending_activation_free);
+
+  state_path = g_build_filename (g_get_user_state_dir (), "phoc", "outputs.ini", NULL);
+  priv->output_state_cache = phoc_output_state_cache_new (state_path);
+
+  priv->layout_transaction = phoc_layout_transaction_new ();
+  g_signal_connect_swapped (priv->layout_transaction, "done",
+                            G_CALLBACK (on_layout_transaction_done), self);
+
+  if (config->scene_graph) {
+    g_message ("Compositing outputs with the scene graph");
+    priv->scene = phoc_scene_new ();
+  }
+
+  priv->memory_monitor = g_memory_monitor_dup_default ();
+  g_signal_connect_object (priv->memory_monitor, "low-memory-warning",
+                           G_CALLBACK (on_low_memory_warning), self,
+                           G_CONNECT_SWAPPED);
+
+  priv->power_profile_monitor = g_power_profile_monitor_dup_default ();
+  if (priv->power_profile_monitor) {
+    g_signal_connect_object (priv->power_profile_monitor, "notify::power-saver-enabled",
+                             G_CALLBACK (on_power_saver_changed), self,
+                             G_CONNECT_SWAPPED);
+    on_power_saver_changed (self);
+  }
+
   /* org.gnome.desktop.interface settings */
   priv->interface_settings = g_settings_new ("org.gnome.desktop.interface");
   if (phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS)) {
@@ -780,6 +1226,15 @@ phoc_desktop_constructed (GObject *object)
                               G_CALLBACK (on_enable_animations_changed), self);
     on_enable_animations_changed (self, "enable-animations", priv->interface_settings);
   }
+
+  /* Accessibility settings */
+  priv->a11y_settings = g_settings_new ("org.gnome.desktop.a11y.applications");
+  g_signal_connect_swapped (priv->a11y_settings, "changed::screen-magnifier-enabled",
+                            G_CALLBACK (on_magnifier_changed), self);
+  priv->magnifier_settings = g_settings_new ("org.gnome.desktop.a11y.magnifier");
+  g_signal_connect_swapped (priv->magnifier_settings, "changed::mag-factor",
+                            G_CALLBACK (on_magnifier_changed), self);
+  on_magnifier_changed (self);
 }
 
 
@@ -789,6 +1244,7 @@ phoc_desktop_finalize (GObject *object)
   PhocDesktop *self = PHOC_DESKTOP (object);
   PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
 
+  g_clear_weak_pointer (&priv->lid_disabled_output);
   g_clear_pointer (&priv->views, g_queue_free);
 
   /* TODO: currently destroys the backend before the desktop */
@@ -802,6 +1258,7 @@ phoc_desktop_finalize (GObject *object)
   wl_list_remove (&self->pointer_constraint.link);
   wl_list_remove (&self->output_manager_apply.link);
   wl_list_remove (&self->output_manager_test.link);
+  g_clear_pointer (&self->output_manager_test_key, g_free);
   wl_list_remove (&self->output_power_manager_set_mode.link);
   wl_list_remove (&self->xdg_activation_v1_request_activate.link);
 
@@ -817,9 +1274,11 @@ phoc_desktop_finalize (GObject *object)
   // We need to shutdown Xwayland before disconnecting all clients, otherwise
   // wlroots will restart it automatically.
   g_clear_pointer (&self->xwayland, wlr_xwayland_destroy);
+  g_clear_pointer (&self->xwayland_server, wlr_xwayland_server_destroy);
 #endif
 
   g_clear_pointer (&priv->idle_inhibit, phoc_idle_inhibit_destroy);
+  g_clear_pointer (&priv->session_lock, phoc_session_lock_free);
   g_clear_object (&priv->phosh);
   g_clear_pointer (&priv->gtk_shell, phoc_gtk_shell_destroy);
   g_clear_object (&priv->layer_shell_effects);
@@ -829,7 +1288,27 @@ phoc_desktop_finalize (GObject *object)
   g_hash_table_remove_all (self->input_output_map);
   g_hash_table_unref (self->input_output_map);
 
+  g_clear_handle_id (&priv->apply_app_settings_id, g_source_remove);
+  g_clear_pointer (&priv->pending_app_settings, g_hash_table_destroy);
+  g_clear_pointer (&priv->pending_activations, g_hash_table_destroy);
+  g_clear_pointer (&priv->clients, g_hash_table_destroy);
+  if (priv->app_settings) {
+    GHashTableIter iter;
+    GSettings *settings;
+
+    g_hash_table_iter_init (&iter, priv->app_settings);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&settings))
+      g_object_weak_unref (G_OBJECT (settings), on_app_settings_finalized, self);
+    g_clear_pointer (&priv->app_settings, g_hash_table_destroy);
+  }
+  g_clear_object (&priv->memory_monitor);
+  g_clear_object (&priv->power_profile_monitor);
+  g_clear_pointer (&priv->output_state_cache, phoc_output_state_cache_free);
+  g_clear_object (&priv->layout_transaction);
+  g_clear_pointer (&priv->scene, phoc_scene_free);
   g_clear_object (&priv->interface_settings);
+  g_clear_object (&priv->a11y_settings);
+  g_clear_object (&priv->magnifier_settings);
   g_clear_object (&priv->settings);
 
   G_OBJECT_CLASS (phoc_desktop_parent_class)->finalize (object);
@@ -902,6 +1381,8 @@ phoc_desktop_set_auto_maximize (PhocDesktop *self, gboolean enable)
 
   g_debug ("auto-maximize: %d", enable);
   self->maximize = enable;
+  if (priv->idle_inhibit)
+    phoc_idle_inhibit_queue_update (priv->idle_inhibit);
 
   /* Disabling auto-maximize leaves all views in their current position */
   if (!enable) {
@@ -973,6 +1454,46 @@ phoc_desktop_get_enable_animations (PhocDesktop *self)
   return priv->enable_animations;
 }
 
+/**
+ * phoc_desktop_get_magnifier_enabled:
+ * @self: The desktop
+ *
+ * Checks whether the user enabled the screen magnifier.
+ *
+ * Returns: Whether the magnifier is enabled
+ */
+gboolean
+phoc_desktop_get_magnifier_enabled (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  return priv->magnifier_enabled;
+}
+
+/**
+ * phoc_desktop_get_layout_serial:
+ * @self: The desktop
+ *
+ * Gets a number that changes whenever outputs are added to, removed
+ * from or moved within the output layout. This allows to cache
+ * information that depends on the output layout.
+ *
+ * Returns: The layout serial
+ */
+guint
+phoc_desktop_get_layout_serial (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  return priv->layout_serial;
+}
+
 /**
  * phoc_desktop_find_output:
  * @self: The desktop
@@ -1075,6 +1596,74 @@ phoc_desktop_layer_surface_at (PhocDesktop *self, double lx, double ly, double *
 }
 
 
+/**
+ * phoc_desktop_set_lid_closed:
+ * @self: The desktop
+ * @closed: Whether the lid is closed
+ *
+ * Tells the desktop about (debounced) lid state changes. The built-in
+ * output is disabled while the lid is closed and an external display
+ * is enabled.
+ */
+void
+phoc_desktop_set_lid_closed (PhocDesktop *self, gboolean closed)
+{
+  PhocDesktopPrivate *priv;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  if (priv->lid_closed == closed)
+    return;
+
+  priv->lid_closed = closed;
+  phoc_desktop_update_lid_policy (self);
+}
+
+/**
+ * phoc_desktop_surface_wants_tearing:
+ * @self: The desktop
+ * @wlr_surface: The surface to check
+ *
+ * Whether the client prefers its frames to be presented right away
+ * over tear free presentation via the tearing control protocol.
+ *
+ * Returns: %TRUE if the surface asked for async presentation
+ */
+gboolean
+phoc_desktop_surface_wants_tearing (PhocDesktop *self, struct wlr_surface *wlr_surface)
+{
+  PhocDesktopPrivate *priv;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  return wlr_tearing_control_manager_v1_surface_hint_from_surface (priv->tearing_control_manager_v1,
+                                                                   wlr_surface) ==
+    WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC;
+}
+
+/**
+ * phoc_desktop_get_content_type:
+ * @self: The desktop
+ * @wlr_surface: The surface to check
+ *
+ * The kind of content the client says the surface shows via the
+ * content type protocol.
+ *
+ * Returns: The surface's content type
+ */
+enum wp_content_type_v1_type
+phoc_desktop_get_content_type (PhocDesktop *self, struct wlr_surface *wlr_surface)
+{
+  PhocDesktopPrivate *priv;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  return wlr_surface_get_content_type_v1 (priv->content_type_manager_v1, wlr_surface);
+}
+
 /**
  * phoc_desktop_get_builtin_output:
  *
@@ -1209,11 +1798,18 @@ void
 phoc_desktop_notify_activity (PhocDesktop *self, PhocSeat *seat)
 {
   PhocDesktopPrivate *priv;
+  PhocOutput *output;
 
   g_assert (PHOC_IS_DESKTOP (self));
   priv = phoc_desktop_get_instance_private (self);
 
+  if (phoc_seat_throttle_activity (seat))
+    return;
+
   wlr_idle_notifier_v1_notify_activity (priv->idle_notifier_v1, seat->seat);
+
+  wl_list_for_each (output, &self->outputs, link)
+    phoc_output_notify_activity (output);
 }
 
 gboolean
@@ -1238,6 +1834,7 @@ phoc_desktop_is_privileged_protocol (PhocDesktop *self, const struct wl_global *
     global == self->output_manager_v1->global ||
     global == self->output_power_manager_v1->global ||
     global == self->security_context_manager_v1->global ||
+    global == phoc_session_lock_get_global (priv->session_lock) ||
     global == self->virtual_keyboard->global ||
     global == self->virtual_pointer->global
     );
@@ -1245,6 +1842,92 @@ phoc_desktop_is_privileged_protocol (PhocDesktop *self, const struct wl_global *
   return is_priv;
 }
 
+static gboolean
+client_is_shell (PhocDesktop *self, struct wl_client *client)
+{
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+  struct wlr_input_method_v2 *input_method;
+
+  if (client == phoc_phosh_private_get_client (priv->phosh) ||
+      phoc_layer_shell_effects_has_client (priv->layer_shell_effects, client))
+    return TRUE;
+
+  wl_list_for_each (input_method, &self->input_method->input_methods, link) {
+    if (wl_resource_get_client (input_method->resource) == client)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/**
+ * phoc_desktop_invalidate_client_priorities:
+ * @self: The desktop
+ *
+ * Clients bound to or unbound from a protocol that makes them part of
+ * the shell, see [method@Desktop.get_client_priority].
+ */
+void
+phoc_desktop_invalidate_client_priorities (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  priv->client_roles_serial++;
+}
+
+/**
+ * phoc_desktop_get_client_priority:
+ * @self: The desktop
+ * @client: The client
+ *
+ * Clients bound to the privileged protocols phoc implements itself
+ * like the shell, input methods like the on screen keyboard and the
+ * client of the focused view are served before other clients.
+ *
+ * Returns: The priority of @client
+ */
+PhocClientPriority
+phoc_desktop_get_client_priority (PhocDesktop *self, struct wl_client *client)
+{
+  PhocSeat *seat = phoc_server_get_last_active_seat (phoc_server_get_default ());
+  PhocDesktopPrivate *priv;
+  PhocDesktopClient *desktop_client;
+  PhocView *view;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  /* This runs for every client before each dispatch so cache the role */
+  desktop_client = g_hash_table_lookup (priv->clients, client);
+  if (!desktop_client) {
+    desktop_client = g_new0 (PhocDesktopClient, 1);
+    desktop_client->desktop = self;
+    desktop_client->wl_client = client;
+    desktop_client->serial = priv->client_roles_serial - 1;
+    desktop_client->destroy.notify = handle_client_destroy;
+    wl_client_add_destroy_listener (client, &desktop_client->destroy);
+    g_hash_table_insert (priv->clients, client, desktop_client);
+  }
+
+  if (desktop_client->serial != priv->client_roles_serial) {
+    desktop_client->is_shell = client_is_shell (self, client);
+    desktop_client->serial = priv->client_roles_serial;
+  }
+
+  if (desktop_client->is_shell)
+    return PHOC_CLIENT_PRIORITY_SHELL;
+
+  /* Cheap enough to not need caching and follows every focus change */
+  view = seat ? phoc_seat_get_focus_view (seat) : NULL;
+  if (view && view->wlr_surface && wl_resource_get_client (view->wlr_surface->resource) == client)
+    return PHOC_CLIENT_PRIORITY_FOREGROUND;
+
+  return PHOC_CLIENT_PRIORITY_BACKGROUND;
+}
+
 /**
  * phoc_desktop_get_views:
  * @self: the desktop
@@ -1265,6 +1948,88 @@ phoc_desktop_get_views (PhocDesktop *self)
   return priv->views;
 }
 
+
+static void
+unlink_view (PhocDesktop *self, GList *view_link)
+{
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+
+  /* The always-on-top views are a prefix of the stack */
+  if (priv->last_on_top == view_link)
+    priv->last_on_top = view_link->prev;
+
+  g_queue_unlink (priv->views, view_link);
+}
+
+
+static void
+add_surface_extents_iterator (PhocOutput         *output,
+                              struct wlr_surface *surface,
+                              struct wlr_box     *box,
+                              float               scale,
+                              void               *data)
+{
+  pixman_region32_t *region = data;
+
+  pixman_region32_union_rect (region, region,
+                              box->x + output->layout_box.x,
+                              box->y + output->layout_box.y,
+                              box->width, box->height);
+}
+
+/*
+ * Adds what @view draws in layout coordinates. This includes
+ * subsurfaces and popups that extend beyond the view's box.
+ */
+static void
+add_view_extents (PhocDesktop *self, pixman_region32_t *region, PhocView *view)
+{
+  PhocOutput *output;
+  struct wlr_box box;
+
+  wl_list_for_each (output, &self->outputs, link)
+    phoc_output_view_for_each_surface (output, view, add_surface_extents_iterator, region);
+
+  for (GSList *l = phoc_view_get_blings (view); l; l = l->next) {
+    box = phoc_bling_get_box (PHOC_BLING (l->data));
+    pixman_region32_union_rect (region, region, box.x, box.y, box.width, box.height);
+  }
+}
+
+/*
+ * Collects the area of @view that is covered by views in front of it
+ * but won't be anymore once it got raised. Returns %FALSE if @view
+ * moves down the stack instead and the caller needs to damage it as
+ * a whole.
+ */
+static gboolean
+get_exposed_region (PhocDesktop *self, PhocView *view, gboolean on_top, pixman_region32_t *exposed)
+{
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+  gboolean in_prefix = !!priv->last_on_top;
+  pixman_region32_t stays_above;
+
+  pixman_region32_init (&stays_above);
+
+  for (GList *l = priv->views->head; l != view->desktop_link; l = l->next) {
+    PhocView *above = PHOC_VIEW (l->data);
+
+    if (!on_top && in_prefix)
+      add_view_extents (self, &stays_above, above);
+    else
+      add_view_extents (self, exposed, above);
+
+    if (l == priv->last_on_top)
+      in_prefix = FALSE;
+  }
+
+  pixman_region32_subtract (exposed, exposed, &stays_above);
+  pixman_region32_fini (&stays_above);
+
+  /* An always-on-top view that isn't one anymore */
+  return on_top || !in_prefix;
+}
+
 /**
  * phoc_desktop_move_view_to_top:
  * @self: the desktop
@@ -1279,29 +2044,52 @@ phoc_desktop_move_view_to_top (PhocDesktop *self, PhocView *view)
 {
   GList *view_link;
   PhocDesktopPrivate *priv;
+  pixman_region32_t exposed;
+  gboolean on_top, partial;
 
   g_assert (PHOC_IS_DESKTOP (self));
   priv = phoc_desktop_get_instance_private (self);
 
-  view_link = g_queue_find (priv->views, view);
+  view_link = view->desktop_link;
   g_assert (view_link);
 
-  g_queue_unlink (priv->views, view_link);
+  on_top = phoc_view_is_always_on_top (view);
+
+  /* Already in place, nothing to restack or repaint */
+  if (on_top && priv->last_on_top && view_link == priv->views->head)
+    return;
+  if (!on_top && view_link == (priv->last_on_top ? priv->last_on_top->next : priv->views->head))
+    return;
+
+  pixman_region32_init (&exposed);
+  partial = get_exposed_region (self, view, on_top, &exposed);
 
-  if (G_UNLIKELY (phoc_view_is_always_on_top (view))) {
+  unlink_view (self, view_link);
+
+  if (G_UNLIKELY (on_top)) {
     g_queue_push_head_link (priv->views, view_link);
+    if (!priv->last_on_top)
+      priv->last_on_top = view_link;
+  } else if (priv->last_on_top) {
+    g_queue_insert_after_link (priv->views, priv->last_on_top, view_link);
   } else {
-    GList *l = NULL;
+    g_queue_push_head_link (priv->views, view_link);
+  }
 
-    for (l = phoc_desktop_get_views (self)->head; l; l = l->next) {
-      if (!phoc_view_is_always_on_top (PHOC_VIEW (l->data)))
-        break;
-    }
+  if (partial) {
+    /* Only repaint what was covered before */
+    if (pixman_region32_not_empty (&exposed)) {
+      PhocOutput *output;
 
-    g_queue_insert_before_link (priv->views, l, view_link);
+      wl_list_for_each (output, &self->outputs, link)
+        phoc_output_damage_view_in_region (output, view, &exposed);
+    }
+  } else {
+    phoc_view_damage_whole (view);
   }
+  pixman_region32_fini (&exposed);
 
-  phoc_view_damage_whole (view);
+  phoc_idle_inhibit_queue_update (priv->idle_inhibit);
 }
 
 /**
@@ -1344,6 +2132,16 @@ phoc_desktop_get_view_by_index (PhocDesktop *self, guint index)
   return g_queue_peek_nth (priv->views, index);
 }
 
+
+static void
+on_view_state_changed (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+
+  /* (Un)maximizing changes which views are visible */
+  phoc_idle_inhibit_queue_update (priv->idle_inhibit);
+}
+
 /**
  * phoc_desktop_insert_view:
  * @self: the desktop
@@ -1360,7 +2158,19 @@ phoc_desktop_insert_view (PhocDesktop *self, PhocView *view)
   g_assert (PHOC_IS_DESKTOP (self));
   priv = phoc_desktop_get_instance_private (self);
 
-  g_queue_push_head (priv->views, view);
+  g_assert (view->desktop_link == NULL);
+
+  /* Placed by move_view_to_top() */
+  view->desktop_link = g_list_alloc ();
+  view->desktop_link->data = view;
+  if (priv->last_on_top)
+    g_queue_insert_after_link (priv->views, priv->last_on_top, view->desktop_link);
+  else
+    g_queue_push_head_link (priv->views, view->desktop_link);
+
+  g_signal_connect_swapped (view, "notify::state", G_CALLBACK (on_view_state_changed), self);
+  phoc_idle_inhibit_queue_update (priv->idle_inhibit);
+
   phoc_desktop_move_view_to_top (self, view);
 }
 
@@ -1381,7 +2191,17 @@ phoc_desktop_remove_view (PhocDesktop *self, PhocView *view)
   g_assert (PHOC_IS_DESKTOP (self));
   priv = phoc_desktop_get_instance_private (self);
 
-  return g_queue_remove (priv->views, view);
+  if (view->desktop_link == NULL)
+    return FALSE;
+
+  unlink_view (self, view->desktop_link);
+  g_list_free_1 (view->desktop_link);
+  view->desktop_link = NULL;
+
+  g_signal_handlers_disconnect_by_func (view, on_view_state_changed, self);
+  phoc_idle_inhibit_queue_update (priv->idle_inhibit);
+
+  return TRUE;
 }
 
 
@@ -1419,8 +2239,7 @@ phoc_desktop_set_view_always_on_top (PhocDesktop *self, PhocView *view, gboolean
   g_assert (PHOC_IS_VIEW (view));
 
   if (phoc_desktop_get_enable_animations (self)) {
-    g_autoptr (PhocTimedAnimation) fade_anim = NULL;
-    g_autoptr (PhocPropertyEaser) easer = NULL;
+    PhocTimedAnimation *fade_anim;
     g_autoptr (PhocColorRect) rect = NULL;
     PhocColor color;
     struct wlr_box rect_box, geom_box;
@@ -1439,17 +2258,13 @@ phoc_desktop_set_view_always_on_top (PhocDesktop *self, PhocView *view, gboolean
     /* Make sure we end up in the render tree */
     phoc_view_add_bling (view, PHOC_BLING (rect));
 
-    easer = g_object_new (PHOC_TYPE_PROPERTY_EASER,
-                          "target", rect,
-                          "easing", PHOC_EASING_EASE_OUT_QUAD,
-                          NULL);
-    phoc_property_easer_set_props (easer, "alpha", 1.0, 0.0, NULL);
-    fade_anim = g_object_new (PHOC_TYPE_TIMED_ANIMATION,
-                              "animatable", phoc_view_get_output (view),
-                              "duration", PHOC_ANIM_ALWAYS_ON_TOP_DURATION,
-                              "property-easer", easer,
-                              "dispose-on-done", TRUE,
-                              NULL);
+    fade_anim = phoc_timed_animation_acquire (PHOC_ANIMATABLE (phoc_view_get_output (view)),
+                                              G_OBJECT (rect),
+                                              PHOC_EASING_EASE_OUT_QUAD,
+                                              PHOC_ANIM_ALWAYS_ON_TOP_DURATION);
+    phoc_timed_animation_set_max_fps (fade_anim, PHOC_ANIM_ALWAYS_ON_TOP_MAX_FPS);
+    phoc_property_easer_set_props (phoc_timed_animation_get_property_easer (fade_anim),
+                                   "alpha", 1.0, 0.0, NULL);
     phoc_bling_map (PHOC_BLING (rect));
     g_object_set_data (G_OBJECT (rect), "view", view);
     g_signal_connect (fade_anim,
@@ -1466,3 +2281,226 @@ phoc_desktop_set_view_always_on_top (PhocDesktop *self, PhocView *view, gboolean
   wl_list_for_each_reverse (child, &view->stack, parent_link)
     phoc_desktop_set_view_always_on_top (self, child, on_top);
 }
+
+/**
+ * phoc_desktop_release_memory:
+ * @self: The desktop
+ *
+ * Releases memory that can be recreated on demand. This drops the
+ * cached thumbnails of views that aren't visible and returns freed
+ * heap memory to the system. Called when the system is low on memory.
+ *
+ * Returns: The number of bytes released from caches
+ */
+guint64
+phoc_desktop_release_memory (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv;
+  guint64 released = 0;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  for (GList *l = priv->views->head; l; l = l->next) {
+    PhocView *view = PHOC_VIEW (l->data);
+
+    if (phoc_desktop_view_is_visible (self, view))
+      continue;
+
+    released += phoc_phosh_private_release_thumbnail (view);
+  }
+
+#ifdef __GLIBC__
+  malloc_trim (0);
+#endif
+
+  return released;
+}
+
+/**
+ * phoc_desktop_get_app_settings:
+ * @self: The desktop
+ * @app_id: The app_id
+ *
+ * Get the `sm.puri.phoc.application` settings for @app_id. Views of
+ * the same app share the settings object. Changes are applied to the
+ * views in one go from an idle callback.
+ *
+ * Returns:(transfer full): The settings
+ */
+GSettings *
+phoc_desktop_get_app_settings (PhocDesktop *self, const char *app_id)
+{
+  PhocDesktopPrivate *priv;
+  g_autofree char *munged_app_id = NULL;
+  g_autofree char *path = NULL;
+  GSettings *settings;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  g_assert (app_id);
+  priv = phoc_desktop_get_instance_private (self);
+
+  munged_app_id = munge_app_id (app_id);
+  settings = g_hash_table_lookup (priv->app_settings, munged_app_id);
+  if (settings)
+    return g_object_ref (settings);
+
+  path = g_strconcat ("/sm/puri/phoc/application/", munged_app_id, "/", NULL);
+  settings = g_settings_new_with_path ("sm.puri.phoc.application", path);
+  g_signal_connect_object (settings, "changed::scale-to-fit",
+                           G_CALLBACK (on_app_settings_changed), self,
+                           G_CONNECT_SWAPPED);
+  g_object_weak_ref (G_OBJECT (settings), on_app_settings_finalized, self);
+  g_hash_table_insert (priv->app_settings, g_steal_pointer (&munged_app_id), settings);
+
+  return settings;
+}
+
+/**
+ * phoc_desktop_get_output_state_cache:
+ * @self: The desktop
+ *
+ * Get the cache of the last committed output state per monitor.
+ *
+ * Returns:(transfer none): The output state cache
+ */
+PhocOutputStateCache *
+phoc_desktop_get_output_state_cache (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  return priv->output_state_cache;
+}
+
+/**
+ * phoc_desktop_get_layout_transaction:
+ * @self: The desktop
+ *
+ * Get the transaction grouping view resizes so they show up in a
+ * single frame.
+ *
+ * Returns:(transfer none): The layout transaction
+ */
+PhocLayoutTransaction *
+phoc_desktop_get_layout_transaction (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  return priv->layout_transaction;
+}
+
+/**
+ * phoc_desktop_get_scene:
+ * @self: The desktop
+ *
+ * Get the scene graph outputs are composited with instead of the
+ * [class@Renderer], see the `scene-graph` config option.
+ *
+ * Returns:(transfer none)(nullable): The scene or %NULL when not using
+ *   the scene graph
+ */
+PhocScene *
+phoc_desktop_get_scene (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  return priv->scene;
+}
+
+/**
+ * phoc_desktop_get_session_lock:
+ * @self: The desktop
+ *
+ * Get the session lock. While the session is locked only lock
+ * surfaces are shown and get input.
+ *
+ * Returns:(transfer none): The session lock
+ */
+PhocSessionLock *
+phoc_desktop_get_session_lock (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  return priv->session_lock;
+}
+
+/**
+ * phoc_desktop_track_activation_token:
+ * @self: The desktop
+ * @view: The view using the token
+ * @token: The activation token
+ *
+ * Indexes @token as pending activation of @view. A token only
+ * activates a single view so if another view was waiting on it that
+ * view's token gets cleared. The token expires after
+ * `PHOC_ACTIVATION_TOKEN_TIMEOUT_SEC` so views that map late can't
+ * steal focus with stale tokens.
+ *
+ * This is meant to be used by [method@View.set_activation_token].
+ */
+void
+phoc_desktop_track_activation_token (PhocDesktop *self, PhocView *view, const char *token)
+{
+  PhocDesktopPrivate *priv;
+  PhocPendingActivation *pending;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  g_assert (PHOC_IS_VIEW (view));
+  g_assert (token);
+  priv = phoc_desktop_get_instance_private (self);
+
+  pending = g_hash_table_lookup (priv->pending_activations, token);
+  if (pending && pending->view != view) {
+    PhocView *other = pending->view;
+
+    g_hash_table_remove (priv->pending_activations, token);
+    phoc_view_set_activation_token (other, NULL, -1);
+  } else if (pending) {
+    return;
+  }
+
+  pending = g_new0 (PhocPendingActivation, 1);
+  pending->view = view;
+  pending->timeout_id = g_timeout_add_seconds (PHOC_ACTIVATION_TOKEN_TIMEOUT_SEC,
+                                               on_pending_activation_timeout,
+                                               pending);
+  g_source_set_name_by_id (pending->timeout_id, "[phoc] activation token timeout");
+  g_hash_table_insert (priv->pending_activations, g_strdup (token), pending);
+}
+
+/**
+ * phoc_desktop_untrack_activation_token:
+ * @self: The desktop
+ * @view: The view that used the token
+ * @token: The activation token
+ *
+ * Drops @token from the pending activations if it belongs to @view.
+ */
+void
+phoc_desktop_untrack_activation_token (PhocDesktop *self, PhocView *view, const char *token)
+{
+  PhocDesktopPrivate *priv;
+  PhocPendingActivation *pending;
+
+  g_assert (PHOC_IS_DESKTOP (self));
+  priv = phoc_desktop_get_instance_private (self);
+
+  if (!priv->pending_activations)
+    return;
+
+  pending = g_hash_table_lookup (priv->pending_activations, token);
+  if (pending && pending->view == view)
+    g_hash_table_remove (priv->pending_activations, token);
+}
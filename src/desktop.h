@@ -3,13 +3,18 @@
 #include "phoc-config.h"
 #include "gtk-shell.h"
 #include "layer-shell-effects.h"
+#include "layout-transaction.h"
+#include "output-state-cache.h"
 #include "phosh-private.h"
+#include "scene.h"
+#include "session-lock.h"
 #include "view.h"
 #include "xwayland-surface.h"
 
 #include <time.h>
 #include <wayland-server-core.h>
 #include <wlr/config.h>
+#include <wlr/types/wlr_content_type_v1.h>
 #include <wlr/types/wlr_foreign_toplevel_management_v1.h>
 #include <wlr/types/wlr_gamma_control_v1.h>
 #include <wlr/types/wlr_input_method_v2.h>
@@ -34,6 +39,21 @@
 
 #include "settings.h"
 
+/**
+ * PhocClientPriority:
+ * @PHOC_CLIENT_PRIORITY_BACKGROUND: Any other client
+ * @PHOC_CLIENT_PRIORITY_FOREGROUND: The client of the focused view
+ * @PHOC_CLIENT_PRIORITY_SHELL: The shell and the on screen keyboard
+ *
+ * How urgent it is to serve a client. Clients the user currently
+ * interacts with shouldn't wait for others.
+ */
+typedef enum {
+  PHOC_CLIENT_PRIORITY_BACKGROUND = 0,
+  PHOC_CLIENT_PRIORITY_FOREGROUND,
+  PHOC_CLIENT_PRIORITY_SHELL,
+} PhocClientPriority;
+
 #define PHOC_TYPE_DESKTOP (phoc_desktop_get_type())
 
 G_DECLARE_FINAL_TYPE (PhocDesktop, phoc_desktop, PHOC, DESKTOP, GObject);
@@ -79,11 +99,15 @@ struct _PhocDesktop {
   struct wl_listener pointer_constraint;
   struct wl_listener output_manager_apply;
   struct wl_listener output_manager_test;
+  /* Last tested output configuration and its result */
+  char              *output_manager_test_key;
+  bool               output_manager_test_ok;
   struct wl_listener output_power_manager_set_mode;
   struct wl_listener xdg_activation_v1_request_activate;
 
 #ifdef PHOC_XWAYLAND
   struct wlr_xcursor_manager *xcursor_manager;
+  struct wlr_xwayland_server *xwayland_server;
   struct wlr_xwayland *xwayland;
   struct wl_listener xwayland_surface;
   struct wl_listener xwayland_ready;
@@ -109,12 +133,20 @@ gboolean     phoc_desktop_get_auto_maximize (PhocDesktop *self);
 void         phoc_desktop_set_scale_to_fit (PhocDesktop *self, gboolean on);
 gboolean     phoc_desktop_get_scale_to_fit (PhocDesktop *self);
 gboolean     phoc_desktop_get_enable_animations (PhocDesktop *self);
+gboolean     phoc_desktop_get_magnifier_enabled (PhocDesktop *self);
+guint        phoc_desktop_get_layout_serial (PhocDesktop *self);
 PhocOutput  *phoc_desktop_find_output (PhocDesktop *self,
                                        const char  *make,
                                        const char  *model,
                                        const char  *serial);
 PhocOutput *phoc_desktop_find_output_by_name (PhocDesktop *self, const char *name);
 PhocOutput *phoc_desktop_get_builtin_output (PhocDesktop *self);
+void        phoc_desktop_set_lid_closed     (PhocDesktop *self, gboolean closed);
+gboolean    phoc_desktop_surface_wants_tearing (PhocDesktop        *self,
+                                                struct wlr_surface *wlr_surface);
+enum wp_content_type_v1_type
+            phoc_desktop_get_content_type   (PhocDesktop        *self,
+                                             struct wlr_surface *wlr_surface);
 PhocOutput *phoc_desktop_layout_get_output (PhocDesktop *self, double lx, double ly);
 
 struct wlr_surface *phoc_desktop_wlr_surface_at (PhocDesktop *desktop,
@@ -141,3 +173,23 @@ void                 phoc_desktop_notify_activity                (PhocDesktop *s
                                                                   PhocSeat    *seat);
 gboolean phoc_desktop_is_privileged_protocol (PhocDesktop            *self,
                                               const struct wl_global *global);
+PhocClientPriority phoc_desktop_get_client_priority (PhocDesktop      *self,
+                                                     struct wl_client *client);
+void     phoc_desktop_invalidate_client_priorities (PhocDesktop   *self);
+void     phoc_desktop_update_lid_policy      (PhocDesktop            *self);
+guint64  phoc_desktop_release_memory         (PhocDesktop            *self);
+GSettings *phoc_desktop_get_app_settings     (PhocDesktop            *self,
+                                              const char             *app_id);
+PhocOutputStateCache *
+         phoc_desktop_get_output_state_cache (PhocDesktop            *self);
+PhocLayoutTransaction *
+         phoc_desktop_get_layout_transaction (PhocDesktop            *self);
+PhocScene *phoc_desktop_get_scene            (PhocDesktop            *self);
+PhocSessionLock *
+         phoc_desktop_get_session_lock       (PhocDesktop            *self);
+void     phoc_desktop_track_activation_token   (PhocDesktop          *self,
+                                                PhocView             *view,
+                                                const char           *token);
+void     phoc_desktop_untrack_activation_token (PhocDesktop          *self,
+                                                PhocView             *view,
+                                                const char           *token);
@@ -45,6 +45,12 @@ typedef struct _PhocLidSwitch {
  * PhocDeviceState:
  *
  * Device state protocol:
+ *
+ * Lid and hall sensors can bounce when the device gets opened or
+ * closed. Switch changes are therefore debounced and clients are only
+ * told about a state that lasted for the configured window. Capability
+ * changes are coalesced in an idle callback as devices usually come
+ * and go in bursts.
  */
 struct _PhocDeviceState {
   GObject             parent;
@@ -52,15 +58,22 @@ struct _PhocDeviceState {
   PhocSeat           *seat; /* unowned, we're embedded in this seat */
   enum zphoc_device_state_v1_capability
                       caps;
+  guint               caps_idle_id;
 
   struct wl_global   *global;
   GSList             *resources;
 
+  guint               debounce_ms;
+
   GSList             *tablet_mode_switches;
   PhocSwitchState     tablet_mode_state;
+  PhocSwitchState     tablet_mode_pending;
+  guint               tablet_mode_debounce_id;
 
   GSList             *lid_switches;
   PhocSwitchState     lid_state;
+  PhocSwitchState     lid_pending;
+  guint               lid_debounce_id;
 };
 
 G_DEFINE_TYPE (PhocDeviceState, phoc_device_state, G_TYPE_OBJECT)
@@ -354,6 +367,10 @@ phoc_device_state_finalize (GObject *object)
 {
   PhocDeviceState *self = PHOC_DEVICE_STATE (object);
 
+  g_clear_handle_id (&self->caps_idle_id, g_source_remove);
+  g_clear_handle_id (&self->tablet_mode_debounce_id, g_source_remove);
+  g_clear_handle_id (&self->lid_debounce_id, g_source_remove);
+
   if (self->tablet_mode_switches)
     g_slist_free_full (g_steal_pointer (&self->tablet_mode_switches), g_free);
 
@@ -384,11 +401,13 @@ phoc_device_state_class_init (PhocDeviceStateClass *klass)
 static void
 phoc_device_state_init (PhocDeviceState *self)
 {
-  struct wl_display *wl_display = phoc_server_get_wl_display (phoc_server_get_default ());
+  PhocServer *server = phoc_server_get_default ();
+  struct wl_display *wl_display = phoc_server_get_wl_display (server);
+  PhocConfig *config = phoc_server_get_config (server);
 
+  self->debounce_ms = config ? config->switch_debounce_ms : PHOC_CONFIG_DEFAULT_SWITCH_DEBOUNCE;
   self->global = wl_global_create (wl_display, &zphoc_device_state_v1_interface,
                                    DEVICE_STATE_PROTOCOL_VERSION, self, device_state_bind);
-
 }
 
 
@@ -401,12 +420,13 @@ phoc_device_state_new (PhocSeat *seat)
 }
 
 
-void
-phoc_device_state_update_capabilities (PhocDeviceState *self)
+static gboolean
+on_caps_idle (gpointer data)
 {
+  PhocDeviceState *self = PHOC_DEVICE_STATE (data);
   uint32_t caps = 0;
 
-  g_assert (PHOC_IS_DEVICE_STATE (self));
+  self->caps_idle_id = 0;
 
   if (phoc_seat_has_switch (self->seat, WLR_SWITCH_TYPE_TABLET_MODE))
     caps |= ZPHOC_DEVICE_STATE_V1_CAPABILITY_TABLET_MODE_SWITCH;
@@ -418,7 +438,7 @@ phoc_device_state_update_capabilities (PhocDeviceState *self)
     caps |= ZPHOC_DEVICE_STATE_V1_CAPABILITY_KEYBOARD;
 
   if (caps == self->caps)
-    return;
+    return G_SOURCE_REMOVE;
 
   self->caps = caps;
 
@@ -434,23 +454,44 @@ phoc_device_state_update_capabilities (PhocDeviceState *self)
 
     zphoc_device_state_v1_send_capabilities (resource, versioned_caps);
   }
-}
 
+  return G_SOURCE_REMOVE;
+}
 
+/**
+ * phoc_device_state_update_capabilities:
+ * @self: The device state
+ *
+ * Schedule an update of the capabilities sent to clients. Multiple
+ * calls are coalesced.
+ */
 void
-phoc_device_state_notify_lid_change (PhocDeviceState *self, gboolean closed)
+phoc_device_state_update_capabilities (PhocDeviceState *self)
 {
   g_assert (PHOC_IS_DEVICE_STATE (self));
-  PhocSwitchState state = closed ? PHOC_SWITCH_STATE_ON : PHOC_SWITCH_STATE_OFF;
 
-  if (self->lid_state == state)
+  if (self->caps_idle_id)
     return;
-  self->lid_state = state;
+
+  self->caps_idle_id = g_idle_add (on_caps_idle, self);
+  g_source_set_name_by_id (self->caps_idle_id, "[phoc] device state caps");
+}
+
+
+static void
+send_lid_state (PhocDeviceState *self)
+{
+  if (self->lid_state == self->lid_pending)
+    return;
+  self->lid_state = self->lid_pending;
+
+  phoc_desktop_set_lid_closed (phoc_server_get_desktop (phoc_server_get_default ()),
+                               self->lid_state == PHOC_SWITCH_STATE_ON);
 
   for (GSList *l = self->lid_switches; l; l = l->next) {
     PhocLidSwitch *switch_ = l->data;
 
-    if (closed)
+    if (self->lid_state == PHOC_SWITCH_STATE_ON)
       zphoc_lid_switch_v1_send_closed (switch_->resource);
     else
       zphoc_lid_switch_v1_send_opened (switch_->resource);
@@ -458,22 +499,82 @@ phoc_device_state_notify_lid_change (PhocDeviceState *self, gboolean closed)
 }
 
 
+static gboolean
+on_lid_debounce_done (gpointer data)
+{
+  PhocDeviceState *self = PHOC_DEVICE_STATE (data);
+
+  self->lid_debounce_id = 0;
+  send_lid_state (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
 void
-phoc_device_state_notify_tablet_mode_change (PhocDeviceState *self, gboolean enabled)
+phoc_device_state_notify_lid_change (PhocDeviceState *self, gboolean closed)
 {
   g_assert (PHOC_IS_DEVICE_STATE (self));
-  PhocSwitchState state = enabled ? PHOC_SWITCH_STATE_ON : PHOC_SWITCH_STATE_OFF;
 
-  if (self->tablet_mode_state == state)
+  self->lid_pending = closed ? PHOC_SWITCH_STATE_ON : PHOC_SWITCH_STATE_OFF;
+
+  if (self->debounce_ms == 0) {
+    send_lid_state (self);
     return;
-  self->tablet_mode_state = state;
+  }
+
+  /* Restart the window so only a state that lasted gets sent */
+  g_clear_handle_id (&self->lid_debounce_id, g_source_remove);
+  self->lid_debounce_id = g_timeout_add (self->debounce_ms, on_lid_debounce_done, self);
+  g_source_set_name_by_id (self->lid_debounce_id, "[phoc] lid debounce");
+}
+
+
+static void
+send_tablet_mode_state (PhocDeviceState *self)
+{
+  if (self->tablet_mode_state == self->tablet_mode_pending)
+    return;
+  self->tablet_mode_state = self->tablet_mode_pending;
 
   for (GSList *l = self->tablet_mode_switches; l; l = l->next) {
     PhocTabletModeSwitch *switch_ = l->data;
 
-    if (enabled)
+    if (self->tablet_mode_state == PHOC_SWITCH_STATE_ON)
       zphoc_tablet_mode_switch_v1_send_enabled (switch_->resource);
     else
       zphoc_tablet_mode_switch_v1_send_disabled (switch_->resource);
   }
 }
+
+
+static gboolean
+on_tablet_mode_debounce_done (gpointer data)
+{
+  PhocDeviceState *self = PHOC_DEVICE_STATE (data);
+
+  self->tablet_mode_debounce_id = 0;
+  send_tablet_mode_state (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+void
+phoc_device_state_notify_tablet_mode_change (PhocDeviceState *self, gboolean enabled)
+{
+  g_assert (PHOC_IS_DEVICE_STATE (self));
+
+  self->tablet_mode_pending = enabled ? PHOC_SWITCH_STATE_ON : PHOC_SWITCH_STATE_OFF;
+
+  if (self->debounce_ms == 0) {
+    send_tablet_mode_state (self);
+    return;
+  }
+
+  g_clear_handle_id (&self->tablet_mode_debounce_id, g_source_remove);
+  self->tablet_mode_debounce_id = g_timeout_add (self->debounce_ms,
+                                                 on_tablet_mode_debounce_done,
+                                                 self);
+  g_source_set_name_by_id (self->tablet_mode_debounce_id, "[phoc] tablet mode debounce");
+}
@@ -25,6 +25,8 @@ struct _PhocDragIcon {
 
   double                x, y;
   double                dx, dy;
+  /* The icon's box in layout coordinates when it was last damaged */
+  struct wlr_box        box;
 
   struct wl_listener    surface_commit;
   struct wl_listener    map;
@@ -34,46 +36,76 @@ struct _PhocDragIcon {
 
 
 static void
-phoc_drag_icon_damage_whole (PhocDragIcon *icon)
+phoc_drag_icon_damage (PhocDragIcon *icon, gboolean whole)
 {
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  struct wlr_surface *surface = icon->wlr_drag_icon->surface;
   PhocOutput *output;
 
   wl_list_for_each (output, &desktop->outputs, link)
-    phoc_output_damage_whole_drag_icon (output, icon);
+    phoc_output_damage_from_drag_icon (output, icon, whole);
+
+  icon->box = (struct wlr_box) {
+    .x = icon->x,
+    .y = icon->y,
+    .width = surface->current.width,
+    .height = surface->current.height,
+  };
+}
+
+/* Damage where the icon was shown before it changed size */
+static void
+phoc_drag_icon_damage_old_box (PhocDragIcon *icon)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocOutput *output;
+
+  wl_list_for_each (output, &desktop->outputs, link) {
+    struct wlr_box box = icon->box;
+
+    box.x -= output->lx;
+    box.y -= output->ly;
+    phoc_output_damage_box (output, &box);
+  }
 }
 
 
 void
 phoc_drag_icon_update_position (PhocDragIcon *self)
 {
-  phoc_drag_icon_damage_whole (self);
-
   PhocSeat *seat = self->seat;
   struct wlr_drag *wlr_drag = self->wlr_drag_icon->drag;
+  double x, y;
 
   g_assert (wlr_drag != NULL);
 
   switch (seat->seat->drag->grab_type) {
   case WLR_DRAG_GRAB_KEYBOARD_POINTER:;
     struct wlr_cursor *cursor = seat->cursor->cursor;
-    self->x = cursor->x + self->dx;
-    self->y = cursor->y + self->dy;
+    x = cursor->x + self->dx;
+    y = cursor->y + self->dy;
     break;
   case WLR_DRAG_GRAB_KEYBOARD_TOUCH:;
     struct wlr_touch_point *point = wlr_seat_touch_get_point (seat->seat, wlr_drag->touch_id);
     if (point == NULL)
       return;
 
-    self->x = seat->touch_x + self->dx;
-    self->y = seat->touch_y + self->dy;
+    x = seat->touch_x + self->dx;
+    y = seat->touch_y + self->dy;
     break;
   case WLR_DRAG_GRAB_KEYBOARD:
   default:
     g_error ("Invalid drag grab type %d", seat->seat->drag->grab_type);
   }
 
-  phoc_drag_icon_damage_whole (self);
+  if (x == self->x && y == self->y)
+    return;
+
+  /* Only the old and the new icon box need repainting */
+  phoc_drag_icon_damage (self, TRUE);
+  self->x = x;
+  self->y = y;
+  phoc_drag_icon_damage (self, TRUE);
 }
 
 
@@ -81,12 +113,20 @@ static void
 phoc_drag_icon_handle_surface_commit (struct wl_listener *listener, void *data)
 {
   PhocDragIcon *self = wl_container_of (listener, self, surface_commit);
-  struct wlr_drag_icon *wlr_icon = self->wlr_drag_icon;
+  struct wlr_surface *surface = self->wlr_drag_icon->surface;
+  double x = self->x, y = self->y;
+
+  if (surface->current.width != self->box.width || surface->current.height != self->box.height)
+    phoc_drag_icon_damage_old_box (self);
 
-  self->dx += wlr_icon->surface->current.dx;
-  self->dy += wlr_icon->surface->current.dy;
+  self->dx += surface->current.dx;
+  self->dy += surface->current.dy;
 
   phoc_drag_icon_update_position (self);
+
+  /* Moving damaged the whole icon already, otherwise only the content changed */
+  if (x == self->x && y == self->y)
+    phoc_drag_icon_damage (self, FALSE);
 }
 
 
@@ -95,7 +135,7 @@ phoc_drag_icon_handle_map (struct wl_listener *listener, void *data)
 {
   PhocDragIcon *icon = wl_container_of (listener, icon, map);
 
-  phoc_drag_icon_damage_whole (icon);
+  phoc_drag_icon_damage (icon, TRUE);
 }
 
 
@@ -104,7 +144,7 @@ phoc_drag_icon_handle_unmap (struct wl_listener *listener, void *data)
 {
   PhocDragIcon *icon = wl_container_of (listener, icon, unmap);
 
-  phoc_drag_icon_damage_whole (icon);
+  phoc_drag_icon_damage (icon, TRUE);
 }
 
 
@@ -113,7 +153,7 @@ phoc_drag_icon_handle_destroy (struct wl_listener *listener, void *data)
 {
   PhocDragIcon *self = wl_container_of (listener, self, destroy);
 
-  phoc_drag_icon_damage_whole (self);
+  phoc_drag_icon_damage (self, TRUE);
 
   g_assert (self->seat->drag_icon == self);
   self->seat->drag_icon = NULL;
@@ -26,6 +26,9 @@ typedef struct _PhocEventPrivate {
   gpointer unused;
 } PhocEventPrivate;
 
+/* Events initialized in caller provided memory vs. allocated on the heap */
+static guint64 n_stack_events;
+static guint64 n_heap_events;
 
 G_DEFINE_BOXED_TYPE (PhocEvent, phoc_event,
                      phoc_event_copy,
@@ -48,6 +51,38 @@ G_DEFINE_BOXED_TYPE (PhocEventSequence, phoc_event_sequence,
                      phoc_event_sequence_copy,
                      phoc_event_sequence_free);
 
+static void
+event_init (PhocEvent *event, PhocEventType type, gconstpointer wlr_event, gsize size)
+{
+  g_assert (event);
+  g_assert (wlr_event == NULL || size >= sizeof (struct wlr_touch_cancel_event));
+  g_assert (size <= sizeof (*event) - G_STRUCT_OFFSET (PhocEvent, button_press));
+
+  memset (event, 0, sizeof (*event));
+  event->type = type;
+
+  if (wlr_event)
+    memcpy (&event->button_press, wlr_event, size);
+}
+
+/**
+ * phoc_event_init:
+ * @event: The event to initialize
+ * @type: The type of event.
+ * @wlr_event: (nullable): The wlroots event to wrap
+ * @size: The size of @wlr_event
+ *
+ * Initializes an event allocated by the caller, e.g. on the stack.
+ * This avoids a heap allocation on the input hot path. As events
+ * don't hold any resources there's nothing to clear afterwards.
+ */
+void
+phoc_event_init (PhocEvent *event, PhocEventType type, gconstpointer wlr_event, gsize size)
+{
+  event_init (event, type, wlr_event, size);
+  n_stack_events++;
+}
+
 /**
  * phoc_event_new:
  * @type: The type of event.
@@ -59,20 +94,14 @@ G_DEFINE_BOXED_TYPE (PhocEventSequence, phoc_event_sequence,
 PhocEvent *
 phoc_event_new (PhocEventType type, gpointer wlr_event, gsize size)
 {
-  PhocEvent *new_event;
   PhocEventPrivate *priv;
 
-  g_assert (wlr_event == NULL || size >= sizeof (struct wlr_touch_cancel_event));
-
-  priv = g_new0 (PhocEventPrivate, 1);
-
-  new_event = (PhocEvent *) priv;
-  new_event->type = type;
+  priv = g_new (PhocEventPrivate, 1);
+  priv->unused = NULL;
+  event_init (&priv->base, type, wlr_event, size);
+  n_heap_events++;
 
-  if (wlr_event)
-    memcpy (&new_event->button_press, wlr_event, size);
-
-  return new_event;
+  return &priv->base;
 }
 
 /**
@@ -122,6 +151,25 @@ phoc_event_free (PhocEvent *event)
   }
 }
 
+/**
+ * phoc_event_get_allocation_stats:
+ * @n_stack: (out) (optional): Events initialized in caller provided memory
+ * @n_heap: (out) (optional): Events allocated on the heap
+ *
+ * Gets the number of events created so far. Events created via
+ * [func@event_init] didn't need a heap allocation, those created via
+ * [func@event_new] or [func@event_copy] did.
+ */
+void
+phoc_event_get_allocation_stats (guint64 *n_stack, guint64 *n_heap)
+{
+  if (n_stack)
+    *n_stack = n_stack_events;
+
+  if (n_heap)
+    *n_heap = n_heap_events;
+}
+
 /**
  * phoc_event_get_event_sequence:
  * @event: a `PhocEvent`
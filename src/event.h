@@ -145,8 +145,14 @@ GType                       phoc_event_sequence_get_type             (void) G_GN
 PhocEvent                  *phoc_event_new                           (PhocEventType    type,
                                                                       const gpointer   wlr_event,
                                                                       gsize            size);
+void                        phoc_event_init                          (PhocEvent       *event,
+                                                                      PhocEventType    type,
+                                                                      gconstpointer    wlr_event,
+                                                                      gsize            size);
 PhocEvent                  *phoc_event_copy                          (const PhocEvent *event);
 void                        phoc_event_free                          (PhocEvent       *event);
+void                        phoc_event_get_allocation_stats          (guint64         *n_stack,
+                                                                      guint64         *n_heap);
 PhocEventSequence          *phoc_event_get_event_sequence            (const PhocEvent *event);
 /* TODO: #include "input-device.h" tirggers header fallout again */
 typedef struct _PhocInputDevice PhocInputDevice;
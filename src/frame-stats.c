@@ -0,0 +1,620 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-frame-stats"
+
+#include "phoc-config.h"
+
+#include "frame-stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * PhocFrameStats:
+ *
+ * Per output frame timing statistics.
+ *
+ * For each [enum@FrameStatsMetric] the most recent samples are kept
+ * in a ring buffer. Additionally all samples ever recorded are
+ * accumulated in a histogram with logarithmic buckets: bucket `0`
+ * holds samples below 2µs, bucket `n` samples in `[2^n, 2^(n+1))`µs
+ * and the last bucket everything above. Percentiles are computed from
+ * the recent samples.
+ *
+ * It also counts the outcomes of direct scanout attempts by
+ * [enum@ScanoutResult], how the cursor got presented by
+ * [enum@CursorPlaneResult] and the number of damage rectangles saved
+ * by coalescing fragmented damage.
+ *
+ * Finally the rendered frames, their damaged area and the textures
+ * drawn into them are counted so tests can assert render budgets.
+ *
+ * Recording is cheap so it can be kept enabled on production builds.
+ */
+
+typedef struct {
+  guint32 samples[PHOC_FRAME_STATS_N_SAMPLES];
+  guint   next;
+  guint   n_samples;
+  guint64 buckets[PHOC_FRAME_STATS_N_BUCKETS];
+  guint32 max;
+} PhocFrameStatsRing;
+
+struct _PhocFrameStats {
+  PhocFrameStatsRing rings[PHOC_FRAME_STATS_METRIC_LAST];
+  guint64            missed_vblanks;
+  guint64            scanout[PHOC_SCANOUT_RESULT_LAST];
+  guint64            cursor[PHOC_CURSOR_PLANE_RESULT_LAST];
+  guint64            damage_rects_saved;
+  guint64            arranges_coalesced;
+  guint64            configures_coalesced;
+  guint64            frames;
+  guint64            damaged_pixels;
+  guint64            texture_draws;
+};
+
+
+PhocFrameStats *
+phoc_frame_stats_new (void)
+{
+  return g_new0 (PhocFrameStats, 1);
+}
+
+
+void
+phoc_frame_stats_free (PhocFrameStats *self)
+{
+  g_free (self);
+}
+
+
+static guint
+get_bucket (guint32 value)
+{
+  guint bucket;
+
+  if (value < 2)
+    return 0;
+
+  bucket = g_bit_storage (value) - 1;
+  return MIN (bucket, PHOC_FRAME_STATS_N_BUCKETS - 1);
+}
+
+/**
+ * phoc_frame_stats_record:
+ * @self: The frame stats
+ * @metric: The metric to record
+ * @duration_us: The measured duration in µs
+ *
+ * Records a sample for the given metric.
+ */
+void
+phoc_frame_stats_record (PhocFrameStats *self, PhocFrameStatsMetric metric, gint64 duration_us)
+{
+  PhocFrameStatsRing *ring;
+  guint32 value;
+
+  g_assert (self);
+  g_assert (metric < PHOC_FRAME_STATS_METRIC_LAST);
+  ring = &self->rings[metric];
+
+  value = CLAMP (duration_us, 0, G_MAXUINT32);
+
+  ring->samples[ring->next] = value;
+  ring->next = (ring->next + 1) % PHOC_FRAME_STATS_N_SAMPLES;
+  ring->n_samples = MIN (ring->n_samples + 1, PHOC_FRAME_STATS_N_SAMPLES);
+  ring->buckets[get_bucket (value)]++;
+  ring->max = MAX (ring->max, value);
+}
+
+/**
+ * phoc_frame_stats_get_samples:
+ * @self: The frame stats
+ * @metric: The metric to get the samples for
+ * @samples: (out caller-allocates) (array length=n_samples): Storage for the samples
+ * @n_samples: The number of samples that fit into @samples
+ *
+ * Gets the most recent samples of a metric, oldest first.
+ *
+ * Returns: The number of samples stored in @samples
+ */
+guint
+phoc_frame_stats_get_samples (PhocFrameStats      *self,
+                              PhocFrameStatsMetric metric,
+                              guint32             *samples,
+                              guint                n_samples)
+{
+  PhocFrameStatsRing *ring;
+  guint n, start;
+
+  g_assert (self);
+  g_assert (metric < PHOC_FRAME_STATS_METRIC_LAST);
+  ring = &self->rings[metric];
+
+  n = MIN (n_samples, ring->n_samples);
+  start = (ring->next + PHOC_FRAME_STATS_N_SAMPLES - n) % PHOC_FRAME_STATS_N_SAMPLES;
+  for (guint i = 0; i < n; i++)
+    samples[i] = ring->samples[(start + i) % PHOC_FRAME_STATS_N_SAMPLES];
+
+  return n;
+}
+
+/**
+ * phoc_frame_stats_get_histogram:
+ * @self: The frame stats
+ * @metric: The metric to get the histogram for
+ * @buckets: (out caller-allocates): The histogram buckets
+ *
+ * Gets the histogram of all recorded samples for the given metric.
+ */
+void
+phoc_frame_stats_get_histogram (PhocFrameStats      *self,
+                                PhocFrameStatsMetric metric,
+                                guint64              buckets[PHOC_FRAME_STATS_N_BUCKETS])
+{
+  g_assert (self);
+  g_assert (metric < PHOC_FRAME_STATS_METRIC_LAST);
+
+  memcpy (buckets, self->rings[metric].buckets, sizeof (self->rings[metric].buckets));
+}
+
+
+static int
+compare_samples (gconstpointer a, gconstpointer b)
+{
+  guint32 sa = *(const guint32 *)a;
+  guint32 sb = *(const guint32 *)b;
+
+  return (sa > sb) - (sa < sb);
+}
+
+
+static guint32
+get_sorted_percentile (const guint32 *sorted, guint n, guint percentile)
+{
+  guint rank;
+
+  if (!n)
+    return 0;
+
+  rank = (percentile * n + 99) / 100;
+
+  return sorted[MAX (rank, 1) - 1];
+}
+
+/**
+ * phoc_frame_stats_get_percentile:
+ * @self: The frame stats
+ * @metric: The metric to get the percentile for
+ * @percentile: The percentile (`0` to `100`)
+ *
+ * Gets the given percentile of the recent samples of a metric using
+ * the nearest rank method.
+ *
+ * Returns: The percentile or `0` if there are no samples
+ */
+guint32
+phoc_frame_stats_get_percentile (PhocFrameStats      *self,
+                                 PhocFrameStatsMetric metric,
+                                 guint                percentile)
+{
+  guint32 samples[PHOC_FRAME_STATS_N_SAMPLES];
+  guint n;
+
+  g_assert (self);
+  g_assert (percentile <= 100);
+
+  n = phoc_frame_stats_get_samples (self, metric, samples, G_N_ELEMENTS (samples));
+  qsort (samples, n, sizeof (guint32), compare_samples);
+
+  return get_sorted_percentile (samples, n, percentile);
+}
+
+/**
+ * phoc_frame_stats_add_missed_vblanks:
+ * @self: The frame stats
+ * @n_missed: The number of vblanks missed
+ *
+ * Records that a frame missed @n_missed vblanks.
+ */
+void
+phoc_frame_stats_add_missed_vblanks (PhocFrameStats *self, guint n_missed)
+{
+  g_assert (self);
+
+  self->missed_vblanks += n_missed;
+}
+
+
+guint64
+phoc_frame_stats_get_missed_vblanks (PhocFrameStats *self)
+{
+  g_assert (self);
+
+  return self->missed_vblanks;
+}
+
+/**
+ * phoc_frame_stats_record_scanout:
+ * @self: The frame stats
+ * @result: The outcome of the scanout attempt
+ *
+ * Records the outcome of a direct scanout attempt.
+ */
+void
+phoc_frame_stats_record_scanout (PhocFrameStats *self, PhocScanoutResult result)
+{
+  g_assert (self);
+  g_assert (result < PHOC_SCANOUT_RESULT_LAST);
+
+  self->scanout[result]++;
+}
+
+
+guint64
+phoc_frame_stats_get_scanout_count (PhocFrameStats *self, PhocScanoutResult result)
+{
+  g_assert (self);
+  g_assert (result < PHOC_SCANOUT_RESULT_LAST);
+
+  return self->scanout[result];
+}
+
+/**
+ * phoc_frame_stats_record_cursor:
+ * @self: The frame stats
+ * @result: How the cursor got presented
+ *
+ * Records how the cursor got presented in a composited frame.
+ */
+void
+phoc_frame_stats_record_cursor (PhocFrameStats *self, PhocCursorPlaneResult result)
+{
+  g_assert (self);
+  g_assert (result < PHOC_CURSOR_PLANE_RESULT_LAST);
+
+  self->cursor[result]++;
+}
+
+
+guint64
+phoc_frame_stats_get_cursor_count (PhocFrameStats *self, PhocCursorPlaneResult result)
+{
+  g_assert (self);
+  g_assert (result < PHOC_CURSOR_PLANE_RESULT_LAST);
+
+  return self->cursor[result];
+}
+
+/**
+ * phoc_frame_stats_add_damage_rects_saved:
+ * @self: The frame stats
+ * @n_saved: The number of damage rectangles saved
+ *
+ * Records how many damage rectangles a frame saved by merging them.
+ * Each saved rectangle is one draw less per damaged texture.
+ */
+void
+phoc_frame_stats_add_damage_rects_saved (PhocFrameStats *self, guint n_saved)
+{
+  g_assert (self);
+
+  self->damage_rects_saved += n_saved;
+}
+
+
+guint64
+phoc_frame_stats_get_damage_rects_saved (PhocFrameStats *self)
+{
+  g_assert (self);
+
+  return self->damage_rects_saved;
+}
+
+/**
+ * phoc_frame_stats_add_arranges_coalesced:
+ * @self: The frame stats
+ * @n_coalesced: The number of layer arranges coalesced
+ *
+ * Records how many layer shell arranges were folded into an
+ * already queued one.
+ */
+void
+phoc_frame_stats_add_arranges_coalesced (PhocFrameStats *self, guint n_coalesced)
+{
+  g_assert (self);
+
+  self->arranges_coalesced += n_coalesced;
+}
+
+
+guint64
+phoc_frame_stats_get_arranges_coalesced (PhocFrameStats *self)
+{
+  g_assert (self);
+
+  return self->arranges_coalesced;
+}
+
+/**
+ * phoc_frame_stats_add_configures_coalesced:
+ * @self: The frame stats
+ * @n_coalesced: The number of configure requests coalesced
+ *
+ * Records how many X11 configure requests were folded into an
+ * already queued one.
+ */
+void
+phoc_frame_stats_add_configures_coalesced (PhocFrameStats *self, guint n_coalesced)
+{
+  g_assert (self);
+
+  self->configures_coalesced += n_coalesced;
+}
+
+
+guint64
+phoc_frame_stats_get_configures_coalesced (PhocFrameStats *self)
+{
+  g_assert (self);
+
+  return self->configures_coalesced;
+}
+
+/**
+ * phoc_frame_stats_add_frame:
+ * @self: The frame stats
+ * @damaged_pixels: The number of pixels the frame repainted
+ * @n_textures: The number of textures drawn into the frame
+ *
+ * Records a frame that got rendered and committed.
+ */
+void
+phoc_frame_stats_add_frame (PhocFrameStats *self, guint64 damaged_pixels, guint n_textures)
+{
+  g_assert (self);
+
+  self->frames++;
+  self->damaged_pixels += damaged_pixels;
+  self->texture_draws += n_textures;
+}
+
+
+guint64
+phoc_frame_stats_get_frames (PhocFrameStats *self)
+{
+  g_assert (self);
+
+  return self->frames;
+}
+
+
+guint64
+phoc_frame_stats_get_damaged_pixels (PhocFrameStats *self)
+{
+  g_assert (self);
+
+  return self->damaged_pixels;
+}
+
+
+guint64
+phoc_frame_stats_get_texture_draws (PhocFrameStats *self)
+{
+  g_assert (self);
+
+  return self->texture_draws;
+}
+
+/**
+ * phoc_frame_stats_reset:
+ * @self: The frame stats
+ *
+ * Drops all recorded samples.
+ */
+void
+phoc_frame_stats_reset (PhocFrameStats *self)
+{
+  g_assert (self);
+
+  memset (self, 0, sizeof (*self));
+}
+
+
+const char *
+phoc_frame_stats_metric_to_string (PhocFrameStatsMetric metric)
+{
+  switch (metric) {
+  case PHOC_FRAME_STATS_METRIC_FRAME_CALLBACKS:
+    return "frame-callbacks";
+  case PHOC_FRAME_STATS_METRIC_RENDER:
+    return "render";
+  case PHOC_FRAME_STATS_METRIC_SUBMIT:
+    return "submit";
+  case PHOC_FRAME_STATS_METRIC_COMMIT:
+    return "commit";
+  case PHOC_FRAME_STATS_METRIC_INPUT_LATENCY:
+    return "input-latency";
+  case PHOC_FRAME_STATS_METRIC_WAKEUP:
+    return "wakeup";
+  case PHOC_FRAME_STATS_METRIC_GPU:
+    return "gpu";
+  case PHOC_FRAME_STATS_METRIC_LAST:
+  default:
+    g_assert_not_reached ();
+  }
+}
+
+
+const char *
+phoc_scanout_result_to_string (PhocScanoutResult result)
+{
+  switch (result) {
+  case PHOC_SCANOUT_RESULT_ACCEPTED:
+    return "accepted";
+  case PHOC_SCANOUT_RESULT_DRAG_ICON:
+    return "drag-icon";
+  case PHOC_SCANOUT_RESULT_SHELL_REVEALED:
+    return "shell-revealed";
+  case PHOC_SCANOUT_RESULT_OVERLAY_LAYER:
+    return "overlay-layer";
+  case PHOC_SCANOUT_RESULT_MAGNIFIED:
+    return "magnified";
+  case PHOC_SCANOUT_RESULT_UNMAPPED:
+    return "unmapped";
+  case PHOC_SCANOUT_RESULT_MULTIPLE_SURFACES:
+    return "multiple-surfaces";
+  case PHOC_SCANOUT_RESULT_XWAYLAND_CHILDREN:
+    return "xwayland-children";
+  case PHOC_SCANOUT_RESULT_NO_BUFFER:
+    return "no-buffer";
+  case PHOC_SCANOUT_RESULT_SCALE_TRANSFORM:
+    return "scale-transform";
+  case PHOC_SCANOUT_RESULT_NOT_ALLOWED:
+    return "not-allowed";
+  case PHOC_SCANOUT_RESULT_TEST_FAILED:
+    return "test-failed";
+  case PHOC_SCANOUT_RESULT_COMMIT_FAILED:
+    return "commit-failed";
+  case PHOC_SCANOUT_RESULT_LAST:
+  default:
+    g_assert_not_reached ();
+  }
+}
+
+
+const char *
+phoc_cursor_plane_result_to_string (PhocCursorPlaneResult result)
+{
+  switch (result) {
+  case PHOC_CURSOR_PLANE_RESULT_HARDWARE:
+    return "hardware";
+  case PHOC_CURSOR_PLANE_RESULT_HIDDEN:
+    return "hidden";
+  case PHOC_CURSOR_PLANE_RESULT_LOCKED:
+    return "locked";
+  case PHOC_CURSOR_PLANE_RESULT_UNSUPPORTED:
+    return "unsupported";
+  case PHOC_CURSOR_PLANE_RESULT_REJECTED:
+    return "rejected";
+  case PHOC_CURSOR_PLANE_RESULT_LAST:
+  default:
+    g_assert_not_reached ();
+  }
+}
+
+/**
+ * phoc_frame_stats_metric_to_variant:
+ * @self: The frame stats
+ * @metric: The metric to serialize
+ *
+ * Serializes a single metric as `a{sv}` holding the recent `samples`
+ * (`au`), the `histogram` (`at`), the `max` value (`u`) and the `p50`,
+ * `p90` and `p99` percentiles (`u`) of the recent samples.
+ *
+ * Returns: (transfer floating): The metric
+ */
+GVariant *
+phoc_frame_stats_metric_to_variant (PhocFrameStats *self, PhocFrameStatsMetric metric)
+{
+  PhocFrameStatsRing *ring;
+  guint32 samples[PHOC_FRAME_STATS_N_SAMPLES];
+  GVariantBuilder builder;
+  guint n;
+
+  g_assert (self);
+  g_assert (metric < PHOC_FRAME_STATS_METRIC_LAST);
+  ring = &self->rings[metric];
+
+  n = phoc_frame_stats_get_samples (self, metric, samples, G_N_ELEMENTS (samples));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "samples",
+                         g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                                    samples, n, sizeof (guint32)));
+  g_variant_builder_add (&builder, "{sv}", "histogram",
+                         g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                                    ring->buckets,
+                                                    PHOC_FRAME_STATS_N_BUCKETS,
+                                                    sizeof (guint64)));
+  g_variant_builder_add (&builder, "{sv}", "max", g_variant_new_uint32 (ring->max));
+
+  /* The samples got copied into the variant, sort them once for all percentiles */
+  qsort (samples, n, sizeof (guint32), compare_samples);
+  g_variant_builder_add (&builder, "{sv}", "p50",
+                         g_variant_new_uint32 (get_sorted_percentile (samples, n, 50)));
+  g_variant_builder_add (&builder, "{sv}", "p90",
+                         g_variant_new_uint32 (get_sorted_percentile (samples, n, 90)));
+  g_variant_builder_add (&builder, "{sv}", "p99",
+                         g_variant_new_uint32 (get_sorted_percentile (samples, n, 99)));
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * phoc_frame_stats_to_variant:
+ * @self: The frame stats
+ *
+ * Serializes the statistics as `a{sv}`. Each metric is serialized as
+ * described in [method@FrameStats.metric_to_variant]. `missed-vblanks` (`t`) holds the number of missed
+ * vblanks, `scanout` (`a{st}`) the number of direct scanout attempts
+ * by result, `cursor` (`a{st}`) the number of composited frames by
+ * how the cursor got presented and `damage-rects-saved` (`t`) the number of damage
+ * rectangles saved by coalescing. `frames` (`t`), `damaged-pixels`
+ * (`t`) and `texture-draws` (`t`) hold the number of rendered frames,
+ * the pixels they repainted and the textures drawn into them.
+ *
+ * Returns: (transfer floating): The statistics
+ */
+GVariant *
+phoc_frame_stats_to_variant (PhocFrameStats *self)
+{
+  GVariantBuilder builder, scanout, cursor;
+
+  g_assert (self);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  for (PhocFrameStatsMetric m = 0; m < PHOC_FRAME_STATS_METRIC_LAST; m++) {
+    g_variant_builder_add (&builder, "{sv}",
+                           phoc_frame_stats_metric_to_string (m),
+                           phoc_frame_stats_metric_to_variant (self, m));
+  }
+
+  g_variant_builder_add (&builder, "{sv}", "missed-vblanks",
+                         g_variant_new_uint64 (self->missed_vblanks));
+
+  g_variant_builder_init (&scanout, G_VARIANT_TYPE ("a{st}"));
+  for (PhocScanoutResult r = 0; r < PHOC_SCANOUT_RESULT_LAST; r++) {
+    g_variant_builder_add (&scanout, "{st}",
+                           phoc_scanout_result_to_string (r),
+                           self->scanout[r]);
+  }
+  g_variant_builder_add (&builder, "{sv}", "scanout", g_variant_builder_end (&scanout));
+
+  g_variant_builder_init (&cursor, G_VARIANT_TYPE ("a{st}"));
+  for (PhocCursorPlaneResult r = 0; r < PHOC_CURSOR_PLANE_RESULT_LAST; r++) {
+    g_variant_builder_add (&cursor, "{st}",
+                           phoc_cursor_plane_result_to_string (r),
+                           self->cursor[r]);
+  }
+  g_variant_builder_add (&builder, "{sv}", "cursor", g_variant_builder_end (&cursor));
+
+  g_variant_builder_add (&builder, "{sv}", "damage-rects-saved",
+                         g_variant_new_uint64 (self->damage_rects_saved));
+  g_variant_builder_add (&builder, "{sv}", "arranges-coalesced",
+                         g_variant_new_uint64 (self->arranges_coalesced));
+  g_variant_builder_add (&builder, "{sv}", "configures-coalesced",
+                         g_variant_new_uint64 (self->configures_coalesced));
+  g_variant_builder_add (&builder, "{sv}", "frames", g_variant_new_uint64 (self->frames));
+  g_variant_builder_add (&builder, "{sv}", "damaged-pixels",
+                         g_variant_new_uint64 (self->damaged_pixels));
+  g_variant_builder_add (&builder, "{sv}", "texture-draws",
+                         g_variant_new_uint64 (self->texture_draws));
+
+  return g_variant_builder_end (&builder);
+}
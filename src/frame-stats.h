@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_FRAME_STATS_N_SAMPLES 256
+#define PHOC_FRAME_STATS_N_BUCKETS 16
+
+/**
+ * PhocFrameStatsMetric:
+ * @PHOC_FRAME_STATS_METRIC_FRAME_CALLBACKS: Time spent in frame callbacks
+ * @PHOC_FRAME_STATS_METRIC_RENDER: Time spent building the render pass
+ * @PHOC_FRAME_STATS_METRIC_SUBMIT: Time spent submitting the render pass
+ * @PHOC_FRAME_STATS_METRIC_COMMIT: Time from output commit until presentation
+ * @PHOC_FRAME_STATS_METRIC_INPUT_LATENCY: Time from an input event until the
+ *   presentation of the client's response to it
+ * @PHOC_FRAME_STATS_METRIC_WAKEUP: Time from a vblank or a repaint deadline
+ *   until the compositor thread got to handle it
+ * @PHOC_FRAME_STATS_METRIC_GPU: Time the GPU spent on the render pass. Only
+ *   recorded if the renderer supports timer queries
+ *
+ * The timings recorded for each frame.
+ */
+typedef enum _PhocFrameStatsMetric {
+  PHOC_FRAME_STATS_METRIC_FRAME_CALLBACKS,
+  PHOC_FRAME_STATS_METRIC_RENDER,
+  PHOC_FRAME_STATS_METRIC_SUBMIT,
+  PHOC_FRAME_STATS_METRIC_COMMIT,
+  PHOC_FRAME_STATS_METRIC_INPUT_LATENCY,
+  PHOC_FRAME_STATS_METRIC_WAKEUP,
+  PHOC_FRAME_STATS_METRIC_GPU,
+  PHOC_FRAME_STATS_METRIC_LAST,
+} PhocFrameStatsMetric;
+
+/**
+ * PhocScanoutResult:
+ * @PHOC_SCANOUT_RESULT_ACCEPTED: The view was scanned out directly
+ * @PHOC_SCANOUT_RESULT_DRAG_ICON: A drag icon can't be put onto an overlay plane
+ * @PHOC_SCANOUT_RESULT_SHELL_REVEALED: The shell is revealed on top of the view
+ * @PHOC_SCANOUT_RESULT_OVERLAY_LAYER: A layer surface is in the overlay layer
+ * @PHOC_SCANOUT_RESULT_MAGNIFIED: The output is zoomed in by the magnifier
+ * @PHOC_SCANOUT_RESULT_UNMAPPED: The view isn't mapped
+ * @PHOC_SCANOUT_RESULT_MULTIPLE_SURFACES: More than one visible surface
+ * @PHOC_SCANOUT_RESULT_XWAYLAND_CHILDREN: The Xwayland surface has children
+ * @PHOC_SCANOUT_RESULT_NO_BUFFER: The view's surface has no buffer
+ * @PHOC_SCANOUT_RESULT_SCALE_TRANSFORM: Scale or transform don't match the output's
+ * @PHOC_SCANOUT_RESULT_NOT_ALLOWED: The output doesn't allow direct scanout
+ * @PHOC_SCANOUT_RESULT_TEST_FAILED: The backend rejected the buffer
+ * @PHOC_SCANOUT_RESULT_COMMIT_FAILED: Committing the buffer failed
+ *
+ * The outcome of a direct scanout attempt.
+ */
+typedef enum _PhocScanoutResult {
+  PHOC_SCANOUT_RESULT_ACCEPTED,
+  PHOC_SCANOUT_RESULT_DRAG_ICON,
+  PHOC_SCANOUT_RESULT_SHELL_REVEALED,
+  PHOC_SCANOUT_RESULT_OVERLAY_LAYER,
+  PHOC_SCANOUT_RESULT_MAGNIFIED,
+  PHOC_SCANOUT_RESULT_UNMAPPED,
+  PHOC_SCANOUT_RESULT_MULTIPLE_SURFACES,
+  PHOC_SCANOUT_RESULT_XWAYLAND_CHILDREN,
+  PHOC_SCANOUT_RESULT_NO_BUFFER,
+  PHOC_SCANOUT_RESULT_SCALE_TRANSFORM,
+  PHOC_SCANOUT_RESULT_NOT_ALLOWED,
+  PHOC_SCANOUT_RESULT_TEST_FAILED,
+  PHOC_SCANOUT_RESULT_COMMIT_FAILED,
+  PHOC_SCANOUT_RESULT_LAST,
+} PhocScanoutResult;
+
+/**
+ * PhocCursorPlaneResult:
+ * @PHOC_CURSOR_PLANE_RESULT_HARDWARE: The cursor is on the cursor plane
+ * @PHOC_CURSOR_PLANE_RESULT_HIDDEN: No cursor is shown on the output
+ * @PHOC_CURSOR_PLANE_RESULT_LOCKED: Software cursors are forced, e.g. for
+ *   screen recording
+ * @PHOC_CURSOR_PLANE_RESULT_UNSUPPORTED: The output has no cursor plane
+ * @PHOC_CURSOR_PLANE_RESULT_REJECTED: The backend refused the cursor image,
+ *   e.g. as it's too large
+ *
+ * How the cursor got presented in a frame.
+ */
+typedef enum _PhocCursorPlaneResult {
+  PHOC_CURSOR_PLANE_RESULT_HARDWARE,
+  PHOC_CURSOR_PLANE_RESULT_HIDDEN,
+  PHOC_CURSOR_PLANE_RESULT_LOCKED,
+  PHOC_CURSOR_PLANE_RESULT_UNSUPPORTED,
+  PHOC_CURSOR_PLANE_RESULT_REJECTED,
+  PHOC_CURSOR_PLANE_RESULT_LAST,
+} PhocCursorPlaneResult;
+
+typedef struct _PhocFrameStats PhocFrameStats;
+
+PhocFrameStats *phoc_frame_stats_new                (void);
+void            phoc_frame_stats_free               (PhocFrameStats *self);
+void            phoc_frame_stats_record             (PhocFrameStats      *self,
+                                                     PhocFrameStatsMetric metric,
+                                                     gint64               duration_us);
+guint           phoc_frame_stats_get_samples        (PhocFrameStats      *self,
+                                                     PhocFrameStatsMetric metric,
+                                                     guint32             *samples,
+                                                     guint                n_samples);
+void            phoc_frame_stats_get_histogram      (PhocFrameStats      *self,
+                                                     PhocFrameStatsMetric metric,
+                                                     guint64              buckets[PHOC_FRAME_STATS_N_BUCKETS]);
+guint32         phoc_frame_stats_get_percentile     (PhocFrameStats      *self,
+                                                     PhocFrameStatsMetric metric,
+                                                     guint                percentile);
+void            phoc_frame_stats_add_missed_vblanks (PhocFrameStats      *self,
+                                                     guint                n_missed);
+guint64         phoc_frame_stats_get_missed_vblanks (PhocFrameStats      *self);
+void            phoc_frame_stats_record_scanout     (PhocFrameStats      *self,
+                                                     PhocScanoutResult    result);
+guint64         phoc_frame_stats_get_scanout_count  (PhocFrameStats      *self,
+                                                     PhocScanoutResult    result);
+void            phoc_frame_stats_record_cursor      (PhocFrameStats        *self,
+                                                     PhocCursorPlaneResult  result);
+guint64         phoc_frame_stats_get_cursor_count   (PhocFrameStats        *self,
+                                                     PhocCursorPlaneResult  result);
+void            phoc_frame_stats_add_damage_rects_saved (PhocFrameStats  *self,
+                                                         guint            n_saved);
+guint64         phoc_frame_stats_get_damage_rects_saved (PhocFrameStats  *self);
+void            phoc_frame_stats_add_arranges_coalesced (PhocFrameStats  *self,
+                                                         guint            n_coalesced);
+guint64         phoc_frame_stats_get_arranges_coalesced (PhocFrameStats  *self);
+void            phoc_frame_stats_add_configures_coalesced (PhocFrameStats *self,
+                                                           guint           n_coalesced);
+guint64         phoc_frame_stats_get_configures_coalesced (PhocFrameStats *self);
+void            phoc_frame_stats_add_frame          (PhocFrameStats      *self,
+                                                     guint64              damaged_pixels,
+                                                     guint                n_textures);
+guint64         phoc_frame_stats_get_frames         (PhocFrameStats      *self);
+guint64         phoc_frame_stats_get_damaged_pixels (PhocFrameStats      *self);
+guint64         phoc_frame_stats_get_texture_draws  (PhocFrameStats      *self);
+void            phoc_frame_stats_reset              (PhocFrameStats      *self);
+const char     *phoc_frame_stats_metric_to_string   (PhocFrameStatsMetric metric);
+const char     *phoc_scanout_result_to_string       (PhocScanoutResult    result);
+const char     *phoc_cursor_plane_result_to_string  (PhocCursorPlaneResult result);
+GVariant       *phoc_frame_stats_to_variant         (PhocFrameStats      *self);
+GVariant       *phoc_frame_stats_metric_to_variant  (PhocFrameStats      *self,
+                                                     PhocFrameStatsMetric metric);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocFrameStats, phoc_frame_stats_free)
+
+G_END_DECLS
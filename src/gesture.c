@@ -20,6 +20,11 @@
 #include "phoc-enums.h"
 #include "phoc-marshalers.h"
 
+#include <string.h>
+
+/* More simultaneous touch points than any gesture needs to track */
+#define PHOC_GESTURE_MAX_POINTS 10
+
 enum {
   PROP_0,
   PROP_N_POINTS,
@@ -40,7 +45,9 @@ typedef struct _PointData PointData;
 
 
 struct _PointData {
-  PhocEvent *event;
+  PhocEventSequence *sequence;
+  /* A copy of the last event so tracking a point doesn't allocate */
+  PhocEvent          event;
 
   double     lx;
   double     ly;
@@ -59,7 +66,9 @@ struct _PointData {
  * `PhocGesture` helps to detect and track ongoing gestures.
  */
 typedef struct _PhocGesturePrivate {
-  GHashTable        *points;
+  /* Tracked points in the order they were added */
+  PointData          points[PHOC_GESTURE_MAX_POINTS];
+  guint              n_tracked_points;
 
   PhocEventSequence *last_sequence;
   PhocInputDevice   *device;
@@ -106,6 +115,32 @@ phoc_gesture_set_property (GObject      *object,
 }
 
 
+static PointData *
+find_point (PhocGesturePrivate *priv, PhocEventSequence *sequence)
+{
+  for (guint i = 0; i < priv->n_tracked_points; i++) {
+    if (priv->points[i].sequence == sequence)
+      return &priv->points[i];
+  }
+
+  return NULL;
+}
+
+
+static void
+remove_point_data (PhocGesturePrivate *priv, PointData *data)
+{
+  guint i = data - priv->points;
+
+  g_assert (i < priv->n_tracked_points);
+
+  priv->n_tracked_points--;
+  memmove (&priv->points[i], &priv->points[i + 1],
+           (priv->n_tracked_points - i) * sizeof (PointData));
+  memset (&priv->points[priv->n_tracked_points], 0, sizeof (PointData));
+}
+
+
 static GList *
 phoc_gesture_get_group_link (PhocGesture *self)
 {
@@ -124,7 +159,7 @@ phoc_gesture_finalize (GObject *object)
   PhocGesturePrivate *priv = phoc_gesture_get_instance_private (self);
 
   phoc_gesture_ungroup (self);
-  g_clear_pointer (&priv->points, g_hash_table_destroy);
+  priv->n_tracked_points = 0;
   g_clear_pointer (&priv->group_link, g_list_free);
 
   G_OBJECT_CLASS (phoc_gesture_parent_class)->finalize (object);
@@ -145,26 +180,26 @@ phoc_gesture_get_n_touchpad_points (PhocGesture *self,
   if (!priv->touchpad)
     return 0;
 
-  data = g_hash_table_lookup (priv->points, NULL);
+  data = find_point (priv, NULL);
 
   if (!data)
     return 0;
 
   if (only_active &&
       (data->state == PHOC_EVENT_SEQUENCE_DENIED ||
-       data->event->type == PHOC_EVENT_TOUCHPAD_SWIPE_END ||
-       data->event->type == PHOC_EVENT_TOUCHPAD_PINCH_END))
+       data->event.type == PHOC_EVENT_TOUCHPAD_SWIPE_END ||
+       data->event.type == PHOC_EVENT_TOUCHPAD_PINCH_END))
     return 0;
 
-  switch (data->event->type) {
+  switch (data->event.type) {
   case PHOC_EVENT_TOUCHPAD_SWIPE_BEGIN:
-    return data->event->touchpad_swipe_begin.fingers;
+    return data->event.touchpad_swipe_begin.fingers;
   case PHOC_EVENT_TOUCHPAD_SWIPE_UPDATE:
-    return data->event->touchpad_swipe_begin.fingers;
+    return data->event.touchpad_swipe_begin.fingers;
   case PHOC_EVENT_TOUCHPAD_PINCH_BEGIN:
-    return data->event->touchpad_pinch_begin.fingers;
+    return data->event.touchpad_pinch_begin.fingers;
   case PHOC_EVENT_TOUCHPAD_PINCH_UPDATE:
-    return data->event->touchpad_pinch_begin.fingers;
+    return data->event.touchpad_pinch_begin.fingers;
   default:
     return 0;
   }
@@ -199,18 +234,17 @@ phoc_gesture_get_n_touch_points (PhocGesture *self,
                                  gboolean     only_active)
 {
   PhocGesturePrivate *priv;
-  GHashTableIter iter;
   guint n_points = 0;
-  PointData *data;
 
   priv = phoc_gesture_get_instance_private (self);
-  g_hash_table_iter_init (&iter, priv->points);
 
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &data)) {
+  for (guint i = 0; i < priv->n_tracked_points; i++) {
+    PointData *data = &priv->points[i];
+
     if (only_active &&
         (data->state == PHOC_EVENT_SEQUENCE_DENIED ||
-         data->event->type == PHOC_EVENT_TOUCH_END ||
-         data->event->type == PHOC_EVENT_BUTTON_RELEASE))
+         data->event.type == PHOC_EVENT_TOUCH_END ||
+         data->event.type == PHOC_EVENT_BUTTON_RELEASE))
       continue;
 
     n_points++;
@@ -316,14 +350,11 @@ phoc_gesture_check_recognized (PhocGesture       *self,
 static void
 update_touchpad_deltas (PointData *data)
 {
-  PhocEvent *event = data->event;
+  PhocEvent *event = &data->event;
   PhocTouchpadGesturePhase phase;
   double dx;
   double dy;
 
-  if (!event)
-    return;
-
   if (!phoc_event_is_touchpad_gesture (event))
     return;
 
@@ -366,7 +397,7 @@ phoc_gesture_update_point (PhocGesture     *self,
       return FALSE;
 
     /* Make touchpad and touchscreen gestures mutually exclusive */
-    if (touchpad && g_hash_table_size (priv->points) > 0)
+    if (touchpad && priv->n_tracked_points > 0)
       return FALSE;
     else if (!touchpad && priv->touchpad)
       return FALSE;
@@ -376,25 +407,27 @@ phoc_gesture_update_point (PhocGesture     *self,
   }
 
   sequence = phoc_event_get_event_sequence (event);
-  existed = g_hash_table_lookup_extended (priv->points, sequence,
-                                          NULL, (gpointer *) &data);
+  data = find_point (priv, sequence);
+  existed = !!data;
   if (!existed) {
     if (!add)
       return FALSE;
 
-    if (g_hash_table_size (priv->points) == 0) {
+    if (priv->n_tracked_points == PHOC_GESTURE_MAX_POINTS) {
+      g_debug ("Too many touch points, ignoring sequence %p", sequence);
+      return FALSE;
+    }
+
+    if (priv->n_tracked_points == 0) {
       priv->device = device;
       priv->touchpad = touchpad;
     }
 
-    data = g_new0 (PointData, 1);
-    g_hash_table_insert (priv->points, sequence, data);
+    data = &priv->points[priv->n_tracked_points++];
+    data->sequence = sequence;
   }
 
-  if (data->event)
-    phoc_event_free (data->event);
-
-  data->event = phoc_event_copy (event);
+  data->event = *event;
   update_touchpad_deltas (data);
   data->lx = lx + data->accum_dx;
   data->ly = ly + data->accum_dy;
@@ -427,7 +460,7 @@ phoc_gesture_check_empty (PhocGesture *self)
 
   priv = phoc_gesture_get_instance_private (self);
 
-  if (g_hash_table_size (priv->points) == 0) {
+  if (priv->n_tracked_points == 0) {
     // priv->window = NULL;
     priv->device = NULL;
     priv->touchpad = FALSE;
@@ -441,6 +474,7 @@ phoc_gesture_remove_point (PhocGesture     *self,
   PhocEventSequence *sequence;
   PhocGesturePrivate *priv;
   PhocInputDevice *device;
+  PointData *data;
 
   sequence = phoc_event_get_event_sequence (event);
   device = phoc_event_get_device (event);
@@ -449,7 +483,9 @@ phoc_gesture_remove_point (PhocGesture     *self,
   if (priv->device != device)
     return;
 
-  g_hash_table_remove (priv->points, sequence);
+  data = find_point (priv, sequence);
+  if (data)
+    remove_point_data (priv, data);
   phoc_gesture_check_empty (self);
 }
 
@@ -457,16 +493,19 @@ phoc_gesture_remove_point (PhocGesture     *self,
 static void
 phoc_gesture_cancel_all (PhocGesture *self)
 {
-  PhocEventSequence *sequence;
   PhocGesturePrivate *priv;
-  GHashTableIter iter;
 
   priv = phoc_gesture_get_instance_private (self);
-  g_hash_table_iter_init (&iter, priv->points);
 
-  while (g_hash_table_iter_next (&iter, (gpointer*) &sequence, NULL)) {
+  while (priv->n_tracked_points) {
+    PhocEventSequence *sequence = priv->points[0].sequence;
+    PointData *data;
+
     g_signal_emit (self, signals[CANCEL], 0, sequence);
-    g_hash_table_iter_remove (&iter);
+    /* Handlers might have modified the tracked points */
+    data = find_point (priv, sequence);
+    if (data)
+      remove_point_data (priv, data);
     phoc_gesture_check_recognized (self, sequence);
   }
 
@@ -484,13 +523,15 @@ phoc_gesture_cancel_sequence (PhocGesture       *self,
   g_return_val_if_fail (PHOC_IS_GESTURE (self), FALSE);
 
   priv = phoc_gesture_get_instance_private (self);
-  data = g_hash_table_lookup (priv->points, sequence);
+  data = find_point (priv, sequence);
 
   if (!data)
     return FALSE;
 
   g_signal_emit (self, signals[CANCEL], 0, sequence);
-  phoc_gesture_remove_point (self, data->event);
+  data = find_point (priv, sequence);
+  if (data)
+    phoc_gesture_remove_point (self, &data->event);
   phoc_gesture_check_recognized (self, sequence);
 
   return TRUE;
@@ -538,12 +579,12 @@ phoc_gesture_handle_event_impl (PhocGesture *self, const PhocEvent *event, doubl
       if (phoc_gesture_check_recognized (self, sequence)) {
         PointData *data;
 
-        data = g_hash_table_lookup (priv->points, sequence);
+        data = find_point (priv, sequence);
 
         /* If the sequence was claimed early, the press event will be consumed */
-        if (phoc_gesture_get_sequence_state (self, sequence) == PHOC_EVENT_SEQUENCE_CLAIMED)
+        if (data && phoc_gesture_get_sequence_state (self, sequence) == PHOC_EVENT_SEQUENCE_CLAIMED)
           data->press_handled = TRUE;
-      } else if (triggered_recognition && g_hash_table_size (priv->points) == 0) {
+      } else if (triggered_recognition && priv->n_tracked_points == 0) {
         /* Recognition was triggered, but the gesture reset during
          * ::begin emission. Still, recognition was strictly triggered,
          * so the event should be consumed.
@@ -714,24 +755,12 @@ phoc_gesture_class_init (PhocGestureClass *klass)
 }
 
 
-static void
-free_point_data (gpointer data)
-{
-  PointData *point = data;
-
-  g_clear_pointer (&point->event, phoc_event_free);
-  g_free (point);
-}
-
-
 static void
 phoc_gesture_init (PhocGesture *self)
 {
   PhocGesturePrivate *priv = phoc_gesture_get_instance_private (self);
 
   priv->n_points = 1;
-  priv->points = g_hash_table_new_full (NULL, NULL, NULL,
-                                        (GDestroyNotify) free_point_data);
   priv->group_link = g_list_prepend (NULL, self);
 }
 
@@ -807,7 +836,10 @@ phoc_gesture_get_sequence_state (PhocGesture       *self,
   g_return_val_if_fail (PHOC_IS_GESTURE (self), PHOC_EVENT_SEQUENCE_NONE);
 
   priv = phoc_gesture_get_instance_private (self);
-  data = g_hash_table_lookup (priv->points, self);
+  /* FIXME: This looks up the gesture rather than the sequence and hence
+   * never matches. Event consumption in handle_event relies on that so
+   * keep it until that is sorted out. */
+  data = find_point (priv, (PhocEventSequence *) self);
 
   if (!data)
     return PHOC_EVENT_SEQUENCE_NONE;
@@ -880,7 +912,7 @@ phoc_gesture_set_sequence_state (PhocGesture           *self,
                         state <= PHOC_EVENT_SEQUENCE_DENIED, FALSE);
 
   priv = phoc_gesture_get_instance_private (self);
-  data = g_hash_table_lookup (priv->points, sequence);
+  data = find_point (priv, sequence);
 
   if (!data)
     return FALSE;
@@ -925,21 +957,23 @@ gboolean
 phoc_gesture_set_state (PhocGesture            *self,
                         PhocEventSequenceState  state)
 {
+  PhocEventSequence *sequences[PHOC_GESTURE_MAX_POINTS];
   gboolean handled = FALSE;
   PhocGesturePrivate *priv;
-  GList *sequences, *l;
+  guint n_sequences;
 
   g_return_val_if_fail (PHOC_IS_GESTURE (self), FALSE);
   g_return_val_if_fail (state >= PHOC_EVENT_SEQUENCE_NONE &&
                         state <= PHOC_EVENT_SEQUENCE_DENIED, FALSE);
 
   priv = phoc_gesture_get_instance_private (self);
-  sequences = g_hash_table_get_keys (priv->points);
+  /* Setting the state emits signals so work on a copy */
+  n_sequences = priv->n_tracked_points;
+  for (guint i = 0; i < n_sequences; i++)
+    sequences[i] = priv->points[i].sequence;
 
-  for (l = sequences; l; l = l->next)
-    handled |= phoc_gesture_set_sequence_state (self, l->data, state);
-
-  g_list_free (sequences);
+  for (guint i = 0; i < n_sequences; i++)
+    handled |= phoc_gesture_set_sequence_state (self, sequences[i], state);
 
   return handled;
 }
@@ -960,28 +994,57 @@ phoc_gesture_set_state (PhocGesture            *self,
 GList *
 phoc_gesture_get_sequences (PhocGesture *self)
 {
-  PhocEventSequence *sequence;
-  PhocGesturePrivate *priv;
-  GList *sequences = NULL;
-  GHashTableIter iter;
-  PointData *data;
+  PhocEventSequence *sequences[PHOC_GESTURE_MAX_POINTS];
+  GList *list = NULL;
+  guint n_sequences;
 
   g_return_val_if_fail (PHOC_IS_GESTURE (self), NULL);
 
+  n_sequences = phoc_gesture_get_active_sequences (self, sequences, G_N_ELEMENTS (sequences));
+  for (guint i = n_sequences; i > 0; i--)
+    list = g_list_prepend (list, sequences[i - 1]);
+
+  return list;
+}
+
+/**
+ * phoc_gesture_get_active_sequences:
+ * @self: a #PhocGesture
+ * @sequences: (out caller-allocates) (array length=max_sequences): Return
+ *   location for the sequences
+ * @max_sequences: The number of elements @sequences can hold
+ *
+ * Like [method@Gesture.get_sequences] but fills the caller provided
+ * @sequences instead of allocating a list. This is meant for use
+ * on the hot path, e.g. when handling touch motion.
+ *
+ * Returns: The number of sequences stored in @sequences
+ **/
+guint
+phoc_gesture_get_active_sequences (PhocGesture        *self,
+                                   PhocEventSequence **sequences,
+                                   guint               max_sequences)
+{
+  PhocGesturePrivate *priv;
+  guint n_sequences = 0;
+
+  g_return_val_if_fail (PHOC_IS_GESTURE (self), 0);
+
   priv = phoc_gesture_get_instance_private (self);
-  g_hash_table_iter_init (&iter, priv->points);
 
-  while (g_hash_table_iter_next (&iter, (gpointer *) &sequence, (gpointer *) &data)) {
+  for (guint i = 0; i < priv->n_tracked_points && n_sequences < max_sequences; i++) {
+    PointData *data = &priv->points[i];
+
     if (data->state == PHOC_EVENT_SEQUENCE_DENIED)
       continue;
-    if (data->event->type == PHOC_EVENT_TOUCH_END ||
-        data->event->type == PHOC_EVENT_BUTTON_RELEASE)
+    if (data->event.type == PHOC_EVENT_TOUCH_END ||
+        data->event.type == PHOC_EVENT_BUTTON_RELEASE)
       continue;
 
-    sequences = g_list_prepend (sequences, sequence);
+    sequences[n_sequences++] = data->sequence;
   }
 
-  return sequences;
+  return n_sequences;
 }
 
 /**
@@ -1026,12 +1089,12 @@ phoc_gesture_get_last_event (PhocGesture *self, PhocEventSequence *sequence)
   g_return_val_if_fail (PHOC_IS_GESTURE (self), NULL);
 
   priv = phoc_gesture_get_instance_private (self);
-  data = g_hash_table_lookup (priv->points, sequence);
+  data = find_point (priv, sequence);
 
   if (!data)
     return NULL;
 
-  return data->event;
+  return &data->event;
 }
 
 
@@ -1063,8 +1126,8 @@ phoc_gesture_get_point (PhocGesture       *self,
 
   priv = phoc_gesture_get_instance_private (self);
 
-  if (!g_hash_table_lookup_extended (priv->points, sequence,
-                                     NULL, (gpointer *) &data))
+  data = find_point (priv, sequence);
+  if (!data)
     return FALSE;
 
   if (lx)
@@ -1087,12 +1150,12 @@ phoc_gesture_get_last_update_time (PhocGesture       *self,
 
   priv = phoc_gesture_get_instance_private (self);
 
-  if (!g_hash_table_lookup_extended (priv->points, sequence,
-                                     NULL, (gpointer *) &data))
+  data = find_point (priv, sequence);
+  if (!data)
     return FALSE;
 
   if (evtime)
-    *evtime = phoc_event_get_time (data->event);
+    *evtime = phoc_event_get_time (&data->event);
 
   return TRUE;
 }
@@ -1142,7 +1205,7 @@ phoc_gesture_handles_sequence (PhocGesture       *self,
   g_return_val_if_fail (PHOC_IS_GESTURE (self), FALSE);
 
   priv = phoc_gesture_get_instance_private (self);
-  data = g_hash_table_lookup (priv->points, sequence);
+  data = find_point (priv, sequence);
 
   if (!data)
     return FALSE;
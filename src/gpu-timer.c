@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-gpu-timer"
+
+#include "phoc-config.h"
+
+#include "gpu-timer.h"
+
+#include <string.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+/* How many frames the GPU may lag behind before frames go untimed */
+#define PHOC_GPU_TIMER_N_QUERIES 4
+/* How often GPU and monotonic clock get correlated */
+#define PHOC_GPU_TIMER_CALIBRATE_US G_USEC_PER_SEC
+
+/**
+ * PhocGpuTimer:
+ *
+ * Measures how long the GPU takes for a render pass via
+ * `GL_EXT_disjoint_timer_query` timestamps placed at the start and
+ * end of the pass.
+ *
+ * Results are read without blocking when the next pass begins, so
+ * they usually arrive a frame late. If the GPU falls behind by more
+ * than a few frames passes go untimed rather than stalling. Results
+ * are dropped when the driver reports a disjoint operation (e.g. a
+ * GPU reset or frequency change) as they can't be trusted.
+ *
+ * Timestamps are converted to the monotonic clock so they can be put
+ * next to CPU side timings.
+ */
+
+typedef struct {
+  GLuint   start;
+  GLuint   end;
+  gint64   offset_ns;
+  gboolean pending;
+  gboolean discard;
+} PhocGpuTimerQuery;
+
+typedef struct {
+  gint64 start_us;
+  gint64 end_us;
+} PhocGpuTimerResult;
+
+struct _PhocGpuTimer {
+  struct wlr_egl    *egl;
+
+  PhocGpuTimerQuery  queries[PHOC_GPU_TIMER_N_QUERIES];
+  guint              next;
+  PhocGpuTimerQuery *current;
+
+  /* Monotonic time minus GPU time in ns */
+  gint64             offset_ns;
+  gint64             last_calibrate_us;
+
+  GArray            *results;
+};
+
+static PFNGLGENQUERIESEXTPROC glGenQueriesEXT;
+static PFNGLDELETEQUERIESEXTPROC glDeleteQueriesEXT;
+static PFNGLQUERYCOUNTEREXTPROC glQueryCounterEXT;
+static PFNGLGETQUERYIVEXTPROC glGetQueryivEXT;
+static PFNGLGETQUERYOBJECTIVEXTPROC glGetQueryObjectivEXT;
+static PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64vEXT;
+static PFNGLGETINTEGER64VEXTPROC glGetInteger64vEXT;
+
+
+/* Must be called with the EGL context current */
+static gboolean
+load_timer_procs (void)
+{
+  const char *exts;
+  GLint bits = 0;
+
+  if (glQueryCounterEXT)
+    return TRUE;
+
+  exts = (const char *)glGetString (GL_EXTENSIONS);
+  if (exts == NULL || !strstr (exts, "GL_EXT_disjoint_timer_query"))
+    return FALSE;
+
+  glGenQueriesEXT = (PFNGLGENQUERIESEXTPROC)eglGetProcAddress ("glGenQueriesEXT");
+  glDeleteQueriesEXT = (PFNGLDELETEQUERIESEXTPROC)eglGetProcAddress ("glDeleteQueriesEXT");
+  glGetQueryivEXT = (PFNGLGETQUERYIVEXTPROC)eglGetProcAddress ("glGetQueryivEXT");
+  glGetQueryObjectivEXT =
+    (PFNGLGETQUERYOBJECTIVEXTPROC)eglGetProcAddress ("glGetQueryObjectivEXT");
+  glGetQueryObjectui64vEXT =
+    (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress ("glGetQueryObjectui64vEXT");
+  glGetInteger64vEXT = (PFNGLGETINTEGER64VEXTPROC)eglGetProcAddress ("glGetInteger64vEXT");
+  if (!glGenQueriesEXT || !glDeleteQueriesEXT || !glGetQueryivEXT || !glGetQueryObjectivEXT ||
+      !glGetQueryObjectui64vEXT || !glGetInteger64vEXT) {
+    return FALSE;
+  }
+
+  /* Implementations may support elapsed time queries only */
+  glGetQueryivEXT (GL_TIMESTAMP_EXT, GL_QUERY_COUNTER_BITS_EXT, &bits);
+  if (!bits)
+    return FALSE;
+
+  glQueryCounterEXT = (PFNGLQUERYCOUNTEREXTPROC)eglGetProcAddress ("glQueryCounterEXT");
+
+  return !!glQueryCounterEXT;
+}
+
+
+static void
+calibrate (PhocGpuTimer *self)
+{
+  gint64 now_us = g_get_monotonic_time ();
+  GLint64 gpu_ns = 0;
+
+  if (self->last_calibrate_us && now_us - self->last_calibrate_us < PHOC_GPU_TIMER_CALIBRATE_US)
+    return;
+
+  glGetInteger64vEXT (GL_TIMESTAMP_EXT, &gpu_ns);
+  self->offset_ns = now_us * 1000 - gpu_ns;
+  self->last_calibrate_us = now_us;
+}
+
+/* Read the results of finished passes, oldest first */
+static void
+collect (PhocGpuTimer *self)
+{
+  GLint disjoint = 0;
+
+  /* Reading the flag resets it. It affects all passes issued so far */
+  glGetIntegerv (GL_GPU_DISJOINT_EXT, &disjoint);
+  if (disjoint) {
+    for (guint i = 0; i < PHOC_GPU_TIMER_N_QUERIES; i++)
+      self->queries[i].discard = TRUE;
+    self->last_calibrate_us = 0;
+  }
+
+  for (guint i = 0; i < PHOC_GPU_TIMER_N_QUERIES; i++) {
+    PhocGpuTimerQuery *query = &self->queries[(self->next + i) % PHOC_GPU_TIMER_N_QUERIES];
+    PhocGpuTimerResult result;
+    GLuint64 start_ns, end_ns;
+    GLint available = 0;
+
+    if (!query->pending)
+      continue;
+
+    glGetQueryObjectivEXT (query->end, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+    if (!available)
+      break;
+
+    query->pending = FALSE;
+    if (query->discard)
+      continue;
+
+    glGetQueryObjectui64vEXT (query->start, GL_QUERY_RESULT_EXT, &start_ns);
+    glGetQueryObjectui64vEXT (query->end, GL_QUERY_RESULT_EXT, &end_ns);
+    result = (PhocGpuTimerResult) {
+      .start_us = ((gint64)start_ns + query->offset_ns) / 1000,
+      .end_us = ((gint64)end_ns + query->offset_ns) / 1000,
+    };
+
+    /* Nobody is interested in old results */
+    if (self->results->len == PHOC_GPU_TIMER_N_QUERIES)
+      g_array_remove_index (self->results, 0);
+    g_array_append_val (self->results, result);
+  }
+}
+
+/**
+ * phoc_gpu_timer_new:
+ * @egl: (nullable): The EGL context render passes use
+ *
+ * Creates a timer for render passes using @egl.
+ *
+ * Returns:(transfer full)(nullable): The timer or %NULL if the
+ *   renderer doesn't support timer queries
+ */
+PhocGpuTimer *
+phoc_gpu_timer_new (struct wlr_egl *egl)
+{
+  PhocGpuTimer *self;
+  GLuint ids[2 * PHOC_GPU_TIMER_N_QUERIES];
+
+  if (!egl)
+    return NULL;
+
+  if (!wlr_egl_make_current (egl))
+    return NULL;
+
+  if (!load_timer_procs ()) {
+    g_debug ("Timestamp queries not supported, GPU times won't be available");
+    wlr_egl_unset_current (egl);
+    return NULL;
+  }
+
+  self = g_new0 (PhocGpuTimer, 1);
+  self->egl = egl;
+  self->results = g_array_new (FALSE, FALSE, sizeof (PhocGpuTimerResult));
+
+  glGenQueriesEXT (G_N_ELEMENTS (ids), ids);
+  for (guint i = 0; i < PHOC_GPU_TIMER_N_QUERIES; i++) {
+    self->queries[i].start = ids[2 * i];
+    self->queries[i].end = ids[2 * i + 1];
+  }
+
+  wlr_egl_unset_current (egl);
+
+  return self;
+}
+
+
+void
+phoc_gpu_timer_free (PhocGpuTimer *self)
+{
+  if (wlr_egl_make_current (self->egl)) {
+    for (guint i = 0; i < PHOC_GPU_TIMER_N_QUERIES; i++) {
+      glDeleteQueriesEXT (1, &self->queries[i].start);
+      glDeleteQueriesEXT (1, &self->queries[i].end);
+    }
+    wlr_egl_unset_current (self->egl);
+  }
+
+  g_array_unref (self->results);
+  g_free (self);
+}
+
+/**
+ * phoc_gpu_timer_begin:
+ * @self: The GPU timer
+ *
+ * Marks the start of a render pass. Must be called within the pass so
+ * the EGL context is current. Also collects the results of earlier
+ * passes the GPU finished meanwhile.
+ */
+void
+phoc_gpu_timer_begin (PhocGpuTimer *self)
+{
+  PhocGpuTimerQuery *query = &self->queries[self->next];
+
+  g_assert (self->current == NULL);
+
+  collect (self);
+
+  /* The GPU is too far behind, skip this pass rather than waiting */
+  if (query->pending)
+    return;
+
+  calibrate (self);
+  query->offset_ns = self->offset_ns;
+  query->discard = FALSE;
+  glQueryCounterEXT (query->start, GL_TIMESTAMP_EXT);
+  self->current = query;
+}
+
+/**
+ * phoc_gpu_timer_end:
+ * @self: The GPU timer
+ *
+ * Marks the end of the render pass started with
+ * [method@GpuTimer.begin]. Must be called before the pass is
+ * submitted.
+ */
+void
+phoc_gpu_timer_end (PhocGpuTimer *self)
+{
+  if (!self->current)
+    return;
+
+  glQueryCounterEXT (self->current->end, GL_TIMESTAMP_EXT);
+  self->current->pending = TRUE;
+  self->current = NULL;
+  self->next = (self->next + 1) % PHOC_GPU_TIMER_N_QUERIES;
+}
+
+/**
+ * phoc_gpu_timer_pop_result:
+ * @self: The GPU timer
+ * @start_us: (out): When the GPU started the pass in monotonic time
+ * @end_us: (out): When the GPU finished the pass in monotonic time
+ *
+ * Takes the oldest result of a finished render pass.
+ *
+ * Returns: %TRUE if there was a result
+ */
+gboolean
+phoc_gpu_timer_pop_result (PhocGpuTimer *self, gint64 *start_us, gint64 *end_us)
+{
+  PhocGpuTimerResult *result;
+
+  if (!self->results->len)
+    return FALSE;
+
+  result = &g_array_index (self->results, PhocGpuTimerResult, 0);
+  *start_us = result->start_us;
+  *end_us = result->end_us;
+  g_array_remove_index (self->results, 0);
+
+  return TRUE;
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include <wlr/render/egl.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PhocGpuTimer PhocGpuTimer;
+
+PhocGpuTimer *phoc_gpu_timer_new        (struct wlr_egl *egl);
+void          phoc_gpu_timer_free       (PhocGpuTimer   *self);
+void          phoc_gpu_timer_begin      (PhocGpuTimer   *self);
+void          phoc_gpu_timer_end        (PhocGpuTimer   *self);
+gboolean      phoc_gpu_timer_pop_result (PhocGpuTimer   *self,
+                                         gint64         *start_us,
+                                         gint64         *end_us);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocGpuTimer, phoc_gpu_timer_free)
+
+G_END_DECLS
@@ -9,6 +9,7 @@
 #define G_LOG_DOMAIN "phoc-idle-inhibit"
 
 #include "phoc-config.h"
+#include "phoc-tracing.h"
 
 #include "idle-inhibit.h"
 #include "server.h"
@@ -24,6 +25,13 @@
  * PhocIdleInhibit:
  *
  * Forward idle inhibit to gnome-session
+ *
+ * An inhibitor only inhibits idle while its view is visible. The
+ * visibility is cached per inhibitor and only reevaluated when
+ * something that affects it changes: the view gets (un)mapped, the
+ * view stack or output layout changes (see
+ * [method@IdleInhibit.queue_update]). Transitions are exposed via the
+ * `idle_inhibit` trace probe.
  */
 struct _PhocIdleInhibit {
   struct wlr_idle_inhibit_manager_v1 *wlr_idle_inhibit;
@@ -32,6 +40,7 @@ struct _PhocIdleInhibit {
   struct wl_listener                  new_idle_inhibitor_v1;
 
   GSList                             *inhibitors_v1;
+  guint                               update_id;
 
   GDBusProxy                         *screensaver_proxy;
   GCancellable                       *cancellable;
@@ -42,6 +51,10 @@ typedef struct _PhocIdleInhibitorV1 {
   PhocView                     *view;
   guint                         cookie;
   GCancellable                 *cancellable;
+  /* Whether we want to inhibit (the cached visibility) */
+  gboolean                      inhibit;
+  /* Whether an Inhibit call is in flight */
+  gboolean                      inhibit_pending;
 
   struct wlr_idle_inhibitor_v1 *wlr_inhibitor;
 
@@ -49,6 +62,9 @@ typedef struct _PhocIdleInhibitorV1 {
 } PhocIdleInhibitorV1;
 
 
+static void sync_inhibitor (PhocIdleInhibitorV1 *inhibitor);
+
+
 static void
 on_screensaver_inhibit_finish (GObject *source, GAsyncResult *res, gpointer user_data)
 {
@@ -58,13 +74,19 @@ on_screensaver_inhibit_finish (GObject *source, GAsyncResult *res, gpointer user
 
   ret = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &err);
   if (ret == NULL) {
-    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
       g_warning ("Failed to inhibit " SCREENSAVER_BUS_NAME ": %s", err->message);
+      inhibitor->inhibit_pending = FALSE;
+    }
     return;
   }
 
+  inhibitor->inhibit_pending = FALSE;
   g_variant_get (ret, "(u)", &inhibitor->cookie);
   g_debug ("Inhibit " SCREENSAVER_BUS_NAME " (%p), cookie = %u", inhibitor, inhibitor->cookie);
+
+  /* Visibility might have changed while the call was in flight */
+  sync_inhibitor (inhibitor);
 }
 
 
@@ -82,6 +104,7 @@ screensaver_idle_inhibit (PhocIdleInhibit *self, PhocIdleInhibitorV1 *inhibitor,
   if (app_id == NULL)
     app_id = PHOC_APP_ID;
 
+  inhibitor->inhibit_pending = TRUE;
   g_dbus_proxy_call (self->screensaver_proxy,
                      "Inhibit",
                      g_variant_new ("(ss)", app_id, _("Inhibiting idle session")),
@@ -126,16 +149,93 @@ screensaver_idle_uninhibit (PhocIdleInhibit *self, PhocIdleInhibitorV1 *inhibito
                      g_variant_new ("(u)", inhibitor->cookie),
                      G_DBUS_CALL_FLAGS_NO_AUTO_START,
                      -1,
-                     inhibitor->cancellable,
+                     self->cancellable,
                      on_screensaver_idle_uninhibit_finish,
                      GUINT_TO_POINTER (inhibitor->cookie));
   inhibitor->cookie = 0;
 }
 
 
+static void
+sync_inhibitor (PhocIdleInhibitorV1 *inhibitor)
+{
+  PhocIdleInhibit *self = inhibitor->idle_inhibit;
+
+  /* Picked up once the call finished */
+  if (inhibitor->inhibit_pending)
+    return;
+
+  if (inhibitor->inhibit && inhibitor->cookie == 0)
+    screensaver_idle_inhibit (self, inhibitor, inhibitor->view);
+  else if (!inhibitor->inhibit && inhibitor->cookie)
+    screensaver_idle_uninhibit (self, inhibitor);
+}
+
+
+static void
+set_inhibit (PhocIdleInhibitorV1 *inhibitor, gboolean inhibit, const char *reason)
+{
+  const char *app_id = NULL;
+
+  if (inhibitor->inhibit == inhibit)
+    return;
+
+  inhibitor->inhibit = inhibit;
+
+  if (inhibitor->view)
+    app_id = phoc_view_get_app_id (inhibitor->view);
+  g_debug ("Idle inhibitor v1 (%p, %s): %s: %s", inhibitor, app_id ?: "<none>",
+           inhibit ? "inhibiting" : "not inhibiting", reason);
+  DTRACE_PROBE3 (phoc, idle_inhibit, app_id, inhibit, reason);
+
+  sync_inhibitor (inhibitor);
+}
+
+
+static void
+update_inhibitor (PhocIdleInhibitorV1 *inhibitor)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+
+  /* Inhibit when we can't find a matching view */
+  if (inhibitor->view == NULL) {
+    set_inhibit (inhibitor, TRUE, "no-view");
+    return;
+  }
+
+  if (!phoc_view_is_mapped (inhibitor->view)) {
+    set_inhibit (inhibitor, FALSE, "unmapped");
+    return;
+  }
+
+  if (desktop && !phoc_desktop_view_is_visible (desktop, inhibitor->view)) {
+    set_inhibit (inhibitor, FALSE, "occluded");
+    return;
+  }
+
+  set_inhibit (inhibitor, TRUE, "visible");
+}
+
+
+static gboolean
+on_update (gpointer data)
+{
+  PhocIdleInhibit *self = data;
+
+  self->update_id = 0;
+
+  for (GSList *l = self->inhibitors_v1; l; l = l->next)
+    update_inhibitor (l->data);
+
+  return G_SOURCE_REMOVE;
+}
+
+
 static void
 phoc_idle_inhibit_destroy_inhibitor_v1 (PhocIdleInhibit *self, PhocIdleInhibitorV1 *inhibitor)
 {
+  if (inhibitor->inhibit)
+    DTRACE_PROBE3 (phoc, idle_inhibit, NULL, FALSE, "destroyed");
   screensaver_idle_uninhibit (self, inhibitor);
 
   /* We go away but view sticks around so disconnect signals */
@@ -166,10 +266,7 @@ on_view_mapped_changed (PhocIdleInhibitorV1 *inhibitor, GParamSpec *pspec, PhocV
 {
   g_assert (PHOC_IS_VIEW (view));
 
-  if (phoc_view_is_mapped (view))
-    screensaver_idle_inhibit (inhibitor->idle_inhibit, inhibitor, view);
-  else
-    screensaver_idle_uninhibit (inhibitor->idle_inhibit, inhibitor);
+  update_inhibitor (inhibitor);
 }
 
 
@@ -178,8 +275,8 @@ on_surface_destroy (PhocIdleInhibitorV1 *inhibitor, PhocView *view)
 {
   g_assert (PHOC_IS_VIEW (view));
 
-  screensaver_idle_uninhibit (inhibitor->idle_inhibit, inhibitor);
-
+  g_signal_handlers_disconnect_by_data (view, inhibitor);
+  set_inhibit (inhibitor, FALSE, "surface-destroyed");
   inhibitor->view = NULL;
 }
 
@@ -205,19 +302,16 @@ handle_idle_inhibitor_v1 (struct wl_listener *listener, void *data)
   inhibitor->view = phoc_view_from_wlr_surface (wlr_inhibitor->surface);
   if (inhibitor->view) {
     g_signal_connect_swapped (inhibitor->view,
-                              "notify::mapped",
+                              "notify::is-mapped",
                               G_CALLBACK (on_view_mapped_changed),
                               inhibitor);
-    on_view_mapped_changed (inhibitor, NULL, inhibitor->view);
-
     g_signal_connect_swapped (inhibitor->view,
                               "surface-destroy",
                               G_CALLBACK (on_surface_destroy),
                               inhibitor);
-  } else {
-    /* Inhibit when we can't find a matching view */
-    screensaver_idle_inhibit (self, inhibitor, NULL);
   }
+
+  update_inhibitor (inhibitor);
 }
 
 
@@ -280,18 +374,38 @@ phoc_idle_inhibit_create (void)
 }
 
 
+/**
+ * phoc_idle_inhibit_queue_update:
+ * @self: The idle inhibit object
+ *
+ * Something that can change view visibility (like the view stack or
+ * the output layout) changed. Reevaluate the inhibitors from an idle
+ * callback so a burst of changes results in a single check.
+ */
+void
+phoc_idle_inhibit_queue_update (PhocIdleInhibit *self)
+{
+  if (self->inhibitors_v1 == NULL || self->update_id)
+    return;
+
+  self->update_id = g_idle_add (on_update, self);
+  g_source_set_name_by_id (self->update_id, "[phoc] idle inhibit update");
+}
+
+
 void
 phoc_idle_inhibit_destroy (PhocIdleInhibit *self)
 {
+  g_clear_handle_id (&self->update_id, g_source_remove);
   wl_list_remove (&self->new_idle_inhibitor_v1.link);
 
+  /* Removes the inhibitor from the list */
+  while (self->inhibitors_v1)
+    phoc_idle_inhibit_destroy_inhibitor_v1 (self, self->inhibitors_v1->data);
+
   g_cancellable_cancel (self->cancellable);
   g_clear_object (&self->cancellable);
 
-  for (GSList *l = self->inhibitors_v1; l; l = l->next)
-    phoc_idle_inhibit_destroy_inhibitor_v1 (self, l->data);
-  g_slist_free (self->inhibitors_v1);
-
   g_clear_object (&self->screensaver_proxy);
 
   g_free (self);
@@ -14,7 +14,8 @@ G_BEGIN_DECLS
 
 typedef struct _PhocIdleInhibit PhocIdleInhibit;
 
-PhocIdleInhibit *phoc_idle_inhibit_create  (void);
-void             phoc_idle_inhibit_destroy (PhocIdleInhibit *self);
+PhocIdleInhibit *phoc_idle_inhibit_create       (void);
+void             phoc_idle_inhibit_destroy      (PhocIdleInhibit *self);
+void             phoc_idle_inhibit_queue_update (PhocIdleInhibit *self);
 
 G_END_DECLS
@@ -47,6 +47,9 @@ typedef struct _PhocInputDevicePrivate {
   char                    *vendor;
   char                    *product;
 
+  /* The output absolute devices are mapped to */
+  PhocOutput              *output;
+
   struct wl_listener       device_destroy;
 } PhocInputDevicePrivate;
 
@@ -398,3 +401,42 @@ phoc_input_device_get_product_id (PhocInputDevice *self)
 
   return priv->product;
 }
+
+/**
+ * phoc_input_device_get_output:
+ * @self: The %PhocInputDevice
+ *
+ * Get the output an absolute input device like a touch screen is
+ * mapped to. This is cheap enough to be used in event handlers.
+ *
+ * Returns: (transfer none) (nullable): The output
+ */
+PhocOutput *
+phoc_input_device_get_output (PhocInputDevice *self)
+{
+  PhocInputDevicePrivate *priv;
+
+  g_assert (PHOC_IS_INPUT_DEVICE (self));
+  priv = phoc_input_device_get_instance_private (self);
+
+  return priv->output;
+}
+
+/**
+ * phoc_input_device_set_output:
+ * @self: The %PhocInputDevice
+ * @output: (nullable): The output
+ *
+ * Set the output the device is mapped to. This is done by the seat
+ * when it resolves the device's mapping.
+ */
+void
+phoc_input_device_set_output (PhocInputDevice *self, PhocOutput *output)
+{
+  PhocInputDevicePrivate *priv;
+
+  g_assert (PHOC_IS_INPUT_DEVICE (self));
+  priv = phoc_input_device_get_instance_private (self);
+
+  priv->output = output;
+}
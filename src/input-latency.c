@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-input-latency"
+
+#include "phoc-config.h"
+
+#include "frame-stats.h"
+#include "input-latency.h"
+#include "utils.h"
+
+/* Event timestamps further in the past are from a different clock */
+#define PHOC_INPUT_LATENCY_MAX_AGE_MS 1000
+
+/**
+ * PhocInputLatency:
+ *
+ * Measures the latency from input events to the presentation of the
+ * frame that reflects the client's response.
+ *
+ * When an input event is sent to a surface the event's timestamp is
+ * remembered for the surface's client. The next commit of any of the
+ * client's surfaces is taken as the response to that input. Once a
+ * surface of the client is rendered after that commit the latency is
+ * recorded when the output presents the frame.
+ *
+ * Samples are recorded per output as
+ * `PHOC_FRAME_STATS_METRIC_INPUT_LATENCY` in the output's
+ * [struct@FrameStats] and per client process name.
+ */
+struct _PhocInputLatency {
+  GObject               parent;
+
+  struct wl_listener    new_surface;
+
+  /* wl_client → PhocInputLatencyClient */
+  GHashTable           *clients;
+  /* process name → PhocFrameStats, kept when clients go away */
+  GHashTable           *stats;
+};
+
+G_DEFINE_TYPE (PhocInputLatency, phoc_input_latency, G_TYPE_OBJECT)
+
+typedef struct {
+  PhocInputLatency   *latency;
+  struct wl_client   *wl_client;
+  struct wl_listener  destroy;
+  PhocFrameStats     *stats;
+
+  /* Earliest input not yet followed by a commit */
+  gint64              input_us;
+  /* Earliest input reflected by a commit that wasn't rendered yet */
+  gint64              committed_us;
+} PhocInputLatencyClient;
+
+typedef struct {
+  PhocInputLatency   *latency;
+  struct wl_listener  commit;
+  struct wl_listener  destroy;
+} PhocInputLatencySurface;
+
+
+static gint64
+input_time_to_us (guint32 time_msec)
+{
+  gint64 now_us = g_get_monotonic_time ();
+  guint32 age_ms;
+
+  /* Event times are truncated to 32 bit so compare via differences */
+  age_ms = (guint32)(now_us / 1000) - time_msec;
+  if (age_ms > PHOC_INPUT_LATENCY_MAX_AGE_MS)
+    age_ms = 0;
+
+  return now_us - (gint64)age_ms * 1000;
+}
+
+
+static void
+handle_client_destroy (struct wl_listener *listener, void *data)
+{
+  PhocInputLatencyClient *client = wl_container_of (listener, client, destroy);
+
+  g_hash_table_remove (client->latency->clients, client->wl_client);
+}
+
+
+static void
+phoc_input_latency_client_free (PhocInputLatencyClient *client)
+{
+  wl_list_remove (&client->destroy.link);
+  g_free (client);
+}
+
+
+static PhocInputLatencyClient *
+get_client (PhocInputLatency *self, struct wlr_surface *surface, gboolean create)
+{
+  struct wl_client *wl_client = wl_resource_get_client (surface->resource);
+  PhocInputLatencyClient *client;
+  g_autofree char *name = NULL;
+
+  client = g_hash_table_lookup (self->clients, wl_client);
+  if (client || !create)
+    return client;
+
+  client = g_new0 (PhocInputLatencyClient, 1);
+  client->latency = self;
+  client->wl_client = wl_client;
+
+  name = phoc_utils_get_client_name (wl_client);
+  client->stats = g_hash_table_lookup (self->stats, name);
+  if (!client->stats) {
+    client->stats = phoc_frame_stats_new ();
+    g_hash_table_insert (self->stats, g_steal_pointer (&name), client->stats);
+  }
+
+  client->destroy.notify = handle_client_destroy;
+  wl_client_add_destroy_listener (wl_client, &client->destroy);
+
+  g_hash_table_insert (self->clients, wl_client, client);
+  return client;
+}
+
+
+static void
+handle_surface_commit (struct wl_listener *listener, void *data)
+{
+  PhocInputLatencySurface *latency_surface = wl_container_of (listener, latency_surface, commit);
+  struct wlr_surface *surface = data;
+  PhocInputLatencyClient *client;
+
+  client = get_client (latency_surface->latency, surface, FALSE);
+  if (!client || !client->input_us)
+    return;
+
+  if (!client->committed_us)
+    client->committed_us = client->input_us;
+  client->input_us = 0;
+}
+
+
+static void
+handle_surface_destroy (struct wl_listener *listener, void *data)
+{
+  PhocInputLatencySurface *latency_surface = wl_container_of (listener, latency_surface, destroy);
+
+  wl_list_remove (&latency_surface->commit.link);
+  wl_list_remove (&latency_surface->destroy.link);
+  g_free (latency_surface);
+}
+
+
+static void
+handle_new_surface (struct wl_listener *listener, void *data)
+{
+  PhocInputLatency *self = wl_container_of (listener, self, new_surface);
+  struct wlr_surface *surface = data;
+  PhocInputLatencySurface *latency_surface = g_new0 (PhocInputLatencySurface, 1);
+
+  latency_surface->latency = self;
+
+  latency_surface->commit.notify = handle_surface_commit;
+  wl_signal_add (&surface->events.commit, &latency_surface->commit);
+
+  latency_surface->destroy.notify = handle_surface_destroy;
+  wl_signal_add (&surface->events.destroy, &latency_surface->destroy);
+}
+
+
+static void
+phoc_input_latency_finalize (GObject *object)
+{
+  PhocInputLatency *self = PHOC_INPUT_LATENCY (object);
+
+  wl_list_remove (&self->new_surface.link);
+  g_clear_pointer (&self->clients, g_hash_table_destroy);
+  g_clear_pointer (&self->stats, g_hash_table_destroy);
+
+  G_OBJECT_CLASS (phoc_input_latency_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_input_latency_class_init (PhocInputLatencyClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_input_latency_finalize;
+}
+
+
+static void
+phoc_input_latency_init (PhocInputLatency *self)
+{
+  self->clients = g_hash_table_new_full (g_direct_hash,
+                                         g_direct_equal,
+                                         NULL,
+                                         (GDestroyNotify)phoc_input_latency_client_free);
+  self->stats = g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify)phoc_frame_stats_free);
+}
+
+
+PhocInputLatency *
+phoc_input_latency_new (struct wlr_compositor *compositor)
+{
+  PhocInputLatency *self = g_object_new (PHOC_TYPE_INPUT_LATENCY, NULL);
+
+  self->new_surface.notify = handle_new_surface;
+  wl_signal_add (&compositor->events.new_surface, &self->new_surface);
+
+  return self;
+}
+
+/**
+ * phoc_input_latency_input_sent:
+ * @self: The input latency tracker
+ * @surface: The surface that received input
+ * @time_msec: The input event's timestamp
+ *
+ * Records that an input event was sent to @surface.
+ */
+void
+phoc_input_latency_input_sent (PhocInputLatency   *self,
+                               struct wlr_surface *surface,
+                               guint32             time_msec)
+{
+  PhocInputLatencyClient *client;
+
+  g_assert (PHOC_IS_INPUT_LATENCY (self));
+
+  if (!surface)
+    return;
+
+  client = get_client (self, surface, TRUE);
+  if (!client->input_us)
+    client->input_us = input_time_to_us (time_msec);
+}
+
+/**
+ * phoc_input_latency_surface_rendered:
+ * @self: The input latency tracker
+ * @surface: The surface that got rendered or scanned out
+ * @output: The output that will present the surface
+ *
+ * Records that @surface will be shown with the next frame of @output.
+ */
+void
+phoc_input_latency_surface_rendered (PhocInputLatency   *self,
+                                     struct wlr_surface *surface,
+                                     PhocOutput         *output)
+{
+  PhocInputLatencyClient *client;
+  PhocInputLatencyPending pending;
+  GArray *pendings;
+
+  g_assert (PHOC_IS_INPUT_LATENCY (self));
+  g_assert (PHOC_IS_OUTPUT (output));
+
+  client = get_client (self, surface, FALSE);
+  if (!client || !client->committed_us)
+    return;
+
+  pendings = phoc_output_get_input_latency_pending (output);
+  pending = (PhocInputLatencyPending) {
+    .input_us = client->committed_us,
+    .client_stats = client->stats,
+  };
+  g_array_append_val (pendings, pending);
+  client->committed_us = 0;
+}
+
+/**
+ * phoc_input_latency_output_presented:
+ * @self: The input latency tracker
+ * @output: The output that presented a frame
+ * @presented_us: The presentation time in µs of the monotonic clock
+ *
+ * Records the latency of all input reflected in the presented frame.
+ */
+void
+phoc_input_latency_output_presented (PhocInputLatency *self,
+                                     PhocOutput       *output,
+                                     gint64            presented_us)
+{
+  PhocFrameStats *output_stats;
+  GArray *pendings;
+
+  g_assert (PHOC_IS_INPUT_LATENCY (self));
+  g_assert (PHOC_IS_OUTPUT (output));
+
+  pendings = phoc_output_get_input_latency_pending (output);
+  if (!pendings->len)
+    return;
+
+  output_stats = phoc_output_get_frame_stats (output);
+  for (guint i = 0; i < pendings->len; i++) {
+    PhocInputLatencyPending *pending = &g_array_index (pendings, PhocInputLatencyPending, i);
+    gint64 latency_us = presented_us - pending->input_us;
+
+    phoc_frame_stats_record (output_stats, PHOC_FRAME_STATS_METRIC_INPUT_LATENCY, latency_us);
+    phoc_frame_stats_record (pending->client_stats, PHOC_FRAME_STATS_METRIC_INPUT_LATENCY,
+                             latency_us);
+  }
+  g_array_set_size (pendings, 0);
+}
+
+/**
+ * phoc_input_latency_clients_to_variant:
+ * @self: The input latency tracker
+ *
+ * Serializes the input latency of each client process as `a{sa{sv}}`
+ * keyed by process name. The values are as described in
+ * [method@FrameStats.metric_to_variant].
+ *
+ * Returns: (transfer floating): The latencies
+ */
+GVariant *
+phoc_input_latency_clients_to_variant (PhocInputLatency *self)
+{
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  PhocFrameStats *stats;
+  const char *name;
+
+  g_assert (PHOC_IS_INPUT_LATENCY (self));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+
+  g_hash_table_iter_init (&iter, self->stats);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&name, (gpointer *)&stats)) {
+    g_variant_builder_add (&builder, "{s@a{sv}}", name,
+                           phoc_frame_stats_metric_to_variant (stats,
+                                                               PHOC_FRAME_STATS_METRIC_INPUT_LATENCY));
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * phoc_input_latency_reset:
+ * @self: The input latency tracker
+ *
+ * Drops the recorded per client latencies.
+ */
+void
+phoc_input_latency_reset (PhocInputLatency *self)
+{
+  GHashTableIter iter;
+  PhocFrameStats *stats;
+
+  g_assert (PHOC_IS_INPUT_LATENCY (self));
+
+  /* Pending samples refer to the stats so only clear them */
+  g_hash_table_iter_init (&iter, self->stats);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&stats))
+    phoc_frame_stats_reset (stats);
+}
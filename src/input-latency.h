@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "frame-stats.h"
+#include "output.h"
+
+#include <glib-object.h>
+#include <wlr/types/wlr_compositor.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PhocInputLatencyPending:
+ * @input_us: When the input happened
+ * @client_stats: The stats of the client that responded to the input
+ *
+ * Input reflected in a frame that wasn't presented yet.
+ */
+typedef struct _PhocInputLatencyPending {
+  gint64          input_us;
+  PhocFrameStats *client_stats;
+} PhocInputLatencyPending;
+
+#define PHOC_TYPE_INPUT_LATENCY (phoc_input_latency_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocInputLatency, phoc_input_latency, PHOC, INPUT_LATENCY, GObject)
+
+PhocInputLatency *phoc_input_latency_new              (struct wlr_compositor *compositor);
+void              phoc_input_latency_input_sent       (PhocInputLatency      *self,
+                                                       struct wlr_surface    *surface,
+                                                       guint32                time_msec);
+void              phoc_input_latency_surface_rendered (PhocInputLatency      *self,
+                                                       struct wlr_surface    *surface,
+                                                       PhocOutput            *output);
+void              phoc_input_latency_output_presented (PhocInputLatency      *self,
+                                                       PhocOutput            *output,
+                                                       gint64                 presented_us);
+GVariant         *phoc_input_latency_clients_to_variant (PhocInputLatency    *self);
+void              phoc_input_latency_reset            (PhocInputLatency      *self);
+
+G_END_DECLS
@@ -24,6 +24,8 @@ typedef struct _PhocTextInput {
   struct wlr_surface *pending_focused_surface;
 
   struct wl_list link;
+  /* Coalesces text input commits into a single done to the input method */
+  guint im_done_id;
 
   struct wl_listener pending_focused_surface_destroy;
   struct wl_listener enable;
@@ -42,7 +44,7 @@ elevate_osk (struct wlr_surface *surface)
     return;
 
   layer = wlr_layer_surface_v1_try_from_wlr_surface (surface);
-  if (!layer)
+  if (!layer || !layer->output)
     return;
 
   phoc_layer_shell_update_osk (PHOC_OUTPUT (layer->output->data), TRUE);
@@ -167,6 +169,7 @@ handle_im_destroy (struct wl_listener *listener, void *data)
 
   g_assert (context == relay->input_method);
   relay->input_method = NULL;
+  phoc_desktop_invalidate_client_priorities (phoc_server_get_desktop (phoc_server_get_default ()));
   PhocTextInput *text_input = relay_get_focused_text_input (relay);
   if (text_input) {
     /* keyboard focus is still there, so keep the surface at hand in case
@@ -189,9 +192,13 @@ text_input_is_focused (struct wlr_text_input_v3 *text_input)
 
 
 static void
-relay_send_im_done (PhocInputMethodRelay *relay, struct wlr_text_input_v3 *input)
+relay_send_im_done (PhocInputMethodRelay *relay, PhocTextInput *text_input)
 {
   struct wlr_input_method_v2 *input_method = relay->input_method;
+  struct wlr_text_input_v3 *input = text_input->input;
+
+  /* Sending the current state supersedes any queued commit */
+  g_clear_handle_id (&text_input->im_done_id, g_source_remove);
 
   if (!input_method) {
     g_debug ("Sending IM_DONE but im is gone");
@@ -237,12 +244,28 @@ handle_text_input_enable (struct wl_listener *listener, void *data)
     return;
 
   wlr_input_method_v2_send_activate (relay->input_method);
-  relay_send_im_done (relay, text_input->input);
+  relay_send_im_done (relay, text_input);
 
   elevate_osk (text_input->input->focused_surface);
 }
 
 
+static gboolean
+on_im_done (gpointer data)
+{
+  PhocTextInput *text_input = data;
+
+  text_input->im_done_id = 0;
+
+  if (!text_input->input->current_enabled || text_input->relay->input_method == NULL)
+    return G_SOURCE_REMOVE;
+
+  relay_send_im_done (text_input->relay, text_input);
+
+  return G_SOURCE_REMOVE;
+}
+
+
 static void
 handle_text_input_commit (struct wl_listener *listener, void *data)
 {
@@ -258,7 +281,14 @@ handle_text_input_commit (struct wl_listener *listener, void *data)
     g_debug ("Text input committed, but input method is gone");
     return;
   }
-  relay_send_im_done (relay, text_input->input);
+
+  /* Bursts of commits (e.g. while typing fast) only need the latest
+   * state to reach the input method */
+  if (text_input->im_done_id)
+    return;
+
+  text_input->im_done_id = g_idle_add (on_im_done, text_input);
+  g_source_set_name_by_id (text_input->im_done_id, "[phoc] text input im done");
 }
 
 
@@ -275,7 +305,7 @@ relay_disable_text_input (PhocInputMethodRelay *relay, PhocTextInput *text_input
     return;
 
   wlr_input_method_v2_send_deactivate (relay->input_method);
-  relay_send_im_done (relay, text_input->input);
+  relay_send_im_done (relay, text_input);
 }
 
 
@@ -329,6 +359,7 @@ handle_text_input_destroy (struct wl_listener *listener, void *data)
   if (text_input->input->current_enabled)
     relay_disable_text_input (relay, text_input);
 
+  g_clear_handle_id (&text_input->im_done_id, g_source_remove);
   text_input_clear_pending_focused_surface (text_input);
   wl_list_remove (&text_input->commit.link);
   wl_list_remove (&text_input->destroy.link);
@@ -414,6 +445,9 @@ relay_handle_input_method (struct wl_listener *listener, void *data)
   PhocInputMethodRelay *relay = wl_container_of (listener, relay, input_method_new);
   struct wlr_input_method_v2 *input_method = data;
 
+  /* Even rejected input methods get served like the shell */
+  phoc_desktop_invalidate_client_priorities (phoc_server_get_desktop (phoc_server_get_default ()));
+
   if (relay->seat->seat != input_method->seat) {
     g_warning ("Attempted to input method for wrong seat");
     return;
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-input-trace"
+
+#include "phoc-config.h"
+
+#include "input-trace.h"
+
+#include <gio/gio.h>
+#include <string.h>
+
+#define PHOC_INPUT_TRACE_MAGIC   "PHIT"
+#define PHOC_INPUT_TRACE_VERSION 1
+
+G_STATIC_ASSERT (sizeof (PhocInputTraceEvent) == 20);
+
+/**
+ * PhocInputTrace:
+ *
+ * A compact trace of input events with their timestamps so input
+ * handling can be replayed, e.g. for benchmarking.
+ *
+ * On disk the trace consists of a header with the `PHIT` magic and a
+ * 32 bit format version followed by the [struct@InputTraceEvent]s in
+ * host byte order.
+ */
+struct _PhocInputTrace {
+  GArray *events;
+};
+
+typedef struct {
+  char    magic[4];
+  guint32 version;
+} PhocInputTraceHeader;
+
+
+PhocInputTrace *
+phoc_input_trace_new (void)
+{
+  PhocInputTrace *self = g_new0 (PhocInputTrace, 1);
+
+  self->events = g_array_new (FALSE, FALSE, sizeof (PhocInputTraceEvent));
+
+  return self;
+}
+
+/**
+ * phoc_input_trace_new_from_file:
+ * @path: The file to load the trace from
+ * @err: Return location for an error
+ *
+ * Loads a trace saved with [method@InputTrace.save].
+ *
+ * Returns:(transfer full)(nullable): The trace or %NULL on error
+ */
+PhocInputTrace *
+phoc_input_trace_new_from_file (const char *path, GError **err)
+{
+  g_autoptr (PhocInputTrace) self = NULL;
+  g_autofree char *contents = NULL;
+  PhocInputTraceHeader header;
+  gsize len, n_events;
+
+  if (!g_file_get_contents (path, &contents, &len, err))
+    return NULL;
+
+  if (len < sizeof (header)) {
+    g_set_error (err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s: Trace too short", path);
+    return NULL;
+  }
+
+  memcpy (&header, contents, sizeof (header));
+  if (memcmp (header.magic, PHOC_INPUT_TRACE_MAGIC, sizeof (header.magic)) != 0 ||
+      header.version != PHOC_INPUT_TRACE_VERSION) {
+    g_set_error (err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s: Not an input trace", path);
+    return NULL;
+  }
+
+  len -= sizeof (header);
+  if (len % sizeof (PhocInputTraceEvent)) {
+    g_set_error (err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s: Truncated trace", path);
+    return NULL;
+  }
+
+  self = phoc_input_trace_new ();
+  n_events = len / sizeof (PhocInputTraceEvent);
+  g_array_append_vals (self->events, contents + sizeof (header), n_events);
+
+  return g_steal_pointer (&self);
+}
+
+
+void
+phoc_input_trace_free (PhocInputTrace *self)
+{
+  g_array_unref (self->events);
+  g_free (self);
+}
+
+/**
+ * phoc_input_trace_add:
+ * @self: The trace
+ * @type: The event type
+ * @time_msec: The event's timestamp
+ * @code: The button or touch id
+ * @state: The button state
+ * @x: The x coordinate or delta
+ * @y: The y coordinate or delta
+ *
+ * Appends an event to the trace. See [enum@InputTraceEventType] for
+ * the meaning of the fields.
+ */
+void
+phoc_input_trace_add (PhocInputTrace         *self,
+                      PhocInputTraceEventType type,
+                      guint32                 time_msec,
+                      guint32                 code,
+                      guint16                 state,
+                      double                  x,
+                      double                  y)
+{
+  PhocInputTraceEvent event = {
+    .time_msec = time_msec,
+    .type = type,
+    .state = state,
+    .code = code,
+    .x = x,
+    .y = y,
+  };
+
+  g_assert (self);
+
+  g_array_append_val (self->events, event);
+}
+
+/**
+ * phoc_input_trace_get_events:
+ * @self: The trace
+ * @n_events:(out): The number of events
+ *
+ * Gets the recorded events in the order they were added.
+ *
+ * Returns:(transfer none)(array length=n_events): The events
+ */
+const PhocInputTraceEvent *
+phoc_input_trace_get_events (PhocInputTrace *self, guint *n_events)
+{
+  g_assert (self);
+  g_assert (n_events);
+
+  *n_events = self->events->len;
+  return (PhocInputTraceEvent *)self->events->data;
+}
+
+/**
+ * phoc_input_trace_save:
+ * @self: The trace
+ * @path: The file to save the trace to
+ * @err: Return location for an error
+ *
+ * Saves the trace to @path.
+ *
+ * Returns: %TRUE on success, otherwise %FALSE
+ */
+gboolean
+phoc_input_trace_save (PhocInputTrace *self, const char *path, GError **err)
+{
+  PhocInputTraceHeader header = { .version = PHOC_INPUT_TRACE_VERSION };
+  g_autofree char *contents = NULL;
+  gsize events_len;
+
+  g_assert (self);
+
+  events_len = self->events->len * sizeof (PhocInputTraceEvent);
+  memcpy (header.magic, PHOC_INPUT_TRACE_MAGIC, sizeof (header.magic));
+
+  contents = g_malloc (sizeof (header) + events_len);
+  memcpy (contents, &header, sizeof (header));
+  if (events_len)
+    memcpy (contents + sizeof (header), self->events->data, events_len);
+
+  return g_file_set_contents (path, contents, sizeof (header) + events_len, err);
+}
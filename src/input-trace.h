@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PhocInputTraceEventType:
+ * @PHOC_INPUT_TRACE_EVENT_POINTER_MOTION: Relative pointer motion, `x` and `y` hold the delta
+ * @PHOC_INPUT_TRACE_EVENT_POINTER_MOTION_ABSOLUTE: Absolute pointer motion in `[0, 1]`
+ * @PHOC_INPUT_TRACE_EVENT_POINTER_BUTTON: Pointer button, `code` is the button, `state` its state
+ * @PHOC_INPUT_TRACE_EVENT_TOUCH_DOWN: Touch down in `[0, 1]`, `code` is the touch id
+ * @PHOC_INPUT_TRACE_EVENT_TOUCH_MOTION: Touch motion in `[0, 1]`, `code` is the touch id
+ * @PHOC_INPUT_TRACE_EVENT_TOUCH_UP: Touch up, `code` is the touch id
+ *
+ * The types of recorded input events.
+ */
+typedef enum _PhocInputTraceEventType {
+  PHOC_INPUT_TRACE_EVENT_POINTER_MOTION = 1,
+  PHOC_INPUT_TRACE_EVENT_POINTER_MOTION_ABSOLUTE,
+  PHOC_INPUT_TRACE_EVENT_POINTER_BUTTON,
+  PHOC_INPUT_TRACE_EVENT_TOUCH_DOWN,
+  PHOC_INPUT_TRACE_EVENT_TOUCH_MOTION,
+  PHOC_INPUT_TRACE_EVENT_TOUCH_UP,
+} PhocInputTraceEventType;
+
+/**
+ * PhocInputTraceEvent:
+ * @time_msec: The event's timestamp
+ * @type: The [enum@InputTraceEventType]
+ * @state: The button state
+ * @code: The button or touch id
+ * @x: The x coordinate or delta
+ * @y: The y coordinate or delta
+ *
+ * A recorded input event. This is also the on disk format.
+ */
+typedef struct _PhocInputTraceEvent {
+  guint32 time_msec;
+  guint16 type;
+  guint16 state;
+  guint32 code;
+  float   x, y;
+} PhocInputTraceEvent;
+
+typedef struct _PhocInputTrace PhocInputTrace;
+
+PhocInputTrace            *phoc_input_trace_new           (void);
+PhocInputTrace            *phoc_input_trace_new_from_file (const char     *path,
+                                                           GError        **err);
+void                       phoc_input_trace_free          (PhocInputTrace *self);
+void                       phoc_input_trace_add           (PhocInputTrace *self,
+                                                           PhocInputTraceEventType type,
+                                                           guint32         time_msec,
+                                                           guint32         code,
+                                                           guint16         state,
+                                                           double          x,
+                                                           double          y);
+const PhocInputTraceEvent *phoc_input_trace_get_events    (PhocInputTrace *self,
+                                                           guint          *n_events);
+gboolean                   phoc_input_trace_save          (PhocInputTrace *self,
+                                                           const char     *path,
+                                                           GError        **err);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocInputTrace, phoc_input_trace_free)
+
+G_END_DECLS
@@ -6,26 +6,75 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <time.h>
+#include <glib-unix.h>
+#include <libinput.h>
 #include <wayland-server-core.h>
+#include <wlr/backend/libinput.h>
 #include "cursor.h"
 #include "input.h"
 #include "seat.h"
 #include "server.h"
 
+/* Above output repaints so input gets handled before the next frame is rendered */
+#define PHOC_INPUT_SOURCE_PRIORITY (G_PRIORITY_HIGH - 10)
+
 /**
  * PhocInput:
  *
  * PhocInput handles new input devices and seats
+ *
+ * With `prioritize-input` set, libinput's fd is also watched by a
+ * main loop source of its own. When it has events they're dispatched
+ * ahead of output repaints and idle work that is pending as well.
+ * Events carry the kernel's timestamps so their timing is kept no
+ * matter how late they get read.
  */
 struct _PhocInput {
   GObject              parent;
 
   struct wl_listener   new_input;
   GSList              *seats; // PhocSeat
+  PhocKeymapCache     *keymap_cache;
+  guint                libinput_source_id;
 };
 
 G_DEFINE_TYPE (PhocInput, phoc_input, G_TYPE_OBJECT);
 
+
+static gboolean
+on_libinput_readable (gint fd, GIOCondition condition, gpointer user_data)
+{
+  /* libinput's fd is part of the Wayland event loop so let that read it */
+  phoc_server_dispatch (phoc_server_get_default ());
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+watch_libinput (PhocInput *self, struct wlr_input_device *device)
+{
+  PhocConfig *config = phoc_server_get_config (phoc_server_get_default ());
+  struct libinput *libinput;
+
+  if (!config->prioritize_input || self->libinput_source_id)
+    return;
+
+  if (!wlr_input_device_is_libinput (device))
+    return;
+
+  /* All devices share the backend's libinput context */
+  libinput = libinput_device_get_context (wlr_libinput_get_device_handle (device));
+
+  self->libinput_source_id = g_unix_fd_add_full (PHOC_INPUT_SOURCE_PRIORITY,
+                                                  libinput_get_fd (libinput),
+                                                  G_IO_IN,
+                                                  on_libinput_readable,
+                                                  NULL,
+                                                  NULL);
+  g_source_set_name_by_id (self->libinput_source_id, "[phoc] libinput source");
+}
+
 const char *
 phoc_input_get_device_type (enum wlr_input_device_type type)
 {
@@ -99,6 +148,7 @@ handle_new_input (struct wl_listener *listener, void *data)
            phoc_input_get_device_type (device->type), seat_name);
 
   phoc_seat_add_device (seat, device);
+  watch_libinput (self, device);
 }
 
 
@@ -127,7 +177,9 @@ phoc_input_finalize (GObject *object)
 {
   PhocInput *self = PHOC_INPUT (object);
 
+  g_clear_handle_id (&self->libinput_source_id, g_source_remove);
   g_clear_slist (&self->seats, g_object_unref);
+  g_clear_pointer (&self->keymap_cache, phoc_keymap_cache_free);
 
   G_OBJECT_CLASS (phoc_input_parent_class)->finalize (object);
 }
@@ -145,6 +197,7 @@ phoc_input_class_init (PhocInputClass *klass)
 static void
 phoc_input_init (PhocInput *self)
 {
+  self->keymap_cache = phoc_keymap_cache_new ();
 }
 
 PhocInput *
@@ -236,3 +289,17 @@ phoc_input_get_last_active_seat (PhocInput *self)
   }
   return seat;
 }
+
+/**
+ * phoc_input_get_keymap_cache:
+ * @self: The input
+ *
+ * Returns:(transfer none): The keymaps shared by all keyboards
+ */
+PhocKeymapCache *
+phoc_input_get_keymap_cache (PhocInput *self)
+{
+  g_assert (PHOC_IS_INPUT (self));
+
+  return self->keymap_cache;
+}
@@ -4,6 +4,7 @@
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_seat.h>
+#include "keymap-cache.h"
 #include "settings.h"
 #include "seat.h"
 #include "view.h"
@@ -22,5 +23,6 @@ PhocSeat          *phoc_input_get_seat (PhocInput *self, char *name);
 void               phoc_input_update_cursor_focus (PhocInput *self);
 GSList *           phoc_input_get_seats          (PhocInput *self);
 PhocSeat          *phoc_input_get_last_active_seat (PhocInput *self);
+PhocKeymapCache   *phoc_input_get_keymap_cache   (PhocInput *self);
 
 G_END_DECLS
@@ -48,6 +48,9 @@ typedef struct _PhocKeybindings
   GObject parent;
 
   GSList *bindings;
+  /* Maps the key of a combo to its PhocKeybinding */
+  GHashTable *combos;
+  guint update_combos_id;
   GSettings *settings;
   GSettings *mutter_settings;
 } PhocKeybindings;
@@ -456,30 +459,66 @@ phoc_keybinding_free (PhocKeybinding *keybinding)
 
 
 static gboolean
-key_combo_eq (const PhocKeyCombo *sym1, const PhocKeyCombo *sym2)
+keybinding_by_name (const PhocKeybinding *keybinding, const gchar *name)
 {
-  return (sym1->modifiers == sym2->modifiers && sym1->keysym == sym2->keysym);
+  return g_strcmp0 (keybinding->name, name);
 }
 
 
-static gboolean
-keybinding_by_name (const PhocKeybinding *keybinding, const gchar *name)
+/*
+ * Rebuild the index of key combos. The first binding in the list using
+ * a combo wins.
+ */
+static void
+update_combos (PhocKeybindings *self)
 {
-  return g_strcmp0 (keybinding->name, name);
+  g_hash_table_remove_all (self->combos);
+
+  for (GSList *l = self->bindings; l; l = l->next) {
+    PhocKeybinding *keybinding = l->data;
+
+    for (GSList *c = keybinding->combos; c; c = c->next) {
+      gint64 key = phoc_key_combo_to_key (c->data);
+
+      if (g_hash_table_contains (self->combos, &key))
+        continue;
+
+      g_hash_table_insert (self->combos, g_memdup2 (&key, sizeof (key)), keybinding);
+    }
+  }
 }
 
 
 static gboolean
-keybinding_by_key_combo (const PhocKeybinding *keybinding, const PhocKeyCombo *combo)
+on_update_combos (gpointer data)
+{
+  PhocKeybindings *self = PHOC_KEYBINDINGS (data);
+
+  self->update_combos_id = 0;
+  update_combos (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+load_accelerators (PhocKeybinding *keybinding, GSettings *settings)
 {
-  GSList *elem = keybinding->combos;
+  g_auto(GStrv) accelerators = NULL;
+
+  accelerators = g_settings_get_strv (settings, keybinding->name);
+
+  g_slist_free_full (keybinding->combos, g_free);
+  keybinding->combos = NULL;
+
+  for (int i = 0; accelerators && accelerators[i]; i++) {
+    PhocKeyCombo *combo;
 
-  while (elem) {
-    if (key_combo_eq (elem->data, combo))
-      return FALSE;
-    elem = elem->next;
+    g_debug ("New keybinding %s for %s", keybinding->name, accelerators[i]);
+    combo = phoc_parse_accelerator (accelerators[i]);
+    if (combo)
+      keybinding->combos = g_slist_append (keybinding->combos, combo);
   }
-  return TRUE;
 }
 
 
@@ -488,16 +527,11 @@ on_keybinding_setting_changed (PhocKeybindings *self,
                                const gchar     *key,
                                GSettings       *settings)
 {
-  g_auto(GStrv) accelerators = NULL;
-  PhocKeybinding *keybinding;
   GSList *elem;
-  int i;
 
   g_return_if_fail (PHOC_IS_KEYBINDINGS (self));
   g_return_if_fail (G_IS_SETTINGS (settings));
 
-  accelerators = g_settings_get_strv (settings, key);
-
   elem = g_slist_find_custom (self->bindings,
                               key,
                               (GCompareFunc)keybinding_by_name);
@@ -506,19 +540,14 @@ on_keybinding_setting_changed (PhocKeybindings *self,
     return;
   }
 
-  keybinding = elem->data;
-
-  g_slist_free_full (keybinding->combos, g_free);
-  keybinding->combos = NULL;
+  load_accelerators (elem->data, settings);
 
-  for (i = 0; accelerators && accelerators[i]; i++) {
-    PhocKeyCombo *combo;
+  /* Rebuild the index only once for a burst of changes */
+  if (self->update_combos_id)
+    return;
 
-    g_debug ("New keybinding %s for %s", key, accelerators[i]);
-    combo = phoc_parse_accelerator (accelerators[i]);
-    if (combo)
-      keybinding->combos = g_slist_append (keybinding->combos, combo);
-  }
+  self->update_combos_id = g_idle_add (on_update_combos, self);
+  g_source_set_name_by_id (self->update_combos_id, "[phoc] update keybindings");
 }
 
 
@@ -548,8 +577,8 @@ phoc_add_keybinding (PhocKeybindings    *self,
                             G_CALLBACK (on_keybinding_setting_changed), self);
 
   self->bindings = g_slist_append (self->bindings, binding);
-  /* Fill in initial values */
-  on_keybinding_setting_changed (self, name, settings);
+  /* Fill in initial values, the index is built once all are added */
+  load_accelerators (binding, settings);
 
   return TRUE;
 }
@@ -559,6 +588,8 @@ phoc_keybindings_dispose (GObject *object)
 {
   PhocKeybindings *self = PHOC_KEYBINDINGS (object);
 
+  g_clear_handle_id (&self->update_combos_id, g_source_remove);
+  g_clear_pointer (&self->combos, g_hash_table_destroy);
   g_slist_free_full (self->bindings, (GDestroyNotify)phoc_keybinding_free);
   self->bindings = NULL;
 
@@ -637,6 +668,8 @@ phoc_keybindings_constructed (GObject *object)
   phoc_add_keybinding (self, self->mutter_settings,
                        "toggle-tiled-right", handle_tile,
                        g_variant_new_int32 (PHOC_VIEW_TILE_RIGHT));
+
+  update_combos (self);
 }
 
 
@@ -655,6 +688,7 @@ static void
 phoc_keybindings_init (PhocKeybindings *self)
 {
   self->bindings = NULL;
+  self->combos = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
 }
 
 
@@ -684,24 +718,20 @@ phoc_keybindings_handle_pressed (PhocKeybindings *self,
                                  PhocSeat        *seat)
 {
   PhocKeybinding *keybinding;
-  GSList *elem;
   PhocKeyCombo combo;
+  gint64 key;
 
   if (length != 1)
     return FALSE;
 
   combo.keysym = pressed_keysyms[0];
   combo.modifiers = modifiers;
+  key = phoc_key_combo_to_key (&combo);
 
-  elem = g_slist_find_custom (self->bindings,
-                              &combo,
-                              (GCompareFunc)keybinding_by_key_combo);
-  if (!elem)
+  keybinding = g_hash_table_lookup (self->combos, &key);
+  if (!keybinding)
     return FALSE;
 
-  g_return_val_if_fail (elem->data, FALSE);
-  keybinding = elem->data;
-
   (*keybinding->func) (seat, keybinding->param);
   return TRUE;
 }
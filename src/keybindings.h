@@ -30,6 +30,19 @@ typedef struct
   xkb_keysym_t keysym;
 } PhocKeyCombo;
 
+/**
+ * phoc_key_combo_to_key: (skip)
+ * @combo: The key combo
+ *
+ * Returns: A key uniquely identifying @combo suitable for use with
+ *   `g_int64_hash` based hash tables.
+ */
+static inline gint64
+phoc_key_combo_to_key (const PhocKeyCombo *combo)
+{
+  return ((gint64) combo->modifiers << 32) | combo->keysym;
+}
+
 typedef struct _PhocSeat PhocSeat;
 gboolean         phoc_keybindings_handle_pressed (PhocKeybindings *self,
                                                   guint32 modifiers,
@@ -69,7 +69,8 @@ struct _PhocKeyboard {
   GSettings         *input_settings;
   GSettings         *keyboard_settings;
   struct xkb_keymap *keymap;
-  GnomeXkbInfo      *xkbinfo;
+  /* Derived from keymap so key presses don't need to look it up */
+  xkb_mod_mask_t     super_mask;
 
   gboolean           wakeup_key_default;
   GHashTable        *wakeup_keys;
@@ -146,6 +147,24 @@ keysym_is_modifier (xkb_keysym_t keysym)
   }
 }
 
+/*
+ * Keys that step a value up or down. Holding them is meant to keep
+ * stepping while for other accelerators a repeat would e.g. toggle
+ * things over and over.
+ */
+static bool
+keysym_is_stepping (xkb_keysym_t keysym)
+{
+  switch (keysym) {
+  case XKB_KEY_XF86AudioRaiseVolume: case XKB_KEY_XF86AudioLowerVolume:
+  case XKB_KEY_XF86MonBrightnessUp: case XKB_KEY_XF86MonBrightnessDown:
+  case XKB_KEY_XF86KbdBrightnessUp: case XKB_KEY_XF86KbdBrightnessDown:
+    return true;
+  default:
+    return false;
+  }
+}
+
 static void
 pressed_keysyms_update (xkb_keysym_t              *pressed_keysyms,
                         const xkb_keysym_t        *keysyms,
@@ -213,9 +232,7 @@ keyboard_execute_super_key (PhocKeyboard              *self,
                             uint32_t                   time,
                             enum wl_keyboard_key_state state)
 {
-  uint32_t super_mod = 1 << xkb_map_mod_get_index (self->keymap, "Mod4");
-
-  if (modifiers > 0 && modifiers != super_mod) {
+  if (modifiers > 0 && modifiers != self->super_mask) {
     /* Check if other modifiers have been pressed e.g. <ctrl><super> */
     return false;
   }
@@ -289,20 +306,30 @@ keyboard_execute_binding (PhocKeyboard              *self,
  */
 static bool
 keyboard_execute_subscribed_binding (PhocKeyboard              *self,
-                                     xkb_keysym_t              *pressed_keysyms,
+                                     xkb_keycode_t              keycode,
                                      uint32_t                   modifiers,
                                      const xkb_keysym_t        *keysyms,
                                      size_t                     keysyms_len,
                                      uint32_t                   time,
                                      enum wl_keyboard_key_state state)
 {
+  PhocSeat *seat = phoc_input_device_get_seat (PHOC_INPUT_DEVICE (self));
   bool handled = false;
   bool pressed;
 
   pressed = !!(state == WL_KEYBOARD_KEY_STATE_PRESSED);
   for (size_t i = 0; i < keysyms_len; ++i) {
     PhocKeyCombo combo = { modifiers, keysyms[i] };
-    handled |= phoc_phosh_private_forward_keysym (&combo, time, pressed);
+
+    if (!phoc_phosh_private_forward_keysym (&combo, time, pressed))
+      continue;
+
+    handled = true;
+    /* Clients don't see the key so repeat it for them (e.g. held volume keys) */
+    if (pressed && keysym_is_stepping (keysyms[i]) &&
+        xkb_keymap_key_repeats (self->keymap, keycode)) {
+      phoc_seat_start_accelerator_repeat (seat, self, keycode, &combo);
+    }
   }
   return handled;
 }
@@ -395,6 +422,11 @@ phoc_keyboard_handle_key (PhocKeyboard *self, struct wlr_keyboard_key_event *eve
   const xkb_keysym_t *keysyms;
   size_t keysyms_len;
 
+  if (event->state == WL_KEYBOARD_KEY_STATE_RELEASED) {
+    phoc_seat_stop_accelerator_repeat (phoc_input_device_get_seat (PHOC_INPUT_DEVICE (self)),
+                                       self, keycode);
+  }
+
   /* Handle translated keysyms */
   keysyms_len = keyboard_keysyms_translated (self, keycode, &keysyms, &modifiers);
   pressed_keysyms_update (self->pressed_keysyms_translated, keysyms, keysyms_len, event->state);
@@ -420,7 +452,7 @@ phoc_keyboard_handle_key (PhocKeyboard *self, struct wlr_keyboard_key_event *eve
   /* Handle subscribed keysyms */
   if (!handled) {
     handled = keyboard_execute_subscribed_binding (self,
-                                                   self->pressed_keysyms_raw, modifiers,
+                                                   keycode, modifiers,
                                                    keysyms, keysyms_len, event->time_msec,
                                                    event->state);
   }
@@ -469,65 +501,44 @@ phoc_keyboard_handle_modifiers (PhocKeyboard *self)
 
 
 static void
-set_fallback_keymap (PhocKeyboard *self)
+apply_keymap (PhocKeyboard *self, struct wlr_keyboard *wlr_keyboard)
 {
-  struct xkb_context *context;
-  PhocInputDevice *input_device = PHOC_INPUT_DEVICE (self);
-  struct wlr_input_device *device = phoc_input_device_get_device (input_device);
-  struct wlr_keyboard *wlr_keyboard = wlr_keyboard_from_input_device (device);
+  xkb_mod_index_t super_idx = xkb_keymap_mod_get_index (self->keymap, XKB_MOD_NAME_LOGO);
 
-  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
-  if (context == NULL)
-    return;
+  self->super_mask = super_idx != XKB_MOD_INVALID ? 1 << super_idx : 0;
+  wlr_keyboard_set_keymap (wlr_keyboard, self->keymap);
+}
 
-  xkb_keymap_unref (self->keymap);
-  self->keymap = xkb_keymap_new_from_names (context, NULL,
-                                            XKB_KEYMAP_COMPILE_NO_FLAGS);
-  xkb_context_unref (context);
 
-  wlr_keyboard_set_keymap (wlr_keyboard, self->keymap);
+static PhocKeymapCache *
+get_keymap_cache (void)
+{
+  return phoc_input_get_keymap_cache (phoc_server_get_input (phoc_server_get_default ()));
 }
 
 
 static void
-set_xkb_keymap (PhocKeyboard *self, const gchar *layout, const gchar *variant, const gchar *options)
+set_keymap (PhocKeyboard *self, struct xkb_keymap *keymap)
 {
-  struct xkb_rule_names rules = { 0 };
-  struct xkb_context *context = NULL;
-  struct xkb_keymap *keymap = NULL;
   PhocInputDevice *input_device = PHOC_INPUT_DEVICE (self);
   struct wlr_input_device *device = phoc_input_device_get_device (input_device);
   struct wlr_keyboard *wlr_keyboard = wlr_keyboard_from_input_device (device);
 
   g_assert (wlr_keyboard);
 
-  rules.layout = layout;
-  rules.variant = variant;
-  rules.options = options;
+  if (keymap == NULL) {
+    if (self->keymap)
+      return;
 
-  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
-  if (context == NULL) {
-    g_warning ("Cannot create XKB context");
-    goto out;
+    keymap = phoc_keymap_cache_lookup (get_keymap_cache (), NULL, NULL, NULL);
+    if (keymap == NULL)
+      return;
   }
 
-  keymap = xkb_map_new_from_names (context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
-  if (keymap == NULL)
-    g_warning ("Cannot create XKB keymap");
-
- out:
-  if (context)
-    xkb_context_unref (context);
-
-  if (keymap) {
-    xkb_keymap_unref (self->keymap);
-    self->keymap = keymap;
-  } else if (self->keymap == NULL) {
-    set_fallback_keymap (self);
-    return;
-  }
+  xkb_keymap_unref (self->keymap);
+  self->keymap = keymap;
 
-  wlr_keyboard_set_keymap (wlr_keyboard, self->keymap);
+  apply_keymap (self, wlr_keyboard);
 }
 
 
@@ -542,8 +553,7 @@ on_input_setting_changed (PhocKeyboard *self,
   g_autofree gchar *id = NULL;
   g_autofree gchar *type = NULL;
   g_autofree gchar *xkb_options_string = NULL;
-  const gchar *layout = NULL;
-  const gchar *variant = NULL;
+  struct xkb_keymap *keymap;
   PhocInputDevice *input_device;
   struct wlr_input_device *device;
 
@@ -576,14 +586,14 @@ on_input_setting_changed (PhocKeyboard *self,
     g_debug ("Setting options %s", xkb_options_string);
   }
 
-  if (!gnome_xkb_info_get_layout_info (self->xkbinfo, id,
-                                       NULL, NULL, &layout, &variant)) {
-    g_debug ("Failed to get layout info for %s", id);
+  g_debug ("Switching to layout %s", id);
+  keymap = phoc_keymap_cache_lookup_source (get_keymap_cache (), id, xkb_options_string);
+  if (keymap == NULL)
     return;
-  }
-  g_debug ("Switching to layout %s %s", layout, variant);
 
-  set_xkb_keymap (self, layout, variant, xkb_options_string);
+  set_keymap (self, keymap);
+  /* Have the other sources ready for the next switch */
+  phoc_keymap_cache_prebuild (get_keymap_cache (), settings);
 }
 
 
@@ -656,7 +666,6 @@ phoc_keyboard_dispose (GObject *object)
 
   g_clear_object (&self->input_settings);
   g_clear_object (&self->keyboard_settings);
-  g_clear_object (&self->xkbinfo);
 
   G_OBJECT_CLASS (phoc_keyboard_parent_class)->dispose (object);
 }
@@ -788,8 +797,7 @@ phoc_keyboard_constructed (GObject *object)
   self->keyboard_settings = g_settings_new ("org.gnome.desktop.peripherals.keyboard");
   self->meta_key = WLR_MODIFIER_LOGO;
 
-  set_fallback_keymap (self);
-  self->xkbinfo = gnome_xkb_info_new ();
+  set_keymap (self, NULL);
 
   g_object_connect (self->input_settings,
     "swapped-signal::changed::sources", G_CALLBACK (on_input_setting_changed), self,
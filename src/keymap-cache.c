@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-keymap-cache"
+
+#include "phoc-config.h"
+
+#include "keymap-cache.h"
+
+/**
+ * PhocKeymapCache:
+ *
+ * Compiled xkb keymaps shared between all keyboards, keyed by the
+ * rule names they were compiled from. Compiling a keymap takes tens
+ * of milliseconds so without the cache every keyboard that gets
+ * attached and every layout switch would stall input and output.
+ *
+ * The keymaps of the configured input sources are compiled ahead of
+ * time, one per main loop iteration, so the first layout switch is
+ * fast too.
+ *
+ * At most `PHOC_KEYMAP_CACHE_MAX_SIZE` keymaps are kept, the least
+ * recently used ones get dropped first.
+ */
+struct _PhocKeymapCache {
+  struct xkb_context *context;
+  GHashTable         *keymaps;
+  /* The keys of keymaps, most recently used first */
+  GQueue              lru;
+  GnomeXkbInfo       *xkbinfo;
+
+  /* Input source ids still to compile ahead of time */
+  GStrv               prebuild_ids;
+  char               *prebuild_options;
+  guint               prebuild_index;
+  guint               prebuild_id;
+};
+
+
+static char *
+make_key (const char *layout, const char *variant, const char *options)
+{
+  return g_strdup_printf ("%s:%s:%s", layout ?: "", variant ?: "", options ?: "");
+}
+
+
+static GnomeXkbInfo *
+get_xkb_info (PhocKeymapCache *self)
+{
+  /* Parsing the xkb rules is slow too so only do it once */
+  if (self->xkbinfo == NULL)
+    self->xkbinfo = gnome_xkb_info_new ();
+
+  return self->xkbinfo;
+}
+
+
+static void
+clear_prebuild (PhocKeymapCache *self)
+{
+  g_clear_handle_id (&self->prebuild_id, g_source_remove);
+  g_clear_pointer (&self->prebuild_ids, g_strfreev);
+  g_clear_pointer (&self->prebuild_options, g_free);
+  self->prebuild_index = 0;
+}
+
+
+static gboolean
+on_prebuild_idle (gpointer data)
+{
+  PhocKeymapCache *self = data;
+  const char *id = self->prebuild_ids[self->prebuild_index++];
+  struct xkb_keymap *keymap;
+
+  keymap = phoc_keymap_cache_lookup_source (self, id, self->prebuild_options);
+  g_clear_pointer (&keymap, xkb_keymap_unref);
+
+  if (self->prebuild_ids[self->prebuild_index])
+    return G_SOURCE_CONTINUE;
+
+  self->prebuild_id = 0;
+  clear_prebuild (self);
+  return G_SOURCE_REMOVE;
+}
+
+
+PhocKeymapCache *
+phoc_keymap_cache_new (void)
+{
+  PhocKeymapCache *self = g_new0 (PhocKeymapCache, 1);
+
+  self->context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
+  if (self->context == NULL)
+    g_warning ("Cannot create XKB context");
+
+  self->keymaps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify) xkb_keymap_unref);
+  g_queue_init (&self->lru);
+
+  return self;
+}
+
+
+void
+phoc_keymap_cache_free (PhocKeymapCache *self)
+{
+  clear_prebuild (self);
+  g_queue_clear (&self->lru);
+  g_hash_table_destroy (self->keymaps);
+  g_clear_object (&self->xkbinfo);
+  g_clear_pointer (&self->context, xkb_context_unref);
+  g_free (self);
+}
+
+/**
+ * phoc_keymap_cache_lookup:
+ * @self: The keymap cache
+ * @layout:(nullable): The xkb layout
+ * @variant:(nullable): The xkb variant
+ * @options:(nullable): The xkb options, comma separated
+ *
+ * Look up a keymap compiling it on first use. Passing %NULL for all
+ * names gives the system's default keymap.
+ *
+ * Returns:(transfer full)(nullable): The keymap or %NULL if it can't
+ *   be compiled
+ */
+struct xkb_keymap *
+phoc_keymap_cache_lookup (PhocKeymapCache *self,
+                          const char      *layout,
+                          const char      *variant,
+                          const char      *options)
+{
+  g_autofree char *key = make_key (layout, variant, options);
+  struct xkb_rule_names rules = {
+    .layout = layout,
+    .variant = variant,
+    .options = options,
+  };
+  struct xkb_keymap *keymap;
+  const char *cached_key;
+
+  if (g_hash_table_lookup_extended (self->keymaps, key, (gpointer *)&cached_key, (gpointer *)&keymap)) {
+    g_queue_remove (&self->lru, cached_key);
+    g_queue_push_head (&self->lru, (gpointer)cached_key);
+    return xkb_keymap_ref (keymap);
+  }
+
+  if (self->context == NULL)
+    return NULL;
+
+  keymap = xkb_keymap_new_from_names (self->context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+  if (keymap == NULL) {
+    g_warning ("Cannot create XKB keymap for %s", key);
+    return NULL;
+  }
+
+  g_debug ("Compiled keymap %s", key);
+  g_queue_push_head (&self->lru, key);
+  g_hash_table_insert (self->keymaps, g_steal_pointer (&key), keymap);
+
+  while (self->lru.length > PHOC_KEYMAP_CACHE_MAX_SIZE) {
+    char *evicted = g_queue_pop_tail (&self->lru);
+
+    g_debug ("Dropping keymap %s", evicted);
+    g_hash_table_remove (self->keymaps, evicted);
+  }
+
+  return xkb_keymap_ref (keymap);
+}
+
+/**
+ * phoc_keymap_cache_lookup_source:
+ * @self: The keymap cache
+ * @id: The id of a xkb input source like `de+nodeadkeys`
+ * @options:(nullable): The xkb options, comma separated
+ *
+ * Like [method@KeymapCache.lookup] but for an entry of the
+ * `org.gnome.desktop.input-sources` `sources` setting.
+ *
+ * Returns:(transfer full)(nullable): The keymap or %NULL if @id is
+ *   unknown or can't be compiled
+ */
+struct xkb_keymap *
+phoc_keymap_cache_lookup_source (PhocKeymapCache *self, const char *id, const char *options)
+{
+  const char *layout = NULL, *variant = NULL;
+
+  if (!gnome_xkb_info_get_layout_info (get_xkb_info (self), id, NULL, NULL, &layout, &variant)) {
+    g_debug ("Failed to get layout info for %s", id);
+    return NULL;
+  }
+
+  return phoc_keymap_cache_lookup (self, layout, variant, options);
+}
+
+/**
+ * phoc_keymap_cache_get_size:
+ * @self: The keymap cache
+ *
+ * Returns: The number of cached keymaps
+ */
+guint
+phoc_keymap_cache_get_size (PhocKeymapCache *self)
+{
+  return g_hash_table_size (self->keymaps);
+}
+
+/**
+ * phoc_keymap_cache_prebuild:
+ * @self: The keymap cache
+ * @input_settings: The `org.gnome.desktop.input-sources` settings
+ *
+ * Compile the keymaps of the configured xkb input sources ahead of
+ * time so switching between them doesn't need to wait for the
+ * compiler. This happens on the main thread from a low priority idle
+ * callback, one keymap per main loop iteration, so each one still
+ * blocks the main loop while it compiles. Only the first
+ * `PHOC_KEYMAP_CACHE_MAX_SIZE` sources are compiled. Replaces any
+ * prebuild still in progress.
+ */
+void
+phoc_keymap_cache_prebuild (PhocKeymapCache *self, GSettings *input_settings)
+{
+  g_autoptr (GVariant) sources = NULL;
+  g_auto (GStrv) xkb_options = NULL;
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+  GVariantIter iter;
+  const char *type, *id;
+  guint n_ids = 0;
+
+  g_return_if_fail (G_IS_SETTINGS (input_settings));
+
+  clear_prebuild (self);
+
+  sources = g_settings_get_value (input_settings, "sources");
+  g_variant_iter_init (&iter, sources);
+  while (g_variant_iter_next (&iter, "(&s&s)", &type, &id)) {
+    if (g_strcmp0 (type, "xkb") == 0 && n_ids < PHOC_KEYMAP_CACHE_MAX_SIZE) {
+      g_strv_builder_add (builder, id);
+      n_ids++;
+    }
+  }
+
+  self->prebuild_ids = g_strv_builder_end (builder);
+  if (self->prebuild_ids[0] == NULL) {
+    clear_prebuild (self);
+    return;
+  }
+
+  xkb_options = g_settings_get_strv (input_settings, "xkb-options");
+  if (xkb_options)
+    self->prebuild_options = g_strjoinv (",", xkb_options);
+
+  self->prebuild_id = g_idle_add_full (G_PRIORITY_LOW, on_prebuild_idle, self, NULL);
+  g_source_set_name_by_id (self->prebuild_id, "[phoc] keymap prebuild");
+}
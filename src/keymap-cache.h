@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <libgnome-desktop/gnome-xkb-info.h>
+#include <xkbcommon/xkbcommon.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_KEYMAP_CACHE_MAX_SIZE 8
+
+typedef struct _PhocKeymapCache PhocKeymapCache;
+
+PhocKeymapCache   *phoc_keymap_cache_new          (void);
+void               phoc_keymap_cache_free         (PhocKeymapCache *self);
+struct xkb_keymap *phoc_keymap_cache_lookup       (PhocKeymapCache *self,
+                                                   const char      *layout,
+                                                   const char      *variant,
+                                                   const char      *options);
+struct xkb_keymap *phoc_keymap_cache_lookup_source (PhocKeymapCache *self,
+                                                    const char      *id,
+                                                    const char      *options);
+guint              phoc_keymap_cache_get_size     (PhocKeymapCache *self);
+void               phoc_keymap_cache_prebuild     (PhocKeymapCache *self,
+                                                   GSettings       *input_settings);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocKeymapCache, phoc_keymap_cache_free)
+
+G_END_DECLS
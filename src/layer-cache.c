@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-layer-cache"
+
+#include "phoc-config.h"
+
+#include "layer-cache.h"
+#include "render-private.h"
+
+#include <drm_fourcc.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/types/wlr_buffer.h>
+
+/**
+ * PhocLayerCache:
+ *
+ * The background and bottom layers of an output composited into a
+ * single texture. With a wallpaper and a translucent app on top a
+ * damaged frame then samples one texture instead of every layer
+ * surface below the app.
+ *
+ * Whether the texture is still up to date is determined by comparing
+ * render summaries (see [method@Renderer.summarize_output]) so
+ * commits, arranging the layers and alpha changes invalidate it
+ * without tracking individual surfaces. The texture is only rebuilt
+ * from an idle callback once two consecutive frames saw the same
+ * summary so animating layers don't get rendered twice per frame.
+ */
+struct _PhocLayerCache {
+  struct wlr_renderer      *wlr_renderer;
+  struct wlr_allocator     *wlr_allocator;
+  PhocLayerCacheUpdateFunc  update_func;
+  gpointer                  update_data;
+
+  struct wlr_buffer        *buffer;
+  struct wlr_texture       *texture;
+  pixman_region32_t         opaque;
+  /* What the texture shows */
+  GArray                   *summary;
+  gboolean                  valid;
+
+  /* What the last frame wanted to show and at what size */
+  GArray                   *last_summary;
+  int                       width, height;
+  guint                     idle_id;
+};
+
+
+static struct wlr_buffer *
+create_buffer (PhocLayerCache *self, int width, int height)
+{
+  struct wlr_drm_format_set fmt_set = {};
+  const struct wlr_drm_format *fmt;
+  struct wlr_buffer *buffer;
+
+  wlr_drm_format_set_add (&fmt_set, DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_INVALID);
+  fmt = wlr_drm_format_set_get (&fmt_set, DRM_FORMAT_ARGB8888);
+
+  buffer = wlr_allocator_create_buffer (self->wlr_allocator, width, height, fmt);
+  wlr_drm_format_set_finish (&fmt_set);
+
+  return buffer;
+}
+
+
+static gboolean
+on_idle_update (gpointer data)
+{
+  PhocLayerCache *self = data;
+
+  self->idle_id = 0;
+  self->update_func (self, self->update_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+summary_copy (GArray *dest, GArray *src)
+{
+  g_array_set_size (dest, 0);
+  g_array_append_vals (dest, src->data, src->len);
+}
+
+/**
+ * phoc_layer_cache_new:
+ * @wlr_renderer: The renderer to composite the layers with
+ * @wlr_allocator: The allocator for the cache's buffer
+ * @update_func: The function rendering the layers
+ * @data: The data passed to @update_func
+ *
+ * Returns:(transfer full): A new layer cache
+ */
+PhocLayerCache *
+phoc_layer_cache_new (struct wlr_renderer      *wlr_renderer,
+                      struct wlr_allocator     *wlr_allocator,
+                      PhocLayerCacheUpdateFunc  update_func,
+                      gpointer                  data)
+{
+  PhocLayerCache *self = g_new0 (PhocLayerCache, 1);
+
+  self->wlr_renderer = wlr_renderer;
+  self->wlr_allocator = wlr_allocator;
+  self->update_func = update_func;
+  self->update_data = data;
+
+  pixman_region32_init (&self->opaque);
+  self->summary = g_array_new (FALSE, FALSE, sizeof (PhocRenderSummaryItem));
+  self->last_summary = g_array_new (FALSE, FALSE, sizeof (PhocRenderSummaryItem));
+
+  return self;
+}
+
+
+void
+phoc_layer_cache_free (PhocLayerCache *self)
+{
+  g_clear_handle_id (&self->idle_id, g_source_remove);
+  g_clear_pointer (&self->texture, wlr_texture_destroy);
+  g_clear_pointer (&self->buffer, wlr_buffer_drop);
+  pixman_region32_fini (&self->opaque);
+  g_array_unref (self->summary);
+  g_array_unref (self->last_summary);
+  g_free (self);
+}
+
+/**
+ * phoc_layer_cache_is_valid:
+ * @self: The layer cache
+ * @summary: (element-type PhocRenderSummaryItem): The summary of the layers to show
+ * @width: The width of the output's buffer
+ * @height: The height of the output's buffer
+ *
+ * Checks whether the cached texture shows @summary. This must not
+ * render itself as it's used while building an output's frame so if
+ * the layers didn't change since the last frame an update is
+ * scheduled.
+ *
+ * Returns: %TRUE if the texture can be used instead of the layers
+ */
+gboolean
+phoc_layer_cache_is_valid (PhocLayerCache *self, GArray *summary, int width, int height)
+{
+  gboolean stable;
+
+  if (self->valid && self->buffer->width == width && self->buffer->height == height &&
+      phoc_render_summary_equal (summary, self->summary)) {
+    return TRUE;
+  }
+
+  self->valid = FALSE;
+
+  stable = self->width == width && self->height == height &&
+    phoc_render_summary_equal (summary, self->last_summary);
+  self->width = width;
+  self->height = height;
+  summary_copy (self->last_summary, summary);
+
+  if (stable && !self->idle_id) {
+    self->idle_id = g_idle_add (on_idle_update, self);
+    g_source_set_name_by_id (self->idle_id, "[phoc] layer cache update");
+  }
+
+  return FALSE;
+}
+
+/**
+ * phoc_layer_cache_begin:
+ * @self: The layer cache
+ * @width: The width of the output's buffer
+ * @height: The height of the output's buffer
+ *
+ * Starts rendering the layers into the cache. The buffer starts out
+ * fully transparent.
+ *
+ * Returns:(transfer none)(nullable): The render pass to add the layers to
+ */
+struct wlr_render_pass *
+phoc_layer_cache_begin (PhocLayerCache *self, int width, int height)
+{
+  struct wlr_render_pass *pass;
+
+  self->valid = FALSE;
+
+  if (self->buffer && (self->buffer->width != width || self->buffer->height != height)) {
+    g_clear_pointer (&self->texture, wlr_texture_destroy);
+    g_clear_pointer (&self->buffer, wlr_buffer_drop);
+  }
+
+  if (!self->buffer) {
+    self->buffer = create_buffer (self, width, height);
+    if (!self->buffer) {
+      g_warning_once ("Failed to allocate %dx%d buffer for layer cache", width, height);
+      return NULL;
+    }
+  }
+
+  pass = wlr_renderer_begin_buffer_pass (self->wlr_renderer, self->buffer, NULL);
+  if (!pass)
+    return NULL;
+
+  wlr_render_pass_add_rect (pass, &(struct wlr_render_rect_options) {
+      .box = { .width = width, .height = height },
+      .color = { 0.0f, 0.0f, 0.0f, 0.0f },
+      .blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+    });
+
+  return pass;
+}
+
+/**
+ * phoc_layer_cache_end:
+ * @self: The layer cache
+ * @pass: The render pass returned by [method@LayerCache.begin]
+ * @summary: (element-type PhocRenderSummaryItem): The summary of the rendered layers
+ * @opaque: The area of the output's buffer the layers cover opaquely
+ *
+ * Submits the render pass. The texture is used for frames whose
+ * layers match @summary from now on.
+ *
+ * Returns: %TRUE if the cache is valid
+ */
+gboolean
+phoc_layer_cache_end (PhocLayerCache         *self,
+                      struct wlr_render_pass *pass,
+                      GArray                 *summary,
+                      pixman_region32_t      *opaque)
+{
+  if (!wlr_render_pass_submit (pass))
+    return FALSE;
+
+  if (!self->texture)
+    self->texture = wlr_texture_from_buffer (self->wlr_renderer, self->buffer);
+
+  summary_copy (self->summary, summary);
+  pixman_region32_copy (&self->opaque, opaque);
+  self->valid = !!self->texture;
+
+  return self->valid;
+}
+
+/**
+ * phoc_layer_cache_get_texture:
+ * @self: The layer cache
+ *
+ * Returns:(transfer none)(nullable): The composited layers
+ */
+struct wlr_texture *
+phoc_layer_cache_get_texture (PhocLayerCache *self)
+{
+  return self->texture;
+}
+
+/**
+ * phoc_layer_cache_get_opaque:
+ * @self: The layer cache
+ *
+ * Returns:(transfer none): The area of the output's buffer the cached
+ *   layers cover opaquely in untransformed output buffer coordinates
+ */
+pixman_region32_t *
+phoc_layer_cache_get_opaque (PhocLayerCache *self)
+{
+  return &self->opaque;
+}
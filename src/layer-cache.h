@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <pixman.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/wlr_renderer.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PhocLayerCache PhocLayerCache;
+
+/**
+ * PhocLayerCacheUpdateFunc:
+ * @cache: The layer cache
+ * @data: The user data
+ *
+ * Invoked from an idle callback when the cached layers stopped
+ * changing. Expected to render them via [method@LayerCache.begin] and
+ * [method@LayerCache.end].
+ */
+typedef void (*PhocLayerCacheUpdateFunc) (PhocLayerCache *cache, gpointer data);
+
+PhocLayerCache         *phoc_layer_cache_new         (struct wlr_renderer      *wlr_renderer,
+                                                      struct wlr_allocator     *wlr_allocator,
+                                                      PhocLayerCacheUpdateFunc  update_func,
+                                                      gpointer                  data);
+void                    phoc_layer_cache_free        (PhocLayerCache           *self);
+gboolean                phoc_layer_cache_is_valid    (PhocLayerCache           *self,
+                                                      GArray                   *summary,
+                                                      int                       width,
+                                                      int                       height);
+struct wlr_render_pass *phoc_layer_cache_begin       (PhocLayerCache           *self,
+                                                      int                       width,
+                                                      int                       height);
+gboolean                phoc_layer_cache_end         (PhocLayerCache           *self,
+                                                      struct wlr_render_pass   *pass,
+                                                      GArray                   *summary,
+                                                      pixman_region32_t        *opaque);
+struct wlr_texture     *phoc_layer_cache_get_texture (PhocLayerCache           *self);
+pixman_region32_t      *phoc_layer_cache_get_opaque  (PhocLayerCache           *self);
+
+G_END_DECLS
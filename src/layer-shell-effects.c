@@ -77,6 +77,9 @@ struct _PhocDraggableLayerSurface {
     int32_t  anim_end;
     PhocAnimDir anim_dir;
     enum zphoc_draggable_layer_surface_v1_drag_end_state last_state;
+    /* Drag progress sent to the client on the next frame */
+    guint    dragged_id;
+    int32_t  dragged_margin;
   } drag;
   struct wlr_box geo;
 
@@ -149,6 +152,30 @@ resource_handle_destroy(struct wl_client *client,
 }
 
 
+static gboolean
+effect_budget_acquire (struct wl_client *client, struct wl_resource *layer_shell_effects_resource)
+{
+  PhocClientBudget *budget = phoc_server_get_client_budget (phoc_server_get_default ());
+
+  if (phoc_client_budget_acquire (budget, client, PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1))
+    return TRUE;
+
+  wl_resource_post_error (layer_shell_effects_resource,
+                          ZPHOC_LAYER_SHELL_EFFECTS_V1_ERROR_RESOURCE_LIMIT,
+                          "Too many layer surface effect objects");
+  return FALSE;
+}
+
+
+static void
+effect_budget_release (struct wl_client *client)
+{
+  PhocClientBudget *budget = phoc_server_get_client_budget (phoc_server_get_default ());
+
+  phoc_client_budget_release (budget, client, PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1);
+}
+
+
 static void
 handle_draggable_layer_surface_set_margins (struct wl_client   *client,
                                             struct wl_resource *resource,
@@ -442,6 +469,10 @@ phoc_draggable_layer_surface_destroy (PhocDraggableLayerSurface *drag_surface)
     phoc_animatable_remove_frame_callback (PHOC_ANIMATABLE (drag_surface->layer_surface),
                                            drag_surface->drag.anim_id);
   }
+  if (drag_surface->drag.dragged_id && drag_surface->layer_surface) {
+    phoc_animatable_remove_frame_callback (PHOC_ANIMATABLE (drag_surface->layer_surface),
+                                           drag_surface->drag.dragged_id);
+  }
 
   if (drag_surface->layer_surface) {
     g_hash_table_remove (layer_shell_effects->drag_surfaces_by_layer_surface,
@@ -533,6 +564,7 @@ draggable_layer_surface_handle_resource_destroy (struct wl_resource *resource)
 {
   PhocDraggableLayerSurface *drag_surface = phoc_draggable_layer_surface_from_resource (resource);
 
+  effect_budget_release (wl_resource_get_client (resource));
   phoc_draggable_layer_surface_destroy (drag_surface);
 }
 
@@ -542,6 +574,7 @@ alpha_layer_surface_handle_resource_destroy (struct wl_resource *resource)
 {
   PhocAlphaLayerSurface *alpha_surface = phoc_alpha_layer_surface_from_resource (resource);
 
+  effect_budget_release (wl_resource_get_client (resource));
   phoc_alpha_layer_surface_destroy (alpha_surface);
 }
 
@@ -551,6 +584,7 @@ stacked_layer_surface_handle_resource_destroy (struct wl_resource *resource)
 {
   PhocStackedLayerSurface *stacked_surface = phoc_stacked_layer_surface_from_resource (resource);
 
+  effect_budget_release (wl_resource_get_client (resource));
   phoc_stacked_layer_surface_destroy (stacked_surface);
 }
 
@@ -579,6 +613,7 @@ draggable_layer_surface_handle_destroy (struct wl_listener *listener, void *data
 
   /* The layer-surface is unusable for us now */
   drag_surface->layer_surface = NULL;
+  drag_surface->drag.dragged_id = 0;
 }
 
 
@@ -744,6 +779,9 @@ handle_get_draggable_layer_surface (struct wl_client   *client,
   wlr_surface = wlr_layer_surface->surface;
   g_assert (wlr_surface);
 
+  if (!effect_budget_acquire (client, layer_shell_effects_resource))
+    return;
+
   drag_surface = g_new0 (PhocDraggableLayerSurface, 1);
 
   version = wl_resource_get_version (layer_shell_effects_resource);
@@ -753,6 +791,7 @@ handle_get_draggable_layer_surface (struct wl_client   *client,
                                                version,
                                                id);
   if (drag_surface->resource == NULL) {
+    effect_budget_release (client);
     g_free (drag_surface);
     wl_client_post_no_memory(client);
     return;
@@ -804,6 +843,9 @@ handle_get_alpha_layer_surface (struct wl_client   *client,
   wlr_surface = wlr_layer_surface->surface;
   g_assert (wlr_surface);
 
+  if (!effect_budget_acquire (client, layer_shell_effects_resource))
+    return;
+
   alpha_surface = g_new0 (PhocAlphaLayerSurface, 1);
 
   version = wl_resource_get_version (layer_shell_effects_resource);
@@ -813,6 +855,7 @@ handle_get_alpha_layer_surface (struct wl_client   *client,
                                                 version,
                                                 id);
   if (alpha_surface->resource == NULL) {
+    effect_budget_release (client);
     wl_client_post_no_memory(client);
     return;
   }
@@ -861,6 +904,9 @@ handle_get_stacked_layer_surface (struct wl_client   *client,
   wlr_surface = wlr_layer_surface->surface;
   g_assert (wlr_surface);
 
+  if (!effect_budget_acquire (client, layer_shell_effects_resource))
+    return;
+
   stacked_surface = g_new0 (PhocStackedLayerSurface, 1);
 
   version = wl_resource_get_version (layer_shell_effects_resource);
@@ -870,6 +916,7 @@ handle_get_stacked_layer_surface (struct wl_client   *client,
                                                  version,
                                                  id);
   if (stacked_surface->resource == NULL) {
+    effect_budget_release (client);
     wl_client_post_no_memory(client);
     return;
   }
@@ -909,6 +956,7 @@ layer_shell_effects_handle_resource_destroy (struct wl_resource *resource)
 
   g_debug ("Destroying layer_shell_effects %p (res %p)", self, resource);
   self->resources = g_slist_remove (self->resources, resource);
+  phoc_desktop_invalidate_client_priorities (phoc_server_get_desktop (phoc_server_get_default ()));
 }
 
 
@@ -935,6 +983,7 @@ layer_shell_effects_bind (struct wl_client *client, void *data, uint32_t version
                                   layer_shell_effects_handle_resource_destroy);
 
   self->resources = g_slist_prepend (self->resources, resource);
+  phoc_desktop_invalidate_client_priorities (phoc_server_get_desktop (phoc_server_get_default ()));
   return;
 }
 
@@ -999,6 +1048,20 @@ phoc_layer_shell_effects_get_global (PhocLayerShellEffects *self)
 }
 
 
+gboolean
+phoc_layer_shell_effects_has_client (PhocLayerShellEffects *self, struct wl_client *client)
+{
+  g_assert (PHOC_IS_LAYER_SHELL_EFFECTS (self));
+
+  for (GSList *l = self->resources; l; l = l->next) {
+    if (wl_resource_get_client (l->data) == client)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+
 static void
 apply_margin (PhocDraggableLayerSurface *drag_surface, double margin)
 {
@@ -1034,6 +1097,49 @@ apply_margin (PhocDraggableLayerSurface *drag_surface, double margin)
 }
 
 
+/*
+ * Move the surface by the margin change without rearranging the
+ * output. Other layer surfaces and views only need to be rearranged
+ * once the drag or animation finished and the exclusive zone
+ * settled.
+ */
+static void
+move_surface (PhocDraggableLayerSurface *drag_surface, PhocOutput *output, int32_t old_margin)
+{
+  PhocLayerSurface *layer_surface = drag_surface->layer_surface;
+  struct wlr_layer_surface_v1 *wlr_layer_surface = layer_surface->layer_surface;
+  int32_t dx = 0, dy = 0;
+
+  switch (wlr_layer_surface->current.anchor) {
+  case PHOC_LAYER_SHELL_EFFECT_DRAG_FROM_TOP:
+    dy = wlr_layer_surface->current.margin.top - old_margin;
+    break;
+  case PHOC_LAYER_SHELL_EFFECT_DRAG_FROM_BOTTOM:
+    dy = old_margin - wlr_layer_surface->current.margin.bottom;
+    break;
+  case PHOC_LAYER_SHELL_EFFECT_DRAG_FROM_LEFT:
+    dx = wlr_layer_surface->current.margin.left - old_margin;
+    break;
+  case PHOC_LAYER_SHELL_EFFECT_DRAG_FROM_RIGHT:
+    dx = old_margin - wlr_layer_surface->current.margin.right;
+    break;
+  default:
+    g_assert_not_reached ();
+    break;
+  }
+
+  if (dx == 0 && dy == 0)
+    return;
+
+  phoc_output_damage_whole_surface (output, wlr_layer_surface->surface,
+                                    layer_surface->geo.x, layer_surface->geo.y);
+  layer_surface->geo.x += dx;
+  layer_surface->geo.y += dy;
+  phoc_output_damage_whole_surface (output, wlr_layer_surface->surface,
+                                    layer_surface->geo.x, layer_surface->geo.y);
+}
+
+
 static void
 apply_state (PhocDraggableLayerSurface *drag_surface, PhocDraggableSurfaceState state)
 {
@@ -1050,7 +1156,43 @@ apply_state (PhocDraggableLayerSurface *drag_surface, PhocDraggableSurfaceState
 
 
 static gboolean
-on_output_frame_callback (PhocAnimatable *animatable, guint64 last_frame, gpointer user_data)
+on_dragged_frame_callback (PhocAnimatable *animatable,
+                           guint64         last_frame,
+                           guint64         frame_time,
+                           gpointer        user_data)
+{
+  PhocDraggableLayerSurface *drag_surface = user_data;
+
+  drag_surface->drag.dragged_id = 0;
+  zphoc_draggable_layer_surface_v1_send_dragged (drag_surface->resource,
+                                                 drag_surface->drag.dragged_margin);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Sends the drag progress batched up for the next frame right away so
+ * it reaches the client before e.g. the drag end.
+ */
+static void
+flush_dragged (PhocDraggableLayerSurface *drag_surface)
+{
+  if (!drag_surface->drag.dragged_id)
+    return;
+
+  phoc_animatable_remove_frame_callback (PHOC_ANIMATABLE (drag_surface->layer_surface),
+                                         drag_surface->drag.dragged_id);
+  drag_surface->drag.dragged_id = 0;
+  zphoc_draggable_layer_surface_v1_send_dragged (drag_surface->resource,
+                                                 drag_surface->drag.dragged_margin);
+}
+
+
+static gboolean
+on_output_frame_callback (PhocAnimatable *animatable,
+                          guint64         last_frame,
+                          guint64         frame_time,
+                          gpointer        user_data)
 
 {
   PhocDraggableLayerSurface *drag_surface = user_data;
@@ -1058,6 +1200,7 @@ on_output_frame_callback (PhocAnimatable *animatable, guint64 last_frame, gpoint
   PhocOutput *output;
   struct wlr_layer_surface_v1 *wlr_layer_surface;
   double margin, distance;
+  int32_t old_margin;
   bool done;
 
   g_assert (drag_surface);
@@ -1090,6 +1233,7 @@ on_output_frame_callback (PhocAnimatable *animatable, guint64 last_frame, gpoint
     g_assert_not_reached ();
     break;
   }
+  old_margin = margin;
 
   done = (drag_surface->drag.anim_dir == ANIM_DIR_IN && margin <= drag_surface->drag.anim_end) ||
     (drag_surface->drag.anim_dir == ANIM_DIR_OUT && margin >= drag_surface->drag.anim_end);
@@ -1112,9 +1256,7 @@ on_output_frame_callback (PhocAnimatable *animatable, guint64 last_frame, gpoint
     apply_state (drag_surface, PHOC_DRAGGABLE_SURFACE_STATE_NONE);
     drag_surface->drag.anim_id = 0;
   } else {
-    gint64 now = g_get_monotonic_time ();
-
-    drag_surface->drag.anim_t += ((float)(now - last_frame)) / drag_surface->drag.anim_duration;
+    drag_surface->drag.anim_t += ((float)(frame_time - last_frame)) / drag_surface->drag.anim_duration;
     if (drag_surface->drag.anim_t > 1.0)
       drag_surface->drag.anim_t = 1.0;
 
@@ -1132,9 +1274,11 @@ on_output_frame_callback (PhocAnimatable *animatable, guint64 last_frame, gpoint
   }
 
   apply_margin (drag_surface, margin);
-  phoc_layer_shell_arrange (output);
-  /* FIXME: way too much damage */
-  phoc_output_damage_whole (output);
+  /* Only rearrange once the surface reached its final state */
+  if (done)
+    phoc_layer_shell_arrange (output);
+  else
+    move_surface (drag_surface, output, old_margin);
 
   return done ? G_SOURCE_REMOVE : G_SOURCE_CONTINUE;
 }
@@ -1156,6 +1300,8 @@ phoc_draggable_layer_surface_slide (PhocDraggableLayerSurface *drag_surface, Pho
   if (wlr_output == NULL)
     return;
 
+  flush_dragged (drag_surface);
+
   switch (wlr_layer_surface->current.anchor) {
   case PHOC_LAYER_SHELL_EFFECT_DRAG_FROM_TOP:
     margin = (double)(int32_t)wlr_layer_surface->current.margin.top;
@@ -1248,7 +1394,7 @@ accept_drag (PhocDraggableLayerSurface *drag_surface,
   struct wlr_output *wlr_output = wlr_layer_surface->output;
   PhocOutput *output;
   int32_t *target;
-  int32_t margin = 0;
+  int32_t margin = 0, old_margin;
 
   output = PHOC_OUTPUT (wlr_output->data);
   g_assert (PHOC_IS_OUTPUT (output));
@@ -1283,6 +1429,7 @@ accept_drag (PhocDraggableLayerSurface *drag_surface,
   if (margin <= drag_surface->current.folded)
     margin = drag_surface->current.folded;
 
+  old_margin = *target;
   *target = margin;
   wlr_layer_surface->current.exclusive_zone = -margin + drag_surface->current.exclusive;
 
@@ -1292,11 +1439,17 @@ accept_drag (PhocDraggableLayerSurface *drag_surface,
   wlr_layer_surface->pending.margin.right = wlr_layer_surface->current.margin.right;
   wlr_layer_surface->pending.exclusive_zone = wlr_layer_surface->current.exclusive_zone;
 
-  zphoc_draggable_layer_surface_v1_send_dragged (drag_surface->resource, margin);
-  phoc_layer_shell_arrange (output);
-
-  /* FIXME: way too much damage */
-  phoc_output_damage_whole (output);
+  /* Touch motion comes in faster than the client can draw so only
+   * report the progress once per frame */
+  drag_surface->drag.dragged_margin = margin;
+  if (!drag_surface->drag.dragged_id) {
+    drag_surface->drag.dragged_id = phoc_animatable_add_frame_callback (
+      PHOC_ANIMATABLE (drag_surface->layer_surface),
+      on_dragged_frame_callback,
+      drag_surface,
+      NULL);
+  }
+  move_surface (drag_surface, output, old_margin);
 
   apply_state (drag_surface, PHOC_DRAGGABLE_SURFACE_STATE_DRAGGING);
 }
@@ -1551,10 +1704,10 @@ phoc_draggable_layer_surface_drag_end (PhocDraggableLayerSurface *drag_surface,
       ANIM_DIR_IN : ANIM_DIR_OUT;
   }
 
-  phoc_layer_shell_arrange (output);
   drag_surface->drag.pending_accept = 0;
   drag_surface->drag.pending_reject = 0;
 
+  /* The surface gets arranged when the slide animation finished */
   phoc_draggable_layer_surface_slide (drag_surface, dir);
 
   apply_state (drag_surface, PHOC_DRAGGABLE_SURFACE_STATE_ANIMATING);
@@ -71,6 +71,8 @@ void                   phoc_layer_shell_effects_send_drag_end   (PhocLayerShellE
                                                                  PhocLayerSurface      *surface,
                                                                  int                    state);
 struct wl_global      *phoc_layer_shell_effects_get_global      (PhocLayerShellEffects *self);
+gboolean               phoc_layer_shell_effects_has_client      (PhocLayerShellEffects *self,
+                                                                 struct wl_client      *client);
 
 /* Drag */
 PhocDraggableLayerSurface *phoc_layer_shell_effects_get_draggable_layer_surface_from_layer_surface (
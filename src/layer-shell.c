@@ -1,6 +1,7 @@
 #define G_LOG_DOMAIN "phoc-layer-shell"
 
 #include "phoc-config.h"
+#include "phoc-tracing.h"
 
 #ifndef _POSIX_C_SOURCE
 #define _POSIX_C_SOURCE 200112L
@@ -222,6 +223,12 @@ arrange_layer (PhocOutput                     *output,
     if (box.width != old_geo.width || box.height != old_geo.height)
       wlr_layer_surface_v1_configure (wlr_layer_surface, box.width, box.height);
 
+    /* Only the area the surface moved away from and to needs repainting */
+    if (wlr_layer_surface->surface->mapped && memcmp (&box, &old_geo, sizeof (box)) != 0) {
+      phoc_output_damage_box (output, &old_geo);
+      phoc_output_damage_box (output, &box);
+    }
+
     // Having a cursor newly end up over the moved layer will not
     // automatically send a motion event to the surface. The event needs to
     // be synthesized.
@@ -245,14 +252,7 @@ arrange_layer (PhocOutput                     *output,
 PhocLayerSurface *
 phoc_layer_shell_find_osk (PhocOutput *output)
 {
-  PhocLayerSurface *layer_surface;
-
-  wl_list_for_each (layer_surface, &output->layer_surfaces, link) {
-    if (strcmp (layer_surface->layer_surface->namespace, "osk") == 0)
-      return layer_surface;
-  }
-
-  return NULL;
+  return phoc_output_get_osk (output);
 }
 
 
@@ -263,6 +263,7 @@ phoc_layer_shell_arrange (PhocOutput *output)
   PhocDesktop *desktop = phoc_server_get_desktop (server);
   PhocInput *input = phoc_server_get_input (server);
   struct wlr_box usable_area = { 0 };
+  struct wlr_box old_usable_area = output->usable_area;
   GSList *seats = phoc_input_get_seats (input);
   enum zwlr_layer_shell_v1_layer layers[] = {
     ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY,
@@ -275,6 +276,10 @@ phoc_layer_shell_arrange (PhocOutput *output)
    * Whenever we rearrange layers we need to check for the OSK's layer as
    * the new surface might need it raised (or the new surface might be the OSK itself)
    */
+  DTRACE_PROBE1 (phoc, layer_arrange_start, output->wlr_output->name);
+
+  phoc_output_clear_queued_arrange_layers (output);
+
   phoc_layer_shell_update_osk (output, FALSE);
 
   wlr_output_effective_resolution (output->wlr_output, &usable_area.width, &usable_area.height);
@@ -283,10 +288,29 @@ phoc_layer_shell_arrange (PhocOutput *output)
     arrange_layer (output, seats, layers[i], &usable_area, true);
   output->usable_area = usable_area;
 
-  for (GList *l = phoc_desktop_get_views (desktop)->head; l; l = l->next) {
-    PhocView *view = PHOC_VIEW (l->data);
+  /*
+   * Only views on this output that fill or are centered in its usable
+   * area depend on it. The usable area is output local so also check
+   * if the output moved in the layout. Views resize in one frame
+   * rather than one after another.
+   */
+  if (!wlr_box_equal (&old_usable_area, &usable_area) ||
+      !wlr_box_equal (&output->arranged_layout_box, &output->layout_box)) {
+    output->arranged_layout_box = output->layout_box;
+    phoc_layout_transaction_begin (phoc_desktop_get_layout_transaction (desktop));
+    for (GList *l = phoc_desktop_get_views (desktop)->head; l; l = l->next) {
+      PhocView *view = PHOC_VIEW (l->data);
+
+      if (!phoc_view_is_maximized (view) && !phoc_view_is_tiled (view) &&
+          !output->desktop->maximize)
+        continue;
 
-    phoc_view_arrange (view, NULL, output->desktop->maximize);
+      if (phoc_view_get_output (view) != output)
+        continue;
+
+      phoc_view_arrange (view, NULL, output->desktop->maximize);
+    }
+    phoc_layout_transaction_end (phoc_desktop_get_layout_transaction (desktop));
   }
 
   // Arrange non-exlusive surfaces from top->bottom
@@ -295,6 +319,8 @@ phoc_layer_shell_arrange (PhocOutput *output)
 
   phoc_output_update_shell_reveal (output);
 
+  DTRACE_PROBE1 (phoc, layer_arrange_end, output->wlr_output->name);
+
   if (G_UNLIKELY (phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_LAYER_SHELL))) {
     PhocLayerSurface *layer_surface;
     g_message ("Dumping layers:");
@@ -504,7 +530,7 @@ popup_handle_map (struct wl_listener *listener, void *data)
   popup->new_subsurface.notify = popup_new_subsurface;
   wl_signal_add (&popup->wlr_popup->base->surface->events.new_subsurface, &popup->new_subsurface);
 
-  phoc_utils_wlr_surface_enter_output (popup->wlr_popup->base->surface, wlr_output);
+  phoc_utils_wlr_surface_enter_output (popup->wlr_popup->base->surface, wlr_output, 1.0);
   popup_damage (popup, true);
   phoc_input_update_cursor_focus (input);
 }
@@ -647,7 +673,7 @@ subsurface_handle_map (struct wl_listener *listener, void *data)
 
   PhocLayerSurface *layer_surface = subsurface_get_root_layer (subsurface);
   phoc_utils_wlr_surface_enter_output (subsurface->wlr_subsurface->surface,
-                                       layer_surface->layer_surface->output);
+                                       layer_surface->layer_surface->output, 1.0);
   subsurface_damage (subsurface, true);
   phoc_input_update_cursor_focus (input);
 }
@@ -768,7 +794,7 @@ phoc_handle_layer_shell_surface (struct wl_listener *listener, void *data)
  * This can be used to adjust the OSKs layer accordingly.
  *
  * When `arrange` is `TRUE` the layers will also be rearranged to reflect that change
- * immediately.
+ * immediately. Nothing is rearranged when the OSK's layer didn't change.
  */
 void
 phoc_layer_shell_update_osk (PhocOutput *output, gboolean arrange)
@@ -806,10 +832,11 @@ phoc_layer_shell_update_osk (PhocOutput *output, gboolean arrange)
   if (!force_overlay && osk->layer != osk->layer_surface->pending.layer)
     osk->layer = osk->layer_surface->pending.layer;
 
-  if (old_layer != osk->layer) {
-    phoc_output_set_layer_dirty (output, old_layer);
-    phoc_output_set_layer_dirty (output, osk->layer);
-  }
+  if (old_layer == osk->layer)
+    return;
+
+  phoc_output_set_layer_dirty (output, old_layer);
+  phoc_output_set_layer_dirty (output, osk->layer);
 
   if (force_overlay && arrange)
     phoc_layer_shell_arrange (output);
@@ -99,16 +99,26 @@ handle_surface_commit (struct wl_listener *listener, void *data)
   struct wlr_layer_surface_v1 *wlr_layer_surface = self->layer_surface;
   struct wlr_output *wlr_output = wlr_layer_surface->output;
 
+  phoc_commit_stats_record (phoc_server_get_commit_stats (server),
+                            wlr_layer_surface->surface, G_OBJECT (self));
+
   if (wlr_output != NULL) {
     PhocOutput *output = PHOC_OUTPUT (wlr_output->data);
     struct wlr_box old_geo = self->geo;
 
     bool layer_changed = false;
     if (wlr_layer_surface->current.committed != 0) {
+      bool exclusive = wlr_layer_surface->current.exclusive_zone > 0;
+
       layer_changed = self->layer != wlr_layer_surface->current.layer;
 
-      phoc_output_set_layer_dirty (output, self->layer);
+      /* Only the layer and whether the surface is exclusive affect stacking */
+      if (layer_changed || exclusive != self->exclusive) {
+        phoc_output_set_layer_dirty (output, self->layer);
+        phoc_output_set_layer_dirty (output, wlr_layer_surface->current.layer);
+      }
 
+      self->exclusive = exclusive;
       self->layer = wlr_layer_surface->current.layer;
       phoc_layer_shell_arrange (output);
       phoc_layer_shell_update_focus ();
@@ -129,10 +139,9 @@ handle_surface_commit (struct wl_listener *listener, void *data)
 
     bool geo_changed = memcmp (&old_geo, &self->geo, sizeof (struct wlr_box)) != 0;
     if (geo_changed || layer_changed) {
-      phoc_output_damage_whole_surface (output,
-                                        wlr_layer_surface->surface,
-                                        old_geo.x,
-                                        old_geo.y);
+      /* The old geometry got damaged when arranging. Damage everything
+       * the surface tree covers at the new position as stacking or
+       * placement changed. */
       phoc_output_damage_whole_surface (output,
                                         wlr_layer_surface->surface,
                                         self->geo.x,
@@ -143,8 +152,6 @@ handle_surface_commit (struct wl_listener *listener, void *data)
                                        self->geo.x,
                                        self->geo.y);
     }
-
-    phoc_output_set_layer_dirty (output, self->layer);
   }
 }
 
@@ -213,10 +220,9 @@ handle_map (struct wl_listener *listener, void *data)
                                     self->geo.x,
                                     self->geo.y);
 
-  phoc_utils_wlr_surface_enter_output (wlr_layer_surface->surface, output->wlr_output);
+  phoc_utils_wlr_surface_enter_output (wlr_layer_surface->surface, output->wlr_output, 1.0);
 
-  phoc_layer_shell_arrange (output);
-  phoc_layer_shell_update_focus ();
+  phoc_output_queue_arrange_layers (output);
 }
 
 
@@ -239,8 +245,9 @@ handle_unmap (struct wl_listener *listener, void *data)
   phoc_input_update_cursor_focus (input);
 
   if (output)
-    phoc_layer_shell_arrange (output);
-  phoc_layer_shell_update_focus ();
+    phoc_output_queue_arrange_layers (output);
+  else
+    phoc_layer_shell_update_focus ();
 }
 
 
@@ -331,7 +338,7 @@ phoc_layer_surface_constructed (GObject *object)
 
   /* Add to the list of layer surfaces on the output */
   output = PHOC_OUTPUT (self->layer_surface->output->data);
-  wl_list_insert (&output->layer_surfaces, &self->link);
+  phoc_output_add_layer_surface (output, self);
 }
 
 
@@ -346,7 +353,7 @@ phoc_layer_surface_finalize (GObject *object)
 
   wl_list_remove (&self->link);
   if (output)
-    phoc_output_set_layer_dirty (output, self->layer);
+    phoc_output_remove_layer_surface (output, self);
 
   wl_list_remove (&self->destroy.link);
   wl_list_remove (&self->map.link);
@@ -358,8 +365,7 @@ phoc_layer_surface_finalize (GObject *object)
     g_assert (PHOC_IS_OUTPUT (output));
     phoc_output_remove_frame_callbacks_by_animatable (output, PHOC_ANIMATABLE (self));
     wl_list_remove (&self->output_destroy.link);
-    phoc_layer_shell_arrange (output);
-    phoc_layer_shell_update_focus ();
+    phoc_output_queue_arrange_layers (output);
   }
 
   G_OBJECT_CLASS (phoc_layer_surface_parent_class)->finalize (object);
@@ -466,7 +472,7 @@ phoc_layer_surface_set_alpha (PhocLayerSurface *self, float alpha)
 float
 phoc_layer_surface_get_alpha (PhocLayerSurface *self)
 {
-  g_assert (PHOC_IS_LAYER_SURFACE (self));
+  phoc_assert_hot (PHOC_IS_LAYER_SURFACE (self));
 
   return self->alpha;
 }
@@ -36,6 +36,7 @@ struct _PhocLayerSurface {
 
   struct wlr_box     geo;
   enum zwlr_layer_shell_v1_layer layer;
+  bool               exclusive;
   float              alpha;
   bool               mapped;
 };
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-layout-transaction"
+
+#include "phoc-config.h"
+
+#include "layout-transaction.h"
+#include "view-snapshot.h"
+
+/* Don't let slow clients freeze the screen */
+#define LAYOUT_TRANSACTION_TIMEOUT_MS 150
+
+enum {
+  DONE,
+  N_SIGNALS
+};
+static guint signals[N_SIGNALS];
+
+/**
+ * PhocLayoutTransaction:
+ *
+ * Groups the resizes of several views, e.g. when the output rotates
+ * or the OSK shows up, so they end up on screen in a single frame.
+ *
+ * While a transaction is open every configure sent to a visible view
+ * is tracked. Once it's closed the tracked views are held: outputs
+ * draw them from a snapshot of their old content until all of them
+ * committed a buffer for their new size or the timeout expired. The
+ * rest of the output (e.g. other views, layer surfaces and the
+ * cursor) keeps updating. Then [signal@LayoutTransaction::done] is
+ * emitted so the outputs show all the resized views at once instead
+ * of several half laid out frames.
+ */
+struct _PhocLayoutTransaction {
+  GObject     parent;
+
+  guint       depth;
+  GPtrArray  *views; /* PhocView, strong refs */
+  GHashTable *snapshots; /* PhocView → PhocViewSnapshot */
+  guint       timeout_id;
+};
+
+G_DEFINE_TYPE (PhocLayoutTransaction, phoc_layout_transaction, G_TYPE_OBJECT)
+
+
+static void
+finish (PhocLayoutTransaction *self)
+{
+  g_clear_handle_id (&self->timeout_id, g_source_remove);
+
+  for (guint i = 0; i < self->views->len; i++)
+    g_signal_handlers_disconnect_by_data (g_ptr_array_index (self->views, i), self);
+  g_ptr_array_set_size (self->views, 0);
+  g_hash_table_remove_all (self->snapshots);
+
+  g_signal_emit (self, signals[DONE], 0);
+}
+
+
+static gboolean
+on_timeout (gpointer data)
+{
+  PhocLayoutTransaction *self = PHOC_LAYOUT_TRANSACTION (data);
+
+  g_debug ("Layout transaction timed out waiting for %u views", self->views->len);
+  self->timeout_id = 0;
+  finish (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+on_view_surface_destroy (PhocLayoutTransaction *self, PhocView *view)
+{
+  /* Nothing left to draw the snapshot for */
+  g_hash_table_remove (self->snapshots, view);
+  phoc_layout_transaction_view_ready (self, view);
+}
+
+
+static void
+phoc_layout_transaction_dispose (GObject *object)
+{
+  PhocLayoutTransaction *self = PHOC_LAYOUT_TRANSACTION (object);
+
+  g_clear_handle_id (&self->timeout_id, g_source_remove);
+  if (self->views) {
+    for (guint i = 0; i < self->views->len; i++)
+      g_signal_handlers_disconnect_by_data (g_ptr_array_index (self->views, i), self);
+  }
+  g_clear_pointer (&self->views, g_ptr_array_unref);
+  g_clear_pointer (&self->snapshots, g_hash_table_destroy);
+
+  G_OBJECT_CLASS (phoc_layout_transaction_parent_class)->dispose (object);
+}
+
+
+static void
+phoc_layout_transaction_class_init (PhocLayoutTransactionClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = phoc_layout_transaction_dispose;
+
+  /**
+   * PhocLayoutTransaction::done:
+   * @self: The layout transaction
+   *
+   * Emitted when all views of a closed transaction are ready or it
+   * timed out. Outputs don't hold back frames anymore.
+   */
+  signals[DONE] = g_signal_new ("done",
+                                G_TYPE_FROM_CLASS (klass),
+                                G_SIGNAL_RUN_LAST,
+                                0, NULL, NULL, NULL,
+                                G_TYPE_NONE, 0);
+}
+
+
+static void
+phoc_layout_transaction_init (PhocLayoutTransaction *self)
+{
+  self->views = g_ptr_array_new_with_free_func (g_object_unref);
+  self->snapshots = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_object_unref);
+}
+
+
+PhocLayoutTransaction *
+phoc_layout_transaction_new (void)
+{
+  return g_object_new (PHOC_TYPE_LAYOUT_TRANSACTION, NULL);
+}
+
+/**
+ * phoc_layout_transaction_begin:
+ * @self: The layout transaction
+ *
+ * Opens the transaction. Configures sent to views until the matching
+ * [method@LayoutTransaction.end] are applied together. Calls can be
+ * nested.
+ */
+void
+phoc_layout_transaction_begin (PhocLayoutTransaction *self)
+{
+  g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
+
+  self->depth++;
+}
+
+/**
+ * phoc_layout_transaction_end:
+ * @self: The layout transaction
+ *
+ * Closes the transaction. If views got configured they're held until
+ * they're ready.
+ */
+void
+phoc_layout_transaction_end (PhocLayoutTransaction *self)
+{
+  g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
+  g_return_if_fail (self->depth > 0);
+
+  self->depth--;
+  if (self->depth || self->views->len == 0 || self->timeout_id)
+    return;
+
+  g_debug ("Waiting for %u views to resize", self->views->len);
+
+  /* The views didn't commit their new size yet so this is their old content */
+  for (guint i = 0; i < self->views->len; i++) {
+    PhocView *view = g_ptr_array_index (self->views, i);
+    PhocViewSnapshot *snapshot = phoc_view_snapshot_new (view);
+
+    if (snapshot)
+      g_hash_table_insert (self->snapshots, view, snapshot);
+  }
+
+  self->timeout_id = g_timeout_add (LAYOUT_TRANSACTION_TIMEOUT_MS, on_timeout, self);
+  g_source_set_name_by_id (self->timeout_id, "[phoc] layout transaction timeout");
+}
+
+/**
+ * phoc_layout_transaction_add_view:
+ * @self: The layout transaction
+ * @view: The view that got configured
+ *
+ * Tracks @view until it committed its new size. Does nothing if the
+ * transaction isn't open.
+ */
+void
+phoc_layout_transaction_add_view (PhocLayoutTransaction *self, PhocView *view)
+{
+  g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
+  g_assert (PHOC_IS_VIEW (view));
+
+  if (self->depth == 0)
+    return;
+
+  if (g_ptr_array_find (self->views, view, NULL))
+    return;
+
+  g_ptr_array_add (self->views, g_object_ref (view));
+  g_signal_connect_swapped (view, "surface-destroy", G_CALLBACK (on_view_surface_destroy), self);
+}
+
+/**
+ * phoc_layout_transaction_view_ready:
+ * @self: The layout transaction
+ * @view: The view
+ *
+ * Tells the transaction that @view committed a buffer for the size it
+ * was configured with (or went away).
+ */
+void
+phoc_layout_transaction_view_ready (PhocLayoutTransaction *self, PhocView *view)
+{
+  guint index;
+
+  g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
+
+  if (!g_ptr_array_find (self->views, view, &index))
+    return;
+
+  g_signal_handlers_disconnect_by_data (view, self);
+  g_ptr_array_remove_index_fast (self->views, index);
+
+  if (self->views->len == 0 && self->timeout_id)
+    finish (self);
+}
+
+/**
+ * phoc_layout_transaction_is_holding:
+ * @self: The layout transaction
+ *
+ * Returns: %TRUE if views are held as they're still resizing
+ */
+gboolean
+phoc_layout_transaction_is_holding (PhocLayoutTransaction *self)
+{
+  g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
+
+  return self->timeout_id != 0;
+}
+
+/**
+ * phoc_layout_transaction_get_snapshot:
+ * @self: The layout transaction
+ * @view: The view
+ *
+ * Gets the snapshot outputs draw instead of @view while it's held.
+ * Views that couldn't be captured are drawn as is.
+ *
+ * Returns:(transfer none)(nullable): The snapshot or %NULL if @view
+ *   isn't held
+ */
+PhocViewSnapshot *
+phoc_layout_transaction_get_snapshot (PhocLayoutTransaction *self, PhocView *view)
+{
+  g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
+
+  if (!self->timeout_id)
+    return NULL;
+
+  return g_hash_table_lookup (self->snapshots, view);
+}
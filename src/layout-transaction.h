@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "view.h"
+
+G_BEGIN_DECLS
+
+typedef struct _PhocViewSnapshot PhocViewSnapshot;
+
+#define PHOC_TYPE_LAYOUT_TRANSACTION (phoc_layout_transaction_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocLayoutTransaction, phoc_layout_transaction, PHOC, LAYOUT_TRANSACTION,
+                      GObject)
+
+PhocLayoutTransaction *phoc_layout_transaction_new        (void);
+void                   phoc_layout_transaction_begin      (PhocLayoutTransaction *self);
+void                   phoc_layout_transaction_end        (PhocLayoutTransaction *self);
+void                   phoc_layout_transaction_add_view   (PhocLayoutTransaction *self,
+                                                           PhocView              *view);
+void                   phoc_layout_transaction_view_ready (PhocLayoutTransaction *self,
+                                                           PhocView              *view);
+gboolean               phoc_layout_transaction_is_holding (PhocLayoutTransaction *self);
+PhocViewSnapshot      *phoc_layout_transaction_get_snapshot (PhocLayoutTransaction *self,
+                                                             PhocView              *view);
+
+G_END_DECLS
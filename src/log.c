@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-log"
+
+#include "phoc-config.h"
+
+#include "log.h"
+
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PHOC_LOG_RING_SIZE     256
+#define PHOC_LOG_RING_MSG_SIZE 120
+
+/**
+ * PhocLogHot:
+ *
+ * Debug messages on hot paths go through [func@debug_hot]. The
+ * enabled domains are looked up once at startup from
+ * `G_MESSAGES_DEBUG` so disabled messages cost a single bit test.
+ *
+ * With the `log-ring` debug flag the messages are additionally kept
+ * in a fixed size in memory ring which is written to stderr when phoc
+ * crashes. Recording into the ring doesn't do any I/O so it can stay
+ * enabled on the frame path.
+ */
+
+typedef struct {
+  gint64  time_us;
+  guint   domain;
+  char    msg[PHOC_LOG_RING_MSG_SIZE];
+} PhocLogRingEntry;
+
+static const struct {
+  PhocLogHotDomain  domain;
+  const char       *log_domains[3];
+} hot_domains[] = {
+  { PHOC_LOG_HOT_INPUT, { "phoc-seat", "phoc-cursor", NULL } },
+  { PHOC_LOG_HOT_LAYERS, { "phoc-output", NULL } },
+};
+
+/* Domains that either log or record to the ring */
+guint phoc_log_hot_domains;
+/* Domains that are passed on to GLib's logging */
+static guint debug_domains;
+
+static PhocLogRingEntry *ring;
+static guint ring_next;
+static guint ring_len;
+
+
+static void
+write_str (int fd, const char *str)
+{
+  gsize len = strlen (str);
+
+  while (len > 0) {
+    gssize n = write (fd, str, len);
+
+    if (n <= 0)
+      return;
+    str += n;
+    len -= n;
+  }
+}
+
+/* Format @value without allocating so this works in a signal handler */
+static void
+write_uint (int fd, guint64 value)
+{
+  char buf[21];
+  int pos = sizeof (buf) - 1;
+
+  buf[pos] = '\0';
+  do {
+    buf[--pos] = '0' + value % 10;
+    value /= 10;
+  } while (value && pos > 0);
+
+  write_str (fd, &buf[pos]);
+}
+
+
+static void
+on_fatal_signal (int sig)
+{
+  write_str (STDERR_FILENO, "phoc: fatal signal, dumping log ring\n");
+  phoc_log_ring_dump (STDERR_FILENO);
+
+  /* SA_RESETHAND restored the default action */
+  raise (sig);
+}
+
+
+static void
+install_crash_handler (void)
+{
+  const int signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+  struct sigaction sa = { 0 };
+
+  sa.sa_handler = on_fatal_signal;
+  sa.sa_flags = SA_RESETHAND;
+  sigemptyset (&sa.sa_mask);
+
+  for (guint i = 0; i < G_N_ELEMENTS (signals); i++)
+    sigaction (signals[i], &sa, NULL);
+}
+
+/**
+ * phoc_log_init:
+ * @ring: Whether to record hot messages in the crash log ring
+ *
+ * Looks up which hot domains have debug messages enabled and sets up
+ * the log ring.
+ */
+void
+phoc_log_init (gboolean ring_enabled)
+{
+  debug_domains = 0;
+
+  for (guint i = 0; i < G_N_ELEMENTS (hot_domains); i++) {
+    for (guint j = 0; hot_domains[i].log_domains[j]; j++) {
+      if (!g_log_writer_default_would_drop (G_LOG_LEVEL_DEBUG, hot_domains[i].log_domains[j])) {
+        debug_domains |= hot_domains[i].domain;
+        break;
+      }
+    }
+  }
+
+  phoc_log_hot_domains = debug_domains;
+
+  if (!ring_enabled)
+    return;
+
+  if (!ring) {
+    ring = g_new0 (PhocLogRingEntry, PHOC_LOG_RING_SIZE);
+    install_crash_handler ();
+  }
+  ring_next = 0;
+  ring_len = 0;
+  phoc_log_hot_domains = G_MAXUINT;
+}
+
+/**
+ * phoc_log_hot:
+ * @domain: The hot domain
+ * @log_domain: The GLib log domain
+ * @format: The format string
+ * @...: The arguments
+ *
+ * Logs a hot message. Use [func@debug_hot] instead which skips
+ * disabled domains before formatting anything.
+ */
+void
+phoc_log_hot (PhocLogHotDomain domain, const char *log_domain, const char *format, ...)
+{
+  va_list args;
+
+  if (ring) {
+    PhocLogRingEntry *entry = &ring[ring_next];
+
+    entry->time_us = g_get_monotonic_time ();
+    entry->domain = domain;
+    va_start (args, format);
+    g_vsnprintf (entry->msg, sizeof (entry->msg), format, args);
+    va_end (args);
+
+    ring_next = (ring_next + 1) % PHOC_LOG_RING_SIZE;
+    ring_len = MIN (ring_len + 1, PHOC_LOG_RING_SIZE);
+  }
+
+  if (debug_domains & domain) {
+    va_start (args, format);
+    g_logv (log_domain, G_LOG_LEVEL_DEBUG, format, args);
+    va_end (args);
+  }
+}
+
+/**
+ * phoc_log_ring_dump:
+ * @fd: The file descriptor to write to
+ *
+ * Writes the log ring's messages oldest first to @fd, one per line
+ * prefixed by their monotonic timestamp in microseconds. This doesn't
+ * allocate so it can be used from a signal handler.
+ */
+void
+phoc_log_ring_dump (int fd)
+{
+  guint start;
+
+  if (!ring)
+    return;
+
+  start = (ring_next + PHOC_LOG_RING_SIZE - ring_len) % PHOC_LOG_RING_SIZE;
+  for (guint i = 0; i < ring_len; i++) {
+    PhocLogRingEntry *entry = &ring[(start + i) % PHOC_LOG_RING_SIZE];
+
+    write_uint (fd, entry->time_us);
+    write_str (fd, " ");
+    write_str (fd, entry->msg);
+    write_str (fd, "\n");
+  }
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "phoc-config.h"
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PhocLogHotDomain:
+ * @PHOC_LOG_HOT_NONE: No domain
+ * @PHOC_LOG_HOT_INPUT: Per event input handling (`phoc-seat`, `phoc-cursor`)
+ * @PHOC_LOG_HOT_LAYERS: Layer surface arrangement (`phoc-output`)
+ *
+ * Groups of debug messages emitted on hot paths.
+ */
+typedef enum {
+  PHOC_LOG_HOT_NONE   = 0,
+  PHOC_LOG_HOT_INPUT  = 1 << 0,
+  PHOC_LOG_HOT_LAYERS = 1 << 1,
+} PhocLogHotDomain;
+
+extern guint phoc_log_hot_domains;
+
+#ifdef PHOC_ENABLE_HOT_DEBUG
+/**
+ * phoc_debug_hot:
+ * @domain: The [enum@LogHotDomain] the message belongs to
+ * @...: The format string and arguments
+ *
+ * Like `g_debug()` but for messages on hot paths. Whether @domain is
+ * enabled is checked before any arguments get evaluated or
+ * formatted.
+ */
+#define phoc_debug_hot(domain, ...)                             \
+  G_STMT_START {                                                \
+    if (G_UNLIKELY (phoc_log_hot_domains & (domain)))           \
+      phoc_log_hot ((domain), G_LOG_DOMAIN, __VA_ARGS__);       \
+  } G_STMT_END
+#else
+#define phoc_debug_hot(domain, ...)                             \
+  G_STMT_START {                                                \
+    if (0)                                                      \
+      phoc_log_hot ((domain), G_LOG_DOMAIN, __VA_ARGS__);       \
+  } G_STMT_END
+#endif
+
+void                    phoc_log_init                (gboolean          ring);
+void                    phoc_log_hot                 (PhocLogHotDomain  domain,
+                                                      const char       *log_domain,
+                                                      const char       *format,
+                                                      ...) G_GNUC_PRINTF (3, 4);
+void                    phoc_log_ring_dump           (int               fd);
+
+G_END_DECLS
@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-magnifier"
+
+#include "phoc-config.h"
+
+#include "magnifier.h"
+
+#include <drm_fourcc.h>
+#include <float.h>
+#include <math.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_damage_ring.h>
+#include <wlr/util/box.h>
+#include <wlr/util/region.h>
+
+/**
+ * PhocMagnifier:
+ *
+ * Zooms into an output for accessibility. The output is rendered at
+ * its normal size into an offscreen buffer and the zoomed in part of
+ * that buffer is then drawn onto the output.
+ *
+ * As the offscreen buffer persists only the frame's damage gets
+ * rendered into it. The damage is then mapped to the zoomed in part
+ * and tracked in a damage ring of its own so only that gets redrawn
+ * on the output. Rendering cost thus follows the damage rather than
+ * the zoom level.
+ *
+ * The zoomed in part is placed so the focus point stays at its
+ * unzoomed position (like proportional mouse tracking in other
+ * magnifiers) so the pointer keeps hitting what's shown below it.
+ */
+struct _PhocMagnifier {
+  PhocOutput             *output;
+
+  double                  zoom;
+  /* In output local layout coordinates */
+  double                  focus_x, focus_y;
+
+  struct wlr_buffer      *buffer;
+  struct wlr_texture     *texture;
+  /* Whether the buffer has the whole output's content */
+  gboolean                valid;
+
+  /* In untransformed output buffer coordinates, like the output's */
+  struct wlr_damage_ring  damage_ring;
+};
+
+
+static struct wlr_buffer *
+create_buffer (PhocMagnifier *self, int width, int height)
+{
+  struct wlr_drm_format_set fmt_set = {};
+  const struct wlr_drm_format *fmt;
+  struct wlr_buffer *buffer;
+
+  wlr_drm_format_set_add (&fmt_set, DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_INVALID);
+  fmt = wlr_drm_format_set_get (&fmt_set, DRM_FORMAT_XRGB8888);
+
+  buffer = wlr_allocator_create_buffer (self->output->wlr_output->allocator, width, height, fmt);
+  wlr_drm_format_set_finish (&fmt_set);
+
+  return buffer;
+}
+
+
+static void
+clear_buffer (PhocMagnifier *self)
+{
+  g_clear_pointer (&self->texture, wlr_texture_destroy);
+  g_clear_pointer (&self->buffer, wlr_buffer_drop);
+  self->valid = FALSE;
+}
+
+/*
+ * The zoomed in part of the output in untransformed output buffer
+ * coordinates.
+ */
+static void
+get_source_box (PhocMagnifier *self, struct wlr_fbox *box)
+{
+  struct wlr_output *wlr_output = self->output->wlr_output;
+  double fx, fy;
+  int width, height;
+
+  wlr_output_transformed_resolution (wlr_output, &width, &height);
+
+  fx = CLAMP (self->focus_x * wlr_output->scale, 0, width);
+  fy = CLAMP (self->focus_y * wlr_output->scale, 0, height);
+
+  *box = (struct wlr_fbox) {
+    .x = fx * (1.0 - 1.0 / self->zoom),
+    .y = fy * (1.0 - 1.0 / self->zoom),
+    .width = width / self->zoom,
+    .height = height / self->zoom,
+  };
+}
+
+
+static void
+redraw (PhocMagnifier *self)
+{
+  wlr_damage_ring_add_whole (&self->damage_ring);
+  wlr_output_update_needs_frame (self->output->wlr_output);
+}
+
+
+PhocMagnifier *
+phoc_magnifier_new (PhocOutput *output)
+{
+  PhocMagnifier *self = g_new0 (PhocMagnifier, 1);
+
+  self->output = output;
+  self->zoom = 1.0;
+  wlr_damage_ring_init (&self->damage_ring);
+
+  return self;
+}
+
+
+void
+phoc_magnifier_free (PhocMagnifier *self)
+{
+  clear_buffer (self);
+  wlr_damage_ring_finish (&self->damage_ring);
+  g_free (self);
+}
+
+/**
+ * phoc_magnifier_set_zoom:
+ * @self: The magnifier
+ * @zoom: The zoom level
+ *
+ * Sets the zoom level. A level of `1.0` turns the magnifier off and
+ * frees its buffer.
+ */
+void
+phoc_magnifier_set_zoom (PhocMagnifier *self, double zoom)
+{
+  zoom = CLAMP (zoom, 1.0, PHOC_MAGNIFIER_MAX_ZOOM);
+
+  if (G_APPROX_VALUE (self->zoom, zoom, DBL_EPSILON))
+    return;
+
+  self->zoom = zoom;
+  if (!phoc_magnifier_is_active (self)) {
+    clear_buffer (self);
+    /* The output's buffers show zoomed in content */
+    phoc_output_damage_whole (self->output);
+    return;
+  }
+
+  redraw (self);
+}
+
+
+double
+phoc_magnifier_get_zoom (PhocMagnifier *self)
+{
+  return self->zoom;
+}
+
+/**
+ * phoc_magnifier_set_focus:
+ * @self: The magnifier
+ * @x: The x coordinate in output local layout coordinates
+ * @y: The y coordinate in output local layout coordinates
+ *
+ * Sets the point the magnifier zooms into, e.g. the pointer's position.
+ */
+void
+phoc_magnifier_set_focus (PhocMagnifier *self, double x, double y)
+{
+  if (self->focus_x == x && self->focus_y == y)
+    return;
+
+  self->focus_x = x;
+  self->focus_y = y;
+
+  if (phoc_magnifier_is_active (self))
+    redraw (self);
+}
+
+
+gboolean
+phoc_magnifier_is_active (PhocMagnifier *self)
+{
+  return self->zoom > 1.0;
+}
+
+/**
+ * phoc_magnifier_map_point:
+ * @self: The magnifier
+ * @x: (inout): The x coordinate in output local layout coordinates
+ * @y: (inout): The y coordinate in output local layout coordinates
+ *
+ * Maps a point on the zoomed in output (e.g. where the user touched)
+ * to the point of the output's content that is shown there. Does
+ * nothing if the magnifier isn't active.
+ */
+void
+phoc_magnifier_map_point (PhocMagnifier *self, double *x, double *y)
+{
+  double scale = self->output->wlr_output->scale;
+  struct wlr_fbox src;
+
+  if (!phoc_magnifier_is_active (self))
+    return;
+
+  get_source_box (self, &src);
+  *x = (src.x + *x * scale / self->zoom) / scale;
+  *y = (src.y + *y * scale / self->zoom) / scale;
+}
+
+/**
+ * phoc_magnifier_needs_frame:
+ * @self: The magnifier
+ *
+ * Returns: %TRUE if the zoomed in part needs to be redrawn even if the
+ *   output's content didn't change
+ */
+gboolean
+phoc_magnifier_needs_frame (PhocMagnifier *self)
+{
+  return phoc_magnifier_is_active (self) && pixman_region32_not_empty (&self->damage_ring.current);
+}
+
+/**
+ * phoc_magnifier_begin:
+ * @self: The magnifier
+ * @frame_damage: The output's damage since the last frame
+ * @damage: (out caller-allocates): The damage to render
+ * @pass: (out)(transfer none)(nullable): The render pass
+ *
+ * Starts rendering the output's content into the offscreen
+ * buffer. @pass is %NULL if there's no damage to render.
+ *
+ * Returns: %FALSE if the offscreen buffer couldn't be set up
+ */
+gboolean
+phoc_magnifier_begin (PhocMagnifier            *self,
+                      const pixman_region32_t  *frame_damage,
+                      pixman_region32_t        *damage,
+                      struct wlr_render_pass  **pass)
+{
+  struct wlr_output *wlr_output = self->output->wlr_output;
+  int width, height;
+
+  *pass = NULL;
+
+  wlr_output_transformed_resolution (wlr_output, &width, &height);
+  wlr_damage_ring_set_bounds (&self->damage_ring, width, height);
+
+  if (self->buffer && (self->buffer->width != wlr_output->width ||
+                       self->buffer->height != wlr_output->height)) {
+    clear_buffer (self);
+  }
+
+  if (!self->buffer) {
+    self->buffer = create_buffer (self, wlr_output->width, wlr_output->height);
+    if (!self->buffer) {
+      g_warning_once ("Failed to allocate %dx%d buffer for magnifier",
+                      wlr_output->width, wlr_output->height);
+      return FALSE;
+    }
+  }
+
+  if (!self->texture) {
+    self->texture = wlr_texture_from_buffer (wlr_output->renderer, self->buffer);
+    if (!self->texture)
+      return FALSE;
+  }
+
+  pixman_region32_copy (damage, frame_damage);
+  if (!self->valid)
+    pixman_region32_union_rect (damage, damage, 0, 0, width, height);
+
+  if (!pixman_region32_not_empty (damage))
+    return TRUE;
+
+  *pass = wlr_renderer_begin_buffer_pass (wlr_output->renderer, self->buffer, NULL);
+  return !!*pass;
+}
+
+/**
+ * phoc_magnifier_end:
+ * @self: The magnifier
+ * @pass: The render pass returned by [method@Magnifier.begin]
+ * @damage: The rendered damage
+ *
+ * Submits the render pass and damages the zoomed in part showing
+ * @damage.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+phoc_magnifier_end (PhocMagnifier           *self,
+                    struct wlr_render_pass  *pass,
+                    const pixman_region32_t *damage)
+{
+  const pixman_box32_t *rects;
+  pixman_region32_t zoomed;
+  struct wlr_fbox src;
+  int nrects;
+
+  if (!wlr_render_pass_submit (pass)) {
+    self->valid = FALSE;
+    return FALSE;
+  }
+  self->valid = TRUE;
+
+  get_source_box (self, &src);
+
+  /* Grow by a pixel as filtering blends in the neighbours */
+  pixman_region32_init (&zoomed);
+  rects = pixman_region32_rectangles ((pixman_region32_t *)damage, &nrects);
+  for (int i = 0; i < nrects; i++) {
+    int x1 = floor ((rects[i].x1 - src.x) * self->zoom) - 1;
+    int y1 = floor ((rects[i].y1 - src.y) * self->zoom) - 1;
+    int x2 = ceil ((rects[i].x2 - src.x) * self->zoom) + 1;
+    int y2 = ceil ((rects[i].y2 - src.y) * self->zoom) + 1;
+
+    pixman_region32_union_rect (&zoomed, &zoomed, x1, y1, x2 - x1, y2 - y1);
+  }
+  wlr_damage_ring_add (&self->damage_ring, &zoomed);
+  pixman_region32_fini (&zoomed);
+
+  return TRUE;
+}
+
+/**
+ * phoc_magnifier_render:
+ * @self: The magnifier
+ * @pass: The output's render pass
+ * @buffer_age: The age of the output's buffer
+ *
+ * Draws the damaged part of the zoomed in content onto the output's
+ * buffer.
+ */
+void
+phoc_magnifier_render (PhocMagnifier *self, struct wlr_render_pass *pass, int buffer_age)
+{
+  struct wlr_output *wlr_output = self->output->wlr_output;
+  pixman_region32_t damage;
+  struct wlr_fbox src;
+  int width, height;
+
+  if (!self->texture || !self->valid)
+    return;
+
+  pixman_region32_init (&damage);
+  wlr_damage_ring_get_buffer_damage (&self->damage_ring, buffer_age, &damage);
+  if (!pixman_region32_not_empty (&damage))
+    goto out;
+
+  phoc_output_transform_damage (self->output, &damage);
+
+  wlr_output_transformed_resolution (wlr_output, &width, &height);
+  get_source_box (self, &src);
+  wlr_fbox_transform (&src, &src, wlr_output_transform_invert (wlr_output->transform),
+                      width, height);
+
+  wlr_render_pass_add_texture (pass, &(struct wlr_render_texture_options) {
+      .texture = self->texture,
+      .src_box = src,
+      .dst_box = { .width = wlr_output->width, .height = wlr_output->height },
+      .clip = &damage,
+      .filter_mode = phoc_output_get_texture_filter_mode (self->output),
+      .blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+    });
+
+ out:
+  pixman_region32_fini (&damage);
+}
+
+/**
+ * phoc_magnifier_get_frame_damage:
+ * @self: The magnifier
+ * @frame_damage: (out caller-allocates): The damage in output buffer coordinates
+ *
+ * Gets the part of the output's buffer that changes with this frame.
+ */
+void
+phoc_magnifier_get_frame_damage (PhocMagnifier *self, pixman_region32_t *frame_damage)
+{
+  pixman_region32_copy (frame_damage, &self->damage_ring.current);
+  phoc_output_transform_damage (self->output, frame_damage);
+}
+
+/**
+ * phoc_magnifier_rotate:
+ * @self: The magnifier
+ *
+ * Rotates the damage once the frame got committed.
+ */
+void
+phoc_magnifier_rotate (PhocMagnifier *self)
+{
+  wlr_damage_ring_rotate (&self->damage_ring);
+}
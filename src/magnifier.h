@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "output.h"
+
+#include <glib.h>
+#include <pixman.h>
+#include <wlr/render/pass.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_MAGNIFIER_MAX_ZOOM 32.0
+
+typedef struct _PhocMagnifier PhocMagnifier;
+
+PhocMagnifier *phoc_magnifier_new              (PhocOutput               *output);
+void           phoc_magnifier_free             (PhocMagnifier            *self);
+void           phoc_magnifier_set_zoom         (PhocMagnifier            *self,
+                                                double                    zoom);
+double         phoc_magnifier_get_zoom         (PhocMagnifier            *self);
+void           phoc_magnifier_set_focus        (PhocMagnifier            *self,
+                                                double                    x,
+                                                double                    y);
+gboolean       phoc_magnifier_is_active        (PhocMagnifier            *self);
+void           phoc_magnifier_map_point        (PhocMagnifier            *self,
+                                                double                   *x,
+                                                double                   *y);
+gboolean       phoc_magnifier_needs_frame      (PhocMagnifier            *self);
+gboolean       phoc_magnifier_begin            (PhocMagnifier            *self,
+                                                const pixman_region32_t  *frame_damage,
+                                                pixman_region32_t        *damage,
+                                                struct wlr_render_pass  **pass);
+gboolean       phoc_magnifier_end              (PhocMagnifier            *self,
+                                                struct wlr_render_pass   *pass,
+                                                const pixman_region32_t  *damage);
+void           phoc_magnifier_render           (PhocMagnifier            *self,
+                                                struct wlr_render_pass   *pass,
+                                                int                       buffer_age);
+void           phoc_magnifier_get_frame_damage (PhocMagnifier            *self,
+                                                pixman_region32_t        *frame_damage);
+void           phoc_magnifier_rotate           (PhocMagnifier            *self);
+
+G_END_DECLS
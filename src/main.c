@@ -28,6 +28,7 @@
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/util/log.h>
 #include "settings.h"
+#include "log.h"
 #include "server.h"
 
 G_NORETURN static void
@@ -100,6 +101,21 @@ static GDebugKey debug_keys[] =
  { .key = "force-shell-reveal",
    .value = PHOC_SERVER_DEBUG_FLAG_FORCE_SHELL_REVEAL,
  },
+ { .key = "input-latency",
+   .value = PHOC_SERVER_DEBUG_FLAG_INPUT_LATENCY,
+ },
+ { .key = "render-list",
+   .value = PHOC_SERVER_DEBUG_FLAG_RENDER_LIST,
+ },
+ { .key = "log-ring",
+   .value = PHOC_SERVER_DEBUG_FLAG_LOG_RING,
+ },
+ { .key = "damage-heatmap",
+   .value = PHOC_SERVER_DEBUG_FLAG_DAMAGE_HEATMAP,
+ },
+ { .key = "timeline",
+   .value = PHOC_SERVER_DEBUG_FLAG_TIMELINE,
+ },
 };
 
 
@@ -167,6 +183,7 @@ main(int argc, char **argv)
   bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);
 
   debug_flags = parse_debug_env ();
+  phoc_log_init (debug_flags & PHOC_SERVER_DEBUG_FLAG_LOG_RING);
   wlr_log_init(WLR_DEBUG, log_glib);
   server = phoc_server_get_default ();
   if (server == NULL) {
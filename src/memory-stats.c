@@ -0,0 +1,546 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-memory-stats"
+
+#include "phoc-config.h"
+
+#include "cursor.h"
+#include "memory-stats.h"
+#include "phosh-private.h"
+#include "seat.h"
+#include "server.h"
+#include "utils.h"
+
+#include <sys/types.h>
+#include <wlr/types/wlr_buffer.h>
+
+#define UPLOAD_RATE_INTERVAL_US G_USEC_PER_SEC
+
+/**
+ * PhocMemoryStats:
+ *
+ * Accounts the memory of the buffers phoc holds on behalf of clients
+ * and the textures and images it keeps itself.
+ *
+ * The size of the buffers currently attached to each client's
+ * surfaces is updated on every commit so a warning can be logged as
+ * soon as a client crosses the warning threshold. Caches are then
+ * released via [method@Desktop.release_memory]. Per view sizes as
+ * well as thumbnails, cutouts and cursor images are only collected
+ * when asked for via [method@MemoryStats.to_variant].
+ *
+ * Buffer sizes are estimated assuming 32 bits per pixel. For shm
+ * buffers this is the size of the texture phoc uploads the buffer
+ * to, for dmabufs it's the imported buffer the client can't release
+ * while phoc holds it.
+ *
+ * For shm buffers the bytes uploaded to textures are accounted as
+ * well. wlroots only uploads the buffer damage when the buffer can
+ * be applied to the existing texture so this is estimated from the
+ * damaged area.
+ */
+struct _PhocMemoryStats {
+  GObject               parent;
+
+  struct wl_listener    new_surface;
+  struct wl_list        surfaces; /* PhocMemoryStatsSurface::link */
+
+  /* wl_client → PhocMemoryStatsClient */
+  GHashTable           *clients;
+  guint64               warn_threshold;
+};
+
+G_DEFINE_TYPE (PhocMemoryStats, phoc_memory_stats, G_TYPE_OBJECT)
+
+typedef struct {
+  PhocMemoryStats    *stats;
+  struct wl_client   *wl_client;
+  struct wl_listener  destroy;
+  char               *name;
+  pid_t               pid;
+
+  guint64             size;
+  guint               n_surfaces;
+  gboolean            warned;
+
+  /* Bytes of shm buffers uploaded to textures */
+  guint64             uploaded;
+  guint64             upload_rate;
+  guint64             interval_uploaded;
+  gint64              interval_start_us;
+} PhocMemoryStatsClient;
+
+typedef struct {
+  PhocMemoryStats    *stats;
+  struct wl_client   *wl_client;
+  struct wl_listener  commit;
+  struct wl_listener  destroy;
+  struct wl_list      link;
+
+  guint64             size;
+} PhocMemoryStatsSurface;
+
+
+static guint64
+get_surface_size (struct wlr_surface *surface)
+{
+  struct wlr_client_buffer *buffer = surface->buffer;
+
+  if (!buffer)
+    return 0;
+
+  /* The buffer's format isn't known here so assume 32 bits per pixel */
+  return (guint64)buffer->base.width * buffer->base.height * 4;
+}
+
+
+static guint64
+get_uploaded_size (struct wlr_surface *surface)
+{
+  struct wlr_client_buffer *buffer = surface->buffer;
+  struct wlr_shm_attributes attribs;
+  pixman_box32_t *rects;
+  guint64 area = 0;
+  int n_rects;
+
+  if (!buffer || !(surface->current.committed & WLR_SURFACE_STATE_BUFFER))
+    return 0;
+
+  /* Only shm buffers get copied, dmabufs are imported */
+  if (!buffer->source || !wlr_buffer_get_shm (buffer->source, &attribs))
+    return 0;
+
+  rects = pixman_region32_rectangles (&surface->buffer_damage, &n_rects);
+  for (int i = 0; i < n_rects; i++)
+    area += (guint64)(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+
+  return attribs.width ? area * (attribs.stride / attribs.width) : 0;
+}
+
+
+static void
+update_upload_rate (PhocMemoryStatsClient *client, guint64 uploaded)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 elapsed_us = now - client->interval_start_us;
+
+  client->uploaded += uploaded;
+  client->interval_uploaded += uploaded;
+
+  if (elapsed_us < UPLOAD_RATE_INTERVAL_US)
+    return;
+
+  /* A client that stopped committing for several intervals is idle */
+  if (elapsed_us > 2 * UPLOAD_RATE_INTERVAL_US)
+    client->upload_rate = 0;
+  else
+    client->upload_rate = client->interval_uploaded * G_USEC_PER_SEC / elapsed_us;
+
+  client->interval_uploaded = 0;
+  client->interval_start_us = now;
+}
+
+
+static void
+check_warn_threshold (PhocMemoryStats *self, PhocMemoryStatsClient *client)
+{
+  if (!self->warn_threshold || client->size <= self->warn_threshold) {
+    client->warned = FALSE;
+    return;
+  }
+
+  if (client->warned)
+    return;
+
+  g_warning ("Client '%s' (%d) holds %" G_GUINT64_FORMAT " KiB of buffers, "
+             "threshold is %" G_GUINT64_FORMAT " KiB",
+             client->name, client->pid, client->size / 1024, self->warn_threshold / 1024);
+  client->warned = TRUE;
+
+  phoc_desktop_release_memory (phoc_server_get_desktop (phoc_server_get_default ()));
+}
+
+
+static void
+handle_client_destroy (struct wl_listener *listener, void *data)
+{
+  PhocMemoryStatsClient *client = wl_container_of (listener, client, destroy);
+
+  /* The client's surfaces are destroyed afterwards and won't find it anymore */
+  g_hash_table_remove (client->stats->clients, client->wl_client);
+}
+
+
+static void
+phoc_memory_stats_client_free (PhocMemoryStatsClient *client)
+{
+  wl_list_remove (&client->destroy.link);
+  g_free (client->name);
+  g_free (client);
+}
+
+
+static PhocMemoryStatsClient *
+get_client (PhocMemoryStats *self, struct wl_client *wl_client)
+{
+  PhocMemoryStatsClient *client;
+
+  client = g_hash_table_lookup (self->clients, wl_client);
+  if (client)
+    return client;
+
+  client = g_new0 (PhocMemoryStatsClient, 1);
+  client->stats = self;
+  client->wl_client = wl_client;
+  client->name = phoc_utils_get_client_name (wl_client);
+  client->interval_start_us = g_get_monotonic_time ();
+  wl_client_get_credentials (wl_client, &client->pid, NULL, NULL);
+
+  client->destroy.notify = handle_client_destroy;
+  wl_client_add_destroy_listener (wl_client, &client->destroy);
+
+  g_hash_table_insert (self->clients, wl_client, client);
+  return client;
+}
+
+
+static void
+handle_surface_commit (struct wl_listener *listener, void *data)
+{
+  PhocMemoryStatsSurface *stats_surface = wl_container_of (listener, stats_surface, commit);
+  PhocMemoryStats *self = stats_surface->stats;
+  struct wlr_surface *surface = data;
+  PhocMemoryStatsClient *client;
+  guint64 size, uploaded;
+
+  size = get_surface_size (surface);
+  uploaded = get_uploaded_size (surface);
+  if (size == stats_surface->size && !uploaded)
+    return;
+
+  client = g_hash_table_lookup (self->clients, stats_surface->wl_client);
+  if (client) {
+    if (uploaded)
+      update_upload_rate (client, uploaded);
+
+    if (size != stats_surface->size) {
+      client->size = client->size - stats_surface->size + size;
+      check_warn_threshold (self, client);
+    }
+  }
+  stats_surface->size = size;
+}
+
+
+static void
+phoc_memory_stats_surface_free (PhocMemoryStatsSurface *stats_surface)
+{
+  wl_list_remove (&stats_surface->commit.link);
+  wl_list_remove (&stats_surface->destroy.link);
+  wl_list_remove (&stats_surface->link);
+  g_free (stats_surface);
+}
+
+
+static void
+handle_surface_destroy (struct wl_listener *listener, void *data)
+{
+  PhocMemoryStatsSurface *stats_surface = wl_container_of (listener, stats_surface, destroy);
+  PhocMemoryStats *self = stats_surface->stats;
+  PhocMemoryStatsClient *client;
+
+  client = g_hash_table_lookup (self->clients, stats_surface->wl_client);
+  if (client) {
+    client->size -= stats_surface->size;
+    client->n_surfaces--;
+    check_warn_threshold (self, client);
+  }
+
+  phoc_memory_stats_surface_free (stats_surface);
+}
+
+
+static void
+handle_new_surface (struct wl_listener *listener, void *data)
+{
+  PhocMemoryStats *self = wl_container_of (listener, self, new_surface);
+  struct wlr_surface *surface = data;
+  PhocMemoryStatsSurface *stats_surface = g_new0 (PhocMemoryStatsSurface, 1);
+  PhocMemoryStatsClient *client;
+
+  stats_surface->stats = self;
+  stats_surface->wl_client = wl_resource_get_client (surface->resource);
+
+  client = get_client (self, stats_surface->wl_client);
+  client->n_surfaces++;
+
+  stats_surface->commit.notify = handle_surface_commit;
+  wl_signal_add (&surface->events.commit, &stats_surface->commit);
+
+  stats_surface->destroy.notify = handle_surface_destroy;
+  wl_signal_add (&surface->events.destroy, &stats_surface->destroy);
+
+  wl_list_insert (&self->surfaces, &stats_surface->link);
+}
+
+
+static void
+add_surface_size (struct wlr_surface *surface, int sx, int sy, void *data)
+{
+  guint64 *size = data;
+
+  *size += get_surface_size (surface);
+}
+
+
+static GVariant *
+views_to_variant (guint64 *thumbnails)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+
+  for (GList *l = phoc_desktop_get_views (desktop)->head; l; l = l->next) {
+    PhocView *view = PHOC_VIEW (l->data);
+    guint64 size = 0, thumbnail;
+    pid_t pid;
+
+    if (!phoc_view_is_mapped (view))
+      continue;
+
+    phoc_view_for_each_surface (view, add_surface_size, &size);
+    thumbnail = phoc_phosh_private_get_thumbnail_size (view);
+    *thumbnails += thumbnail;
+    wl_client_get_credentials (wl_resource_get_client (view->wlr_surface->resource),
+                               &pid, NULL, NULL);
+
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_builder_add (&builder, "{sv}", "app-id",
+                           g_variant_new_string (phoc_view_get_app_id (view) ?: ""));
+    g_variant_builder_add (&builder, "{sv}", "pid", g_variant_new_int32 (pid));
+    g_variant_builder_add (&builder, "{sv}", "buffers", g_variant_new_uint64 (size));
+    g_variant_builder_add (&builder, "{sv}", "thumbnail", g_variant_new_uint64 (thumbnail));
+    g_variant_builder_close (&builder);
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+
+static guint64
+get_cursors_size (void)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  guint64 size = 0;
+
+  for (GSList *l = phoc_input_get_seats (phoc_server_get_input (server)); l; l = l->next) {
+    PhocSeat *seat = PHOC_SEAT (l->data);
+
+    size += phoc_cursor_get_xcursor_size (phoc_seat_get_cursor (seat));
+  }
+
+#ifdef PHOC_XWAYLAND
+  /* XWayland's default cursor */
+  size += phoc_utils_xcursor_manager_get_size (desktop->xcursor_manager);
+#endif
+
+  return size;
+}
+
+
+static guint64
+get_cutouts_size (void)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocOutput *output;
+  guint64 size = 0;
+
+  wl_list_for_each (output, &desktop->outputs, link)
+    size += phoc_output_get_cutouts_size (output);
+
+  return size;
+}
+
+
+static void
+phoc_memory_stats_finalize (GObject *object)
+{
+  PhocMemoryStats *self = PHOC_MEMORY_STATS (object);
+  PhocMemoryStatsSurface *stats_surface, *tmp;
+
+  wl_list_remove (&self->new_surface.link);
+  wl_list_for_each_safe (stats_surface, tmp, &self->surfaces, link)
+    phoc_memory_stats_surface_free (stats_surface);
+  g_clear_pointer (&self->clients, g_hash_table_destroy);
+
+  G_OBJECT_CLASS (phoc_memory_stats_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_memory_stats_class_init (PhocMemoryStatsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_memory_stats_finalize;
+}
+
+
+static void
+phoc_memory_stats_init (PhocMemoryStats *self)
+{
+  wl_list_init (&self->surfaces);
+  self->clients = g_hash_table_new_full (g_direct_hash,
+                                         g_direct_equal,
+                                         NULL,
+                                         (GDestroyNotify)phoc_memory_stats_client_free);
+}
+
+/**
+ * phoc_memory_stats_new:
+ * @compositor: The compositor whose surfaces to track
+ * @warn_threshold: The warning threshold in bytes, `0` to disable
+ *
+ * Returns: (transfer full): A new memory accounting object
+ */
+PhocMemoryStats *
+phoc_memory_stats_new (struct wlr_compositor *compositor, guint64 warn_threshold)
+{
+  PhocMemoryStats *self = g_object_new (PHOC_TYPE_MEMORY_STATS, NULL);
+
+  self->warn_threshold = warn_threshold;
+  self->new_surface.notify = handle_new_surface;
+  wl_signal_add (&compositor->events.new_surface, &self->new_surface);
+
+  return self;
+}
+
+/**
+ * phoc_memory_stats_get_warn_threshold:
+ * @self: The memory accounting object
+ *
+ * Returns: The warning threshold in bytes, `0` if disabled
+ */
+guint64
+phoc_memory_stats_get_warn_threshold (PhocMemoryStats *self)
+{
+  g_assert (PHOC_IS_MEMORY_STATS (self));
+
+  return self->warn_threshold;
+}
+
+/**
+ * phoc_memory_stats_set_warn_threshold:
+ * @self: The memory accounting object
+ * @warn_threshold: The warning threshold in bytes, `0` to disable
+ *
+ * A warning is logged when a client's buffers exceed the threshold.
+ * It's logged again once the client went below the threshold and
+ * exceeds it again.
+ */
+void
+phoc_memory_stats_set_warn_threshold (PhocMemoryStats *self, guint64 warn_threshold)
+{
+  GHashTableIter iter;
+  PhocMemoryStatsClient *client;
+
+  g_assert (PHOC_IS_MEMORY_STATS (self));
+
+  self->warn_threshold = warn_threshold;
+
+  g_hash_table_iter_init (&iter, self->clients);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&client))
+    check_warn_threshold (self, client);
+}
+
+/**
+ * phoc_memory_stats_get_client_size:
+ * @self: The memory accounting object
+ * @wl_client: The client
+ *
+ * Get the estimated size of the buffers attached to all of
+ * @wl_client's surfaces.
+ *
+ * Returns: The size in bytes
+ */
+guint64
+phoc_memory_stats_get_client_size (PhocMemoryStats *self, struct wl_client *wl_client)
+{
+  PhocMemoryStatsClient *client;
+
+  g_assert (PHOC_IS_MEMORY_STATS (self));
+
+  client = g_hash_table_lookup (self->clients, wl_client);
+  return client ? client->size : 0;
+}
+
+/**
+ * phoc_memory_stats_to_variant:
+ * @self: The memory accounting object
+ *
+ * Collects the current memory usage. All sizes are in bytes. The
+ * dictionary has these keys:
+ *
+ * - `clients` (`aa{sv}`): `name`, `pid`, `surfaces` and `buffers` of each
+ *   client as well as `uploaded`, the bytes of shm buffers uploaded to
+ *   textures, and `upload-rate` in bytes per second
+ * - `views` (`aa{sv}`): `app-id`, `pid`, `buffers` and `thumbnail` of each mapped view
+ * - `cursors` (`t`): The loaded cursor theme images
+ * - `cutouts` (`t`): The cutouts overlay textures
+ * - `total` (`t`): The sum of the buffers, thumbnails, cursors and cutouts
+ * - `warn-threshold` (`t`): The per client warning threshold
+ *
+ * Returns:(transfer floating): The memory usage as `a{sv}`
+ */
+GVariant *
+phoc_memory_stats_to_variant (PhocMemoryStats *self)
+{
+  GVariantBuilder builder, clients;
+  PhocMemoryStatsClient *client;
+  GHashTableIter iter;
+  guint64 total = 0, thumbnails = 0, cursors, cutouts;
+  gint64 now = g_get_monotonic_time ();
+  GVariant *views;
+
+  g_assert (PHOC_IS_MEMORY_STATS (self));
+
+  g_variant_builder_init (&clients, G_VARIANT_TYPE ("aa{sv}"));
+  g_hash_table_iter_init (&iter, self->clients);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&client)) {
+    g_variant_builder_open (&clients, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_builder_add (&clients, "{sv}", "name", g_variant_new_string (client->name));
+    g_variant_builder_add (&clients, "{sv}", "pid", g_variant_new_int32 (client->pid));
+    g_variant_builder_add (&clients, "{sv}", "surfaces", g_variant_new_uint32 (client->n_surfaces));
+    g_variant_builder_add (&clients, "{sv}", "buffers", g_variant_new_uint64 (client->size));
+    g_variant_builder_add (&clients, "{sv}", "uploaded", g_variant_new_uint64 (client->uploaded));
+    /* The rate is only updated on commit so drop it for idle clients */
+    g_variant_builder_add (&clients, "{sv}", "upload-rate",
+                           g_variant_new_uint64 (now - client->interval_start_us >
+                                                 2 * UPLOAD_RATE_INTERVAL_US ?
+                                                 0 : client->upload_rate));
+    g_variant_builder_close (&clients);
+    total += client->size;
+  }
+
+  views = views_to_variant (&thumbnails);
+  cursors = get_cursors_size ();
+  cutouts = get_cutouts_size ();
+  total += thumbnails + cursors + cutouts;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&builder, "{sv}", "clients", g_variant_builder_end (&clients));
+  g_variant_builder_add (&builder, "{sv}", "views", views);
+  g_variant_builder_add (&builder, "{sv}", "cursors", g_variant_new_uint64 (cursors));
+  g_variant_builder_add (&builder, "{sv}", "cutouts", g_variant_new_uint64 (cutouts));
+  g_variant_builder_add (&builder, "{sv}", "total", g_variant_new_uint64 (total));
+  g_variant_builder_add (&builder, "{sv}", "warn-threshold",
+                         g_variant_new_uint64 (self->warn_threshold));
+
+  return g_variant_builder_end (&builder);
+}
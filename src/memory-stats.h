@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <wlr/types/wlr_compositor.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_MEMORY_STATS (phoc_memory_stats_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocMemoryStats, phoc_memory_stats, PHOC, MEMORY_STATS, GObject)
+
+PhocMemoryStats *phoc_memory_stats_new                  (struct wlr_compositor *compositor,
+                                                         guint64                warn_threshold);
+guint64          phoc_memory_stats_get_warn_threshold   (PhocMemoryStats       *self);
+void             phoc_memory_stats_set_warn_threshold   (PhocMemoryStats       *self,
+                                                         guint64                warn_threshold);
+guint64          phoc_memory_stats_get_client_size      (PhocMemoryStats       *self,
+                                                         struct wl_client      *wl_client);
+GVariant        *phoc_memory_stats_to_variant           (PhocMemoryStats       *self);
+
+G_END_DECLS
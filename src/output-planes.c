@@ -0,0 +1,563 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-output-planes"
+
+#include "phoc-config.h"
+#include "phoc-tracing.h"
+
+#include "desktop.h"
+#include "layer-surface.h"
+#include "output.h"
+#include "output-planes.h"
+#include "seat.h"
+#include "server.h"
+#include "utils.h"
+
+#include <string.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_output_layer.h>
+
+/**
+ * PhocOutputPlanes:
+ *
+ * Puts the topmost layer surfaces of an output onto hardware overlay
+ * planes (via `wlr_output_layer`) so the renderer only needs to
+ * composite what's below them.
+ *
+ * Candidates are taken from the top of the stacking order downwards
+ * and the search stops at the first surface that can't be put on a
+ * plane, as planes are always stacked above the composited primary
+ * buffer. Surfaces the backend rejected aren't tried again until
+ * they attach a new buffer so backends without overlay plane support
+ * don't pay for a test commit each frame.
+ *
+ * Drag icons are put onto planes as well, both when compositing and
+ * when scanning out a fullscreen view directly, so dragging something
+ * over a video doesn't force composition.
+ *
+ * The hardware cursor is handled by wlroots' cursor plane already.
+ */
+
+typedef struct {
+  struct wlr_buffer  *buffer;
+  struct wl_listener  destroy;
+} PhocRejectedBuffer;
+
+struct _PhocOutputPlanes {
+  PhocOutput                   *output; /* unowned */
+
+  struct wlr_output_layer      *layers[PHOC_OUTPUT_PLANES_MAX];
+  struct wlr_output_layer_state states[PHOC_OUTPUT_PLANES_MAX];
+  struct wlr_surface           *surfaces[PHOC_OUTPUT_PLANES_MAX];
+  guint                         n_layers;
+
+  /* Surfaces on planes in the current frame */
+  struct wlr_surface           *assigned[PHOC_OUTPUT_PLANES_MAX];
+  guint                         n_assigned;
+
+  /* Buffers the backend refused, forgotten once destroyed */
+  PhocRejectedBuffer            rejected[PHOC_OUTPUT_PLANES_MAX];
+  guint                         n_rejected;
+};
+
+typedef struct {
+  struct wlr_surface *surface;
+  struct wlr_box      box;
+  float               scale;
+  guint               n_surfaces;
+} PhocPlaneCandidate;
+
+
+PhocOutputPlanes *
+phoc_output_planes_new (PhocOutput *output)
+{
+  PhocOutputPlanes *self = g_new0 (PhocOutputPlanes, 1);
+
+  self->output = output;
+
+  return self;
+}
+
+
+static void clear_rejected (PhocOutputPlanes *self);
+
+void
+phoc_output_planes_free (PhocOutputPlanes *self)
+{
+  clear_rejected (self);
+  for (guint i = 0; i < self->n_layers; i++)
+    wlr_output_layer_destroy (self->layers[i]);
+
+  g_free (self);
+}
+
+
+static void
+candidate_iterator (PhocOutput         *output,
+                    struct wlr_surface *surface,
+                    struct wlr_box     *box,
+                    float               scale,
+                    void               *data)
+{
+  PhocPlaneCandidate *candidate = data;
+
+  if (!wlr_surface_has_buffer (surface))
+    return;
+
+  candidate->surface = surface;
+  candidate->box = *box;
+  candidate->scale = scale;
+  candidate->n_surfaces++;
+}
+
+
+static void
+on_rejected_buffer_destroy (struct wl_listener *listener, void *data)
+{
+  PhocRejectedBuffer *rejected = wl_container_of (listener, rejected, destroy);
+
+  /* Another buffer might get allocated at the same address */
+  wl_list_remove (&rejected->destroy.link);
+  rejected->buffer = NULL;
+}
+
+
+static void
+add_rejected (PhocOutputPlanes *self, struct wlr_buffer *buffer)
+{
+  PhocRejectedBuffer *rejected = &self->rejected[self->n_rejected++];
+
+  rejected->buffer = buffer;
+  rejected->destroy.notify = on_rejected_buffer_destroy;
+  wl_signal_add (&buffer->events.destroy, &rejected->destroy);
+}
+
+
+static void
+clear_rejected (PhocOutputPlanes *self)
+{
+  for (guint i = 0; i < self->n_rejected; i++) {
+    PhocRejectedBuffer *rejected = &self->rejected[i];
+
+    if (rejected->buffer) {
+      wl_list_remove (&rejected->destroy.link);
+      rejected->buffer = NULL;
+    }
+  }
+  self->n_rejected = 0;
+}
+
+
+static gboolean
+is_rejected (PhocOutputPlanes *self, struct wlr_buffer *buffer)
+{
+  for (guint i = 0; i < self->n_rejected; i++) {
+    if (self->rejected[i].buffer == buffer)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/*
+ * Check whether the surfaces collected in @candidate can be put onto
+ * a plane.
+ */
+static gboolean
+check_candidate (PhocOutputPlanes *self, PhocPlaneCandidate *candidate)
+{
+  struct wlr_output *wlr_output = self->output->wlr_output;
+
+  if (candidate->n_surfaces == 0)
+    return TRUE;
+
+  /* Popups and subsurfaces would need to go onto planes of their own */
+  if (candidate->n_surfaces > 1)
+    return FALSE;
+
+  if (candidate->scale != 1.0)
+    return FALSE;
+
+  if (candidate->surface->buffer == NULL)
+    return FALSE;
+
+  if (candidate->surface->current.transform != wlr_output->transform)
+    return FALSE;
+
+  return TRUE;
+}
+
+/*
+ * Check whether the layer surface is suitable for a plane and fill in
+ * its position.
+ */
+static gboolean
+get_candidate (PhocOutputPlanes   *self,
+               PhocLayerSurface   *layer_surface,
+               PhocPlaneCandidate *candidate)
+{
+  *candidate = (PhocPlaneCandidate) { 0 };
+
+  if (!phoc_layer_surface_get_mapped (layer_surface))
+    return TRUE;
+
+  /* Planes don't do alpha blending of the whole surface */
+  if (phoc_layer_surface_get_alpha (layer_surface) < 1.0)
+    return FALSE;
+
+  phoc_output_layer_surface_for_each_surface (self->output, layer_surface,
+                                              candidate_iterator, candidate);
+  return check_candidate (self, candidate);
+}
+
+
+/*
+ * Add the drag icons of all seats as candidates. Returns %FALSE if
+ * one can't be put on a plane so nothing below it can either.
+ */
+static gboolean
+collect_drag_icons (PhocOutputPlanes   *self,
+                    PhocPlaneCandidate  candidates[PHOC_OUTPUT_PLANES_MAX],
+                    guint              *n)
+{
+  PhocOutput *output = self->output;
+  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
+
+  for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next) {
+    PhocSeat *seat = PHOC_SEAT (elem->data);
+    PhocPlaneCandidate candidate = { 0 };
+
+    if (!phoc_drag_icon_is_mapped (seat->drag_icon))
+      continue;
+
+    phoc_output_surface_for_each_surface (output,
+                                          phoc_drag_icon_get_wlr_surface (seat->drag_icon),
+                                          phoc_drag_icon_get_x (seat->drag_icon) - output->layout_box.x,
+                                          phoc_drag_icon_get_y (seat->drag_icon) - output->layout_box.y,
+                                          candidate_iterator, &candidate);
+    if (!check_candidate (self, &candidate))
+      return FALSE;
+
+    /* Not on this output */
+    if (candidate.surface == NULL)
+      continue;
+
+    if (is_rejected (self, &candidate.surface->buffer->base))
+      return FALSE;
+
+    if (*n == PHOC_OUTPUT_PLANES_MAX)
+      return FALSE;
+
+    candidates[(*n)++] = candidate;
+  }
+
+  return TRUE;
+}
+
+/*
+ * Collect the candidates from topmost to bottommost, mirroring the
+ * stacking order the renderer uses.
+ */
+static guint
+collect_candidates (PhocOutputPlanes *self, PhocPlaneCandidate candidates[PHOC_OUTPUT_PLANES_MAX])
+{
+  PhocOutput *output = self->output;
+  enum zwlr_layer_shell_v1_layer layers[] = {
+    ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY,
+    ZWLR_LAYER_SHELL_V1_LAYER_TOP,
+  };
+  guint n = 0;
+
+  for (guint i = 0; i < G_N_ELEMENTS (layers); i++) {
+    GQueue *layer_surfaces;
+
+    if (layers[i] == ZWLR_LAYER_SHELL_V1_LAYER_TOP) {
+      /* Drag icons are rendered between the overlay and top layer */
+      if (!collect_drag_icons (self, candidates, &n))
+        return n;
+
+      /* The top layer is only rendered above fullscreen views when revealed */
+      if (output->fullscreen_view && !phoc_output_has_shell_revealed (output))
+        return n;
+    }
+
+    layer_surfaces = phoc_output_get_layer_surfaces_for_layer (output, layers[i]);
+    for (GList *l = layer_surfaces->tail; l; l = l->prev) {
+      PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (l->data);
+      PhocPlaneCandidate candidate;
+
+      if (!get_candidate (self, layer_surface, &candidate))
+        return n;
+
+      /* Nothing visible */
+      if (candidate.surface == NULL)
+        continue;
+
+      if (is_rejected (self, &candidate.surface->buffer->base))
+        return n;
+
+      candidates[n++] = candidate;
+      if (n == PHOC_OUTPUT_PLANES_MAX)
+        return n;
+    }
+  }
+
+  return n;
+}
+
+
+static gboolean
+can_use_planes (PhocOutputPlanes *self)
+{
+  /* Software cursors, debug overlays and the output shield are
+   * rendered on the primary plane on top of everything */
+  return !phoc_output_has_render_overlays (self->output);
+}
+
+
+static gboolean
+update_assigned (PhocOutputPlanes *self)
+{
+  struct wlr_surface *assigned[PHOC_OUTPUT_PLANES_MAX];
+  guint n_assigned = 0;
+  gboolean changed;
+
+  for (guint i = 0; i < self->n_layers; i++) {
+    if (self->states[i].buffer)
+      assigned[n_assigned++] = self->surfaces[i];
+  }
+
+  changed = n_assigned != self->n_assigned ||
+    memcmp (assigned, self->assigned, n_assigned * sizeof (assigned[0]));
+
+  memcpy (self->assigned, assigned, n_assigned * sizeof (assigned[0]));
+  self->n_assigned = n_assigned;
+
+  return changed;
+}
+
+
+static void
+set_layers (PhocOutputPlanes         *self,
+            PhocPlaneCandidate        candidates[PHOC_OUTPUT_PLANES_MAX],
+            guint                     n,
+            struct wlr_output_state  *pending)
+{
+  struct wlr_output *wlr_output = self->output->wlr_output;
+
+  while (self->n_layers < n) {
+    self->layers[self->n_layers] = wlr_output_layer_create (wlr_output);
+    self->n_layers++;
+  }
+
+  /* Layers are ordered bottom to top while candidates are top to bottom */
+  for (guint i = 0; i < self->n_layers; i++) {
+    struct wlr_output_layer_state *state = &self->states[i];
+
+    *state = (struct wlr_output_layer_state) { .layer = self->layers[i] };
+    self->surfaces[i] = NULL;
+
+    if (i < n) {
+      PhocPlaneCandidate *candidate = &candidates[n - i - 1];
+      struct wlr_box dst_box = candidate->box;
+
+      phoc_utils_scale_box (&dst_box, wlr_output->scale);
+      phoc_output_transform_box (self->output, &dst_box);
+
+      state->buffer = &candidate->surface->buffer->base;
+      state->dst_box = dst_box;
+      wlr_surface_get_buffer_source_box (candidate->surface, &state->src_box);
+      self->surfaces[i] = candidate->surface;
+    }
+  }
+
+  wlr_output_state_set_layers (pending, self->states, self->n_layers);
+}
+
+/*
+ * Keep the accepted surfaces from the top down to the first
+ * rejected one. Everything below has to be composited. Returns the
+ * number of accepted surfaces.
+ */
+static guint
+apply_test_result (PhocOutputPlanes *self, gboolean tested)
+{
+  gboolean stop = FALSE;
+  guint n_accepted = 0;
+
+  clear_rejected (self);
+  for (int i = self->n_layers - 1; i >= 0; i--) {
+    struct wlr_output_layer_state *state = &self->states[i];
+
+    if (state->buffer == NULL)
+      continue;
+
+    if (!tested || !state->accepted) {
+      if (!stop)
+        add_rejected (self, state->buffer);
+      stop = TRUE;
+    }
+
+    if (stop)
+      state->buffer = NULL;
+    else
+      n_accepted++;
+  }
+
+  return n_accepted;
+}
+
+/**
+ * phoc_output_planes_assign:
+ * @self: The output planes
+ * @pending: The pending output state
+ *
+ * Try to put the topmost surfaces of the output onto overlay planes
+ * and add the resulting layer configuration to @pending. Surfaces
+ * that ended up on a plane must be skipped by the renderer, see
+ * [method@OutputPlanes.has_surface].
+ *
+ * Returns: %TRUE if the set of surfaces on planes changed. In that
+ *   case the whole output needs to be repainted.
+ */
+gboolean
+phoc_output_planes_assign (PhocOutputPlanes *self, struct wlr_output_state *pending)
+{
+  struct wlr_output *wlr_output = self->output->wlr_output;
+  PhocPlaneCandidate candidates[PHOC_OUTPUT_PLANES_MAX];
+  guint n = 0, n_accepted;
+  gboolean tested;
+
+  if (can_use_planes (self))
+    n = collect_candidates (self, candidates);
+
+  if (n == 0) {
+    phoc_output_planes_clear (self, pending);
+    return update_assigned (self);
+  }
+
+  set_layers (self, candidates, n, pending);
+  tested = wlr_output_test_state (wlr_output, pending);
+  n_accepted = apply_test_result (self, tested);
+
+  DTRACE_PROBE3 (phoc, planes_assign, wlr_output->name, n, n_accepted);
+
+  return update_assigned (self);
+}
+
+/**
+ * phoc_output_planes_clear:
+ * @self: The output planes
+ * @pending: The pending output state
+ *
+ * Disable all overlay planes in @pending. This is meant for commits
+ * that don't use the composited primary buffer like direct scanout.
+ */
+void
+phoc_output_planes_clear (PhocOutputPlanes *self, struct wlr_output_state *pending)
+{
+  if (self->n_layers == 0)
+    return;
+
+  for (guint i = 0; i < self->n_layers; i++) {
+    self->states[i] = (struct wlr_output_layer_state) { .layer = self->layers[i] };
+    self->surfaces[i] = NULL;
+  }
+
+  wlr_output_state_set_layers (pending, self->states, self->n_layers);
+}
+
+
+/**
+ * phoc_output_planes_assign_drag_icons:
+ * @self: The output planes
+ * @pending: The pending output state
+ *
+ * Put the drag icons shown on the output onto overlay planes and add
+ * the resulting layer configuration to @pending. This is meant for
+ * direct scanout where nothing else is composited. The caller needs
+ * to test @pending and pass the result to
+ * [method@OutputPlanes.finish_drag_icons].
+ *
+ * Returns: %FALSE if a drag icon can't be put onto a plane
+ */
+gboolean
+phoc_output_planes_assign_drag_icons (PhocOutputPlanes *self, struct wlr_output_state *pending)
+{
+  PhocPlaneCandidate candidates[PHOC_OUTPUT_PLANES_MAX];
+  guint n = 0;
+
+  if (!collect_drag_icons (self, candidates, &n))
+    return FALSE;
+
+  if (n == 0) {
+    phoc_output_planes_clear (self, pending);
+    return TRUE;
+  }
+
+  set_layers (self, candidates, n, pending);
+  return TRUE;
+}
+
+/**
+ * phoc_output_planes_finish_drag_icons:
+ * @self: The output planes
+ * @tested: Whether the backend accepted the pending state
+ *
+ * Check whether the backend accepted all drag icons set up by
+ * [method@OutputPlanes.assign_drag_icons]. Icons the backend refused
+ * aren't tried again until they attach a new buffer. If @tested is
+ * %FALSE the primary buffer might be at fault so nothing is recorded.
+ *
+ * Returns: %TRUE if all drag icons are shown on planes
+ */
+gboolean
+phoc_output_planes_finish_drag_icons (PhocOutputPlanes *self, gboolean tested)
+{
+  guint n = 0;
+
+  if (!tested)
+    return FALSE;
+
+  for (guint i = 0; i < self->n_layers; i++) {
+    if (self->states[i].buffer)
+      n++;
+  }
+
+  if (apply_test_result (self, TRUE) != n)
+    return FALSE;
+
+  update_assigned (self);
+  return TRUE;
+}
+
+
+/**
+ * phoc_output_planes_has_surface:
+ * @self: The output planes
+ * @surface: The surface to look up
+ *
+ * Returns: %TRUE if the @surface is shown on an overlay plane in the
+ *   current frame.
+ */
+gboolean
+phoc_output_planes_has_surface (PhocOutputPlanes *self, struct wlr_surface *surface)
+{
+  for (guint i = 0; i < self->n_assigned; i++) {
+    if (self->assigned[i] == surface)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+
+guint
+phoc_output_planes_get_n_assigned (PhocOutputPlanes *self)
+{
+  return self->n_assigned;
+}
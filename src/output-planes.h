@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_output.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_OUTPUT_PLANES_MAX 3
+
+typedef struct _PhocOutput PhocOutput;
+typedef struct _PhocOutputPlanes PhocOutputPlanes;
+
+PhocOutputPlanes *phoc_output_planes_new            (PhocOutput               *output);
+void              phoc_output_planes_free           (PhocOutputPlanes         *self);
+gboolean          phoc_output_planes_assign         (PhocOutputPlanes         *self,
+                                                     struct wlr_output_state  *pending);
+void              phoc_output_planes_clear          (PhocOutputPlanes         *self,
+                                                     struct wlr_output_state  *pending);
+gboolean          phoc_output_planes_assign_drag_icons (PhocOutputPlanes         *self,
+                                                        struct wlr_output_state  *pending);
+gboolean          phoc_output_planes_finish_drag_icons (PhocOutputPlanes         *self,
+                                                        gboolean                  tested);
+gboolean          phoc_output_planes_has_surface    (PhocOutputPlanes         *self,
+                                                     struct wlr_surface       *surface);
+guint             phoc_output_planes_get_n_assigned (PhocOutputPlanes         *self);
+
+G_END_DECLS
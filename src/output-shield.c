@@ -16,7 +16,12 @@
 
 #include "render-private.h"
 
+#include <drm_fourcc.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/types/wlr_buffer.h>
+
 #define PHOC_ANIM_DURATION_SHIELD_UP 250 /* ms */
+#define PHOC_ANIM_SHIELD_UP_MAX_FPS  30
 
 enum {
   PROP_0,
@@ -32,6 +37,14 @@ static GParamSpec *props[PROP_LAST_PROP];
  * A shield that covers a whole `PhocOutput`. It can be raised (to cover
  * the whole screen) and lowered to show the screens content.
  *
+ * As the fade changes every pixel of the output the output's content
+ * is rendered once into a snapshot in the first frame after lowering
+ * started. The snapshot gets its own buffer pass before the output
+ * begins rendering its frame. While fading
+ * out only the snapshot and the shield are drawn instead of all
+ * surfaces. While the shield is fully raised nothing but the shield
+ * is drawn.
+ *
  * TODO: Use PhocColorRect to simplify
  */
 struct _PhocOutputShield {
@@ -40,7 +53,13 @@ struct _PhocOutputShield {
   float               alpha;
   PhocOutput         *output;
   PhocTimedAnimation *animation;
-  gulong              render_end_id;
+  guint               render_hook_id;
+
+  /* The output's content the shield fades out to */
+  struct wlr_buffer  *snapshot;
+  struct wlr_texture *snapshot_texture;
+  gboolean            snapshot_pending;
+  gboolean            capturing;
 };
 
 static void phoc_output_shield_animatable_interface_init (PhocAnimatableInterface *iface);
@@ -138,24 +157,111 @@ phoc_output_shield_get_property (GObject    *object,
 }
 
 
+static void
+clear_snapshot (PhocOutputShield *self)
+{
+  g_clear_pointer (&self->snapshot_texture, wlr_texture_destroy);
+  g_clear_pointer (&self->snapshot, wlr_buffer_drop);
+  self->snapshot_pending = FALSE;
+}
+
+
+static struct wlr_buffer *
+create_buffer (struct wlr_allocator *wlr_allocator, int width, int height)
+{
+  struct wlr_drm_format_set fmt_set = {};
+  const struct wlr_drm_format *fmt;
+  struct wlr_buffer *buffer;
+
+  wlr_drm_format_set_add (&fmt_set, DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_INVALID);
+  fmt = wlr_drm_format_set_get (&fmt_set, DRM_FORMAT_ARGB8888);
+
+  buffer = wlr_allocator_create_buffer (wlr_allocator, width, height, fmt);
+  wlr_drm_format_set_finish (&fmt_set);
+
+  return buffer;
+}
+
+
+static void
+take_snapshot (PhocOutputShield *self)
+{
+  PhocRenderer *renderer = phoc_server_get_renderer (phoc_server_get_default ());
+  struct wlr_renderer *wlr_renderer = phoc_renderer_get_wlr_renderer (renderer);
+  struct wlr_output *wlr_output = self->output->wlr_output;
+  struct wlr_render_pass *render_pass;
+  PhocRenderContext ctx;
+  pixman_region32_t damage;
+
+  clear_snapshot (self);
+
+  if (!wlr_output->enabled)
+    return;
+
+  self->snapshot = create_buffer (phoc_renderer_get_wlr_allocator (renderer),
+                                  wlr_output->width, wlr_output->height);
+  if (!self->snapshot) {
+    g_warning_once ("Failed to allocate shield snapshot for %s", wlr_output->name);
+    return;
+  }
+
+  render_pass = wlr_renderer_begin_buffer_pass (wlr_renderer, self->snapshot, NULL);
+  if (!render_pass) {
+    clear_snapshot (self);
+    return;
+  }
+
+  pixman_region32_init_rect (&damage, 0, 0, wlr_output->width, wlr_output->height);
+  ctx = (PhocRenderContext) {
+    .output = self->output,
+    .damage = &damage,
+    .alpha = 1.0,
+    .render_pass = render_pass,
+  };
+
+  /* Keep the shield itself out of the snapshot */
+  self->capturing = TRUE;
+  phoc_renderer_render_output (renderer, self->output, &ctx);
+  self->capturing = FALSE;
+  pixman_region32_fini (&damage);
+
+  if (!wlr_render_pass_submit (render_pass)) {
+    clear_snapshot (self);
+    return;
+  }
+
+  self->snapshot_texture = wlr_texture_from_buffer (wlr_renderer, self->snapshot);
+  if (!self->snapshot_texture)
+    clear_snapshot (self);
+}
+
+
 static void
 stop_render (PhocOutputShield *self)
 {
   PhocRenderer *renderer = phoc_server_get_renderer (phoc_server_get_default ());
 
-  g_clear_signal_handler (&self->render_end_id, renderer);
+  if (!self->render_hook_id)
+    return;
+
+  phoc_renderer_remove_render_hook (renderer, self->render_hook_id);
+  self->render_hook_id = 0;
 }
 
 
 
 static void
-on_render (PhocOutputShield *self, PhocRenderContext *ctx)
+on_render (PhocRenderContext *ctx, gpointer user_data)
 {
+  PhocOutputShield *self = PHOC_OUTPUT_SHIELD (user_data);
   struct wlr_output *wlr_output;
 
   if (self->output == NULL || self->output != ctx->output)
     return;
 
+  if (self->capturing)
+    return;
+
   g_debug ("%s: alpha: %f", __func__, self->alpha);
   wlr_output = self->output->wlr_output;
 
@@ -171,13 +277,14 @@ start_render (PhocOutputShield *self)
 {
   PhocRenderer *renderer = phoc_server_get_renderer (phoc_server_get_default ());
 
-  if (self->render_end_id)
+  if (self->render_hook_id)
     return;
 
-  self->render_end_id = g_signal_connect_swapped (renderer,
-                                                  "render-end",
-                                                  G_CALLBACK (on_render),
-                                                  self);
+  self->render_hook_id = phoc_renderer_add_render_hook (renderer,
+                                                        self->output,
+                                                        PHOC_RENDER_HOOK_ORDER_SHIELD,
+                                                        on_render,
+                                                        self);
 }
 
 
@@ -186,6 +293,9 @@ on_animation_done (PhocOutputShield *self)
 {
   /* We can unhook from the render loop once the shield is lowered completely */
   stop_render (self);
+  clear_snapshot (self);
+  /* Show the live content again */
+  phoc_output_damage_whole (self->output);
 }
 
 
@@ -210,6 +320,7 @@ phoc_output_shield_constructed (GObject *object)
   fade_anim = g_object_new (PHOC_TYPE_TIMED_ANIMATION,
                             "animatable", self,
                             "duration", PHOC_ANIM_DURATION_SHIELD_UP,
+                            "max-fps", PHOC_ANIM_SHIELD_UP_MAX_FPS,
                             "property-easer", easer,
                             NULL);
   g_set_object (&self->animation, fade_anim);
@@ -227,6 +338,7 @@ phoc_output_shield_finalize (GObject *object)
 
   set_output (self, NULL);
   stop_render (self);
+  clear_snapshot (self);
 
   G_OBJECT_CLASS (phoc_output_shield_parent_class)->finalize (object);
 }
@@ -303,6 +415,7 @@ phoc_output_shield_raise (PhocOutputShield *self)
   g_return_if_fail (PHOC_IS_OUTPUT_SHIELD (self));
 
   phoc_timed_animation_skip (self->animation);
+  clear_snapshot (self);
 
   set_alpha (self, 1.0);
   phoc_output_damage_whole (self->output);
@@ -321,6 +434,76 @@ phoc_output_shield_lower (PhocOutputShield *self)
 {
   g_return_if_fail (PHOC_IS_OUTPUT_SHIELD (self));
 
+  /* Taken with the next frame, see phoc_output_shield_prepare_frame() */
+  clear_snapshot (self);
+  self->snapshot_pending = TRUE;
   start_render (self);
   phoc_timed_animation_play (self->animation);
 }
+
+/**
+ * phoc_output_shield_prepare_frame:
+ * @self: The shield
+ *
+ * Prepares the shield for the output's next frame. This renders the
+ * snapshot of the output's content when the shield started to lower.
+ * Must be called before the output begins its frame's render pass as
+ * the snapshot is rendered in a render pass of its own.
+ */
+void
+phoc_output_shield_prepare_frame (PhocOutputShield *self)
+{
+  g_return_if_fail (PHOC_IS_OUTPUT_SHIELD (self));
+
+  if (!self->snapshot_pending || !self->render_hook_id || self->output == NULL)
+    return;
+
+  take_snapshot (self);
+}
+
+/**
+ * phoc_output_shield_render_cached:
+ * @self: The shield
+ * @render_pass: The render pass of the output's frame
+ *
+ * Renders the output's whole frame if the shield allows to avoid
+ * rendering the output's surfaces: When the shield is fully raised
+ * only the shield is drawn, while it fades out the snapshot taken
+ * in [method@OutputShield.prepare_frame] and the shield on top.
+ *
+ * Returns: %TRUE if the frame got rendered, %FALSE if the output's
+ *   surfaces need to be rendered.
+ */
+gboolean
+phoc_output_shield_render_cached (PhocOutputShield *self, struct wlr_render_pass *render_pass)
+{
+  struct wlr_output *wlr_output;
+
+  g_return_val_if_fail (PHOC_IS_OUTPUT_SHIELD (self), FALSE);
+
+  /* Not shown */
+  if (!self->render_hook_id || self->output == NULL)
+    return FALSE;
+
+  wlr_output = self->output->wlr_output;
+  if (self->alpha < 1.0) {
+    if (!self->snapshot_texture ||
+        self->snapshot_texture->width != wlr_output->width ||
+        self->snapshot_texture->height != wlr_output->height) {
+      return FALSE;
+    }
+
+    wlr_render_pass_add_texture (render_pass, &(struct wlr_render_texture_options) {
+        .texture = self->snapshot_texture,
+        .dst_box = { .width = wlr_output->width, .height = wlr_output->height },
+        .blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+      });
+  }
+
+  wlr_render_pass_add_rect (render_pass, &(struct wlr_render_rect_options){
+      .box = { .width = wlr_output->width, .height = wlr_output->height },
+      .color =  { .a = self->alpha },
+    });
+
+  return TRUE;
+}
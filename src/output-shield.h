@@ -20,5 +20,8 @@ G_DECLARE_FINAL_TYPE (PhocOutputShield, phoc_output_shield, PHOC, OUTPUT_SHIELD,
 PhocOutputShield   *phoc_output_shield_new                       (PhocOutput *output);
 void                phoc_output_shield_raise                     (PhocOutputShield *self);
 void                phoc_output_shield_lower                     (PhocOutputShield *self);
+void                phoc_output_shield_prepare_frame             (PhocOutputShield *self);
+gboolean            phoc_output_shield_render_cached             (PhocOutputShield       *self,
+                                                                  struct wlr_render_pass *render_pass);
 
 G_END_DECLS
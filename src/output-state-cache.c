@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-output-state-cache"
+
+#include "phoc-config.h"
+
+#include "output-state-cache.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+
+#define KEY_WIDTH     "width"
+#define KEY_HEIGHT    "height"
+#define KEY_REFRESH   "refresh"
+#define KEY_SCALE     "scale"
+#define KEY_TRANSFORM "transform"
+
+/**
+ * PhocOutputStateCache:
+ *
+ * Remembers the last mode, scale and transform that got committed on
+ * an output keyed by the output's make, model and serial. When a
+ * known monitor gets plugged in again that state can be restored
+ * right away instead of probing modes and computing the scale.
+ *
+ * The caller decides which outputs get cached, see
+ * [func@output_state_cache_get_identity].
+ */
+struct _PhocOutputStateCache {
+  char     *path;
+  GKeyFile *keyfile;
+  gboolean  dirty;
+  guint     save_id;
+};
+
+
+static void
+save (PhocOutputStateCache *self)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *dir = NULL;
+
+  if (!self->dirty)
+    return;
+
+  self->dirty = FALSE;
+
+  dir = g_path_get_dirname (self->path);
+  if (g_mkdir_with_parents (dir, 0755) != 0) {
+    g_warning ("Failed to create %s: %s", dir, g_strerror (errno));
+    return;
+  }
+
+  if (!g_key_file_save_to_file (self->keyfile, self->path, &err))
+    g_warning ("Failed to save output state to %s: %s", self->path, err->message);
+}
+
+
+static gboolean
+on_save (gpointer data)
+{
+  PhocOutputStateCache *self = data;
+
+  self->save_id = 0;
+  save (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * phoc_output_state_cache_new:
+ * @path: The file the state is kept in
+ *
+ * Returns:(transfer full): A new output state cache
+ */
+PhocOutputStateCache *
+phoc_output_state_cache_new (const char *path)
+{
+  PhocOutputStateCache *self = g_new0 (PhocOutputStateCache, 1);
+  g_autoptr (GError) err = NULL;
+
+  g_assert (path);
+
+  self->path = g_strdup (path);
+  self->keyfile = g_key_file_new ();
+
+  if (!g_key_file_load_from_file (self->keyfile, path, G_KEY_FILE_NONE, &err) &&
+      !g_error_matches (err, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+    g_warning ("Failed to load output state from %s: %s", path, err->message);
+  }
+
+  return self;
+}
+
+
+void
+phoc_output_state_cache_free (PhocOutputStateCache *self)
+{
+  g_clear_handle_id (&self->save_id, g_source_remove);
+  save (self);
+
+  g_clear_pointer (&self->keyfile, g_key_file_free);
+  g_free (self->path);
+  g_free (self);
+}
+
+/**
+ * phoc_output_state_cache_get_identity:
+ * @wlr_output: The output
+ *
+ * Gets the key the state of @wlr_output's monitor is cached under.
+ * Only outputs that identify a particular monitor should be cached,
+ * e.g. the headless and wayland backends create outputs that don't.
+ *
+ * Returns:(transfer full)(nullable): The identity or %NULL if the
+ *   output lacks make and model.
+ */
+char *
+phoc_output_state_cache_get_identity (struct wlr_output *wlr_output)
+{
+  if (!wlr_output->make && !wlr_output->model)
+    return NULL;
+
+  return g_strdup_printf ("%s|%s|%s",
+                          wlr_output->make ?: "",
+                          wlr_output->model ?: "",
+                          wlr_output->serial ?: "");
+}
+
+/**
+ * phoc_output_state_cache_restore:
+ * @self: The output state cache
+ * @identity: The monitor's identity
+ * @wlr_output: The output to restore the state for
+ * @pending: The state to fill in
+ *
+ * Fills in mode, scale and transform last committed on the monitor
+ * identified by @identity.
+ *
+ * Returns: %TRUE if a state for the monitor was found and its mode
+ *   is still available.
+ */
+gboolean
+phoc_output_state_cache_restore (PhocOutputStateCache    *self,
+                                 const char              *identity,
+                                 struct wlr_output       *wlr_output,
+                                 struct wlr_output_state *pending)
+{
+  struct wlr_output_mode *mode, *found = NULL;
+  int width, height, refresh, transform;
+  double scale;
+
+  if (!identity || !g_key_file_has_group (self->keyfile, identity))
+    return FALSE;
+
+  width = g_key_file_get_integer (self->keyfile, identity, KEY_WIDTH, NULL);
+  height = g_key_file_get_integer (self->keyfile, identity, KEY_HEIGHT, NULL);
+  refresh = g_key_file_get_integer (self->keyfile, identity, KEY_REFRESH, NULL);
+  scale = g_key_file_get_double (self->keyfile, identity, KEY_SCALE, NULL);
+  transform = g_key_file_get_integer (self->keyfile, identity, KEY_TRANSFORM, NULL);
+
+  if (scale <= 0.0 || transform < WL_OUTPUT_TRANSFORM_NORMAL ||
+      transform > WL_OUTPUT_TRANSFORM_FLIPPED_270)
+    return FALSE;
+
+  wl_list_for_each (mode, &wlr_output->modes, link) {
+    if (mode->width == width && mode->height == height && mode->refresh == refresh) {
+      found = mode;
+      break;
+    }
+  }
+
+  if (!found)
+    return FALSE;
+
+  wlr_output_state_set_mode (pending, found);
+  wlr_output_state_set_scale (pending, scale);
+  wlr_output_state_set_transform (pending, transform);
+
+  return TRUE;
+}
+
+/**
+ * phoc_output_state_cache_store:
+ * @self: The output state cache
+ * @identity: The monitor's identity
+ * @wlr_output: The output
+ *
+ * Remembers @wlr_output's current mode, scale and transform for the
+ * monitor identified by @identity. The state is written out from an
+ * idle callback.
+ */
+void
+phoc_output_state_cache_store (PhocOutputStateCache *self,
+                               const char           *identity,
+                               struct wlr_output    *wlr_output)
+{
+  struct wlr_output_mode *mode = wlr_output->current_mode;
+
+  if (!identity || !wlr_output->enabled || !mode)
+    return;
+
+  if (g_key_file_has_group (self->keyfile, identity) &&
+      g_key_file_get_integer (self->keyfile, identity, KEY_WIDTH, NULL) == mode->width &&
+      g_key_file_get_integer (self->keyfile, identity, KEY_HEIGHT, NULL) == mode->height &&
+      g_key_file_get_integer (self->keyfile, identity, KEY_REFRESH, NULL) == mode->refresh &&
+      g_key_file_get_double (self->keyfile, identity, KEY_SCALE, NULL) == wlr_output->scale &&
+      g_key_file_get_integer (self->keyfile, identity, KEY_TRANSFORM, NULL) == wlr_output->transform) {
+    return;
+  }
+
+  g_key_file_set_integer (self->keyfile, identity, KEY_WIDTH, mode->width);
+  g_key_file_set_integer (self->keyfile, identity, KEY_HEIGHT, mode->height);
+  g_key_file_set_integer (self->keyfile, identity, KEY_REFRESH, mode->refresh);
+  g_key_file_set_double (self->keyfile, identity, KEY_SCALE, wlr_output->scale);
+  g_key_file_set_integer (self->keyfile, identity, KEY_TRANSFORM, wlr_output->transform);
+
+  self->dirty = TRUE;
+  if (self->save_id)
+    return;
+
+  self->save_id = g_idle_add (on_save, self);
+  g_source_set_name_by_id (self->save_id, "[phoc] save output state");
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <wlr/types/wlr_output.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PhocOutputStateCache PhocOutputStateCache;
+
+PhocOutputStateCache *phoc_output_state_cache_new     (const char              *path);
+void                  phoc_output_state_cache_free    (PhocOutputStateCache    *self);
+char                 *phoc_output_state_cache_get_identity (struct wlr_output  *wlr_output);
+gboolean              phoc_output_state_cache_restore (PhocOutputStateCache    *self,
+                                                       const char              *identity,
+                                                       struct wlr_output       *wlr_output,
+                                                       struct wlr_output_state *pending);
+void                  phoc_output_state_cache_store   (PhocOutputStateCache    *self,
+                                                       const char              *identity,
+                                                       struct wlr_output       *wlr_output);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocOutputStateCache, phoc_output_state_cache_free)
+
+G_END_DECLS
@@ -4,11 +4,14 @@
 #include "phoc-tracing.h"
 
 #define _POSIX_C_SOURCE 200809L
+#include <drm_fourcc.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <wlr/backend/drm.h>
 #include <wlr/config.h>
+#include <wlr/interfaces/wlr_output.h>
 #include <wlr/render/swapchain.h>
 #include <wlr/render/android.h>
 #include <wlr/types/wlr_compositor.h>
@@ -23,13 +26,23 @@
 #include "bling.h"
 #include "cursor.h"
 #include "cutouts-overlay.h"
+#include "damage-heatmap.h"
+#include "frame-stats.h"
+#include "gpu-timer.h"
+#include "input-latency.h"
 #include "settings.h"
+#include "layer-cache.h"
 #include "layer-shell.h"
 #include "layer-shell-effects.h"
+#include "log.h"
+#include "magnifier.h"
 #include "output.h"
+#include "output-planes.h"
 #include "output-shield.h"
+#include "overview.h"
 #include "render.h"
 #include "render-private.h"
+#include "scene.h"
 #include "seat.h"
 #include "server.h"
 #include "input-method-relay.h"
@@ -50,17 +63,32 @@ enum {
 };
 static guint signals[N_SIGNALS] = { 0 };
 
+/*
+ * Identifies a gamma LUT. The hash alone isn't enough to tell LUTs
+ * apart so the ramp size and whether it resets to the default LUT
+ * are compared as well.
+ */
+typedef struct {
+  gboolean applied; /* FALSE if no LUT was applied yet */
+  gboolean reset;   /* The default LUT */
+  guint32  ramp_size;
+  guint32  hash;
+} PhocGammaLutKey;
+
 typedef struct _PhocOutputPrivate {
   PhocRenderer            *renderer;
   PhocOutputShield        *shield;
 
-  GSList                  *frame_callbacks;
-  gint                     frame_callback_next_id;
+  /* Slot map of PhocOutputFrameCallbackInfo, see phoc_output_add_frame_callback */
+  GArray                  *frame_callbacks;
+  GArray                  *frame_callbacks_free;
+  guint                    n_frame_callbacks;
+  guint                    frame_tick;
+  /* Predicted presentation time of the last frame callbacks ran for */
   gint64                   last_frame_us;
 
   PhocCutoutsOverlay      *cutouts;
-  gulong                   render_cutouts_id;
-  struct wlr_texture      *cutouts_texture;
+  guint                    render_cutouts_id;
 
   gboolean shell_revealed;
   gboolean force_shell_reveal;
@@ -69,11 +97,90 @@ typedef struct _PhocOutputPrivate {
   struct wl_listener     frame;
   struct wl_listener     needs_frame;
   struct wl_listener     request_state;
+  struct wl_listener     present;
+
+  PhocFrameStats        *frame_stats;
+  /* PhocInputLatencyPending reflected in the next presented frame */
+  GArray                *input_latency_pending;
+  PhocGpuTimer          *gpu_timer; /* (nullable): without timer queries */
+  PhocDamageHeatmap     *damage_heatmap;
+  PhocLayerCache        *layer_cache; /* (nullable): the composited lower layers */
+  PhocScanoutResult      scanout_result;
+  PhocCursorPlaneResult  cursor_result;
+  PhocOutputPlanes      *planes;
+  double                 damage_max_waste;
+  guint                  damage_max_rects;
+  /* The fullscreen view's content in the buffer on screen (weak) */
+  PhocView              *rendered_view;
+  guint64                rendered_view_serial;
+  /* Surfaces fully covered by opaque surfaces in the last render pass */
+  GHashTable            *occluded_surfaces;
+  /* PhocRenderSummaryItem of the next frame and of the one on screen */
+  GArray                *frame_summary;
+  GArray                *rendered_summary;
+  gboolean               rendered_summary_valid;
+  gint64                 hidden_frame_done_us;
+
+  /* Frame scheduling */
+  gint64                 deadline_margin_us;
+  /* Whether the pending damage came from background clients only */
+  gboolean               background_damage;
+  gboolean               priority_damage;
+  gint64                 render_estimate_us;
+  gint64                 last_present_us;
+  gint64                 refresh_us;
+  guint                  repaint_id;
+  gint64                 repaint_deadline_us;
+  gint64                 frame_us;
+  gint64                 commit_us;
+
+  /* Buffer age fallback for drivers that always report 0 */
+  guint                  buffer_count;
+  guint                  rendered_frames;
 
   PhocOutputScaleFilter  scale_filter;
+  /* drmModeModeInfo of the modelines added to the connector */
+  GArray                *added_modes;
   gboolean               gamma_lut_changed;
+  /* The gamma LUT on screen and the one in the pending commit */
+  PhocGammaLutKey        gamma_lut;
+  PhocGammaLutKey        pending_gamma_lut;
+  gboolean               gamma_lut_unsupported;
+
+  /* Adaptive sync */
+  PhocOutputAdaptiveSync adaptive_sync;
+  PhocView              *vrr_view;
+  guint64                vrr_view_serial;
+  gint64                 vrr_commit_us;
+  gint64                 vrr_interval_us;
+  gint64                 vrr_jitter_us;
+
+  /* Refresh rate switching */
+  float                  idle_refresh_rate;
+  guint                  idle_frames;
+  struct wlr_output_mode *active_mode;
+  struct wlr_output_mode *idle_mode;
+  struct wlr_output_mode *pending_mode;
+  gint64                 last_activity_us;
+  guint                  idle_refresh_id;
+  /* Stay at the idle refresh rate */
+  gboolean               power_saver;
+  /* Powered off, no frames or animations */
+  gboolean               dormant;
+  struct wlr_buffer     *wake_buffer;
 
   GQueue                *layer_surfaces[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY + 1];
+  /* The on screen keyboard's layer surface, looked up again when invalid */
+  PhocLayerSurface      *osk;
+  gboolean               osk_valid;
+  /* Queued layer shell arrange */
+  guint                  arrange_layers_id;
+  gboolean               arrange_layers_pending;
+
+  /* Live views placed by the shell */
+  PhocOverview          *overview;
+
+  PhocMagnifier         *magnifier;
 } PhocOutputPrivate;
 
 static void phoc_output_initable_iface_init (GInitableIface *iface);
@@ -88,19 +195,33 @@ G_DEFINE_TYPE_WITH_CODE (PhocOutput, phoc_output, G_TYPE_OBJECT,
 
 #define PHOC_OUTPUT_SELF(p) PHOC_PRIV_CONTAINER(PHOC_OUTPUT, PhocOutput, (p))
 
-static void phoc_output_for_each_surface (PhocOutput          *self,
-                                          PhocSurfaceIterator  iterator,
-                                          void                *user_data,
-                                          gboolean             visible_only);
+#define PHOC_HIDDEN_FRAME_DONE_INTERVAL_US (G_USEC_PER_SEC)
+/* How early to repaint frames only background clients damaged */
+#define PHOC_BACKGROUND_DEADLINE_MARGIN_US 2000
+
+static void phoc_output_layer_for_each_surface (PhocOutput                    *self,
+                                                enum zwlr_layer_shell_v1_layer layer,
+                                                PhocSurfaceIterator            iterator,
+                                                void                          *user_data);
 
 typedef struct {
   PhocAnimatable    *animatable;
   PhocFrameCallback  callback;
   gpointer           user_data;
   GDestroyNotify     notify;
-  guint              id;
+  /* Bumped when the slot gets freed so stale ids don't match */
+  guint16            generation;
+  gboolean           used;
+  /* The frame tick the callback got added in */
+  guint              added_tick;
 } PhocOutputFrameCallbackInfo;
 
+/* Frame callback ids encode the slot's index and the slot's generation */
+#define FRAME_CALLBACK_MAX_SLOTS     G_MAXUINT16
+#define FRAME_CALLBACK_ID(idx, gen)  ((((guint)(gen)) << 16) | ((idx) + 1))
+#define FRAME_CALLBACK_INDEX(id)     (((id) & 0xFFFF) - 1)
+#define FRAME_CALLBACK_GENERATION(id) ((guint16)((id) >> 16))
+
 
 typedef struct {
   PhocSurfaceIterator  user_iterator;
@@ -113,12 +234,33 @@ typedef struct {
 } PhocOutputSurfaceIteratorData;
 
 
+static PhocOutputFrameCallbackInfo *
+get_frame_callback (PhocOutputPrivate *priv, guint index)
+{
+  return &g_array_index (priv->frame_callbacks, PhocOutputFrameCallbackInfo, index);
+}
+
+/*
+ * Frees the slot and invokes the callback's destroy notify. The
+ * notify might add callbacks so slot pointers are invalid afterwards.
+ */
 static void
-phoc_output_frame_callback_info_free (PhocOutputFrameCallbackInfo *cb_info)
+phoc_output_frame_callback_clear (PhocOutputPrivate *priv, guint index)
 {
-  if (cb_info->notify && cb_info->user_data)
-    cb_info->notify (cb_info->user_data);
-  g_free (cb_info);
+  PhocOutputFrameCallbackInfo *cb_info = get_frame_callback (priv, index);
+  GDestroyNotify notify = cb_info->notify;
+  gpointer user_data = cb_info->user_data;
+
+  g_assert (cb_info->used);
+
+  *cb_info = (PhocOutputFrameCallbackInfo) {
+    .generation = cb_info->generation + 1,
+  };
+  priv->n_frame_callbacks--;
+  g_array_append_val (priv->frame_callbacks_free, index);
+
+  if (notify && user_data)
+    notify (user_data);
 }
 
 /**
@@ -243,16 +385,26 @@ phoc_output_init (PhocOutput *self)
   PhocServer *server = phoc_server_get_default ();
   PhocOutputPrivate *priv = phoc_output_get_instance_private(self);
 
-  priv->frame_callback_next_id = 1;
+  priv->frame_callbacks = g_array_new (FALSE, TRUE, sizeof (PhocOutputFrameCallbackInfo));
+  priv->frame_callbacks_free = g_array_new (FALSE, FALSE, sizeof (guint));
   priv->last_frame_us = g_get_monotonic_time ();
   priv->shield = phoc_output_shield_new (self);
 
-  self->debug_touch_points = NULL;
+  self->n_debug_touch_points = 0;
   wl_list_init (&self->layer_surfaces);
 
   priv->scale_filter = PHOC_OUTPUT_SCALE_FILTER_AUTO;
+  priv->adaptive_sync = PHOC_OUTPUT_ADAPTIVE_SYNC_OFF;
+  priv->frame_stats = phoc_frame_stats_new ();
+  priv->input_latency_pending = g_array_new (FALSE, FALSE, sizeof (PhocInputLatencyPending));
+  priv->planes = phoc_output_planes_new (self);
+  priv->magnifier = phoc_magnifier_new (self);
+  priv->occluded_surfaces = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->frame_summary = g_array_new (FALSE, FALSE, sizeof (PhocRenderSummaryItem));
+  priv->rendered_summary = g_array_new (FALSE, FALSE, sizeof (PhocRenderSummaryItem));
 
   priv->renderer = g_object_ref (phoc_server_get_renderer (server));
+  priv->gpu_timer = phoc_gpu_timer_new (phoc_renderer_get_egl (priv->renderer));
 }
 
 PhocOutput *
@@ -270,6 +422,9 @@ update_output_manager_config (PhocDesktop *desktop)
   struct wlr_output_configuration_v1 *config = wlr_output_configuration_v1_create ();
   PhocOutput *output;
 
+  /* Outputs changed so earlier test results don't apply anymore */
+  g_clear_pointer (&desktop->output_manager_test_key, g_free);
+
   wl_list_for_each (output, &desktop->outputs, link) {
     struct wlr_output_configuration_head_v1 *config_head;
     struct wlr_box output_box;
@@ -298,21 +453,40 @@ phoc_output_handle_destroy (struct wl_listener *listener, void *data)
 
 
 static void
-render_cutouts (PhocOutput *self, PhocRenderContext *ctx)
+clear_render_cutouts (PhocOutput *self)
 {
   PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
 
-  g_assert (PHOC_IS_OUTPUT (self));
+  if (!priv->render_cutouts_id)
+    return;
+
+  phoc_renderer_remove_render_hook (priv->renderer, priv->render_cutouts_id);
+  priv->render_cutouts_id = 0;
+}
+
+
+static void
+render_cutouts (PhocRenderContext *ctx, gpointer user_data)
+{
+  PhocOutput *self = PHOC_OUTPUT (user_data);
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
 
-  if (priv->cutouts_texture) {
-    struct wlr_texture *texture = priv->cutouts_texture;
+  /* Parsing the device information is deferred until it's needed */
+  if (G_UNLIKELY (!priv->cutouts)) {
+    PhocServer *server = phoc_server_get_default ();
 
-    wlr_render_pass_add_texture (ctx->render_pass, &(struct wlr_render_texture_options) {
-        .texture = texture,
-        .transform = WL_OUTPUT_TRANSFORM_NORMAL,
-        .filter_mode = phoc_output_get_texture_filter_mode (ctx->output),
-    });
+    priv->cutouts = phoc_cutouts_overlay_new (phoc_server_get_compatibles (server));
+    if (!priv->cutouts) {
+      g_warning ("Could not create cutout overlay");
+      clear_render_cutouts (self);
+      return;
+    }
+    g_signal_connect_swapped (priv->cutouts, "changed",
+                              G_CALLBACK (phoc_output_damage_whole), self);
+    g_message ("Adding cutouts overlay");
   }
+
+  phoc_cutouts_overlay_render (priv->cutouts, ctx);
 }
 
 
@@ -323,316 +497,1767 @@ phoc_output_handle_damage (struct wl_listener *listener, void *user_data)
   PhocOutput *self = PHOC_OUTPUT_SELF (priv);
   struct wlr_output_event_damage *event = user_data;
 
+  /* Software cursors */
+  priv->priority_damage = TRUE;
   if (wlr_damage_ring_add (&self->damage_ring, event->damage))
     wlr_output_schedule_frame (self->wlr_output);
 }
 
 
+static PhocGammaLutKey
+get_gamma_lut_key (struct wlr_gamma_control_v1 *gamma_control)
+{
+  PhocGammaLutKey key = { .applied = TRUE, .hash = 5381 };
+  const guint8 *data;
+  gsize len;
+
+  /* Resetting to the default LUT */
+  if (gamma_control == NULL || gamma_control->table == NULL) {
+    key.reset = TRUE;
+    key.hash = 0;
+    return key;
+  }
+
+  key.ramp_size = gamma_control->ramp_size;
+  data = (const guint8 *)gamma_control->table;
+  len = gamma_control->ramp_size * 3 * sizeof (*gamma_control->table);
+  for (gsize i = 0; i < len; i++)
+    key.hash = (key.hash << 5) + key.hash + data[i];
+
+  return key;
+}
+
+
+static gboolean
+gamma_lut_key_equal (const PhocGammaLutKey *a, const PhocGammaLutKey *b)
+{
+  return a->applied == b->applied &&
+    a->reset == b->reset &&
+    a->ramp_size == b->ramp_size &&
+    a->hash == b->hash;
+}
+
+
 static void
 phoc_output_set_gamma_lut (PhocOutput *self, struct wlr_output_state *pending)
 {
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
   PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
   struct wlr_gamma_control_v1 *gamma_control;
+  PhocGammaLutKey key;
 
   gamma_control = wlr_gamma_control_manager_v1_get_control (desktop->gamma_control_manager_v1,
                                                             self->wlr_output);
-  priv->gamma_lut_changed = FALSE;
+
+  /* Night light tools often send the same ramp over and over */
+  key = get_gamma_lut_key (gamma_control);
+  if (gamma_lut_key_equal (&key, &priv->gamma_lut))
+    goto nothing_to_commit;
+
+  /* No need to test again if the CRTC can't do gamma at all */
+  if (priv->gamma_lut_unsupported && gamma_control && gamma_control->table) {
+    wlr_gamma_control_v1_send_failed_and_destroy (gamma_control);
+    goto nothing_to_commit;
+  }
 
   if (!wlr_gamma_control_v1_apply (gamma_control, pending))
-    return;
+    goto nothing_to_commit;
 
   if (!wlr_output_test_state (self->wlr_output, pending)) {
+    g_debug ("Gamma LUT not supported by %s", self->wlr_output->name);
+    priv->gamma_lut_unsupported = TRUE;
     wlr_output_state_finish (pending);
     wlr_gamma_control_v1_send_failed_and_destroy (gamma_control);
     *pending = (struct wlr_output_state){0};
+    goto nothing_to_commit;
   }
-}
 
+  /* Keep gamma_lut_changed set until the commit so the frame can't be skipped */
+  priv->pending_gamma_lut = key;
+  return;
 
-static void
-surface_send_frame_done_iterator (PhocOutput         *output,
-                                  struct wlr_surface *wlr_surface,
-                                  struct wlr_box     *box,
-                                  float               scale,
-                                  void               *data)
-{
-  struct timespec *when = data;
-
-  wlr_surface_send_frame_done (wlr_surface, when);
+ nothing_to_commit:
+  priv->gamma_lut_changed = FALSE;
 }
 
 
+/*
+ * Resets the gamma LUT latch once a commit was attempted so a failed
+ * commit doesn't force frames forever. The LUT on screen only changes
+ * if the commit succeeded.
+ */
 static void
-count_surface_iterator (PhocOutput         *output,
-                        struct wlr_surface *wlr_surface,
-                        struct wlr_box     *box,
-                        float               scale,
-                        void               *data)
+gamma_lut_committed (PhocOutput *self, struct wlr_output_state *pending, gboolean success)
 {
-  size_t *n = data;
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
 
-  (*n)++;
-}
+  if (!(pending->committed & WLR_OUTPUT_STATE_GAMMA_LUT))
+    return;
 
+  if (success)
+    priv->gamma_lut = priv->pending_gamma_lut;
+  priv->gamma_lut_changed = FALSE;
+}
 
-PHOC_TRACE_NO_INLINE static bool
-scan_out_fullscreen_view (PhocOutput *self, PhocView *view, struct wlr_output_state *pending)
-{
-  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
-  struct wlr_output *wlr_output = self->wlr_output;
-  size_t n_surfaces = 0;
-  struct wlr_surface *wlr_surface;
 
-  g_assert (PHOC_IS_VIEW (view));
+typedef struct {
+  struct timespec when;
+  GHashTable     *occluded;
+  gboolean        hidden; /* All surfaces of this iteration are hidden */
+  gboolean        send_hidden;
+} PhocFrameDoneData;
 
-  for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next) {
-    PhocSeat *seat = PHOC_SEAT (elem->data);
-    PhocDragIcon *drag_icon;
 
-    g_assert (PHOC_IS_SEAT (seat));
-    drag_icon = seat->drag_icon;
+/* Whether the surface was visible in the output's last frame */
+static gboolean
+is_shown_on_output (PhocOutput *self, struct wlr_surface *wlr_surface)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
 
-    if (phoc_drag_icon_is_mapped (drag_icon))
-      return false;
-  }
+  if (priv->dormant)
+    return FALSE;
 
-  if (phoc_output_has_shell_revealed (self))
-    return false;
+  return !priv->occluded_surfaces || !g_hash_table_contains (priv->occluded_surfaces, wlr_surface);
+}
 
-  if (phoc_output_has_layer (self, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY))
-    return false;
+/*
+ * The output a surface that spans several outputs gets frame done
+ * events from. Otherwise the client would render at the combined rate
+ * of all of them. Prefer the highest refresh rate so the client
+ * renders as often as any of its outputs can show it. Outputs the
+ * surface is covered on don't render its updates so they might not
+ * emit frame events at all, pick one where it's visible if there is
+ * one. Disabled outputs don't emit frame events so these are skipped.
+ */
+static struct wlr_output *
+get_frame_done_output (struct wlr_surface *wlr_surface)
+{
+  struct wlr_surface_output *surface_output;
+  struct wlr_output *primary = NULL, *fallback = NULL;
 
-  if (!phoc_view_is_mapped (view))
-    return false;
+  wl_list_for_each (surface_output, &wlr_surface->current_outputs, link) {
+    struct wlr_output *wlr_output = surface_output->output;
 
-  phoc_output_view_for_each_surface (self, view, count_surface_iterator, &n_surfaces);
-  if (n_surfaces > 1)
-    return false;
+    if (!wlr_output->enabled || !wlr_output->data)
+      continue;
 
-#ifdef PHOC_XWAYLAND
-  if (PHOC_IS_XWAYLAND_SURFACE (view)) {
-    struct wlr_xwayland_surface *xsurface =
-      phoc_xwayland_surface_get_wlr_surface (PHOC_XWAYLAND_SURFACE (view));
-    if (!wl_list_empty (&xsurface->children)) {
-      return false;
-    }
-  }
-#endif
+    if (!fallback || wlr_output->refresh > fallback->refresh)
+      fallback = wlr_output;
 
-  wlr_surface = view->wlr_surface;
-  if (wlr_surface->buffer == NULL)
-    return false;
+    if (!is_shown_on_output (PHOC_OUTPUT (wlr_output->data), wlr_surface))
+      continue;
 
-  if ((float)wlr_surface->current.scale != wlr_output->scale ||
-      wlr_surface->current.transform != wlr_output->transform) {
-    return false;
+    if (!primary || wlr_output->refresh > primary->refresh)
+      primary = wlr_output;
   }
 
-  if (!wlr_output_is_direct_scanout_allowed (wlr_output))
-    return false;
+  return primary ?: fallback;
+}
 
-  wlr_output_state_set_buffer (pending, &wlr_surface->buffer->base);
-  if (!wlr_output_test_state (wlr_output, pending))
-    return false;
 
-  wlr_presentation_surface_scanned_out_on_output (self->desktop->presentation,
-                                                  wlr_surface,
-                                                  wlr_output);
+/* Whether the surface also shows up on other enabled outputs */
+static gboolean
+is_on_other_outputs (struct wlr_surface *wlr_surface, struct wlr_output *wlr_output)
+{
+  struct wlr_surface_output *surface_output;
+
+  wl_list_for_each (surface_output, &wlr_surface->current_outputs, link) {
+    if (surface_output->output != wlr_output && surface_output->output->enabled)
+      return TRUE;
+  }
 
-  return wlr_output_commit_state (wlr_output, pending);
+  return FALSE;
 }
 
 
 static void
-get_frame_damage (PhocOutput *self, pixman_region32_t *frame_damage)
+surface_send_frame_done_iterator (PhocOutput         *output,
+                                  struct wlr_surface *wlr_surface,
+                                  struct wlr_box     *box,
+                                  float               scale,
+                                  void               *data)
 {
-  PhocServer *server = phoc_server_get_default ();
-  int width, height;
-  enum wl_output_transform transform;
+  PhocFrameDoneData *frame_done = data;
+  struct wlr_output *primary = get_frame_done_output (wlr_surface);
 
-  wlr_output_transformed_resolution (self->wlr_output, &width, &height);
-
-  pixman_region32_init (frame_damage);
-
-  transform = wlr_output_transform_invert (self->wlr_output->transform);
-  wlr_region_transform (frame_damage, &self->damage_ring.current, transform, width, height);
+  /* Surfaces not on any output (yet) get them from everywhere */
+  if (primary && primary != output->wlr_output)
+    return;
 
-  if (G_UNLIKELY (phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_DAMAGE_TRACKING))) {
-    pixman_region32_union_rect (frame_damage, frame_damage,
-                                0, 0, self->wlr_output->width, self->wlr_output->height);
+  if (!frame_done->send_hidden) {
+    gboolean hidden = frame_done->hidden ||
+      (frame_done->occluded && g_hash_table_contains (frame_done->occluded, wlr_surface));
 
+    /* Only covered on this output, it might be seen on the others */
+    if (hidden && !is_on_other_outputs (wlr_surface, output->wlr_output))
+      return;
   }
-}
 
+  wlr_surface_send_frame_done (wlr_surface, &frame_done->when);
+}
 
-PHOC_TRACE_NO_INLINE static void
-phoc_output_draw (PhocOutput *self)
+/*
+ * Send frame done events to all surfaces on the output. Surfaces that
+ * can't be seen as they're covered by opaque surfaces or fullscreen
+ * views only get them every PHOC_HIDDEN_FRAME_DONE_INTERVAL_US so
+ * clients don't keep rendering at full rate for nothing. Surfaces
+ * spanning several outputs only get them from one of them and are only
+ * throttled if they aren't on any other output. While the session is
+ * locked only the lock surface gets them.
+ */
+static void
+send_frame_done (PhocOutput *self)
 {
   PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
-  struct wlr_output *wlr_output = self->wlr_output;
-  bool needs_frame, scanned_out = false;
-  pixman_region32_t buffer_damage;
-  int buffer_age;
-  PhocRenderContext render_context;
-  struct wlr_buffer *buffer;
-  struct wlr_render_pass *render_pass;
-  struct wlr_output_state pending = { 0 };
+  PhocFrameDoneData frame_done = { 0 };
+  PhocSessionLock *session_lock;
+  gint64 now_us = g_get_monotonic_time ();
 
-  if (!wlr_output->enabled)
-    return;
-
-  needs_frame = wlr_output->needs_frame;
-  needs_frame |= pixman_region32_not_empty (&self->damage_ring.current);
-  needs_frame |= priv->gamma_lut_changed;
-
-  if (!needs_frame)
-    return;
-
-  if (G_UNLIKELY (priv->gamma_lut_changed))
-    phoc_output_set_gamma_lut (self, &pending);
+  clock_gettime (CLOCK_MONOTONIC, &frame_done.when);
 
-  pending.committed |= WLR_OUTPUT_STATE_DAMAGE;
-  get_frame_damage (self, &pending.damage);
-
-  /* Check if we can delegate the fullscreen surface to the output */
-  if (phoc_output_has_fullscreen_view (self))
-    scanned_out = scan_out_fullscreen_view (self, self->fullscreen_view, &pending);
+  if (now_us - priv->hidden_frame_done_us >= PHOC_HIDDEN_FRAME_DONE_INTERVAL_US) {
+    frame_done.send_hidden = TRUE;
+    priv->hidden_frame_done_us = now_us;
+  }
 
-  if (scanned_out)
-    goto out;
+  session_lock = phoc_desktop_get_session_lock (self->desktop);
+  if (G_UNLIKELY (phoc_session_lock_is_locked (session_lock))) {
+    struct wlr_surface *surface = phoc_session_lock_get_surface (session_lock, self);
 
-  if (!wlr_output_configure_primary_swapchain (wlr_output, &pending, &wlr_output->swapchain))
-    goto  out;
+    if (surface) {
+      phoc_output_surface_for_each_surface (self, surface, 0, 0,
+                                            surface_send_frame_done_iterator, &frame_done);
+    }
+    return;
+  }
 
-  buffer = wlr_swapchain_acquire (wlr_output->swapchain, &buffer_age);
-  if (!buffer)
-    goto out;
+  if (!phoc_output_has_fullscreen_view (self)) {
+    frame_done.occluded = priv->occluded_surfaces;
+    phoc_output_for_each_surface (self, surface_send_frame_done_iterator, &frame_done, true);
 
-  if (wlr_renderer_is_android(wlr_output->renderer))
-    buffer_age = wlr_renderer_get_buffer_age (wlr_output->renderer, buffer);
+    /* Views that aren't rendered at all, e.g. below a maximized one */
+    frame_done.hidden = TRUE;
+    for (GList *l = phoc_desktop_get_views (self->desktop)->head; l; l = l->next) {
+      PhocView *view = PHOC_VIEW (l->data);
 
-  render_pass = wlr_renderer_begin_buffer_pass_for_output (wlr_output->renderer, buffer, NULL, (void*)wlr_output);
-  if (!render_pass) {
-    wlr_buffer_unlock (buffer);
-    goto out;
+      if (phoc_view_is_mapped (view) && !phoc_desktop_view_is_visible (self->desktop, view)) {
+        phoc_output_view_for_each_surface (self, view,
+                                           surface_send_frame_done_iterator, &frame_done);
+      }
+    }
+    return;
   }
 
-  pixman_region32_init (&buffer_damage);
-  wlr_damage_ring_get_buffer_damage (&self->damage_ring, buffer_age, &buffer_damage);
-
-  render_context = (PhocRenderContext){
-    .output = self,
-    .damage = &buffer_damage,
-    .alpha = 1.0,
-    .render_pass = render_pass,
-  };
-  phoc_renderer_render_output (priv->renderer, self, &render_context);
+  /* The occluded surfaces are stale when scanning out, but only the
+   * fullscreen view and what's stacked above it is shown anyway */
+  phoc_output_view_for_each_surface (self, self->fullscreen_view,
+                                     surface_send_frame_done_iterator, &frame_done);
+#ifdef PHOC_XWAYLAND
+  if (PHOC_IS_XWAYLAND_SURFACE (self->fullscreen_view)) {
+    phoc_output_xwayland_children_for_each_surface (self,
+                                                    PHOC_XWAYLAND_SURFACE (self->fullscreen_view),
+                                                    surface_send_frame_done_iterator,
+                                                    &frame_done);
+  }
+#endif
 
-  pixman_region32_fini (&buffer_damage);
+  /* The other views on this output are covered by the fullscreen view */
+  frame_done.hidden = TRUE;
+  for (GList *l = phoc_desktop_get_views (self->desktop)->head; l; l = l->next) {
+    PhocView *view = PHOC_VIEW (l->data);
 
-  if (!wlr_render_pass_submit (render_pass)) {
-    wlr_buffer_unlock (buffer);
-    goto out;
+    if (view != self->fullscreen_view && phoc_view_is_mapped (view)) {
+      phoc_output_view_for_each_surface (self, view,
+                                         surface_send_frame_done_iterator, &frame_done);
+    }
   }
+  frame_done.hidden = FALSE;
 
-  wlr_output_state_set_buffer (&pending, buffer);
-  wlr_buffer_unlock (buffer);
+  if (priv->overview)
+    phoc_overview_for_each_surface (priv->overview, surface_send_frame_done_iterator, &frame_done);
+  phoc_output_drag_icons_for_each_surface (self, phoc_server_get_input (phoc_server_get_default ()),
+                                           surface_send_frame_done_iterator, &frame_done);
 
-  if (!wlr_output_commit_state (wlr_output, &pending))
-    goto out;
+  for (enum zwlr_layer_shell_v1_layer layer = ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND;
+       layer <= ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY; layer++) {
+    frame_done.hidden = layer < ZWLR_LAYER_SHELL_V1_LAYER_TOP ||
+      (layer == ZWLR_LAYER_SHELL_V1_LAYER_TOP && !phoc_output_has_shell_revealed (self));
+    phoc_output_layer_for_each_surface (self, layer, surface_send_frame_done_iterator, &frame_done);
+  }
+}
 
-  wlr_damage_ring_rotate (&self->damage_ring);
 
- out:
-  wlr_output_state_finish (&pending);
-}
+typedef struct {
+  struct wlr_surface *candidate;
+  struct wlr_box      candidate_box;
+  gboolean            has_background;
+  gboolean            blocked;
+} PhocScanoutSurfaceData;
 
 
 static void
-phoc_output_handle_frame (struct wl_listener *listener, void *data)
+find_scanout_surface_iterator (PhocOutput         *output,
+                               struct wlr_surface *wlr_surface,
+                               struct wlr_box     *box,
+                               float               scale,
+                               void               *data)
 {
-  PhocOutputPrivate *priv = wl_container_of (listener, priv, frame);
-  PhocOutput *self = PHOC_OUTPUT_SELF (priv);
-  struct timespec now;
+  struct wlr_box output_box = { 0 }, intersection;
+  PhocScanoutSurfaceData *scanout = data;
+  struct wlr_render_color color;
 
-  /* Process all registered frame callbacks */
-  GSList *l = priv->frame_callbacks;
-  while (l != NULL) {
-    GSList *next = l->next;
-    PhocOutputFrameCallbackInfo *cb_info = l->data;
-    gboolean ret;
+  /* Surfaces without content don't hinder direct scanout. Video players e.g.
+   * often add an empty subsurface */
+  if (!wlr_surface_has_buffer (wlr_surface))
+    return;
 
-    ret = cb_info->callback(cb_info->animatable, priv->last_frame_us, cb_info->user_data);
-    if (ret == G_SOURCE_REMOVE) {
-      phoc_output_frame_callback_info_free (cb_info);
-      priv->frame_callbacks = g_slist_delete_link (priv->frame_callbacks, l);
-    }
-    l = next;
-  }
-  priv->last_frame_us = g_get_monotonic_time ();
+  /* Neither do surfaces that aren't visible on this output */
+  wlr_output_effective_resolution (output->wlr_output, &output_box.width, &output_box.height);
+  if (!wlr_box_intersection (&intersection, box, &output_box))
+    return;
 
-  /* Ensure the cutouts are drawn */
-  if (G_UNLIKELY (priv->cutouts_texture)) {
-    struct wlr_box box = { 0, 0, priv->cutouts_texture->width, priv->cutouts_texture->height };
-    if (wlr_damage_ring_add_box (&self->damage_ring, &box))
-      wlr_output_schedule_frame (self->wlr_output);
+  /* Nor single pixel backgrounds below the buffer as long as that covers the output */
+  if (!scanout->candidate && phoc_utils_wlr_surface_get_single_pixel_color (wlr_surface, &color)) {
+    scanout->has_background = TRUE;
+    return;
   }
 
-  /* Repaint the output */
-  phoc_output_draw (self);
-
-  /* Send frame done events to all visible surfaces */
-  clock_gettime (CLOCK_MONOTONIC, &now);
-  phoc_output_for_each_surface (self, surface_send_frame_done_iterator, &now, true);
+  if (scanout->candidate) {
+    scanout->blocked = TRUE;
+    return;
+  }
 
-  /* Want frame clock ticking as long as we have frame callbacks */
-  if (priv->frame_callbacks)
-    wlr_output_schedule_frame (self->wlr_output);
+  scanout->candidate = wlr_surface;
+  scanout->candidate_box = *box;
 }
 
 
+/*
+ * Keep the buffer last presented on the output so it can be put on
+ * screen right away when the output gets powered on again. Only
+ * buffers we rendered ourselves that show everything qualify, not
+ * client buffers or ones with content on other planes.
+ */
 static void
-phoc_output_handle_needs_frame (struct wl_listener *listener, void *user_data)
+set_wake_buffer (PhocOutput *self, struct wlr_buffer *buffer)
 {
-  PhocOutputPrivate *priv = wl_container_of (listener, priv, needs_frame);
-  PhocOutput *self = PHOC_OUTPUT_SELF (priv);
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
 
-  wlr_output_schedule_frame (self->wlr_output);
+  if (buffer)
+    wlr_buffer_lock (buffer);
+  g_clear_pointer (&priv->wake_buffer, wlr_buffer_unlock);
+  priv->wake_buffer = buffer;
 }
 
+/*
+ * Renderers drawing to an EGL surface (Android) report the age
+ * themselves. Some drivers report 0 for every frame though which
+ * forces full repaints. With the number of buffers they cycle through
+ * configured the age is then derived from the frames rendered since
+ * the content was lost.
+ */
+static int
+get_buffer_age (PhocOutput *self, struct wlr_buffer *buffer, int swapchain_age)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  int age;
 
-static void
-update_output_scale_iterator (PhocOutput         *self,
-                              struct wlr_surface *wlr_surface,
-                              struct wlr_box     *box,
-                              float               scale,
-                              void               *user_data)
+  if (!(phoc_renderer_get_caps (priv->renderer) & PHOC_RENDERER_CAP_QUERY_BUFFER_AGE))
+    return swapchain_age;
 
+  age = wlr_renderer_get_buffer_age (self->wlr_output->renderer, buffer);
+  if (age > 0 || priv->buffer_count == 0 || priv->rendered_frames < priv->buffer_count)
+    return age;
 
-{
-  phoc_utils_wlr_surface_update_scales (wlr_surface);
+  return priv->buffer_count;
 }
 
 
-static void
-phoc_output_handle_commit (struct wl_listener *listener, void *data)
+static bool
+phoc_output_commit_state (PhocOutput *self, struct wlr_output_state *pending)
 {
-  PhocOutput *self = wl_container_of (listener, self, commit);
   PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
-  struct wlr_output_event_commit *event = data;
 
-  if (event->state->committed & (WLR_OUTPUT_STATE_MODE |
-                                 WLR_OUTPUT_STATE_SCALE |
-                                 WLR_OUTPUT_STATE_TRANSFORM)) {
-    phoc_layer_shell_arrange (self);
+  priv->commit_us = g_get_monotonic_time ();
+  if (!wlr_output_commit_state (self->wlr_output, pending)) {
+    gamma_lut_committed (self, pending, FALSE);
+    priv->commit_us = 0;
+    if (G_UNLIKELY (priv->pending_mode && (pending->committed & WLR_OUTPUT_STATE_MODE))) {
+      g_warning ("Failed to switch refresh rate of %s, disabling idle refresh rate",
+                 self->wlr_output->name);
+      priv->pending_mode = NULL;
+      priv->idle_mode = NULL;
+    }
+    return false;
   }
 
-  if (event->state->committed & (WLR_OUTPUT_STATE_ENABLED |
-                                 WLR_OUTPUT_STATE_MODE |
+  gamma_lut_committed (self, pending, TRUE);
+  return true;
+}
+
+
+/*
+ * How the cursors on the output get presented. wlroots renders them
+ * in software when they can't go onto the cursor plane.
+ */
+static PhocCursorPlaneResult
+get_cursor_plane_result (PhocOutput *self)
+{
+  struct wlr_output *wlr_output = self->wlr_output;
+  struct wlr_output_cursor *cursor;
+  gboolean shown = FALSE;
+
+  wl_list_for_each (cursor, &wlr_output->cursors, link) {
+    if (!cursor->enabled || !cursor->visible)
+      continue;
+
+    if (wlr_output->hardware_cursor == cursor) {
+      shown = TRUE;
+      continue;
+    }
+
+    if (wlr_output->software_cursor_locks > 0)
+      return PHOC_CURSOR_PLANE_RESULT_LOCKED;
+
+    if (wlr_output->impl->set_cursor == NULL)
+      return PHOC_CURSOR_PLANE_RESULT_UNSUPPORTED;
+
+    return PHOC_CURSOR_PLANE_RESULT_REJECTED;
+  }
+
+  return shown ? PHOC_CURSOR_PLANE_RESULT_HARDWARE : PHOC_CURSOR_PLANE_RESULT_HIDDEN;
+}
+
+
+static void
+record_cursor_result (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  PhocCursorPlaneResult result = get_cursor_plane_result (self);
+
+  if (priv->cursor_result != result) {
+    g_debug ("Cursor on %s: %s", self->wlr_output->name,
+             phoc_cursor_plane_result_to_string (result));
+    if (result != PHOC_CURSOR_PLANE_RESULT_HARDWARE && result != PHOC_CURSOR_PLANE_RESULT_HIDDEN)
+      DTRACE_PROBE2 (phoc, cursor_software, self->wlr_output->name,
+                     phoc_cursor_plane_result_to_string (result));
+  }
+  priv->cursor_result = result;
+  phoc_frame_stats_record_cursor (priv->frame_stats, result);
+}
+
+/* GPU times arrive once the GPU finished, usually a frame later */
+static void
+record_gpu_times (PhocOutput *self, PhocTimelineTrace *timeline)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gint64 start_us, end_us;
+
+  while (phoc_gpu_timer_pop_result (priv->gpu_timer, &start_us, &end_us)) {
+    phoc_frame_stats_record (priv->frame_stats, PHOC_FRAME_STATS_METRIC_GPU, end_us - start_us);
+    if (G_UNLIKELY (timeline))
+      phoc_timeline_trace_add_span (timeline, self->wlr_output->name, "gpu", start_us, end_us,
+                                    NULL, 0);
+  }
+}
+
+
+static void
+plane_presented_iterator (PhocOutput         *output,
+                          struct wlr_surface *wlr_surface,
+                          struct wlr_box     *box,
+                          float               scale,
+                          void               *data)
+{
+  phoc_output_surface_presented (output, wlr_surface, PHOC_OUTPUT_PRESENTATION_PLANE);
+}
+
+
+PHOC_TRACE_NO_INLINE static bool
+scan_out_fullscreen_view (PhocOutput *self, PhocView *view, struct wlr_output_state *pending)
+{
+  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
+  struct wlr_output *wlr_output = self->wlr_output;
+  PhocScanoutSurfaceData scanout = { 0 };
+  struct wlr_surface *wlr_surface;
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  PhocInputLatency *latency;
+  PhocScanoutResult result;
+  gboolean tested;
+
+  g_assert (PHOC_IS_VIEW (view));
+
+  /* Drag icons can stay on top of the view when they fit onto overlay planes */
+  if (!phoc_output_planes_assign_drag_icons (priv->planes, pending)) {
+    result = PHOC_SCANOUT_RESULT_DRAG_ICON;
+    goto reject;
+  }
+
+  if (phoc_output_has_shell_revealed (self)) {
+    result = PHOC_SCANOUT_RESULT_SHELL_REVEALED;
+    goto reject;
+  }
+
+  if (phoc_output_has_layer (self, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY)) {
+    result = PHOC_SCANOUT_RESULT_OVERLAY_LAYER;
+    goto reject;
+  }
+
+  if (phoc_magnifier_is_active (priv->magnifier)) {
+    result = PHOC_SCANOUT_RESULT_MAGNIFIED;
+    goto reject;
+  }
+
+  if (!phoc_view_is_mapped (view)) {
+    result = PHOC_SCANOUT_RESULT_UNMAPPED;
+    goto reject;
+  }
+
+  phoc_output_view_for_each_surface (self, view, find_scanout_surface_iterator, &scanout);
+  if (scanout.blocked) {
+    result = PHOC_SCANOUT_RESULT_MULTIPLE_SURFACES;
+    goto reject;
+  }
+
+  if (scanout.has_background) {
+    struct wlr_box buffer_box = scanout.candidate_box;
+    int width, height;
+
+    /* The buffer needs to hide the background completely and must not be stretched */
+    wlr_output_transformed_resolution (wlr_output, &width, &height);
+    phoc_utils_scale_box (&buffer_box, wlr_output->scale);
+    if (!scanout.candidate ||
+        !wlr_box_equal (&buffer_box, &(struct wlr_box){ .width = width, .height = height }) ||
+        scanout.candidate->buffer == NULL ||
+        scanout.candidate->buffer->base.width != wlr_output->width ||
+        scanout.candidate->buffer->base.height != wlr_output->height) {
+      result = PHOC_SCANOUT_RESULT_MULTIPLE_SURFACES;
+      goto reject;
+    }
+  }
+
+#ifdef PHOC_XWAYLAND
+  if (PHOC_IS_XWAYLAND_SURFACE (view)) {
+    /* Unmapped children aren't rendered so they don't block scanout */
+    if (phoc_xwayland_surface_get_mapped_children (PHOC_XWAYLAND_SURFACE (view))->len) {
+      result = PHOC_SCANOUT_RESULT_XWAYLAND_CHILDREN;
+      goto reject;
+    }
+  }
+#endif
+
+  wlr_surface = scanout.candidate ?: view->wlr_surface;
+  if (wlr_surface->buffer == NULL) {
+    result = PHOC_SCANOUT_RESULT_NO_BUFFER;
+    goto reject;
+  }
+
+  if ((float)wlr_surface->current.scale != wlr_output->scale ||
+      wlr_surface->current.transform != wlr_output->transform) {
+    result = PHOC_SCANOUT_RESULT_SCALE_TRANSFORM;
+    goto reject;
+  }
+
+  if (!wlr_output_is_direct_scanout_allowed (wlr_output)) {
+    result = PHOC_SCANOUT_RESULT_NOT_ALLOWED;
+    goto reject;
+  }
+
+  wlr_output_state_set_buffer (pending, &wlr_surface->buffer->base);
+  /* Games can ask for lower latency over tear free presentation */
+  pending->tearing_page_flip = phoc_desktop_surface_wants_tearing (self->desktop, wlr_surface);
+  tested = wlr_output_test_state (wlr_output, pending);
+  if (!tested && pending->tearing_page_flip) {
+    g_debug ("Async page flip not supported on %s", wlr_output->name);
+    pending->tearing_page_flip = false;
+    tested = wlr_output_test_state (wlr_output, pending);
+  }
+  if (!phoc_output_planes_finish_drag_icons (priv->planes, tested)) {
+    result = tested ? PHOC_SCANOUT_RESULT_DRAG_ICON : PHOC_SCANOUT_RESULT_TEST_FAILED;
+    goto reject;
+  }
+
+  phoc_output_surface_presented (self, wlr_surface, PHOC_OUTPUT_PRESENTATION_SCANOUT);
+  phoc_output_drag_icons_for_each_surface (self, input, plane_presented_iterator, NULL);
+  latency = phoc_server_get_input_latency (phoc_server_get_default ());
+  if (G_UNLIKELY (latency))
+    phoc_input_latency_surface_rendered (latency, wlr_surface, self);
+
+  if (!phoc_output_commit_state (self, pending)) {
+    result = PHOC_SCANOUT_RESULT_COMMIT_FAILED;
+    goto reject;
+  }
+  set_wake_buffer (self, NULL);
+
+  priv->scanout_result = PHOC_SCANOUT_RESULT_ACCEPTED;
+  phoc_frame_stats_record_scanout (priv->frame_stats, PHOC_SCANOUT_RESULT_ACCEPTED);
+  DTRACE_PROBE1 (phoc, scanout_accept, wlr_output->name);
+  return true;
+
+ reject:
+  /* Rendered frames are always presented tear free */
+  pending->tearing_page_flip = false;
+  if (priv->scanout_result != result)
+    g_debug ("Direct scanout on %s: %s", wlr_output->name, phoc_scanout_result_to_string (result));
+  priv->scanout_result = result;
+  phoc_frame_stats_record_scanout (priv->frame_stats, result);
+  DTRACE_PROBE2 (phoc, scanout_reject, wlr_output->name, phoc_scanout_result_to_string (result));
+  return false;
+}
+
+
+static gboolean
+has_drag_icons (void)
+{
+  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
+
+  for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next) {
+    PhocSeat *seat = PHOC_SEAT (elem->data);
+
+    if (phoc_drag_icon_is_mapped (seat->drag_icon))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/*
+ * Whether the frame has to be rendered even if the surfaces didn't
+ * change: software cursors and drag icons move independently of them
+ * and priority damage needs to show up right away.
+ */
+static gboolean
+has_pending_overlay_damage (PhocOutput *self, gboolean priority_damage)
+{
+  PhocCursorPlaneResult cursor_result;
+
+  if (priority_damage)
+    return TRUE;
+
+  cursor_result = get_cursor_plane_result (self);
+  if (cursor_result != PHOC_CURSOR_PLANE_RESULT_HARDWARE &&
+      cursor_result != PHOC_CURSOR_PLANE_RESULT_HIDDEN) {
+    return TRUE;
+  }
+
+  return has_drag_icons ();
+}
+
+/*
+ * Whether the buffer on screen is still up to date as all damage is
+ * hidden below an opaque fullscreen view that didn't change since it
+ * got rendered, e.g. a clock updating in the background layer. Only
+ * valid after a failed scanout attempt as that rules out surfaces on
+ * top of the view.
+ */
+static gboolean
+can_skip_frame (PhocOutput *self, PhocView *view, gboolean priority_damage)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  struct wlr_surface *wlr_surface = view->wlr_surface;
+  struct wlr_box view_box, output_box;
+
+  switch (priv->scanout_result) {
+  case PHOC_SCANOUT_RESULT_MULTIPLE_SURFACES:
+  case PHOC_SCANOUT_RESULT_SCALE_TRANSFORM:
+  case PHOC_SCANOUT_RESULT_NOT_ALLOWED:
+  case PHOC_SCANOUT_RESULT_TEST_FAILED:
+    break;
+  default:
+    return FALSE;
+  }
+
+  if (priv->rendered_view != view ||
+      priv->rendered_view_serial != phoc_view_get_content_serial (view)) {
+    return FALSE;
+  }
+
+  if (self->wlr_output->needs_frame || priv->gamma_lut_changed || priv->pending_mode)
+    return FALSE;
+
+  if (phoc_output_has_render_overlays (self))
+    return FALSE;
+
+  /* Cursors and drag icons no longer rule out scanout so they need checking here */
+  if (has_pending_overlay_damage (self, priority_damage))
+    return FALSE;
+
+  /* The view's surface needs to cover the whole output */
+  phoc_view_get_box (view, &view_box);
+  view_box.x -= self->lx;
+  view_box.y -= self->ly;
+  output_box = (struct wlr_box) { .x = 0, .y = 0 };
+  wlr_output_effective_resolution (self->wlr_output, &output_box.width, &output_box.height);
+  if (view_box.x > output_box.x || view_box.y > output_box.y ||
+      view_box.x + view_box.width < output_box.width ||
+      view_box.y + view_box.height < output_box.height) {
+    return FALSE;
+  }
+
+  return pixman_region32_contains_rectangle (&wlr_surface->opaque_region,
+                                            &(pixman_box32_t) {
+                                              .x2 = wlr_surface->current.width,
+                                              .y2 = wlr_surface->current.height,
+                                            }) == PIXMAN_REGION_IN;
+}
+
+
+/*
+ * Whether the buffer on screen is still up to date as rendering the
+ * frame would draw the same surfaces with the same content, geometry
+ * and alpha again, e.g. when the damage stems from a finished
+ * animation or a view that got damaged as a whole. @summarized is
+ * set when the frame's summary was computed.
+ */
+static gboolean
+can_skip_unchanged_frame (PhocOutput *self, gboolean priority_damage, gboolean *summarized)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  PhocServer *server = phoc_server_get_default ();
+
+  *summarized = FALSE;
+
+  if (self->wlr_output->needs_frame || priv->gamma_lut_changed || priv->pending_mode)
+    return FALSE;
+
+  if (has_pending_overlay_damage (self, priority_damage))
+    return FALSE;
+
+  if (phoc_output_has_render_overlays (self))
+    return FALSE;
+
+  /* Touch points are only collected while rendering */
+  if (G_UNLIKELY (phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_TOUCH_POINTS)))
+    return FALSE;
+
+  /* Planes show surface content outside of the primary buffer */
+  if (phoc_output_planes_get_n_assigned (priv->planes))
+    return FALSE;
+
+  if (!phoc_renderer_summarize_output (priv->renderer, self, priv->frame_summary))
+    return FALSE;
+  *summarized = TRUE;
+
+  if (!priv->rendered_summary_valid)
+    return FALSE;
+
+  return phoc_render_summary_equal (priv->frame_summary, priv->rendered_summary);
+}
+
+
+/*
+ * Track how regularly the fullscreen view commits relative to the
+ * output's refresh rate.
+ */
+static gboolean
+fullscreen_view_commits_irregularly (PhocOutput *self, PhocView *view)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gint64 now_us, interval_us, refresh_us;
+  guint64 serial = phoc_view_get_content_serial (view);
+
+  if (self->wlr_output->refresh <= 0)
+    return FALSE;
+  refresh_us = 1000000000 / self->wlr_output->refresh;
+
+  if (priv->vrr_view != view) {
+    priv->vrr_view = view;
+    priv->vrr_view_serial = serial;
+    priv->vrr_commit_us = 0;
+    priv->vrr_interval_us = refresh_us;
+    priv->vrr_jitter_us = 0;
+    return FALSE;
+  }
+
+  if (priv->vrr_view_serial != serial) {
+    now_us = g_get_monotonic_time ();
+    priv->vrr_view_serial = serial;
+
+    if (priv->vrr_commit_us) {
+      /* Ignore pauses, they're not part of a rendering loop */
+      interval_us = MIN (now_us - priv->vrr_commit_us, 4 * refresh_us);
+      priv->vrr_jitter_us += (ABS (interval_us - priv->vrr_interval_us) - priv->vrr_jitter_us) / 8;
+      priv->vrr_interval_us += (interval_us - priv->vrr_interval_us) / 8;
+    }
+    priv->vrr_commit_us = now_us;
+  }
+
+  /* Either not keeping up with the refresh rate or varying a lot */
+  return priv->vrr_interval_us > refresh_us * 5 / 4 || priv->vrr_jitter_us > refresh_us / 4;
+}
+
+/* What the fullscreen view says it shows, if any */
+static enum wp_content_type_v1_type
+get_fullscreen_content_type (PhocOutput *self)
+{
+  PhocView *view = self->fullscreen_view;
+
+  if (!view || !phoc_view_is_mapped (view))
+    return WP_CONTENT_TYPE_V1_TYPE_NONE;
+
+  return phoc_desktop_get_content_type (self->desktop, view->wlr_surface);
+}
+
+/*
+ * In auto mode enable adaptive sync while a fullscreen view is
+ * scanned out or commits at irregular intervals. Once enabled it stays
+ * on for that view to avoid flickering refresh rate changes. Games and
+ * videos get it right away so frames are shown at the rate they're
+ * produced.
+ */
+static void
+update_adaptive_sync (PhocOutput *self, struct wlr_output_state *pending)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  PhocView *view = self->fullscreen_view;
+  gboolean enabled, enable = FALSE;
+
+  if (priv->adaptive_sync != PHOC_OUTPUT_ADAPTIVE_SYNC_AUTO)
+    return;
+
+  enabled = self->wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+
+  if (view && phoc_view_is_mapped (view)) {
+    gboolean same_view = priv->vrr_view == view;
+    gboolean irregular = fullscreen_view_commits_irregularly (self, view);
+    enum wp_content_type_v1_type content_type = get_fullscreen_content_type (self);
+
+    enable = (enabled && same_view) || irregular ||
+      priv->scanout_result == PHOC_SCANOUT_RESULT_ACCEPTED ||
+      content_type == WP_CONTENT_TYPE_V1_TYPE_GAME ||
+      content_type == WP_CONTENT_TYPE_V1_TYPE_VIDEO;
+  } else {
+    priv->vrr_view = NULL;
+  }
+
+  if (enable == enabled)
+    return;
+
+  g_debug ("%s adaptive sync on %s", enable ? "Enabling" : "Disabling", self->wlr_output->name);
+  wlr_output_state_set_adaptive_sync_enabled (pending, enable);
+}
+
+
+static gint64
+get_mode_refresh_us (struct wlr_output_mode *mode)
+{
+  if (!mode || mode->refresh <= 0)
+    return 0;
+
+  return 1000000000 / mode->refresh;
+}
+
+/*
+ * The mode with the same resolution as @active_mode and the refresh
+ * rate closest to @refresh_rate, if it's lower than @active_mode's.
+ */
+static struct wlr_output_mode *
+find_idle_mode (PhocOutput *self, struct wlr_output_mode *active_mode, float refresh_rate)
+{
+  struct wlr_output_mode *mode, *best = NULL;
+  int mhz = (int)(refresh_rate * 1000);
+
+  wl_list_for_each (mode, &self->wlr_output->modes, link) {
+    if (mode->width != active_mode->width || mode->height != active_mode->height)
+      continue;
+
+    if (mode->refresh >= active_mode->refresh)
+      continue;
+
+    if (!best || ABS (mode->refresh - mhz) < ABS (best->refresh - mhz))
+      best = mode;
+  }
+
+  return best;
+}
+
+
+static void
+update_refresh_modes (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  priv->active_mode = self->wlr_output->current_mode;
+  priv->idle_mode = NULL;
+
+  if (priv->idle_refresh_rate > 0 && priv->active_mode)
+    priv->idle_mode = find_idle_mode (self, priv->active_mode, priv->idle_refresh_rate);
+
+  if (priv->idle_mode) {
+    g_debug ("Idle refresh rate for %s: %.3f Hz", self->wlr_output->name,
+             priv->idle_mode->refresh / 1000.0);
+  }
+}
+
+/*
+ * Switch to @mode with the next frame. The frame gets rendered in
+ * full as the skip heuristics would otherwise drop it.
+ */
+static void
+request_mode (PhocOutput *self, struct wlr_output_mode *mode)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  if (self->wlr_output->current_mode == mode) {
+    priv->pending_mode = NULL;
+    return;
+  }
+
+  if (priv->pending_mode == mode)
+    return;
+
+  g_debug ("Switching %s to %.3f Hz", self->wlr_output->name, mode->refresh / 1000.0);
+  priv->pending_mode = mode;
+  wlr_damage_ring_add_whole (&self->damage_ring);
+  wlr_output_schedule_frame (self->wlr_output);
+}
+
+
+static gboolean
+on_idle_refresh_timeout (gpointer data)
+{
+  PhocOutput *self = PHOC_OUTPUT (data);
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gint64 idle_us, elapsed_us;
+
+  priv->idle_refresh_id = 0;
+
+  if (!priv->idle_mode)
+    return G_SOURCE_REMOVE;
+
+  /* Animations keep the refresh rate up */
+  if (priv->n_frame_callbacks)
+    priv->last_activity_us = g_get_monotonic_time ();
+
+  idle_us = priv->idle_frames * get_mode_refresh_us (priv->active_mode);
+  elapsed_us = g_get_monotonic_time () - priv->last_activity_us;
+  if (elapsed_us < idle_us) {
+    priv->idle_refresh_id = g_timeout_add (MAX ((idle_us - elapsed_us) / 1000, 1),
+                                           on_idle_refresh_timeout, self);
+    g_source_set_name_by_id (priv->idle_refresh_id, "[phoc] idle refresh");
+    return G_SOURCE_REMOVE;
+  }
+
+  request_mode (self, priv->idle_mode);
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Record activity on the output. Damage only postpones lowering the
+ * refresh rate, input and animations also raise it again. Photos
+ * shown fullscreen don't need a high refresh rate unless interacted
+ * with, so their damage doesn't count.
+ */
+static void
+note_activity (PhocOutput *self, gboolean raise)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gboolean lowered;
+
+  if (!priv->idle_mode)
+    return;
+
+  if (priv->power_saver) {
+    request_mode (self, priv->idle_mode);
+    return;
+  }
+
+  if (raise || get_fullscreen_content_type (self) != WP_CONTENT_TYPE_V1_TYPE_PHOTO)
+    priv->last_activity_us = g_get_monotonic_time ();
+
+  lowered = self->wlr_output->current_mode == priv->idle_mode;
+  if (lowered && priv->pending_mode != priv->active_mode) {
+    if (!raise)
+      return;
+
+    request_mode (self, priv->active_mode);
+  } else if (raise && priv->pending_mode == priv->idle_mode) {
+    /* Not lowered yet so just don't */
+    request_mode (self, self->wlr_output->current_mode);
+  }
+
+  if (priv->idle_refresh_id)
+    return;
+
+  priv->idle_refresh_id = g_timeout_add (MAX (priv->idle_frames *
+                                              get_mode_refresh_us (priv->active_mode) / 1000, 1),
+                                         on_idle_refresh_timeout, self);
+  g_source_set_name_by_id (priv->idle_refresh_id, "[phoc] idle refresh");
+}
+
+/*
+ * A disabled (e.g. powered off) output is dormant: It doesn't render
+ * and, as there are no frame events, doesn't send frame done events
+ * so clients only shown on it stop rendering. Animations driven by
+ * its frame callbacks pause and continue where they stopped once it's
+ * enabled again. Damage keeps accumulating so what changed while the
+ * output was off still gets repainted after waking up with the last
+ * presented buffer. Without that buffer the whole output is repainted.
+ */
+static void
+set_dormant (PhocOutput *self, gboolean dormant, gboolean has_buffer)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  if (priv->dormant == dormant)
+    return;
+
+  g_debug ("Output %s %s dormant", self->wlr_output->name, dormant ? "going" : "leaving");
+  priv->dormant = dormant;
+
+  if (dormant) {
+    g_clear_handle_id (&priv->repaint_id, g_source_remove);
+    g_clear_handle_id (&priv->idle_refresh_id, g_source_remove);
+    return;
+  }
+
+  /* Don't let animations catch up on the time the output was off */
+  priv->last_frame_us = g_get_monotonic_time ();
+  note_activity (self, TRUE);
+
+  if (has_buffer) {
+    if (pixman_region32_not_empty (&self->damage_ring.current) || priv->n_frame_callbacks)
+      wlr_output_schedule_frame (self->wlr_output);
+    return;
+  }
+
+  /* Whatever wlroots put on screen isn't what we rendered last */
+  g_clear_pointer (&priv->wake_buffer, wlr_buffer_unlock);
+  priv->rendered_summary_valid = FALSE;
+  phoc_output_damage_whole (self);
+}
+
+
+static void
+get_frame_damage (PhocOutput *self, pixman_region32_t *frame_damage)
+{
+  PhocServer *server = phoc_server_get_default ();
+  int width, height;
+  enum wl_output_transform transform;
+
+  wlr_output_transformed_resolution (self->wlr_output, &width, &height);
+
+  pixman_region32_init (frame_damage);
+
+  transform = wlr_output_transform_invert (self->wlr_output->transform);
+  wlr_region_transform (frame_damage, &self->damage_ring.current, transform, width, height);
+
+  if (G_UNLIKELY (phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_DAMAGE_TRACKING))) {
+    pixman_region32_union_rect (frame_damage, frame_damage,
+                                0, 0, self->wlr_output->width, self->wlr_output->height);
+
+  }
+}
+
+
+/*
+ * Render the output into the magnifier's buffer and draw the zoomed in
+ * part of it onto the output. See [struct@Magnifier].
+ */
+static gboolean
+draw_magnified (PhocOutput *self, struct wlr_output_state *pending)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  struct wlr_output *wlr_output = self->wlr_output;
+  PhocRenderContext render_context;
+  struct wlr_render_pass *render_pass;
+  struct wlr_buffer *buffer;
+  pixman_region32_t damage;
+  guint n_textures = 0;
+  gboolean success;
+  int buffer_age;
+  gint64 start_us;
+
+  if (!wlr_output_configure_primary_swapchain (wlr_output, pending, &wlr_output->swapchain))
+    return FALSE;
+
+  start_us = g_get_monotonic_time ();
+  pixman_region32_init (&damage);
+  success = phoc_magnifier_begin (priv->magnifier, &self->damage_ring.current, &damage,
+                                  &render_pass);
+  if (render_pass) {
+    render_context = (PhocRenderContext){
+      .output = self,
+      .damage = &damage,
+      .alpha = 1.0,
+      .render_pass = render_pass,
+      .occluded_surfaces = priv->occluded_surfaces,
+      .input_latency = phoc_server_get_input_latency (phoc_server_get_default ()),
+    };
+    phoc_renderer_render_output (priv->renderer, self, &render_context);
+    n_textures = render_context.n_textures;
+    success = phoc_magnifier_end (priv->magnifier, render_pass, &damage);
+  }
+  pixman_region32_fini (&damage);
+  if (!success)
+    return FALSE;
+
+  buffer = wlr_swapchain_acquire (wlr_output->swapchain, &buffer_age);
+  if (!buffer)
+    return FALSE;
+
+  buffer_age = get_buffer_age (self, buffer, buffer_age);
+
+  /* Render passes can't nest so the shield renders its snapshot first */
+  phoc_output_shield_prepare_frame (priv->shield);
+
+  render_pass = wlr_renderer_begin_buffer_pass_for_output (wlr_output->renderer, buffer, NULL,
+                                                           (void *)wlr_output);
+  if (!render_pass) {
+    wlr_buffer_unlock (buffer);
+    return FALSE;
+  }
+
+  phoc_magnifier_render (priv->magnifier, render_pass, buffer_age);
+  phoc_frame_stats_record (priv->frame_stats, PHOC_FRAME_STATS_METRIC_RENDER,
+                           g_get_monotonic_time () - start_us);
+
+  if (!wlr_render_pass_submit (render_pass)) {
+    wlr_buffer_unlock (buffer);
+    return FALSE;
+  }
+
+  phoc_magnifier_get_frame_damage (priv->magnifier, &pending->damage);
+  wlr_output_state_set_buffer (pending, buffer);
+  wlr_buffer_unlock (buffer);
+
+  if (!phoc_output_commit_state (self, pending))
+    return FALSE;
+
+  /* The main damage ring doesn't track the magnified content */
+  set_wake_buffer (self, NULL);
+  priv->rendered_frames++;
+
+  record_cursor_result (self);
+  phoc_frame_stats_add_frame (priv->frame_stats,
+                              phoc_utils_region_area (&self->damage_ring.current),
+                              n_textures);
+  wlr_damage_ring_rotate (&self->damage_ring);
+  phoc_magnifier_rotate (priv->magnifier);
+
+  return TRUE;
+}
+
+
+/*
+ * Let wlroots composite the output from the scene graph. It tracks
+ * damage, occlusion and direct scan out on its own.
+ */
+static gboolean
+draw_scene (PhocOutput *self, PhocScene *scene, struct wlr_output_state *pending)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gint64 start_us;
+
+  phoc_output_planes_clear (priv->planes, pending);
+  g_clear_weak_pointer (&priv->rendered_view);
+  priv->rendered_summary_valid = FALSE;
+
+  start_us = g_get_monotonic_time ();
+  if (!phoc_scene_build_state (scene, self, pending))
+    return FALSE;
+  phoc_frame_stats_record (priv->frame_stats, PHOC_FRAME_STATS_METRIC_RENDER,
+                           g_get_monotonic_time () - start_us);
+
+  /* Nothing in the scene changed */
+  if (!(pending->committed & WLR_OUTPUT_STATE_BUFFER)) {
+    pixman_region32_clear (&self->damage_ring.current);
+    return TRUE;
+  }
+
+  if (!phoc_output_commit_state (self, pending))
+    return FALSE;
+
+  set_wake_buffer (self, NULL);
+  priv->rendered_frames++;
+  record_cursor_result (self);
+  phoc_frame_stats_add_frame (priv->frame_stats,
+                              phoc_utils_region_area (&self->damage_ring.current), 0);
+  wlr_damage_ring_rotate (&self->damage_ring);
+
+  return TRUE;
+}
+
+
+PHOC_TRACE_NO_INLINE static void
+phoc_output_draw (PhocOutput *self, gboolean priority_damage)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  struct wlr_output *wlr_output = self->wlr_output;
+  bool needs_frame, scanned_out = false;
+  gboolean summarized = FALSE;
+  pixman_region32_t buffer_damage;
+  int buffer_age;
+  PhocRenderContext render_context;
+  struct wlr_buffer *buffer;
+  struct wlr_render_pass *render_pass;
+  struct wlr_output_state pending = { 0 };
+  PhocTimelineTrace *timeline;
+  PhocScene *scene;
+  PhocSessionLock *session_lock;
+  gint64 start_us, end_us, frame_start_us = 0, damage_area = 0;
+  guint64 repainted_area;
+  guint n_saved;
+  gboolean locked;
+
+  if (!wlr_output->enabled)
+    return;
+
+  needs_frame = wlr_output->needs_frame;
+  needs_frame |= pixman_region32_not_empty (&self->damage_ring.current);
+  needs_frame |= priv->gamma_lut_changed;
+  needs_frame |= phoc_magnifier_needs_frame (priv->magnifier);
+
+  if (!needs_frame)
+    return;
+
+  DTRACE_PROBE2 (phoc, frame_start, wlr_output->name,
+                 phoc_utils_region_area (&self->damage_ring.current));
+  timeline = phoc_server_get_timeline_trace (phoc_server_get_default ());
+  if (G_UNLIKELY (timeline)) {
+    frame_start_us = g_get_monotonic_time ();
+    damage_area = phoc_utils_region_area (&self->damage_ring.current);
+  }
+
+  note_activity (self, FALSE);
+
+  if (G_UNLIKELY (priv->gamma_lut_changed))
+    phoc_output_set_gamma_lut (self, &pending);
+
+  if (G_UNLIKELY (priv->pending_mode))
+    wlr_output_state_set_mode (&pending, priv->pending_mode);
+
+  pending.committed |= WLR_OUTPUT_STATE_DAMAGE;
+  get_frame_damage (self, &pending.damage);
+
+  update_adaptive_sync (self, &pending);
+
+  /* Only the lock surface is shown, keep the shortcuts that could show anything else out */
+  session_lock = phoc_desktop_get_session_lock (self->desktop);
+  locked = phoc_session_lock_is_locked (session_lock);
+
+  if (phoc_magnifier_is_active (priv->magnifier) && !locked) {
+    phoc_output_planes_clear (priv->planes, &pending);
+    g_clear_weak_pointer (&priv->rendered_view);
+    priv->rendered_summary_valid = FALSE;
+    draw_magnified (self, &pending);
+    goto out;
+  }
+
+  scene = phoc_desktop_get_scene (self->desktop);
+  if (G_UNLIKELY (scene) && !locked) {
+    draw_scene (self, scene, &pending);
+    goto out;
+  }
+
+  /* Check if we can delegate the fullscreen surface to the output */
+  if (phoc_output_has_fullscreen_view (self) && !locked &&
+      !phoc_layout_transaction_get_snapshot (phoc_desktop_get_layout_transaction (self->desktop),
+                                             self->fullscreen_view)) {
+    phoc_output_planes_clear (priv->planes, &pending);
+    scanned_out = scan_out_fullscreen_view (self, self->fullscreen_view, &pending);
+  }
+
+  if (scanned_out) {
+    g_clear_weak_pointer (&priv->rendered_view);
+    priv->rendered_summary_valid = FALSE;
+    goto out;
+  }
+
+  if (phoc_output_has_fullscreen_view (self) && !locked &&
+      can_skip_frame (self, self->fullscreen_view, priority_damage)) {
+    pixman_region32_clear (&self->damage_ring.current);
+    DTRACE_PROBE1 (phoc, frame_skip, wlr_output->name);
+    goto out;
+  }
+
+  if (can_skip_unchanged_frame (self, priority_damage, &summarized)) {
+    pixman_region32_clear (&self->damage_ring.current);
+    DTRACE_PROBE1 (phoc, frame_skip, wlr_output->name);
+    goto out;
+  }
+  /* From here on the buffer on screen changes */
+  priv->rendered_summary_valid = FALSE;
+
+  if (!wlr_output_configure_primary_swapchain (wlr_output, &pending, &wlr_output->swapchain))
+    goto  out;
+
+  /* Surfaces moving on or off planes uncover parts of the primary buffer */
+  if (G_UNLIKELY (locked)) {
+    phoc_output_planes_clear (priv->planes, &pending);
+  } else if (phoc_output_planes_assign (priv->planes, &pending)) {
+    wlr_damage_ring_add_whole (&self->damage_ring);
+    pixman_region32_union_rect (&pending.damage, &pending.damage,
+                                0, 0, wlr_output->width, wlr_output->height);
+  }
+
+  buffer = wlr_swapchain_acquire (wlr_output->swapchain, &buffer_age);
+  if (!buffer)
+    goto out;
+
+  buffer_age = get_buffer_age (self, buffer, buffer_age);
+
+  render_pass = wlr_renderer_begin_buffer_pass_for_output (wlr_output->renderer, buffer, NULL, (void*)wlr_output);
+  if (!render_pass) {
+    wlr_buffer_unlock (buffer);
+    goto out;
+  }
+
+  pixman_region32_init (&buffer_damage);
+  wlr_damage_ring_get_buffer_damage (&self->damage_ring, buffer_age, &buffer_damage);
+  /* Software rendering pays per pixel rather than per rectangle so render the exact damage */
+  if (!(phoc_renderer_get_caps (priv->renderer) & PHOC_RENDERER_CAP_SOFTWARE)) {
+    n_saved = phoc_utils_region_simplify (&buffer_damage,
+                                          priv->damage_max_waste,
+                                          priv->damage_max_rects);
+    phoc_frame_stats_add_damage_rects_saved (priv->frame_stats, n_saved);
+  }
+  repainted_area = phoc_utils_region_area (&buffer_damage);
+
+  render_context = (PhocRenderContext){
+    .output = self,
+    .damage = &buffer_damage,
+    .alpha = 1.0,
+    .render_pass = render_pass,
+    .planes = priv->planes,
+    .occluded_surfaces = priv->occluded_surfaces,
+    .input_latency = phoc_server_get_input_latency (phoc_server_get_default ()),
+  };
+  if (G_UNLIKELY (phoc_server_check_debug_flags (phoc_server_get_default (),
+                                                 PHOC_SERVER_DEBUG_FLAG_DAMAGE_HEATMAP))) {
+    int width, height;
+
+    if (!priv->damage_heatmap)
+      priv->damage_heatmap = phoc_damage_heatmap_new ();
+
+    wlr_output_transformed_resolution (wlr_output, &width, &height);
+    phoc_damage_heatmap_add_damage (priv->damage_heatmap, &self->damage_ring.current,
+                                    width, height);
+  }
+
+  if (priv->gpu_timer)
+    phoc_gpu_timer_begin (priv->gpu_timer);
+
+  start_us = g_get_monotonic_time ();
+  /* Planes show content the shield can't cover */
+  if (phoc_output_planes_get_n_assigned (priv->planes) ||
+      !phoc_output_shield_render_cached (priv->shield, render_pass)) {
+    phoc_renderer_render_output (priv->renderer, self, &render_context);
+  }
+  end_us = g_get_monotonic_time ();
+  phoc_frame_stats_record (priv->frame_stats, PHOC_FRAME_STATS_METRIC_RENDER, end_us - start_us);
+  if (G_UNLIKELY (timeline)) {
+    phoc_timeline_trace_add_span (timeline, wlr_output->name, "render", start_us, end_us,
+                                  "textures", render_context.n_textures);
+  }
+
+  pixman_region32_fini (&buffer_damage);
+
+  if (priv->gpu_timer) {
+    phoc_gpu_timer_end (priv->gpu_timer);
+    record_gpu_times (self, timeline);
+  }
+
+  start_us = g_get_monotonic_time ();
+  if (!wlr_render_pass_submit (render_pass)) {
+    wlr_buffer_unlock (buffer);
+    goto out;
+  }
+  end_us = g_get_monotonic_time ();
+  phoc_frame_stats_record (priv->frame_stats, PHOC_FRAME_STATS_METRIC_SUBMIT, end_us - start_us);
+  if (G_UNLIKELY (timeline))
+    phoc_timeline_trace_add_span (timeline, wlr_output->name, "submit", start_us, end_us, NULL, 0);
+
+  wlr_output_state_set_buffer (&pending, buffer);
+  wlr_buffer_unlock (buffer);
+
+  start_us = g_get_monotonic_time ();
+  if (!phoc_output_commit_state (self, &pending))
+    goto out;
+  if (G_UNLIKELY (timeline)) {
+    phoc_timeline_trace_add_span (timeline, wlr_output->name, "commit", start_us,
+                                  g_get_monotonic_time (), NULL, 0);
+  }
+
+  if (G_UNLIKELY (locked))
+    phoc_session_lock_output_presented (session_lock, self);
+
+  set_wake_buffer (self, phoc_output_planes_get_n_assigned (priv->planes) ? NULL : pending.buffer);
+  priv->rendered_frames++;
+  record_cursor_result (self);
+  phoc_frame_stats_add_frame (priv->frame_stats, repainted_area, render_context.n_textures);
+  wlr_damage_ring_rotate (&self->damage_ring);
+
+  if (phoc_output_has_fullscreen_view (self))
+    g_set_weak_pointer (&priv->rendered_view, self->fullscreen_view);
+  else
+    g_clear_weak_pointer (&priv->rendered_view);
+  if (priv->rendered_view)
+    priv->rendered_view_serial = phoc_view_get_content_serial (priv->rendered_view);
+
+  if (summarized && !phoc_output_planes_get_n_assigned (priv->planes)) {
+    GArray *tmp = priv->rendered_summary;
+
+    priv->rendered_summary = priv->frame_summary;
+    priv->frame_summary = tmp;
+    priv->rendered_summary_valid = TRUE;
+  }
+
+ out:
+  DTRACE_PROBE2 (phoc, frame_end, wlr_output->name, scanned_out);
+  if (G_UNLIKELY (timeline)) {
+    phoc_timeline_trace_add_span (timeline, wlr_output->name,
+                                  scanned_out ? "frame (scanout)" : "frame",
+                                  frame_start_us, g_get_monotonic_time (), "damage", damage_area);
+  }
+
+  /*
+   * A successful commit clears the pending mode, a failed one disables
+   * the idle mode. When nothing got committed (e.g. the swapchain or
+   * render pass failed) the mode switch is retried with the next frame.
+   */
+  if (G_UNLIKELY (priv->pending_mode)) {
+    wlr_damage_ring_add_whole (&self->damage_ring);
+    wlr_output_schedule_frame (wlr_output);
+  }
+
+  wlr_output_state_finish (&pending);
+}
+
+
+static void
+phoc_output_repaint (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gint64 start_us = g_get_monotonic_time ();
+  gboolean priority_damage = priv->priority_damage;
+
+  priv->background_damage = FALSE;
+  priv->priority_damage = FALSE;
+  phoc_output_draw (self, priority_damage);
+
+  /* Adapt quickly to slower frames, slowly to faster ones */
+  if (priv->commit_us >= start_us) {
+    gint64 duration_us = priv->commit_us - start_us;
+
+    if (duration_us > priv->render_estimate_us)
+      priv->render_estimate_us = duration_us;
+    else
+      priv->render_estimate_us += (duration_us - priv->render_estimate_us) / 8;
+  }
+
+  send_frame_done (self);
+
+  /* Want frame clock ticking as long as we have frame callbacks */
+  if (priv->n_frame_callbacks)
+    wlr_output_schedule_frame (self->wlr_output);
+}
+
+
+static gboolean
+on_repaint_timeout (gpointer data)
+{
+  PhocOutput *self = PHOC_OUTPUT (data);
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  phoc_frame_stats_record (priv->frame_stats, PHOC_FRAME_STATS_METRIC_WAKEUP,
+                           MAX (g_get_monotonic_time () - priv->repaint_deadline_us, 0));
+  priv->repaint_id = 0;
+  phoc_output_repaint (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * How long to delay the repaint so it finishes right before the
+ * next vblank, leaving a margin for render time spikes. This gives
+ * clients committing late in the refresh cycle the chance to make it
+ * into the current frame.
+ */
+static gint64
+get_next_vblank_us (PhocOutput *self, gint64 now_us)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gint64 next_vblank_us;
+
+  if (priv->refresh_us <= 0 || !priv->last_present_us)
+    return 0;
+
+  next_vblank_us = priv->last_present_us + priv->refresh_us;
+  if (next_vblank_us <= now_us)
+    next_vblank_us += ((now_us - next_vblank_us) / priv->refresh_us + 1) * priv->refresh_us;
+
+  return next_vblank_us;
+}
+
+/*
+ * When the frame started at @now_us will likely be shown. Animations
+ * are advanced to that time rather than to when their frame callback
+ * happens to run so they stay in step with the display even when
+ * callbacks run at varying points of the refresh cycle.
+ */
+static gint64
+predict_presentation_us (PhocOutput *self, gint64 now_us)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gint64 predicted_us = 0;
+
+  /* Without a fixed refresh rate the frame is shown once it's ready */
+  if (self->wlr_output->adaptive_sync_status != WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED)
+    predicted_us = get_next_vblank_us (self, now_us);
+
+  if (!predicted_us)
+    predicted_us = now_us;
+
+  /* Never run the clock backwards, e.g. with two frames in one refresh cycle */
+  return MAX (predicted_us, priv->last_frame_us);
+}
+
+
+/*
+ * Frames only background clients damaged are repainted right before
+ * the deadline even without a configured margin. This leaves the start
+ * of the refresh cycle to the shell and the focused client and lets
+ * their commits still make it into the frame.
+ */
+static gint64
+get_deadline_margin_us (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  if (priv->deadline_margin_us > 0)
+    return priv->deadline_margin_us;
+
+  if (priv->background_damage && !priv->priority_damage && !priv->n_frame_callbacks)
+    return PHOC_BACKGROUND_DEADLINE_MARGIN_US;
+
+  return 0;
+}
+
+
+static gint64
+get_repaint_delay_us (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gint64 now_us, next_vblank_us, delay_us, margin_us;
+
+  margin_us = get_deadline_margin_us (self);
+  if (margin_us <= 0)
+    return 0;
+
+  /* Without a fixed refresh rate present as soon as clients commit */
+  if (self->wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED)
+    return 0;
+
+  now_us = g_get_monotonic_time ();
+  next_vblank_us = get_next_vblank_us (self, now_us);
+  if (!next_vblank_us)
+    return 0;
+
+  delay_us = next_vblank_us - now_us - priv->render_estimate_us - margin_us;
+  return MAX (delay_us, 0);
+}
+
+
+static void
+phoc_output_handle_frame (struct wl_listener *listener, void *data)
+{
+  PhocOutputPrivate *priv = wl_container_of (listener, priv, frame);
+  PhocOutput *self = PHOC_OUTPUT_SELF (priv);
+  PhocTimelineTrace *timeline;
+  gint64 delay_us, frame_time_us, end_us;
+
+  /* Idle frames of disabled outputs */
+  if (priv->dormant)
+    return;
+
+  /* A repaint is scheduled already */
+  if (priv->repaint_id)
+    return;
+
+  priv->frame_us = g_get_monotonic_time ();
+  frame_time_us = predict_presentation_us (self, priv->frame_us);
+
+  /*
+   * Process all registered frame callbacks. Callbacks can add and
+   * remove callbacks so look up the slot by index on each step. Ones
+   * added in this tick run in the next one.
+   */
+  priv->frame_tick++;
+  for (guint i = 0; i < priv->frame_callbacks->len; i++) {
+    PhocOutputFrameCallbackInfo *cb_info = get_frame_callback (priv, i);
+    guint16 generation = cb_info->generation;
+    gboolean ret;
+
+    if (!cb_info->used || cb_info->added_tick == priv->frame_tick)
+      continue;
+
+    ret = cb_info->callback (cb_info->animatable, priv->last_frame_us, frame_time_us,
+                             cb_info->user_data);
+
+    /* The callback might have removed itself already */
+    cb_info = get_frame_callback (priv, i);
+    if (ret == G_SOURCE_REMOVE && cb_info->used && cb_info->generation == generation)
+      phoc_output_frame_callback_clear (priv, i);
+  }
+  priv->last_frame_us = frame_time_us;
+  end_us = g_get_monotonic_time ();
+  phoc_frame_stats_record (priv->frame_stats, PHOC_FRAME_STATS_METRIC_FRAME_CALLBACKS,
+                           end_us - priv->frame_us);
+  timeline = phoc_server_get_timeline_trace (phoc_server_get_default ());
+  if (G_UNLIKELY (timeline && priv->n_frame_callbacks)) {
+    phoc_timeline_trace_add_span (timeline, self->wlr_output->name, "frame-callbacks",
+                                  priv->frame_us, end_us, "callbacks", priv->n_frame_callbacks);
+  }
+  phoc_thread_priority_update (phoc_server_get_thread_priority (phoc_server_get_default ()));
+
+  delay_us = get_repaint_delay_us (self);
+  if (delay_us >= 1000) {
+    priv->repaint_deadline_us = g_get_monotonic_time () + delay_us / 1000 * 1000;
+    priv->repaint_id = g_timeout_add_full (G_PRIORITY_HIGH, delay_us / 1000,
+                                           on_repaint_timeout, self, NULL);
+    g_source_set_name_by_id (priv->repaint_id, "[phoc] repaint");
+    return;
+  }
+
+  phoc_output_repaint (self);
+}
+
+
+static void
+phoc_output_handle_present (struct wl_listener *listener, void *data)
+{
+  PhocOutputPrivate *priv = wl_container_of (listener, priv, present);
+  PhocOutput *self = PHOC_OUTPUT_SELF (priv);
+  PhocInputLatency *input_latency = phoc_server_get_input_latency (phoc_server_get_default ());
+  struct wlr_output_event_present *event = data;
+  gint64 presented_us, latency_us, refresh_us;
+
+  if (event->presented && event->when) {
+    if (G_UNLIKELY (!priv->last_present_us))
+      phoc_server_mark_startup_phase (phoc_server_get_default (), "first-frame");
+    priv->last_present_us = event->when->tv_sec * G_USEC_PER_SEC + event->when->tv_nsec / 1000;
+    priv->refresh_us = event->refresh / 1000;
+
+    phoc_frame_stats_record (priv->frame_stats, PHOC_FRAME_STATS_METRIC_WAKEUP,
+                             MAX (g_get_monotonic_time () - priv->last_present_us, 0));
+
+    if (G_UNLIKELY (input_latency))
+      phoc_input_latency_output_presented (input_latency, self, priv->last_present_us);
+  }
+
+  if (!priv->commit_us)
+    return;
+
+  if (!event->presented || !event->when)
+    goto out;
+
+  presented_us = priv->last_present_us;
+  phoc_frame_stats_record (priv->frame_stats, PHOC_FRAME_STATS_METRIC_COMMIT,
+                           presented_us - priv->commit_us);
+
+  /* A frame should hit the vblank following the frame event */
+  refresh_us = event->refresh / 1000;
+  if (refresh_us > 0 && priv->frame_us) {
+    gint64 n_vblanks;
+
+    latency_us = presented_us - priv->frame_us;
+    n_vblanks = (latency_us + refresh_us / 2) / refresh_us;
+    if (n_vblanks > 1)
+      phoc_frame_stats_add_missed_vblanks (priv->frame_stats, n_vblanks - 1);
+  }
+
+ out:
+  priv->commit_us = 0;
+  priv->frame_us = 0;
+}
+
+
+static void
+phoc_output_handle_needs_frame (struct wl_listener *listener, void *user_data)
+{
+  PhocOutputPrivate *priv = wl_container_of (listener, priv, needs_frame);
+  PhocOutput *self = PHOC_OUTPUT_SELF (priv);
+
+  wlr_output_schedule_frame (self->wlr_output);
+}
+
+
+static void
+update_output_scale_iterator (PhocOutput         *self,
+                              struct wlr_surface *wlr_surface,
+                              struct wlr_box     *box,
+                              float               scale,
+                              void               *user_data)
+
+
+{
+  phoc_utils_wlr_surface_update_scales (wlr_surface, scale);
+}
+
+
+/*
+ * Only monitors driven by DRM are identified by make, model and
+ * serial. Built-in panels aren't hotplugged and their transform
+ * follows the device's rotation so restoring it on the next start
+ * would be wrong.
+ */
+static char *
+get_state_cache_identity (PhocOutput *self)
+{
+  if (!wlr_output_is_drm (self->wlr_output) || phoc_output_is_builtin (self))
+    return NULL;
+
+  return phoc_output_state_cache_get_identity (self->wlr_output);
+}
+
+
+static void
+phoc_output_handle_commit (struct wl_listener *listener, void *data)
+{
+  PhocOutput *self = wl_container_of (listener, self, commit);
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  struct wlr_output_event_commit *event = data;
+
+  if (event->state->committed & (WLR_OUTPUT_STATE_MODE |
+                                 WLR_OUTPUT_STATE_SCALE |
+                                 WLR_OUTPUT_STATE_TRANSFORM)) {
+    phoc_output_queue_arrange_layers (self);
+  }
+
+  if (event->state->committed & WLR_OUTPUT_STATE_MODE) {
+    struct wlr_output_mode *mode = self->wlr_output->current_mode;
+
+    priv->pending_mode = NULL;
+    /* Someone else picked a new mode */
+    if (mode != priv->active_mode && mode != priv->idle_mode)
+      update_refresh_modes (self);
+    if (mode == priv->active_mode)
+      note_activity (self, FALSE);
+  }
+
+  if (event->state->committed & (WLR_OUTPUT_STATE_ENABLED |
+                                 WLR_OUTPUT_STATE_MODE |
                                  WLR_OUTPUT_STATE_SCALE |
                                  WLR_OUTPUT_STATE_TRANSFORM)) {
     update_output_manager_config (self->desktop);
+    /* Don't remember the temporary reduced refresh rate */
+    if (!priv->idle_mode || self->wlr_output->current_mode != priv->idle_mode) {
+      g_autofree char *identity = get_state_cache_identity (self);
+
+      if (identity) {
+        phoc_output_state_cache_store (phoc_desktop_get_output_state_cache (self->desktop),
+                                       identity, self->wlr_output);
+      }
+    }
+  }
+
+  /* The driver might hand out new buffers */
+  if (event->state->committed & (WLR_OUTPUT_STATE_ENABLED |
+                                 WLR_OUTPUT_STATE_MODE |
+                                 WLR_OUTPUT_STATE_RENDER_FORMAT |
+                                 WLR_OUTPUT_STATE_TRANSFORM)) {
+    priv->rendered_frames = 0;
   }
 
   if (event->state->committed & (WLR_OUTPUT_STATE_MODE |
@@ -643,12 +2268,26 @@ phoc_output_handle_commit (struct wl_listener *listener, void *data)
     wlr_output_schedule_frame (self->wlr_output);
   }
 
+  if (event->state->committed & WLR_OUTPUT_STATE_ENABLED) {
+    set_dormant (self, !self->wlr_output->enabled,
+                 !!(event->state->committed & WLR_OUTPUT_STATE_BUFFER));
+  }
+
   if (event->state->committed & WLR_OUTPUT_STATE_ENABLED && self->wlr_output->enabled) {
+    /* The output might be driven by a different CRTC now */
+    priv->gamma_lut = (PhocGammaLutKey) { 0 };
+    priv->gamma_lut_unsupported = FALSE;
     priv->gamma_lut_changed = TRUE;
     wlr_output_schedule_frame (self->wlr_output);
+
+    /* The primary plane's formats might differ as well */
+    if (self->fullscreen_view) {
+      phoc_server_set_linux_dmabuf_surface_feedback (phoc_server_get_default (),
+                                                     self->fullscreen_view, self, true);
+    }
   }
 
-  if (event->state->committed & WLR_OUTPUT_STATE_SCALE)
+  if (event->state->committed & (WLR_OUTPUT_STATE_SCALE | WLR_OUTPUT_STATE_TRANSFORM))
     phoc_output_for_each_surface (self, update_output_scale_iterator, NULL, FALSE);
 }
 
@@ -760,6 +2399,42 @@ adjust_frac_scale (double scale)
 }
 
 
+/* Config reloads pass the same modelines again */
+static void
+add_mode (PhocOutput *self, const drmModeModeInfo *info)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  if (!priv->added_modes)
+    priv->added_modes = g_array_new (FALSE, FALSE, sizeof (drmModeModeInfo));
+
+  for (guint i = 0; i < priv->added_modes->len; i++) {
+    if (memcmp (&g_array_index (priv->added_modes, drmModeModeInfo, i), info, sizeof (*info)) == 0)
+      return;
+  }
+
+  if (wlr_drm_connector_add_mode (self->wlr_output, info))
+    g_array_append_vals (priv->added_modes, info, 1);
+}
+
+
+static void
+update_layout_position (PhocOutput *self, PhocOutputConfig *output_config)
+{
+  if (!self->wlr_output->enabled) {
+    wlr_output_layout_remove (self->desktop->layout, self->wlr_output);
+    return;
+  }
+
+  if (output_config && output_config->x > 0 && output_config->y > 0) {
+    wlr_output_layout_add (self->desktop->layout, self->wlr_output, output_config->x,
+                           output_config->y);
+  } else {
+    wlr_output_layout_add_auto (self->desktop->layout, self->wlr_output);
+  }
+}
+
+
 static void
 phoc_output_fill_state (PhocOutput              *self,
                         PhocOutputConfig        *output_config,
@@ -767,6 +2442,7 @@ phoc_output_fill_state (PhocOutput              *self,
 {
   PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
   struct wlr_output_mode *preferred_mode = wlr_output_preferred_mode (self->wlr_output);
+  g_autofree char *identity = get_state_cache_identity (self);
   gboolean enable = FALSE;
 
   wlr_output_state_init (pending);
@@ -786,7 +2462,8 @@ phoc_output_fill_state (PhocOutput              *self,
 
       for (GSList *l = output_config->modes; l; l = l->next) {
         PhocOutputModeConfig *mode_config = l->data;
-        wlr_drm_connector_add_mode (self->wlr_output, &mode_config->info);
+
+        add_mode (self, &mode_config->info);
       }
     } else if (output_config->modes != NULL) {
       g_warning ("Can only add modes for DRM backend");
@@ -812,6 +2489,38 @@ phoc_output_fill_state (PhocOutput              *self,
 
     wlr_output_state_set_transform (pending, transform);
     priv->scale_filter = output_config->scale_filter;
+
+    if (output_config->render_format != DRM_FORMAT_INVALID) {
+      wlr_output_state_set_render_format (pending, output_config->render_format);
+      if (!wlr_output_test_state (self->wlr_output, pending)) {
+        g_warning ("Render format 0x%08x not supported by %s, using default",
+                   output_config->render_format, self->wlr_output->name);
+        pending->committed &= ~WLR_OUTPUT_STATE_RENDER_FORMAT;
+      }
+    }
+
+    priv->idle_refresh_rate = output_config->idle_refresh_rate;
+    priv->idle_frames = output_config->idle_frames;
+    priv->buffer_count = output_config->buffer_count;
+
+    priv->adaptive_sync = output_config->adaptive_sync;
+    if (priv->adaptive_sync != PHOC_OUTPUT_ADAPTIVE_SYNC_OFF) {
+      wlr_output_state_set_adaptive_sync_enabled (pending, true);
+      if (!wlr_output_test_state (self->wlr_output, pending)) {
+        g_warning ("Adaptive sync not supported by %s", self->wlr_output->name);
+        priv->adaptive_sync = PHOC_OUTPUT_ADAPTIVE_SYNC_OFF;
+        pending->committed &= ~WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED;
+      } else if (priv->adaptive_sync == PHOC_OUTPUT_ADAPTIVE_SYNC_AUTO) {
+        /* Only enabled once there's content that benefits */
+        wlr_output_state_set_adaptive_sync_enabled (pending, false);
+      }
+    }
+  } else if (enable && identity &&
+             phoc_output_state_cache_restore (phoc_desktop_get_output_state_cache (self->desktop),
+                                              identity, self->wlr_output, pending) &&
+             wlr_output_test_state (self->wlr_output, pending)) {
+    /* Known monitor, use what was committed last time */
+    g_debug ("Restored last used mode, scale and transform for %s", self->wlr_output->name);
   } else if (enable) {
     enum wl_output_transform transform = WL_OUTPUT_TRANSFORM_NORMAL;
 
@@ -840,13 +2549,55 @@ phoc_output_fill_state (PhocOutput              *self,
     wlr_output_state_set_scale (pending, phoc_output_compute_scale (self, pending));
     wlr_output_state_set_transform (pending, transform);
   }
+}
 
-  if (output_config && output_config->x > 0 && output_config->y > 0) {
-    wlr_output_layout_add (self->desktop->layout, self->wlr_output, output_config->x,
-                           output_config->y);
-  } else {
-    wlr_output_layout_add_auto (self->desktop->layout, self->wlr_output);
+
+/**
+ * phoc_output_apply_config:
+ * @self: The output
+ * @output_config: (nullable): The output's configuration
+ *
+ * Applies a changed configuration to an output that is already set
+ * up, e.g. after the config file got reloaded.
+ */
+void
+phoc_output_apply_config (PhocOutput *self, PhocOutputConfig *output_config)
+{
+  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
+  struct wlr_output_state pending;
+  int width, height;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  phoc_output_fill_state (self, output_config, &pending);
+  if (!wlr_output_commit_state (self->wlr_output, &pending)) {
+    g_warning ("Failed to apply configuration to %s", self->wlr_output->name);
+    wlr_output_state_finish (&pending);
+    return;
+  }
+  wlr_output_state_finish (&pending);
+
+  update_layout_position (self, output_config);
+  phoc_output_update_layout_box (self);
+
+  if (self->fullscreen_view)
+    phoc_view_set_fullscreen (self->fullscreen_view, true, self);
+
+  /* The scale might have changed */
+  for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next) {
+    PhocSeat *seat = PHOC_SEAT (elem->data);
+
+    phoc_cursor_configure_xcursor (seat->cursor);
   }
+
+  wlr_output_transformed_resolution (self->wlr_output, &width, &height);
+  wlr_damage_ring_set_bounds (&self->damage_ring, width, height);
+
+  phoc_layer_shell_arrange (self);
+  phoc_layer_shell_update_focus ();
+  phoc_output_damage_whole (self);
+
+  update_output_manager_config (self->desktop);
 }
 
 
@@ -860,7 +2611,6 @@ phoc_output_initable_init (GInitable    *initable,
   PhocRenderer *renderer = phoc_server_get_renderer (server);
   PhocOutput *self = PHOC_OUTPUT (initable);
   PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
-  struct wlr_box output_box;
   int width, height;
 
   PhocConfig *config = phoc_server_get_config (phoc_server_get_default ());
@@ -897,14 +2647,22 @@ phoc_output_initable_init (GInitable    *initable,
   priv->request_state.notify = handle_request_state;
   wl_signal_add (&self->wlr_output->events.request_state, &priv->request_state);
 
+  priv->present.notify = phoc_output_handle_present;
+  wl_signal_add (&self->wlr_output->events.present, &priv->present);
+
+  priv->damage_max_waste = config->damage_max_waste;
+  priv->damage_max_rects = config->damage_max_rects;
+  priv->deadline_margin_us = config->frame_deadline_margin_us;
+
   PhocOutputConfig *output_config = phoc_config_get_output (config, self);
   struct wlr_output_state pending;
   phoc_output_fill_state (self, output_config, &pending);
 
-  wlr_output_commit_state (self->wlr_output, &pending);
-  wlr_output_layout_get_box (self->desktop->layout, self->wlr_output, &output_box);
-  self->lx = output_box.x;
-  self->ly = output_box.y;
+  if (wlr_output_commit_state (self->wlr_output, &pending))
+    update_layout_position (self, output_config);
+  else
+    g_warning ("Failed to configure %s", self->wlr_output->name);
+  phoc_output_update_layout_box (self);
 
   for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next) {
     PhocSeat *seat = PHOC_SEAT (elem->data);
@@ -924,16 +2682,11 @@ phoc_output_initable_init (GInitable    *initable,
   wlr_damage_ring_set_bounds (&self->damage_ring, width, height);
 
   if (phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_CUTOUTS)) {
-    priv->cutouts = phoc_cutouts_overlay_new (phoc_server_get_compatibles (server));
-    if (priv->cutouts) {
-      g_message ("Adding cutouts overlay");
-      priv->cutouts_texture = phoc_cutouts_overlay_get_cutouts_texture (priv->cutouts, self);
-      priv->render_cutouts_id = g_signal_connect_swapped (renderer, "render-end",
-                                                          G_CALLBACK (render_cutouts),
-                                                          self);
-    } else {
-      g_warning ("Could not create cutout overlay");
-    }
+    priv->render_cutouts_id = phoc_renderer_add_render_hook (renderer,
+                                                             self,
+                                                             PHOC_RENDER_HOOK_ORDER_CUTOUTS,
+                                                             render_cutouts,
+                                                             self);
   }
 
   wlr_output_state_finish (&pending);
@@ -970,22 +2723,43 @@ phoc_output_finalize (GObject *object)
   wl_list_remove (&priv->damage.link);
   wl_list_remove (&priv->frame.link);
   wl_list_remove (&priv->needs_frame.link);
+  wl_list_remove (&priv->present.link);
   wlr_damage_ring_finish (&self->damage_ring);
 
-  g_clear_list (&self->debug_touch_points, g_free);
+  g_clear_pointer (&priv->planes, phoc_output_planes_free);
+  g_clear_pointer (&priv->added_modes, g_array_unref);
+  g_clear_pointer (&priv->magnifier, phoc_magnifier_free);
+  g_clear_pointer (&priv->wake_buffer, wlr_buffer_unlock);
+  g_clear_pointer (&priv->occluded_surfaces, g_hash_table_destroy);
+  g_clear_handle_id (&priv->repaint_id, g_source_remove);
+  g_clear_handle_id (&priv->idle_refresh_id, g_source_remove);
+  g_clear_handle_id (&priv->arrange_layers_id, g_source_remove);
   /* Remove all frame callbacks, this will also free associated user data */
-  g_clear_slist (&priv->frame_callbacks,
-                 (GDestroyNotify)phoc_output_frame_callback_info_free);
+  for (guint i = 0; i < priv->frame_callbacks->len; i++) {
+    if (get_frame_callback (priv, i)->used)
+      phoc_output_frame_callback_clear (priv, i);
+  }
+  g_clear_pointer (&priv->frame_callbacks, g_array_unref);
+  g_clear_pointer (&priv->frame_callbacks_free, g_array_unref);
 
   wl_list_init (&self->layer_surfaces);
   for (int i = 0; i < G_N_ELEMENTS (priv->layer_surfaces); i++)
     g_clear_pointer (&priv->layer_surfaces[i], g_queue_free);
+  g_clear_weak_pointer (&priv->osk);
+  g_clear_weak_pointer (&priv->rendered_view);
 
-  g_clear_signal_handler (&priv->render_cutouts_id, priv->renderer);
+  clear_render_cutouts (self);
   g_clear_object (&priv->renderer);
   g_clear_object (&priv->cutouts);
-  g_clear_pointer (&priv->cutouts_texture, wlr_texture_destroy);
   g_clear_object (&priv->shield);
+  g_clear_object (&priv->overview);
+  g_clear_pointer (&priv->frame_stats, phoc_frame_stats_free);
+  g_clear_pointer (&priv->input_latency_pending, g_array_unref);
+  g_clear_pointer (&priv->gpu_timer, phoc_gpu_timer_free);
+  g_clear_pointer (&priv->damage_heatmap, phoc_damage_heatmap_free);
+  g_clear_pointer (&priv->layer_cache, phoc_layer_cache_free);
+  g_clear_pointer (&priv->frame_summary, g_array_unref);
+  g_clear_pointer (&priv->rendered_summary, g_array_unref);
   g_clear_object (&self->desktop);
 
   G_OBJECT_CLASS (phoc_output_parent_class)->finalize (object);
@@ -1130,18 +2904,15 @@ phoc_output_view_for_each_surface (PhocOutput          *self,
                                    PhocSurfaceIterator  iterator,
                                    void                *user_data)
 {
-  struct wlr_box output_box;
-  wlr_output_layout_get_box (self->desktop->layout, self->wlr_output, &output_box);
-
-  if (wlr_box_empty (&output_box))
+  if (wlr_box_empty (&self->layout_box))
     return;
 
   PhocOutputSurfaceIteratorData data = {
     .user_iterator = iterator,
     .user_data = user_data,
     .output = self,
-    .ox = view->box.x - output_box.x,
-    .oy = view->box.y - output_box.y,
+    .ox = view->box.x - self->layout_box.x,
+    .oy = view->box.y - self->layout_box.y,
     .width = view->box.width,
     .height = view->box.height,
     .scale = phoc_view_get_scale (view)
@@ -1150,39 +2921,79 @@ phoc_output_view_for_each_surface (PhocOutput          *self,
   phoc_view_for_each_surface (view, phoc_output_for_each_surface_iterator, &data);
 }
 
+/**
+ * phoc_output_view_for_each_surface_in_box:
+ * @self: the output
+ * @view: The [type@View]
+ * @box: The box in output local layout coordinates
+ * @iterator: (scope call): The callback invoked on each iteration
+ * @user_data: Callback user data
+ *
+ * Iterate over surfaces in a [type@View]s surface tree as if the view
+ * was scaled to fit into @box keeping its aspect ratio and centered
+ * in it. The view's position in the layout doesn't matter.
+ */
+void
+phoc_output_view_for_each_surface_in_box (PhocOutput           *self,
+                                          PhocView             *view,
+                                          const struct wlr_box *box,
+                                          PhocSurfaceIterator   iterator,
+                                          void                 *user_data)
+{
+  struct wlr_box geo;
+  float scale;
+
+  phoc_view_get_geometry (view, &geo);
+  if (wlr_box_empty (&geo) || wlr_box_empty (box))
+    return;
+
+  scale = MIN ((float)box->width / geo.width, (float)box->height / geo.height);
+
+  PhocOutputSurfaceIteratorData data = {
+    .user_iterator = iterator,
+    .user_data = user_data,
+    .output = self,
+    .ox = (box->x + (box->width - geo.width * scale) / 2) / scale - geo.x,
+    .oy = (box->y + (box->height - geo.height * scale) / 2) / scale - geo.y,
+    .width = geo.width,
+    .height = geo.height,
+    .scale = scale,
+  };
+
+  phoc_view_for_each_surface (view, phoc_output_for_each_surface_iterator, &data);
+}
+
 #ifdef PHOC_XWAYLAND
 /**
  * phoc_output_xwayland_children_for_each_surface:
  * @self: the output
- * @surface: The wlr_xwayland_surface
+ * @surface: The xwayland surface
  * @iterator: (scope call): The callback invoked on each iteration
  * @user_data: Callback user data
  *
- * Iterate over children of a `wlr_xwayland_surface`.
+ * Iterate over the mapped children of an xwayland surface. This
+ * returns right away if there are none.
  */
 void
-phoc_output_xwayland_children_for_each_surface (PhocOutput                  *self,
-                                                struct wlr_xwayland_surface *surface,
-                                                PhocSurfaceIterator          iterator,
-                                                void                        *user_data)
+phoc_output_xwayland_children_for_each_surface (PhocOutput          *self,
+                                                PhocXWaylandSurface *surface,
+                                                PhocSurfaceIterator  iterator,
+                                                void                *user_data)
 {
-  struct wlr_box output_box;
-  wlr_output_layout_get_box (self->desktop->layout, self->wlr_output, &output_box);
+  GPtrArray *children = phoc_xwayland_surface_get_mapped_children (surface);
+
+  if (children->len == 0)
+    return;
 
-  if (wlr_box_empty (&output_box))
+  if (wlr_box_empty (&self->layout_box))
     return;
 
-  struct wlr_xwayland_surface *child;
+  for (guint i = 0; i < children->len; i++) {
+    struct wlr_xwayland_surface *child = g_ptr_array_index (children, i);
+    double ox = child->x - self->layout_box.x;
+    double oy = child->y - self->layout_box.y;
 
-  wl_list_for_each (child, &surface->children, parent_link) {
-    if (child->surface && child->surface->mapped) {
-      double ox = child->x - output_box.x;
-      double oy = child->y - output_box.y;
-      phoc_output_surface_for_each_surface (self, child->surface, ox, oy, iterator,
-                                            user_data);
-    }
-    phoc_output_xwayland_children_for_each_surface (self, child,
-                                                    iterator, user_data);
+    phoc_output_surface_for_each_surface (self, child->surface, ox, oy, iterator, user_data);
   }
 }
 #endif
@@ -1270,6 +3081,7 @@ phoc_output_get_layer_surfaces_for_layer (PhocOutput *self, enum zwlr_layer_shel
   PhocLayerSurface *layer_surface;
   PhocOutputPrivate *priv;
   g_autoptr (GQueue) queue = NULL;
+  g_autoptr (GHashTable) links = NULL;
 
   g_assert (PHOC_IS_OUTPUT (self));
   priv = phoc_output_get_instance_private (self);
@@ -1295,6 +3107,11 @@ phoc_output_get_layer_surfaces_for_layer (PhocOutput *self, enum zwlr_layer_shel
       g_queue_push_head (queue, layer_surface);
   }
 
+  /* Links stay valid when moved around so look them up once */
+  links = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (GList *l = queue->head; l; l = l->next)
+    g_hash_table_insert (links, l->data, l);
+
   GSList *stacks = phoc_desktop_get_layer_surface_stacks (desktop);
   for (GSList *s = stacks; s; s = s->next) {
     PhocStackedLayerSurface *stack = s->data;
@@ -1325,24 +3142,24 @@ phoc_output_get_layer_surfaces_for_layer (PhocOutput *self, enum zwlr_layer_shel
       continue;
     }
 
-    stacked_link = g_queue_find (queue, stacked);
+    stacked_link = g_hash_table_lookup (links, stacked);
     g_assert (stacked_link);
     g_queue_unlink (queue, stacked_link);
 
-    target_link = g_queue_find (queue, target);
+    target_link = g_hash_table_lookup (links, target);
     g_assert (target_link);
 
     switch (phoc_stacked_layer_surface_get_position (stack)) {
     case PHOC_STACKED_SURFACE_STACK_BELOW:
-      g_debug ("Stacking '%s' below '%s'",
-               PHOC_LAYER_SURFACE (stacked_link->data)->layer_surface->namespace,
-               PHOC_LAYER_SURFACE (target_link->data)->layer_surface->namespace);
+      phoc_debug_hot (PHOC_LOG_HOT_LAYERS, "Stacking '%s' below '%s'",
+                      PHOC_LAYER_SURFACE (stacked_link->data)->layer_surface->namespace,
+                      PHOC_LAYER_SURFACE (target_link->data)->layer_surface->namespace);
       g_queue_insert_before_link (queue, target_link, stacked_link);
       break;
     case PHOC_STACKED_SURFACE_STACK_ABOVE:
-      g_debug ("Stacking '%s' above '%s'",
-               PHOC_LAYER_SURFACE (stacked_link->data)->layer_surface->namespace,
-               PHOC_LAYER_SURFACE (target_link->data)->layer_surface->namespace);
+      phoc_debug_hot (PHOC_LOG_HOT_LAYERS, "Stacking '%s' above '%s'",
+                      PHOC_LAYER_SURFACE (stacked_link->data)->layer_surface->namespace,
+                      PHOC_LAYER_SURFACE (target_link->data)->layer_surface->namespace);
       g_queue_insert_after_link (queue, target_link, stacked_link);
       break;
     default:
@@ -1350,32 +3167,192 @@ phoc_output_get_layer_surfaces_for_layer (PhocOutput *self, enum zwlr_layer_shel
     }
   }
 
-  g_clear_pointer (&priv->layer_surfaces[layer], g_queue_free);
-  priv->layer_surfaces[layer] = g_steal_pointer (&queue);
-  return priv->layer_surfaces[layer];
+  g_clear_pointer (&priv->layer_surfaces[layer], g_queue_free);
+  priv->layer_surfaces[layer] = g_steal_pointer (&queue);
+  return priv->layer_surfaces[layer];
+}
+
+/**
+ * phoc_output_set_layer_dirty:
+ * @self: the output
+ * @layer: The layer to marks as dirty
+ *
+ * Invalidate the ordering of layer surfaces.
+ *
+ * Moving a layer surface between layers or changing the exclusive zone
+ * might affect a layer surfaces position in the stack. Calling this function
+ * invalidates the current ordering and makes sure the ordering is recalculated
+ * on next access.
+ */
+void
+phoc_output_set_layer_dirty (PhocOutput *self, enum zwlr_layer_shell_v1_layer layer)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  g_clear_pointer (&priv->layer_surfaces[layer], g_queue_free);
+}
+
+
+static gboolean
+on_arrange_layers (gpointer data)
+{
+  PhocOutput *self = PHOC_OUTPUT (data);
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  priv->arrange_layers_id = 0;
+
+  /* Arranged synchronously in the meantime */
+  if (priv->arrange_layers_pending)
+    phoc_layer_shell_arrange (self);
+  phoc_layer_shell_update_focus ();
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * phoc_output_queue_arrange_layers:
+ * @self: the output
+ *
+ * Queue arranging the output's layer surfaces and updating the layer
+ * focus from an idle callback. This allows several changes within the
+ * same main loop iteration (e.g. a layer surface unmapping and
+ * another one mapping) to result in a single arrange.
+ */
+void
+phoc_output_queue_arrange_layers (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  if (priv->arrange_layers_pending)
+    phoc_frame_stats_add_arranges_coalesced (priv->frame_stats, 1);
+  priv->arrange_layers_pending = TRUE;
+
+  if (priv->arrange_layers_id)
+    return;
+
+  priv->arrange_layers_id = g_idle_add (on_arrange_layers, self);
+  g_source_set_name_by_id (priv->arrange_layers_id, "[phoc] arrange layers");
+}
+
+/**
+ * phoc_output_clear_queued_arrange_layers:
+ * @self: the output
+ *
+ * Marks a queued arrange as done as the layer surfaces were arranged
+ * synchronously. The queued layer focus update still happens.
+ */
+void
+phoc_output_clear_queued_arrange_layers (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  if (!priv->arrange_layers_pending)
+    return;
+
+  priv->arrange_layers_pending = FALSE;
+  phoc_frame_stats_add_arranges_coalesced (priv->frame_stats, 1);
+}
+
+static gboolean
+is_osk (PhocLayerSurface *layer_surface)
+{
+  return g_strcmp0 (phoc_layer_surface_get_namespace (layer_surface), "osk") == 0;
+}
+
+/**
+ * phoc_output_add_layer_surface:
+ * @self: the output
+ * @layer_surface: The new layer surface
+ *
+ * Adds a layer surface to the output's layer surfaces.
+ */
+void
+phoc_output_add_layer_surface (PhocOutput *self, PhocLayerSurface *layer_surface)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  wl_list_insert (&self->layer_surfaces, &layer_surface->link);
+  phoc_output_set_layer_dirty (self, layer_surface->layer);
+
+  /* The namespace can't change so the most recent OSK wins */
+  if (is_osk (layer_surface)) {
+    g_set_weak_pointer (&priv->osk, layer_surface);
+    priv->osk_valid = TRUE;
+  }
+}
+
+/**
+ * phoc_output_remove_layer_surface:
+ * @self: the output
+ * @layer_surface: The layer surface that goes away
+ *
+ * Drop a layer surface from the ordered layer surfaces. Unlike
+ * [method@Output.set_layer_dirty] this keeps the order of the remaining
+ * surfaces so it doesn't need to be recalculated.
+ */
+void
+phoc_output_remove_layer_surface (PhocOutput *self, PhocLayerSurface *layer_surface)
+{
+  PhocOutputPrivate *priv;
+  GQueue *queue;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  queue = priv->layer_surfaces[layer_surface->layer];
+  if (queue)
+    g_queue_remove (queue, layer_surface);
+
+  if (priv->osk == layer_surface || (!priv->osk && is_osk (layer_surface))) {
+    g_clear_weak_pointer (&priv->osk);
+    priv->osk_valid = FALSE;
+  }
 }
 
 /**
- * phoc_output_set_layer_dirty:
+ * phoc_output_get_osk:
  * @self: the output
- * @layer: The layer to marks as dirty
  *
- * Invalidate the ordering of layer surfaces.
+ * Gets the on screen keyboard's layer surface on this output. The
+ * surface is tracked as layer surfaces come and go so this doesn't
+ * need to look at the other layer surfaces.
  *
- * Moving a layer surface between layers or changing the exclusive zone
- * might affect a layer surfaces position in the stack. Calling this function
- * invalidates the current ordering and makes sure the ordering is recalculated
- * on next access.
+ * Returns:(transfer none)(nullable): The OSK's layer surface or %NULL
  */
-void
-phoc_output_set_layer_dirty (PhocOutput *self, enum zwlr_layer_shell_v1_layer layer)
+PhocLayerSurface *
+phoc_output_get_osk (PhocOutput *self)
 {
   PhocOutputPrivate *priv;
+  PhocLayerSurface *layer_surface;
 
   g_assert (PHOC_IS_OUTPUT (self));
   priv = phoc_output_get_instance_private (self);
 
-  g_clear_pointer (&priv->layer_surfaces[layer], g_queue_free);
+  if (priv->osk_valid)
+    return priv->osk;
+
+  g_clear_weak_pointer (&priv->osk);
+  wl_list_for_each (layer_surface, &self->layer_surfaces, link) {
+    if (is_osk (layer_surface)) {
+      g_set_weak_pointer (&priv->osk, layer_surface);
+      break;
+    }
+  }
+  priv->osk_valid = TRUE;
+
+  return priv->osk;
 }
 
 /**
@@ -1393,10 +3370,7 @@ phoc_output_drag_icons_for_each_surface (PhocOutput          *self,
                                          PhocSurfaceIterator  iterator,
                                          void                *user_data)
 {
-  struct wlr_box output_box;
-  wlr_output_layout_get_box (self->desktop->layout, self->wlr_output, &output_box);
-
-  if (wlr_box_empty (&output_box))
+  if (wlr_box_empty (&self->layout_box))
     return;
 
   for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next) {
@@ -1407,8 +3381,8 @@ phoc_output_drag_icons_for_each_surface (PhocOutput          *self,
     if (!phoc_drag_icon_is_mapped (drag_icon))
       continue;
 
-    double ox = phoc_drag_icon_get_x (drag_icon) - output_box.x;
-    double oy = phoc_drag_icon_get_y (drag_icon) - output_box.y;
+    double ox = phoc_drag_icon_get_x (drag_icon) - self->layout_box.x;
+    double oy = phoc_drag_icon_get_y (drag_icon) - self->layout_box.y;
     phoc_output_surface_for_each_surface (self, phoc_drag_icon_get_wlr_surface (drag_icon),
                                           ox, oy, iterator, user_data);
   }
@@ -1423,12 +3397,13 @@ phoc_output_drag_icons_for_each_surface (PhocOutput          *self,
  *
  * Iterate over surfaces on the output.
  */
-static void
+void
 phoc_output_for_each_surface (PhocOutput          *self,
                               PhocSurfaceIterator  iterator,
                               void                *user_data,
                               gboolean             visible_only)
 {
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
   PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
   PhocDesktop *desktop = self->desktop;
 
@@ -1438,11 +3413,9 @@ phoc_output_for_each_surface (PhocOutput          *self,
     phoc_output_view_for_each_surface (self, view, iterator, user_data);
 
 #ifdef PHOC_XWAYLAND
-    if (PHOC_IS_XWAYLAND_SURFACE (view)) {
-      struct wlr_xwayland_surface *xsurface =
-        phoc_xwayland_surface_get_wlr_surface (PHOC_XWAYLAND_SURFACE (view));
-      phoc_output_xwayland_children_for_each_surface (self, xsurface, iterator, user_data);
-    }
+    if (PHOC_IS_XWAYLAND_SURFACE (view))
+      phoc_output_xwayland_children_for_each_surface (self, PHOC_XWAYLAND_SURFACE (view),
+                                                      iterator, user_data);
 #endif
   } else {
     for (GList *l = phoc_desktop_get_views (desktop)->tail; l; l = l->prev) {
@@ -1453,6 +3426,10 @@ phoc_output_for_each_surface (PhocOutput          *self,
     }
   }
 
+  /* Placed views aren't necessarily visible in the layout */
+  if (priv->overview)
+    phoc_overview_for_each_surface (priv->overview, iterator, user_data);
+
   phoc_output_drag_icons_for_each_surface (self, input, iterator, user_data);
 
   for (enum zwlr_layer_shell_v1_layer layer = ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND;
@@ -1461,17 +3438,81 @@ phoc_output_for_each_surface (PhocOutput          *self,
   }
 }
 
+/**
+ * phoc_output_surface_presented:
+ * @self: The output
+ * @surface: The surface that is part of the output's next frame
+ * @presentation: How the surface's buffer is presented
+ *
+ * Sets up presentation feedback for @surface. Only buffers that end
+ * up on a KMS plane get the zero-copy flag so clients can tell
+ * whether they're composited and pace their rendering accordingly.
+ * The refresh interval is filled in by wlroots once the frame got
+ * presented.
+ */
+void
+phoc_output_surface_presented (PhocOutput             *self,
+                               struct wlr_surface     *surface,
+                               PhocOutputPresentation  presentation)
+{
+  struct wlr_presentation *wlr_presentation = self->desktop->presentation;
+
+  switch (presentation) {
+  case PHOC_OUTPUT_PRESENTATION_COMPOSITED:
+    wlr_presentation_surface_textured_on_output (wlr_presentation, surface, self->wlr_output);
+    break;
+  case PHOC_OUTPUT_PRESENTATION_SCANOUT:
+  case PHOC_OUTPUT_PRESENTATION_PLANE:
+    wlr_presentation_surface_scanned_out_on_output (wlr_presentation, surface, self->wlr_output);
+    break;
+  default:
+    g_assert_not_reached ();
+  }
+}
+
 
 void
 phoc_output_damage_whole (PhocOutput *self)
 {
+  PhocOutputPrivate *priv;
+
   if (self == NULL || self->wlr_output == NULL)
     return;
 
+  priv = phoc_output_get_instance_private (self);
+  priv->priority_damage = TRUE;
+  /* E.g. the fullscreen view got unmapped, can't reuse its last frame */
+  g_clear_weak_pointer (&priv->rendered_view);
   wlr_damage_ring_add_whole (&self->damage_ring);
   wlr_output_schedule_frame (self->wlr_output);
 }
 
+/**
+ * phoc_output_damage_box:
+ * @self: The output to add damage to
+ * @box: The box to damage in output local layout coordinates
+ *
+ * Adds @box to the damaged area of @self and schedules a new frame.
+ * This is useful to damage the area a surface occupied before it
+ * moved.
+ */
+void
+phoc_output_damage_box (PhocOutput *self, const struct wlr_box *box)
+{
+  struct wlr_box scaled = *box;
+  PhocOutputPrivate *priv;
+
+  if (self == NULL || self->wlr_output == NULL)
+    return;
+
+  priv = phoc_output_get_instance_private (self);
+  priv->priority_damage = TRUE;
+
+  phoc_utils_scale_box (&scaled, self->wlr_output->scale);
+  if (wlr_damage_ring_add_box (&self->damage_ring, &scaled))
+    wlr_output_schedule_frame (self->wlr_output);
+}
+
 
 static bool
 phoc_view_accept_damage (PhocOutput *self, PhocView  *view)
@@ -1509,18 +3550,23 @@ static void
 damage_surface_iterator (PhocOutput *self, struct wlr_surface *wlr_surface, struct wlr_box *_box,
                          float scale, void *data)
 {
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
   bool *whole = data;
-
   struct wlr_box box = *_box;
 
-  phoc_utils_scale_box (&box, scale);
-  phoc_utils_scale_box (&box, self->wlr_output->scale);
+  if (phoc_desktop_get_client_priority (self->desktop,
+                                        wl_resource_get_client (wlr_surface->resource)))
+    priv->priority_damage = TRUE;
+  else
+    priv->background_damage = TRUE;
+
+  /* Round like the renderer does so damage and rendered box match */
+  phoc_utils_scale_box (&box, scale * self->wlr_output->scale);
 
   pixman_region32_t damage;
   pixman_region32_init (&damage);
   wlr_surface_get_effective_damage (wlr_surface, &damage);
-  wlr_region_scale (&damage, &damage, scale);
-  wlr_region_scale (&damage, &damage, self->wlr_output->scale);
+  wlr_region_scale (&damage, &damage, scale * self->wlr_output->scale);
   if (ceil (self->wlr_output->scale) > wlr_surface->current.scale) {
     /* When scaling up a surface, it'll become blurry so we need to
      * expand the damage region */
@@ -1595,15 +3641,157 @@ phoc_output_damage_from_view (PhocOutput *self, PhocView  *view, bool whole)
   phoc_output_view_for_each_surface (self, view, damage_surface_iterator, &whole);
 }
 
+/**
+ * phoc_output_damage_from_view_root:
+ * @self: The output to add damage to
+ * @view: The view providing the damage
+ *
+ * Like [method@Output.damage_from_view] with `whole` set to %FALSE
+ * but only adds the buffer damage of @view's root surface, not the
+ * one of its subsurfaces and popups.
+ */
 void
-phoc_output_damage_whole_drag_icon (PhocOutput *self, PhocDragIcon *icon)
+phoc_output_damage_from_view_root (PhocOutput *self, PhocView *view)
 {
-  bool whole = true;
+  bool whole = false;
+
+  if (!phoc_view_accept_damage (self, view))
+    return;
+
+  if (wlr_box_empty (&self->layout_box))
+    return;
+
+  PhocOutputSurfaceIteratorData data = {
+    .user_iterator = damage_surface_iterator,
+    .user_data = &whole,
+    .output = self,
+    .ox = view->box.x - self->layout_box.x,
+    .oy = view->box.y - self->layout_box.y,
+    .width = view->box.width,
+    .height = view->box.height,
+    .scale = phoc_view_get_scale (view)
+  };
+
+  phoc_output_for_each_surface_iterator (view->wlr_surface, 0, 0, &data);
+}
+
+/**
+ * phoc_output_damage_from_view_child:
+ * @self: The output to add damage to
+ * @view: The view @surface belongs to
+ * @surface: The child surface providing the damage
+ * @sx: The x position of @surface relative to @view
+ * @sy: The y position of @surface relative to @view
+ * @whole: Whether to damage the whole surface
+ *
+ * Like [method@Output.damage_from_view] but only adds the damage of
+ * @surface and its subsurfaces instead of the whole view's surface tree.
+ */
+void
+phoc_output_damage_from_view_child (PhocOutput         *self,
+                                    PhocView           *view,
+                                    struct wlr_surface *surface,
+                                    int                 sx,
+                                    int                 sy,
+                                    bool                whole)
+{
+  if (!phoc_view_accept_damage (self, view))
+    return;
+
+  if (wlr_box_empty (&self->layout_box))
+    return;
+
+  PhocOutputSurfaceIteratorData data = {
+    .user_iterator = damage_surface_iterator,
+    .user_data = &whole,
+    .output = self,
+    .ox = view->box.x - self->layout_box.x + sx,
+    .oy = view->box.y - self->layout_box.y + sy,
+    .width = view->box.width,
+    .height = view->box.height,
+    .scale = phoc_view_get_scale (view)
+  };
+
+  wlr_surface_for_each_surface (surface, phoc_output_for_each_surface_iterator, &data);
+}
+
+
+static void
+damage_surface_in_region_iterator (PhocOutput *self, struct wlr_surface *wlr_surface,
+                                   struct wlr_box *_box, float scale, void *data)
+{
+  pixman_region32_t *region = data;
+  pixman_region32_t damage;
+  struct wlr_box box = *_box;
+
+  phoc_utils_scale_box (&box, scale);
+
+  pixman_region32_init (&damage);
+  pixman_region32_intersect_rect (&damage, region, box.x, box.y, box.width, box.height);
+  if (pixman_region32_not_empty (&damage)) {
+    wlr_region_scale (&damage, &damage, self->wlr_output->scale);
+    if (wlr_damage_ring_add (&self->damage_ring, &damage))
+      wlr_output_schedule_frame (self->wlr_output);
+  }
+  pixman_region32_fini (&damage);
+}
+
+/**
+ * phoc_output_damage_view_in_region:
+ * @self: The output to add damage to
+ * @view: The view to damage
+ * @region: The area to damage in layout coordinates
+ *
+ * Like [method@Output.damage_from_view] with `whole` set to %TRUE
+ * but only damages the parts of @view that are within @region. This
+ * is useful when only some parts of a view got uncovered.
+ */
+void
+phoc_output_damage_view_in_region (PhocOutput *self, PhocView *view, pixman_region32_t *region)
+{
+  pixman_region32_t local;
+  GSList *blings;
+
+  if (!phoc_view_accept_damage (self, view) || !phoc_view_is_mapped (view))
+    return;
+
+  pixman_region32_init (&local);
+  pixman_region32_copy (&local, region);
+  pixman_region32_translate (&local, -self->lx, -self->ly);
+
+  phoc_output_view_for_each_surface (self, view, damage_surface_in_region_iterator, &local);
+
+  blings = phoc_view_get_blings (view);
+  for (GSList *l = blings; l; l = l->next) {
+    PhocBox box = phoc_bling_get_box (PHOC_BLING (l->data));
+
+    box.x -= self->lx;
+    box.y -= self->ly;
+    damage_surface_in_region_iterator (self, NULL, &box, 1.0, &local);
+  }
+
+  pixman_region32_fini (&local);
+}
+
+/**
+ * phoc_output_damage_from_drag_icon:
+ * @self: The output to add damage to
+ * @icon: The drag icon providing the damage
+ * @whole: Whether to damage the whole icon
+ *
+ * Adds the @icon's damage to the damaged area of @self. If @whole is
+ * %FALSE only buffer damage is taken into account.
+ */
+void
+phoc_output_damage_from_drag_icon (PhocOutput *self, PhocDragIcon *icon, bool whole)
+{
+  if (wlr_box_empty (&self->layout_box))
+    return;
 
   phoc_output_surface_for_each_surface (self,
                                         phoc_drag_icon_get_wlr_surface (icon),
-                                        phoc_drag_icon_get_x (icon),
-                                        phoc_drag_icon_get_y (icon),
+                                        phoc_drag_icon_get_x (icon) - self->layout_box.x,
+                                        phoc_drag_icon_get_y (icon) - self->layout_box.y,
                                         damage_surface_iterator, &whole);
 }
 
@@ -1632,6 +3820,94 @@ phoc_output_damage_from_surface (PhocOutput         *self,
 }
 
 
+typedef struct {
+  struct wlr_output       *wlr_output;
+  struct wlr_output_state  state;
+  gboolean                 enabled;
+  gboolean                 needs_commit;
+  int                      x, y;
+} PhocOutputConfigHead;
+
+
+static void
+output_config_head_clear (PhocOutputConfigHead *head)
+{
+  wlr_output_state_finish (&head->state);
+}
+
+
+static char *
+output_config_to_key (struct wlr_output_configuration_v1 *config)
+{
+  struct wlr_output_configuration_head_v1 *config_head;
+  GString *key = g_string_new (NULL);
+
+  wl_list_for_each (config_head, &config->heads, link) {
+    g_string_append_printf (key, "%s:%d:%p:%dx%d@%d:%d:%f;",
+                            config_head->state.output->name,
+                            config_head->state.enabled,
+                            config_head->state.mode,
+                            config_head->state.custom_mode.width,
+                            config_head->state.custom_mode.height,
+                            config_head->state.custom_mode.refresh,
+                            config_head->state.transform,
+                            config_head->state.scale);
+  }
+
+  return g_string_free (key, FALSE);
+}
+
+
+static void
+output_config_head_init (PhocOutputConfigHead                    *head,
+                         struct wlr_output_configuration_head_v1 *config_head)
+{
+  struct wlr_output *wlr_output = config_head->state.output;
+  float scale = adjust_frac_scale (config_head->state.scale);
+
+  head->wlr_output = wlr_output;
+  head->enabled = config_head->state.enabled;
+  head->x = config_head->state.x;
+  head->y = config_head->state.y;
+  wlr_output_state_init (&head->state);
+
+  if (!head->enabled) {
+    head->needs_commit = wlr_output->enabled;
+    if (head->needs_commit)
+      wlr_output_state_set_enabled (&head->state, false);
+    return;
+  }
+
+  wlr_output_state_set_enabled (&head->state, true);
+  if (config_head->state.mode != NULL) {
+    wlr_output_state_set_mode (&head->state, config_head->state.mode);
+  } else {
+    wlr_output_state_set_custom_mode (&head->state,
+                                      config_head->state.custom_mode.width,
+                                      config_head->state.custom_mode.height,
+                                      config_head->state.custom_mode.refresh);
+  }
+  wlr_output_state_set_transform (&head->state, config_head->state.transform);
+  wlr_output_state_set_scale (&head->state, scale);
+
+  /* Avoid a modeset when only the position in the layout changes */
+  head->needs_commit = !wlr_output->enabled ||
+    (config_head->state.mode && config_head->state.mode != wlr_output->current_mode) ||
+    (!config_head->state.mode && (config_head->state.custom_mode.width != wlr_output->width ||
+                                  config_head->state.custom_mode.height != wlr_output->height ||
+                                  config_head->state.custom_mode.refresh != wlr_output->refresh)) ||
+    config_head->state.transform != wlr_output->transform ||
+    scale != wlr_output->scale;
+}
+
+/*
+ * The backend can't commit several outputs at once. Outputs that get
+ * disabled are committed first as they may free up resources (e.g.
+ * CRTCs) the other outputs need. The remaining outputs are all tested
+ * before any of them is touched so a configuration that can't be
+ * applied doesn't leave us with some outputs reconfigured and others
+ * not.
+ */
 static void
 output_manager_apply_config (PhocDesktop                        *desktop,
                              struct wlr_output_configuration_v1 *config,
@@ -1639,73 +3915,81 @@ output_manager_apply_config (PhocDesktop                        *desktop,
 
 {
   struct wlr_output_configuration_head_v1 *config_head;
+  g_autoptr (GArray) heads = NULL;
+  g_autofree char *key = NULL;
   gboolean ok = TRUE;
 
-  /* First disable outputs we need to disable */
+  key = output_config_to_key (config);
+  if (test_only && g_strcmp0 (key, desktop->output_manager_test_key) == 0) {
+    ok = desktop->output_manager_test_ok;
+    goto out;
+  }
+
+  heads = g_array_new (FALSE, TRUE, sizeof (PhocOutputConfigHead));
+  g_array_set_clear_func (heads, (GDestroyNotify)output_config_head_clear);
   wl_list_for_each (config_head, &config->heads, link) {
-    struct wlr_output *wlr_output = config_head->state.output;
-    struct wlr_output_state pending;
+    PhocOutputConfigHead head;
 
-    wlr_output_state_init (&pending);
-    if (config_head->state.enabled)
-      continue;
+    output_config_head_init (&head, config_head);
+    g_array_append_val (heads, head);
+  }
 
-    if (!wlr_output->enabled)
-      continue;
+  if (test_only) {
+    /* Can't disable outputs for real so test with them still enabled */
+    for (guint i = 0; ok && i < heads->len; i++) {
+      PhocOutputConfigHead *head = &g_array_index (heads, PhocOutputConfigHead, i);
 
-    wlr_output_state_set_enabled (&pending, false);
-    if (test_only) {
-      ok &= wlr_output_test_state (wlr_output, &pending);
-    } else {
-      wlr_output_layout_remove (desktop->layout, wlr_output);
-      ok &= wlr_output_commit_state (wlr_output, &pending);
+      if (head->needs_commit)
+        ok = wlr_output_test_state (head->wlr_output, &head->state);
     }
-    wlr_output_state_finish (&pending);
+
+    g_free (desktop->output_manager_test_key);
+    desktop->output_manager_test_key = g_steal_pointer (&key);
+    desktop->output_manager_test_ok = ok;
+    goto out;
   }
 
-  /* Then enable outputs that need to */
-  wl_list_for_each (config_head, &config->heads, link) {
-    struct wlr_output *wlr_output = config_head->state.output;
-    PhocOutput *output = PHOC_OUTPUT (wlr_output->data);
-    struct wlr_output_state pending;
-    struct wlr_box output_box;
+  /* First disable outputs we need to disable */
+  for (guint i = 0; i < heads->len; i++) {
+    PhocOutputConfigHead *head = &g_array_index (heads, PhocOutputConfigHead, i);
 
-    if (!config_head->state.enabled)
+    if (head->enabled || !head->needs_commit)
       continue;
 
-    wlr_output_state_init (&pending);
-    wlr_output_state_set_enabled (&pending, true);
-    if (config_head->state.mode != NULL) {
-      wlr_output_state_set_mode (&pending, config_head->state.mode);
-    } else {
-      wlr_output_state_set_custom_mode (&pending,
-                                        config_head->state.custom_mode.width,
-                                        config_head->state.custom_mode.height,
-                                        config_head->state.custom_mode.refresh);
-    }
-    wlr_output_state_set_transform (&pending, config_head->state.transform);
-    wlr_output_state_set_scale (&pending, adjust_frac_scale (config_head->state.scale));
-
-    if (test_only) {
-      ok &= wlr_output_test_state (wlr_output, &pending);
-    } else {
-      wlr_output_layout_add (desktop->layout,
-                             wlr_output,
-                             config_head->state.x,
-                             config_head->state.y);
-      ok &= wlr_output_commit_state (wlr_output, &pending);
-
-      if (output->fullscreen_view)
-        phoc_view_set_fullscreen (output->fullscreen_view, true, output);
-
-      wlr_output_layout_get_box (output->desktop->layout, output->wlr_output, &output_box);
-      output->lx = output_box.x;
-      output->ly = output_box.y;
-    }
+    wlr_output_layout_remove (desktop->layout, head->wlr_output);
+    ok &= wlr_output_commit_state (head->wlr_output, &head->state);
+  }
 
-    wlr_output_state_finish (&pending);
+  /* Then test the outputs that stay enabled or get enabled */
+  for (guint i = 0; ok && i < heads->len; i++) {
+    PhocOutputConfigHead *head = &g_array_index (heads, PhocOutputConfigHead, i);
+
+    if (head->enabled && head->needs_commit)
+      ok = wlr_output_test_state (head->wlr_output, &head->state);
+  }
+
+  if (!ok)
+    goto out;
+
+  /* And commit them */
+  for (guint i = 0; i < heads->len; i++) {
+    PhocOutputConfigHead *head = &g_array_index (heads, PhocOutputConfigHead, i);
+    PhocOutput *output = PHOC_OUTPUT (head->wlr_output->data);
+
+    if (!head->enabled)
+      continue;
+
+    wlr_output_layout_add (desktop->layout, head->wlr_output, head->x, head->y);
+    if (head->needs_commit)
+      ok &= wlr_output_commit_state (head->wlr_output, &head->state);
+
+    if (output->fullscreen_view)
+      phoc_view_set_fullscreen (output->fullscreen_view, true, output);
+
+    phoc_output_update_layout_box (output);
   }
 
+ out:
   if (ok)
     wlr_output_configuration_v1_send_succeeded (config);
   else
@@ -1713,8 +3997,11 @@ output_manager_apply_config (PhocDesktop                        *desktop,
 
   wlr_output_configuration_v1_destroy (config);
 
-  if (!test_only)
+  if (!test_only) {
+    /* An external output might have been enabled or disabled */
+    phoc_desktop_update_lid_policy (desktop);
     update_output_manager_config (desktop);
+  }
 }
 
 
@@ -1731,7 +4018,7 @@ phoc_handle_output_manager_apply (struct wl_listener *listener, void *data)
 void
 phoc_handle_output_manager_test (struct wl_listener *listener, void *data)
 {
-  PhocDesktop *desktop = wl_container_of (listener, desktop, output_manager_apply);
+  PhocDesktop *desktop = wl_container_of (listener, desktop, output_manager_test);
   struct wlr_output_configuration_v1 *config = data;
 
   output_manager_apply_config (desktop, config, TRUE);
@@ -1743,6 +4030,7 @@ phoc_output_handle_output_power_manager_set_mode (struct wl_listener *listener,
 {
   struct wlr_output_power_v1_set_mode_event *event = data;
   struct wlr_output_state pending;
+  PhocOutputPrivate *priv;
   PhocOutput *self;
   bool enable = true;
   bool current;
@@ -1750,6 +4038,7 @@ phoc_output_handle_output_power_manager_set_mode (struct wl_listener *listener,
   g_return_if_fail (event && event->output && event->output->data);
 
   self = event->output->data;
+  priv = phoc_output_get_instance_private (self);
   g_debug ("Request to set output power mode of %p to %d", self->wlr_output->name, event->mode);
   switch (event->mode) {
   case ZWLR_OUTPUT_POWER_V1_MODE_OFF:
@@ -1770,15 +4059,27 @@ phoc_output_handle_output_power_manager_set_mode (struct wl_listener *listener,
   wlr_output_state_init (&pending);
   wlr_output_state_set_enabled (&pending, enable);
 
+  /* Show the last frame right away rather than a black one */
+  if (enable && priv->wake_buffer &&
+      priv->wake_buffer->width == self->wlr_output->width &&
+      priv->wake_buffer->height == self->wlr_output->height) {
+    wlr_output_state_set_buffer (&pending, priv->wake_buffer);
+    if (!wlr_output_test_state (self->wlr_output, &pending)) {
+      g_debug ("Can't wake %s with its last frame", self->wlr_output->name);
+      wlr_output_state_finish (&pending);
+      wlr_output_state_init (&pending);
+      wlr_output_state_set_enabled (&pending, enable);
+    }
+  }
+
   if (!wlr_output_commit_state (self->wlr_output, &pending)) {
     g_warning ("Failed to commit power mode change to %d for %p", enable, self);
     wlr_output_state_finish (&pending);
     return;
   }
 
+  /* The commit handler makes the output dormant or wakes it up */
   wlr_output_state_finish (&pending);
-  if (enable)
-    phoc_output_damage_whole (self);
 }
 
 /**
@@ -1854,6 +4155,23 @@ phoc_output_has_fullscreen_view (PhocOutput *self)
 }
 
 
+/**
+ * phoc_output_add_frame_callback:
+ * @self: The output
+ * @animatable: The animatable the callback belongs to
+ * @callback: The callback to invoke on each frame
+ * @user_data: The data passed to @callback
+ * @notify: Invoked on @user_data when the callback gets removed
+ *
+ * Adds a callback that is invoked before each frame of @self until it
+ * returns `G_SOURCE_REMOVE` or gets removed.
+ *
+ * Callbacks live in a slot map: adding and removing them doesn't
+ * allocate once the slots exist and the returned id carries the
+ * slot's generation so stale ids don't remove newer callbacks.
+ *
+ * Returns: The callback's id, never `0`
+ */
 guint
 phoc_output_add_frame_callback  (PhocOutput        *self,
                                  PhocAnimatable    *animatable,
@@ -1862,28 +4180,42 @@ phoc_output_add_frame_callback  (PhocOutput        *self,
                                  GDestroyNotify     notify)
 {
   PhocOutputPrivate *priv;
-  PhocOutputFrameCallbackInfo *cb_info = g_new0 (PhocOutputFrameCallbackInfo, 1);
+  PhocOutputFrameCallbackInfo *cb_info;
+  guint index;
 
   g_assert (PHOC_IS_OUTPUT (self));
   priv = phoc_output_get_instance_private (self);
 
-  *cb_info = (PhocOutputFrameCallbackInfo) {
-    .animatable = animatable,
-    .callback = callback,
-    .user_data = user_data,
-    .notify = notify,
-    .id = priv->frame_callback_next_id,
-  };
+  if (priv->frame_callbacks_free->len) {
+    index = g_array_index (priv->frame_callbacks_free, guint, priv->frame_callbacks_free->len - 1);
+    g_array_set_size (priv->frame_callbacks_free, priv->frame_callbacks_free->len - 1);
+  } else {
+    g_assert (priv->frame_callbacks->len < FRAME_CALLBACK_MAX_SLOTS);
+    index = priv->frame_callbacks->len;
+    g_array_set_size (priv->frame_callbacks, index + 1);
+  }
 
-  if (priv->frame_callbacks == NULL) {
+  if (priv->n_frame_callbacks == 0) {
     priv->last_frame_us = g_get_monotonic_time ();
     /* No other frame callbacks so need to schedule a frame to keep
      * frame clock ticking */
     wlr_output_schedule_frame (self->wlr_output);
+    note_activity (self, TRUE);
   }
 
-  priv->frame_callbacks = g_slist_prepend (priv->frame_callbacks, cb_info);
-  return priv->frame_callback_next_id++;
+  cb_info = get_frame_callback (priv, index);
+  *cb_info = (PhocOutputFrameCallbackInfo) {
+    .animatable = animatable,
+    .callback = callback,
+    .user_data = user_data,
+    .notify = notify,
+    .generation = cb_info->generation,
+    .used = TRUE,
+    .added_tick = priv->frame_tick,
+  };
+  priv->n_frame_callbacks++;
+
+  return FRAME_CALLBACK_ID (index, cb_info->generation);
 }
 
 
@@ -1891,29 +4223,18 @@ void
 phoc_output_remove_frame_callback  (PhocOutput *self, guint id)
 {
   PhocOutputPrivate *priv;
+  PhocOutputFrameCallbackInfo *cb_info;
+  guint index = FRAME_CALLBACK_INDEX (id);
 
   g_assert (PHOC_IS_OUTPUT (self));
   priv = phoc_output_get_instance_private (self);
 
-  for (GSList *elem = priv->frame_callbacks; elem; elem = elem->next) {
-    PhocOutputFrameCallbackInfo *cb_info = elem->data;
-
-    if (cb_info->id == id) {
-      phoc_output_frame_callback_info_free (cb_info);
-      priv->frame_callbacks = g_slist_delete_link (priv->frame_callbacks, elem);
-      return;
-    }
-  }
-  g_return_if_reached();
-}
-
+  g_return_if_fail (id != 0 && index < priv->frame_callbacks->len);
 
-static gint
-find_cb_by_animatable (PhocOutputFrameCallbackInfo *info,  PhocAnimatable *animatable)
-{
-  g_assert (PHOC_IS_ANIMATABLE (animatable));
+  cb_info = get_frame_callback (priv, index);
+  g_return_if_fail (cb_info->used && cb_info->generation == FRAME_CALLBACK_GENERATION (id));
 
-  return !(info->animatable == animatable);
+  phoc_output_frame_callback_clear (priv, index);
 }
 
 /**
@@ -1926,21 +4247,39 @@ find_cb_by_animatable (PhocOutputFrameCallbackInfo *info,  PhocAnimatable *anima
 void
 phoc_output_remove_frame_callbacks_by_animatable (PhocOutput *self, PhocAnimatable *animatable)
 {
-  PhocOutputPrivate *priv;
-  GSList *found;
-
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  g_assert (PHOC_IS_ANIMATABLE (animatable));
+  priv = phoc_output_get_instance_private (self);
+
+  for (guint i = 0; i < priv->frame_callbacks->len; i++) {
+    PhocOutputFrameCallbackInfo *cb_info = get_frame_callback (priv, i);
+
+    if (cb_info->used && cb_info->animatable == animatable)
+      phoc_output_frame_callback_clear (priv, i);
+  }
+}
+
+/**
+ * phoc_output_get_next_present_us:
+ * @self: The output
+ *
+ * Predicts when the next frame will be presented based on the last
+ * presentation time and the refresh rate.
+ *
+ * Returns: The predicted presentation time in µs of the monotonic
+ *   clock or `0` if the output didn't present a frame yet.
+ */
+gint64
+phoc_output_get_next_present_us (PhocOutput *self)
+{
   g_assert (PHOC_IS_OUTPUT (self));
-  priv = phoc_output_get_instance_private (self);
 
-  do {
-    found = g_slist_find_custom (priv->frame_callbacks, animatable,
-                                 (GCompareFunc)find_cb_by_animatable);
-    if (found)
-      priv->frame_callbacks = g_slist_delete_link (priv->frame_callbacks, found);
-
-  } while (found);
+  return get_next_vblank_us (self, g_get_monotonic_time ());
 }
 
+
 /**
  * phoc_output_has_frame_callbacks:
  * @self: The output to look at
@@ -1955,7 +4294,22 @@ phoc_output_has_frame_callbacks (PhocOutput *self)
   g_assert (PHOC_IS_OUTPUT (self));
   priv = phoc_output_get_instance_private (self);
 
-  return !!priv->frame_callbacks;
+  return priv->n_frame_callbacks > 0;
+}
+
+/**
+ * phoc_output_notify_activity:
+ * @self: The output
+ *
+ * Notify the output about user activity like input. This raises the
+ * output's refresh rate if it was lowered due to inactivity.
+ */
+void
+phoc_output_notify_activity (PhocOutput *self)
+{
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  note_activity (self, TRUE);
 }
 
 /**
@@ -2045,7 +4399,7 @@ should_reveal_shell (PhocOutput *self)
     /* is OSK displayed because of our fullscreen view? */
     if (phoc_view_is_mapped (self->fullscreen_view) &&
         phoc_input_method_relay_is_enabled (&seat->im_relay, self->fullscreen_view->wlr_surface)) {
-      PhocLayerSurface *osk = phoc_layer_shell_find_osk (self);
+      PhocLayerSurface *osk = phoc_output_get_osk (self);
       if (osk && phoc_layer_surface_get_mapped (osk))
         return true;
     }
@@ -2145,6 +4499,30 @@ phoc_output_get_scale (PhocOutput *self)
   return self->wlr_output->scale;
 }
 
+/**
+ * phoc_output_update_layout_box:
+ * @self: The output
+ *
+ * Refreshes the cached position and size of the output in the output
+ * layout. Needs to be invoked whenever the layout changes so per
+ * surface code paths don't have to look the output up in the layout.
+ */
+void
+phoc_output_update_layout_box (PhocOutput *self)
+{
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  wlr_output_layout_get_box (self->desktop->layout, self->wlr_output, &self->layout_box);
+  self->lx = self->layout_box.x;
+  self->ly = self->layout_box.y;
+
+  /* Views need to follow when the output moves in the layout */
+  if (!wlr_box_empty (&self->layout_box) &&
+      !wlr_box_equal (&self->arranged_layout_box, &self->layout_box)) {
+    phoc_output_queue_arrange_layers (self);
+  }
+}
+
 
 const char *
 phoc_output_get_name (PhocOutput *self)
@@ -2245,3 +4623,349 @@ phoc_output_get_wlr_output (PhocOutput *self)
 
   return self->wlr_output;
 }
+
+
+/**
+ * phoc_output_get_frame_stats:
+ * @self: The output
+ *
+ * Get the frame timing statistics of this output.
+ *
+ * Returns:(transfer none): The frame statistics
+ */
+PhocFrameStats *
+phoc_output_get_frame_stats (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  return priv->frame_stats;
+}
+
+/**
+ * phoc_output_get_input_latency_pending:
+ * @self: The output
+ *
+ * Get the input whose latency is recorded once the output presents
+ * its next frame. See [class@InputLatency].
+ *
+ * Returns:(transfer none)(element-type PhocInputLatencyPending): The pending input
+ */
+GArray *
+phoc_output_get_input_latency_pending (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  return priv->input_latency_pending;
+}
+
+/**
+ * phoc_output_get_layer_cache:
+ * @self: The output
+ *
+ * Get the texture the output's background and bottom layers are
+ * composited into. See [struct@LayerCache].
+ *
+ * Returns:(transfer none)(nullable): The layer cache
+ */
+PhocLayerCache *
+phoc_output_get_layer_cache (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  return priv->layer_cache;
+}
+
+/**
+ * phoc_output_set_layer_cache:
+ * @self: The output
+ * @cache:(transfer full)(nullable): The layer cache
+ *
+ * Sets the output's layer cache replacing any previous one. Use
+ * %NULL to drop the cache.
+ */
+void
+phoc_output_set_layer_cache (PhocOutput *self, PhocLayerCache *cache)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  if (priv->layer_cache == cache)
+    return;
+
+  g_clear_pointer (&priv->layer_cache, phoc_layer_cache_free);
+  priv->layer_cache = cache;
+}
+
+/**
+ * phoc_output_has_pending_frame:
+ * @self: The output
+ *
+ * Whether a frame is scheduled, about to be repainted or waiting to
+ * be presented.
+ *
+ * Returns: %TRUE if the output isn't idle
+ */
+gboolean
+phoc_output_has_pending_frame (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  return self->wlr_output->frame_pending || self->wlr_output->needs_frame ||
+    self->wlr_output->idle_frame || priv->repaint_id;
+}
+
+/**
+ * phoc_output_set_overview:
+ * @self: The output
+ * @overview: (nullable): The overview
+ *
+ * Sets the views the shell placed on top of the output's top layer.
+ */
+void
+phoc_output_set_overview (PhocOutput *self, PhocOverview *overview)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  g_set_object (&priv->overview, overview);
+}
+
+/**
+ * phoc_output_get_overview:
+ * @self: The output
+ *
+ * Returns:(transfer none)(nullable): The overview
+ */
+PhocOverview *
+phoc_output_get_overview (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  return priv->overview;
+}
+
+/**
+ * phoc_output_set_magnifier_zoom:
+ * @self: The output
+ * @zoom: The zoom level, `1.0` turns the magnifier off
+ *
+ * Zooms into the output for accessibility, see [struct@Magnifier].
+ */
+void
+phoc_output_set_magnifier_zoom (PhocOutput *self, double zoom)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  phoc_magnifier_set_zoom (priv->magnifier, zoom);
+}
+
+
+double
+phoc_output_get_magnifier_zoom (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  return phoc_magnifier_get_zoom (priv->magnifier);
+}
+
+/**
+ * phoc_output_set_magnifier_focus:
+ * @self: The output
+ * @lx: The x coordinate in layout coordinates
+ * @ly: The y coordinate in layout coordinates
+ *
+ * Sets the point the magnifier zooms into.
+ */
+void
+phoc_output_set_magnifier_focus (PhocOutput *self, double lx, double ly)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  phoc_magnifier_set_focus (priv->magnifier, lx - self->lx, ly - self->ly);
+}
+
+/**
+ * phoc_output_magnifier_map_point:
+ * @self: The output
+ * @lx: (inout): The x coordinate in layout coordinates
+ * @ly: (inout): The y coordinate in layout coordinates
+ *
+ * Maps a point on the output to the point of its content that's shown
+ * there while the magnifier zooms in, see [method@Magnifier.map_point].
+ */
+void
+phoc_output_magnifier_map_point (PhocOutput *self, double *lx, double *ly)
+{
+  PhocOutputPrivate *priv;
+  double ox, oy;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  if (!phoc_magnifier_is_active (priv->magnifier))
+    return;
+
+  ox = *lx - self->lx;
+  oy = *ly - self->ly;
+  phoc_magnifier_map_point (priv->magnifier, &ox, &oy);
+  *lx = ox + self->lx;
+  *ly = oy + self->ly;
+}
+
+/**
+ * phoc_output_set_power_saver:
+ * @self: The output
+ * @power_saver: Whether the system saves power
+ *
+ * While saving power the output stays at its idle refresh rate (if
+ * one is configured) instead of raising it on input and animations.
+ */
+void
+phoc_output_set_power_saver (PhocOutput *self, gboolean power_saver)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  if (priv->power_saver == power_saver)
+    return;
+
+  priv->power_saver = power_saver;
+  note_activity (self, TRUE);
+}
+
+/**
+ * phoc_output_get_damage_heatmap:
+ * @self: The output
+ *
+ * Get the damage heatmap of this output. It's only recorded when
+ * the `damage-heatmap` debug flag is set.
+ *
+ * Returns:(transfer none)(nullable): The damage heatmap
+ */
+PhocDamageHeatmap *
+phoc_output_get_damage_heatmap (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  return priv->damage_heatmap;
+}
+
+/**
+ * phoc_output_get_scanout_result:
+ * @self: The output
+ *
+ * Get the outcome of the most recent direct scanout attempt. This
+ * tells why the fullscreen view isn't scanned out directly.
+ *
+ * Returns: The scanout result
+ */
+PhocScanoutResult
+phoc_output_get_scanout_result (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  return priv->scanout_result;
+}
+
+/**
+ * phoc_output_has_render_overlays:
+ * @self: The output
+ *
+ * Whether anything not backed by a surface gets rendered on top of
+ * the output's content, e.g. software cursors, debug touch points,
+ * views placed on the overview, snapshots of closing views or render
+ * hooks like the output shield.
+ *
+ * Returns: %TRUE if there are overlays
+ */
+gboolean
+phoc_output_has_render_overlays (PhocOutput *self)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocRenderer *renderer = phoc_server_get_renderer (server);
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  switch (get_cursor_plane_result (self)) {
+  case PHOC_CURSOR_PLANE_RESULT_HARDWARE:
+  case PHOC_CURSOR_PLANE_RESULT_HIDDEN:
+    break;
+  default:
+    return TRUE;
+  }
+
+  if (self->n_debug_touch_points)
+    return TRUE;
+
+  if (priv->overview && phoc_overview_has_views (priv->overview))
+    return TRUE;
+
+  if (G_UNLIKELY (phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_DAMAGE_TRACKING |
+                                                 PHOC_SERVER_DEBUG_FLAG_DAMAGE_HEATMAP)))
+    return TRUE;
+
+  if (phoc_renderer_has_view_snapshots (renderer, self))
+    return TRUE;
+
+  return phoc_renderer_has_render_hooks (renderer, self);
+}
+
+/**
+ * phoc_output_get_cutouts_size:
+ * @self: The output
+ *
+ * Get the size of the textures used to render the cutouts overlay.
+ *
+ * Returns: The size in bytes, `0` if the overlay isn't in use
+ */
+gsize
+phoc_output_get_cutouts_size (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  if (!priv->cutouts)
+    return 0;
+
+  return phoc_cutouts_overlay_get_texture_size (priv->cutouts);
+}
@@ -2,6 +2,8 @@
 
 #include "animatable.h"
 #include "drag-icon.h"
+#include "frame-stats.h"
+#include "layer-cache.h"
 #include "render.h"
 #include "view.h"
 
@@ -19,9 +21,12 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (PhocOutput, phoc_output, PHOC, OUTPUT, GObject);
 
+typedef struct _PhocDamageHeatmap PhocDamageHeatmap;
 typedef struct _PhocDesktop PhocDesktop;
 typedef struct _PhocInput PhocInput;
 typedef struct _PhocLayerSurface PhocLayerSurface;
+typedef struct _PhocOutputConfig PhocOutputConfig;
+typedef struct _PhocOverview PhocOverview;
 
 /**
  * PhocOutputScaleFilter:
@@ -32,6 +37,53 @@ typedef enum _PhocOutputScaleFilter {
   PHOC_OUTPUT_SCALE_FILTER_NEAREST,
 } PhocOutputScaleFilter;
 
+/**
+ * PhocOutputAdaptiveSync:
+ * @PHOC_OUTPUT_ADAPTIVE_SYNC_OFF: Use a fixed refresh rate
+ * @PHOC_OUTPUT_ADAPTIVE_SYNC_ON: Always use a variable refresh rate
+ * @PHOC_OUTPUT_ADAPTIVE_SYNC_AUTO: Use a variable refresh rate when a
+ *   fullscreen view is scanned out or doesn't commit at the refresh rate
+ */
+typedef enum _PhocOutputAdaptiveSync {
+  PHOC_OUTPUT_ADAPTIVE_SYNC_OFF = 1,
+  PHOC_OUTPUT_ADAPTIVE_SYNC_ON,
+  PHOC_OUTPUT_ADAPTIVE_SYNC_AUTO,
+} PhocOutputAdaptiveSync;
+
+/**
+ * PhocOutputPresentation:
+ * @PHOC_OUTPUT_PRESENTATION_COMPOSITED: The surface got composited into the
+ *   output's buffer
+ * @PHOC_OUTPUT_PRESENTATION_SCANOUT: The surface's buffer is scanned out
+ *   directly as the output's primary buffer
+ * @PHOC_OUTPUT_PRESENTATION_PLANE: The surface's buffer is shown on an
+ *   overlay plane
+ *
+ * How a surface's buffer makes it to the screen.
+ */
+typedef enum _PhocOutputPresentation {
+  PHOC_OUTPUT_PRESENTATION_COMPOSITED = 1,
+  PHOC_OUTPUT_PRESENTATION_SCANOUT,
+  PHOC_OUTPUT_PRESENTATION_PLANE,
+} PhocOutputPresentation;
+
+/* Touch points drawn by the touch point debug overlay per frame */
+#define PHOC_OUTPUT_MAX_DEBUG_TOUCH_POINTS 16
+
+/**
+ * PhocOutputTouchPoint:
+ * @id: The touch point's id
+ * @x: The x coordinate in output buffer coordinates
+ * @y: The y coordinate in output buffer coordinates
+ *
+ * A touch point of the touch point debug overlay.
+ */
+typedef struct _PhocOutputTouchPoint {
+  int    id;
+  double x;
+  double y;
+} PhocOutputTouchPoint;
+
 /**
  * PhocOutput:
  *
@@ -51,9 +103,14 @@ struct _PhocOutput {
   PhocView                 *fullscreen_view;
   struct wl_list            layer_surfaces; // PhocLayerSurface::link
 
-  GList                    *debug_touch_points;
+  PhocOutputTouchPoint      debug_touch_points[PHOC_OUTPUT_MAX_DEBUG_TOUCH_POINTS];
+  guint                     n_debug_touch_points;
 
   struct wlr_box            usable_area;
+  /* Position and size in the layout, empty if not part of it */
+  struct wlr_box            layout_box;
+  /* The layout box views were last arranged for */
+  struct wlr_box            arranged_layout_box;
   int                       lx, ly;
 
   struct wl_listener        commit;
@@ -101,25 +158,39 @@ void        phoc_output_view_for_each_surface        (PhocOutput *self,
                                                       PhocView *view,
                                                       PhocSurfaceIterator iterator,
                                                       void *user_data);
+void        phoc_output_view_for_each_surface_in_box (PhocOutput           *self,
+                                                      PhocView             *view,
+                                                      const struct wlr_box *box,
+                                                      PhocSurfaceIterator   iterator,
+                                                      void                 *user_data);
 void        phoc_output_drag_icons_for_each_surface  (PhocOutput *self,
                                                       PhocInput *input,
                                                       PhocSurfaceIterator iterator,
                                                       void *user_data);
+void        phoc_output_for_each_surface             (PhocOutput          *self,
+                                                      PhocSurfaceIterator  iterator,
+                                                      void                *user_data,
+                                                      gboolean             visible_only);
 void        phoc_output_layer_surface_for_each_surface (PhocOutput          *self,
                                                         PhocLayerSurface    *layer_surface,
                                                         PhocSurfaceIterator  iterator,
                                                         void                *user_data);
 
 #ifdef PHOC_XWAYLAND
-struct wlr_xwayland_surface;
-void        phoc_output_xwayland_children_for_each_surface (PhocOutput *self,
-                                                            struct wlr_xwayland_surface *surface,
-                                                            PhocSurfaceIterator iterator,
-                                                            void *user_data);
+typedef struct _PhocXWaylandSurface PhocXWaylandSurface;
+void        phoc_output_xwayland_children_for_each_surface (PhocOutput          *self,
+                                                            PhocXWaylandSurface *surface,
+                                                            PhocSurfaceIterator  iterator,
+                                                            void                *user_data);
 #endif
 GQueue     *phoc_output_get_layer_surfaces_for_layer (PhocOutput                     *self,
                                                       enum zwlr_layer_shell_v1_layer  layer);
 void        phoc_output_set_layer_dirty (PhocOutput *self, enum zwlr_layer_shell_v1_layer  layer);
+void        phoc_output_add_layer_surface (PhocOutput *self, PhocLayerSurface *layer_surface);
+void        phoc_output_remove_layer_surface (PhocOutput *self, PhocLayerSurface *layer_surface);
+PhocLayerSurface *phoc_output_get_osk (PhocOutput *self);
+void        phoc_output_queue_arrange_layers (PhocOutput *self);
+void        phoc_output_clear_queued_arrange_layers (PhocOutput *self);
 
 /* signal handlers */
 void        phoc_handle_output_manager_apply (struct wl_listener *listener, void *data);
@@ -131,10 +202,26 @@ void        phoc_output_handle_gamma_control_set_gamma (struct wl_listener *list
 /* methods */
 struct wlr_output *
             phoc_output_get_wlr_output (PhocOutput *output);
+void        phoc_output_surface_presented (PhocOutput             *self,
+                                          struct wlr_surface     *surface,
+                                          PhocOutputPresentation  presentation);
 void        phoc_output_damage_whole (PhocOutput *output);
+void        phoc_output_apply_config (PhocOutput *self, PhocOutputConfig *output_config);
+void        phoc_output_damage_box (PhocOutput *self, const struct wlr_box *box);
 void        phoc_output_damage_from_view (PhocOutput *self, PhocView *view, bool whole);
-void        phoc_output_damage_whole_drag_icon (PhocOutput   *self,
-                                                PhocDragIcon *icon);
+void        phoc_output_damage_from_view_root (PhocOutput *self, PhocView *view);
+void        phoc_output_damage_from_view_child (PhocOutput         *self,
+                                                PhocView           *view,
+                                                struct wlr_surface *surface,
+                                                int                 sx,
+                                                int                 sy,
+                                                bool                whole);
+void        phoc_output_damage_view_in_region (PhocOutput        *self,
+                                               PhocView          *view,
+                                               pixman_region32_t *region);
+void        phoc_output_damage_from_drag_icon (PhocOutput   *self,
+                                               PhocDragIcon *icon,
+                                               bool          whole);
 void        phoc_output_damage_from_surface (PhocOutput *self, struct wlr_surface *surface,
                                              double ox, double oy);
 void        phoc_output_damage_whole_surface (PhocOutput *self, struct wlr_surface *surface,
@@ -161,15 +248,41 @@ void       phoc_output_remove_frame_callback (PhocOutput        *self,
 void       phoc_output_remove_frame_callbacks_by_animatable (PhocOutput     *self,
                                                              PhocAnimatable *animatable);
 bool       phoc_output_has_frame_callbacks   (PhocOutput        *self);
+gint64     phoc_output_get_next_present_us   (PhocOutput        *self);
+void       phoc_output_notify_activity       (PhocOutput        *self);
 
 void       phoc_output_lower_shield          (PhocOutput *self);
 void       phoc_output_raise_shield          (PhocOutput *self);
 float      phoc_output_get_scale             (PhocOutput *self);
+void       phoc_output_update_layout_box     (PhocOutput *self);
 const char *phoc_output_get_name             (PhocOutput *self);
 void       phoc_output_transform_damage      (PhocOutput *self, pixman_region32_t *damage);
 void       phoc_output_transform_box         (PhocOutput *self, struct wlr_box *box);
 
 enum wlr_scale_filter_mode
            phoc_output_get_texture_filter_mode (PhocOutput *self);
+PhocFrameStats *
+           phoc_output_get_frame_stats (PhocOutput *self);
+GArray    *phoc_output_get_input_latency_pending (PhocOutput *self);
+PhocLayerCache *
+           phoc_output_get_layer_cache       (PhocOutput *self);
+void       phoc_output_set_layer_cache       (PhocOutput     *self,
+                                              PhocLayerCache *cache);
+gboolean   phoc_output_has_pending_frame (PhocOutput *self);
+PhocDamageHeatmap *
+           phoc_output_get_damage_heatmap (PhocOutput *self);
+void       phoc_output_set_overview          (PhocOutput   *self,
+                                              PhocOverview *overview);
+PhocOverview *
+           phoc_output_get_overview          (PhocOutput *self);
+void       phoc_output_set_magnifier_zoom    (PhocOutput *self, double zoom);
+double     phoc_output_get_magnifier_zoom    (PhocOutput *self);
+void       phoc_output_set_magnifier_focus   (PhocOutput *self, double lx, double ly);
+void       phoc_output_magnifier_map_point   (PhocOutput *self, double *lx, double *ly);
+void       phoc_output_set_power_saver       (PhocOutput *self, gboolean power_saver);
+PhocScanoutResult
+           phoc_output_get_scanout_result (PhocOutput *self);
+gboolean   phoc_output_has_render_overlays   (PhocOutput *self);
+gsize      phoc_output_get_cutouts_size      (PhocOutput *self);
 
 G_END_DECLS
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-overview"
+
+#include "phoc-config.h"
+
+#include "overview.h"
+
+/**
+ * PhocOverview:
+ *
+ * Views the shell placed on an output's overview. The compositor
+ * renders the placed views' surfaces directly above the top layer so
+ * showing live window previews doesn't need a render, a readback and
+ * a copy per view like thumbnails do.
+ *
+ * Placed views get frame callbacks from the output and damage their
+ * placement whenever their content changes.
+ */
+struct _PhocOverview {
+  GObject     parent;
+
+  PhocOutput *output;
+  GArray     *placements; /* PhocOverviewPlacement */
+};
+
+G_DEFINE_TYPE (PhocOverview, phoc_overview, G_TYPE_OBJECT)
+
+typedef struct {
+  PhocView       *view;
+  struct wlr_box  box;
+} PhocOverviewPlacement;
+
+
+static void
+damage_placement (PhocOverview *self, PhocOverviewPlacement *placement)
+{
+  if (self->output)
+    phoc_output_damage_box (self->output, &placement->box);
+}
+
+
+static PhocOverviewPlacement *
+find_placement (PhocOverview *self, PhocView *view, guint *index)
+{
+  for (guint i = 0; i < self->placements->len; i++) {
+    PhocOverviewPlacement *placement = &g_array_index (self->placements, PhocOverviewPlacement, i);
+
+    if (placement->view != view)
+      continue;
+
+    if (index)
+      *index = i;
+    return placement;
+  }
+
+  return NULL;
+}
+
+
+static void
+on_view_content_changed (PhocOverview *self, PhocView *view)
+{
+  PhocOverviewPlacement *placement = find_placement (self, view, NULL);
+
+  g_assert (placement);
+  damage_placement (self, placement);
+}
+
+
+static void
+on_view_surface_destroy (PhocOverview *self, PhocView *view)
+{
+  phoc_overview_remove_view (self, view);
+}
+
+
+static void
+phoc_overview_dispose (GObject *object)
+{
+  PhocOverview *self = PHOC_OVERVIEW (object);
+
+  while (self->placements->len) {
+    PhocOverviewPlacement *placement = &g_array_index (self->placements, PhocOverviewPlacement, 0);
+
+    phoc_overview_remove_view (self, placement->view);
+  }
+
+  g_clear_weak_pointer (&self->output);
+
+  G_OBJECT_CLASS (phoc_overview_parent_class)->dispose (object);
+}
+
+
+static void
+phoc_overview_finalize (GObject *object)
+{
+  PhocOverview *self = PHOC_OVERVIEW (object);
+
+  g_clear_pointer (&self->placements, g_array_unref);
+
+  G_OBJECT_CLASS (phoc_overview_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_overview_class_init (PhocOverviewClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = phoc_overview_dispose;
+  object_class->finalize = phoc_overview_finalize;
+}
+
+
+static void
+phoc_overview_init (PhocOverview *self)
+{
+  self->placements = g_array_new (FALSE, FALSE, sizeof (PhocOverviewPlacement));
+}
+
+
+PhocOverview *
+phoc_overview_new (PhocOutput *output)
+{
+  PhocOverview *self = g_object_new (PHOC_TYPE_OVERVIEW, NULL);
+
+  g_set_weak_pointer (&self->output, output);
+
+  return self;
+}
+
+/**
+ * phoc_overview_place_view:
+ * @self: The overview
+ * @view: The view to place
+ * @box: Where to show the view in output local layout coordinates
+ *
+ * Shows @view scaled to fit into @box keeping its aspect ratio. If
+ * @view is already placed it's moved. Views placed later are drawn
+ * on top.
+ */
+void
+phoc_overview_place_view (PhocOverview *self, PhocView *view, const struct wlr_box *box)
+{
+  PhocOverviewPlacement *placement;
+
+  g_assert (PHOC_IS_OVERVIEW (self));
+  g_assert (PHOC_IS_VIEW (view));
+
+  placement = find_placement (self, view, NULL);
+  if (placement) {
+    if (wlr_box_equal (&placement->box, box))
+      return;
+
+    damage_placement (self, placement);
+    placement->box = *box;
+    damage_placement (self, placement);
+    return;
+  }
+
+  g_array_append_val (self->placements, ((PhocOverviewPlacement) { .view = view, .box = *box }));
+  g_signal_connect_swapped (view, "content-changed", G_CALLBACK (on_view_content_changed), self);
+  g_signal_connect_swapped (view, "surface-destroy", G_CALLBACK (on_view_surface_destroy), self);
+
+  placement = &g_array_index (self->placements, PhocOverviewPlacement, self->placements->len - 1);
+  damage_placement (self, placement);
+}
+
+/**
+ * phoc_overview_remove_view:
+ * @self: The overview
+ * @view: The view to remove
+ *
+ * Stops showing @view on the overview.
+ */
+void
+phoc_overview_remove_view (PhocOverview *self, PhocView *view)
+{
+  PhocOverviewPlacement *placement;
+  guint index;
+
+  g_assert (PHOC_IS_OVERVIEW (self));
+
+  placement = find_placement (self, view, &index);
+  if (!placement)
+    return;
+
+  damage_placement (self, placement);
+  g_signal_handlers_disconnect_by_data (view, self);
+  g_array_remove_index (self->placements, index);
+}
+
+/**
+ * phoc_overview_get_output:
+ * @self: The overview
+ *
+ * Returns:(transfer none)(nullable): The output the views are placed
+ *   on or %NULL if the output is gone
+ */
+PhocOutput *
+phoc_overview_get_output (PhocOverview *self)
+{
+  g_assert (PHOC_IS_OVERVIEW (self));
+
+  return self->output;
+}
+
+/**
+ * phoc_overview_has_views:
+ * @self: The overview
+ *
+ * Returns: %TRUE if any views are placed on the overview
+ */
+gboolean
+phoc_overview_has_views (PhocOverview *self)
+{
+  g_assert (PHOC_IS_OVERVIEW (self));
+
+  return self->placements->len > 0;
+}
+
+/**
+ * phoc_overview_for_each_surface:
+ * @self: The overview
+ * @iterator: (scope call): The callback invoked on each iteration
+ * @user_data: Callback user data
+ *
+ * Iterate over the surfaces of the placed views in rendering order
+ * (bottom to top).
+ */
+void
+phoc_overview_for_each_surface (PhocOverview        *self,
+                                PhocSurfaceIterator  iterator,
+                                void                *user_data)
+{
+  g_assert (PHOC_IS_OVERVIEW (self));
+
+  if (!self->output)
+    return;
+
+  for (guint i = 0; i < self->placements->len; i++) {
+    PhocOverviewPlacement *placement = &g_array_index (self->placements, PhocOverviewPlacement, i);
+
+    if (!phoc_view_is_mapped (placement->view))
+      continue;
+
+    phoc_output_view_for_each_surface_in_box (self->output, placement->view, &placement->box,
+                                              iterator, user_data);
+  }
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "output.h"
+#include "view.h"
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_OVERVIEW (phoc_overview_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocOverview, phoc_overview, PHOC, OVERVIEW, GObject)
+
+PhocOverview *phoc_overview_new              (PhocOutput           *output);
+void          phoc_overview_place_view       (PhocOverview         *self,
+                                              PhocView             *view,
+                                              const struct wlr_box *box);
+void          phoc_overview_remove_view      (PhocOverview         *self,
+                                              PhocView             *view);
+PhocOutput   *phoc_overview_get_output       (PhocOverview         *self);
+gboolean      phoc_overview_has_views        (PhocOverview         *self);
+void          phoc_overview_for_each_surface (PhocOverview         *self,
+                                              PhocSurfaceIterator   iterator,
+                                              void                 *user_data);
+
+G_END_DECLS
@@ -8,6 +8,38 @@
 
 #pragma once
 
+/*
+ * Static probes (provider "phoc") covering the frame pipeline. See
+ * helpers/tracing/ for systemtap and bpftrace scripts using them.
+ *
+ * frame_start (output_name, damage_area): an output starts a frame,
+ *   damage_area is the damaged area in buffer pixels
+ * frame_end (output_name, scanned_out): frame done, scanned_out is
+ *   non-zero if the frame went out via direct scanout
+ * frame_skip (output_name): the frame was skipped as all damage is
+ *   hidden below an unchanged fullscreen view
+ * render_texture (output_name, texture, width, height): a texture got
+ *   submitted to the render pass with the given output box size
+ * render_culled (output_name, pixels): pixels not painted in this frame
+ *   due to opaque surfaces on top
+ * scanout_accept (output_name): the fullscreen view got scanned out
+ * scanout_reject (output_name, reason): direct scanout was rejected,
+ *   reason is a short string like "overlay-layer"
+ * planes_assign (output_name, n_candidates, n_accepted): surfaces were
+ *   tested for and put on hardware overlay planes
+ * cursor_software (output_name, reason): the cursor started getting
+ *   rendered in software, reason is a short string like "rejected"
+ * input_dispatch_start (type, time_msec): an input event enters the
+ *   gesture machinery, time_msec is the event's CLOCK_MONOTONIC timestamp
+ * input_dispatch_end (type): the event was processed
+ * layer_arrange_start (output_name), layer_arrange_end (output_name):
+ *   layer surfaces on an output get (re)arranged
+ * startup_phase (phase): startup reached the given phase, e.g.
+ *   "first-frame" or "shell-up"
+ * idle_inhibit (app_id, inhibit, reason): an idle inhibitor started or
+ *   stopped inhibiting, reason is a short string like "occluded"
+ */
+
 #ifdef PHOC_USE_DTRACE
 
 # include <sys/sdt.h>
@@ -13,6 +13,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <wayland-server-core.h>
 #include <wlr/config.h>
@@ -22,12 +23,10 @@
 #include <wlr-screencopy-unstable-v1-protocol.h>
 #include "server.h"
 #include "desktop.h"
+#include "overview.h"
 #include "render.h"
 #include "utils.h"
 
-#include <GLES2/gl2.h>
-#include <GLES2/gl2ext.h>
-
 #include <drm_fourcc.h>
 
 /* help older (0.8.2) libxkbcommon */
@@ -55,6 +54,8 @@ struct _PhocPhoshPrivate {
   struct wl_resource* resource;
   struct wl_global *global;
   GList *keyboard_events;
+  /* Maps the key of every subscribed accelerator to its keyboard event */
+  GHashTable *accelerators;
   guint last_action_id;
   GList *startup_trackers;
   PhocPhoshPrivateShellState state;
@@ -69,6 +70,7 @@ typedef struct {
 
 typedef struct {
   struct wl_resource *resource, *toplevel;
+  struct wl_listener toplevel_destroy;
   struct phosh_private *phosh;
 
   enum wl_shm_format format;
@@ -77,6 +79,14 @@ typedef struct {
   uint32_t stride;
 
   struct wlr_buffer *buffer;
+  struct wlr_shm_attributes attribs;
+  gboolean dmabuf; /* rendered into directly, bypasses the thumbnail cache */
+  guint64  budget_bytes; /* accounted to the client's thumbnail memory budget */
+  gboolean with_damage;
+  gboolean busy; /* waiting for damage or readback, buffer is locked */
+  guint    idle_id;
+  guint64  content_serial;
+  GCancellable *cancellable;
 
   PhocView *view;
 } PhocPhoshPrivateScreencopyFrame;
@@ -86,12 +96,42 @@ typedef struct {
   PhocPhoshPrivate   *phosh;
 } PhocPhoshPrivateStartupTracker;
 
+/* The last thumbnail rendered for a view */
+typedef struct {
+  guint64   content_serial;
+  uint32_t  format;
+  uint32_t  width;
+  uint32_t  height;
+  uint32_t  stride;
+  guint8   *data;
+} PhocPhoshPrivateThumbnail;
+
+#define PHOC_THUMBNAIL_KEY "phoc-thumbnail"
+#define PHOC_THUMBNAIL_TILE_SIZE 32
+
+/*
+ * A client capturing a view via the same toplevel handle. Remember
+ * which content the client already got so new frames are only pushed
+ * when the view changed and damage is relative to what this client
+ * has rather than to the view's shared thumbnail.
+ */
+typedef struct {
+  struct wl_resource *toplevel;
+  struct wl_listener  toplevel_destroy;
+  GHashTable         *owner; /* toplevel resource → PhocPhoshPrivateCaptureSession */
+  gboolean            delivered;
+  guint64             content_serial;
+  PhocPhoshPrivateThumbnail *baseline; /* last shm frame delivered, for damage tracking */
+} PhocPhoshPrivateCaptureSession;
+
+#define PHOC_CAPTURE_SESSIONS_KEY "phoc-capture-sessions"
+
 static PhocPhoshPrivate *phoc_phosh_private_from_resource (struct wl_resource *resource);
 static PhocPhoshPrivateKeyboardEventData *phoc_phosh_private_keyboard_event_from_resource (struct wl_resource *resource);
 static PhocPhoshPrivateScreencopyFrame *phoc_phosh_private_screencopy_frame_from_resource(struct wl_resource *resource);
 static PhocPhoshPrivateStartupTracker *phoc_phosh_private_startup_tracker_from_resource(struct wl_resource *resource);
 
-#define PHOSH_PRIVATE_VERSION 7
+#define PHOSH_PRIVATE_VERSION 9
 
 
 static void
@@ -147,6 +187,16 @@ phoc_phosh_private_keyboard_event_destroy (PhocPhoshPrivateKeyboardEventData *kb
 
   g_debug ("Destroying private_keyboard_event %p (res %p)", kbevent, kbevent->resource);
   phosh = kbevent->phosh;
+  if (phosh) {
+    GHashTableIter iter;
+    gpointer key;
+
+    g_hash_table_iter_init (&iter, kbevent->subscribed_accelerators);
+    while (g_hash_table_iter_next (&iter, &key, NULL)) {
+      if (g_hash_table_lookup (phosh->accelerators, key) == kbevent)
+        g_hash_table_remove (phosh->accelerators, key);
+    }
+  }
   g_hash_table_remove_all (kbevent->subscribed_accelerators);
   g_hash_table_unref (kbevent->subscribed_accelerators);
   wl_resource_set_user_data (kbevent->resource, NULL);
@@ -158,35 +208,21 @@ static void
 phoc_phosh_private_keyboard_event_handle_resource_destroy (struct wl_resource *resource)
 {
   PhocPhoshPrivateKeyboardEventData *kbevent = phoc_phosh_private_keyboard_event_from_resource (resource);
+  PhocClientBudget *budget = phoc_server_get_client_budget (phoc_server_get_default ());
 
+  phoc_client_budget_release (budget, wl_resource_get_client (resource),
+                              PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1);
   phoc_phosh_private_keyboard_event_destroy (kbevent);
 }
 
-static bool
-phoc_phosh_private_keyboard_event_accelerator_is_registered (PhocKeyCombo                      *combo,
-                                                             PhocPhoshPrivateKeyboardEventData *kbevent)
-{
-  gint64 key = ((gint64) combo->modifiers << 32) | combo->keysym;
-  gpointer ret = g_hash_table_lookup (kbevent->subscribed_accelerators, &key);
-  g_debug ("Accelerator is registered: Lookup -> %p", ret);
-  return (ret != NULL);
-}
-
 static bool
 phoc_phosh_private_accelerator_already_subscribed (PhocKeyCombo *combo)
 {
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
   PhocPhoshPrivate *phosh = phoc_desktop_get_phosh_private (desktop);
-  GList *l;
-  PhocPhoshPrivateKeyboardEventData *kbevent;
+  gint64 key = phoc_key_combo_to_key (combo);
 
-  for (l = phosh->keyboard_events; l != NULL; l = l->next) {
-    kbevent = (PhocPhoshPrivateKeyboardEventData *)l->data;
-    if (phoc_phosh_private_keyboard_event_accelerator_is_registered (combo, kbevent))
-      return true;
-  }
-
-  return false;
+  return g_hash_table_contains (phosh->accelerators, &key);
 }
 
 
@@ -275,11 +311,14 @@ phoc_phosh_private_keyboard_event_grab_accelerator_request (struct wl_client   *
   }
 
   new_key = (gint64 *) g_malloc (sizeof (gint64));
-  *new_key = ((gint64) combo->modifiers << 32) | combo->keysym;
+  *new_key = phoc_key_combo_to_key (combo);
 
   /* subscribed accelerators of kbevent */
   g_hash_table_insert (kbevent->subscribed_accelerators,
                        new_key, GUINT_TO_POINTER (new_action_id));
+  /* all subscribed accelerators */
+  g_hash_table_insert (kbevent->phosh->accelerators,
+                       g_memdup2 (new_key, sizeof (gint64)), kbevent);
 
   phosh_private_keyboard_event_send_grab_success_event (resource,
                                                         accelerator,
@@ -310,6 +349,7 @@ phoc_phosh_private_keyboard_event_ungrab_accelerator_request (struct wl_client *
   }
 
   if (found) {
+    g_hash_table_remove (kbevent->phosh->accelerators, key);
     g_hash_table_remove (kbevent->subscribed_accelerators, key);
     phosh_private_keyboard_event_send_ungrab_success_event (resource,
                                                             action_id);
@@ -342,16 +382,21 @@ handle_get_keyboard_event (struct wl_client   *client,
                            struct wl_resource *phosh_private_resource,
                            uint32_t            id)
 {
-  PhocPhoshPrivateKeyboardEventData *kbevent = g_new0 (PhocPhoshPrivateKeyboardEventData, 1);
+  PhocClientBudget *budget = phoc_server_get_client_budget (phoc_server_get_default ());
+  PhocPhoshPrivateKeyboardEventData *kbevent;
 
-  if (kbevent == NULL) {
-    wl_client_post_no_memory (client);
+  if (!phoc_client_budget_acquire (budget, client, PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1)) {
+    wl_resource_post_error (phosh_private_resource, PHOSH_PRIVATE_ERROR_RESOURCE_LIMIT,
+                            "Too many keyboard event objects");
     return;
   }
 
+  kbevent = g_new0 (PhocPhoshPrivateKeyboardEventData, 1);
+
   int version = wl_resource_get_version (phosh_private_resource);
   kbevent->resource = wl_resource_create (client, &phosh_private_keyboard_event_interface, version, id);
   if (kbevent->resource == NULL) {
+    phoc_client_budget_release (budget, client, PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1);
     g_free (kbevent);
     wl_client_post_no_memory (client);
     return;
@@ -361,6 +406,7 @@ handle_get_keyboard_event (struct wl_client   *client,
                                                             g_int64_equal,
                                                             g_free, NULL);
   if (kbevent->subscribed_accelerators == NULL) {
+    phoc_client_budget_release (budget, client, PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1);
     wl_resource_destroy (kbevent->resource);
     g_free (kbevent);
     wl_client_post_no_memory (client);
@@ -381,14 +427,42 @@ handle_get_keyboard_event (struct wl_client   *client,
 }
 
 
+static void
+thumbnail_frame_finish (PhocPhoshPrivateScreencopyFrame *frame)
+{
+  if (frame->view) {
+    g_signal_handlers_disconnect_by_data (frame->view, frame);
+    frame->view = NULL;
+  }
+  if (frame->toplevel) {
+    wl_list_remove (&frame->toplevel_destroy.link);
+    frame->toplevel = NULL;
+  }
+  g_clear_handle_id (&frame->idle_id, g_source_remove);
+  g_cancellable_cancel (frame->cancellable);
+  g_clear_object (&frame->cancellable);
+
+  if (frame->busy) {
+    wlr_buffer_unlock (frame->buffer);
+    frame->busy = FALSE;
+  }
+}
+
+
 static void
 phosh_private_screencopy_frame_handle_resource_destroy (struct wl_resource *resource)
 {
   PhocPhoshPrivateScreencopyFrame *frame = phoc_phosh_private_screencopy_frame_from_resource (resource);
 
   g_debug ("Destroying private_screencopy_frame %p (res %p)", frame, frame->resource);
-  if (frame->view)
-    g_signal_handlers_disconnect_by_data (frame->view, frame);
+  thumbnail_frame_finish (frame);
+
+  if (frame->budget_bytes) {
+    PhocClientBudget *budget = phoc_server_get_client_budget (phoc_server_get_default ());
+
+    phoc_client_budget_release (budget, wl_resource_get_client (resource),
+                                PHOC_CLIENT_RESOURCE_THUMBNAIL_MEMORY, frame->budget_bytes);
+  }
 
   free (frame);
 }
@@ -399,34 +473,383 @@ on_surface_destroy (PhocView *view, PhocPhoshPrivateScreencopyFrame *frame)
 {
   g_assert (PHOC_IS_VIEW (view));
 
-  g_signal_handlers_disconnect_by_data (frame->view, frame);
-  frame->view = NULL;
+  if (frame->busy)
+    zwlr_screencopy_frame_v1_send_failed (frame->resource);
+
+  thumbnail_frame_finish (frame);
 }
 
 
+/*
+ * The client destroyed the toplevel handle while the frame is still
+ * around. Capture sessions are keyed by it so the frame can't continue.
+ */
 static void
-thumbnail_frame_handle_copy (struct wl_client   *wl_client,
-                             struct wl_resource *frame_resource,
-                             struct wl_resource *buffer_resource)
+thumbnail_frame_handle_toplevel_destroy (struct wl_listener *listener, void *data)
 {
-  PhocServer *server = phoc_server_get_default ();
-  PhocRenderer *self = phoc_server_get_renderer (server);
+  PhocPhoshPrivateScreencopyFrame *frame = wl_container_of (listener, frame, toplevel_destroy);
+
+  if (frame->busy)
+    zwlr_screencopy_frame_v1_send_failed (frame->resource);
+
+  thumbnail_frame_finish (frame);
+}
+
+
+static void
+thumbnail_free (PhocPhoshPrivateThumbnail *thumbnail)
+{
+  g_free (thumbnail->data);
+  g_free (thumbnail);
+}
+
+
+static gboolean
+thumbnail_matches (PhocPhoshPrivateThumbnail *thumbnail, struct wlr_shm_attributes *attribs)
+{
+  return thumbnail->format == attribs->format &&
+    thumbnail->width == attribs->width &&
+    thumbnail->height == attribs->height &&
+    thumbnail->stride == attribs->stride;
+}
+
+
+static void
+thumbnail_store (PhocPhoshPrivateThumbnail *thumbnail,
+                 guint64                    content_serial,
+                 const guint8              *data,
+                 struct wlr_shm_attributes *attribs)
+{
+  gsize size = (gsize)attribs->stride * attribs->height;
+
+  if ((gsize)thumbnail->stride * thumbnail->height != size) {
+    g_free (thumbnail->data);
+    thumbnail->data = g_malloc (size);
+  }
+
+  thumbnail->content_serial = content_serial;
+  thumbnail->format = attribs->format;
+  thumbnail->width = attribs->width;
+  thumbnail->height = attribs->height;
+  thumbnail->stride = attribs->stride;
+  memcpy (thumbnail->data, data, size);
+}
+
+
+static void
+capture_session_free (PhocPhoshPrivateCaptureSession *session)
+{
+  wl_list_remove (&session->toplevel_destroy.link);
+  g_clear_pointer (&session->baseline, thumbnail_free);
+  g_free (session);
+}
+
+
+static void
+capture_session_handle_toplevel_destroy (struct wl_listener *listener, void *data)
+{
+  PhocPhoshPrivateCaptureSession *session = wl_container_of (listener, session, toplevel_destroy);
+
+  /* Frees session */
+  g_hash_table_remove (session->owner, session->toplevel);
+}
+
+
+static PhocPhoshPrivateCaptureSession *
+capture_session_get (PhocView *view, struct wl_resource *toplevel)
+{
+  GHashTable *sessions = g_object_get_data (G_OBJECT (view), PHOC_CAPTURE_SESSIONS_KEY);
+  PhocPhoshPrivateCaptureSession *session;
+
+  if (sessions == NULL) {
+    sessions = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                      (GDestroyNotify)capture_session_free);
+    g_object_set_data_full (G_OBJECT (view), PHOC_CAPTURE_SESSIONS_KEY, sessions,
+                            (GDestroyNotify)g_hash_table_destroy);
+  }
+
+  session = g_hash_table_lookup (sessions, toplevel);
+  if (session)
+    return session;
+
+  session = g_new0 (PhocPhoshPrivateCaptureSession, 1);
+  session->toplevel = toplevel;
+  session->owner = sessions;
+  session->toplevel_destroy.notify = capture_session_handle_toplevel_destroy;
+  wl_resource_add_destroy_listener (toplevel, &session->toplevel_destroy);
+  g_hash_table_insert (sessions, toplevel, session);
+
+  return session;
+}
+
+
+static PhocPhoshPrivateThumbnail *
+thumbnail_get_cached (PhocView *view, struct wlr_shm_attributes *attribs)
+{
+  PhocPhoshPrivateThumbnail *thumbnail = g_object_get_data (G_OBJECT (view), PHOC_THUMBNAIL_KEY);
+
+  if (thumbnail == NULL || !thumbnail_matches (thumbnail, attribs))
+    return NULL;
+
+  return thumbnail;
+}
+
+/*
+ * Fill the buffer from the view's cached thumbnail if the view didn't
+ * change since it was rendered.
+ */
+static gboolean
+thumbnail_from_cache (PhocView *view, struct wlr_buffer *buffer, struct wlr_shm_attributes *attribs)
+{
+  PhocPhoshPrivateThumbnail *thumbnail = thumbnail_get_cached (view, attribs);
+  void *data;
+  uint32_t format;
+  size_t stride;
+
+  if (thumbnail == NULL || thumbnail->content_serial != phoc_view_get_content_serial (view))
+    return FALSE;
+
+  if (!wlr_buffer_begin_data_ptr_access (buffer, WLR_BUFFER_DATA_PTR_ACCESS_WRITE,
+                                         &data, &format, &stride)) {
+    return FALSE;
+  }
+
+  memcpy (data, thumbnail->data, (gsize)thumbnail->stride * thumbnail->height);
+  wlr_buffer_end_data_ptr_access (buffer);
+
+  return TRUE;
+}
+
+/*
+ * Compare the thumbnail against the new content tile by tile
+ */
+static void
+thumbnail_get_damage (PhocPhoshPrivateThumbnail *thumbnail,
+                      const guint8              *data,
+                      pixman_region32_t         *damage)
+{
+  for (uint32_t ty = 0; ty < thumbnail->height; ty += PHOC_THUMBNAIL_TILE_SIZE) {
+    uint32_t th = MIN (PHOC_THUMBNAIL_TILE_SIZE, thumbnail->height - ty);
+
+    for (uint32_t tx = 0; tx < thumbnail->width; tx += PHOC_THUMBNAIL_TILE_SIZE) {
+      uint32_t tw = MIN (PHOC_THUMBNAIL_TILE_SIZE, thumbnail->width - tx);
+
+      for (uint32_t y = ty; y < ty + th; y++) {
+        gsize offset = (gsize)y * thumbnail->stride + tx * 4;
+
+        if (memcmp (thumbnail->data + offset, data + offset, tw * 4) != 0) {
+          pixman_region32_union_rect (damage, damage, tx, ty, tw, th);
+          break;
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Store the buffer's content as the view's thumbnail.
+ */
+static void
+thumbnail_to_cache (PhocView                  *view,
+                    guint64                    content_serial,
+                    struct wlr_buffer         *buffer,
+                    struct wlr_shm_attributes *attribs)
+{
+  PhocPhoshPrivateThumbnail *thumbnail = g_object_get_data (G_OBJECT (view), PHOC_THUMBNAIL_KEY);
+  void *data;
+  uint32_t format;
+  size_t stride;
+
+  if (!wlr_buffer_begin_data_ptr_access (buffer, WLR_BUFFER_DATA_PTR_ACCESS_READ,
+                                         &data, &format, &stride)) {
+    return;
+  }
+
+  if (thumbnail == NULL) {
+    thumbnail = g_new0 (PhocPhoshPrivateThumbnail, 1);
+    g_object_set_data_full (G_OBJECT (view), PHOC_THUMBNAIL_KEY, thumbnail,
+                            (GDestroyNotify)thumbnail_free);
+  }
+
+  thumbnail_store (thumbnail, content_serial, data, attribs);
+
+  wlr_buffer_end_data_ptr_access (buffer);
+}
+
+/*
+ * Get the area of the frame's buffer that differs from what the
+ * frame's capture session delivered last and remember the buffer's
+ * content as the new baseline. The first frame of a session is
+ * always fully damaged.
+ */
+static void
+thumbnail_frame_get_damage (PhocPhoshPrivateScreencopyFrame *frame,
+                            PhocPhoshPrivateCaptureSession  *session,
+                            pixman_region32_t               *damage)
+{
+  void *data;
+  uint32_t format;
+  size_t stride;
+
+  if (frame->dmabuf) {
+    pixman_region32_union_rect (damage, damage, 0, 0, frame->width, frame->height);
+    return;
+  }
+
+  if (!wlr_buffer_begin_data_ptr_access (frame->buffer, WLR_BUFFER_DATA_PTR_ACCESS_READ,
+                                         &data, &format, &stride)) {
+    pixman_region32_union_rect (damage, damage, 0, 0, frame->width, frame->height);
+    g_clear_pointer (&session->baseline, thumbnail_free);
+    return;
+  }
+
+  if (session->delivered && session->baseline &&
+      thumbnail_matches (session->baseline, &frame->attribs)) {
+    thumbnail_get_damage (session->baseline, data, damage);
+  } else {
+    pixman_region32_union_rect (damage, damage, 0, 0, frame->width, frame->height);
+  }
+
+  if (session->baseline == NULL)
+    session->baseline = g_new0 (PhocPhoshPrivateThumbnail, 1);
+
+  thumbnail_store (session->baseline, frame->content_serial, data, &frame->attribs);
+
+  wlr_buffer_end_data_ptr_access (frame->buffer);
+}
+
+static void
+thumbnail_frame_send_ready (PhocPhoshPrivateScreencopyFrame *frame, pixman_region32_t *damage)
+{
+  zwlr_screencopy_frame_v1_send_flags (frame->resource, 0);
+
+  if (frame->with_damage) {
+    int n_rects;
+    pixman_box32_t *rects = pixman_region32_rectangles (damage, &n_rects);
+
+    for (int i = 0; i < n_rects; i++) {
+      zwlr_screencopy_frame_v1_send_damage (frame->resource,
+                                            rects[i].x1, rects[i].y1,
+                                            rects[i].x2 - rects[i].x1,
+                                            rects[i].y2 - rects[i].y1);
+    }
+  }
+
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  uint32_t tv_sec_hi = (sizeof(now.tv_sec) > 4) ? now.tv_sec >> 32 : 0;
+  uint32_t tv_sec_lo = now.tv_sec & 0xFFFFFFFF;
+  zwlr_screencopy_frame_v1_send_ready (frame->resource, tv_sec_hi, tv_sec_lo, now.tv_nsec);
+}
+
+static void thumbnail_frame_render (PhocPhoshPrivateScreencopyFrame *frame);
+
+/*
+ * Send the frame's buffer to the client. Frames captured with damage
+ * keep waiting when nothing changed for the frame's capture session.
+ */
+static void
+thumbnail_frame_deliver (PhocPhoshPrivateScreencopyFrame *frame)
+{
+  PhocPhoshPrivateCaptureSession *session;
+  pixman_region32_t damage;
+
+  if (!frame->with_damage) {
+    pixman_region32_init_rect (&damage, 0, 0, frame->width, frame->height);
+    thumbnail_frame_send_ready (frame, &damage);
+    pixman_region32_fini (&damage);
+    thumbnail_frame_finish (frame);
+    return;
+  }
+
+  session = capture_session_get (frame->view, frame->toplevel);
+  pixman_region32_init (&damage);
+  thumbnail_frame_get_damage (frame, session, &damage);
+
+  if (pixman_region32_not_empty (&damage)) {
+    session->delivered = TRUE;
+    session->content_serial = frame->content_serial;
+    thumbnail_frame_send_ready (frame, &damage);
+    thumbnail_frame_finish (frame);
+  } else if (frame->content_serial != phoc_view_get_content_serial (frame->view)) {
+    /* Nothing visible changed but the view did meanwhile */
+    thumbnail_frame_render (frame);
+  }
+  /* Otherwise wait for further changes */
+
+  pixman_region32_fini (&damage);
+}
+
+static void
+on_render_view_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  PhocRenderer *renderer = PHOC_RENDERER (source_object);
   PhocPhoshPrivateScreencopyFrame *frame;
-  struct wlr_shm_attributes attribs;
+  g_autoptr (GError) err = NULL;
 
-  frame = phoc_phosh_private_screencopy_frame_from_resource (frame_resource);
-  g_return_if_fail (frame);
+  if (!phoc_renderer_render_view_to_buffer_finish (renderer, res, &err)) {
+    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      return;
+
+    frame = user_data;
+    g_debug ("Failed to render thumbnail: %s", err->message);
+    zwlr_screencopy_frame_v1_send_failed (frame->resource);
+    thumbnail_frame_finish (frame);
+    return;
+  }
+
+  frame = user_data;
+  g_clear_object (&frame->cancellable);
 
+  if (!frame->dmabuf)
+    thumbnail_to_cache (frame->view, frame->content_serial, frame->buffer, &frame->attribs);
+
+  thumbnail_frame_deliver (frame);
+}
+
+/*
+ * Render the view into the frame's buffer and send the result once
+ * the readback finished. Unchanged views are served from the cache.
+ */
+static void
+thumbnail_frame_render (PhocPhoshPrivateScreencopyFrame *frame)
+{
+  PhocRenderer *renderer = phoc_server_get_renderer (phoc_server_get_default ());
+
+  frame->content_serial = phoc_view_get_content_serial (frame->view);
+
+  if (!frame->dmabuf && thumbnail_from_cache (frame->view, frame->buffer, &frame->attribs)) {
+    thumbnail_frame_deliver (frame);
+    return;
+  }
+
+  frame->cancellable = g_cancellable_new ();
+  phoc_renderer_render_view_to_buffer_async (renderer,
+                                             frame->view,
+                                             frame->buffer,
+                                             frame->cancellable,
+                                             on_render_view_done,
+                                             frame);
+}
+
+
+/*
+ * Lock the client's buffer and check it matches what we announced.
+ */
+static gboolean
+thumbnail_frame_attach_buffer (PhocPhoshPrivateScreencopyFrame *frame,
+                               struct wl_resource              *buffer_resource)
+{
   if (frame->buffer != NULL) {
     wl_resource_post_error (frame->resource,
                             ZWLR_SCREENCOPY_FRAME_V1_ERROR_ALREADY_USED,
                             "frame already used");
-    return;
+    return FALSE;
   }
 
   if (!frame->view) {
     zwlr_screencopy_frame_v1_send_failed (frame->resource);
-    return;
+    return FALSE;
   }
 
   frame->buffer = wlr_buffer_try_from_resource (buffer_resource);
@@ -434,54 +857,114 @@ thumbnail_frame_handle_copy (struct wl_client   *wl_client,
     wl_resource_post_error (frame->resource,
                             ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER,
                             "unsupported buffer type");
-    return;
+    return FALSE;
   }
 
-  if (!wlr_buffer_get_shm (frame->buffer, &attribs)) {
-    wl_resource_post_error (frame->resource,
-                            ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER,
-                            "unsupported buffer type");
-    goto unlock_buffer;
+  if (!wlr_buffer_get_shm (frame->buffer, &frame->attribs)) {
+    struct wlr_dmabuf_attributes dmabuf_attribs;
+
+    if (!wlr_buffer_get_dmabuf (frame->buffer, &dmabuf_attribs)) {
+      wl_resource_post_error (frame->resource,
+                              ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER,
+                              "unsupported buffer type");
+      goto unlock_buffer;
+    }
+
+    if (dmabuf_attribs.width != frame->width || dmabuf_attribs.height != frame->height) {
+      wl_resource_post_error (frame->resource,
+                              ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER,
+                              "invalid buffer attributes");
+      goto unlock_buffer;
+    }
+
+    frame->dmabuf = TRUE;
+    return TRUE;
   }
 
-  if (attribs.width != frame->width ||
-      attribs.height != frame->height || attribs.stride != frame->stride) {
+  if (frame->attribs.width != frame->width ||
+      frame->attribs.height != frame->height || frame->attribs.stride != frame->stride) {
     wl_resource_post_error (frame->resource,
                             ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER,
                             "invalid buffer attributes");
     goto unlock_buffer;
   }
 
-  PhocView *view = frame->view;
-  g_signal_handlers_disconnect_by_data (frame->view, frame);
-  frame->view = NULL;
+  return TRUE;
 
-  if (!phoc_renderer_render_view_to_buffer (self, view, frame->buffer)) {
-    zwlr_screencopy_frame_v1_send_failed (frame->resource);
-    goto unlock_buffer;
-  }
+ unlock_buffer:
+  wlr_buffer_unlock (frame->buffer);
+  return FALSE;
+}
 
-  zwlr_screencopy_frame_v1_send_flags (frame->resource, 0);
 
-  struct timespec now;
-  clock_gettime (CLOCK_MONOTONIC, &now);
-  uint32_t tv_sec_hi = (sizeof(now.tv_sec) > 4) ? now.tv_sec >> 32 : 0;
-  uint32_t tv_sec_lo = now.tv_sec & 0xFFFFFFFF;
-  zwlr_screencopy_frame_v1_send_ready (frame->resource, tv_sec_hi, tv_sec_lo, now.tv_nsec);
+static void
+thumbnail_frame_handle_copy (struct wl_client   *wl_client,
+                             struct wl_resource *frame_resource,
+                             struct wl_resource *buffer_resource)
+{
+  PhocPhoshPrivateScreencopyFrame *frame;
 
-unlock_buffer:
-  wlr_buffer_unlock (frame->buffer);
+  frame = phoc_phosh_private_screencopy_frame_from_resource (frame_resource);
+  g_return_if_fail (frame);
+
+  if (!thumbnail_frame_attach_buffer (frame, buffer_resource))
+    return;
+
+  frame->busy = TRUE;
+  thumbnail_frame_render (frame);
+}
+
+
+static gboolean
+on_damage_idle (gpointer data)
+{
+  PhocPhoshPrivateScreencopyFrame *frame = data;
+
+  frame->idle_id = 0;
+
+  /* A readback is in flight already, it will pick up the change */
+  if (frame->cancellable == NULL)
+    thumbnail_frame_render (frame);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+on_content_changed (PhocView *view, PhocPhoshPrivateScreencopyFrame *frame)
+{
+  g_assert (PHOC_IS_VIEW (view));
+
+  /* Render once all of the view's surfaces got committed */
+  if (!frame->idle_id)
+    frame->idle_id = g_idle_add (on_damage_idle, frame);
 }
 
+
 static void
 thumbnail_frame_handle_copy_with_damage (struct wl_client   *wl_client,
                                          struct wl_resource *frame_resource,
                                          struct wl_resource *buffer_resource)
 {
-  // XXX: unimplemented
-  (void)wl_client;
-  (void)buffer_resource;
-  zwlr_screencopy_frame_v1_send_failed (frame_resource);
+  PhocPhoshPrivateScreencopyFrame *frame;
+  PhocPhoshPrivateCaptureSession *session;
+
+  frame = phoc_phosh_private_screencopy_frame_from_resource (frame_resource);
+  g_return_if_fail (frame);
+
+  if (!thumbnail_frame_attach_buffer (frame, buffer_resource))
+    return;
+
+  frame->with_damage = TRUE;
+  frame->busy = TRUE;
+  g_signal_connect (frame->view, "content-changed", G_CALLBACK (on_content_changed), frame);
+
+  /* The client has the current content already, wait for the view to commit */
+  session = capture_session_get (frame->view, frame->toplevel);
+  if (session->delivered && session->content_serial == phoc_view_get_content_serial (frame->view))
+    return;
+
+  thumbnail_frame_render (frame);
 }
 
 static void
@@ -497,16 +980,6 @@ static const struct zwlr_screencopy_frame_v1_interface phoc_phosh_private_screen
   .copy_with_damage = thumbnail_frame_handle_copy_with_damage,
 };
 
-static uint32_t
-get_preferred_read_format (void)
-{
-  const char *exts_str = (const char *)glGetString(GL_EXTENSIONS);
-  if (exts_str != NULL && strstr(exts_str, "GL_EXT_read_format_bgra"))
-    return DRM_FORMAT_ARGB8888;
-
-  return DRM_FORMAT_ABGR8888;
-}
-
 static void
 handle_get_thumbnail (struct wl_client *client,
                       struct wl_resource *phosh_private_resource,
@@ -515,7 +988,9 @@ handle_get_thumbnail (struct wl_client *client,
                       uint32_t max_width,
                       uint32_t max_height)
 {
-  static uint32_t preferred_read_format = 0;
+  PhocServer *server = phoc_server_get_default ();
+  PhocRenderer *renderer = phoc_server_get_renderer (server);
+  PhocClientBudget *budget = phoc_server_get_client_budget (server);
   PhocPhoshPrivateScreencopyFrame *frame = g_new0 (PhocPhoshPrivateScreencopyFrame, 1);
 
   if (frame == NULL) {
@@ -523,9 +998,6 @@ handle_get_thumbnail (struct wl_client *client,
     return;
   }
 
-  if (!preferred_read_format)
-    preferred_read_format = get_preferred_read_format();
-
   int version = wl_resource_get_version (phosh_private_resource);
   frame->resource = wl_resource_create (client, &zwlr_screencopy_frame_v1_interface, version, id);
   if (frame->resource == NULL) {
@@ -552,9 +1024,11 @@ handle_get_thumbnail (struct wl_client *client,
     return;
   }
 
-  frame->toplevel = toplevel;
-  frame->view = view;
-  g_signal_connect (view, "surface-destroy", G_CALLBACK (on_surface_destroy), frame);
+  /* Thumbnails are refused via the frame so the shell isn't disconnected on bursts */
+  if (!phoc_client_budget_acquire (budget, client, PHOC_CLIENT_RESOURCE_THUMBNAILS, 1)) {
+    zwlr_screencopy_frame_v1_send_failed (frame->resource);
+    return;
+  }
 
   // We hold to the current surface size even though it may change before
   // the frame is actually rendered. wlr-screencopy doesn't give much
@@ -564,7 +1038,7 @@ handle_get_thumbnail (struct wl_client *client,
   struct wlr_box box;
   phoc_view_get_box (view, &box);
 
-  frame->format = preferred_read_format;
+  frame->format = phoc_renderer_get_preferred_read_format (renderer);
   frame->width = box.width * view->wlr_surface->current.scale;
   frame->height = box.height * view->wlr_surface->current.scale;
 
@@ -583,8 +1057,30 @@ handle_get_thumbnail (struct wl_client *client,
 
   frame->stride = 4 * frame->width;
 
+  if (!phoc_client_budget_acquire (budget, client, PHOC_CLIENT_RESOURCE_THUMBNAIL_MEMORY,
+                                   (guint64)frame->stride * frame->height)) {
+    zwlr_screencopy_frame_v1_send_failed (frame->resource);
+    return;
+  }
+  frame->budget_bytes = (guint64)frame->stride * frame->height;
+
+  frame->toplevel = toplevel;
+  frame->toplevel_destroy.notify = thumbnail_frame_handle_toplevel_destroy;
+  wl_resource_add_destroy_listener (toplevel, &frame->toplevel_destroy);
+  frame->view = view;
+  g_signal_connect (view, "surface-destroy", G_CALLBACK (on_surface_destroy), frame);
+
   zwlr_screencopy_frame_v1_send_buffer (frame->resource, frame->format,
                                         frame->width, frame->height, frame->stride);
+
+  if (version >= ZWLR_SCREENCOPY_FRAME_V1_LINUX_DMABUF_SINCE_VERSION) {
+    /* Let the client skip the readback by rendering into its dmabuf */
+    if (phoc_renderer_can_render_to_dmabuf (renderer)) {
+      zwlr_screencopy_frame_v1_send_linux_dmabuf (frame->resource, frame->format,
+                                                  frame->width, frame->height);
+    }
+    zwlr_screencopy_frame_v1_send_buffer_done (frame->resource);
+  }
 }
 
 
@@ -652,6 +1148,197 @@ handle_get_startup_tracker (struct wl_client   *client,
 }
 
 
+static void
+phoc_phosh_private_commit_stats_handle_list (struct wl_client   *client,
+                                             struct wl_resource *resource)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocCommitStats *commit_stats = phoc_server_get_commit_stats (server);
+
+  for (GList *l = phoc_desktop_get_views (desktop)->head; l; l = l->next) {
+    PhocView *view = PHOC_VIEW (l->data);
+    PhocCommitStatsInfo info;
+    pid_t pid = 0;
+
+    if (!view->wlr_surface ||
+        !phoc_commit_stats_get_owner_info (commit_stats, G_OBJECT (view), &info)) {
+      continue;
+    }
+
+    wl_client_get_credentials (wl_resource_get_client (view->wlr_surface->resource),
+                               &pid, NULL, NULL);
+    phosh_private_commit_stats_send_view (resource,
+                                          phoc_view_get_app_id (view) ?: "",
+                                          pid,
+                                          info.commit_rate,
+                                          MIN (info.damage_per_commit, G_MAXUINT32),
+                                          info.full_damage_percent,
+                                          info.buffer_width,
+                                          info.buffer_height);
+  }
+  phosh_private_commit_stats_send_done (resource);
+}
+
+
+static void
+phoc_phosh_private_commit_stats_handle_destroy (struct wl_client   *client,
+                                                struct wl_resource *resource)
+{
+  wl_resource_destroy (resource);
+}
+
+
+static const struct phosh_private_commit_stats_interface phoc_phosh_private_commit_stats_impl = {
+  .list = phoc_phosh_private_commit_stats_handle_list,
+  .destroy = phoc_phosh_private_commit_stats_handle_destroy,
+};
+
+
+static void
+handle_get_commit_stats (struct wl_client   *client,
+                         struct wl_resource *phosh_private_resource,
+                         uint32_t            id)
+{
+  int version = wl_resource_get_version (phosh_private_resource);
+  struct wl_resource *resource;
+
+  resource = wl_resource_create (client, &phosh_private_commit_stats_interface, version, id);
+  if (resource == NULL) {
+    wl_client_post_no_memory (client);
+    return;
+  }
+
+  g_debug ("New phosh_private_commit_stats (res %p)", resource);
+  /* The statistics are kept by the server so there's no state to track */
+  wl_resource_set_implementation (resource, &phoc_phosh_private_commit_stats_impl, NULL, NULL);
+}
+
+
+static PhocView *
+view_from_toplevel (struct wl_resource *toplevel)
+{
+  struct wlr_foreign_toplevel_handle_v1 *toplevel_handle = wl_resource_get_user_data (toplevel);
+
+  if (!toplevel_handle)
+    return NULL;
+
+  return toplevel_handle->data;
+}
+
+
+static void
+phoc_phosh_private_overview_handle_place_view (struct wl_client   *client,
+                                               struct wl_resource *resource,
+                                               struct wl_resource *toplevel,
+                                               int32_t             x,
+                                               int32_t             y,
+                                               int32_t             width,
+                                               int32_t             height)
+{
+  PhocOverview *overview = wl_resource_get_user_data (resource);
+  PhocView *view = view_from_toplevel (toplevel);
+  struct wlr_box box = { .x = x, .y = y, .width = width, .height = height };
+
+  if (width <= 0 || height <= 0) {
+    wl_resource_post_error (resource, PHOSH_PRIVATE_ERROR_INVALID_ARGUMENT,
+                            "Invalid size %dx%d", width, height);
+    return;
+  }
+
+  /* The toplevel or the output is already gone */
+  if (!view || !overview)
+    return;
+
+  phoc_overview_place_view (overview, view, &box);
+}
+
+
+static void
+phoc_phosh_private_overview_handle_remove_view (struct wl_client   *client,
+                                                struct wl_resource *resource,
+                                                struct wl_resource *toplevel)
+{
+  PhocOverview *overview = wl_resource_get_user_data (resource);
+  PhocView *view = view_from_toplevel (toplevel);
+
+  if (!view || !overview)
+    return;
+
+  phoc_overview_remove_view (overview, view);
+}
+
+
+static void
+phoc_phosh_private_overview_handle_destroy (struct wl_client   *client,
+                                            struct wl_resource *resource)
+{
+  wl_resource_destroy (resource);
+}
+
+
+static const struct phosh_private_overview_interface phoc_phosh_private_overview_impl = {
+  .place_view = phoc_phosh_private_overview_handle_place_view,
+  .remove_view = phoc_phosh_private_overview_handle_remove_view,
+  .destroy = phoc_phosh_private_overview_handle_destroy,
+};
+
+
+static void
+phoc_phosh_private_overview_handle_resource_destroy (struct wl_resource *resource)
+{
+  PhocOverview *overview = wl_resource_get_user_data (resource);
+  PhocOutput *output;
+
+  if (!overview)
+    return;
+
+  g_debug ("Destroying phosh_private_overview %p (res %p)", overview, resource);
+  output = phoc_overview_get_output (overview);
+  if (output && phoc_output_get_overview (output) == overview)
+    phoc_output_set_overview (output, NULL);
+
+  g_object_unref (overview);
+}
+
+
+static void
+handle_get_overview (struct wl_client   *client,
+                     struct wl_resource *phosh_private_resource,
+                     uint32_t            id,
+                     struct wl_resource *output_resource)
+{
+  int version = wl_resource_get_version (phosh_private_resource);
+  struct wlr_output *wlr_output = wlr_output_from_resource (output_resource);
+  PhocOutput *output = wlr_output ? wlr_output->data : NULL;
+  g_autoptr (PhocOverview) overview = NULL;
+  struct wl_resource *resource;
+
+  resource = wl_resource_create (client, &phosh_private_overview_interface, version, id);
+  if (resource == NULL) {
+    wl_client_post_no_memory (client);
+    return;
+  }
+
+  if (output && phoc_output_get_overview (output)) {
+    wl_resource_post_error (resource, PHOSH_PRIVATE_OVERVIEW_ERROR_ALREADY_EXISTS,
+                            "Output %s already has an overview", phoc_output_get_name (output));
+    return;
+  }
+
+  /* An inert overview if the output is gone */
+  if (output) {
+    overview = phoc_overview_new (output);
+    phoc_output_set_overview (output, overview);
+  }
+
+  g_debug ("New phosh_private_overview %p (res %p)", overview, resource);
+  wl_resource_set_implementation (resource, &phoc_phosh_private_overview_impl,
+                                  g_steal_pointer (&overview),
+                                  phoc_phosh_private_overview_handle_resource_destroy);
+}
+
+
 static void
 handle_set_shell_state (struct wl_client               *client,
                         struct wl_resource             *phosh_private_resource,
@@ -678,9 +1365,11 @@ phosh_handle_resource_destroy (struct wl_resource *resource)
 
   g_debug ("Destroying phosh %p (res %p)", phosh, resource);
   phosh->resource = NULL;
+  phoc_desktop_invalidate_client_priorities (phoc_server_get_desktop (phoc_server_get_default ()));
 
   g_list_free (phosh->keyboard_events);
   phosh->keyboard_events = NULL;
+  g_hash_table_remove_all (phosh->accelerators);
 
   phosh->state = PHOC_PHOSH_PRIVATE_SHELL_STATE_UNKNOWN;
   g_object_notify_by_pspec (G_OBJECT (phosh), props[PROP_SHELL_STATE]);
@@ -694,6 +1383,8 @@ static const struct phosh_private_interface phosh_private_impl = {
   handle_get_keyboard_event,   /* interface */
   handle_get_startup_tracker,  /* interface */
   handle_set_shell_state,      /* request */
+  handle_get_commit_stats,     /* interface */
+  handle_get_overview,         /* interface */
 };
 
 
@@ -717,6 +1408,7 @@ phosh_private_bind (struct wl_client *client, void *data, uint32_t version, uint
                                     &phosh_private_impl,
                                     phosh, phosh_handle_resource_destroy);
     phosh->resource = resource;
+    phoc_desktop_invalidate_client_priorities (phoc_server_get_desktop (phoc_server_get_default ()));
     g_debug ("Bound client %d with version %d", id, version);
     phosh->version = version;
     return;
@@ -783,6 +1475,7 @@ phoc_phosh_private_finalize (GObject *object)
   PhocPhoshPrivate *self = PHOC_PHOSH_PRIVATE (object);
 
   wl_global_destroy (self->global);
+  g_hash_table_destroy (self->accelerators);
 
   G_OBJECT_CLASS (phoc_phosh_private_parent_class)->finalize (object);
 }
@@ -818,6 +1511,7 @@ static void
 phoc_phosh_private_init (PhocPhoshPrivate *self)
 {
   self->last_action_id = 1;
+  self->accelerators = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
 }
 
 
@@ -835,34 +1529,34 @@ phoc_phosh_private_forward_keysym (PhocKeyCombo *combo,
 {
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
   PhocPhoshPrivate *phosh = phoc_desktop_get_phosh_private (desktop);
-  GList *l;
-  bool forwarded = false;
-
-  for (l = phosh->keyboard_events; l != NULL; l = l->next) {
-    PhocPhoshPrivateKeyboardEventData *kbevent = l->data;
-    uint32_t version = wl_resource_get_version (kbevent->resource);
-
-    g_debug("addr of kbevent and res kbev %p res %p", kbevent, kbevent->resource);
-    /*  forward the keysym if it is has been subscribed to */
-    if (phoc_phosh_private_keyboard_event_accelerator_is_registered (combo, kbevent)) {
-      gint64 key = ((gint64)combo->modifiers << 32) | combo->keysym;
-      guint action_id = GPOINTER_TO_UINT (g_hash_table_lookup (kbevent->subscribed_accelerators, &key));
-
-      if (pressed) {
-        phosh_private_keyboard_event_send_accelerator_activated_event (kbevent->resource,
-                                                                       action_id,
-                                                                       timestamp);
-        forwarded = true;
-      } else if (version >= PHOSH_PRIVATE_KEYBOARD_EVENT_ACCELERATOR_RELEASED_EVENT_SINCE_VERSION) {
-        phosh_private_keyboard_event_send_accelerator_released_event (kbevent->resource,
-                                                                      action_id,
-                                                                      timestamp);
-        forwarded = true;
-      }
-    }
+  PhocPhoshPrivateKeyboardEventData *kbevent;
+  gint64 key = phoc_key_combo_to_key (combo);
+  uint32_t version;
+  guint action_id;
+
+  /* An accelerator can only be subscribed by a single client */
+  kbevent = g_hash_table_lookup (phosh->accelerators, &key);
+  if (kbevent == NULL)
+    return false;
+
+  g_debug("addr of kbevent and res kbev %p res %p", kbevent, kbevent->resource);
+  version = wl_resource_get_version (kbevent->resource);
+  action_id = GPOINTER_TO_UINT (g_hash_table_lookup (kbevent->subscribed_accelerators, &key));
+
+  /*  forward the keysym as it has been subscribed to */
+  if (pressed) {
+    phosh_private_keyboard_event_send_accelerator_activated_event (kbevent->resource,
+                                                                   action_id,
+                                                                   timestamp);
+    return true;
+  } else if (version >= PHOSH_PRIVATE_KEYBOARD_EVENT_ACCELERATOR_RELEASED_EVENT_SINCE_VERSION) {
+    phosh_private_keyboard_event_send_accelerator_released_event (kbevent->resource,
+                                                                  action_id,
+                                                                  timestamp);
+    return true;
   }
 
-  return forwarded;
+  return false;
 }
 
 void
@@ -924,3 +1618,58 @@ phoc_phosh_private_get_global (PhocPhoshPrivate *self)
 
   return self->global;
 }
+
+/**
+ * phoc_phosh_private_get_client:
+ * @self: The phosh private protocol
+ *
+ * Returns:(nullable): The client bound to the protocol, usually the shell
+ */
+struct wl_client *
+phoc_phosh_private_get_client (PhocPhoshPrivate *self)
+{
+  g_assert (PHOC_IS_PHOSH_PRIVATE (self));
+
+  return self->resource ? wl_resource_get_client (self->resource) : NULL;
+}
+
+/**
+ * phoc_phosh_private_get_thumbnail_size:
+ * @view: The view
+ *
+ * Get the size of the thumbnail cached for @view.
+ *
+ * Returns: The size in bytes, `0` if there's no cached thumbnail
+ */
+gsize
+phoc_phosh_private_get_thumbnail_size (PhocView *view)
+{
+  PhocPhoshPrivateThumbnail *thumbnail;
+
+  g_assert (PHOC_IS_VIEW (view));
+
+  thumbnail = g_object_get_data (G_OBJECT (view), PHOC_THUMBNAIL_KEY);
+  if (thumbnail == NULL)
+    return 0;
+
+  return (gsize)thumbnail->stride * thumbnail->height;
+}
+
+/**
+ * phoc_phosh_private_release_thumbnail:
+ * @view: The view
+ *
+ * Drops the thumbnail cached for @view. The next thumbnail request
+ * renders the view again.
+ *
+ * Returns: The number of bytes released
+ */
+gsize
+phoc_phosh_private_release_thumbnail (PhocView *view)
+{
+  gsize size = phoc_phosh_private_get_thumbnail_size (view);
+
+  g_object_set_data (G_OBJECT (view), PHOC_THUMBNAIL_KEY, NULL);
+
+  return size;
+}
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "keybindings.h"
+#include "view.h"
 
 #include <phosh-private-protocol.h>
 #include "glib-object.h"
@@ -33,5 +34,8 @@ void              phoc_phosh_private_notify_launch (PhocPhoshPrivate
                                                     enum phosh_private_startup_tracker_protocol proto);
 PhocPhoshPrivateShellState phoc_phosh_private_get_shell_state (PhocPhoshPrivate *self);
 struct wl_global *phoc_phosh_private_get_global     (PhocPhoshPrivate *self);
+struct wl_client *phoc_phosh_private_get_client     (PhocPhoshPrivate *self);
+gsize             phoc_phosh_private_get_thumbnail_size (PhocView *view);
+gsize             phoc_phosh_private_release_thumbnail  (PhocView *view);
 
 G_END_DECLS
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-raster-pool"
+
+#include "phoc-config.h"
+
+#include "raster-pool.h"
+#include "thread-priority.h"
+
+#include <drm_fourcc.h>
+
+/* Overlays are drawn rarely, keep most cores for clients */
+#define RASTER_POOL_MAX_THREADS 2
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (cairo_t, cairo_destroy)
+
+/**
+ * PhocRasterPool:
+ *
+ * A small thread pool to draw overlay textures with cairo, e.g. the
+ * cutouts overlay's corner masks. Drawing happens on a worker thread
+ * while uploading the result to the renderer happens on the main
+ * thread in [method@RasterPool.draw_finish] so output hotplug or a
+ * scale change doesn't stall the compositor.
+ */
+struct _PhocRasterPool {
+  GObject              parent;
+
+  struct wlr_renderer *wlr_renderer;
+  GThreadPool         *pool;
+};
+
+G_DEFINE_TYPE (PhocRasterPool, phoc_raster_pool, G_TYPE_OBJECT)
+
+typedef struct {
+  int                 width;
+  int                 height;
+  PhocRasterDrawFunc  draw_func;
+  gpointer            draw_data;
+  GDestroyNotify      draw_data_destroy;
+} PhocRasterJob;
+
+
+static void
+phoc_raster_job_free (PhocRasterJob *job)
+{
+  if (job->draw_data_destroy)
+    job->draw_data_destroy (job->draw_data);
+
+  g_free (job);
+}
+
+
+static void
+raster_pool_run (gpointer data, gpointer user_data)
+{
+  g_autoptr (GTask) task = G_TASK (data);
+  PhocRasterJob *job = g_task_get_task_data (task);
+  cairo_surface_t *surface;
+  g_autoptr (cairo_t) cr = NULL;
+
+  phoc_thread_priority_reset_current_thread ();
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, job->width, job->height);
+  cr = cairo_create (surface);
+  job->draw_func (cr, job->width, job->height, job->draw_data);
+  cairo_surface_flush (surface);
+
+  if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to draw: %s",
+                             cairo_status_to_string (cairo_surface_status (surface)));
+    cairo_surface_destroy (surface);
+    return;
+  }
+
+  g_task_return_pointer (task, surface, (GDestroyNotify)cairo_surface_destroy);
+}
+
+
+static void
+phoc_raster_pool_finalize (GObject *object)
+{
+  PhocRasterPool *self = PHOC_RASTER_POOL (object);
+
+  /* Queued tasks hold a ref so there's nothing left to wait for */
+  g_thread_pool_free (self->pool, TRUE, TRUE);
+
+  G_OBJECT_CLASS (phoc_raster_pool_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_raster_pool_class_init (PhocRasterPoolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_raster_pool_finalize;
+}
+
+
+static void
+phoc_raster_pool_init (PhocRasterPool *self)
+{
+  self->pool = g_thread_pool_new (raster_pool_run, self, RASTER_POOL_MAX_THREADS, FALSE, NULL);
+}
+
+
+PhocRasterPool *
+phoc_raster_pool_new (struct wlr_renderer *wlr_renderer)
+{
+  PhocRasterPool *self = g_object_new (PHOC_TYPE_RASTER_POOL, NULL);
+
+  self->wlr_renderer = wlr_renderer;
+
+  return self;
+}
+
+/**
+ * phoc_raster_pool_draw_async:
+ * @self: The raster pool
+ * @width: The texture's width
+ * @height: The texture's height
+ * @draw_func: The function drawing the texture's content
+ * @draw_data: The data passed to @draw_func
+ * @draw_data_destroy: (nullable): Frees @draw_data once done
+ * @cancellable: (nullable): A cancellable
+ * @callback: The callback to invoke when done
+ * @user_data: The user data for @callback
+ *
+ * Draws a @width x @height ARGB8888 texture on a worker thread.
+ */
+void
+phoc_raster_pool_draw_async (PhocRasterPool       *self,
+                             int                   width,
+                             int                   height,
+                             PhocRasterDrawFunc    draw_func,
+                             gpointer              draw_data,
+                             GDestroyNotify        draw_data_destroy,
+                             GCancellable         *cancellable,
+                             GAsyncReadyCallback   callback,
+                             gpointer              user_data)
+{
+  g_autoptr (GError) err = NULL;
+  PhocRasterJob *job;
+  GTask *task;
+
+  g_assert (PHOC_IS_RASTER_POOL (self));
+  g_assert (width > 0 && height > 0);
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, phoc_raster_pool_draw_async);
+
+  job = g_new0 (PhocRasterJob, 1);
+  job->width = width;
+  job->height = height;
+  job->draw_func = draw_func;
+  job->draw_data = draw_data;
+  job->draw_data_destroy = draw_data_destroy;
+  g_task_set_task_data (task, job, (GDestroyNotify)phoc_raster_job_free);
+
+  /* The pool takes the task's ref */
+  if (!g_thread_pool_push (self->pool, task, &err)) {
+    g_task_return_error (task, g_steal_pointer (&err));
+    g_object_unref (task);
+  }
+}
+
+/**
+ * phoc_raster_pool_draw_finish:
+ * @self: The raster pool
+ * @res: The result
+ * @error: The return location for errors
+ *
+ * Uploads the drawn content. Must be called from the main thread.
+ *
+ * Returns: (transfer full)(nullable): The texture or %NULL on error
+ */
+struct wlr_texture *
+phoc_raster_pool_draw_finish (PhocRasterPool  *self,
+                              GAsyncResult    *res,
+                              GError         **error)
+{
+  cairo_surface_t *surface;
+  struct wlr_texture *texture;
+
+  g_assert (PHOC_IS_RASTER_POOL (self));
+  g_assert (g_task_is_valid (res, self));
+
+  surface = g_task_propagate_pointer (G_TASK (res), error);
+  if (surface == NULL)
+    return NULL;
+
+  texture = wlr_texture_from_pixels (self->wlr_renderer,
+                                     DRM_FORMAT_ARGB8888,
+                                     cairo_image_surface_get_stride (surface),
+                                     cairo_image_surface_get_width (surface),
+                                     cairo_image_surface_get_height (surface),
+                                     cairo_image_surface_get_data (surface));
+  cairo_surface_destroy (surface);
+
+  if (texture == NULL)
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to upload texture");
+
+  return texture;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <cairo/cairo.h>
+
+#include <wlr/render/wlr_renderer.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PhocRasterDrawFunc:
+ * @cr: The cairo context to draw with
+ * @width: The width of the surface
+ * @height: The height of the surface
+ * @data: The user data
+ *
+ * Draws an overlay texture's content. Invoked on a worker thread so
+ * it must not touch compositor state.
+ */
+typedef void (*PhocRasterDrawFunc) (cairo_t *cr, int width, int height, gpointer data);
+
+#define PHOC_TYPE_RASTER_POOL (phoc_raster_pool_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocRasterPool, phoc_raster_pool, PHOC, RASTER_POOL, GObject)
+
+PhocRasterPool     *phoc_raster_pool_new         (struct wlr_renderer  *wlr_renderer);
+void                phoc_raster_pool_draw_async  (PhocRasterPool       *self,
+                                                  int                   width,
+                                                  int                   height,
+                                                  PhocRasterDrawFunc    draw_func,
+                                                  gpointer              draw_data,
+                                                  GDestroyNotify        draw_data_destroy,
+                                                  GCancellable         *cancellable,
+                                                  GAsyncReadyCallback   callback,
+                                                  gpointer              user_data);
+struct wlr_texture *phoc_raster_pool_draw_finish (PhocRasterPool       *self,
+                                                  GAsyncResult         *res,
+                                                  GError              **error);
+
+G_END_DECLS
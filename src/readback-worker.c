@@ -0,0 +1,525 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-readback-worker"
+
+#include "phoc-config.h"
+
+#include "readback-worker.h"
+#include "thread-priority.h"
+
+#include <drm_fourcc.h>
+#include <string.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+/* Don't let a GPU hang stall the readback queue forever */
+#define FENCE_TIMEOUT_NS (500 * 1000 * 1000ull)
+
+/**
+ * PhocReadbackWorker:
+ *
+ * Reads back offscreen rendered buffers (e.g. thumbnails for
+ * phosh-private's screencopy) on a separate thread so the compositor
+ * thread never waits on the GPU or on `glReadPixels`.
+ *
+ * The worker has its own EGL context shared with the renderer's. The
+ * buffers are imported as dmabufs, waited on via the fence submitted
+ * with the rendering commands and read back in the format of the
+ * buffer the result ends up in, converting from RGBA on the worker
+ * when ARGB8888 is wanted but the driver can't read BGRA directly.
+ * The result is handed back to the main loop via [class@Gio.Task].
+ */
+struct _PhocReadbackWorker {
+  GObject                                       parent;
+
+  EGLDisplay                                    display;
+  EGLContext                                    context;
+  gboolean                                      read_bgra;
+  gboolean                                      has_modifiers;
+
+  PFNEGLCREATEIMAGEKHRPROC                      eglCreateImageKHR;
+  PFNEGLDESTROYIMAGEKHRPROC                     eglDestroyImageKHR;
+  PFNEGLCLIENTWAITSYNCKHRPROC                   eglClientWaitSyncKHR;
+  PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC glEGLImageTargetRenderbufferStorageOES;
+
+  GThread                                      *thread;
+  GAsyncQueue                                  *jobs; /* GTask */
+  gboolean                                      shut_down;
+};
+
+G_DEFINE_TYPE (PhocReadbackWorker, phoc_readback_worker, G_TYPE_OBJECT)
+
+typedef struct {
+  struct wlr_dmabuf_attributes dmabuf;
+  uint32_t                     format;
+  EGLSyncKHR                   fence;
+} PhocReadbackJob;
+
+/* Pushed to the queue to make the thread quit */
+static int quit_job;
+
+
+static gboolean
+has_extension (const char *exts, const char *extension)
+{
+  return exts && strstr (exts, extension);
+}
+
+
+static EGLImageKHR
+import_dmabuf (PhocReadbackWorker *self, const struct wlr_dmabuf_attributes *dmabuf)
+{
+  static const EGLint plane_attribs[WLR_DMABUF_MAX_PLANES][5] = {
+    {
+      EGL_DMA_BUF_PLANE0_FD_EXT,
+      EGL_DMA_BUF_PLANE0_OFFSET_EXT,
+      EGL_DMA_BUF_PLANE0_PITCH_EXT,
+      EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT,
+      EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT,
+    }, {
+      EGL_DMA_BUF_PLANE1_FD_EXT,
+      EGL_DMA_BUF_PLANE1_OFFSET_EXT,
+      EGL_DMA_BUF_PLANE1_PITCH_EXT,
+      EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT,
+      EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT,
+    }, {
+      EGL_DMA_BUF_PLANE2_FD_EXT,
+      EGL_DMA_BUF_PLANE2_OFFSET_EXT,
+      EGL_DMA_BUF_PLANE2_PITCH_EXT,
+      EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT,
+      EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT,
+    }, {
+      EGL_DMA_BUF_PLANE3_FD_EXT,
+      EGL_DMA_BUF_PLANE3_OFFSET_EXT,
+      EGL_DMA_BUF_PLANE3_PITCH_EXT,
+      EGL_DMA_BUF_PLANE3_MODIFIER_LO_EXT,
+      EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT,
+    },
+  };
+  gboolean with_modifier = dmabuf->modifier != DRM_FORMAT_MOD_INVALID;
+  EGLint attribs[7 + WLR_DMABUF_MAX_PLANES * 10 + 3];
+  guint i = 0;
+
+  if (with_modifier && !self->has_modifiers) {
+    if (dmabuf->modifier != DRM_FORMAT_MOD_LINEAR)
+      return EGL_NO_IMAGE_KHR;
+    with_modifier = FALSE;
+  }
+
+  attribs[i++] = EGL_WIDTH;
+  attribs[i++] = dmabuf->width;
+  attribs[i++] = EGL_HEIGHT;
+  attribs[i++] = dmabuf->height;
+  attribs[i++] = EGL_LINUX_DRM_FOURCC_EXT;
+  attribs[i++] = dmabuf->format;
+
+  for (int p = 0; p < dmabuf->n_planes; p++) {
+    attribs[i++] = plane_attribs[p][0];
+    attribs[i++] = dmabuf->fd[p];
+    attribs[i++] = plane_attribs[p][1];
+    attribs[i++] = dmabuf->offset[p];
+    attribs[i++] = plane_attribs[p][2];
+    attribs[i++] = dmabuf->stride[p];
+    if (with_modifier) {
+      attribs[i++] = plane_attribs[p][3];
+      attribs[i++] = dmabuf->modifier & 0xFFFFFFFF;
+      attribs[i++] = plane_attribs[p][4];
+      attribs[i++] = dmabuf->modifier >> 32;
+    }
+  }
+
+  attribs[i++] = EGL_IMAGE_PRESERVED_KHR;
+  attribs[i++] = EGL_TRUE;
+  attribs[i++] = EGL_NONE;
+  g_assert (i <= G_N_ELEMENTS (attribs));
+
+  return self->eglCreateImageKHR (self->display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT,
+                                  NULL, attribs);
+}
+
+
+static void
+rgba_to_bgra (guint8 *data, gsize size)
+{
+  for (gsize i = 0; i + 3 < size; i += 4) {
+    guint8 r = data[i];
+
+    data[i] = data[i + 2];
+    data[i + 2] = r;
+  }
+}
+
+/*
+ * Read the dmabuf back in the given DRM format with a stride of width * 4
+ */
+static GBytes *
+read_pixels (PhocReadbackWorker                 *self,
+             const struct wlr_dmabuf_attributes *dmabuf,
+             uint32_t                            format,
+             GError                            **error)
+{
+  gsize size = (gsize)dmabuf->width * 4 * dmabuf->height;
+  g_autofree guint8 *data = NULL;
+  EGLImageKHR image;
+  GLuint rbo, fbo;
+
+  image = import_dmabuf (self, dmabuf);
+  if (image == EGL_NO_IMAGE_KHR) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to import buffer");
+    return NULL;
+  }
+
+  /* Drop stale errors so we only check our own calls below */
+  while (glGetError () != GL_NO_ERROR);
+
+  glGenRenderbuffers (1, &rbo);
+  glBindRenderbuffer (GL_RENDERBUFFER, rbo);
+  self->glEGLImageTargetRenderbufferStorageOES (GL_RENDERBUFFER, image);
+
+  glGenFramebuffers (1, &fbo);
+  glBindFramebuffer (GL_FRAMEBUFFER, fbo);
+  glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo);
+
+  if (glCheckFramebufferStatus (GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
+    data = g_malloc (size);
+    glPixelStorei (GL_PACK_ALIGNMENT, 4);
+    switch (format) {
+    case DRM_FORMAT_XRGB8888:
+    case DRM_FORMAT_ARGB8888:
+      if (self->read_bgra) {
+        glReadPixels (0, 0, dmabuf->width, dmabuf->height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, data);
+      } else {
+        glReadPixels (0, 0, dmabuf->width, dmabuf->height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        rgba_to_bgra (data, size);
+      }
+      break;
+    default:
+      glReadPixels (0, 0, dmabuf->width, dmabuf->height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+      break;
+    }
+
+    if (glGetError () != GL_NO_ERROR)
+      g_clear_pointer (&data, g_free);
+  }
+
+  glBindFramebuffer (GL_FRAMEBUFFER, 0);
+  glDeleteFramebuffers (1, &fbo);
+  glBindRenderbuffer (GL_RENDERBUFFER, 0);
+  glDeleteRenderbuffers (1, &rbo);
+  self->eglDestroyImageKHR (self->display, image);
+
+  if (data == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to read back buffer");
+    return NULL;
+  }
+
+  return g_bytes_new_take (g_steal_pointer (&data), size);
+}
+
+
+static void
+run_job (PhocReadbackWorker *self, GTask *task)
+{
+  PhocReadbackJob *job = g_task_get_task_data (task);
+  GError *err = NULL;
+  GBytes *pixels;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  /* On timeout read anyway like the main thread would */
+  if (job->fence != EGL_NO_SYNC_KHR &&
+      self->eglClientWaitSyncKHR (self->display, job->fence, 0, FENCE_TIMEOUT_NS) == EGL_FALSE) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to wait for fence");
+    return;
+  }
+
+  pixels = read_pixels (self, &job->dmabuf, job->format, &err);
+  if (pixels)
+    g_task_return_pointer (task, pixels, (GDestroyNotify)g_bytes_unref);
+  else
+    g_task_return_error (task, err);
+}
+
+
+static gpointer
+readback_thread (gpointer data)
+{
+  PhocReadbackWorker *self = data;
+  /* The worker may get finalized from a task we drop, don't use it after the loop */
+  g_autoptr (GAsyncQueue) jobs = g_async_queue_ref (self->jobs);
+  EGLDisplay display = self->display;
+  gboolean current;
+  GTask *task;
+
+  phoc_thread_priority_reset_current_thread ();
+
+  eglBindAPI (EGL_OPENGL_ES_API);
+  current = eglMakeCurrent (self->display, EGL_NO_SURFACE, EGL_NO_SURFACE, self->context);
+  if (!current)
+    g_warning ("Failed to make readback context current: 0x%x", eglGetError ());
+
+  while ((task = g_async_queue_pop (jobs)) != (gpointer)&quit_job) {
+    if (current)
+      run_job (self, task);
+    else
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED, "No readback context");
+    g_object_unref (task);
+  }
+
+  eglMakeCurrent (display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglReleaseThread ();
+
+  return NULL;
+}
+
+/*
+ * Check the GL side with the new context made current temporarily
+ * as it needn't match what the renderer's context supports.
+ */
+static gboolean
+check_gl (PhocReadbackWorker *self)
+{
+  EGLContext prev_context = eglGetCurrentContext ();
+  EGLSurface prev_draw = eglGetCurrentSurface (EGL_DRAW);
+  EGLSurface prev_read = eglGetCurrentSurface (EGL_READ);
+  const char *exts;
+  gboolean ok;
+
+  if (!eglMakeCurrent (self->display, EGL_NO_SURFACE, EGL_NO_SURFACE, self->context))
+    return FALSE;
+
+  exts = (const char *)glGetString (GL_EXTENSIONS);
+  ok = has_extension (exts, "GL_OES_EGL_image");
+  self->read_bgra = has_extension (exts, "GL_EXT_read_format_bgra");
+
+  eglMakeCurrent (self->display, prev_draw, prev_read, prev_context);
+
+  return ok;
+}
+
+
+static gboolean
+phoc_readback_worker_setup (PhocReadbackWorker *self, struct wlr_egl *egl)
+{
+  EGLint attribs[] = {
+    EGL_CONTEXT_CLIENT_VERSION, 2,
+    EGL_NONE, EGL_NONE,
+    EGL_NONE,
+  };
+  const char *exts;
+
+  self->display = wlr_egl_get_display (egl);
+  exts = eglQueryString (self->display, EGL_EXTENSIONS);
+
+  if (!has_extension (exts, "EGL_KHR_surfaceless_context") ||
+      !has_extension (exts, "EGL_KHR_no_config_context") ||
+      !has_extension (exts, "EGL_EXT_image_dma_buf_import") ||
+      !has_extension (exts, "EGL_KHR_fence_sync")) {
+    g_debug ("Missing EGL extensions for threaded readback");
+    return FALSE;
+  }
+  self->has_modifiers = has_extension (exts, "EGL_EXT_image_dma_buf_import_modifiers");
+
+  self->eglCreateImageKHR = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress ("eglCreateImageKHR");
+  self->eglDestroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress ("eglDestroyImageKHR");
+  self->eglClientWaitSyncKHR =
+    (PFNEGLCLIENTWAITSYNCKHRPROC)eglGetProcAddress ("eglClientWaitSyncKHR");
+  self->glEGLImageTargetRenderbufferStorageOES =
+    (PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC)eglGetProcAddress ("glEGLImageTargetRenderbufferStorageOES");
+  if (!self->eglCreateImageKHR || !self->eglDestroyImageKHR || !self->eglClientWaitSyncKHR ||
+      !self->glEGLImageTargetRenderbufferStorageOES) {
+    g_debug ("Missing EGL functions for threaded readback");
+    return FALSE;
+  }
+
+  /* Readback shouldn't preempt compositing on the GPU either */
+  if (has_extension (exts, "EGL_IMG_context_priority")) {
+    attribs[2] = EGL_CONTEXT_PRIORITY_LEVEL_IMG;
+    attribs[3] = EGL_CONTEXT_PRIORITY_LOW_IMG;
+  }
+
+  self->context = eglCreateContext (self->display, EGL_NO_CONFIG_KHR,
+                                    wlr_egl_get_context (egl), attribs);
+  if (self->context == EGL_NO_CONTEXT) {
+    g_warning ("Failed to create readback context: 0x%x", eglGetError ());
+    return FALSE;
+  }
+
+  if (!check_gl (self)) {
+    g_debug ("Missing GL extensions for threaded readback");
+    return FALSE;
+  }
+
+  self->thread = g_thread_new ("phoc-readback", readback_thread, self);
+  return TRUE;
+}
+
+
+static void
+phoc_readback_worker_finalize (GObject *object)
+{
+  PhocReadbackWorker *self = PHOC_READBACK_WORKER (object);
+
+  phoc_readback_worker_shutdown (self);
+  g_async_queue_unref (self->jobs);
+
+  G_OBJECT_CLASS (phoc_readback_worker_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_readback_worker_class_init (PhocReadbackWorkerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_readback_worker_finalize;
+}
+
+
+static void
+phoc_readback_worker_init (PhocReadbackWorker *self)
+{
+  self->context = EGL_NO_CONTEXT;
+  self->jobs = g_async_queue_new ();
+}
+
+/**
+ * phoc_readback_worker_new:
+ * @egl: The renderer's EGL
+ *
+ * Returns: (transfer full)(nullable): A new readback worker or %NULL
+ *   if the EGL implementation doesn't support reading back on a
+ *   separate thread
+ */
+PhocReadbackWorker *
+phoc_readback_worker_new (struct wlr_egl *egl)
+{
+  g_autoptr (PhocReadbackWorker) self = g_object_new (PHOC_TYPE_READBACK_WORKER, NULL);
+
+  if (!phoc_readback_worker_setup (self, egl))
+    return NULL;
+
+  return g_steal_pointer (&self);
+}
+
+/**
+ * phoc_readback_worker_read_async:
+ * @self: The readback worker
+ * @buffer: The dmabuf to read back
+ * @format: The DRM format to return the pixels in
+ * @fence: The fence to wait on before reading or `EGL_NO_SYNC_KHR`
+ * @cancellable: (nullable): A cancellable
+ * @callback: The callback to invoke when done
+ * @user_data: The user data for @callback
+ *
+ * Reads back @buffer on the worker thread once @fence signaled. Pixels
+ * are read as RGBA unless @format is ARGB8888 or XRGB8888. The
+ * caller must keep @buffer locked and @fence alive until @callback
+ * was invoked.
+ */
+void
+phoc_readback_worker_read_async (PhocReadbackWorker  *self,
+                                 struct wlr_buffer   *buffer,
+                                 uint32_t             format,
+                                 EGLSyncKHR           fence,
+                                 GCancellable        *cancellable,
+                                 GAsyncReadyCallback  callback,
+                                 gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+  PhocReadbackJob *job;
+
+  g_assert (PHOC_IS_READBACK_WORKER (self));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, phoc_readback_worker_read_async);
+
+  if (self->shut_down) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                             "Readback worker shut down");
+    return;
+  }
+
+  job = g_new0 (PhocReadbackJob, 1);
+  job->format = format;
+  job->fence = fence;
+  g_task_set_task_data (task, job, g_free);
+
+  if (!wlr_buffer_get_dmabuf (buffer, &job->dmabuf)) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Buffer isn't a dmabuf");
+    return;
+  }
+
+  g_async_queue_push (self->jobs, g_steal_pointer (&task));
+}
+
+/**
+ * phoc_readback_worker_read_finish:
+ * @self: The readback worker
+ * @res: The result
+ * @error: The return location for errors
+ *
+ * Returns: (transfer full): The pixels in the format passed to
+ *   [method@ReadbackWorker.read_async] with a stride of four bytes
+ *   per pixel or %NULL on error
+ */
+GBytes *
+phoc_readback_worker_read_finish (PhocReadbackWorker  *self,
+                                  GAsyncResult        *res,
+                                  GError             **error)
+{
+  g_assert (PHOC_IS_READBACK_WORKER (self));
+  g_assert (g_task_is_valid (res, self));
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
+/**
+ * phoc_readback_worker_shutdown:
+ * @self: The readback worker
+ *
+ * Fails all queued readbacks, waits for the one in progress and stops
+ * the thread. Must be called before the EGL display the worker was
+ * created for goes away as pending tasks may keep the worker alive.
+ * Later readbacks fail right away. Calling it more than once is fine.
+ */
+void
+phoc_readback_worker_shutdown (PhocReadbackWorker *self)
+{
+  GTask *task;
+
+  g_assert (PHOC_IS_READBACK_WORKER (self));
+
+  if (self->shut_down)
+    return;
+  self->shut_down = TRUE;
+
+  while ((task = g_async_queue_try_pop (self->jobs))) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CLOSED, "Readback worker shut down");
+    g_object_unref (task);
+  }
+
+  if (self->thread) {
+    g_async_queue_push (self->jobs, &quit_job);
+    /* Dropping a task on the worker can finalize us, the thread quits on its own then */
+    if (g_thread_self () == self->thread)
+      g_thread_unref (self->thread);
+    else
+      g_thread_join (self->thread);
+    self->thread = NULL;
+  }
+
+  /* Only released once not current on the worker anymore */
+  if (self->context != EGL_NO_CONTEXT) {
+    eglDestroyContext (self->display, self->context);
+    self->context = EGL_NO_CONTEXT;
+  }
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include <wlr/render/egl.h>
+#include <wlr/types/wlr_buffer.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_READBACK_WORKER (phoc_readback_worker_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocReadbackWorker, phoc_readback_worker, PHOC, READBACK_WORKER, GObject)
+
+PhocReadbackWorker *phoc_readback_worker_new         (struct wlr_egl      *egl);
+void                phoc_readback_worker_read_async  (PhocReadbackWorker  *self,
+                                                      struct wlr_buffer   *buffer,
+                                                      uint32_t             format,
+                                                      EGLSyncKHR           fence,
+                                                      GCancellable        *cancellable,
+                                                      GAsyncReadyCallback  callback,
+                                                      gpointer             user_data);
+GBytes             *phoc_readback_worker_read_finish (PhocReadbackWorker  *self,
+                                                      GAsyncResult        *res,
+                                                      GError             **error);
+void                phoc_readback_worker_shutdown    (PhocReadbackWorker  *self);
+
+G_END_DECLS
@@ -5,13 +5,91 @@
  */
 #pragma once
 
+#include "raster-pool.h"
 #include "render.h"
 
 #include <wlr/types/wlr_output.h>
 
 G_BEGIN_DECLS
 
+typedef struct _PhocBling PhocBling;
+
+typedef enum {
+  PHOC_RENDER_ITEM_TEXTURE,
+  PHOC_RENDER_ITEM_BLING,
+  PHOC_RENDER_ITEM_RECT,
+} PhocRenderItemType;
+
+/**
+ * PhocRenderItem:
+ * @type: What to draw
+ * @surface: (nullable): The surface the texture belongs to
+ * @texture: The texture to draw
+ * @src_box: The source box in buffer coordinates
+ * @dst_box: The destination box in transformed output buffer coordinates
+ * @transform: The transform to apply to the texture
+ * @alpha: The opacity
+ * @blend_mode: How to blend the texture, `WLR_RENDER_BLEND_MODE_NONE`
+ *   when it's known to be opaque within @clip
+ * @clip: The area to paint in transformed output buffer coordinates
+ * @bling: The bling to render for `PHOC_RENDER_ITEM_BLING`
+ * @color: The premultiplied color for `PHOC_RENDER_ITEM_RECT`
+ *
+ * A single draw operation of an output frame. The render list of a
+ * frame is built first and submitted to the render pass afterwards.
+ *
+ * A `PHOC_RENDER_ITEM_RECT` item fills @clip with @color and can
+ * batch the rectangles of several solid color blings.
+ */
+typedef struct _PhocRenderItem {
+  PhocRenderItemType        type;
+
+  struct wlr_surface       *surface;
+  struct wlr_texture       *texture;
+  struct wlr_fbox           src_box;
+  struct wlr_box            dst_box;
+  enum wl_output_transform  transform;
+  float                     alpha;
+  enum wlr_render_blend_mode blend_mode;
+  pixman_region32_t         clip;
+
+  PhocBling                *bling;
+  struct wlr_render_color   color;
+} PhocRenderItem;
+
+/**
+ * PhocRenderSummaryItem:
+ * @surface: The surface
+ * @texture: The surface's texture
+ * @seq: The surface's commit sequence number
+ * @src_box: The source box in buffer coordinates
+ * @dst_box: The destination box in output buffer coordinates
+ * @transform: The surface's transform
+ * @alpha: The opacity
+ * @filter_mode: The filter used for scaling
+ *
+ * What a surface contributes to an output's frame independent of the
+ * frame's damage. Used to detect frames that wouldn't change the
+ * output's content.
+ */
+typedef struct _PhocRenderSummaryItem {
+  struct wlr_surface         *surface;
+  struct wlr_texture         *texture;
+  guint32                     seq;
+  struct wlr_fbox             src_box;
+  struct wlr_box              dst_box;
+  enum wl_output_transform    transform;
+  float                       alpha;
+  enum wlr_scale_filter_mode  filter_mode;
+} PhocRenderSummaryItem;
+
 struct wlr_renderer  *phoc_renderer_get_wlr_renderer  (PhocRenderer *self);
 struct wlr_allocator *phoc_renderer_get_wlr_allocator (PhocRenderer *self);
+PhocRasterPool       *phoc_renderer_get_raster_pool   (PhocRenderer *self);
+gboolean              phoc_renderer_summarize_output  (PhocRenderer *self,
+                                                       PhocOutput   *output,
+                                                       GArray       *summary);
+gboolean              phoc_render_summary_equal       (GArray       *summary,
+                                                       GArray       *other);
 
 G_END_DECLS
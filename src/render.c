@@ -12,12 +12,30 @@
 #define G_LOG_DOMAIN "phoc-render"
 
 #include "phoc-config.h"
+
+/* Cast checks are function calls, the render loop of release builds skips them */
+#ifndef PHOC_HOT_PATH_CHECKS
+# define G_DISABLE_CAST_CHECKS
+#endif
+
+#include "phoc-tracing.h"
 #include "bling.h"
+#include "damage-heatmap.h"
+#include "layer-cache.h"
 #include "layer-shell.h"
+#include "layout-transaction.h"
+#include "output-planes.h"
+#include "overview.h"
+#include "raster-pool.h"
+#include "readback-worker.h"
 #include "seat.h"
+#include "input-latency.h"
 #include "server.h"
 #include "render.h"
 #include "render-private.h"
+#include "scaled-texture.h"
+#include "view-cache.h"
+#include "view-snapshot.h"
 #include "xwayland-surface.h"
 #include "utils.h"
 
@@ -27,6 +45,7 @@
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <wlr/backend.h>
 #include <wlr/config.h>
@@ -35,6 +54,10 @@
 #include <wlr/render/gles2.h>
 #include <wlr/render/android.h>
 #include <wlr/render/egl.h>
+#include <wlr/render/pixman.h>
+#if WLR_HAS_VULKAN_RENDERER
+# include <wlr/render/vulkan.h>
+#endif
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_buffer.h>
@@ -44,6 +67,8 @@
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
+#define PHOC_VIEW_CACHE_KEY "phoc-view-cache"
+
 #define TOUCH_POINT_SIZE 20
 #define TOUCH_POINT_BORDER 0.1
 
@@ -58,14 +83,11 @@
  * PhocRenderer:
  *
  * The renderer
+ *
+ * Other parts of the compositor can draw on top of an output's
+ * content via render hooks, see [method@Renderer.add_render_hook].
  */
 
-enum {
-  RENDER_END,
-  N_SIGNALS
-};
-static guint signals[N_SIGNALS] = { 0 };
-
 enum {
   PROP_0,
   PROP_WLR_BACKEND,
@@ -79,25 +101,75 @@ struct _PhocRenderer {
   struct wlr_backend   *wlr_backend;
   struct wlr_renderer  *wlr_renderer;
   struct wlr_allocator *wlr_allocator;
+  PhocRendererCaps      caps;
+
+  GArray               *occluded;
+  /* Each surface's own opaque area, only kept for software rendering */
+  GArray               *surface_opaque;
+  GArray               *render_list;
+
+  /* Unused offscreen render targets for view snapshots */
+  GPtrArray            *render_targets;
+  GMemoryMonitor       *memory_monitor;
+
+  /* wlr_surface → PhocScaledTexture for surfaces of scaled down views */
+  GHashTable           *scaled_textures;
+  /* Summary of the cacheable layers of the output being rendered */
+  GArray               *layer_summary;
+  /* Summary of the view being checked and the frame's valid view caches */
+  GArray               *view_summary;
+  GHashTable           *view_caches;
+
+  PhocReadbackWorker   *readback_worker;
+  PhocRasterPool       *raster_pool;
+
+  /* Snapshots of closing views drawn in the stack of views */
+  GPtrArray            *view_snapshots;
+
+  GArray               *render_hooks; /* PhocRenderHook, sorted by order */
+  guint                 last_render_hook_id;
+  gboolean              running_render_hooks;
+  guint                 n_removed_render_hooks;
 };
 
+typedef struct {
+  guint               id;
+  PhocOutput         *output; /* (nullable): Only for this output */
+  gint                order;
+  PhocRenderHookFunc  func; /* NULL if removed while running hooks */
+  gpointer            user_data;
+} PhocRenderHook;
+
 static void phoc_renderer_initable_iface_init (GInitableIface *iface);
+static void summarize_surface_iterator (PhocOutput         *output,
+                                        struct wlr_surface *surface,
+                                        struct wlr_box     *box,
+                                        float               scale,
+                                        void               *data);
 
 G_DEFINE_TYPE_WITH_CODE (PhocRenderer, phoc_renderer, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, phoc_renderer_initable_iface_init));
 
 
+/* The projection of a view's geometry into the target, same for all its surfaces */
 struct view_render_data {
-  PhocView *view;
-  int width;
-  int height;
+  float proj[9];
 };
 
-struct touch_point_data {
-  int id;
-  double x;
-  double y;
-};
+
+static void
+view_render_data_init (struct view_render_data *data, PhocView *view, int width, int height)
+{
+  struct wlr_box geo;
+  float scale;
+
+  phoc_view_get_geometry (view, &geo);
+  scale = fmin (width / (float)geo.width, height / (float)geo.height);
+
+  wlr_matrix_identity (data->proj);
+  wlr_matrix_scale (data->proj, scale, scale);
+  wlr_matrix_translate (data->proj, -geo.x, -geo.y);
+}
 
 
 static void
@@ -151,470 +223,2369 @@ phoc_renderer_get_property (GObject    *object,
 
 
 static void
-render_texture (PhocOutput               *output,
-                struct wlr_texture       *texture,
-                const struct wlr_fbox    *_src_box,
-                const struct wlr_box     *dst_box,
-                const struct wlr_box     *clip_box,
-                enum wl_output_transform  surface_transform,
-                float                     alpha,
-                PhocRenderContext        *ctx)
+render_item_clear (PhocRenderItem *item)
+{
+  pixman_region32_fini (&item->clip);
+}
+
+/**
+ * try_merge_rect:
+ *
+ * Merges a solid rectangle into the last item of the frame's render
+ * list if that one is a rectangle of the same color so both are drawn
+ * in one go. Translucent rectangles are only merged if they don't
+ * overlap as the overlap would otherwise be blended twice.
+ *
+ * Returns: %TRUE if the rectangle got merged
+ */
+static gboolean
+try_merge_rect (PhocRenderContext             *ctx,
+                const struct wlr_box          *box,
+                const struct wlr_render_color *color,
+                pixman_region32_t             *clip)
+{
+  PhocRenderItem *last;
+  struct wlr_box dst_box;
+
+  if (!ctx->render_list->len)
+    return FALSE;
+
+  last = &g_array_index (ctx->render_list, PhocRenderItem, ctx->render_list->len - 1);
+  if (last->type != PHOC_RENDER_ITEM_RECT)
+    return FALSE;
+
+  if (memcmp (&last->color, color, sizeof (*color)) != 0)
+    return FALSE;
+
+  if (color->a < 1.0) {
+    pixman_region32_t overlap;
+    gboolean overlaps;
+
+    pixman_region32_init (&overlap);
+    pixman_region32_intersect (&overlap, &last->clip, clip);
+    overlaps = pixman_region32_not_empty (&overlap);
+    pixman_region32_fini (&overlap);
+    if (overlaps)
+      return FALSE;
+  }
+
+  /* The clip limits what gets painted so the box only needs to cover both */
+  dst_box.x = MIN (last->dst_box.x, box->x);
+  dst_box.y = MIN (last->dst_box.y, box->y);
+  dst_box.width = MAX (last->dst_box.x + last->dst_box.width, box->x + box->width) - dst_box.x;
+  dst_box.height = MAX (last->dst_box.y + last->dst_box.height, box->y + box->height) - dst_box.y;
+  last->dst_box = dst_box;
+
+  pixman_region32_union (&last->clip, &last->clip, clip);
+
+  return TRUE;
+}
+
+
+/*
+ * Get the damaged part of @box in buffer coordinates and transform
+ * @box into buffer coordinates too. Unless the damage has to be culled
+ * this only transforms boxes and intersects them with the frame damage
+ * that got transformed once per frame. @damage must be released by the
+ * caller in any case.
+ */
+static gboolean
+get_item_damage (PhocOutput            *output,
+                 struct wlr_box        *box,
+                 const struct wlr_box  *clip_box,
+                 pixman_region32_t     *occluded,
+                 PhocRenderContext     *ctx,
+                 pixman_region32_t     *damage)
+{
+  struct wlr_box clip;
+  guint64 area;
+
+  if (ctx->buffer_damage && !(occluded && pixman_region32_not_empty (occluded))) {
+    phoc_output_transform_box (output, box);
+    if (clip_box) {
+      clip = *clip_box;
+      phoc_output_transform_box (output, &clip);
+    }
+    return phoc_utils_is_damaged (box, ctx->buffer_damage, clip_box ? &clip : NULL, damage);
+  }
+
+  if (!phoc_utils_is_damaged (box, ctx->damage, clip_box, damage))
+    return FALSE;
+
+  /* Don't paint what opaque surfaces above will paint over anyway */
+  if (occluded && pixman_region32_not_empty (occluded)) {
+    area = phoc_utils_region_area (damage);
+    pixman_region32_subtract (damage, damage, occluded);
+    ctx->culled_pixels += area - phoc_utils_region_area (damage);
+    if (!pixman_region32_not_empty (damage))
+      return FALSE;
+  }
+
+  phoc_output_transform_box (output, box);
+  phoc_output_transform_damage (output, damage);
+  return TRUE;
+}
+
+
+/**
+ * add_texture_item:
+ *
+ * Adds a draw item for the damaged and not occluded part of the
+ * texture to the frame's render list.
+ */
+static void
+add_texture_item (PhocOutput               *output,
+                  struct wlr_surface       *surface,
+                  struct wlr_texture       *texture,
+                  const struct wlr_fbox    *_src_box,
+                  const struct wlr_box     *dst_box,
+                  const struct wlr_box     *clip_box,
+                  pixman_region32_t        *occluded,
+                  enum wl_output_transform  surface_transform,
+                  float                     alpha,
+                  enum wlr_render_blend_mode blend_mode,
+                  PhocRenderContext        *ctx)
 {
   pixman_region32_t damage;
   struct wlr_box proj_box = *dst_box;
   struct wlr_fbox src_box = {0};
-  enum wl_output_transform transform;
+  PhocRenderItem item;
 
-  if (!phoc_utils_is_damaged (&proj_box, ctx->damage, clip_box, &damage))
+  if (!get_item_damage (output, &proj_box, clip_box, occluded, ctx, &damage))
     goto buffer_damage_finish;
 
   if (_src_box)
     src_box = *_src_box;
 
-  phoc_output_transform_box (output, &proj_box);
-  phoc_output_transform_damage (output, &damage);
-  transform = wlr_output_transform_compose (surface_transform, output->wlr_output->transform);
-
-  wlr_render_pass_add_texture (ctx->render_pass, &(struct wlr_render_texture_options) {
-      .texture = texture,
-      .src_box = src_box,
-      .dst_box = proj_box,
-      .transform = transform,
-      .alpha = &alpha,
-      .clip = &damage,
-      .filter_mode = phoc_output_get_texture_filter_mode (ctx->output),
-    });
+  item = (PhocRenderItem) {
+    .type = PHOC_RENDER_ITEM_TEXTURE,
+    .surface = surface,
+    .texture = texture,
+    .src_box = src_box,
+    .dst_box = proj_box,
+    .transform = wlr_output_transform_compose (surface_transform, ctx->transform),
+    .alpha = alpha,
+    .blend_mode = blend_mode,
+  };
+  /* The item takes over the damage */
+  item.clip = damage;
+  g_array_append_val (ctx->render_list, item);
+  return;
 
  buffer_damage_finish:
   pixman_region32_fini (&damage);
 }
 
+/**
+ * add_rect_item:
+ *
+ * Adds a solid rectangle for the damaged and not occluded part of a
+ * single pixel surface to the frame's render list.
+ */
+static void
+add_rect_item (PhocOutput                    *output,
+               const struct wlr_box          *dst_box,
+               const struct wlr_box          *clip_box,
+               pixman_region32_t             *occluded,
+               const struct wlr_render_color *_color,
+               float                          alpha,
+               PhocRenderContext             *ctx)
+{
+  pixman_region32_t damage;
+  struct wlr_box box = *dst_box;
+  struct wlr_render_color color = {
+    _color->r * alpha, _color->g * alpha, _color->b * alpha, _color->a * alpha,
+  };
+  PhocRenderItem item;
+
+  /* Premultiplied so this paints nothing */
+  if (color.a <= 0.0f)
+    return;
+
+  if (!get_item_damage (output, &box, clip_box, occluded, ctx, &damage))
+    goto damage_finish;
+
+  if (try_merge_rect (ctx, &box, &color, &damage))
+    goto damage_finish;
+
+  item = (PhocRenderItem) {
+    .type = PHOC_RENDER_ITEM_RECT,
+    .dst_box = box,
+    .color = color,
+  };
+  /* The item takes over the damage */
+  item.clip = damage;
+  g_array_append_val (ctx->render_list, item);
+  return;
+
+ damage_finish:
+  pixman_region32_fini (&damage);
+}
+
+/*
+ * Look up the state surface iterators need once per frame instead of
+ * once per surface.
+ */
 static void
-collect_touch_points (PhocOutput *output, struct wlr_surface *surface, struct wlr_box box, float scale)
+prepare_context (PhocRenderContext *ctx)
 {
-  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
   PhocServer *server = phoc_server_get_default ();
-  if (G_LIKELY (!(phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_TOUCH_POINTS))))
+  PhocOutput *output = ctx->output;
+
+  ctx->tex_filter = phoc_output_get_texture_filter_mode (output);
+  ctx->scale = output->wlr_output->scale;
+  ctx->transform = output->wlr_output->transform;
+  ctx->shell_revealed = phoc_output_has_shell_revealed (output);
+  ctx->input = phoc_server_get_input (server);
+  ctx->seats = phoc_input_get_seats (ctx->input);
+
+  ctx->debug.touch_points =
+    phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_TOUCH_POINTS);
+  ctx->debug.render_list =
+    phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_RENDER_LIST);
+  ctx->debug.damage_tracking =
+    phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_DAMAGE_TRACKING);
+  ctx->debug.damage_heatmap =
+    phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_DAMAGE_HEATMAP);
+}
+
+
+static void
+collect_touch_points (PhocRenderContext  *ctx,
+                      struct wlr_surface *surface,
+                      struct wlr_box      box,
+                      float               scale)
+{
+  PhocOutput *output = ctx->output;
+
+  if (G_LIKELY (!ctx->debug.touch_points))
     return;
 
-  for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next) {
+  for (GSList *elem = ctx->seats; elem; elem = elem->next) {
     PhocSeat *seat = PHOC_SEAT (elem->data);
     struct wlr_touch_point *point;
 
-    g_assert (PHOC_IS_SEAT (seat));
+    phoc_assert_hot (PHOC_IS_SEAT (seat));
 
     wl_list_for_each(point, &seat->seat->touch_state.touch_points, link) {
-      struct touch_point_data *touch_point;
+      PhocOutputTouchPoint *touch_point;
 
       if (point->surface != surface)
         continue;
 
-      touch_point = g_new (struct touch_point_data, 1);
-      touch_point->id = point->touch_id;
-      touch_point->x = box.x + point->sx * output->wlr_output->scale * scale;
-      touch_point->y = box.y + point->sy * output->wlr_output->scale * scale;
-      output->debug_touch_points = g_list_append (output->debug_touch_points, touch_point);
+      if (output->n_debug_touch_points == PHOC_OUTPUT_MAX_DEBUG_TOUCH_POINTS)
+        return;
+
+      touch_point = &output->debug_touch_points[output->n_debug_touch_points++];
+      *touch_point = (PhocOutputTouchPoint) {
+        .id = point->touch_id,
+        .x = box.x + point->sx * ctx->scale * scale,
+        .y = box.y + point->sy * ctx->scale * scale,
+      };
     }
   }
 }
 
 
+/**
+ * region_inset:
+ * @region: (inout): The region to shrink
+ * @inset: The number of pixels to remove at each edge
+ *
+ * Shrinks each rectangle of region by @inset pixels on each side.
+ */
+static void
+region_inset (pixman_region32_t *region, int inset)
+{
+  const pixman_box32_t *rects;
+  g_autofree pixman_box32_t *inset_rects = NULL;
+  int nrects, n = 0;
+
+  rects = pixman_region32_rectangles (region, &nrects);
+  inset_rects = g_new (pixman_box32_t, MAX (nrects, 1));
+
+  for (int i = 0; i < nrects; i++) {
+    pixman_box32_t box = {
+      .x1 = rects[i].x1 + inset,
+      .y1 = rects[i].y1 + inset,
+      .x2 = rects[i].x2 - inset,
+      .y2 = rects[i].y2 - inset,
+    };
+
+    if (box.x1 >= box.x2 || box.y1 >= box.y2)
+      continue;
+
+    inset_rects[n++] = box;
+  }
+
+  pixman_region32_fini (region);
+  pixman_region32_init_rects (region, inset_rects, n);
+}
+
+/**
+ * collect_opaque_iterator:
+ *
+ * Records the part of a surface that is guaranteed to be fully opaque
+ * (in output buffer coordinates) so surfaces below it can skip
+ * painting that area. This needs to visit surfaces in the exact same
+ * order as `render_surface_iterator`.
+ */
 static void
-render_surface_iterator (PhocOutput         *output,
+collect_opaque_iterator (PhocOutput         *output,
                          struct wlr_surface *surface,
                          struct wlr_box     *box,
                          float               scale,
                          void               *data)
 {
   PhocRenderContext *ctx = data;
-  struct wlr_output *wlr_output = output->wlr_output;
-  float alpha = ctx->alpha;
+  pixman_region32_t opaque;
+  struct wlr_box dst_box = *box;
+  struct wlr_render_color color;
+  float scale_x, scale_y;
 
-  struct wlr_texture *texture = wlr_surface_get_texture (surface);
-  if (!texture)
-    return;
+  pixman_region32_init (&opaque);
 
-  struct wlr_fbox src_box;
-  wlr_surface_get_buffer_source_box (surface, &src_box);
+  if (ctx->alpha < 1.0f || !wlr_surface_get_texture (surface))
+    goto out;
 
-  struct wlr_box dst_box = *box;
-  struct wlr_box clip_box = *box;
+  /* An opaque single pixel covers the whole surface, no matter the opaque region */
+  if (phoc_utils_wlr_surface_get_single_pixel_color (surface, &color) && color.a >= 1.0f) {
+    phoc_utils_scale_box (&dst_box, scale * ctx->scale);
+    pixman_region32_union_rect (&opaque, &opaque,
+                                dst_box.x, dst_box.y, dst_box.width, dst_box.height);
+    goto out;
+  }
+
+  if (!pixman_region32_not_empty (&surface->opaque_region))
+    goto out;
 
-  phoc_utils_scale_box (&dst_box, scale);
-  phoc_utils_scale_box (&dst_box, wlr_output->scale);
-  phoc_utils_scale_box (&clip_box, scale);
-  phoc_utils_scale_box (&clip_box, wlr_output->scale);
+  if (surface->current.width <= 0 || surface->current.height <= 0)
+    goto out;
 
-  render_texture (output, texture, &src_box, &dst_box, &clip_box, surface->current.transform, alpha, ctx);
+  /* Compose view and output scale to only round once */
+  phoc_utils_scale_box (&dst_box, scale * ctx->scale);
 
-  wlr_presentation_surface_scanned_out_on_output (output->desktop->presentation,
-                                                  surface,
-                                                  wlr_output);
+  pixman_region32_copy (&opaque, &surface->opaque_region);
+  scale_x = (float)dst_box.width / surface->current.width;
+  scale_y = (float)dst_box.height / surface->current.height;
+  if (scale_x != 1.0f || scale_y != 1.0f) {
+    /* Filtering blends in neighbouring texels at the edges */
+    if (ctx->tex_filter != WLR_SCALE_FILTER_NEAREST)
+      region_inset (&opaque, 1);
+    phoc_utils_region_scale_inward (&opaque, &opaque, scale_x, scale_y);
+  }
+  pixman_region32_translate (&opaque, dst_box.x, dst_box.y);
+  pixman_region32_intersect_rect (&opaque, &opaque,
+                                  dst_box.x, dst_box.y, dst_box.width, dst_box.height);
 
-  collect_touch_points(output, surface, dst_box, scale);
+ out:
+  g_array_append_val (ctx->occluded, opaque);
 }
 
 
-static void
-render_blings (PhocOutput *output, PhocView *view, PhocRenderContext *ctx)
+/*
+ * Get a downscaled copy of the surface's texture for scaled down
+ * views. Only used when the copy is considerably smaller as it costs
+ * an extra buffer.
+ */
+static struct wlr_texture *
+get_scaled_texture (PhocRenderer          *self,
+                    PhocOutput            *output,
+                    struct wlr_surface    *surface,
+                    struct wlr_texture    *texture,
+                    const struct wlr_fbox *src_box,
+                    const struct wlr_box  *dst_box)
 {
-  GSList *blings;
+  PhocScaledTexture *scaled;
 
-  if (!phoc_view_is_mapped (view))
-    return;
+  if (!self->wlr_allocator || !(self->caps & PHOC_RENDERER_CAP_BUFFER_TARGETS))
+    return NULL;
 
-  blings = phoc_view_get_blings (view);
-  if (!blings)
-    return;
+  /* Keep viewports and transformed buffers simple */
+  if (surface->current.transform != WL_OUTPUT_TRANSFORM_NORMAL)
+    return NULL;
 
-  for (GSList *l = blings; l; l = l->next) {
-    PhocBling *bling = PHOC_BLING (l->data);
+  if (src_box->x != 0 || src_box->y != 0 ||
+      src_box->width != texture->width || src_box->height != texture->height) {
+    return NULL;
+  }
+
+  if ((guint64)dst_box->width * dst_box->height * 4 > (guint64)texture->width * texture->height * 3)
+    return NULL;
 
-    phoc_bling_render (bling, ctx);
+  scaled = g_hash_table_lookup (self->scaled_textures, surface);
+  if (!scaled) {
+    scaled = phoc_scaled_texture_new (surface, self->wlr_renderer, self->wlr_allocator,
+                                      self->scaled_textures);
+    g_hash_table_insert (self->scaled_textures, surface, scaled);
   }
+
+  return phoc_scaled_texture_get (scaled, output, dst_box);
 }
 
 
-static void
-render_view (PhocOutput *output, PhocView *view, PhocRenderContext *ctx)
+/*
+ * Software renderers read back the destination to blend. Skip that if
+ * the surface is opaque wherever the frame is damaged. @box is in
+ * output buffer coordinates.
+ */
+static enum wlr_render_blend_mode
+get_blend_mode (PhocRenderContext *ctx, guint idx, const struct wlr_box *box, float alpha)
 {
-  // Do not render views fullscreened on other outputs
-  if (phoc_view_is_fullscreen (view) && phoc_view_get_fullscreen_output (view) != output)
-    return;
-
-  ctx->alpha = phoc_view_get_alpha (view);
+  pixman_region32_t *opaque;
+  pixman_box32_t *extents, damaged;
+
+  if (!ctx->surface_opaque || idx >= ctx->surface_opaque->len || alpha < 1.0f)
+    return WLR_RENDER_BLEND_MODE_PREMULTIPLIED;
+
+  opaque = &g_array_index (ctx->surface_opaque, pixman_region32_t, idx);
+  if (!pixman_region32_not_empty (opaque))
+    return WLR_RENDER_BLEND_MODE_PREMULTIPLIED;
+
+  extents = pixman_region32_extents (ctx->damage);
+  damaged = (pixman_box32_t) {
+    .x1 = MAX (extents->x1, box->x),
+    .y1 = MAX (extents->y1, box->y),
+    .x2 = MIN (extents->x2, box->x + box->width),
+    .y2 = MIN (extents->y2, box->y + box->height),
+  };
+  if (damaged.x1 >= damaged.x2 || damaged.y1 >= damaged.y2)
+    return WLR_RENDER_BLEND_MODE_PREMULTIPLIED;
 
-  if (!phoc_view_is_fullscreen (view))
-    render_blings (output, view, ctx);
+  if (pixman_region32_contains_rectangle (opaque, &damaged) == PIXMAN_REGION_IN)
+    return WLR_RENDER_BLEND_MODE_NONE;
 
-  phoc_output_view_for_each_surface (output, view, render_surface_iterator, ctx);
+  return WLR_RENDER_BLEND_MODE_PREMULTIPLIED;
 }
 
 
 static void
-render_layer (enum zwlr_layer_shell_v1_layer layer, PhocRenderContext *ctx)
+render_surface_iterator (PhocOutput         *output,
+                         struct wlr_surface *surface,
+                         struct wlr_box     *box,
+                         float               scale,
+                         void               *data)
 {
-  GQueue *layer_surfaces = phoc_output_get_layer_surfaces_for_layer (ctx->output, layer);
-
-  for (GList *l = layer_surfaces->head; l; l = l->next) {
-    PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (l->data);
+  PhocRenderContext *ctx = data;
+  float alpha = ctx->alpha;
+  pixman_region32_t *occluded = NULL;
+  struct wlr_render_color color;
 
-    ctx->alpha = phoc_layer_surface_get_alpha (layer_surface);
-    phoc_output_layer_surface_for_each_surface (ctx->output,
-                                                layer_surface,
-                                                render_surface_iterator,
-                                                ctx);
-  }
-}
+  if (ctx->occluded && ctx->surface_idx < ctx->occluded->len)
+    occluded = &g_array_index (ctx->occluded, pixman_region32_t, ctx->surface_idx);
+  ctx->surface_idx++;
 
+  if (G_UNLIKELY (ctx->input_latency))
+    phoc_input_latency_surface_rendered (ctx->input_latency, surface, output);
 
-static void
-render_drag_icons (PhocInput *input, PhocRenderContext *ctx)
-{
-  ctx->alpha = 1.0;
+  /* Shown on a hardware plane above us */
+  if (ctx->planes && phoc_output_planes_has_surface (ctx->planes, surface)) {
+    phoc_output_surface_presented (output, surface, PHOC_OUTPUT_PRESENTATION_PLANE);
+    return;
+  }
 
-  phoc_output_drag_icons_for_each_surface (ctx->output, input, render_surface_iterator, ctx);
-}
+  struct wlr_texture *texture = wlr_surface_get_texture (surface);
+  if (!texture)
+    return;
 
+  struct wlr_fbox src_box;
+  wlr_surface_get_buffer_source_box (surface, &src_box);
 
-static void
-color_hsv_to_rgb (struct wlr_render_color *color)
-{
-  float h = color->r, s = color->g, v = color->b;
+  struct wlr_box dst_box = *box;
+  struct wlr_box clip_box = *box;
 
-  h = fmodf (h, 360);
-  if (h < 0)
-    h += 360;
+  /*
+   * Compose view and output scale so the box is only rounded once,
+   * otherwise scaled views on fractionally scaled outputs end up off
+   * by a pixel and get resampled.
+   */
+  phoc_utils_scale_box (&dst_box, scale * ctx->scale);
+  phoc_utils_scale_box (&clip_box, scale * ctx->scale);
+
+  /* Clients following the preferred scale already render at the displayed size */
+  if (scale < 1.0f && src_box.width > dst_box.width) {
+    PhocServer *server = phoc_server_get_default ();
+
+    if (phoc_server_get_config (server)->scaled_view_cache) {
+      PhocRenderer *self = phoc_server_get_renderer (server);
+      struct wlr_texture *scaled = get_scaled_texture (self, output, surface, texture,
+                                                       &src_box, &dst_box);
+
+      if (scaled) {
+        texture = scaled;
+        src_box = (struct wlr_fbox) { .width = scaled->width, .height = scaled->height };
+      }
+    }
+  }
 
-  int d = h / 60;
-  float e = h / 60 - d;
-  float a = v * (1 - s);
-  float b = v * (1 - e * s);
-  float c = v * (1 - (1 - e) * s);
+  if (ctx->occluded_surfaces && occluded &&
+      pixman_region32_contains_rectangle (occluded, &(pixman_box32_t) {
+          .x1 = clip_box.x, .y1 = clip_box.y,
+          .x2 = clip_box.x + clip_box.width, .y2 = clip_box.y + clip_box.height,
+        }) == PIXMAN_REGION_IN) {
+    g_hash_table_add (ctx->occluded_surfaces, surface);
+  }
 
-  switch (d) {
-  default:
-  case 0: color->r = v, color->g = c, color->b = a; return;
-  case 1: color->r = b, color->g = v, color->b = a; return;
-  case 2: color->r = a, color->g = v, color->b = c; return;
-  case 3: color->r = a, color->g = b, color->b = v; return;
-  case 4: color->r = c, color->g = a, color->b = v; return;
-  case 5: color->r = v, color->g = a, color->b = b; return;
+  /* Single pixel buffers are usually stretched far, skip sampling them */
+  if (phoc_utils_wlr_surface_get_single_pixel_color (surface, &color)) {
+    add_rect_item (output, &dst_box, &clip_box, occluded, &color, alpha, ctx);
+  } else {
+    add_texture_item (output, surface, texture, &src_box, &dst_box, &clip_box, occluded,
+                      surface->current.transform, alpha,
+                      get_blend_mode (ctx, ctx->surface_idx - 1, &clip_box, alpha), ctx);
   }
-}
 
+  phoc_output_surface_presented (output, surface, PHOC_OUTPUT_PRESENTATION_COMPOSITED);
 
-static struct wlr_box
-phoc_box_from_touch_point (struct touch_point_data *touch_point, int width, int height)
-{
-  return (struct wlr_box) {
-    .x = touch_point->x - width / 2.0,
-    .y = touch_point->y - height / 2.0,
-    .width = width,
-    .height = height
-  };
+  collect_touch_points (ctx, surface, dst_box, scale);
 }
 
+
 static void
-render_touch_point_cb (gpointer data, gpointer user_data)
+render_blings (PhocOutput *output, GSList *blings, PhocRenderContext *ctx)
 {
-  struct touch_point_data *touch_point = data;
-  PhocRenderContext *ctx = user_data;
-  struct wlr_output *wlr_output = ctx->output->wlr_output;
-  int size = TOUCH_POINT_SIZE * wlr_output->scale;
-  struct wlr_render_color color = {touch_point->id * 100 + 240, 1.0, 1.0, 0.75};
-  struct wlr_box point_box;
+  for (GSList *l = blings; l; l = l->next) {
+    PhocBling *bling = PHOC_BLING (l->data);
+    struct wlr_render_color color;
+    pixman_region32_t damage;
+    PhocRenderItem item;
+    struct wlr_box box;
+
+    box = phoc_bling_get_box (bling);
+    box.x -= output->lx;
+    box.y -= output->ly;
+    phoc_utils_scale_box (&box, ctx->scale);
+    phoc_output_transform_box (output, &box);
+
+    /* Blings outside of the damage don't contribute to the frame */
+    if (!phoc_utils_is_damaged (&box, ctx->buffer_damage, NULL, &damage)) {
+      pixman_region32_fini (&damage);
+      continue;
+    }
 
-  color_hsv_to_rgb (&color);
+    if (!phoc_bling_get_rect (bling, &color)) {
+      pixman_region32_fini (&damage);
+      item = (PhocRenderItem) {
+        .type = PHOC_RENDER_ITEM_BLING,
+        .bling = bling,
+      };
+      /* Keep the clean up uniform with texture items */
+      pixman_region32_init (&item.clip);
+      g_array_append_val (ctx->render_list, item);
+      continue;
+    }
 
-  point_box = phoc_box_from_touch_point (touch_point, size, size);
-  phoc_output_transform_box (ctx->output, &point_box);
-  wlr_render_pass_add_rect (ctx->render_pass, &(struct wlr_render_rect_options){
-      .box = point_box,
+    if (try_merge_rect (ctx, &box, &color, &damage)) {
+      pixman_region32_fini (&damage);
+      continue;
+    }
+
+    item = (PhocRenderItem) {
+      .type = PHOC_RENDER_ITEM_RECT,
+      .dst_box = box,
       .color = color,
-    });
+    };
+    /* The item takes over the damage */
+    item.clip = damage;
+    g_array_append_val (ctx->render_list, item);
+  }
+}
 
-  size = TOUCH_POINT_SIZE * (1.0 - TOUCH_POINT_BORDER) * wlr_output->scale;
-  point_box = phoc_box_from_touch_point (touch_point, size, size);
-  phoc_output_transform_box (ctx->output, &point_box);
-  wlr_render_pass_add_rect (ctx->render_pass, &(struct wlr_render_rect_options){
-      .box = point_box,
-      .color = COLOR_TRANSPARENT_WHITE,
-    });
 
-  point_box = phoc_box_from_touch_point (touch_point, 8 * wlr_output->scale, 2 * wlr_output->scale);
-  phoc_output_transform_box (ctx->output, &point_box);
-  wlr_render_pass_add_rect (ctx->render_pass, &(struct wlr_render_rect_options){
-      .box = point_box,
-      .color = color,
-    });
+typedef struct {
+  PhocRenderContext  ctx;
+  GArray            *summary;
+  gboolean           comparable;
+} PhocRenderSummaryData;
 
-  point_box = phoc_box_from_touch_point (touch_point, 2 * wlr_output->scale, 8 * wlr_output->scale);
-  phoc_output_transform_box (ctx->output, &point_box);
-  wlr_render_pass_add_rect (ctx->render_pass, &(struct wlr_render_rect_options){
-      .box = point_box,
-      .color = color,
-    });
-}
 
 static void
-render_touch_points (PhocRenderContext *ctx)
+summarize_blings (GSList *blings, PhocRenderContext *ctx)
 {
-  if (G_LIKELY (ctx->output->debug_touch_points == NULL))
-    return;
+  PhocRenderSummaryData *data = (PhocRenderSummaryData *)ctx;
 
-  g_list_foreach (ctx->output->debug_touch_points, render_touch_point_cb, ctx);
+  /* Blings don't tell whether they look different */
+  if (blings)
+    data->comparable = FALSE;
 }
 
 
 static void
-damage_touch_point_cb (gpointer data, gpointer user_data)
+mark_occluded_iterator (PhocOutput         *output,
+                        struct wlr_surface *surface,
+                        struct wlr_box     *box,
+                        float               scale,
+                        void               *data)
 {
-  struct touch_point_data *touch_point = data;
-  PhocOutput *output = user_data;
-  struct wlr_output *wlr_output = output->wlr_output;
-  int size = TOUCH_POINT_SIZE * wlr_output->scale;
-  struct wlr_box box = phoc_box_from_touch_point (touch_point, size, size);
-  pixman_region32_t region;
+  PhocRenderContext *ctx = data;
 
-  pixman_region32_init_rect (&region, box.x, box.y, box.width, box.height);
-  wlr_damage_ring_add (&output->damage_ring, &region);
-  pixman_region32_fini (&region);
+  g_hash_table_add (ctx->occluded_surfaces, surface);
 }
 
+
+/*
+ * Add a texture caching the content of several surfaces to the frame.
+ * @box is where it goes in transformed output buffer coordinates and
+ * @cache_opaque the area it covers opaquely in untransformed output
+ * buffer coordinates. As a single texture it takes up one slot in the
+ * occlusion array.
+ */
 static void
-damage_touch_points (PhocOutput *output)
+render_cached_texture (PhocOutput           *output,
+                       struct wlr_texture   *texture,
+                       const struct wlr_box *box,
+                       pixman_region32_t    *cache_opaque,
+                       PhocSurfaceIterator   iterator,
+                       PhocRenderContext    *ctx)
 {
-  if (G_LIKELY (output->debug_touch_points == NULL))
-    return;
+  pixman_region32_t *occluded = NULL;
+  pixman_region32_t damage;
+  PhocRenderItem item;
 
-  g_list_foreach (output->debug_touch_points, damage_touch_point_cb, output);
-}
+  if (iterator == collect_opaque_iterator) {
+    pixman_region32_t opaque;
 
-static void
-view_render_to_buffer_iterator (struct wlr_surface *surface, int sx, int sy, void *_data)
-{
-  if (!wlr_surface_has_buffer (surface)) {
+    pixman_region32_init (&opaque);
+    pixman_region32_copy (&opaque, cache_opaque);
+    g_array_append_val (ctx->occluded, opaque);
     return;
   }
 
-  PhocServer *server = phoc_server_get_default ();
-  PhocRenderer *self = phoc_server_get_renderer (server);
-  struct wlr_texture *texture = wlr_surface_get_texture (surface);
+  g_assert (iterator == render_surface_iterator);
 
-  struct view_render_data *data = _data;
-  PhocView *view = data->view;
+  if (ctx->occluded && ctx->surface_idx < ctx->occluded->len)
+    occluded = &g_array_index (ctx->occluded, pixman_region32_t, ctx->surface_idx);
+  ctx->surface_idx++;
 
-  struct wlr_box geo;
-  phoc_view_get_geometry (view, &geo);
+  pixman_region32_init (&damage);
+  pixman_region32_copy (&damage, ctx->damage);
+  if (occluded && pixman_region32_not_empty (occluded)) {
+    guint64 area = phoc_utils_region_area (&damage);
 
-  float scale = fmin (data->width / (float)geo.width,
-                      data->height / (float)geo.height);
+    pixman_region32_subtract (&damage, &damage, occluded);
+    ctx->culled_pixels += area - phoc_utils_region_area (&damage);
+  }
 
-  float proj[9];
-  wlr_matrix_identity (proj);
-  wlr_matrix_scale (proj, scale, scale);
-  wlr_matrix_translate (proj, -geo.x, -geo.y);
+  /* The texture is already in the output's buffer layout */
+  phoc_output_transform_damage (output, &damage);
+  pixman_region32_intersect_rect (&damage, &damage, box->x, box->y, box->width, box->height);
+  if (!pixman_region32_not_empty (&damage)) {
+    pixman_region32_fini (&damage);
+    return;
+  }
+
+  item = (PhocRenderItem) {
+    .type = PHOC_RENDER_ITEM_TEXTURE,
+    .texture = texture,
+    .src_box = { .width = texture->width, .height = texture->height },
+    .dst_box = *box,
+    .transform = WL_OUTPUT_TRANSFORM_NORMAL,
+    .alpha = 1.0,
+  };
+  /* The item takes over the damage */
+  item.clip = damage;
+  g_array_append_val (ctx->render_list, item);
+}
+
+/*
+ * Add the cached background and bottom layers to the frame.
+ */
+static void
+render_layer_cache (PhocOutput *output, PhocSurfaceIterator iterator, PhocRenderContext *ctx)
+{
+  struct wlr_texture *texture = phoc_layer_cache_get_texture (ctx->layer_cache);
+  struct wlr_box box = { .width = texture->width, .height = texture->height };
+
+  render_cached_texture (output, texture, &box, phoc_layer_cache_get_opaque (ctx->layer_cache),
+                         iterator, ctx);
+}
+
+
+static void
+cached_surface_iterator (PhocOutput         *output,
+                         struct wlr_surface *surface,
+                         struct wlr_box     *box,
+                         float               scale,
+                         void               *data)
+{
+  PhocRenderContext *ctx = data;
+
+  if (G_UNLIKELY (ctx->input_latency))
+    phoc_input_latency_surface_rendered (ctx->input_latency, surface, output);
+
+  phoc_output_surface_presented (output, surface, PHOC_OUTPUT_PRESENTATION_COMPOSITED);
+}
+
+/*
+ * Add a view's cached surfaces to the frame. The surfaces still get
+ * presentation feedback as if they were rendered individually.
+ */
+static void
+render_view_cache (PhocOutput          *output,
+                   PhocView            *view,
+                   PhocViewCache       *cache,
+                   PhocSurfaceIterator  iterator,
+                   PhocRenderContext   *ctx)
+{
+  render_cached_texture (output,
+                         phoc_view_cache_get_texture (cache),
+                         phoc_view_cache_get_box (cache),
+                         phoc_view_cache_get_opaque (cache),
+                         iterator,
+                         ctx);
+
+  if (iterator == render_surface_iterator)
+    phoc_output_view_for_each_surface (output, view, cached_surface_iterator, ctx);
+}
+
+
+/*
+ * Draw a view snapshot, e.g. of a view held back by the layout
+ * transaction or of a closing view. It counts as a single non opaque
+ * surface.
+ */
+static void
+render_view_snapshot (PhocOutput          *output,
+                      PhocViewSnapshot    *snapshot,
+                      PhocSurfaceIterator  iterator,
+                      PhocRenderContext   *ctx)
+{
+  struct wlr_texture *texture = phoc_view_snapshot_get_texture (snapshot);
+  const struct wlr_box *snapshot_box = phoc_view_snapshot_get_box (snapshot);
+  float scale = phoc_view_snapshot_get_scale (snapshot);
+  pixman_region32_t *occluded = NULL;
+  struct wlr_box box;
+
+  if (iterator == collect_opaque_iterator) {
+    pixman_region32_t opaque;
+
+    pixman_region32_init (&opaque);
+    g_array_append_val (ctx->occluded, opaque);
+    return;
+  }
+
+  if (iterator == summarize_surface_iterator) {
+    /* Snapshots don't tell whether they look different */
+    ((PhocRenderSummaryData *)ctx)->comparable = FALSE;
+    return;
+  }
+
+  g_assert (iterator == render_surface_iterator);
+
+  if (ctx->occluded && ctx->surface_idx < ctx->occluded->len)
+    occluded = &g_array_index (ctx->occluded, pixman_region32_t, ctx->surface_idx);
+  ctx->surface_idx++;
+
+  /* Shrink towards the center */
+  box = (struct wlr_box) {
+    .x = snapshot_box->x + snapshot_box->width * (1.0 - scale) / 2.0,
+    .y = snapshot_box->y + snapshot_box->height * (1.0 - scale) / 2.0,
+    .width = snapshot_box->width * scale,
+    .height = snapshot_box->height * scale,
+  };
+  phoc_utils_scale_box (&box, ctx->scale);
+  add_texture_item (output, NULL, texture, NULL, &box, &box, occluded,
+                    WL_OUTPUT_TRANSFORM_NORMAL,
+                    ctx->alpha * phoc_view_snapshot_get_alpha (snapshot),
+                    WLR_RENDER_BLEND_MODE_PREMULTIPLIED,
+                    ctx);
+}
+
+
+/*
+ * Draw the snapshots of closing views that were right above @below
+ * in the stack. If @below is %NULL draw those that were below all
+ * views or, if @on_top is set, those whose view below left the stack.
+ */
+static void
+render_closing_views (PhocOutput          *output,
+                      PhocView            *below,
+                      gboolean             on_top,
+                      PhocSurfaceIterator  iterator,
+                      PhocRenderContext   *ctx)
+{
+  PhocRenderer *self = phoc_server_get_renderer (phoc_server_get_default ());
+
+  for (guint i = 0; i < self->view_snapshots->len; i++) {
+    PhocViewSnapshot *snapshot = g_ptr_array_index (self->view_snapshots, i);
+    gboolean stacked;
+
+    if (phoc_view_snapshot_get_output (snapshot) != output ||
+        !phoc_view_snapshot_get_texture (snapshot)) {
+      continue;
+    }
+
+    if (on_top)
+      stacked = phoc_view_snapshot_is_on_top (snapshot);
+    else
+      stacked = phoc_view_snapshot_is_stacked_on (snapshot, below);
+
+    if (!stacked)
+      continue;
+
+    ctx->alpha = 1.0;
+    render_view_snapshot (output, snapshot, iterator, ctx);
+  }
+}
+
+
+static void
+render_view (PhocOutput *output, PhocView *view, PhocSurfaceIterator iterator, PhocRenderContext *ctx)
+{
+  const PhocViewRenderState *state = phoc_view_get_render_state (view);
+
+  // Do not render views fullscreened on other outputs
+  if (state->fullscreen_output && state->fullscreen_output != output)
+    return;
+
+  ctx->alpha = state->alpha;
+
+  if (!state->fullscreen_output && state->blings && phoc_view_is_mapped (view)) {
+    if (iterator == render_surface_iterator)
+      render_blings (output, state->blings, ctx);
+    else if (iterator == summarize_surface_iterator)
+      summarize_blings (state->blings, ctx);
+  }
+
+  /*
+   * Fully transparent views don't contribute to the frame. Treat them
+   * like covered ones so their clients get throttled frame callbacks
+   * until they become visible again.
+   */
+  if (ctx->alpha <= 0.0f) {
+    if (iterator == render_surface_iterator && ctx->occluded_surfaces)
+      phoc_output_view_for_each_surface (output, view, mark_occluded_iterator, ctx);
+    return;
+  }
+
+  if (iterator == collect_opaque_iterator || iterator == render_surface_iterator) {
+    PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+    PhocLayoutTransaction *transaction = phoc_desktop_get_layout_transaction (desktop);
+    PhocViewSnapshot *snapshot = phoc_layout_transaction_get_snapshot (transaction, view);
+
+    if (snapshot && phoc_view_snapshot_get_output (snapshot) == output &&
+        phoc_view_snapshot_get_texture (snapshot)) {
+      render_view_snapshot (output, snapshot, iterator, ctx);
+      return;
+    }
+  }
+
+  if (ctx->view_caches &&
+      (iterator == collect_opaque_iterator || iterator == render_surface_iterator)) {
+    PhocViewCache *cache = g_hash_table_lookup (ctx->view_caches, view);
+
+    if (cache) {
+      render_view_cache (output, view, cache, iterator, ctx);
+      return;
+    }
+  }
+
+  phoc_output_view_for_each_surface (output, view, iterator, ctx);
+}
+
+
+static void
+render_layer (enum zwlr_layer_shell_v1_layer layer, PhocSurfaceIterator iterator, PhocRenderContext *ctx)
+{
+  GQueue *layer_surfaces = phoc_output_get_layer_surfaces_for_layer (ctx->output, layer);
+
+  for (GList *l = layer_surfaces->head; l; l = l->next) {
+    PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (l->data);
+
+    ctx->alpha = phoc_layer_surface_get_alpha (layer_surface);
+    if (ctx->alpha <= 0.0f) {
+      if (iterator == render_surface_iterator && ctx->occluded_surfaces) {
+        phoc_output_layer_surface_for_each_surface (ctx->output, layer_surface,
+                                                    mark_occluded_iterator, ctx);
+      }
+      continue;
+    }
+
+    phoc_output_layer_surface_for_each_surface (ctx->output,
+                                                layer_surface,
+                                                iterator,
+                                                ctx);
+  }
+}
+
+
+static void
+unmark_occluded_iterator (PhocOutput         *output,
+                          struct wlr_surface *surface,
+                          struct wlr_box     *box,
+                          float               scale,
+                          void               *data)
+{
+  PhocRenderContext *ctx = data;
+
+  g_hash_table_remove (ctx->occluded_surfaces, surface);
+}
+
+
+static void
+render_overview (PhocOutput *output, PhocSurfaceIterator iterator, PhocRenderContext *ctx)
+{
+  PhocOverview *overview = phoc_output_get_overview (output);
+
+  if (!overview)
+    return;
+
+  /* Placed views are shown even when covered in the layout */
+  if (iterator == render_surface_iterator && ctx->occluded_surfaces)
+    phoc_overview_for_each_surface (overview, unmark_occluded_iterator, ctx);
+
+  ctx->alpha = 1.0;
+  phoc_overview_for_each_surface (overview, iterator, ctx);
+}
+
+
+static void
+render_drag_icons (PhocSurfaceIterator iterator, PhocRenderContext *ctx)
+{
+  ctx->alpha = 1.0;
+
+  phoc_output_drag_icons_for_each_surface (ctx->output, ctx->input, iterator, ctx);
+}
+
+
+/**
+ * render_surfaces:
+ * @output: The output to render
+ * @iterator: The iterator invoked for each surface
+ * @ctx: The render context
+ *
+ * Invokes @iterator on all surfaces visible on @output in rendering
+ * order (bottom to top). Blings are only rendered when the iterator
+ * is `render_surface_iterator`. If @ctx has a layer cache it replaces
+ * the background and bottom layers, this is only supported for
+ * `collect_opaque_iterator` and `render_surface_iterator`.
+ */
+static void
+render_surfaces (PhocOutput *output, PhocSurfaceIterator iterator, PhocRenderContext *ctx)
+{
+  PhocDesktop *desktop = PHOC_DESKTOP (output->desktop);
+  PhocSessionLock *session_lock = phoc_desktop_get_session_lock (desktop);
+
+  /* Nothing but the lock surface may show up while the session is locked */
+  if (G_UNLIKELY (phoc_session_lock_is_locked (session_lock))) {
+    struct wlr_surface *surface = phoc_session_lock_get_surface (session_lock, output);
+
+    if (surface)
+      phoc_output_surface_for_each_surface (output, surface, 0, 0, iterator, ctx);
+    return;
+  }
+
+  // If a view is fullscreen on this output, render it
+  if (output->fullscreen_view != NULL) {
+    PhocView *view = output->fullscreen_view;
+
+    render_view (output, view, iterator, ctx);
+
+    // During normal rendering the xwayland window tree isn't traversed
+    // because all windows are rendered. Here we only want to render
+    // the fullscreen window's children so we have to traverse the tree.
+#ifdef PHOC_XWAYLAND
+    if (PHOC_IS_XWAYLAND_SURFACE (view)) {
+      phoc_output_xwayland_children_for_each_surface (output,
+                                                      PHOC_XWAYLAND_SURFACE (view),
+                                                      iterator,
+                                                      ctx);
+    }
+#endif
+
+    if (ctx->shell_revealed) {
+      // Render top layer above fullscreen view when requested
+      render_layer (ZWLR_LAYER_SHELL_V1_LAYER_TOP, iterator, ctx);
+    }
+  } else {
+    // Render background and bottom layers under views
+    if (ctx->layer_cache) {
+      render_layer_cache (output, iterator, ctx);
+    } else {
+      render_layer (ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND, iterator, ctx);
+      render_layer (ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM, iterator, ctx);
+    }
+
+    /* Render all views, closing ones where they were in the stack */
+    render_closing_views (output, NULL, FALSE, iterator, ctx);
+    for (GList *l = phoc_desktop_get_views (desktop)->tail; l; l = l->prev) {
+      PhocView *view = PHOC_VIEW (l->data);
+
+      if (phoc_desktop_view_is_visible (desktop, view))
+        render_view (output, view, iterator, ctx);
+      render_closing_views (output, view, FALSE, iterator, ctx);
+    }
+    render_closing_views (output, NULL, TRUE, iterator, ctx);
+    // Render top layer above views
+    render_layer (ZWLR_LAYER_SHELL_V1_LAYER_TOP, iterator, ctx);
+  }
+  render_overview (output, iterator, ctx);
+  render_drag_icons (iterator, ctx);
+
+  render_layer (ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, iterator, ctx);
+}
+
+
+static void
+summarize_surface_iterator (PhocOutput         *output,
+                            struct wlr_surface *surface,
+                            struct wlr_box     *box,
+                            float               scale,
+                            void               *data)
+{
+  PhocRenderSummaryData *summary_data = data;
+  struct wlr_texture *texture = wlr_surface_get_texture (surface);
+  PhocRenderSummaryItem item;
+
+  if (!texture)
+    return;
+
+  item = (PhocRenderSummaryItem) {
+    .surface = surface,
+    .texture = texture,
+    .seq = surface->current.seq,
+    .dst_box = *box,
+    .transform = surface->current.transform,
+    .alpha = summary_data->ctx.alpha,
+    .filter_mode = summary_data->ctx.tex_filter,
+  };
+  wlr_surface_get_buffer_source_box (surface, &item.src_box);
+  phoc_utils_scale_box (&item.dst_box, scale * summary_data->ctx.scale);
+
+  g_array_append_val (summary_data->summary, item);
+}
+
+/**
+ * phoc_renderer_summarize_output:
+ * @self: The renderer
+ * @output: The output
+ * @summary: (element-type PhocRenderSummaryItem): Filled with the output's summary
+ *
+ * Records what each surface would contribute to the output's next
+ * frame regardless of damage. If the summary matches the one of the
+ * frame on screen rendering the frame won't change the output's
+ * content.
+ *
+ * Returns: %FALSE if the frame has content that can't be summarized
+ *   (like blings) and hence can't be compared.
+ */
+gboolean
+phoc_renderer_summarize_output (PhocRenderer *self, PhocOutput *output, GArray *summary)
+{
+  PhocRenderSummaryData data = {
+    .ctx = {
+      .output = output,
+      .alpha = 1.0,
+    },
+    .summary = summary,
+    .comparable = TRUE,
+  };
+
+  g_assert (PHOC_IS_RENDERER (self));
+
+  prepare_context (&data.ctx);
+  g_array_set_size (summary, 0);
+  render_surfaces (output, summarize_surface_iterator, &data.ctx);
+
+  return data.comparable;
+}
+
+/**
+ * phoc_render_summary_equal:
+ * @summary: (element-type PhocRenderSummaryItem): A summary
+ * @other: (element-type PhocRenderSummaryItem): Another summary
+ *
+ * Compares two summaries filled by [method@Renderer.summarize_output].
+ *
+ * Returns: %TRUE if the summaries describe the same content
+ */
+gboolean
+phoc_render_summary_equal (GArray *summary, GArray *other)
+{
+  if (summary->len != other->len)
+    return FALSE;
+
+  for (guint i = 0; i < summary->len; i++) {
+    PhocRenderSummaryItem *a = &g_array_index (summary, PhocRenderSummaryItem, i);
+    PhocRenderSummaryItem *b = &g_array_index (other, PhocRenderSummaryItem, i);
+
+    if (a->surface != b->surface || a->texture != b->texture || a->seq != b->seq)
+      return FALSE;
+
+    if (!wlr_fbox_equal (&a->src_box, &b->src_box) || !wlr_box_equal (&a->dst_box, &b->dst_box))
+      return FALSE;
+
+    if (a->transform != b->transform || a->alpha != b->alpha || a->filter_mode != b->filter_mode)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+/**
+ * compute_occlusion:
+ * @self: The renderer
+ * @output: The output to render
+ * @ctx: The render context
+ * @opaque: (out): The area covered by opaque surfaces
+ *
+ * Walks the surfaces front to back and records for each surface the
+ * area that is covered by opaque surfaces above it.
+ */
+static void
+compute_occlusion (PhocRenderer *self, PhocOutput *output, PhocRenderContext *ctx,
+                   pixman_region32_t *opaque)
+{
+  g_array_set_size (self->occluded, 0);
+  ctx->occluded = self->occluded;
+  render_surfaces (output, collect_opaque_iterator, ctx);
+
+  /* Software rendering keeps each surface's opaque area to skip blending there */
+  if (self->caps & PHOC_RENDERER_CAP_SOFTWARE) {
+    g_array_set_size (self->surface_opaque, self->occluded->len);
+    ctx->surface_opaque = self->surface_opaque;
+  }
+
+  pixman_region32_clear (opaque);
+  for (int i = (int)self->occluded->len - 1; i >= 0; i--) {
+    pixman_region32_t *region = &g_array_index (self->occluded, pixman_region32_t, i);
+    pixman_region32_t surface_opaque;
+
+    pixman_region32_init (&surface_opaque);
+    pixman_region32_copy (&surface_opaque, region);
+    pixman_region32_copy (region, opaque);
+    pixman_region32_union (opaque, opaque, &surface_opaque);
+    if (ctx->surface_opaque)
+      g_array_index (ctx->surface_opaque, pixman_region32_t, i) = surface_opaque;
+    else
+      pixman_region32_fini (&surface_opaque);
+  }
+  pixman_region32_intersect (opaque, opaque, ctx->damage);
+}
+
+
+static void
+color_hsv_to_rgb (struct wlr_render_color *color)
+{
+  float h = color->r, s = color->g, v = color->b;
+
+  h = fmodf (h, 360);
+  if (h < 0)
+    h += 360;
+
+  int d = h / 60;
+  float e = h / 60 - d;
+  float a = v * (1 - s);
+  float b = v * (1 - e * s);
+  float c = v * (1 - (1 - e) * s);
+
+  switch (d) {
+  default:
+  case 0: color->r = v, color->g = c, color->b = a; return;
+  case 1: color->r = b, color->g = v, color->b = a; return;
+  case 2: color->r = a, color->g = v, color->b = c; return;
+  case 3: color->r = a, color->g = b, color->b = v; return;
+  case 4: color->r = c, color->g = a, color->b = v; return;
+  case 5: color->r = v, color->g = a, color->b = b; return;
+  }
+}
+
+
+static struct wlr_box
+phoc_box_from_touch_point (PhocOutputTouchPoint *touch_point, int width, int height)
+{
+  return (struct wlr_box) {
+    .x = touch_point->x - width / 2.0,
+    .y = touch_point->y - height / 2.0,
+    .width = width,
+    .height = height
+  };
+}
+
+
+static void
+add_touch_point_rect (PhocRenderContext    *ctx,
+                      PhocOutputTouchPoint *touch_point,
+                      int                   width,
+                      int                   height,
+                      struct wlr_render_color color)
+{
+  struct wlr_box point_box = phoc_box_from_touch_point (touch_point, width, height);
+
+  phoc_output_transform_box (ctx->output, &point_box);
+  wlr_render_pass_add_rect (ctx->render_pass, &(struct wlr_render_rect_options){
+      .box = point_box,
+      .color = color,
+    });
+}
+
+/*
+ * Draws the touch points collected during this frame. The draws are
+ * batched per shape so the renderer sees runs of rects sharing the
+ * same geometry setup rather than interleaving shapes per point.
+ */
+static void
+render_touch_points (PhocRenderContext *ctx)
+{
+  PhocOutput *output = ctx->output;
+  float scale = ctx->scale;
+  int outer = TOUCH_POINT_SIZE * scale;
+  int inner = TOUCH_POINT_SIZE * (1.0 - TOUCH_POINT_BORDER) * scale;
+  int long_side = 8 * scale, short_side = 2 * scale;
+  struct wlr_render_color colors[PHOC_OUTPUT_MAX_DEBUG_TOUCH_POINTS];
+  guint n = output->n_debug_touch_points;
+
+  if (G_LIKELY (n == 0))
+    return;
+
+  for (guint i = 0; i < n; i++) {
+    colors[i] = (struct wlr_render_color){output->debug_touch_points[i].id * 100 + 240, 1.0, 1.0, 0.75};
+    color_hsv_to_rgb (&colors[i]);
+  }
+
+  for (guint i = 0; i < n; i++)
+    add_touch_point_rect (ctx, &output->debug_touch_points[i], outer, outer, colors[i]);
+
+  for (guint i = 0; i < n; i++)
+    add_touch_point_rect (ctx, &output->debug_touch_points[i], inner, inner, COLOR_TRANSPARENT_WHITE);
+
+  for (guint i = 0; i < n; i++) {
+    add_touch_point_rect (ctx, &output->debug_touch_points[i], long_side, short_side, colors[i]);
+    add_touch_point_rect (ctx, &output->debug_touch_points[i], short_side, long_side, colors[i]);
+  }
+}
+
+
+static void
+damage_touch_points (PhocOutput *output)
+{
+  int size = TOUCH_POINT_SIZE * output->wlr_output->scale;
+  pixman_region32_t region;
+
+  if (G_LIKELY (output->n_debug_touch_points == 0))
+    return;
+
+  pixman_region32_init (&region);
+  for (guint i = 0; i < output->n_debug_touch_points; i++) {
+    struct wlr_box box = phoc_box_from_touch_point (&output->debug_touch_points[i], size, size);
+
+    pixman_region32_union_rect (&region, &region, box.x, box.y, box.width, box.height);
+  }
+  wlr_damage_ring_add (&output->damage_ring, &region);
+  pixman_region32_fini (&region);
+}
+
+static void
+view_render_to_buffer_iterator (struct wlr_surface *surface, int sx, int sy, void *_data)
+{
+  if (!wlr_surface_has_buffer (surface)) {
+    return;
+  }
+
+  PhocServer *server = phoc_server_get_default ();
+  PhocRenderer *self = phoc_server_get_renderer (server);
+  struct wlr_texture *texture = wlr_surface_get_texture (surface);
+
+  struct view_render_data *data = _data;
 
   struct wlr_fbox src_box;
   wlr_surface_get_buffer_source_box (surface, &src_box);
 
-  struct wlr_box dst_box = {
-    .x = sx,
-    .y = sy,
-    .width = surface->current.width,
-    .height = surface->current.height,
-  };
+  struct wlr_box dst_box = {
+    .x = sx,
+    .y = sy,
+    .width = surface->current.width,
+    .height = surface->current.height,
+  };
+
+  float mat[9];
+  wlr_matrix_project_box (mat, &dst_box, wlr_output_transform_invert (surface->current.transform), 0, data->proj);
+  /* Droidian FIXME: handle this in wlroots? */
+  wlr_matrix_project_box (mat, &dst_box, WL_OUTPUT_TRANSFORM_FLIPPED_180, 0, data->proj);
+  wlr_render_subtexture_with_matrix (self->wlr_renderer, texture, &src_box, mat, 1.0);
+}
+
+
+/*
+ * An offscreen render target for view snapshots. Targets are kept
+ * in a pool after use so bursts of thumbnail requests don't hit the
+ * allocator for every view.
+ */
+typedef struct {
+  int32_t                    width, height;
+  /* Render target when the renderer can't render into buffers (android) */
+  GLuint                     tex, fbo;
+  GLint                      gl_format;
+  /* Render target otherwise */
+  struct wlr_buffer         *buffer;
+
+  gint64                     last_used_us;
+} PhocRenderTarget;
+
+#define PHOC_RENDER_TARGET_POOL_MAX 8
+#define PHOC_RENDER_TARGET_MAX_AGE_US (10 * G_USEC_PER_SEC)
+/* Android targets are rounded up to this so similar sizes share them */
+#define PHOC_RENDER_TARGET_BUCKET 64
+
+static struct wlr_egl *get_egl (PhocRenderer *self);
+
+
+static void
+phoc_render_target_free (PhocRenderTarget *rt, struct wlr_egl *egl)
+{
+  if (egl && (rt->fbo || rt->tex)) {
+    if (wlr_egl_make_current (egl)) {
+      glDeleteFramebuffers (1, &rt->fbo);
+      glDeleteTextures (1, &rt->tex);
+      wlr_egl_unset_current (egl);
+    }
+  }
+
+  g_clear_pointer (&rt->buffer, wlr_buffer_drop);
+  g_free (rt);
+}
+
+
+static void
+render_targets_trim (PhocRenderer *self, gint64 max_age_us)
+{
+  gint64 now = g_get_monotonic_time ();
+  struct wlr_egl *egl = get_egl (self);
+
+  for (int i = self->render_targets->len - 1; i >= 0; i--) {
+    PhocRenderTarget *rt = g_ptr_array_index (self->render_targets, i);
+
+    if (now - rt->last_used_us < max_age_us)
+      continue;
+
+    g_ptr_array_remove_index (self->render_targets, i);
+    phoc_render_target_free (rt, egl);
+  }
+}
+
+
+static PhocRenderTarget *
+render_target_create_android (PhocRenderer *self, int32_t width, int32_t height, GLint gl_format)
+{
+  struct wlr_egl *egl = get_egl (self);
+  PhocRenderTarget *rt;
+
+  if (!wlr_egl_make_current (egl))
+    return NULL;
+
+  rt = g_new0 (PhocRenderTarget, 1);
+  rt->width = width;
+  rt->height = height;
+  rt->gl_format = gl_format;
+
+  glGenTextures (1, &rt->tex);
+  glBindTexture (GL_TEXTURE_2D, rt->tex);
+  glTexImage2D (GL_TEXTURE_2D, 0, gl_format, width, height, 0, gl_format, GL_UNSIGNED_BYTE, NULL);
+  glBindTexture (GL_TEXTURE_2D, 0);
+
+  glGenFramebuffers (1, &rt->fbo);
+  glBindFramebuffer (GL_FRAMEBUFFER, rt->fbo);
+  glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rt->tex, 0);
+  glBindFramebuffer (GL_FRAMEBUFFER, 0);
+
+  wlr_egl_unset_current (egl);
+
+  return rt;
+}
+
+
+static PhocRenderTarget *
+render_target_create (PhocRenderer *self, int32_t width, int32_t height)
+{
+  PhocRenderTarget *rt;
+  struct wlr_buffer *buffer;
+
+  g_return_val_if_fail (self->wlr_allocator, NULL);
+
+  struct wlr_drm_format_set fmt_set = {};
+  wlr_drm_format_set_add (&fmt_set, DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_INVALID);
+
+  const struct wlr_drm_format *fmt = wlr_drm_format_set_get (&fmt_set, DRM_FORMAT_ARGB8888);
+
+  buffer = wlr_allocator_create_buffer (self->wlr_allocator, width, height, fmt);
+  wlr_drm_format_set_finish (&fmt_set);
+  if (!buffer)
+    g_return_val_if_reached (NULL);
+
+  rt = g_new0 (PhocRenderTarget, 1);
+  rt->width = width;
+  rt->height = height;
+  rt->buffer = buffer;
+
+  return rt;
+}
+
+/*
+ * Get a render target of at least the given size from the pool or
+ * create a new one. GL framebuffer targets are rendered via
+ * wlr_renderer_begin() so a larger texture works fine there. Buffer
+ * targets set the viewport to the buffer's size so these need an
+ * exact match.
+ */
+static PhocRenderTarget *
+phoc_renderer_acquire_render_target (PhocRenderer *self,
+                                     int32_t       width,
+                                     int32_t       height,
+                                     GLint         gl_format)
+{
+  gboolean gl_target = !(self->caps & PHOC_RENDERER_CAP_BUFFER_TARGETS);
+
+  if (gl_target) {
+    width = (width + PHOC_RENDER_TARGET_BUCKET - 1) / PHOC_RENDER_TARGET_BUCKET * PHOC_RENDER_TARGET_BUCKET;
+    height = (height + PHOC_RENDER_TARGET_BUCKET - 1) / PHOC_RENDER_TARGET_BUCKET * PHOC_RENDER_TARGET_BUCKET;
+  }
+
+  for (guint i = 0; i < self->render_targets->len; i++) {
+    PhocRenderTarget *rt = g_ptr_array_index (self->render_targets, i);
+
+    if (rt->width != width || rt->height != height || rt->gl_format != gl_format)
+      continue;
+
+    return g_ptr_array_steal_index_fast (self->render_targets, i);
+  }
+
+  if (gl_target)
+    return render_target_create_android (self, width, height, gl_format);
+
+  return render_target_create (self, width, height);
+}
+
+
+static void
+phoc_renderer_release_render_target (PhocRenderer *self, PhocRenderTarget *rt)
+{
+  rt->last_used_us = g_get_monotonic_time ();
+  render_targets_trim (self, PHOC_RENDER_TARGET_MAX_AGE_US);
+
+  if (self->render_targets->len >= PHOC_RENDER_TARGET_POOL_MAX) {
+    PhocRenderTarget *oldest = g_ptr_array_steal_index (self->render_targets, 0);
+
+    phoc_render_target_free (oldest, get_egl (self));
+  }
+
+  g_ptr_array_add (self->render_targets, rt);
+}
+
+
+static void
+on_low_memory_warning (PhocRenderer                 *self,
+                       GMemoryMonitorWarningLevel    level,
+                       GMemoryMonitor               *monitor)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocOutput *output;
+
+  g_debug ("Low memory warning (%d), dropping %u render targets and %u scaled textures", level,
+           self->render_targets->len, g_hash_table_size (self->scaled_textures));
+  render_targets_trim (self, 0);
+  g_hash_table_remove_all (self->scaled_textures);
+
+  wl_list_for_each (output, &desktop->outputs, link)
+    phoc_output_set_layer_cache (output, NULL);
+
+  for (GList *l = phoc_desktop_get_views (desktop)->head; l; l = l->next)
+    g_object_set_data (G_OBJECT (l->data), PHOC_VIEW_CACHE_KEY, NULL);
+}
+
+
+/*
+ * A view rendered into the client's buffer. For shm buffers this
+ * goes via an offscreen target that still needs to be read back,
+ * dmabufs are rendered into directly.
+ */
+typedef struct {
+  PhocRenderer              *renderer;
+  struct wlr_buffer         *target;
+  gboolean                   needs_readback;
+
+  /* Offscreen target for shm buffers */
+  PhocRenderTarget          *rt;
+
+  struct wlr_egl            *egl;
+  EGLSyncKHR                 fence;
+  gint64                     start_us;
+} PhocReadback;
+
+#define PHOC_READBACK_TIMEOUT_US (500 * 1000)
+
+static PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR;
+static PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR;
+static PFNEGLCLIENTWAITSYNCKHRPROC eglClientWaitSyncKHR;
+
+
+static struct wlr_egl *
+get_egl (PhocRenderer *self)
+{
+  if (wlr_renderer_is_android (self->wlr_renderer))
+    return wlr_android_renderer_get_egl (self->wlr_renderer);
+
+  if (wlr_renderer_is_gles2 (self->wlr_renderer))
+    return wlr_gles2_renderer_get_egl (self->wlr_renderer);
+
+  return NULL;
+}
+
+static gboolean
+load_fence_procs (EGLDisplay display)
+{
+  const char *exts;
+
+  if (eglCreateSyncKHR)
+    return TRUE;
+
+  exts = eglQueryString (display, EGL_EXTENSIONS);
+  if (exts == NULL || !strstr (exts, "EGL_KHR_fence_sync"))
+    return FALSE;
+
+  eglCreateSyncKHR = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress ("eglCreateSyncKHR");
+  eglDestroySyncKHR = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress ("eglDestroySyncKHR");
+  eglClientWaitSyncKHR = (PFNEGLCLIENTWAITSYNCKHRPROC)eglGetProcAddress ("eglClientWaitSyncKHR");
+  if (!eglCreateSyncKHR || !eglDestroySyncKHR || !eglClientWaitSyncKHR) {
+    eglCreateSyncKHR = NULL;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Must be called with the EGL context current */
+static void
+readback_create_fence (PhocReadback *readback)
+{
+  EGLDisplay display;
+
+  if (readback->egl == NULL)
+    return;
+
+  display = wlr_egl_get_display (readback->egl);
+  if (load_fence_procs (display))
+    readback->fence = eglCreateSyncKHR (display, EGL_SYNC_FENCE_KHR, NULL);
+
+  /* Flush the fence too so it signals when waited on from the readback worker's context */
+  glFlush ();
+}
+
+/* Whether the GPU finished rendering so reading back won't block */
+static gboolean
+readback_is_done (PhocReadback *readback)
+{
+  EGLint ret;
+
+  if (readback->fence == EGL_NO_SYNC_KHR)
+    return TRUE;
+
+  if (g_get_monotonic_time () - readback->start_us > PHOC_READBACK_TIMEOUT_US)
+    return TRUE;
+
+  ret = eglClientWaitSyncKHR (wlr_egl_get_display (readback->egl), readback->fence, 0, 0);
+  return ret != EGL_TIMEOUT_EXPIRED_KHR;
+}
+
+
+static void
+phoc_readback_free (PhocReadback *readback)
+{
+  if (readback->fence != EGL_NO_SYNC_KHR)
+    eglDestroySyncKHR (wlr_egl_get_display (readback->egl), readback->fence);
+
+  if (readback->rt)
+    phoc_renderer_release_render_target (readback->renderer, readback->rt);
+
+  g_clear_pointer (&readback->target, wlr_buffer_unlock);
+  g_free (readback);
+}
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocReadback, phoc_readback_free)
+
+
+static uint32_t
+get_shm_format (struct wlr_buffer *shm_buffer)
+{
+  struct wlr_shm_attributes attribs;
+
+  if (!wlr_buffer_get_shm (shm_buffer, &attribs))
+    return DRM_FORMAT_ARGB8888;
+
+  return attribs.format;
+}
+
+
+/* FIXME: Rework when switching to wlroots 0.18.x git again */
+static gboolean
+render_view_android (PhocRenderer *self, PhocView *view, PhocReadback *readback)
+{
+  EGLint gl_format;
+  int32_t width = readback->target->width;
+  int32_t height = readback->target->height;
+
+  switch (get_shm_format (readback->target)) {
+  case DRM_FORMAT_XRGB8888:
+  case DRM_FORMAT_ARGB8888:
+    gl_format = GL_BGRA_EXT;
+    break;
+  default:
+    gl_format = GL_RGBA;
+    break;
+  }
+
+  readback->rt = phoc_renderer_acquire_render_target (self, width, height, gl_format);
+  if (!readback->rt)
+    return false;
+
+  if (!wlr_egl_make_current (readback->egl))
+    return false;
+
+  struct view_render_data render_data;
+  view_render_data_init (&render_data, view, width, height);
+
+  glBindFramebuffer (GL_FRAMEBUFFER, readback->rt->fbo);
+
+  wlr_renderer_begin (self->wlr_renderer, width, height);
+  wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_TRANSPARENT);
+  wlr_surface_for_each_surface (view->wlr_surface, view_render_to_buffer_iterator, &render_data);
+  wlr_renderer_end (self->wlr_renderer);
+
+  readback_create_fence (readback);
 
-  float mat[9];
-  wlr_matrix_project_box (mat, &dst_box, wlr_output_transform_invert (surface->current.transform), 0, proj);
-  /* Droidian FIXME: handle this in wlroots? */
-  wlr_matrix_project_box (mat, &dst_box, WL_OUTPUT_TRANSFORM_FLIPPED_180, 0, proj);
-  wlr_render_subtexture_with_matrix (self->wlr_renderer, texture, &src_box, mat, 1.0);
+  glBindFramebuffer (GL_FRAMEBUFFER, 0);
+  wlr_egl_unset_current (readback->egl);
+
+  return true;
 }
 
 
-/* FIXME: Rework when switching to wlroots 0.18.x git again */
 static gboolean
-phoc_renderer_render_view_to_buffer_android (PhocRenderer      *self,
-                                             PhocView          *view,
-                                             struct wlr_buffer *shm_buffer)
+read_view_android (PhocRenderer *self, PhocReadback *readback)
 {
-  struct wlr_surface *surface = view->wlr_surface;
+  struct wlr_buffer *shm_buffer = readback->target;
   void *data;
   uint32_t format;
-  EGLint gl_format;
   size_t stride;
-  struct wlr_shm_attributes attribs;
+  gboolean success = false;
+
+  if (!wlr_egl_make_current (readback->egl))
+    return false;
 
-  g_return_val_if_fail (surface, false);
-  g_return_val_if_fail (self->wlr_allocator, false);
-  g_return_val_if_fail (shm_buffer, false);
+  glBindFramebuffer (GL_FRAMEBUFFER, readback->rt->fbo);
 
-  if (!wlr_buffer_get_shm (shm_buffer, &attribs)) {
-    format = DRM_FORMAT_ARGB8888;
-  } else {
-    format = attribs.format;
+  if (wlr_buffer_begin_data_ptr_access (shm_buffer,
+                                        WLR_BUFFER_DATA_PTR_ACCESS_WRITE,
+                                        &data, &format, &stride)) {
+    wlr_renderer_read_pixels (self->wlr_renderer, format, stride,
+                              shm_buffer->width, shm_buffer->height, 0, 0, 0, 0, data);
+    wlr_buffer_end_data_ptr_access (shm_buffer);
+    success = true;
   }
 
-  switch (format) {
-  case DRM_FORMAT_XRGB8888:
-  case DRM_FORMAT_ARGB8888:
-    gl_format = GL_BGRA_EXT;
-    break;
-  default:
-    gl_format = GL_RGBA;
-    break;
-  }
+  glBindFramebuffer (GL_FRAMEBUFFER, 0);
+  wlr_egl_unset_current (readback->egl);
 
-  int32_t width = shm_buffer->width;
-  int32_t height = shm_buffer->height;
+  return success;
+}
 
-  struct wlr_egl *egl = wlr_android_renderer_get_egl (self->wlr_renderer);
-  GLuint tex, fbo;
 
-  if (!surface || !wlr_egl_make_current (egl)) {
-    return false;
+static gboolean
+render_view_to_readback (PhocRenderer *self, PhocView *view, PhocReadback *readback)
+{
+  int32_t width = readback->target->width;
+  int32_t height = readback->target->height;
+  struct wlr_buffer *buffer;
+
+  /* Render into a GL framebuffer if the allocator's buffers can't be used */
+  if (!(self->caps & PHOC_RENDERER_CAP_BUFFER_TARGETS)) {
+    if (!readback->needs_readback)
+      return false;
+
+    return render_view_android (self, view, readback);
   }
 
-  struct view_render_data render_data ={
-    .view = view,
-    .width = width,
-    .height = height
-  };
+  if (readback->needs_readback) {
+    readback->rt = phoc_renderer_acquire_render_target (self, width, height, 0);
+    if (!readback->rt)
+      return false;
+    buffer = readback->rt->buffer;
+  } else {
+    buffer = readback->target;
+  }
 
-  glGenTextures (1, &tex);
-  glBindTexture (GL_TEXTURE_2D, tex);
-  glTexImage2D (GL_TEXTURE_2D, 0, gl_format, width, height, 0, gl_format, GL_UNSIGNED_BYTE, NULL);
-  glBindTexture (GL_TEXTURE_2D, 0);
+  struct view_render_data render_data;
+  view_render_data_init (&render_data, view, width, height);
 
-  glGenFramebuffers (1, &fbo);
-  glBindFramebuffer (GL_FRAMEBUFFER, fbo);
-  glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+  if (!wlr_renderer_begin_with_buffer (self->wlr_renderer, buffer))
+    return false;
 
-  wlr_renderer_begin (self->wlr_renderer, width, height);
   wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_TRANSPARENT);
-  wlr_surface_for_each_surface (surface, view_render_to_buffer_iterator, &render_data);
+  wlr_surface_for_each_surface (view->wlr_surface, view_render_to_buffer_iterator, &render_data);
+  readback_create_fence (readback);
   wlr_renderer_end (self->wlr_renderer);
 
+  return true;
+}
+
+
+static gboolean
+read_view (PhocRenderer *self, PhocReadback *readback)
+{
+  struct wlr_buffer *shm_buffer = readback->target;
+  void *data;
+  uint32_t format;
+  size_t stride;
+
+  /* Rendered into the client's buffer directly, nothing to read back */
+  if (!readback->needs_readback)
+    return true;
+
+  if (!(self->caps & PHOC_RENDERER_CAP_BUFFER_TARGETS))
+    return read_view_android (self, readback);
+
   if (!wlr_buffer_begin_data_ptr_access (shm_buffer,
                                          WLR_BUFFER_DATA_PTR_ACCESS_WRITE,
                                          &data, &format, &stride)) {
     return false;
   }
 
-  wlr_renderer_read_pixels (self->wlr_renderer, format, stride, width, height, 0, 0, 0, 0, data);
+  wlr_renderer_begin_with_buffer (self->wlr_renderer, readback->rt->buffer);
+  wlr_renderer_read_pixels (self->wlr_renderer,
+                            DRM_FORMAT_ARGB8888, stride,
+                            shm_buffer->width, shm_buffer->height, 0, 0, 0, 0, data);
+  wlr_renderer_end (self->wlr_renderer);
 
   wlr_buffer_end_data_ptr_access (shm_buffer);
 
-  glDeleteFramebuffers (1, &fbo);
-  glDeleteTextures (1, &tex);
-  glBindFramebuffer (GL_FRAMEBUFFER, 0);
+  return true;
+}
 
-  wlr_egl_unset_current (egl);
 
-  return true;
+static PhocReadback *
+phoc_readback_new (PhocRenderer *self, struct wlr_buffer *buffer)
+{
+  PhocReadback *readback = g_new0 (PhocReadback, 1);
+  struct wlr_dmabuf_attributes attribs;
+
+  readback->renderer = self;
+  readback->target = wlr_buffer_lock (buffer);
+  readback->needs_readback = !wlr_buffer_get_dmabuf (buffer, &attribs);
+  readback->egl = get_egl (self);
+  readback->fence = EGL_NO_SYNC_KHR;
+  readback->start_us = g_get_monotonic_time ();
+
+  return readback;
+}
+
+/**
+ * phoc_renderer_render_view_to_buffer:
+ * @self: The renderer
+ * @view: The view to render
+ * @buffer: The shm or dmabuf buffer to render into
+ *
+ * Render the view into the given buffer. This blocks until the GPU
+ * finished rendering, see [method@Renderer.render_view_to_buffer_async]
+ * for a non blocking variant.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+phoc_renderer_render_view_to_buffer (PhocRenderer      *self,
+                                     PhocView          *view,
+                                     struct wlr_buffer *buffer)
+{
+  g_autoptr (PhocReadback) readback = NULL;
+
+  g_return_val_if_fail (view->wlr_surface, false);
+  g_return_val_if_fail (buffer, false);
+
+  readback = phoc_readback_new (self, buffer);
+  if (!render_view_to_readback (self, view, readback))
+    return false;
+
+  return read_view (self, readback);
+}
+
+
+static gboolean
+on_readback_poll (gpointer data)
+{
+  GTask *task = G_TASK (data);
+  PhocReadback *readback = g_task_get_task_data (task);
+
+  if (g_task_return_error_if_cancelled (task))
+    return G_SOURCE_REMOVE;
+
+  if (!readback_is_done (readback))
+    return G_SOURCE_CONTINUE;
+
+  if (read_view (readback->renderer, readback)) {
+    g_task_return_boolean (task, TRUE);
+  } else {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "Failed to read back view");
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+copy_to_shm (struct wlr_buffer *shm_buffer, GBytes *pixels)
+{
+  gsize src_stride = (gsize)shm_buffer->width * 4;
+  const guint8 *src;
+  void *data;
+  uint32_t format;
+  size_t stride;
+  gsize size;
+
+  src = g_bytes_get_data (pixels, &size);
+  g_return_val_if_fail (size == src_stride * shm_buffer->height, FALSE);
+
+  if (!wlr_buffer_begin_data_ptr_access (shm_buffer,
+                                         WLR_BUFFER_DATA_PTR_ACCESS_WRITE,
+                                         &data, &format, &stride)) {
+    return FALSE;
+  }
+
+  if (stride == src_stride) {
+    memcpy (data, src, size);
+  } else {
+    for (int y = 0; y < shm_buffer->height; y++)
+      memcpy ((guint8 *)data + y * stride, src + y * src_stride, MIN (stride, src_stride));
+  }
+
+  wlr_buffer_end_data_ptr_access (shm_buffer);
+
+  return TRUE;
+}
+
+
+static void
+on_readback_worker_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  PhocReadbackWorker *worker = PHOC_READBACK_WORKER (source_object);
+  g_autoptr (GTask) task = G_TASK (user_data);
+  PhocReadback *readback = g_task_get_task_data (task);
+  g_autoptr (GBytes) pixels = NULL;
+  GError *err = NULL;
+
+  pixels = phoc_readback_worker_read_finish (worker, res, &err);
+  if (pixels == NULL) {
+    g_task_return_error (task, err);
+    return;
+  }
+
+  if (copy_to_shm (readback->target, pixels)) {
+    g_task_return_boolean (task, TRUE);
+  } else {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "Failed to copy view");
+  }
+}
+
+/**
+ * phoc_renderer_render_view_to_buffer_async:
+ * @self: The renderer
+ * @view: The view to render
+ * @buffer: The shm or dmabuf buffer to render into
+ * @cancellable: (nullable): A cancellable
+ * @callback: The callback to invoke when done
+ * @user_data: The user data for @callback
+ *
+ * Render the view into the given buffer. The rendering commands are
+ * submitted right away but the result is only read back into
+ * a shm @buffer once the GPU signals completion so the main loop isn't
+ * blocked. If the renderer has %PHOC_RENDERER_CAP_THREADED_READBACK the
+ * readback happens on a worker thread and the main loop only copies
+ * the result. A dmabuf @buffer is rendered into directly, the task
+ * completes once the GPU is done with it. @view only needs to
+ * stay alive until this function returns.
+ */
+void
+phoc_renderer_render_view_to_buffer_async (PhocRenderer        *self,
+                                           PhocView            *view,
+                                           struct wlr_buffer   *buffer,
+                                           GCancellable        *cancellable,
+                                           GAsyncReadyCallback  callback,
+                                           gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+  g_autoptr (GSource) source = NULL;
+  PhocReadback *readback;
+
+  g_assert (PHOC_IS_RENDERER (self));
+  g_assert (PHOC_IS_VIEW (view));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, phoc_renderer_render_view_to_buffer_async);
+
+  readback = phoc_readback_new (self, buffer);
+  g_task_set_task_data (task, readback, (GDestroyNotify)phoc_readback_free);
+
+  if (view->wlr_surface == NULL || !render_view_to_readback (self, view, readback)) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "Failed to render view");
+    return;
+  }
+
+  if (readback->needs_readback && self->readback_worker) {
+    phoc_readback_worker_read_async (self->readback_worker,
+                                     readback->rt->buffer,
+                                     get_shm_format (readback->target),
+                                     readback->fence,
+                                     cancellable,
+                                     on_readback_worker_done,
+                                     g_steal_pointer (&task));
+    return;
+  }
+
+  /* Read back from a later main loop iteration once the GPU is done */
+  source = g_timeout_source_new (1);
+  g_source_set_name (source, "[phoc] readback");
+  g_task_attach_source (task, source, on_readback_poll);
+}
+
+
+gboolean
+phoc_renderer_render_view_to_buffer_finish (PhocRenderer  *self,
+                                            GAsyncResult  *res,
+                                            GError       **error)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+  g_assert (g_task_is_valid (res, self));
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+/**
+ * phoc_renderer_can_render_to_dmabuf:
+ * @self: The renderer
+ *
+ * Whether views can be rendered into client provided dmabufs via
+ * [method@Renderer.render_view_to_buffer_async].
+ *
+ * Returns: %TRUE if dmabuf render targets are supported
+ */
+gboolean
+phoc_renderer_can_render_to_dmabuf (PhocRenderer *self)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+
+  return !!(self->caps & PHOC_RENDERER_CAP_DMABUF_TARGETS);
+}
+
+
+static void
+dump_render_list (PhocRenderContext *ctx)
+{
+  GArray *render_list = ctx->render_list;
+
+  g_message ("Render list for %s: %u items", ctx->output->wlr_output->name, render_list->len);
+  for (guint i = 0; i < render_list->len; i++) {
+    PhocRenderItem *item = &g_array_index (render_list, PhocRenderItem, i);
+
+    switch (item->type) {
+    case PHOC_RENDER_ITEM_TEXTURE:
+      g_message ("  %3u: texture %p surface %p src %.1f,%.1f %.1fx%.1f dst %d,%d %dx%d "
+                 "transform %d alpha %.2f%s clip %d rects", i, item->texture, item->surface,
+                 item->src_box.x, item->src_box.y, item->src_box.width, item->src_box.height,
+                 item->dst_box.x, item->dst_box.y, item->dst_box.width, item->dst_box.height,
+                 item->transform, item->alpha,
+                 item->blend_mode == WLR_RENDER_BLEND_MODE_NONE ? " opaque" : "",
+                 pixman_region32_n_rects (&item->clip));
+      break;
+    case PHOC_RENDER_ITEM_BLING:
+      g_message ("  %3u: bling %s %p", i, G_OBJECT_TYPE_NAME (item->bling), item->bling);
+      break;
+    case PHOC_RENDER_ITEM_RECT:
+      g_message ("  %3u: rect %d,%d %dx%d color %.2f,%.2f,%.2f,%.2f clip %d rects", i,
+                 item->dst_box.x, item->dst_box.y, item->dst_box.width, item->dst_box.height,
+                 item->color.r, item->color.g, item->color.b, item->color.a,
+                 pixman_region32_n_rects (&item->clip));
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+  }
+}
+
+/**
+ * submit_render_list:
+ * @ctx: The render context
+ *
+ * Adds the items of the frame's render list to the render pass.
+ */
+static void
+submit_render_list (PhocRenderContext *ctx)
+{
+  PhocOutput *output = ctx->output;
+  enum wlr_scale_filter_mode filter_mode = ctx->tex_filter;
+
+  for (guint i = 0; i < ctx->render_list->len; i++) {
+    PhocRenderItem *item = &g_array_index (ctx->render_list, PhocRenderItem, i);
+
+    switch (item->type) {
+    case PHOC_RENDER_ITEM_TEXTURE:
+      wlr_render_pass_add_texture (ctx->render_pass, &(struct wlr_render_texture_options) {
+          .texture = item->texture,
+          .src_box = item->src_box,
+          .dst_box = item->dst_box,
+          .transform = item->transform,
+          .alpha = &item->alpha,
+          .clip = &item->clip,
+          .filter_mode = filter_mode,
+          .blend_mode = item->blend_mode,
+        });
+      DTRACE_PROBE4 (phoc, render_texture, output->wlr_output->name, item->texture,
+                     item->dst_box.width, item->dst_box.height);
+      ctx->n_textures++;
+      break;
+    case PHOC_RENDER_ITEM_BLING:
+      phoc_bling_render (item->bling, ctx);
+      break;
+    case PHOC_RENDER_ITEM_RECT:
+      wlr_render_pass_add_rect (ctx->render_pass, &(struct wlr_render_rect_options) {
+          .box = item->dst_box,
+          .color = item->color,
+          .clip = &item->clip,
+        });
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+  }
+}
+
+
+static void
+summarize_layer_cache (PhocOutput *output, GArray *summary)
+{
+  PhocRenderSummaryData data = {
+    .ctx = {
+      .output = output,
+      .alpha = 1.0,
+    },
+    .summary = summary,
+    .comparable = TRUE,
+  };
+
+  prepare_context (&data.ctx);
+  g_array_set_size (summary, 0);
+  render_layer (ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND, summarize_surface_iterator, &data.ctx);
+  render_layer (ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM, summarize_surface_iterator, &data.ctx);
+}
+
+
+static void
+render_cache_iterator (PhocOutput         *output,
+                       struct wlr_surface *surface,
+                       struct wlr_box     *box,
+                       float               scale,
+                       void               *data)
+{
+  PhocRenderContext *ctx = data;
+  struct wlr_texture *texture = wlr_surface_get_texture (surface);
+  struct wlr_box dst_box = *box;
+  struct wlr_fbox src_box;
+
+  if (!texture)
+    return;
+
+  wlr_surface_get_buffer_source_box (surface, &src_box);
+  phoc_utils_scale_box (&dst_box, scale * ctx->scale);
+
+  add_texture_item (output, surface, texture, &src_box, &dst_box, &dst_box, NULL,
+                    surface->current.transform, ctx->alpha, WLR_RENDER_BLEND_MODE_PREMULTIPLIED,
+                    ctx);
+}
+
+/*
+ * Composite the background and bottom layers into the output's layer
+ * cache. Invoked from an idle callback so this never happens while a
+ * frame is being built.
+ */
+static void
+update_layer_cache (PhocLayerCache *cache, gpointer data)
+{
+  PhocOutput *output = PHOC_OUTPUT (data);
+  PhocRenderer *self = phoc_server_get_renderer (phoc_server_get_default ());
+  struct wlr_output *wlr_output = output->wlr_output;
+  g_autoptr (GArray) summary = g_array_new (FALSE, FALSE, sizeof (PhocRenderSummaryItem));
+  g_autoptr (GArray) occluded = g_array_new (FALSE, FALSE, sizeof (pixman_region32_t));
+  PhocRenderContext ctx = {
+    .output = output,
+    .alpha = 1.0,
+    .occluded = occluded,
+  };
+  pixman_region32_t damage, opaque;
+  int width, height;
+
+  if (!wlr_output)
+    return;
+
+  prepare_context (&ctx);
+  summarize_layer_cache (output, summary);
+  if (!summary->len)
+    return;
+
+  ctx.render_pass = phoc_layer_cache_begin (cache, wlr_output->width, wlr_output->height);
+  if (!ctx.render_pass)
+    return;
+
+  wlr_output_transformed_resolution (wlr_output, &width, &height);
+  pixman_region32_init_rect (&damage, 0, 0, width, height);
+  ctx.damage = &damage;
+
+  /* Frames using the cache still skip the clear below opaque layers */
+  g_array_set_clear_func (occluded, (GDestroyNotify)pixman_region32_fini);
+  render_layer (ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND, collect_opaque_iterator, &ctx);
+  render_layer (ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM, collect_opaque_iterator, &ctx);
+  pixman_region32_init (&opaque);
+  for (guint i = 0; i < occluded->len; i++)
+    pixman_region32_union (&opaque, &opaque, &g_array_index (occluded, pixman_region32_t, i));
+  ctx.occluded = NULL;
+
+  ctx.render_list = self->render_list;
+  render_layer (ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND, render_cache_iterator, &ctx);
+  render_layer (ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM, render_cache_iterator, &ctx);
+  submit_render_list (&ctx);
+  g_array_set_size (self->render_list, 0);
+
+  if (!phoc_layer_cache_end (cache, ctx.render_pass, summary, &opaque))
+    g_debug ("Failed to update layer cache of %s", wlr_output->name);
+
+  pixman_region32_fini (&opaque);
+  pixman_region32_fini (&damage);
+}
+
+/*
+ * Get the output's layer cache if it's enabled and shows the current
+ * background and bottom layers.
+ */
+static PhocLayerCache *
+get_layer_cache (PhocRenderer *self, PhocOutput *output, PhocRenderContext *ctx)
+{
+  PhocConfig *config = phoc_server_get_config (phoc_server_get_default ());
+  PhocLayerCache *cache;
+
+  if (!config->layer_cache || !(self->caps & PHOC_RENDERER_CAP_BUFFER_TARGETS))
+    return NULL;
+
+  /* The layers aren't rendered below fullscreen views or the lock surface anyway */
+  if (output->fullscreen_view ||
+      phoc_session_lock_is_locked (phoc_desktop_get_session_lock (output->desktop)))
+    return NULL;
+
+  /* Surfaces on planes must not end up in the cache */
+  if (ctx->planes && phoc_output_planes_get_n_assigned (ctx->planes))
+    return NULL;
+
+  summarize_layer_cache (output, self->layer_summary);
+  if (!self->layer_summary->len)
+    return NULL;
+
+  cache = phoc_output_get_layer_cache (output);
+  if (!cache) {
+    cache = phoc_layer_cache_new (self->wlr_renderer, self->wlr_allocator,
+                                  update_layer_cache, output);
+    phoc_output_set_layer_cache (output, cache);
+  }
+
+  if (!phoc_layer_cache_is_valid (cache, self->layer_summary,
+                                  output->wlr_output->width, output->wlr_output->height)) {
+    return NULL;
+  }
+
+  return cache;
+}
+
+
+/*
+ * Summarize the surfaces of @view on @output. @box is set to the area
+ * they cover in transformed output buffer coordinates.
+ *
+ * Returns: %TRUE if the view consists of several surfaces worth caching
+ */
+static gboolean
+summarize_view_cache (PhocOutput *output, PhocView *view, GArray *summary, struct wlr_box *box)
+{
+  PhocRenderSummaryData data = {
+    .ctx = {
+      .output = output,
+      .alpha = 1.0,
+    },
+    .summary = summary,
+    .comparable = TRUE,
+  };
+  int x1 = G_MAXINT, y1 = G_MAXINT, x2 = G_MININT, y2 = G_MININT;
+
+  prepare_context (&data.ctx);
+  g_array_set_size (summary, 0);
+  phoc_output_view_for_each_surface (output, view, summarize_surface_iterator, &data.ctx);
+  if (!data.comparable || summary->len < 2)
+    return FALSE;
+
+  for (guint i = 0; i < summary->len; i++) {
+    PhocRenderSummaryItem *item = &g_array_index (summary, PhocRenderSummaryItem, i);
+
+    x1 = MIN (x1, item->dst_box.x);
+    y1 = MIN (y1, item->dst_box.y);
+    x2 = MAX (x2, item->dst_box.x + item->dst_box.width);
+    y2 = MAX (y2, item->dst_box.y + item->dst_box.height);
+  }
+
+  *box = (struct wlr_box) { .x = x1, .y = y1, .width = x2 - x1, .height = y2 - y1 };
+  phoc_output_transform_box (output, box);
+
+  return !wlr_box_empty (box);
+}
+
+/*
+ * Composite the surfaces of a view into its cache. Invoked from an
+ * idle callback so this never happens while a frame is being built.
+ */
+static void
+update_view_cache (PhocViewCache *cache, gpointer data)
+{
+  PhocView *view = PHOC_VIEW (data);
+  PhocOutput *output = phoc_view_cache_get_output (cache);
+  PhocRenderer *self = phoc_server_get_renderer (phoc_server_get_default ());
+  g_autoptr (GArray) summary = g_array_new (FALSE, FALSE, sizeof (PhocRenderSummaryItem));
+  g_autoptr (GArray) occluded = g_array_new (FALSE, FALSE, sizeof (pixman_region32_t));
+  PhocRenderContext ctx = {
+    .output = output,
+    .alpha = 1.0,
+    .occluded = occluded,
+  };
+  pixman_region32_t damage, opaque;
+  struct wlr_box box;
+  int width, height;
+
+  if (!output || !output->wlr_output || !phoc_view_is_mapped (view))
+    return;
+
+  prepare_context (&ctx);
+  if (!summarize_view_cache (output, view, summary, &box))
+    return;
+
+  ctx.render_pass = phoc_view_cache_begin (cache, &box);
+  if (!ctx.render_pass)
+    return;
+
+  wlr_output_transformed_resolution (output->wlr_output, &width, &height);
+  pixman_region32_init_rect (&damage, 0, 0, width, height);
+  ctx.damage = &damage;
+
+  g_array_set_clear_func (occluded, (GDestroyNotify)pixman_region32_fini);
+  phoc_output_view_for_each_surface (output, view, collect_opaque_iterator, &ctx);
+  pixman_region32_init (&opaque);
+  for (guint i = 0; i < occluded->len; i++)
+    pixman_region32_union (&opaque, &opaque, &g_array_index (occluded, pixman_region32_t, i));
+  ctx.occluded = NULL;
+
+  ctx.render_list = self->render_list;
+  phoc_output_view_for_each_surface (output, view, render_cache_iterator, &ctx);
+  /* The cache's origin is at the view's origin in the output's buffer */
+  for (guint i = 0; i < self->render_list->len; i++) {
+    PhocRenderItem *item = &g_array_index (self->render_list, PhocRenderItem, i);
+
+    item->dst_box.x -= box.x;
+    item->dst_box.y -= box.y;
+    pixman_region32_translate (&item->clip, -box.x, -box.y);
+  }
+  submit_render_list (&ctx);
+  g_array_set_size (self->render_list, 0);
+
+  if (!phoc_view_cache_end (cache, ctx.render_pass, summary, &opaque))
+    g_debug ("Failed to update view cache of %p", view);
+
+  pixman_region32_fini (&opaque);
+  pixman_region32_fini (&damage);
 }
 
-gboolean
-phoc_renderer_render_view_to_buffer (PhocRenderer      *self,
-                                     PhocView          *view,
-                                     struct wlr_buffer *shm_buffer)
+/*
+ * Look up the views on the output whose cache shows their current
+ * surfaces. Invoked once per frame so the caches can tell for how many
+ * frames their view didn't change. Views outside of the frame's damage
+ * aren't drawn so they're not summarized either.
+ */
+static GHashTable *
+get_view_caches (PhocRenderer *self, PhocOutput *output, PhocRenderContext *ctx)
 {
-  /* Do not use wlr_allocator on android */
-  if (wlr_renderer_is_android(self->wlr_renderer))
-    return phoc_renderer_render_view_to_buffer_android (self, view, shm_buffer);
+  PhocConfig *config = phoc_server_get_config (phoc_server_get_default ());
+  PhocDesktop *desktop = PHOC_DESKTOP (output->desktop);
 
-  struct wlr_surface *surface = view->wlr_surface;
-  struct wlr_buffer *buffer;
-  void *data;
-  uint32_t format;
-  size_t stride;
+  if (!config->view_cache_frames || !(self->caps & PHOC_RENDERER_CAP_BUFFER_TARGETS))
+    return NULL;
 
-  g_return_val_if_fail (surface, false);
-  g_return_val_if_fail (self->wlr_allocator, false);
-  g_return_val_if_fail (shm_buffer, false);
+  /* Only the lock surface is rendered while locked */
+  if (phoc_session_lock_is_locked (phoc_desktop_get_session_lock (desktop)))
+    return NULL;
 
-  int32_t width = shm_buffer->width;
-  int32_t height = shm_buffer->height;
+  /* Surfaces on planes must not end up in a cache */
+  if (ctx->planes && phoc_output_planes_get_n_assigned (ctx->planes))
+    return NULL;
 
-  struct wlr_drm_format_set fmt_set = {};
-  wlr_drm_format_set_add (&fmt_set, DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_INVALID);
+  g_hash_table_remove_all (self->view_caches);
+  for (GList *l = phoc_desktop_get_views (desktop)->head; l; l = l->next) {
+    PhocView *view = PHOC_VIEW (l->data);
+    const PhocViewRenderState *state = phoc_view_get_render_state (view);
+    PhocViewCache *cache;
+    struct wlr_box view_box, box;
 
-  const struct wlr_drm_format *fmt = wlr_drm_format_set_get (&fmt_set, DRM_FORMAT_ARGB8888);
+    if (!phoc_view_is_mapped (view) || !phoc_desktop_view_is_visible (desktop, view))
+      continue;
 
-  buffer = wlr_allocator_create_buffer (self->wlr_allocator, width, height, fmt);
-  if (!buffer) {
-    wlr_drm_format_set_finish (&fmt_set);
-    g_return_val_if_reached (false);
-  }
+    if (output->fullscreen_view && output->fullscreen_view != view)
+      continue;
 
-  struct view_render_data render_data = {
-    .view = view,
-    .width = width,
-    .height = height
-  };
+    if (state->fullscreen_output && state->fullscreen_output != output)
+      continue;
 
-  wlr_renderer_begin_with_buffer (self->wlr_renderer, buffer);
-  wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_TRANSPARENT);
-  wlr_surface_for_each_surface (surface, view_render_to_buffer_iterator, &render_data);
+    /* Caching a translucent view would change how its surfaces blend */
+    if (state->alpha < 1.0f)
+      continue;
 
-  if (!wlr_buffer_begin_data_ptr_access (shm_buffer,
-                                         WLR_BUFFER_DATA_PTR_ACCESS_WRITE,
-                                         &data, &format, &stride)) {
-    return false;
-  }
+    /* The cache is bound to a single output */
+    phoc_view_get_box (view, &view_box);
+    if (view_box.x < output->layout_box.x || view_box.y < output->layout_box.y ||
+        view_box.x + view_box.width > output->layout_box.x + output->layout_box.width ||
+        view_box.y + view_box.height > output->layout_box.y + output->layout_box.height) {
+      continue;
+    }
 
-  wlr_renderer_read_pixels (self->wlr_renderer,
-                            DRM_FORMAT_ARGB8888, stride, width, height, 0, 0, 0, 0, data);
-  wlr_renderer_end (self->wlr_renderer);
+    /* Nothing to draw, no need to look at the view's surfaces */
+    box = view_box;
+    box.x -= output->lx;
+    box.y -= output->ly;
+    phoc_utils_scale_box (&box, ctx->scale);
+    if (pixman_region32_contains_rectangle (ctx->damage, &(pixman_box32_t) {
+          .x1 = box.x,
+          .y1 = box.y,
+          .x2 = box.x + box.width,
+          .y2 = box.y + box.height,
+        }) == PIXMAN_REGION_OUT) {
+      continue;
+    }
 
-  wlr_buffer_drop (buffer);
-  wlr_drm_format_set_finish (&fmt_set);
+    if (!summarize_view_cache (output, view, self->view_summary, &box))
+      continue;
 
-  wlr_buffer_end_data_ptr_access (shm_buffer);
+    cache = g_object_get_data (G_OBJECT (view), PHOC_VIEW_CACHE_KEY);
+    if (!cache) {
+      cache = phoc_view_cache_new (self->wlr_renderer, self->wlr_allocator,
+                                   update_view_cache, view);
+      g_object_set_data_full (G_OBJECT (view), PHOC_VIEW_CACHE_KEY, cache,
+                              (GDestroyNotify)phoc_view_cache_free);
+    }
 
-  return true;
+    if (phoc_view_cache_is_valid (cache, output, self->view_summary, config->view_cache_frames))
+      g_hash_table_insert (self->view_caches, view, cache);
+  }
+
+  return g_hash_table_size (self->view_caches) ? self->view_caches : NULL;
 }
 
 
@@ -657,6 +2628,29 @@ render_damage (PhocRenderer *self, PhocRenderContext *ctx)
 }
 
 
+static void
+run_render_hooks (PhocRenderer *self, PhocRenderContext *ctx)
+{
+  self->running_render_hooks = TRUE;
+  for (guint i = 0; i < self->render_hooks->len; i++) {
+    PhocRenderHook *hook = &g_array_index (self->render_hooks, PhocRenderHook, i);
+
+    if (!hook->func || (hook->output && hook->output != ctx->output))
+      continue;
+
+    hook->func (ctx, hook->user_data);
+  }
+  self->running_render_hooks = FALSE;
+
+  /* Drop the hooks removed while running */
+  for (guint i = self->render_hooks->len; self->n_removed_render_hooks && i > 0; i--) {
+    if (!g_array_index (self->render_hooks, PhocRenderHook, i - 1).func) {
+      g_array_remove_index (self->render_hooks, i - 1);
+      self->n_removed_render_hooks--;
+    }
+  }
+}
+
 /**
  * phoc_renderer_render_output:
  * @self: The renderer
@@ -668,86 +2662,160 @@ render_damage (PhocRenderer *self, PhocRenderContext *ctx)
 void
 phoc_renderer_render_output (PhocRenderer *self, PhocOutput *output, PhocRenderContext *ctx)
 {
-  PhocServer *server = phoc_server_get_default ();
   struct wlr_output *wlr_output = output->wlr_output;
-  PhocDesktop *desktop = PHOC_DESKTOP (output->desktop);
   pixman_region32_t *damage = ctx->damage;
-  pixman_region32_t transformed_damage;
+  pixman_region32_t buffer_damage, transformed_damage, opaque;
 
   g_assert (PHOC_IS_RENDERER (self));
 
+  prepare_context (ctx);
+  pixman_region32_init (&buffer_damage);
   pixman_region32_init (&transformed_damage);
+  pixman_region32_init (&opaque);
+  ctx->culled_pixels = 0;
+
+  /* Transformed once so items only need to transform their boxes */
+  pixman_region32_copy (&buffer_damage, damage);
+  phoc_output_transform_damage (output, &buffer_damage);
+  ctx->buffer_damage = &buffer_damage;
 
   if (!pixman_region32_not_empty (damage)) {
     // Output isn't damaged but needs buffer swap
     goto renderer_end;
   }
 
-  pixman_region32_copy (&transformed_damage, damage);
-  phoc_output_transform_damage (output, &transformed_damage);
-  wlr_output_handle_damage(wlr_output, &transformed_damage);
-
-  wlr_render_pass_add_rect (ctx->render_pass,
-                            &(struct wlr_render_rect_options){
-                              .box = { .width = wlr_output->width, .height = wlr_output->height },
-                              .color = COLOR_BLACK,
-                              .clip = &transformed_damage,
-                            });
-
-  // If a view is fullscreen on this output, render it
-  if (output->fullscreen_view != NULL) {
-    PhocView *view = output->fullscreen_view;
+  wlr_output_handle_damage(wlr_output, &buffer_damage);
 
-    render_view (output, view, ctx);
+  ctx->layer_cache = get_layer_cache (self, output, ctx);
+  ctx->view_caches = get_view_caches (self, output, ctx);
+  compute_occlusion (self, output, ctx, &opaque);
+  if (ctx->occluded_surfaces)
+    g_hash_table_remove_all (ctx->occluded_surfaces);
 
-    // During normal rendering the xwayland window tree isn't traversed
-    // because all windows are rendered. Here we only want to render
-    // the fullscreen window's children so we have to traverse the tree.
-#ifdef PHOC_XWAYLAND
-    if (PHOC_IS_XWAYLAND_SURFACE (view)) {
-      struct wlr_xwayland_surface *xsurface =
-        phoc_xwayland_surface_get_wlr_surface (PHOC_XWAYLAND_SURFACE (view));
-      phoc_output_xwayland_children_for_each_surface (output,
-                                                      xsurface,
-                                                      render_surface_iterator,
-                                                      ctx);
-    }
-#endif
+  /* Only clear what isn't covered by opaque surfaces */
+  pixman_region32_subtract (&transformed_damage, damage, &opaque);
+  phoc_output_transform_damage (output, &transformed_damage);
+  if (pixman_region32_not_empty (&transformed_damage)) {
+    wlr_render_pass_add_rect (ctx->render_pass,
+                              &(struct wlr_render_rect_options){
+                                .box = { .width = wlr_output->width, .height = wlr_output->height },
+                                .color = COLOR_BLACK,
+                                .clip = &transformed_damage,
+                              });
+  }
 
-    if (phoc_output_has_shell_revealed (output)) {
-      // Render top layer above fullscreen view when requested
-      render_layer (ZWLR_LAYER_SHELL_V1_LAYER_TOP, ctx);
-    }
-  } else {
-    // Render background and bottom layers under views
-    render_layer (ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND, ctx);
-    render_layer (ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM, ctx);
+  /* Build the render list… */
+  ctx->surface_idx = 0;
+  ctx->render_list = self->render_list;
+  render_surfaces (output, render_surface_iterator, ctx);
+  ctx->occluded = NULL;
+  g_array_set_size (self->occluded, 0);
+  ctx->surface_opaque = NULL;
+  g_array_set_size (self->surface_opaque, 0);
 
-    /* Render all views */
-    for (GList *l = phoc_desktop_get_views (desktop)->tail; l; l = l->prev) {
-      PhocView *view = PHOC_VIEW (l->data);
+  if (G_UNLIKELY (ctx->debug.render_list))
+    dump_render_list (ctx);
 
-      if (phoc_desktop_view_is_visible (desktop, view))
-        render_view (output, view, ctx);
-    }
-    // Render top layer above views
-    render_layer (ZWLR_LAYER_SHELL_V1_LAYER_TOP, ctx);
-  }
-  render_drag_icons (phoc_server_get_input (server), ctx);
+  /* …and submit it */
+  submit_render_list (ctx);
+  ctx->render_list = NULL;
+  ctx->layer_cache = NULL;
+  ctx->view_caches = NULL;
+  g_array_set_size (self->render_list, 0);
 
-  render_layer (ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, ctx);
+  DTRACE_PROBE2 (phoc, render_culled, wlr_output->name, ctx->culled_pixels);
 
  renderer_end:
+  pixman_region32_fini (&opaque);
   pixman_region32_fini (&transformed_damage);
   wlr_output_add_software_cursors_to_render_pass (wlr_output, ctx->render_pass, damage);
 
   render_touch_points (ctx);
-  g_signal_emit (self, signals[RENDER_END], 0, ctx);
-  if (G_UNLIKELY (phoc_server_check_debug_flags (server,PHOC_SERVER_DEBUG_FLAG_DAMAGE_TRACKING)))
+  run_render_hooks (self, ctx);
+  if (G_UNLIKELY (ctx->debug.damage_tracking))
     render_damage (self, ctx);
+  if (G_UNLIKELY (ctx->debug.damage_heatmap && phoc_output_get_damage_heatmap (output)))
+    phoc_damage_heatmap_render (phoc_output_get_damage_heatmap (output), ctx);
 
   damage_touch_points (output);
-  g_clear_list (&output->debug_touch_points, g_free);
+  output->n_debug_touch_points = 0;
+
+  ctx->buffer_damage = NULL;
+  pixman_region32_fini (&buffer_damage);
+}
+
+
+static const char *
+get_renderer_name (struct wlr_renderer *wlr_renderer)
+{
+  if (wlr_renderer_is_android (wlr_renderer))
+    return "android";
+
+  if (wlr_renderer_is_gles2 (wlr_renderer))
+    return "gles2";
+
+#if WLR_HAS_VULKAN_RENDERER
+  if (wlr_renderer_is_vk (wlr_renderer))
+    return "vulkan";
+#endif
+
+  if (wlr_renderer_is_pixman (wlr_renderer))
+    return "pixman";
+
+  return "unknown";
+}
+
+
+static gboolean
+gl_has_extension (struct wlr_egl *egl, const char *extension)
+{
+  const char *exts;
+  gboolean found;
+
+  if (!wlr_egl_make_current (egl))
+    return FALSE;
+
+  exts = (const char *)glGetString (GL_EXTENSIONS);
+  found = exts && strstr (exts, extension);
+  wlr_egl_unset_current (egl);
+
+  return found;
+}
+
+/*
+ * Query what the renderer can do once so GL specific code paths are
+ * only taken for GL based renderers and e.g. the Vulkan renderer
+ * selected via WLR_RENDERER=vulkan never hits a GL call.
+ */
+static PhocRendererCaps
+detect_caps (PhocRenderer *self)
+{
+  PhocRendererCaps caps = PHOC_RENDERER_CAP_NONE;
+  struct wlr_egl *egl = get_egl (self);
+
+  if (egl) {
+    caps |= PHOC_RENDERER_CAP_EGL;
+    if (gl_has_extension (egl, "GL_EXT_read_format_bgra"))
+      caps |= PHOC_RENDERER_CAP_READ_BGRA;
+  } else {
+    /* Vulkan and pixman read back in any format they can render */
+    caps |= PHOC_RENDERER_CAP_READ_BGRA;
+  }
+
+  if (wlr_renderer_is_pixman (self->wlr_renderer))
+    caps |= PHOC_RENDERER_CAP_SOFTWARE;
+
+  if (wlr_renderer_is_android (self->wlr_renderer)) {
+    /* Renders via the Android EGL surface, not via allocated buffers */
+    caps |= PHOC_RENDERER_CAP_QUERY_BUFFER_AGE;
+    return caps;
+  }
+
+  caps |= PHOC_RENDERER_CAP_BUFFER_TARGETS;
+  if (wlr_renderer_get_dmabuf_texture_formats (self->wlr_renderer))
+    caps |= PHOC_RENDERER_CAP_DMABUF_TARGETS;
+
+  return caps;
 }
 
 
@@ -775,6 +2843,22 @@ phoc_renderer_initable_init (GInitable    *initable,
     return FALSE;
   }
 
+  self->caps = detect_caps (self);
+  self->raster_pool = phoc_raster_pool_new (self->wlr_renderer);
+
+  /* Only buffer targets can be shared with the worker as dmabufs */
+  if ((self->caps & PHOC_RENDERER_CAP_EGL) && (self->caps & PHOC_RENDERER_CAP_BUFFER_TARGETS)) {
+    self->readback_worker = phoc_readback_worker_new (get_egl (self));
+    if (self->readback_worker)
+      self->caps |= PHOC_RENDERER_CAP_THREADED_READBACK;
+  }
+
+  g_info ("Using %s renderer, caps 0x%x", get_renderer_name (self->wlr_renderer), self->caps);
+
+  self->memory_monitor = g_memory_monitor_dup_default ();
+  g_signal_connect_swapped (self->memory_monitor, "low-memory-warning",
+                            G_CALLBACK (on_low_memory_warning), self);
+
   return TRUE;
 }
 
@@ -784,6 +2868,25 @@ phoc_renderer_finalize (GObject *object)
 {
   PhocRenderer *self = PHOC_RENDERER (object);
 
+  g_clear_pointer (&self->occluded, g_array_unref);
+  g_clear_pointer (&self->surface_opaque, g_array_unref);
+  g_clear_pointer (&self->render_list, g_array_unref);
+  g_clear_pointer (&self->layer_summary, g_array_unref);
+  g_clear_pointer (&self->view_summary, g_array_unref);
+  g_clear_pointer (&self->view_caches, g_hash_table_destroy);
+  g_clear_pointer (&self->render_hooks, g_array_unref);
+  g_clear_pointer (&self->view_snapshots, g_ptr_array_unref);
+  if (self->memory_monitor)
+    g_signal_handlers_disconnect_by_data (self->memory_monitor, self);
+  g_clear_object (&self->memory_monitor);
+  render_targets_trim (self, 0);
+  g_clear_pointer (&self->render_targets, g_ptr_array_unref);
+  g_clear_pointer (&self->scaled_textures, g_hash_table_destroy);
+  /* Pending readbacks may keep the worker alive past the EGL display */
+  if (self->readback_worker)
+    phoc_readback_worker_shutdown (self->readback_worker);
+  g_clear_object (&self->readback_worker);
+  g_clear_object (&self->raster_pool);
   g_clear_pointer (&self->wlr_allocator, wlr_allocator_destroy);
   g_clear_pointer (&self->wlr_renderer, wlr_renderer_destroy);
 
@@ -820,26 +2923,28 @@ phoc_renderer_class_init (PhocRendererClass *klass)
 
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 
-  /**
-   * PhocRenderer::render-end
-   * @self: The renderer emitting the signal
-   * @output: The output being rendered on
-   *
-   * This signal is emitted at the end of a render pass
-   */
-  signals[RENDER_END] = g_signal_new ("render-end",
-                                      G_TYPE_FROM_CLASS (klass),
-                                      G_SIGNAL_RUN_LAST,
-                                      0, NULL, NULL, NULL,
-                                      G_TYPE_NONE, 1,
-                                      /* PhocRenderContext: */
-                                      G_TYPE_POINTER);
 }
 
 
 static void
 phoc_renderer_init (PhocRenderer *self)
 {
+  self->occluded = g_array_new (FALSE, FALSE, sizeof (pixman_region32_t));
+  g_array_set_clear_func (self->occluded, (GDestroyNotify)pixman_region32_fini);
+  self->surface_opaque = g_array_new (FALSE, FALSE, sizeof (pixman_region32_t));
+  g_array_set_clear_func (self->surface_opaque, (GDestroyNotify)pixman_region32_fini);
+  self->render_list = g_array_new (FALSE, FALSE, sizeof (PhocRenderItem));
+  g_array_set_clear_func (self->render_list, (GDestroyNotify)render_item_clear);
+  self->layer_summary = g_array_new (FALSE, FALSE, sizeof (PhocRenderSummaryItem));
+  self->view_summary = g_array_new (FALSE, FALSE, sizeof (PhocRenderSummaryItem));
+  self->view_caches = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->render_targets = g_ptr_array_new ();
+  self->render_hooks = g_array_new (FALSE, FALSE, sizeof (PhocRenderHook));
+  self->view_snapshots = g_ptr_array_new ();
+  self->scaled_textures = g_hash_table_new_full (g_direct_hash,
+                                                 g_direct_equal,
+                                                 NULL,
+                                                 (GDestroyNotify)phoc_scaled_texture_free);
 }
 
 
@@ -868,3 +2973,271 @@ phoc_renderer_get_wlr_allocator (PhocRenderer *self)
 
   return self->wlr_allocator;
 }
+
+/**
+ * phoc_renderer_get_raster_pool:
+ * @self: The renderer
+ *
+ * Gets the pool to draw CPU rasterized overlay textures off the main
+ * thread.
+ *
+ * Returns: (transfer none): The raster pool
+ */
+PhocRasterPool *
+phoc_renderer_get_raster_pool (PhocRenderer *self)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+
+  return self->raster_pool;
+}
+
+/**
+ * phoc_renderer_add_render_hook:
+ * @self: The renderer
+ * @output:(nullable): Only run the hook when rendering this output
+ * @order: Where to draw relative to other hooks, lower ones are drawn first
+ * @func: The function drawing on top of the output's content
+ * @user_data: Data passed to @func
+ *
+ * Adds a hook that draws at the end of the render pass of @output or
+ * of every output if @output is %NULL. Hooks of the same order are run
+ * in the order they were added. Hooks can't be added from within a
+ * hook.
+ *
+ * Returns: The hook's id for [method@Renderer.remove_render_hook]
+ */
+guint
+phoc_renderer_add_render_hook (PhocRenderer       *self,
+                               PhocOutput         *output,
+                               gint                order,
+                               PhocRenderHookFunc  func,
+                               gpointer            user_data)
+{
+  PhocRenderHook hook = {
+    .id = ++self->last_render_hook_id,
+    .output = output,
+    .order = order,
+    .func = func,
+    .user_data = user_data,
+  };
+  guint i;
+
+  g_assert (PHOC_IS_RENDERER (self));
+  g_assert (func);
+  g_assert (!self->running_render_hooks);
+
+  for (i = 0; i < self->render_hooks->len; i++) {
+    if (g_array_index (self->render_hooks, PhocRenderHook, i).order > order)
+      break;
+  }
+  g_array_insert_val (self->render_hooks, i, hook);
+
+  return hook.id;
+}
+
+/**
+ * phoc_renderer_remove_render_hook:
+ * @self: The renderer
+ * @id: The hook's id
+ *
+ * Removes a hook added via [method@Renderer.add_render_hook].
+ */
+void
+phoc_renderer_remove_render_hook (PhocRenderer *self, guint id)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+
+  for (guint i = 0; i < self->render_hooks->len; i++) {
+    PhocRenderHook *hook = &g_array_index (self->render_hooks, PhocRenderHook, i);
+
+    if (hook->id != id)
+      continue;
+
+    /* Don't shift hooks that are being iterated over */
+    if (self->running_render_hooks) {
+      hook->func = NULL;
+      self->n_removed_render_hooks++;
+    } else {
+      g_array_remove_index (self->render_hooks, i);
+    }
+    return;
+  }
+
+  g_critical ("No render hook with id %u", id);
+}
+
+/**
+ * phoc_renderer_has_render_hooks:
+ * @self: The renderer
+ * @output: The output
+ *
+ * Returns: %TRUE if hooks draw on top of @output's content
+ */
+gboolean
+phoc_renderer_has_render_hooks (PhocRenderer *self, PhocOutput *output)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+
+  for (guint i = 0; i < self->render_hooks->len; i++) {
+    PhocRenderHook *hook = &g_array_index (self->render_hooks, PhocRenderHook, i);
+
+    if (hook->func && (!hook->output || hook->output == output))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/**
+ * phoc_renderer_add_view_snapshot:
+ * @self: The renderer
+ * @snapshot: The snapshot of a closing view
+ *
+ * Draws @snapshot on its output where the captured view was in the
+ * stack of views until it's removed again via
+ * [method@Renderer.remove_view_snapshot]. The renderer doesn't take a
+ * reference.
+ */
+void
+phoc_renderer_add_view_snapshot (PhocRenderer *self, PhocViewSnapshot *snapshot)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+  g_assert (PHOC_IS_VIEW_SNAPSHOT (snapshot));
+
+  g_ptr_array_add (self->view_snapshots, snapshot);
+}
+
+/**
+ * phoc_renderer_remove_view_snapshot:
+ * @self: The renderer
+ * @snapshot: The snapshot to remove
+ *
+ * Stops drawing a snapshot added via [method@Renderer.add_view_snapshot].
+ */
+void
+phoc_renderer_remove_view_snapshot (PhocRenderer *self, PhocViewSnapshot *snapshot)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+
+  if (!g_ptr_array_remove (self->view_snapshots, snapshot))
+    g_critical ("View snapshot %p not drawn", snapshot);
+}
+
+/**
+ * phoc_renderer_has_view_snapshots:
+ * @self: The renderer
+ * @output: (nullable): The output or %NULL for any output
+ *
+ * Returns: %TRUE if snapshots of closing views are drawn on @output
+ */
+gboolean
+phoc_renderer_has_view_snapshots (PhocRenderer *self, PhocOutput *output)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+
+  for (guint i = 0; i < self->view_snapshots->len; i++) {
+    PhocViewSnapshot *snapshot = g_ptr_array_index (self->view_snapshots, i);
+
+    if (!output || phoc_view_snapshot_get_output (snapshot) == output)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/**
+ * phoc_renderer_get_scaled_texture:
+ * @self: The renderer
+ * @surface: The surface
+ * @output: The output
+ *
+ * Returns:(transfer none)(nullable): The up to date downscaled copy of
+ *   @surface's texture used on @output
+ */
+struct wlr_texture *
+phoc_renderer_get_scaled_texture (PhocRenderer *self, struct wlr_surface *surface, PhocOutput *output)
+{
+  PhocScaledTexture *scaled;
+
+  g_assert (PHOC_IS_RENDERER (self));
+
+  scaled = g_hash_table_lookup (self->scaled_textures, surface);
+  if (!scaled)
+    return NULL;
+
+  return phoc_scaled_texture_peek (scaled, output);
+}
+
+/**
+ * phoc_renderer_get_view_cache_texture:
+ * @self: The renderer
+ * @view: The view
+ *
+ * Returns:(transfer none)(nullable): The texture @view's surfaces are
+ *   composited into if it's up to date
+ */
+struct wlr_texture *
+phoc_renderer_get_view_cache_texture (PhocRenderer *self, PhocView *view)
+{
+  PhocViewCache *cache;
+
+  g_assert (PHOC_IS_RENDERER (self));
+
+  cache = g_object_get_data (G_OBJECT (view), PHOC_VIEW_CACHE_KEY);
+  if (!cache)
+    return NULL;
+
+  return phoc_view_cache_get_texture (cache);
+}
+
+/**
+ * phoc_renderer_get_caps:
+ * @self: The renderer
+ *
+ * Gets the renderer's capabilities. Use these instead of checking
+ * for a particular renderer type.
+ *
+ * Returns: The renderer's capabilities
+ */
+PhocRendererCaps
+phoc_renderer_get_caps (PhocRenderer *self)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+
+  return self->caps;
+}
+
+/**
+ * phoc_renderer_get_preferred_read_format:
+ * @self: The renderer
+ *
+ * Gets the DRM format pixels can be read back in most efficiently.
+ *
+ * Returns: The DRM format
+ */
+uint32_t
+phoc_renderer_get_preferred_read_format (PhocRenderer *self)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+
+  if (self->caps & PHOC_RENDERER_CAP_READ_BGRA)
+    return DRM_FORMAT_ARGB8888;
+
+  return DRM_FORMAT_ABGR8888;
+}
+
+/**
+ * phoc_renderer_get_egl:
+ * @self: The renderer
+ *
+ * Gets the EGL context of GL based renderers.
+ *
+ * Returns:(transfer none)(nullable): The EGL context
+ */
+struct wlr_egl *
+phoc_renderer_get_egl (PhocRenderer *self)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+
+  return get_egl (self);
+}
@@ -5,9 +5,11 @@
  */
 #pragma once
 
-#include <glib-object.h>
+#include <gio/gio.h>
 
+#include <wlr/render/egl.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_compositor.h>
 
 G_BEGIN_DECLS
 
@@ -17,16 +19,94 @@ G_DECLARE_FINAL_TYPE (PhocRenderer, phoc_renderer, PHOC, RENDERER, GObject)
 
 typedef struct _PhocOutput PhocOutput;
 typedef struct _PhocView PhocView;
+typedef struct _PhocOutputPlanes PhocOutputPlanes;
+typedef struct _PhocInputLatency PhocInputLatency;
+typedef struct _PhocLayerCache PhocLayerCache;
+typedef struct _PhocInput PhocInput;
+typedef struct _PhocViewSnapshot PhocViewSnapshot;
+
+/**
+ * PhocRendererCaps:
+ * @PHOC_RENDERER_CAP_NONE: No optional capabilities
+ * @PHOC_RENDERER_CAP_EGL: The renderer is EGL based so GL calls can be made
+ *   with its context current
+ * @PHOC_RENDERER_CAP_BUFFER_TARGETS: The renderer can render into buffers
+ *   from the allocator. If not, offscreen rendering needs GL framebuffers.
+ * @PHOC_RENDERER_CAP_DMABUF_TARGETS: Client dmabufs can be rendered into
+ * @PHOC_RENDERER_CAP_QUERY_BUFFER_AGE: The buffer age of swapchain buffers
+ *   must be queried from the renderer
+ * @PHOC_RENDERER_CAP_READ_BGRA: Pixels can be read back in BGRA order
+ * @PHOC_RENDERER_CAP_THREADED_READBACK: Offscreen rendered views are read
+ *   back on a worker thread
+ * @PHOC_RENDERER_CAP_SOFTWARE: The renderer composites on the CPU so
+ *   every painted or blended pixel costs more than an extra draw call
+ *
+ * Capabilities of the renderer picked at startup so code doesn't
+ * need to check for particular renderer types.
+ */
+typedef enum {
+  PHOC_RENDERER_CAP_NONE              = 0,
+  PHOC_RENDERER_CAP_EGL               = 1 << 0,
+  PHOC_RENDERER_CAP_BUFFER_TARGETS    = 1 << 1,
+  PHOC_RENDERER_CAP_DMABUF_TARGETS    = 1 << 2,
+  PHOC_RENDERER_CAP_QUERY_BUFFER_AGE  = 1 << 3,
+  PHOC_RENDERER_CAP_READ_BGRA         = 1 << 4,
+  PHOC_RENDERER_CAP_THREADED_READBACK = 1 << 5,
+  PHOC_RENDERER_CAP_SOFTWARE          = 1 << 6,
+} PhocRendererCaps;
 
 
 typedef struct _PhocRenderContext {
   PhocOutput                 *output;
   pixman_region32_t          *damage;
+  /* (nullable): @damage in buffer coordinates, set up by the renderer */
+  pixman_region32_t          *buffer_damage;
   float                       alpha;
   struct wlr_render_pass     *render_pass;
+  PhocOutputPlanes           *planes;
+
+  /* Looked up once per frame by the renderer so surface iterators don't */
   enum wlr_scale_filter_mode  tex_filter;
+  float                       scale;
+  enum wl_output_transform    transform;
+  gboolean                    shell_revealed;
+  PhocInput                  *input;
+  GSList                     *seats; /* (element-type PhocSeat): not owned */
+  struct {
+    gboolean                  touch_points;
+    gboolean                  render_list;
+    gboolean                  damage_tracking;
+    gboolean                  damage_heatmap;
+  } debug;
+
+  /* Occlusion culling */
+  GArray                     *occluded; /* pixman_region32_t per surface */
+  guint                       surface_idx;
+  guint64                     culled_pixels;
+  GHashTable                 *occluded_surfaces; /* (nullable): fully covered wlr_surfaces */
+  GArray                     *surface_opaque; /* (nullable): pixman_region32_t per surface, software rendering only */
+
+  PhocInputLatency           *input_latency; /* (nullable) */
+  PhocLayerCache             *layer_cache; /* (nullable): replaces background and bottom layers */
+  GHashTable                 *view_caches; /* (nullable): PhocView → PhocViewCache replacing its surfaces */
+
+  GArray                     *render_list; /* PhocRenderItem */
+  guint                       n_textures; /* Textures added to the render pass */
 } PhocRenderContext;
 
+/* Render hooks with a lower order are drawn first */
+#define PHOC_RENDER_HOOK_ORDER_CUTOUTS       200
+#define PHOC_RENDER_HOOK_ORDER_SHIELD        300
+
+/**
+ * PhocRenderHookFunc:
+ * @ctx: The context of the frame being rendered
+ * @user_data: The data passed when adding the hook
+ *
+ * Draws on top of an output's content at the end of a render pass.
+ */
+typedef void (*PhocRenderHookFunc) (PhocRenderContext *ctx, gpointer user_data);
+
 
 PhocRenderer *phoc_renderer_new (struct wlr_backend *wlr_backend, GError **error);
 
@@ -36,5 +116,40 @@ void          phoc_renderer_render_output (PhocRenderer      *self,
 gboolean      phoc_renderer_render_view_to_buffer (PhocRenderer           *self,
                                                    PhocView               *view,
                                                    struct wlr_buffer      *data);
+void          phoc_renderer_render_view_to_buffer_async (PhocRenderer        *self,
+                                                         PhocView            *view,
+                                                         struct wlr_buffer   *buffer,
+                                                         GCancellable        *cancellable,
+                                                         GAsyncReadyCallback  callback,
+                                                         gpointer             user_data);
+gboolean      phoc_renderer_render_view_to_buffer_finish (PhocRenderer  *self,
+                                                          GAsyncResult  *res,
+                                                          GError       **error);
+gboolean      phoc_renderer_can_render_to_dmabuf (PhocRenderer *self);
+guint         phoc_renderer_add_render_hook    (PhocRenderer       *self,
+                                                PhocOutput         *output,
+                                                gint                order,
+                                                PhocRenderHookFunc  func,
+                                                gpointer            user_data);
+void          phoc_renderer_remove_render_hook (PhocRenderer       *self,
+                                                guint               id);
+gboolean      phoc_renderer_has_render_hooks   (PhocRenderer       *self,
+                                                PhocOutput         *output);
+void          phoc_renderer_add_view_snapshot    (PhocRenderer     *self,
+                                                  PhocViewSnapshot *snapshot);
+void          phoc_renderer_remove_view_snapshot (PhocRenderer     *self,
+                                                  PhocViewSnapshot *snapshot);
+gboolean      phoc_renderer_has_view_snapshots   (PhocRenderer     *self,
+                                                  PhocOutput       *output);
+struct wlr_texture *
+              phoc_renderer_get_scaled_texture   (PhocRenderer       *self,
+                                                  struct wlr_surface *surface,
+                                                  PhocOutput         *output);
+struct wlr_texture *
+              phoc_renderer_get_view_cache_texture (PhocRenderer *self,
+                                                    PhocView     *view);
+PhocRendererCaps phoc_renderer_get_caps (PhocRenderer *self);
+uint32_t      phoc_renderer_get_preferred_read_format (PhocRenderer *self);
+struct wlr_egl *phoc_renderer_get_egl (PhocRenderer *self);
 
 G_END_DECLS
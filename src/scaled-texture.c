@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-scaled-texture"
+
+#include "phoc-config.h"
+
+#include "scaled-texture.h"
+
+#include <drm_fourcc.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/types/wlr_buffer.h>
+
+/**
+ * PhocScaledTexture:
+ *
+ * Downscaled copies of a surface's texture so surfaces of scaled down
+ * views don't need to sample their full resolution texture in every
+ * frame.
+ *
+ * There's one copy per output the surface is shown on as outputs
+ * with different scales need differently sized copies. A copy is
+ * rendered when the surface commits or, if it isn't there yet or
+ * doesn't match the requested size, from an idle callback that then
+ * damages the surface on the copy's output so it gets used. Until
+ * then [method@ScaledTexture.get] returns %NULL and the surface's
+ * texture should be used. Copies that weren't used between two
+ * commits are dropped, once there are none left the scaled texture
+ * removes itself from @owner.
+ */
+struct _PhocScaledTexture {
+  struct wlr_surface   *surface;
+  struct wlr_renderer  *wlr_renderer;
+  struct wlr_allocator *wlr_allocator;
+  /* wlr_surface → PhocScaledTexture */
+  GHashTable           *owner;
+
+  struct wl_listener    commit;
+  struct wl_listener    destroy;
+
+  GPtrArray            *copies;
+  guint                 idle_id;
+};
+
+typedef struct {
+  PhocOutput           *output;
+  struct wlr_buffer    *buffer;
+  struct wlr_texture   *texture;
+  /* Where the copy was last requested, in output buffer coordinates */
+  struct wlr_box        box;
+  gboolean              valid;
+  gboolean              used;
+} PhocScaledCopy;
+
+
+static void
+scaled_copy_free (PhocScaledCopy *copy)
+{
+  g_clear_weak_pointer (&copy->output);
+  g_clear_pointer (&copy->texture, wlr_texture_destroy);
+  g_clear_pointer (&copy->buffer, wlr_buffer_drop);
+  g_free (copy);
+}
+
+
+static PhocScaledCopy *
+find_copy (PhocScaledTexture *self, PhocOutput *output)
+{
+  for (guint i = 0; i < self->copies->len; i++) {
+    PhocScaledCopy *copy = g_ptr_array_index (self->copies, i);
+
+    if (copy->output == output)
+      return copy;
+  }
+
+  return NULL;
+}
+
+
+static struct wlr_buffer *
+create_buffer (PhocScaledTexture *self, int width, int height)
+{
+  struct wlr_drm_format_set fmt_set = {};
+  const struct wlr_drm_format *fmt;
+  struct wlr_buffer *buffer;
+
+  wlr_drm_format_set_add (&fmt_set, DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_INVALID);
+  fmt = wlr_drm_format_set_get (&fmt_set, DRM_FORMAT_ARGB8888);
+
+  buffer = wlr_allocator_create_buffer (self->wlr_allocator, width, height, fmt);
+  wlr_drm_format_set_finish (&fmt_set);
+
+  return buffer;
+}
+
+
+static void
+scaled_copy_update (PhocScaledTexture *self, PhocScaledCopy *copy)
+{
+  struct wlr_texture *texture = wlr_surface_get_texture (self->surface);
+  int width = copy->box.width, height = copy->box.height;
+  struct wlr_render_pass *pass;
+
+  copy->valid = FALSE;
+
+  if (!texture || width <= 0 || height <= 0)
+    return;
+
+  if (copy->buffer && (copy->buffer->width != width || copy->buffer->height != height)) {
+    g_clear_pointer (&copy->texture, wlr_texture_destroy);
+    g_clear_pointer (&copy->buffer, wlr_buffer_drop);
+  }
+
+  if (!copy->buffer) {
+    copy->buffer = create_buffer (self, width, height);
+    if (!copy->buffer) {
+      g_warning_once ("Failed to allocate %dx%d buffer for scaled texture", width, height);
+      return;
+    }
+  }
+
+  pass = wlr_renderer_begin_buffer_pass (self->wlr_renderer, copy->buffer, NULL);
+  if (!pass)
+    return;
+
+  wlr_render_pass_add_texture (pass, &(struct wlr_render_texture_options) {
+      .texture = texture,
+      .dst_box = { .width = width, .height = height },
+      .filter_mode = WLR_SCALE_FILTER_BILINEAR,
+      .blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+    });
+  if (!wlr_render_pass_submit (pass))
+    return;
+
+  if (!copy->texture)
+    copy->texture = wlr_texture_from_buffer (self->wlr_renderer, copy->buffer);
+
+  copy->valid = !!copy->texture;
+}
+
+
+static gboolean
+on_idle_update (gpointer data)
+{
+  PhocScaledTexture *self = data;
+
+  self->idle_id = 0;
+
+  for (guint i = 0; i < self->copies->len; i++) {
+    PhocScaledCopy *copy = g_ptr_array_index (self->copies, i);
+    PhocOutput *output = copy->output;
+
+    if (copy->valid || !output)
+      continue;
+
+    scaled_copy_update (self, copy);
+    if (!copy->valid)
+      continue;
+
+    /* The last frame used the full resolution texture, switch over */
+    if (wlr_damage_ring_add_box (&output->damage_ring, &copy->box))
+      wlr_output_schedule_frame (output->wlr_output);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+handle_surface_commit (struct wl_listener *listener, void *data)
+{
+  PhocScaledTexture *self = wl_container_of (listener, self, commit);
+
+  g_clear_handle_id (&self->idle_id, g_source_remove);
+
+  for (guint i = self->copies->len; i > 0; i--) {
+    PhocScaledCopy *copy = g_ptr_array_index (self->copies, i - 1);
+
+    /* Not shown scaled down on that output anymore */
+    if (!copy->used || !copy->output) {
+      g_ptr_array_remove_index_fast (self->copies, i - 1);
+      continue;
+    }
+
+    copy->used = FALSE;
+    scaled_copy_update (self, copy);
+  }
+
+  if (self->copies->len == 0) {
+    /* Frees self */
+    g_hash_table_remove (self->owner, self->surface);
+  }
+}
+
+/**
+ * phoc_scaled_texture_new:
+ * @surface: The surface to keep a downscaled texture for
+ * @wlr_renderer: The renderer to downscale with
+ * @wlr_allocator: The allocator for the downscaled buffer
+ * @owner: The hash table holding the scaled texture with @surface as key
+ *
+ * Returns:(transfer full): The scaled texture
+ */
+PhocScaledTexture *
+phoc_scaled_texture_new (struct wlr_surface   *surface,
+                         struct wlr_renderer  *wlr_renderer,
+                         struct wlr_allocator *wlr_allocator,
+                         GHashTable           *owner)
+{
+  PhocScaledTexture *self = g_new0 (PhocScaledTexture, 1);
+
+  self->surface = surface;
+  self->wlr_renderer = wlr_renderer;
+  self->wlr_allocator = wlr_allocator;
+  self->owner = owner;
+  self->copies = g_ptr_array_new_with_free_func ((GDestroyNotify)scaled_copy_free);
+
+  self->commit.notify = handle_surface_commit;
+  wl_signal_add (&surface->events.commit, &self->commit);
+
+  self->destroy.notify = handle_surface_destroy;
+  wl_signal_add (&surface->events.destroy, &self->destroy);
+
+  return self;
+}
+
+
+void
+phoc_scaled_texture_free (PhocScaledTexture *self)
+{
+  g_clear_handle_id (&self->idle_id, g_source_remove);
+  wl_list_remove (&self->commit.link);
+  wl_list_remove (&self->destroy.link);
+  g_clear_pointer (&self->copies, g_ptr_array_unref);
+  g_free (self);
+}
+
+/**
+ * phoc_scaled_texture_get:
+ * @self: The scaled texture
+ * @output: The output the surface is rendered on
+ * @box: Where the surface gets rendered in @output's buffer coordinates
+ *
+ * Gets the surface's texture downscaled to @box's size for
+ * @output. This must not render itself as it's used while building
+ * an output's frame so if there's no up to date copy at that size one
+ * is scheduled.
+ *
+ * Returns:(transfer none)(nullable): The downscaled texture
+ */
+struct wlr_texture *
+phoc_scaled_texture_get (PhocScaledTexture *self, PhocOutput *output, const struct wlr_box *box)
+{
+  PhocScaledCopy *copy = find_copy (self, output);
+
+  if (!copy) {
+    copy = g_new0 (PhocScaledCopy, 1);
+    g_set_weak_pointer (&copy->output, output);
+    g_ptr_array_add (self->copies, copy);
+  }
+
+  copy->used = TRUE;
+
+  if (copy->valid && copy->box.width == box->width && copy->box.height == box->height) {
+    copy->box = *box;
+    return copy->texture;
+  }
+
+  copy->box = *box;
+  copy->valid = FALSE;
+  if (!self->idle_id) {
+    self->idle_id = g_idle_add (on_idle_update, self);
+    g_source_set_name_by_id (self->idle_id, "[phoc] scaled texture update");
+  }
+
+  return NULL;
+}
+
+/**
+ * phoc_scaled_texture_peek:
+ * @self: The scaled texture
+ * @output: The output
+ *
+ * Gets the up to date copy for @output without marking it as used.
+ *
+ * Returns:(transfer none)(nullable): The downscaled texture
+ */
+struct wlr_texture *
+phoc_scaled_texture_peek (PhocScaledTexture *self, PhocOutput *output)
+{
+  PhocScaledCopy *copy = find_copy (self, output);
+
+  if (!copy || !copy->valid)
+    return NULL;
+
+  return copy->texture;
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "output.h"
+
+#include <glib.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_compositor.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PhocScaledTexture PhocScaledTexture;
+
+PhocScaledTexture  *phoc_scaled_texture_new     (struct wlr_surface   *surface,
+                                                 struct wlr_renderer  *wlr_renderer,
+                                                 struct wlr_allocator *wlr_allocator,
+                                                 GHashTable           *owner);
+void                phoc_scaled_texture_free    (PhocScaledTexture    *self);
+struct wlr_texture *phoc_scaled_texture_get     (PhocScaledTexture    *self,
+                                                 PhocOutput           *output,
+                                                 const struct wlr_box *box);
+struct wlr_texture *phoc_scaled_texture_peek    (PhocScaledTexture    *self,
+                                                 PhocOutput           *output);
+
+G_END_DECLS
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-scene"
+
+#include "phoc-config.h"
+
+#include "desktop.h"
+#include "drag-icon.h"
+#include "input.h"
+#include "layer-surface.h"
+#include "scene.h"
+#include "seat.h"
+#include "server.h"
+#include "xdg-surface.h"
+
+#include <wlr/types/wlr_scene.h>
+
+/**
+ * PhocScene:
+ *
+ * An alternative to [class@Renderer] that mirrors views, layer surfaces
+ * and drag icons into a `wlr_scene` scene graph and lets wlroots
+ * composite the outputs. This gives per node damage tracking,
+ * occlusion culling and direct scan out of whatever is on top so both
+ * approaches can be compared on the same device.
+ *
+ * The scene is synced from the desktop's state right before an output
+ * is painted: nodes for surfaces that are gone get dropped, the others
+ * are moved to their current position and stacking order.
+ *
+ * Blings, scaled down views, layer surface popups, layer surface
+ * fading and the magnifier aren't handled yet.
+ */
+struct _PhocScene {
+  struct wlr_scene      *wlr_scene;
+  struct wlr_scene_tree *layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY + 1];
+  struct wlr_scene_tree *views;
+  struct wlr_scene_tree *drag_icons;
+
+  /* wlr_surface → PhocSceneNode */
+  GHashTable            *nodes;
+  /* Bumped on each sync, nodes not seen in the last sync get dropped */
+  guint                  serial;
+};
+
+typedef struct {
+  PhocScene             *scene;
+  struct wlr_surface    *surface;
+  struct wlr_scene_tree *tree;
+  struct wl_listener     destroy;
+  guint                  serial;
+} PhocSceneNode;
+
+
+static void
+on_node_destroy (struct wl_listener *listener, void *data)
+{
+  PhocSceneNode *node = wl_container_of (listener, node, destroy);
+
+  wl_list_remove (&node->destroy.link);
+  g_hash_table_remove (node->scene->nodes, node->surface);
+}
+
+/*
+ * Looks up the node showing @surface below @parent, creating it if
+ * needed. For xdg surfaces @xdg_surface makes popups part of the tree.
+ */
+static PhocSceneNode *
+ensure_node (PhocScene               *self,
+             struct wlr_scene_tree   *parent,
+             struct wlr_surface      *surface,
+             struct wlr_xdg_surface  *xdg_surface)
+{
+  PhocSceneNode *node = g_hash_table_lookup (self->nodes, surface);
+  struct wlr_scene_tree *tree;
+
+  if (node) {
+    if (node->tree->node.parent != parent)
+      wlr_scene_node_reparent (&node->tree->node, parent);
+    node->serial = self->serial;
+    return node;
+  }
+
+  if (xdg_surface)
+    tree = wlr_scene_xdg_surface_create (parent, xdg_surface);
+  else
+    tree = wlr_scene_subsurface_tree_create (parent, surface);
+
+  if (!tree)
+    return NULL;
+
+  node = g_new0 (PhocSceneNode, 1);
+  node->scene = self;
+  node->surface = surface;
+  node->tree = tree;
+  node->serial = self->serial;
+  node->destroy.notify = on_node_destroy;
+  wl_signal_add (&tree->node.events.destroy, &node->destroy);
+  g_hash_table_insert (self->nodes, surface, node);
+
+  return node;
+}
+
+/*
+ * Nodes are placed bottom to top so raising each one restores the
+ * stacking order.
+ */
+static void
+place_node (PhocSceneNode *node, int x, int y, gboolean enabled)
+{
+  wlr_scene_node_set_position (&node->tree->node, x, y);
+  wlr_scene_node_set_enabled (&node->tree->node, enabled);
+  wlr_scene_node_raise_to_top (&node->tree->node);
+}
+
+
+static gboolean
+view_is_shown (PhocDesktop *desktop, PhocView *view)
+{
+  PhocOutput *output;
+
+  if (!phoc_desktop_view_is_visible (desktop, view))
+    return FALSE;
+
+  /* A fullscreen view hides everything else on its output */
+  output = phoc_view_get_output (view);
+  if (output && phoc_output_has_fullscreen_view (output) && output->fullscreen_view != view)
+    return FALSE;
+
+  return TRUE;
+}
+
+
+static void
+sync_views (PhocScene *self, PhocDesktop *desktop)
+{
+  GQueue *views = phoc_desktop_get_views (desktop);
+
+  /* The topmost view is at the head */
+  for (GList *l = views->tail; l; l = l->prev) {
+    PhocView *view = PHOC_VIEW (l->data);
+    struct wlr_xdg_surface *xdg_surface = NULL;
+    PhocSceneNode *node;
+    struct wlr_box geo;
+
+    if (!phoc_view_is_mapped (view))
+      continue;
+
+    if (PHOC_IS_XDG_SURFACE (view))
+      xdg_surface = phoc_xdg_surface_get_wlr_xdg_surface (PHOC_XDG_SURFACE (view));
+
+    node = ensure_node (self, self->views, view->wlr_surface, xdg_surface);
+    if (!node)
+      continue;
+
+    phoc_view_get_geometry (view, &geo);
+    place_node (node, view->box.x - geo.x, view->box.y - geo.y, view_is_shown (desktop, view));
+  }
+}
+
+
+static void
+sync_layer_surfaces (PhocScene *self, PhocDesktop *desktop)
+{
+  PhocOutput *output;
+
+  wl_list_for_each (output, &desktop->outputs, link) {
+    for (enum zwlr_layer_shell_v1_layer layer = ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND;
+         layer <= ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY;
+         layer++) {
+      GQueue *layer_surfaces = phoc_output_get_layer_surfaces_for_layer (output, layer);
+      gboolean hidden;
+
+      /* Fullscreen views cover the top layer unless the shell got revealed */
+      hidden = layer == ZWLR_LAYER_SHELL_V1_LAYER_TOP &&
+        phoc_output_has_fullscreen_view (output) && !phoc_output_has_shell_revealed (output);
+
+      for (GList *l = layer_surfaces->head; l; l = l->next) {
+        PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (l->data);
+        PhocSceneNode *node;
+
+        if (!phoc_layer_surface_get_mapped (layer_surface))
+          continue;
+
+        node = ensure_node (self, self->layers[layer],
+                            layer_surface->layer_surface->surface, NULL);
+        if (!node)
+          continue;
+
+        place_node (node,
+                    output->lx + layer_surface->geo.x,
+                    output->ly + layer_surface->geo.y,
+                    !hidden && phoc_layer_surface_get_alpha (layer_surface) > 0.0f);
+      }
+    }
+  }
+}
+
+
+static void
+sync_drag_icons (PhocScene *self)
+{
+  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
+
+  for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next) {
+    PhocSeat *seat = PHOC_SEAT (elem->data);
+    PhocSceneNode *node;
+
+    if (!seat->drag_icon || !phoc_drag_icon_is_mapped (seat->drag_icon))
+      continue;
+
+    node = ensure_node (self, self->drag_icons,
+                        phoc_drag_icon_get_wlr_surface (seat->drag_icon), NULL);
+    if (!node)
+      continue;
+
+    place_node (node,
+                phoc_drag_icon_get_x (seat->drag_icon),
+                phoc_drag_icon_get_y (seat->drag_icon),
+                TRUE);
+  }
+}
+
+
+static void
+sync (PhocScene *self)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  g_autoptr (GPtrArray) stale = g_ptr_array_new ();
+  GHashTableIter iter;
+  PhocSceneNode *node;
+
+  self->serial++;
+
+  sync_layer_surfaces (self, desktop);
+  sync_views (self, desktop);
+  sync_drag_icons (self);
+
+  /* Destroying a node removes it from the table so collect them first */
+  g_hash_table_iter_init (&iter, self->nodes);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&node)) {
+    if (node->serial != self->serial)
+      g_ptr_array_add (stale, node->tree);
+  }
+
+  for (guint i = 0; i < stale->len; i++) {
+    struct wlr_scene_tree *tree = g_ptr_array_index (stale, i);
+
+    wlr_scene_node_destroy (&tree->node);
+  }
+}
+
+
+PhocScene *
+phoc_scene_new (void)
+{
+  PhocScene *self = g_new0 (PhocScene, 1);
+
+  self->wlr_scene = wlr_scene_create ();
+  self->nodes = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+  /* Trees are stacked in creation order */
+  self->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND] = wlr_scene_tree_create (&self->wlr_scene->tree);
+  self->layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM] = wlr_scene_tree_create (&self->wlr_scene->tree);
+  self->views = wlr_scene_tree_create (&self->wlr_scene->tree);
+  self->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP] = wlr_scene_tree_create (&self->wlr_scene->tree);
+  self->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY] = wlr_scene_tree_create (&self->wlr_scene->tree);
+  self->drag_icons = wlr_scene_tree_create (&self->wlr_scene->tree);
+
+  return self;
+}
+
+
+void
+phoc_scene_free (PhocScene *self)
+{
+  /* Drops all nodes and their scene outputs */
+  wlr_scene_node_destroy (&self->wlr_scene->tree.node);
+  g_assert (g_hash_table_size (self->nodes) == 0);
+  g_hash_table_destroy (self->nodes);
+  g_free (self);
+}
+
+/**
+ * phoc_scene_build_state:
+ * @self: The scene
+ * @output: The output to paint
+ * @state: The output state to fill in
+ *
+ * Syncs the scene with the desktop and lets wlroots render the part of
+ * the scene covered by @output into @state. If nothing changed @state
+ * won't get a buffer.
+ *
+ * Returns: %TRUE on success, otherwise %FALSE
+ */
+gboolean
+phoc_scene_build_state (PhocScene *self, PhocOutput *output, struct wlr_output_state *state)
+{
+  struct wlr_scene_output *scene_output;
+
+  g_assert (self);
+  g_assert (PHOC_IS_OUTPUT (output));
+
+  scene_output = wlr_scene_get_scene_output (self->wlr_scene, output->wlr_output);
+  if (!scene_output) {
+    /* Destroyed by wlroots together with the wlr_output */
+    scene_output = wlr_scene_output_create (self->wlr_scene, output->wlr_output);
+    if (!scene_output)
+      return FALSE;
+  }
+  wlr_scene_output_set_position (scene_output, output->lx, output->ly);
+
+  sync (self);
+
+  return wlr_scene_output_build_state (scene_output, state, NULL);
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "output.h"
+
+#include <wlr/types/wlr_output.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PhocScene PhocScene;
+
+PhocScene *phoc_scene_new         (void);
+void       phoc_scene_free        (PhocScene               *self);
+gboolean   phoc_scene_build_state (PhocScene               *self,
+                                   PhocOutput              *output,
+                                   struct wlr_output_state *state);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocScene, phoc_scene_free)
+
+G_END_DECLS
@@ -27,6 +27,9 @@
 #include "cursor.h"
 #include "device-state.h"
 #include "keyboard.h"
+#include "log.h"
+#include "output.h"
+#include "phosh-private.h"
 #include "pointer.h"
 #include "switch.h"
 #include "seat.h"
@@ -36,6 +39,11 @@
 #include "touch.h"
 #include "xwayland-surface.h"
 
+/* Report idle activity at most this often per seat */
+#define ACTIVITY_INTERVAL_MS 250
+/* Flush queued tablet tool axis events when the output doesn't repaint */
+#define TOOL_AXIS_FLUSH_TIMEOUT_MS 50
+
 enum {
   PROP_0,
   PROP_INPUT,
@@ -52,15 +60,34 @@ typedef struct _PhocSeatPrivate {
   /* The first element in the queue is the currently focused view, the
    * one after that the view that was previously focused and so on */
   GQueue                *views; /* (element-type: PhocSeatView) */
+  /* PhocView → PhocSeatView */
+  GHashTable            *seat_views;
   /* Whether a view on this seat has focus */
   bool                   has_focus;
 
   struct wl_client      *exclusive_client;
 
-  GHashTable            *input_mapping_settings;
+  /* PhocInputDevice → PhocInputMapping */
+  GHashTable            *input_mappings;
 
   uint32_t               last_button_serial;
   uint32_t               last_touch_serial;
+
+  /* Repeat of a held down phosh-private accelerator. A single timer
+   * is shared by all keyboards of the seat. */
+  struct {
+    struct wl_event_source *timer;
+    PhocKeyboard           *keyboard;
+    xkb_keycode_t           keycode;
+    PhocKeyCombo            combo;
+  } accelerator_repeat;
+
+  /* Activity seen while the timer is armed is reported once it fires */
+  struct {
+    struct wl_event_source *timer;
+    gboolean                armed;
+    gboolean                pending;
+  } activity;
 } PhocSeatPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (PhocSeat, phoc_seat, G_TYPE_OBJECT)
@@ -216,7 +243,7 @@ handle_touch_down (struct wl_listener *listener, void *data)
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
   PhocCursor *cursor = wl_container_of (listener, cursor, touch_down);
   struct wlr_touch_down_event *event = data;
-  PhocOutput *output = g_hash_table_lookup (desktop->input_output_map, event->touch->base.name);
+  PhocOutput *output = phoc_input_device_get_output (event->touch->base.data);
 
   if (output && !output->wlr_output->enabled) {
     g_debug ("Touch event ignored since output '%s' is disabled.",
@@ -285,14 +312,23 @@ handle_tablet_tool_position (PhocCursor             *cursor,
   }
 
   double sx, sy;
+  PhocView *view = NULL;
   struct wlr_surface *surface = phoc_desktop_wlr_surface_at (desktop,
                                                              cursor->cursor->x,
                                                              cursor->cursor->y,
                                                              &sx,
                                                              &sy,
-                                                             NULL);
+                                                             &view);
   PhocTabletTool *phoc_tool = tool->data;
 
+  /* Only look up the app's setting when the tool enters a new surface */
+  if (surface != phoc_tool->full_rate_surface) {
+    GSettings *settings = view ? phoc_view_get_app_settings (view) : NULL;
+
+    phoc_tool->full_rate_surface = surface;
+    phoc_tool->full_rate = settings && g_settings_get_boolean (settings, "tablet-full-rate");
+  }
+
   if (!surface) {
     wlr_tablet_v2_tablet_tool_notify_proximity_out (phoc_tool->tablet_v2_tool);
     /* XXX: TODO: Fallback pointer semantics */
@@ -313,19 +349,10 @@ handle_tablet_tool_position (PhocCursor             *cursor,
 
 
 static void
-handle_tool_axis (struct wl_listener *listener, void *data)
+process_tool_axis (PhocCursor *cursor, struct wlr_tablet_tool_axis_event *event)
 {
-  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
-  PhocCursor *cursor = wl_container_of (listener, cursor, tool_axis);
-
-  struct wlr_tablet_tool_axis_event *event = data;
   PhocTabletTool *phoc_tool = event->tool->data;
 
-  if (!phoc_tool) { // TODO: Should this be an assert?
-    g_debug ("Tool Axis, before proximity");
-    return;
-  }
-
   /*
    * We need to handle them ourselves, not pass it into the cursor
    * without any consideration
@@ -361,6 +388,176 @@ handle_tool_axis (struct wl_listener *listener, void *data)
 
   if (event->updated_axes & WLR_TABLET_TOOL_AXIS_WHEEL)
     wlr_tablet_v2_tablet_tool_notify_wheel (phoc_tool->tablet_v2_tool, event->wheel_delta, 0);
+}
+
+/*
+ * Process the axis events merged since the last frame. Needs to
+ * happen before any other event of the tool so clients see them in
+ * order.
+ */
+static void
+phoc_tablet_tool_flush_axis (PhocTabletTool *phoc_tool)
+{
+  struct wlr_tablet_tool_axis_event event = phoc_tool->pending_axis;
+  g_autoptr (PhocTablet) tablet = NULL;
+
+  if (!event.updated_axes)
+    return;
+
+  phoc_tool->pending_axis = (struct wlr_tablet_tool_axis_event) { 0 };
+
+  /* The tablet went away in the meantime */
+  tablet = g_weak_ref_get (&phoc_tool->pending_tablet);
+  if (!tablet)
+    return;
+
+  event.tablet = wlr_tablet_from_input_device (phoc_input_device_get_device (PHOC_INPUT_DEVICE (tablet)));
+  process_tool_axis (phoc_tool->seat->cursor, &event);
+}
+
+
+static gboolean
+on_tool_flush_frame_callback (PhocAnimatable *animatable,
+                              guint64         last_frame,
+                              guint64         frame_time,
+                              gpointer        user_data)
+{
+  PhocTabletTool *phoc_tool = user_data;
+
+  phoc_tablet_tool_flush_axis (phoc_tool);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+on_tool_flush_frame_callback_done (gpointer user_data)
+{
+  PhocTabletTool *phoc_tool = user_data;
+
+  phoc_tool->flush_id = 0;
+  phoc_tool->flush_output = NULL;
+  g_clear_handle_id (&phoc_tool->flush_timeout_id, g_source_remove);
+}
+
+
+static gboolean
+on_tool_flush_timeout (gpointer user_data)
+{
+  PhocTabletTool *phoc_tool = user_data;
+
+  phoc_tool->flush_timeout_id = 0;
+  phoc_tablet_tool_flush_axis (phoc_tool);
+
+  /* The output didn't render a frame in time */
+  if (phoc_tool->flush_id)
+    phoc_output_remove_frame_callback (phoc_tool->flush_output, phoc_tool->flush_id);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+merge_tool_axis (struct wlr_tablet_tool_axis_event       *pending,
+                 const struct wlr_tablet_tool_axis_event *event)
+{
+  uint32_t axes = event->updated_axes;
+
+  pending->tool = event->tool;
+  pending->time_msec = event->time_msec;
+
+  /* Absolute axes keep the most recent value, relative ones add up */
+  if (axes & WLR_TABLET_TOOL_AXIS_X)
+    pending->x = event->x;
+  if (axes & WLR_TABLET_TOOL_AXIS_Y)
+    pending->y = event->y;
+  pending->dx += event->dx;
+  pending->dy += event->dy;
+
+  if (axes & WLR_TABLET_TOOL_AXIS_PRESSURE)
+    pending->pressure = event->pressure;
+  if (axes & WLR_TABLET_TOOL_AXIS_DISTANCE)
+    pending->distance = event->distance;
+  if (axes & WLR_TABLET_TOOL_AXIS_TILT_X)
+    pending->tilt_x = event->tilt_x;
+  if (axes & WLR_TABLET_TOOL_AXIS_TILT_Y)
+    pending->tilt_y = event->tilt_y;
+  if (axes & WLR_TABLET_TOOL_AXIS_ROTATION)
+    pending->rotation = event->rotation;
+  if (axes & WLR_TABLET_TOOL_AXIS_SLIDER)
+    pending->slider = event->slider;
+  if (axes & WLR_TABLET_TOOL_AXIS_WHEEL)
+    pending->wheel_delta += event->wheel_delta;
+
+  pending->updated_axes |= axes;
+}
+
+/*
+ * Merge the axis event into the tool's pending one and process that
+ * on the next frame of the output the cursor is on. A timeout makes
+ * sure the events don't stall when that output doesn't repaint.
+ */
+static void
+queue_tool_axis (PhocCursor *cursor, struct wlr_tablet_tool_axis_event *event)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocTabletTool *phoc_tool = event->tool->data;
+  PhocTablet *tablet = event->tablet->base.data;
+  PhocOutput *output;
+
+  if (phoc_tool->pending_axis.updated_axes) {
+    g_autoptr (PhocTablet) pending_tablet = g_weak_ref_get (&phoc_tool->pending_tablet);
+
+    /* The tool moved to another tablet */
+    if (pending_tablet != tablet)
+      phoc_tablet_tool_flush_axis (phoc_tool);
+  }
+
+  merge_tool_axis (&phoc_tool->pending_axis, event);
+  g_weak_ref_set (&phoc_tool->pending_tablet, tablet);
+
+  if (phoc_tool->flush_id)
+    return;
+
+  output = phoc_desktop_layout_get_output (desktop, cursor->cursor->x, cursor->cursor->y);
+  if (!output) {
+    phoc_tablet_tool_flush_axis (phoc_tool);
+    return;
+  }
+
+  phoc_tool->flush_output = output;
+  phoc_tool->flush_id = phoc_output_add_frame_callback (output,
+                                                        PHOC_ANIMATABLE (output),
+                                                        on_tool_flush_frame_callback,
+                                                        phoc_tool,
+                                                        on_tool_flush_frame_callback_done);
+  phoc_tool->flush_timeout_id = g_timeout_add (TOOL_AXIS_FLUSH_TIMEOUT_MS,
+                                               on_tool_flush_timeout,
+                                               phoc_tool);
+  g_source_set_name_by_id (phoc_tool->flush_timeout_id, "[phoc] tool axis flush");
+}
+
+
+static void
+handle_tool_axis (struct wl_listener *listener, void *data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocCursor *cursor = wl_container_of (listener, cursor, tool_axis);
+
+  struct wlr_tablet_tool_axis_event *event = data;
+  PhocTabletTool *phoc_tool = event->tool->data;
+
+  if (!phoc_tool) { // TODO: Should this be an assert?
+    g_debug ("Tool Axis, before proximity");
+    return;
+  }
+
+  if (phoc_tool->coalesce && !phoc_tool->full_rate) {
+    queue_tool_axis (cursor, event);
+  } else {
+    phoc_tablet_tool_flush_axis (phoc_tool);
+    process_tool_axis (cursor, event);
+  }
 
   phoc_desktop_notify_activity (desktop, cursor->seat);
 }
@@ -374,6 +571,8 @@ handle_tool_tip (struct wl_listener *listener, void *data)
   struct wlr_tablet_tool_tip_event *event = data;
   PhocTabletTool *phoc_tool = event->tool->data;
 
+  phoc_tablet_tool_flush_axis (phoc_tool);
+
   if (event->state == WLR_TABLET_TOOL_TIP_DOWN) {
     wlr_tablet_v2_tablet_tool_notify_down (phoc_tool->tablet_v2_tool);
     wlr_tablet_tool_v2_start_implicit_grab (phoc_tool->tablet_v2_tool);
@@ -389,6 +588,11 @@ handle_tablet_tool_destroy (struct wl_listener *listener, void *data)
 {
   PhocTabletTool *tool = wl_container_of (listener, tool, tool_destroy);
 
+  if (tool->flush_id)
+    phoc_output_remove_frame_callback (tool->flush_output, tool->flush_id);
+  g_clear_handle_id (&tool->flush_timeout_id, g_source_remove);
+  g_weak_ref_clear (&tool->pending_tablet);
+
   wl_list_remove (&tool->link);
   wl_list_remove (&tool->tool_link);
 
@@ -406,6 +610,8 @@ handle_tool_button (struct wl_listener *listener, void *data)
   struct wlr_tablet_tool_button_event *event = data;
   PhocTabletTool *phoc_tool = event->tool->data;
 
+  phoc_tablet_tool_flush_axis (phoc_tool);
+
   wlr_tablet_v2_tablet_tool_notify_button (phoc_tool->tablet_v2_tool,
                                            (enum zwp_tablet_pad_v2_button_state)event->button,
                                            (enum zwp_tablet_pad_v2_button_state)event->state);
@@ -452,9 +658,12 @@ handle_tool_proximity (struct wl_listener *listener, void *data)
   phoc_desktop_notify_activity (desktop, cursor->seat);
 
   if (!tool->data) {
+    PhocConfig *config = phoc_server_get_config (phoc_server_get_default ());
     PhocTabletTool *phoc_tool = g_new0 (PhocTabletTool, 1);
 
     phoc_tool->seat = cursor->seat;
+    phoc_tool->coalesce = config && config->tablet_motion == PHOC_TABLET_MOTION_COALESCE;
+    g_weak_ref_init (&phoc_tool->pending_tablet, NULL);
     tool->data = phoc_tool;
     phoc_tool->tablet_v2_tool = wlr_tablet_tool_create (desktop->tablet_v2,
                                                         cursor->seat->seat,
@@ -470,8 +679,13 @@ handle_tool_proximity (struct wl_listener *listener, void *data)
     wl_list_init (&phoc_tool->tool_link);
   }
 
+  phoc_tablet_tool_flush_axis (tool->data);
+
   if (event->state == WLR_TABLET_TOOL_PROXIMITY_OUT) {
     PhocTabletTool *phoc_tool = tool->data;
+
+    phoc_tool->full_rate_surface = NULL;
+    phoc_tool->full_rate = FALSE;
     wlr_tablet_v2_tablet_tool_notify_proximity_out (phoc_tool->tablet_v2_tool);
 
     /* Clear cursor image if there's no pointing device. */
@@ -497,34 +711,68 @@ handle_pointer_focus_change (struct wl_listener *listener,
 }
 
 
-static PhocOutput *
-get_output_from_settings (PhocSeat *self, PhocInputDevice *device)
+/*
+ * The resolved output of an absolute input device like touch or
+ * tablets. Resolving it needs lookups in GSettings and the outputs so
+ * it's only redone when the mapping might have changed.
+ */
+typedef struct {
+  PhocSeat        *seat;
+  PhocInputDevice *device;
+  GSettings       *settings;
+  /* The configured output's make, model and serial, NULL if unset */
+  GStrv            edid;
+  PhocOutput      *output;
+  /* Whether the output matched the configured one */
+  gboolean         configured;
+  gboolean         dirty;
+} PhocInputMapping;
+
+
+static void
+phoc_input_mapping_free (PhocInputMapping *mapping)
 {
-  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
-  PhocSeatPrivate *priv = phoc_seat_get_instance_private (self);
-  GSettings *settings;
-  g_auto (GStrv) edid = NULL;
+  g_signal_handlers_disconnect_by_data (mapping->settings, mapping);
+  g_clear_object (&mapping->settings);
+  g_clear_pointer (&mapping->edid, g_strfreev);
+  g_free (mapping);
+}
+
 
-  settings = g_hash_table_lookup (priv->input_mapping_settings, device);
-  g_assert (G_IS_SETTINGS (settings));
+static void
+input_mapping_load_settings (PhocInputMapping *mapping)
+{
+  g_auto (GStrv) edid = g_settings_get_strv (mapping->settings, "output");
 
-  edid = g_settings_get_strv (settings, "output");
+  g_clear_pointer (&mapping->edid, g_strfreev);
 
   if (g_strv_length (edid) != 3) {
     g_warning ("EDID configuration for '%s' does not have 3 values",
-               phoc_input_device_get_name (device));
-    return NULL;
+               phoc_input_device_get_name (mapping->device));
+    return;
   }
 
   if (!*edid[0] && !*edid[1] && !*edid[2])
+    return;
+
+  mapping->edid = g_steal_pointer (&edid);
+}
+
+
+static PhocOutput *
+get_output_from_settings (PhocInputMapping *mapping)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+
+  if (!mapping->edid)
     return NULL;
 
-  g_debug ("Looking up output %s/%s/%s", edid[0], edid[1], edid[2]);
-  return phoc_desktop_find_output (desktop, edid[0], edid[1], edid[2]);
+  g_debug ("Looking up output %s/%s/%s", mapping->edid[0], mapping->edid[1], mapping->edid[2]);
+  return phoc_desktop_find_output (desktop, mapping->edid[0], mapping->edid[1], mapping->edid[2]);
 }
 
 static PhocOutput *
-get_output_from_wlroots (PhocSeat *self, PhocInputDevice *device)
+get_output_from_wlroots (PhocInputDevice *device)
 {
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
   struct wlr_input_device *wlr_device = phoc_input_device_get_device (device);
@@ -542,81 +790,116 @@ get_output_from_wlroots (PhocSeat *self, PhocInputDevice *device)
   return phoc_desktop_find_output_by_name (desktop, touch->output_name);
 }
 
-
+/*
+ * Resolve the output the device should be mapped to ignoring
+ * @removed as that one is about to go away.
+ */
 static void
-seat_set_device_output_mappings (PhocSeat *self, PhocInputDevice *device)
+resolve_input_mapping (PhocInputMapping *mapping, PhocOutput *removed)
 {
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
-  struct wlr_cursor *cursor = self->cursor->cursor;
+  PhocInputDevice *device = mapping->device;
   PhocOutput *output;
-  const char *type = "";
 
-  switch (phoc_input_device_get_device_type (device)) {
-  /* only map devices with absolute positions */
-  case WLR_INPUT_DEVICE_TOUCH:
-    type = "touch";
-    break;
-  case WLR_INPUT_DEVICE_TABLET_TOOL:
-    type = "tablet";
-    break;
-  default:
-    g_assert_not_reached ();
-  }
+  mapping->dirty = FALSE;
 
-  output = get_output_from_settings (self, device);
+  output = get_output_from_settings (mapping);
+  if (output == removed)
+    output = NULL;
+  mapping->configured = !!output;
 
   if (!output)
-    output = get_output_from_wlroots (self, device);
+    output = get_output_from_wlroots (device);
 
-  if (!output)
+  if (!output || output == removed)
     output = phoc_desktop_get_builtin_output (desktop);
 
-  if (!output)
+  if (output == removed)
+    output = NULL;
+
+  if (output == mapping->output)
     return;
 
-  g_debug ("Mapping %s device %s to %s", type, phoc_input_device_get_name (device),
-           output->wlr_output->name);
-  wlr_cursor_map_input_to_output (cursor,
+  mapping->output = output;
+  phoc_input_device_set_output (device, output);
+  wlr_cursor_map_input_to_output (mapping->seat->cursor->cursor,
                                   phoc_input_device_get_device (device),
-                                  output->wlr_output);
-  g_hash_table_insert (desktop->input_output_map,
-                       g_strdup (phoc_input_device_get_name (device)),
-                       output);
-  return;
+                                  output ? output->wlr_output : NULL);
+  if (output) {
+    g_debug ("Mapping %s device %s to %s",
+             phoc_input_device_get_device_type (device) == WLR_INPUT_DEVICE_TOUCH ? "touch" : "tablet",
+             phoc_input_device_get_name (device), output->wlr_output->name);
+    g_hash_table_insert (desktop->input_output_map,
+                         g_strdup (phoc_input_device_get_name (device)),
+                         output);
+  } else {
+    g_debug ("Unmapping device %s", phoc_input_device_get_name (device));
+    g_hash_table_remove (desktop->input_output_map, phoc_input_device_get_name (device));
+  }
 }
 
 
 static void
-reset_device_mappings (gpointer data, gpointer user_data)
+update_input_mappings (PhocSeat *self, PhocOutput *removed)
 {
-  PhocInputDevice *device = PHOC_INPUT_DEVICE (data);
-  PhocSeat *seat = PHOC_SEAT (user_data);
-  struct wlr_cursor *cursor = seat->cursor->cursor;
+  PhocSeatPrivate *priv = phoc_seat_get_instance_private (self);
+  PhocInputMapping *mapping;
+  GHashTableIter iter;
 
-  wlr_cursor_map_input_to_output (cursor, phoc_input_device_get_device (device), NULL);
+  g_hash_table_iter_init (&iter, priv->input_mappings);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&mapping)) {
+    if (mapping->dirty)
+      resolve_input_mapping (mapping, removed);
+  }
 }
 
-
+/**
+ * phoc_seat_configure_cursor:
+ * @seat: The seat
+ *
+ * Update the device to output mappings of touch screens and tablets
+ * after an output got added. Devices mapped to their configured
+ * output keep their mapping, only the ones that fell back to another
+ * output or aren't mapped at all get resolved again.
+ */
 void
 phoc_seat_configure_cursor (PhocSeat *seat)
 {
-  struct wlr_cursor *cursor = seat->cursor->cursor;
+  PhocSeatPrivate *priv = phoc_seat_get_instance_private (seat);
+  PhocInputMapping *mapping;
+  GHashTableIter iter;
 
-  /* Reset mappings */
-  wlr_cursor_map_to_output (cursor, NULL);
+  g_hash_table_iter_init (&iter, priv->input_mappings);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&mapping)) {
+    if (!mapping->configured)
+      mapping->dirty = TRUE;
+  }
 
-  g_slist_foreach (seat->touch, reset_device_mappings, seat);
-  g_slist_foreach (seat->tablets, reset_device_mappings, seat);
+  update_input_mappings (seat, NULL);
+}
 
-  /* Configure device to output mappings */
-  for (GSList *elem = seat->tablets; elem; elem = elem->next) {
-    PhocInputDevice *input_device = PHOC_INPUT_DEVICE (elem->data);
-    seat_set_device_output_mappings (seat, input_device);
-  }
-  for (GSList *elem = seat->touch; elem; elem = elem->next) {
-    PhocInputDevice *input_device = PHOC_INPUT_DEVICE (elem->data);
-    seat_set_device_output_mappings (seat, input_device);
+/**
+ * phoc_seat_remove_output_mappings:
+ * @seat: The seat
+ * @output: The output that is going away
+ *
+ * Map the touch screens and tablets currently mapped to @output to
+ * another output.
+ */
+void
+phoc_seat_remove_output_mappings (PhocSeat *seat, PhocOutput *output)
+{
+  PhocSeatPrivate *priv = phoc_seat_get_instance_private (seat);
+  PhocInputMapping *mapping;
+  GHashTableIter iter;
+
+  g_hash_table_iter_init (&iter, priv->input_mappings);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&mapping)) {
+    if (mapping->output == output)
+      mapping->dirty = TRUE;
   }
+
+  update_input_mappings (seat, output);
 }
 
 static void
@@ -744,8 +1027,15 @@ phoc_seat_handle_destroy (struct wl_listener *listener, void *data)
 
   phoc_input_method_relay_destroy (&self->im_relay);
 
-  g_queue_free_full (priv->views, (GDestroyNotify)seat_view_destroy);
-  priv->views = NULL;
+  /* Tear down without moving focus around */
+  while (priv->views && !g_queue_is_empty (priv->views)) {
+    PhocSeatView *seat_view = g_queue_pop_head (priv->views);
+
+    g_signal_handlers_disconnect_by_data (seat_view->view, seat_view);
+    g_free (seat_view);
+  }
+  g_clear_pointer (&priv->views, g_queue_free);
+  g_clear_pointer (&priv->seat_views, g_hash_table_destroy);
 }
 
 
@@ -795,12 +1085,12 @@ seat_update_capabilities (PhocSeat *self)
 
 
 static void
-on_settings_output_changed (PhocSeat *seat)
+on_settings_output_changed (PhocInputMapping *mapping)
 {
-  g_assert (PHOC_IS_SEAT (seat));
-
-  g_debug ("Input output mappings changed, reloading settings");
-  phoc_seat_configure_cursor (seat);
+  g_debug ("Output mapping of %s changed, reloading settings",
+           phoc_input_device_get_name (mapping->device));
+  input_mapping_load_settings (mapping);
+  resolve_input_mapping (mapping, NULL);
 }
 
 
@@ -810,7 +1100,7 @@ phoc_seat_add_input_mapping_settings (PhocSeat *self, PhocInputDevice *device)
   PhocSeatPrivate *priv = phoc_seat_get_instance_private (self);
   const char *schema, *group, *vendor, *product;
   g_autofree char *path = NULL;
-  g_autoptr (GSettings) settings = NULL;
+  PhocInputMapping *mapping;
 
   switch (phoc_input_device_get_device_type (device)) {
   case WLR_INPUT_DEVICE_TOUCH:
@@ -831,11 +1121,14 @@ phoc_seat_add_input_mapping_settings (PhocSeat *self, PhocInputDevice *device)
                           group, vendor, product);
 
   g_debug ("Tracking config path %s for %s", path, phoc_input_device_get_name (device));
-  settings = g_settings_new_with_path (schema, path);
-  g_signal_connect_swapped (settings, "changed::output",
-                            G_CALLBACK (on_settings_output_changed), self);
-  g_hash_table_insert (priv->input_mapping_settings, device, g_steal_pointer (&settings));
-  on_settings_output_changed (self);
+  mapping = g_new0 (PhocInputMapping, 1);
+  mapping->seat = self;
+  mapping->device = device;
+  mapping->settings = g_settings_new_with_path (schema, path);
+  g_signal_connect_swapped (mapping->settings, "changed::output",
+                            G_CALLBACK (on_settings_output_changed), mapping);
+  g_hash_table_insert (priv->input_mappings, device, mapping);
+  on_settings_output_changed (mapping);
 }
 
 
@@ -845,6 +1138,7 @@ on_keyboard_destroy (PhocSeat *self, PhocKeyboard *keyboard)
   g_assert (PHOC_IS_SEAT (self));
   g_assert (PHOC_IS_KEYBOARD (keyboard));
 
+  phoc_seat_stop_accelerator_repeat (self, keyboard, XKB_KEYCODE_INVALID);
   self->keyboards = g_slist_remove (self->keyboards, keyboard);
   g_object_unref (keyboard);
   seat_update_capabilities (self);
@@ -865,12 +1159,13 @@ on_keyboard_activity (PhocSeat *self, uint32_t keycode, PhocKeyboard *keyboard)
   is_wakeup = phoc_keyboard_is_wakeup_key (keyboard, keycode);
 
   if (output && !output->wlr_output->enabled && !is_wakeup) {
-    g_debug ("Activity notify skipped: output '%s' is disabled and keycode %d is not a wakeup key.",
-             output->wlr_output->name, keycode);
+    phoc_debug_hot (PHOC_LOG_HOT_INPUT,
+                    "Activity notify skipped: output '%s' is disabled and keycode %d is not a wakeup key.",
+                    output->wlr_output->name, keycode);
     return;
   }
 
-  g_debug ("Keycode %d pressed. is_wakeup=%d", keycode, is_wakeup);
+  phoc_debug_hot (PHOC_LOG_HOT_INPUT, "Keycode %d pressed. is_wakeup=%d", keycode, is_wakeup);
 
   phoc_desktop_notify_activity (desktop, self);
 }
@@ -974,8 +1269,10 @@ on_touch_destroy (PhocTouch *touch)
   g_assert (PHOC_IS_TOUCH (touch));
   g_debug ("Removing touch device: %s", device->name);
   g_hash_table_remove (desktop->input_output_map, device->name);
-  g_hash_table_remove (priv->input_mapping_settings, touch);
+  g_hash_table_remove (priv->input_mappings, touch);
 
+  /* Pending motion refers to the device */
+  phoc_cursor_flush_touch_motions (seat->cursor);
   seat->touch = g_slist_remove (seat->touch, touch);
   wlr_cursor_detach_input_device (seat->cursor->cursor, device);
   g_object_unref (touch);
@@ -1157,7 +1454,7 @@ on_tablet_destroy (PhocSeat *seat, PhocTablet *tablet)
   g_assert (PHOC_IS_TABLET (tablet));
   g_debug ("Removing tablet device: %s", device->name);
   wlr_cursor_detach_input_device (seat->cursor->cursor, device);
-  g_hash_table_remove (priv->input_mapping_settings, tablet);
+  g_hash_table_remove (priv->input_mappings, tablet);
   g_hash_table_remove (desktop->input_output_map, device->name);
 
   seat->tablets = g_slist_remove (seat->tablets, tablet);
@@ -1286,8 +1583,9 @@ seat_view_destroy (PhocSeatView *seat_view)
   }
 
   g_signal_handlers_disconnect_by_data (view, seat_view);
-  if (!g_queue_remove (priv->views, seat_view))
+  if (!g_hash_table_remove (priv->seat_views, view))
     g_critical ("Tried to remove inexistent view %p", seat_view);
+  g_queue_delete_link (priv->views, seat_view->link);
   g_free (seat_view);
 
   if (view && view->parent) {
@@ -1330,6 +1628,8 @@ seat_add_view (PhocSeat *seat, PhocView *view)
   seat_view->view = view;
 
   g_queue_push_tail (priv->views, seat_view);
+  seat_view->link = priv->views->tail;
+  g_hash_table_insert (priv->seat_views, view, seat_view);
 
   g_signal_connect (view, "notify::is-mapped", G_CALLBACK (on_view_is_mapped_changed), seat_view);
   g_signal_connect (view, "surface-destroy", G_CALLBACK (on_view_surface_destroy), seat_view);
@@ -1350,9 +1650,8 @@ seat_add_view (PhocSeat *seat, PhocView *view)
 PhocSeatView *
 phoc_seat_view_from_view (PhocSeat *seat, PhocView *view)
 {
-  PhocSeatPrivate *priv = phoc_seat_get_instance_private (seat);
-  bool found = false;
-  PhocSeatView *seat_view = NULL;
+  PhocSeatPrivate *priv;
+  PhocSeatView *seat_view;
 
   g_assert (PHOC_IS_SEAT (seat));
   priv = phoc_seat_get_instance_private (seat);
@@ -1360,16 +1659,8 @@ phoc_seat_view_from_view (PhocSeat *seat, PhocView *view)
   if (view == NULL)
     return NULL;
 
-  for (GList *l = priv->views->head; l; l = l->next) {
-    seat_view = l->data;
-
-    if (seat_view->view == view) {
-      found = true;
-      break;
-    }
-  }
-
-  if (!found)
+  seat_view = g_hash_table_lookup (priv->seat_views, view);
+  if (!seat_view)
     seat_view = seat_add_view (seat, view);
 
   return seat_view;
@@ -1379,11 +1670,16 @@ phoc_seat_view_from_view (PhocSeat *seat, PhocView *view)
 bool
 phoc_seat_allow_input (PhocSeat *seat, struct wl_resource *resource)
 {
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocSessionLock *lock = phoc_desktop_get_session_lock (desktop);
   PhocSeatPrivate *priv;
 
   g_assert (PHOC_IS_SEAT (seat));
   priv = phoc_seat_get_instance_private (seat);
 
+  if (G_UNLIKELY (phoc_session_lock_is_locked (lock)))
+    return phoc_session_lock_allow_client (lock, wl_resource_get_client (resource));
+
   return !priv->exclusive_client || wl_resource_get_client (resource) == priv->exclusive_client;
 }
 
@@ -1496,8 +1792,10 @@ phoc_seat_set_focus_view (PhocSeat *seat, PhocView *view)
   }
 
   /* Set next seat view to receive focus */
-  g_queue_remove (priv->views, seat_view);
-  g_queue_push_head (priv->views, seat_view);
+  if (seat_view->link != priv->views->head) {
+    g_queue_unlink (priv->views, seat_view->link);
+    g_queue_push_head_link (priv->views, seat_view->link);
+  }
 
   /* Flush the token early as a layer surface might have focus */
   if (phoc_view_get_activation_token (view))
@@ -1556,10 +1854,8 @@ phoc_seat_set_focus_layer (PhocSeat                    *seat,
       seat->focused_layer = NULL;
       phoc_seat_set_focus_view (seat, seat_view ? seat_view->view : NULL);
 
-      if (output) {
-        phoc_layer_shell_arrange (output);
-        phoc_output_update_shell_reveal (output);
-      }
+      if (output)
+        phoc_output_queue_arrange_layers (output);
     }
     return;
   }
@@ -1868,7 +2164,9 @@ phoc_seat_finalize (GObject *object)
   PhocSeat *self = PHOC_SEAT (object);
   PhocSeatPrivate *priv = phoc_seat_get_instance_private (self);
 
-  g_clear_pointer (&priv->input_mapping_settings, g_hash_table_destroy);
+  g_clear_pointer (&priv->input_mappings, g_hash_table_destroy);
+  g_clear_pointer (&priv->accelerator_repeat.timer, wl_event_source_remove);
+  g_clear_pointer (&priv->activity.timer, wl_event_source_remove);
   phoc_seat_handle_destroy (&self->destroy, self->seat);
   wlr_seat_destroy (self->seat);
   g_clear_pointer (&priv->name, g_free);
@@ -1922,13 +2220,14 @@ phoc_seat_init (PhocSeat *self)
 
   wl_list_init (&self->tablet_pads);
   priv->views = g_queue_new ();
+  priv->seat_views = g_hash_table_new (g_direct_hash, g_direct_equal);
 
   self->touch_id = -1;
 
-  priv->input_mapping_settings = g_hash_table_new_full (g_direct_hash,
-                                                        g_direct_equal,
-                                                        NULL,
-                                                        g_object_unref);
+  priv->input_mappings = g_hash_table_new_full (g_direct_hash,
+                                                g_direct_equal,
+                                                NULL,
+                                                (GDestroyNotify)phoc_input_mapping_free);
 }
 
 
@@ -2050,3 +2349,170 @@ phoc_seat_update_last_button_serial (PhocSeat *self, uint32_t serial)
 
   priv->last_button_serial = serial;
 }
+
+
+static int
+handle_accelerator_repeat (void *data)
+{
+  PhocSeat *self = PHOC_SEAT (data);
+  PhocSeatPrivate *priv = phoc_seat_get_instance_private (self);
+  struct wlr_input_device *device;
+  struct wlr_keyboard *wlr_keyboard;
+
+  if (!priv->accelerator_repeat.keyboard)
+    return 0;
+
+  device = phoc_input_device_get_device (PHOC_INPUT_DEVICE (priv->accelerator_repeat.keyboard));
+  wlr_keyboard = wlr_keyboard_from_input_device (device);
+
+  /* The accelerator might have been unsubscribed in the meantime */
+  if (wlr_keyboard->repeat_info.rate <= 0 ||
+      !phoc_phosh_private_forward_keysym (&priv->accelerator_repeat.combo,
+                                          g_get_monotonic_time () / 1000, true)) {
+    priv->accelerator_repeat.keyboard = NULL;
+    return 0;
+  }
+
+  wl_event_source_timer_update (priv->accelerator_repeat.timer,
+                                MAX (1000 / wlr_keyboard->repeat_info.rate, 1));
+  return 0;
+}
+
+/**
+ * phoc_seat_start_accelerator_repeat:
+ * @self: The seat
+ * @keyboard: The keyboard the accelerator's key is held down on
+ * @keycode: The xkb keycode of the held down key
+ * @combo: The accelerator to repeat
+ *
+ * Starts re-sending @combo to the phosh-private client at the
+ * keyboard's repeat rate until the key is released. Clients don't
+ * see the key so they can't repeat it themselves. The caller decides
+ * which accelerators repeat, e.g. only volume and brightness keys.
+ * Starting a repeat replaces the current one as only the most recently
+ * pressed key repeats.
+ */
+void
+phoc_seat_start_accelerator_repeat (PhocSeat           *self,
+                                    PhocKeyboard       *keyboard,
+                                    xkb_keycode_t       keycode,
+                                    const PhocKeyCombo *combo)
+{
+  PhocSeatPrivate *priv;
+  struct wlr_input_device *device;
+  struct wlr_keyboard *wlr_keyboard;
+
+  g_assert (PHOC_IS_SEAT (self));
+  g_assert (PHOC_IS_KEYBOARD (keyboard));
+  priv = phoc_seat_get_instance_private (self);
+
+  device = phoc_input_device_get_device (PHOC_INPUT_DEVICE (keyboard));
+  wlr_keyboard = wlr_keyboard_from_input_device (device);
+  if (wlr_keyboard->repeat_info.rate <= 0) {
+    phoc_seat_stop_accelerator_repeat (self, NULL, XKB_KEYCODE_INVALID);
+    return;
+  }
+
+  if (!priv->accelerator_repeat.timer) {
+    struct wl_display *wl_display = phoc_server_get_wl_display (phoc_server_get_default ());
+    struct wl_event_loop *loop = wl_display_get_event_loop (wl_display);
+
+    priv->accelerator_repeat.timer = wl_event_loop_add_timer (loop, handle_accelerator_repeat,
+                                                              self);
+  }
+
+  priv->accelerator_repeat.keyboard = keyboard;
+  priv->accelerator_repeat.keycode = keycode;
+  priv->accelerator_repeat.combo = *combo;
+  wl_event_source_timer_update (priv->accelerator_repeat.timer,
+                                MAX (wlr_keyboard->repeat_info.delay, 1));
+}
+
+/**
+ * phoc_seat_stop_accelerator_repeat:
+ * @self: The seat
+ * @keyboard:(nullable): The keyboard the key got released on
+ * @keycode: The xkb keycode of the released key
+ *
+ * Stops repeating the current accelerator if it's triggered by
+ * @keycode on @keyboard. A %NULL @keyboard matches any keyboard and
+ * `XKB_KEYCODE_INVALID` any key.
+ */
+void
+phoc_seat_stop_accelerator_repeat (PhocSeat *self, PhocKeyboard *keyboard, xkb_keycode_t keycode)
+{
+  PhocSeatPrivate *priv;
+
+  g_assert (PHOC_IS_SEAT (self));
+  priv = phoc_seat_get_instance_private (self);
+
+  if (!priv->accelerator_repeat.keyboard)
+    return;
+
+  if (keyboard && keyboard != priv->accelerator_repeat.keyboard)
+    return;
+
+  if (keycode != XKB_KEYCODE_INVALID && keycode != priv->accelerator_repeat.keycode)
+    return;
+
+  priv->accelerator_repeat.keyboard = NULL;
+  /* Disarm but keep the timer around for the next key press */
+  wl_event_source_timer_update (priv->accelerator_repeat.timer, 0);
+}
+
+
+static int
+handle_activity_timer (void *data)
+{
+  PhocSeat *self = PHOC_SEAT (data);
+  PhocSeatPrivate *priv = phoc_seat_get_instance_private (self);
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+
+  priv->activity.armed = FALSE;
+  if (!priv->activity.pending)
+    return 0;
+
+  priv->activity.pending = FALSE;
+  /* Rearms the timer so continuous input is reported once per interval */
+  phoc_desktop_notify_activity (desktop, self);
+
+  return 0;
+}
+
+/**
+ * phoc_seat_throttle_activity:
+ * @self: The seat
+ *
+ * Rate limits reporting user activity on the seat so continuous input
+ * like scrolling doesn't reset the idle timers on every event. The
+ * first activity is reported right away, further activity within
+ * `ACTIVITY_INTERVAL_MS` is only flagged and reported once the
+ * interval is over.
+ *
+ * Returns: %TRUE if the activity shouldn't be reported now
+ */
+gboolean
+phoc_seat_throttle_activity (PhocSeat *self)
+{
+  PhocSeatPrivate *priv;
+
+  g_assert (PHOC_IS_SEAT (self));
+  priv = phoc_seat_get_instance_private (self);
+
+  if (priv->activity.armed) {
+    priv->activity.pending = TRUE;
+    return TRUE;
+  }
+
+  if (!priv->activity.timer) {
+    struct wl_display *wl_display = phoc_server_get_wl_display (phoc_server_get_default ());
+    struct wl_event_loop *loop = wl_display_get_event_loop (wl_display);
+
+    priv->activity.timer = wl_event_loop_add_timer (loop, handle_activity_timer, self);
+  }
+
+  wl_event_source_timer_update (priv->activity.timer, ACTIVITY_INTERVAL_MS);
+  priv->activity.armed = TRUE;
+
+  return FALSE;
+}
@@ -9,6 +9,7 @@
 #include "drag-icon.h"
 #include "input.h"
 #include "input-method-relay.h"
+#include "keybindings.h"
 #include "layer-shell.h"
 
 #include <wlr/types/wlr_switch.h>
@@ -24,6 +25,7 @@ G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE (PhocSeat, phoc_seat, PHOC, SEAT, GObject)
 
 typedef struct _PhocCursor PhocCursor;
+typedef struct _PhocKeyboard PhocKeyboard;
 typedef struct _PhocTablet PhocTablet;
 
 /**
@@ -75,6 +77,7 @@ typedef struct _PhocSeat {
 typedef struct _PhocSeatView {
   PhocSeat          *seat;
   PhocView          *view;
+  GList             *link; /* The seat's views */
 
   bool               has_button_grab;
   double             grab_sx;
@@ -113,6 +116,18 @@ typedef struct _PhocTabletTool {
 
   PhocTablet                       *current_tablet;
   struct wl_listener                tablet_destroy;
+
+  /* Axis events merged until the next output frame */
+  gboolean                          coalesce;
+  struct wlr_tablet_tool_axis_event pending_axis;
+  GWeakRef                          pending_tablet;
+  PhocOutput                       *flush_output;
+  guint                             flush_id;
+  guint                             flush_timeout_id;
+  /* Whether the surface under the tool opted into full rate events */
+  gboolean                          full_rate;
+  /* Only used for comparison, never dereferenced */
+  struct wlr_surface               *full_rate_surface;
 } PhocTabletTool;
 
 
@@ -130,6 +145,8 @@ void               phoc_seat_add_device (PhocSeat                *seat,
                                          struct wlr_input_device *device);
 
 void               phoc_seat_configure_cursor (PhocSeat *seat);
+void               phoc_seat_remove_output_mappings (PhocSeat   *seat,
+                                                     PhocOutput *output);
 PhocCursor        *phoc_seat_get_cursor (PhocSeat *self);
 
 bool               phoc_seat_grab_meta_press (PhocSeat *seat);
@@ -167,3 +184,12 @@ gboolean           phoc_seat_has_switch   (PhocSeat *self, enum wlr_switch_type
 void               phoc_seat_update_last_touch_serial (PhocSeat *self, uint32_t serial);
 void               phoc_seat_update_last_button_serial (PhocSeat *self, uint32_t serial);
 uint32_t           phoc_seat_get_last_button_or_touch_serial (PhocSeat *self);
+
+void               phoc_seat_start_accelerator_repeat (PhocSeat           *self,
+                                                       PhocKeyboard       *keyboard,
+                                                       xkb_keycode_t       keycode,
+                                                       const PhocKeyCombo *combo);
+void               phoc_seat_stop_accelerator_repeat  (PhocSeat           *self,
+                                                       PhocKeyboard       *keyboard,
+                                                       xkb_keycode_t       keycode);
+gboolean           phoc_seat_throttle_activity        (PhocSeat           *self);
@@ -9,11 +9,15 @@
 #define G_LOG_DOMAIN "phoc-server"
 
 #include "phoc-config.h"
+#include "phoc-tracing.h"
+#include "anim/timed-animation.h"
+#include "debug-dbus.h"
 #include "render.h"
 #include "render-private.h"
 #include "utils.h"
 #include "seat.h"
 #include "server.h"
+#include "stall-watchdog.h"
 
 #include <gmobile.h>
 
@@ -28,6 +32,8 @@
 #endif /* WLROOTS_HAS_ANDROID_RENDERER */
 
 #include <errno.h>
+#include <glib-unix.h>
+#include <signal.h>
 
 /* Maximum protocol versions we support */
 #define PHOC_WL_DISPLAY_VERSION 6
@@ -49,9 +55,21 @@ typedef struct _PhocServer {
   PhocConfig          *config;
   PhocServerFlags      flags;
   PhocServerDebugFlags debug_flags;
+  gboolean             power_saver;
 
   PhocRenderer        *renderer;
   PhocDesktop         *desktop;
+  PhocDebugDBus       *debug_dbus;
+  PhocInputLatency    *input_latency;
+  PhocInputTrace      *input_trace;
+  PhocTimelineTrace   *timeline_trace;
+  guint                timeline_signal_id;
+  PhocMemoryStats     *memory_stats;
+  PhocCommitStats     *commit_stats;
+  PhocStallWatchdog   *stall_watchdog;
+  PhocClientBudget    *client_budget;
+  PhocThreadPriority  *thread_priority;
+  GFileMonitor        *config_monitor;
 
   gchar               *session_exec;
   gint                 exit_status;
@@ -59,6 +77,9 @@ typedef struct _PhocServer {
 
   GStrv                dt_compatibles;
 
+  gint64               startup_us;
+  GArray              *startup_phases;
+
   struct wl_display   *wl_display;
   guint                wl_source;
 
@@ -71,6 +92,11 @@ typedef struct _PhocServer {
   struct wlr_data_device_manager *data_device_manager;
 } PhocServer;
 
+typedef struct {
+  const char *name;
+  gint64      us;
+} PhocStartupPhase;
+
 static void phoc_server_initable_iface_init (GInitableIface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (PhocServer, phoc_server, G_TYPE_OBJECT,
@@ -82,6 +108,27 @@ typedef struct {
 } WaylandEventSource;
 
 
+/*
+ * Flush the clients the user interacts with first so their events,
+ * like frame callbacks and input, don't queue up behind background
+ * clients with lots of pending events.
+ */
+static void
+flush_priority_clients (struct wl_display *display)
+{
+  PhocServer *server = phoc_server_get_default ();
+  struct wl_client *client;
+
+  if (!server->desktop)
+    return;
+
+  wl_client_for_each (client, wl_display_get_client_list (display)) {
+    if (phoc_desktop_get_client_priority (server->desktop, client))
+      wl_client_flush (client);
+  }
+}
+
+
 static gboolean
 wayland_event_source_prepare (GSource *base,
                               int     *timeout)
@@ -90,6 +137,7 @@ wayland_event_source_prepare (GSource *base,
 
   *timeout = -1;
 
+  flush_priority_clients (source->display);
   wl_display_flush_clients (source->display);
 
   return FALSE;
@@ -100,10 +148,7 @@ wayland_event_source_dispatch (GSource     *base,
                                GSourceFunc callback,
                                void        *data)
 {
-  WaylandEventSource *source = (WaylandEventSource *)base;
-  struct wl_event_loop *loop = wl_display_get_event_loop (source->display);
-
-  wl_event_loop_dispatch (loop, 0);
+  phoc_server_dispatch (phoc_server_get_default ());
 
   return TRUE;
 }
@@ -161,8 +206,10 @@ on_session_exit (GPid pid, gint status, PhocServer *self)
 
 
 static void
-on_child_setup (gpointer unused)
+on_child_setup (gpointer data)
 {
+  /* Only async-signal-safe calls after fork, so no type checks */
+  PhocServer *self = data;
   sigset_t mask;
 
   /* phoc wants SIGUSR1 blocked due to wlroots/xwayland but we
@@ -170,6 +217,9 @@ on_child_setup (gpointer unused)
   sigemptyset(&mask);
   sigaddset(&mask, SIGUSR1);
   sigprocmask(SIG_UNBLOCK, &mask, NULL);
+
+  if (self->thread_priority)
+    phoc_thread_priority_restore_child (self->thread_priority);
 }
 
 
@@ -209,6 +259,29 @@ phoc_startup_session (PhocServer *server)
 }
 
 
+static gboolean
+on_timeline_flush_signal (gpointer data)
+{
+  PhocServer *self = PHOC_SERVER (data);
+  g_autofree char *path = NULL;
+  g_autoptr (GError) err = NULL;
+
+  if (!self->timeline_trace)
+    return G_SOURCE_CONTINUE;
+
+  path = g_build_filename (g_get_user_runtime_dir (), "phoc-timeline.json", NULL);
+  if (phoc_timeline_trace_save (self->timeline_trace, path, &err))
+    g_message ("Saved timeline trace to %s", path);
+  else
+    g_warning ("Failed to save timeline trace: %s", err->message);
+
+  /* Start over so consecutive dumps don't overlap */
+  phoc_server_set_timeline_trace (self, phoc_timeline_trace_new ());
+
+  return G_SOURCE_CONTINUE;
+}
+
+
 static void
 on_shell_state_changed (PhocServer *self, GParamSpec *pspec, PhocPhoshPrivate *phosh)
 {
@@ -223,6 +296,7 @@ on_shell_state_changed (PhocServer *self, GParamSpec *pspec, PhocPhoshPrivate *p
 
   switch (state) {
   case PHOC_PHOSH_PRIVATE_SHELL_STATE_UP:
+    phoc_server_mark_startup_phase (self, "shell-up");
     /* Shell is up, lower shields */
     wl_list_for_each (output, &self->desktop->outputs, link)
       phoc_output_lower_shield (output);
@@ -296,6 +370,7 @@ phoc_server_initable_init (GInitable    *initable,
                  "Could not create backend");
     return FALSE;
   }
+  phoc_server_mark_startup_phase (self, "backend");
 
   self->renderer = phoc_renderer_new (self->backend, error);
   if (self->renderer == NULL) {
@@ -303,6 +378,7 @@ phoc_server_initable_init (GInitable    *initable,
   }
   wlr_renderer = phoc_renderer_get_wlr_renderer (self->renderer);
   wlr_renderer_init_wl_shm (wlr_renderer, self->wl_display);
+  phoc_server_mark_startup_phase (self, "renderer");
 
 #ifdef WLROOTS_HAS_ANDROID_RENDERER
   if (wlr_renderer_is_android (wlr_renderer)) {
@@ -356,10 +432,24 @@ phoc_server_finalize (GObject *object)
 {
   PhocServer *self = PHOC_SERVER (object);
 
+  g_clear_object (&self->config_monitor);
   g_clear_pointer (&self->dt_compatibles, g_strfreev);
+  g_clear_pointer (&self->startup_phases, g_array_unref);
   g_clear_handle_id (&self->wl_source, g_source_remove);
+  g_clear_pointer (&self->stall_watchdog, phoc_stall_watchdog_free);
+  g_clear_object (&self->debug_dbus);
+  g_clear_object (&self->input_latency);
+  g_clear_pointer (&self->input_trace, phoc_input_trace_free);
+  g_clear_handle_id (&self->timeline_signal_id, g_source_remove);
+  g_clear_pointer (&self->timeline_trace, phoc_timeline_trace_free);
+  g_clear_object (&self->memory_stats);
+  g_clear_object (&self->commit_stats);
+  g_clear_object (&self->client_budget);
+  g_clear_object (&self->thread_priority);
   g_clear_object (&self->input);
   g_clear_object (&self->desktop);
+  /* All animatables are gone so no pooled animation is in use anymore */
+  phoc_timed_animation_clear_pool ();
   g_clear_pointer (&self->session_exec, g_free);
 
   if (self->inited) {
@@ -389,6 +479,9 @@ phoc_server_init (PhocServer *self)
 {
   g_autoptr (GError) err = NULL;
 
+  self->startup_us = g_get_monotonic_time ();
+  self->startup_phases = g_array_new (FALSE, FALSE, sizeof (PhocStartupPhase));
+
   self->dt_compatibles = gm_device_tree_get_compatibles (NULL, &err);
 }
 
@@ -419,6 +512,68 @@ phoc_server_get_default (void)
   return instance;
 }
 
+static void
+on_config_file_changed (PhocServer        *self,
+                        GFile             *file,
+                        GFile             *other_file,
+                        GFileMonitorEvent  event,
+                        GFileMonitor      *monitor)
+{
+  g_autoptr (PhocConfig) config = NULL;
+  g_autoptr (GPtrArray) changed = NULL;
+  PhocOutput *output;
+
+  if (event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT && event != G_FILE_MONITOR_EVENT_CREATED)
+    return;
+
+  config = phoc_config_new_from_file (self->config->config_path);
+  if (config == NULL)
+    return;
+
+  /* Only touch outputs whose configuration actually changed */
+  changed = g_ptr_array_new ();
+  wl_list_for_each (output, &self->desktop->outputs, link) {
+    if (!phoc_output_config_equal (phoc_config_get_output (self->config, output),
+                                   phoc_config_get_output (config, output))) {
+      g_ptr_array_add (changed, output);
+    }
+  }
+
+  phoc_config_take_outputs (self->config, config);
+  g_message ("Reloaded output configuration from %s, %u outputs changed",
+             self->config->config_path, changed->len);
+
+  for (guint i = 0; i < changed->len; i++) {
+    output = g_ptr_array_index (changed, i);
+    phoc_output_apply_config (output, phoc_config_get_output (self->config, output));
+  }
+
+  if (changed->len)
+    phoc_desktop_update_lid_policy (self->desktop);
+}
+
+
+static void
+watch_config (PhocServer *self)
+{
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GError) err = NULL;
+
+  if (self->config->config_path == NULL)
+    return;
+
+  file = g_file_new_for_path (self->config->config_path);
+  self->config_monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, &err);
+  if (self->config_monitor == NULL) {
+    g_warning ("Failed to watch %s: %s", self->config->config_path, err->message);
+    return;
+  }
+
+  g_signal_connect_object (self->config_monitor, "changed",
+                           G_CALLBACK (on_config_file_changed),
+                           self, G_CONNECT_SWAPPED);
+}
+
 /**
  * phoc_server_setup:
  * @self: The server
@@ -442,12 +597,15 @@ phoc_server_setup (PhocServer *self, PhocConfig *config,
   g_assert (!self->inited);
 
   self->config = config;
+  self->thread_priority = phoc_thread_priority_new (config);
   self->flags = flags;
   self->debug_flags = debug_flags;
   self->mainloop = mainloop;
   self->exit_status = 1;
   self->desktop = phoc_desktop_new ();
+  phoc_server_mark_startup_phase (self, "desktop");
   self->input = phoc_input_new ();
+  phoc_server_mark_startup_phase (self, "input");
   self->session_exec = g_strdup (exec);
   self->mainloop = mainloop;
 
@@ -466,6 +624,7 @@ phoc_server_setup (PhocServer *self, PhocConfig *config,
     wl_display_destroy (self->wl_display);
     return FALSE;
   }
+  phoc_server_mark_startup_phase (self, "backend-started");
 
   g_setenv("WAYLAND_DISPLAY", socket, true);
 
@@ -478,14 +637,58 @@ phoc_server_setup (PhocServer *self, PhocConfig *config,
     on_shell_state_changed (self, NULL, phoc_desktop_get_phosh_private (self->desktop));
   }
 
+  if (self->config->stall_threshold_ms)
+    self->stall_watchdog = phoc_stall_watchdog_new (self->wl_display,
+                                                    self->config->stall_threshold_ms);
   phoc_wayland_init (self);
+  self->debug_dbus = phoc_debug_dbus_new ();
+  if (self->debug_flags & PHOC_SERVER_DEBUG_FLAG_INPUT_LATENCY)
+    self->input_latency = phoc_input_latency_new (self->compositor);
+  if (self->debug_flags & PHOC_SERVER_DEBUG_FLAG_TIMELINE) {
+    self->timeline_trace = phoc_timeline_trace_new ();
+    if (self->stall_watchdog)
+      phoc_stall_watchdog_set_timeline_trace (self->stall_watchdog, self->timeline_trace);
+    self->timeline_signal_id = g_unix_signal_add (SIGUSR2, on_timeline_flush_signal, self);
+  }
+  self->memory_stats = phoc_memory_stats_new (self->compositor,
+                                              self->config->memory_warn_threshold);
+  self->commit_stats = phoc_commit_stats_new ();
+  self->client_budget = phoc_client_budget_new (self->config->client_thumbnail_rate,
+                                                self->config->client_subscriptions,
+                                                self->config->client_thumbnail_memory);
+  watch_config (self);
   if (self->session_exec)
     phoc_startup_session (self);
 
+  phoc_server_mark_startup_phase (self, "setup");
   self->inited = TRUE;
   return TRUE;
 }
 
+/**
+ * phoc_server_dispatch:
+ * @self: The server
+ *
+ * Dispatches the Wayland event loop's pending events, i.e. client
+ * requests, input and backend events and Wayland timers.
+ */
+void
+phoc_server_dispatch (PhocServer *self)
+{
+  struct wl_event_loop *loop;
+
+  g_assert (PHOC_IS_SERVER (self));
+
+  loop = wl_display_get_event_loop (self->wl_display);
+  if (self->stall_watchdog)
+    phoc_stall_watchdog_dispatch_begin (self->stall_watchdog);
+
+  wl_event_loop_dispatch (loop, 0);
+
+  if (self->stall_watchdog)
+    phoc_stall_watchdog_dispatch_end (self->stall_watchdog);
+}
+
 /**
  * phoc_server_get_exit_status:
  * @self: The server
@@ -595,9 +798,31 @@ phoc_server_get_config (PhocServer *self)
 gboolean
 phoc_server_check_debug_flags (PhocServer *self, PhocServerDebugFlags check)
 {
+  PhocServerDebugFlags flags;
+
   g_assert (PHOC_IS_SERVER (self));
 
-  return !!(self->debug_flags & check);
+  flags = self->debug_flags;
+  if (G_UNLIKELY (self->power_saver))
+    flags &= ~PHOC_SERVER_DEBUG_FLAGS_POWER_HUNGRY;
+
+  return !!(flags & check);
+}
+
+/**
+ * phoc_server_set_power_saver:
+ * @self: The server
+ * @power_saver: Whether the system saves power
+ *
+ * While saving power the debug flags that cost extra rendering on
+ * every frame are ignored.
+ */
+void
+phoc_server_set_power_saver (PhocServer *self, gboolean power_saver)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  self->power_saver = power_saver;
 }
 
 /**
@@ -653,6 +878,210 @@ phoc_server_get_compositor (PhocServer *self)
 }
 
 
+/**
+ * phoc_server_get_input_latency:
+ * @self: The server
+ *
+ * Get the input latency tracker. It only exists when the
+ * `input-latency` debug flag is set.
+ *
+ * Returns:(transfer none)(nullable): The input latency tracker
+ */
+PhocInputLatency *
+phoc_server_get_input_latency (PhocServer *self)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  return self->input_latency;
+}
+
+/**
+ * phoc_server_get_input_trace:
+ * @self: The server
+ *
+ * Get the trace input events are currently recorded to.
+ *
+ * Returns:(transfer none)(nullable): The input trace
+ */
+PhocInputTrace *
+phoc_server_get_input_trace (PhocServer *self)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  return self->input_trace;
+}
+
+/**
+ * phoc_server_get_memory_stats:
+ * @self: The server
+ *
+ * Get the accounting of the buffers held for clients.
+ *
+ * Returns:(transfer none): The memory accounting object
+ */
+PhocMemoryStats *
+phoc_server_get_memory_stats (PhocServer *self)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  return self->memory_stats;
+}
+
+/**
+ * phoc_server_get_commit_stats:
+ * @self: The server
+ *
+ * Get the commit statistics of clients, views and layer surfaces.
+ *
+ * Returns:(transfer none): The commit statistics object
+ */
+PhocCommitStats *
+phoc_server_get_commit_stats (PhocServer *self)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  return self->commit_stats;
+}
+
+/**
+ * phoc_server_get_client_budget:
+ * @self: The server
+ *
+ * Get the limits on resources clients can make the compositor allocate.
+ *
+ * Returns:(transfer none): The client budget
+ */
+PhocClientBudget *
+phoc_server_get_client_budget (PhocServer *self)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  return self->client_budget;
+}
+
+/**
+ * phoc_server_get_thread_priority:
+ * @self: The server
+ *
+ * Get the object managing the scheduling of the compositor thread.
+ *
+ * Returns:(transfer none): The thread priority
+ */
+PhocThreadPriority *
+phoc_server_get_thread_priority (PhocServer *self)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  return self->thread_priority;
+}
+
+/**
+ * phoc_server_mark_startup_phase:
+ * @self: The server
+ * @phase:(transfer none): A static string naming the phase
+ *
+ * Records that startup reached @phase. Only the first time a phase
+ * is reached is recorded so this can be called for things like the
+ * first presented frame unconditionally.
+ */
+void
+phoc_server_mark_startup_phase (PhocServer *self, const char *phase)
+{
+  PhocStartupPhase entry = { .name = phase, .us = g_get_monotonic_time () };
+
+  g_assert (PHOC_IS_SERVER (self));
+
+  for (guint i = 0; i < self->startup_phases->len; i++) {
+    if (g_str_equal (g_array_index (self->startup_phases, PhocStartupPhase, i).name, phase))
+      return;
+  }
+
+  DTRACE_PROBE1 (phoc, startup_phase, phase);
+  g_debug ("Startup phase '%s' reached after %.3fms", phase,
+           (entry.us - self->startup_us) / 1000.0);
+  g_array_append_val (self->startup_phases, entry);
+}
+
+/**
+ * phoc_server_startup_phases_to_variant:
+ * @self: The server
+ *
+ * Serializes the startup phases reached so far as `a(sx)`: the name
+ * and the time in µs since the server got created, in order.
+ *
+ * Returns: (transfer floating): The startup phases
+ */
+GVariant *
+phoc_server_startup_phases_to_variant (PhocServer *self)
+{
+  GVariantBuilder builder;
+
+  g_assert (PHOC_IS_SERVER (self));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sx)"));
+  for (guint i = 0; i < self->startup_phases->len; i++) {
+    PhocStartupPhase *entry = &g_array_index (self->startup_phases, PhocStartupPhase, i);
+
+    g_variant_builder_add (&builder, "(sx)", entry->name, entry->us - self->startup_us);
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * phoc_server_get_timeline_trace:
+ * @self: The server
+ *
+ * Get the trace the compositor's timeline is currently recorded to.
+ *
+ * Returns:(transfer none)(nullable): The timeline trace
+ */
+PhocTimelineTrace *
+phoc_server_get_timeline_trace (PhocServer *self)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  return self->timeline_trace;
+}
+
+/**
+ * phoc_server_set_timeline_trace:
+ * @self: The server
+ * @trace:(transfer full)(nullable): The trace to record to
+ *
+ * Sets the trace the compositor's timeline gets recorded to. Pass
+ * %NULL to stop recording.
+ */
+void
+phoc_server_set_timeline_trace (PhocServer *self, PhocTimelineTrace *trace)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  g_clear_pointer (&self->timeline_trace, phoc_timeline_trace_free);
+  self->timeline_trace = trace;
+
+  if (self->stall_watchdog)
+    phoc_stall_watchdog_set_timeline_trace (self->stall_watchdog, trace);
+}
+
+/**
+ * phoc_server_set_input_trace:
+ * @self: The server
+ * @trace:(transfer full)(nullable): The trace to record to
+ *
+ * Sets the trace input events get recorded to. Pass %NULL to stop
+ * recording.
+ */
+void
+phoc_server_set_input_trace (PhocServer *self, PhocInputTrace *trace)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  g_clear_pointer (&self->input_trace, phoc_input_trace_free);
+  self->input_trace = trace;
+}
+
+
 struct wlr_session *
 phoc_server_get_session (PhocServer *self)
 {
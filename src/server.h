@@ -9,10 +9,17 @@
 
 #pragma once
 
+#include "client-budget.h"
+#include "commit-stats.h"
 #include "desktop.h"
 #include "input.h"
+#include "input-latency.h"
+#include "input-trace.h"
+#include "memory-stats.h"
 #include "render.h"
 #include "settings.h"
+#include "thread-priority.h"
+#include "timeline-trace.h"
 
 #include <wayland-server-core.h>
 #include <wlr/backend.h>
@@ -48,8 +55,18 @@ typedef enum _PhocServerDebugFlags {
   PHOC_SERVER_DEBUG_FLAG_CUTOUTS            = 1 << 5,
   PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS = 1 << 6,
   PHOC_SERVER_DEBUG_FLAG_FORCE_SHELL_REVEAL = 1 << 7,
+  PHOC_SERVER_DEBUG_FLAG_INPUT_LATENCY      = 1 << 8,
+  PHOC_SERVER_DEBUG_FLAG_RENDER_LIST        = 1 << 9,
+  PHOC_SERVER_DEBUG_FLAG_LOG_RING           = 1 << 10,
+  PHOC_SERVER_DEBUG_FLAG_DAMAGE_HEATMAP     = 1 << 11,
+  PHOC_SERVER_DEBUG_FLAG_TIMELINE           = 1 << 12,
 } PhocServerDebugFlags;
 
+/* Debug flags that add rendering work to every frame */
+#define PHOC_SERVER_DEBUG_FLAGS_POWER_HUNGRY (PHOC_SERVER_DEBUG_FLAG_DAMAGE_TRACKING | \
+                                              PHOC_SERVER_DEBUG_FLAG_TOUCH_POINTS |    \
+                                              PHOC_SERVER_DEBUG_FLAG_DAMAGE_HEATMAP)
+
 
 PhocServer            *phoc_server_get_default             (void);
 gboolean               phoc_server_setup                   (PhocServer *self,
@@ -60,6 +77,9 @@ gboolean               phoc_server_setup                   (PhocServer *self,
                                                             PhocServerDebugFlags debug_flags);
 gboolean               phoc_server_check_debug_flags       (PhocServer *self,
                                                             PhocServerDebugFlags check);
+void                   phoc_server_dispatch                (PhocServer *self);
+void                   phoc_server_set_power_saver         (PhocServer *self,
+                                                            gboolean    power_saver);
 const char            *phoc_server_get_session_exec        (PhocServer *self);
 gint                   phoc_server_get_session_exit_status (PhocServer *self);
 PhocRenderer          *phoc_server_get_renderer            (PhocServer *self);
@@ -72,6 +92,20 @@ struct wlr_session    *phoc_server_get_session             (PhocServer *self);
 struct wlr_backend    *phoc_server_get_backend             (PhocServer *self);
 struct wlr_compositor *phoc_server_get_compositor          (PhocServer *self);
 struct wl_display     *phoc_server_get_wl_display          (PhocServer *self);
+PhocInputLatency      *phoc_server_get_input_latency       (PhocServer *self);
+PhocInputTrace        *phoc_server_get_input_trace         (PhocServer *self);
+PhocTimelineTrace     *phoc_server_get_timeline_trace      (PhocServer *self);
+PhocMemoryStats       *phoc_server_get_memory_stats        (PhocServer *self);
+PhocCommitStats       *phoc_server_get_commit_stats        (PhocServer *self);
+PhocClientBudget      *phoc_server_get_client_budget       (PhocServer *self);
+PhocThreadPriority    *phoc_server_get_thread_priority     (PhocServer *self);
+void                   phoc_server_mark_startup_phase      (PhocServer *self,
+                                                            const char *phase);
+GVariant              *phoc_server_startup_phases_to_variant (PhocServer *self);
+void                   phoc_server_set_input_trace         (PhocServer     *self,
+                                                            PhocInputTrace *trace);
+void                   phoc_server_set_timeline_trace      (PhocServer        *self,
+                                                            PhocTimelineTrace *trace);
 void                   phoc_server_set_linux_dmabuf_surface_feedback (PhocServer *self,
                                                                       PhocView   *view,
                                                                       PhocOutput *output,
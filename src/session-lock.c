@@ -0,0 +1,483 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-session-lock"
+
+#include "phoc-config.h"
+
+#include "desktop.h"
+#include "input.h"
+#include "seat.h"
+#include "server.h"
+#include "session-lock.h"
+
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_session_lock_v1.h>
+
+/**
+ * PhocSessionLock:
+ *
+ * Implements `ext-session-lock-v1`.
+ *
+ * Locking raises the shield of every output so the next frame is
+ * opaque no matter how long the lock screen takes to show up. Once
+ * every output presented that frame the client is told the session is
+ * locked. While locked only lock surfaces are rendered, get frame
+ * callbacks and receive input. The views and layer surfaces below
+ * aren't looked at at all, which also keeps a locked phone cheap to
+ * render. A lock surface fades in over the shield once it's mapped.
+ *
+ * If the locking client goes away without unlocking the session stays
+ * locked and outputs stay black until a new lock client shows up.
+ */
+struct _PhocSessionLock {
+  struct wlr_session_lock_manager_v1 *manager;
+  struct wl_listener                  new_lock;
+
+  gboolean                            locked;
+  /* The active lock, %NULL when unlocked or the lock client went away */
+  struct wlr_session_lock_v1         *lock;
+  struct wl_client                   *client;
+  struct wl_listener                  new_surface;
+  struct wl_listener                  unlock;
+  struct wl_listener                  destroy;
+  gboolean                            locked_sent;
+
+  /* Outputs that showed the shield since locking */
+  GHashTable                         *presented;
+  /* Outputs whose shield waits for a lock surface */
+  GHashTable                         *shielded;
+  GSList                             *surfaces; /* PhocSessionLockSurface */
+  struct wlr_surface                 *focused;
+};
+
+typedef struct {
+  PhocSessionLock                    *session_lock;
+  struct wlr_session_lock_surface_v1 *lock_surface;
+  struct wl_listener                  map;
+  struct wl_listener                  destroy;
+  struct wl_listener                  output_commit;
+} PhocSessionLockSurface;
+
+
+static PhocDesktop *
+get_desktop (void)
+{
+  return phoc_server_get_desktop (phoc_server_get_default ());
+}
+
+
+static void
+focus_surface (PhocSessionLock *self, struct wlr_surface *surface)
+{
+  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
+
+  self->focused = surface;
+
+  for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next) {
+    PhocSeat *seat = PHOC_SEAT (elem->data);
+    struct wlr_keyboard *keyboard = wlr_seat_get_keyboard (seat->seat);
+
+    if (!surface) {
+      wlr_seat_keyboard_clear_focus (seat->seat);
+      continue;
+    }
+
+    wlr_seat_keyboard_end_grab (seat->seat);
+    if (keyboard) {
+      wlr_seat_keyboard_notify_enter (seat->seat, surface, keyboard->keycodes,
+                                      keyboard->num_keycodes, &keyboard->modifiers);
+    } else {
+      wlr_seat_keyboard_notify_enter (seat->seat, surface, NULL, 0, NULL);
+    }
+  }
+}
+
+
+static void
+set_exclusive_client (struct wl_client *client)
+{
+  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
+
+  for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next)
+    phoc_seat_set_exclusive_client (PHOC_SEAT (elem->data), client);
+}
+
+
+static void
+check_locked (PhocSessionLock *self)
+{
+  PhocDesktop *desktop = get_desktop ();
+  PhocOutput *output;
+
+  if (!self->lock || self->locked_sent)
+    return;
+
+  /* Outputs that are off or going away show nothing anyway */
+  wl_list_for_each (output, &desktop->outputs, link) {
+    if (!output->wlr_output->enabled ||
+        !wlr_output_layout_get (desktop->layout, output->wlr_output)) {
+      continue;
+    }
+
+    if (!g_hash_table_contains (self->presented, output))
+      return;
+  }
+
+  g_debug ("Session locked");
+  wlr_session_lock_v1_send_locked (self->lock);
+  self->locked_sent = TRUE;
+}
+
+
+static void
+configure_surface (PhocSessionLockSurface *surface)
+{
+  int width, height;
+
+  wlr_output_effective_resolution (surface->lock_surface->output, &width, &height);
+  wlr_session_lock_surface_v1_configure (surface->lock_surface, width, height);
+}
+
+
+static void
+on_surface_output_commit (struct wl_listener *listener, void *data)
+{
+  PhocSessionLockSurface *surface = wl_container_of (listener, surface, output_commit);
+  struct wlr_output_event_commit *event = data;
+
+  if (event->state->committed & (WLR_OUTPUT_STATE_MODE |
+                                 WLR_OUTPUT_STATE_SCALE |
+                                 WLR_OUTPUT_STATE_TRANSFORM)) {
+    configure_surface (surface);
+  }
+}
+
+
+static void
+on_surface_map (struct wl_listener *listener, void *data)
+{
+  PhocSessionLockSurface *surface = wl_container_of (listener, surface, map);
+  PhocSessionLock *self = surface->session_lock;
+  PhocOutput *output = PHOC_OUTPUT (surface->lock_surface->output->data);
+
+  if (!self->focused)
+    focus_surface (self, surface->lock_surface->surface);
+
+  if (!output)
+    return;
+
+  /* Let the lock screen fade in */
+  if (g_hash_table_remove (self->shielded, output))
+    phoc_output_lower_shield (output);
+  phoc_output_damage_whole (output);
+}
+
+
+static void
+on_surface_destroy (struct wl_listener *listener, void *data)
+{
+  PhocSessionLockSurface *surface = wl_container_of (listener, surface, destroy);
+  PhocSessionLock *self = surface->session_lock;
+  PhocOutput *output = PHOC_OUTPUT (surface->lock_surface->output->data);
+
+  wl_list_remove (&surface->map.link);
+  wl_list_remove (&surface->destroy.link);
+  wl_list_remove (&surface->output_commit.link);
+  self->surfaces = g_slist_remove (self->surfaces, surface);
+
+  if (self->locked && self->focused == surface->lock_surface->surface) {
+    struct wlr_surface *next = NULL;
+
+    for (GSList *l = self->surfaces; l; l = l->next) {
+      PhocSessionLockSurface *other = l->data;
+
+      if (other->lock_surface->surface->mapped) {
+        next = other->lock_surface->surface;
+        break;
+      }
+    }
+    focus_surface (self, next);
+  }
+
+  if (output)
+    phoc_output_damage_whole (output);
+
+  g_free (surface);
+}
+
+
+static void
+on_new_surface (struct wl_listener *listener, void *data)
+{
+  PhocSessionLock *self = wl_container_of (listener, self, new_surface);
+  struct wlr_session_lock_surface_v1 *lock_surface = data;
+  PhocSessionLockSurface *surface = g_new0 (PhocSessionLockSurface, 1);
+
+  surface->session_lock = self;
+  surface->lock_surface = lock_surface;
+
+  surface->map.notify = on_surface_map;
+  wl_signal_add (&lock_surface->surface->events.map, &surface->map);
+  surface->destroy.notify = on_surface_destroy;
+  wl_signal_add (&lock_surface->events.destroy, &surface->destroy);
+  surface->output_commit.notify = on_surface_output_commit;
+  wl_signal_add (&lock_surface->output->events.commit, &surface->output_commit);
+
+  self->surfaces = g_slist_prepend (self->surfaces, surface);
+  configure_surface (surface);
+}
+
+
+static void
+clear_lock (PhocSessionLock *self)
+{
+  wl_list_remove (&self->new_surface.link);
+  wl_list_remove (&self->unlock.link);
+  wl_list_remove (&self->destroy.link);
+  self->lock = NULL;
+  self->client = NULL;
+}
+
+
+static void
+on_unlock (struct wl_listener *listener, void *data)
+{
+  PhocSessionLock *self = wl_container_of (listener, self, unlock);
+  PhocDesktop *desktop = get_desktop ();
+  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
+  PhocView *view = phoc_desktop_get_view_by_index (desktop, 0);
+  PhocOutput *output;
+
+  g_debug ("Session unlocked");
+  self->locked = FALSE;
+
+  /* Outputs that went away meanwhile were already dropped from the tables */
+  wl_list_for_each (output, &desktop->outputs, link) {
+    if (g_hash_table_contains (self->shielded, output))
+      phoc_output_lower_shield (output);
+    phoc_output_damage_whole (output);
+  }
+  g_hash_table_remove_all (self->shielded);
+  g_hash_table_remove_all (self->presented);
+
+  focus_surface (self, NULL);
+  set_exclusive_client (NULL);
+  for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next) {
+    PhocSeat *seat = PHOC_SEAT (elem->data);
+
+    if (view && phoc_view_is_mapped (view) && !seat->focused_layer)
+      phoc_seat_set_focus_view (seat, view);
+  }
+
+  clear_lock (self);
+}
+
+
+static void
+on_lock_destroy (struct wl_listener *listener, void *data)
+{
+  PhocSessionLock *self = wl_container_of (listener, self, destroy);
+
+  g_warning ("Lock client went away, session stays locked");
+  clear_lock (self);
+  set_exclusive_client (NULL);
+}
+
+
+static void
+on_new_lock (struct wl_listener *listener, void *data)
+{
+  PhocSessionLock *self = wl_container_of (listener, self, new_lock);
+  struct wlr_session_lock_v1 *lock = data;
+  PhocOutput *output;
+
+  if (self->lock) {
+    g_warning ("Session already locked, rejecting lock");
+    wlr_session_lock_v1_destroy (lock);
+    return;
+  }
+
+  self->lock = lock;
+  self->client = wl_resource_get_client (lock->resource);
+  self->locked_sent = FALSE;
+
+  self->new_surface.notify = on_new_surface;
+  wl_signal_add (&lock->events.new_surface, &self->new_surface);
+  self->unlock.notify = on_unlock;
+  wl_signal_add (&lock->events.unlock, &self->unlock);
+  self->destroy.notify = on_lock_destroy;
+  wl_signal_add (&lock->events.destroy, &self->destroy);
+
+  set_exclusive_client (self->client);
+
+  /* A new lock client taking over an abandoned lock */
+  if (self->locked) {
+    check_locked (self);
+    return;
+  }
+
+  g_debug ("Locking session");
+  self->locked = TRUE;
+  wl_list_for_each (output, &get_desktop ()->outputs, link) {
+    phoc_output_raise_shield (output);
+    g_hash_table_add (self->shielded, output);
+  }
+
+  check_locked (self);
+}
+
+
+PhocSessionLock *
+phoc_session_lock_new (struct wl_display *wl_display)
+{
+  PhocSessionLock *self = g_new0 (PhocSessionLock, 1);
+
+  self->manager = wlr_session_lock_manager_v1_create (wl_display);
+  self->new_lock.notify = on_new_lock;
+  wl_signal_add (&self->manager->events.new_lock, &self->new_lock);
+
+  self->presented = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->shielded = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  return self;
+}
+
+
+void
+phoc_session_lock_free (PhocSessionLock *self)
+{
+  for (GSList *l = self->surfaces; l; l = l->next) {
+    PhocSessionLockSurface *surface = l->data;
+
+    wl_list_remove (&surface->map.link);
+    wl_list_remove (&surface->destroy.link);
+    wl_list_remove (&surface->output_commit.link);
+    g_free (surface);
+  }
+  g_slist_free (self->surfaces);
+
+  if (self->lock)
+    clear_lock (self);
+
+  wl_list_remove (&self->new_lock.link);
+  g_hash_table_destroy (self->presented);
+  g_hash_table_destroy (self->shielded);
+  g_free (self);
+}
+
+/**
+ * phoc_session_lock_is_locked:
+ * @self: The session lock
+ *
+ * Returns: %TRUE if the session is locked
+ */
+gboolean
+phoc_session_lock_is_locked (PhocSessionLock *self)
+{
+  g_assert (self);
+
+  return self->locked;
+}
+
+/**
+ * phoc_session_lock_allow_client:
+ * @self: The session lock
+ * @client: The client
+ *
+ * Returns: %TRUE if @client may receive input
+ */
+gboolean
+phoc_session_lock_allow_client (PhocSessionLock *self, struct wl_client *client)
+{
+  g_assert (self);
+
+  if (!self->locked)
+    return TRUE;
+
+  return self->client && self->client == client;
+}
+
+/**
+ * phoc_session_lock_get_surface:
+ * @self: The session lock
+ * @output: The output
+ *
+ * Returns:(nullable)(transfer none): The mapped lock surface of
+ *   @output if the session is locked
+ */
+struct wlr_surface *
+phoc_session_lock_get_surface (PhocSessionLock *self, PhocOutput *output)
+{
+  g_assert (self);
+
+  if (!self->locked)
+    return NULL;
+
+  for (GSList *l = self->surfaces; l; l = l->next) {
+    PhocSessionLockSurface *surface = l->data;
+
+    if (surface->lock_surface->output == output->wlr_output &&
+        surface->lock_surface->surface->mapped) {
+      return surface->lock_surface->surface;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * phoc_session_lock_output_presented:
+ * @self: The session lock
+ * @output: The output
+ *
+ * Notes that @output committed a frame. Once all outputs did so since
+ * locking the lock client is told the session is locked.
+ */
+void
+phoc_session_lock_output_presented (PhocSessionLock *self, PhocOutput *output)
+{
+  g_assert (self);
+
+  if (!self->lock || self->locked_sent)
+    return;
+
+  g_hash_table_add (self->presented, output);
+  check_locked (self);
+}
+
+/**
+ * phoc_session_lock_remove_output:
+ * @self: The session lock
+ * @output: The output
+ *
+ * Forgets about @output as it's going away. If it was the last output
+ * that didn't present a frame since locking the lock client is told
+ * the session is locked.
+ */
+void
+phoc_session_lock_remove_output (PhocSessionLock *self, PhocOutput *output)
+{
+  g_assert (self);
+
+  g_hash_table_remove (self->presented, output);
+  g_hash_table_remove (self->shielded, output);
+  check_locked (self);
+}
+
+/**
+ * phoc_session_lock_get_global:
+ * @self: The session lock
+ *
+ * Returns:(transfer none): The protocol's global
+ */
+struct wl_global *
+phoc_session_lock_get_global (PhocSessionLock *self)
+{
+  g_assert (self);
+
+  return self->manager->global;
+}
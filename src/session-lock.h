@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "output.h"
+
+#include <glib.h>
+#include <wayland-server-core.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PhocSessionLock PhocSessionLock;
+
+PhocSessionLock    *phoc_session_lock_new              (struct wl_display *wl_display);
+void                phoc_session_lock_free             (PhocSessionLock   *self);
+gboolean            phoc_session_lock_is_locked        (PhocSessionLock   *self);
+gboolean            phoc_session_lock_allow_client     (PhocSessionLock   *self,
+                                                        struct wl_client  *client);
+struct wlr_surface *phoc_session_lock_get_surface      (PhocSessionLock   *self,
+                                                        PhocOutput        *output);
+void                phoc_session_lock_output_presented (PhocSessionLock   *self,
+                                                        PhocOutput        *output);
+void                phoc_session_lock_remove_output    (PhocSessionLock   *self,
+                                                        PhocOutput        *output);
+struct wl_global   *phoc_session_lock_get_global       (PhocSessionLock   *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocSessionLock, phoc_session_lock_free)
+
+G_END_DECLS
@@ -2,7 +2,9 @@
 
 #include "phoc-config.h"
 
+#include <drm_fourcc.h>
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
 #include <sys/param.h>
 
@@ -93,6 +95,51 @@ parse_scale_filter (const char *value)
 }
 
 
+static PhocOutputAdaptiveSync
+parse_adaptive_sync (const char *value)
+{
+  GEnumValue *ev;
+  g_autoptr (GEnumClass) eclass = NULL;
+
+  eclass = G_ENUM_CLASS (g_type_class_ref (phoc_output_adaptive_sync_get_type ()));
+  ev = g_enum_get_value_by_nick (eclass, value);
+  if (!ev) {
+    g_critical ("Got invalid output adaptive-sync value: %s", value);
+    return PHOC_OUTPUT_ADAPTIVE_SYNC_OFF;
+  }
+
+  return ev->value;
+}
+
+
+static const struct {
+  const char *name;
+  uint32_t    format;
+} render_formats[] = {
+  { "xrgb8888", DRM_FORMAT_XRGB8888 },
+  { "argb8888", DRM_FORMAT_ARGB8888 },
+  { "rgb565", DRM_FORMAT_RGB565 },
+  { "xrgb2101010", DRM_FORMAT_XRGB2101010 },
+  { "xbgr2101010", DRM_FORMAT_XBGR2101010 },
+  { "xbgr16161616f", DRM_FORMAT_XBGR16161616F },
+};
+
+
+static uint32_t
+parse_render_format (const char *value)
+{
+  for (int i = 0; i < G_N_ELEMENTS (render_formats); i++) {
+    if (strcasecmp (value, render_formats[i].name) == 0)
+      return render_formats[i].format;
+  }
+
+  if (strcasecmp (value, "auto") != 0)
+    g_critical ("Got invalid output render-format value: %s", value);
+
+  return DRM_FORMAT_INVALID;
+}
+
+
 static const char *output_prefix = "output:";
 
 static PhocOutputConfig *
@@ -109,6 +156,10 @@ phoc_output_config_new (const char *name)
   oc->y = -1;
   oc->scale_filter = PHOC_OUTPUT_SCALE_FILTER_AUTO;
   oc->drm_panel_orientation = false;
+  oc->render_format = DRM_FORMAT_INVALID;
+  oc->adaptive_sync = PHOC_OUTPUT_ADAPTIVE_SYNC_OFF;
+  oc->idle_refresh_rate = 0;
+  oc->idle_frames = 60;
 
   return oc;
 }
@@ -118,17 +169,43 @@ static void
 phoc_output_config_destroy (PhocOutputConfig *oc)
 {
   g_slist_free_full (oc->modes, g_free);
+  g_strfreev (oc->vmm);
   g_free (oc->name);
   g_free (oc);
 }
 
 
+static gboolean
+parse_mode (const char *value, struct PhocMode *mode)
+{
+  char *end;
+
+  mode->width = strtol (value, &end, 10);
+  if (*end != 'x')
+    return FALSE;
+  ++end;
+
+  mode->height = strtol (end, &end, 10);
+  if (*end) {
+    if (*end != '@')
+      return FALSE;
+    ++end;
+
+    mode->refresh_rate = strtof (end, &end);
+    if (strcmp ("Hz", end) != 0)
+      return FALSE;
+  }
+
+  return mode->width > 0 && mode->height > 0 && mode->refresh_rate >= 0;
+}
+
+
 static int
 config_ini_handler (PhocConfig *config, const char *section, const char *name, const char *value)
 {
   if (strcmp (section, "core") == 0) {
     if (strcmp (name, "xwayland") == 0) {
-      if (strcasecmp (value, "true") == 0) {
+      if (strcasecmp (value, "true") == 0 || strcasecmp (value, "lazy") == 0) {
         config->xwayland = true;
       } else if (strcasecmp (value, "immediate") == 0) {
         config->xwayland = true;
@@ -138,25 +215,97 @@ config_ini_handler (PhocConfig *config, const char *section, const char *name, c
       } else {
         g_critical ("got unknown xwayland value: %s", value);
       }
+    } else if (strcmp (name, "xwayland-idle-timeout") == 0) {
+      config->xwayland_idle_timeout = MAX (strtol (value, NULL, 10), 0);
+    } else if (strcmp (name, "damage-max-waste") == 0) {
+      config->damage_max_waste = CLAMP (g_ascii_strtod (value, NULL), 0.0, 1.0);
+    } else if (strcmp (name, "damage-max-rects") == 0) {
+      config->damage_max_rects = strtoul (value, NULL, 10);
+    } else if (strcmp (name, "frame-deadline-margin") == 0) {
+      config->frame_deadline_margin_us = MAX (g_ascii_strtod (value, NULL), 0.0) * 1000;
+    } else if (strcmp (name, "touch-motion") == 0) {
+      if (strcmp (value, "immediate") == 0) {
+        config->touch_motion = PHOC_TOUCH_MOTION_IMMEDIATE;
+      } else if (strcmp (value, "coalesce") == 0) {
+        config->touch_motion = PHOC_TOUCH_MOTION_COALESCE;
+      } else if (strcmp (value, "resample") == 0) {
+        config->touch_motion = PHOC_TOUCH_MOTION_RESAMPLE;
+      } else {
+        g_critical ("got unknown touch-motion: %s", value);
+      }
+    } else if (strcmp (name, "scaled-view-cache") == 0) {
+      config->scaled_view_cache = parse_boolean (value, false);
+    } else if (strcmp (name, "layer-cache") == 0) {
+      config->layer_cache = parse_boolean (value, false);
+    } else if (strcmp (name, "view-cache-frames") == 0) {
+      config->view_cache_frames = strtoul (value, NULL, 10);
+    } else if (strcmp (name, "scene-graph") == 0) {
+      config->scene_graph = parse_boolean (value, false);
+    } else if (strcmp (name, "prioritize-input") == 0) {
+      config->prioritize_input = parse_boolean (value, false);
+    } else if (strcmp (name, "memory-warn-threshold") == 0) {
+      config->memory_warn_threshold = g_ascii_strtoull (value, NULL, 10) * 1024 * 1024;
+    } else if (strcmp (name, "stall-threshold") == 0) {
+      config->stall_threshold_ms = strtoul (value, NULL, 10);
+    } else if (strcmp (name, "pointer-motion") == 0) {
+      if (strcmp (value, "immediate") == 0) {
+        config->pointer_motion = PHOC_POINTER_MOTION_IMMEDIATE;
+      } else if (strcmp (value, "coalesce") == 0) {
+        config->pointer_motion = PHOC_POINTER_MOTION_COALESCE;
+      } else {
+        g_critical ("got unknown pointer-motion: %s", value);
+      }
+    } else if (strcmp (name, "tablet-motion") == 0) {
+      if (strcmp (value, "immediate") == 0) {
+        config->tablet_motion = PHOC_TABLET_MOTION_IMMEDIATE;
+      } else if (strcmp (value, "coalesce") == 0) {
+        config->tablet_motion = PHOC_TABLET_MOTION_COALESCE;
+      } else {
+        g_critical ("got unknown tablet-motion: %s", value);
+      }
+    } else if (strcmp (name, "switch-debounce") == 0) {
+      config->switch_debounce_ms = MAX (strtol (value, NULL, 10), 0);
+    } else if (strcmp (name, "client-thumbnail-rate") == 0) {
+      config->client_thumbnail_rate = strtoul (value, NULL, 10);
+    } else if (strcmp (name, "client-subscriptions") == 0) {
+      config->client_subscriptions = strtoul (value, NULL, 10);
+    } else if (strcmp (name, "client-thumbnail-memory") == 0) {
+      config->client_thumbnail_memory = g_ascii_strtoull (value, NULL, 10) * 1024 * 1024;
+    } else if (strcmp (name, "scheduling") == 0) {
+      if (strcmp (value, "other") == 0) {
+        config->sched_policy = PHOC_SCHED_POLICY_OTHER;
+      } else if (strcmp (value, "rr") == 0) {
+        config->sched_policy = PHOC_SCHED_POLICY_RR;
+      } else if (strcmp (value, "fifo") == 0) {
+        config->sched_policy = PHOC_SCHED_POLICY_FIFO;
+      } else {
+        g_critical ("got unknown scheduling: %s", value);
+      }
+    } else if (strcmp (name, "scheduling-priority") == 0) {
+      config->sched_priority = CLAMP (strtol (value, NULL, 10), 1, 99);
+    } else if (strcmp (name, "scheduling-boost") == 0) {
+      if (strcmp (value, "always") == 0) {
+        config->sched_boost_animations = false;
+      } else if (strcmp (value, "animations") == 0) {
+        config->sched_boost_animations = true;
+      } else {
+        g_critical ("got unknown scheduling-boost: %s", value);
+      }
+    } else if (strcmp (name, "cpu-affinity") == 0) {
+      g_free (config->cpu_affinity);
+      config->cpu_affinity = g_strdup (value);
     } else {
       g_critical ("got unknown core config: %s", name);
     }
   } else if (strncmp (output_prefix, section, strlen (output_prefix)) == 0) {
     const char *output_name = section + strlen (output_prefix);
-    PhocOutputConfig *oc = NULL;
-
-    for (GSList *l = config->outputs; l; l = l->next) {
-      PhocOutputConfig *tmp = l->data;
-
-      if (g_str_equal (tmp->name, output_name)) {
-        oc = tmp;
-        break;
-      }
-    }
+    PhocOutputConfig *oc;
 
+    oc = g_hash_table_lookup (config->outputs_by_name, output_name);
     if (oc == NULL) {
       oc = phoc_output_config_new (output_name);
       config->outputs = g_slist_prepend (config->outputs, oc);
+      g_hash_table_insert (config->outputs_by_name, oc->name, oc);
     }
 
     if (strcmp (name, "enable") == 0) {
@@ -170,7 +319,10 @@ config_ini_handler (PhocConfig *config, const char *section, const char *name, c
         oc->scale = 0;
       } else {
         oc->scale = strtof (value, NULL);
-        g_assert (oc->scale > 0);
+        if (oc->scale <= 0) {
+          g_critical ("Invalid scale '%s' for output %s", value, oc->name);
+          oc->scale = 0;
+        }
       }
     } else if (strcmp (name, "rotate") == 0) {
       if (strcmp (value, "normal") == 0) {
@@ -195,20 +347,14 @@ config_ini_handler (PhocConfig *config, const char *section, const char *name, c
       /* Make sure we rotate clockwise */
       phoc_utils_fix_transform (&oc->transform);
     } else if (strcmp (name, "mode") == 0) {
-      char *end;
-      oc->mode.width = strtol (value, &end, 10);
-      g_assert (*end == 'x');
-      ++end;
-      oc->mode.height = strtol (end, &end, 10);
-      if (*end) {
-        g_assert (*end == '@');
-        ++end;
-        oc->mode.refresh_rate = strtof (end, &end);
-        g_assert (strcmp ("Hz", end) == 0);
+      if (parse_mode (value, &oc->mode)) {
+        g_debug ("Parsed mode %dx%d@%f for output %s",
+                 oc->mode.width, oc->mode.height,
+                 oc->mode.refresh_rate, oc->name);
+      } else {
+        g_critical ("Invalid mode '%s' for output %s", value, oc->name);
+        oc->mode = (struct PhocMode){ 0 };
       }
-      g_debug ("Parsed mode %dx%d@%f for output %s",
-               oc->mode.width, oc->mode.height,
-               oc->mode.refresh_rate, oc->name);
     } else if (strcmp (name, "modeline") == 0) {
       g_autofree PhocOutputModeConfig *mode = g_new0 (PhocOutputModeConfig, 1);
 
@@ -220,6 +366,24 @@ config_ini_handler (PhocConfig *config, const char *section, const char *name, c
       oc->scale_filter = parse_scale_filter (value);
     } else if (strcmp (name, "drm-panel-orientation") == 0) {
       oc->drm_panel_orientation = parse_boolean (value, true);
+    } else if (strcmp (name, "render-format") == 0) {
+      oc->render_format = parse_render_format (value);
+    } else if (strcmp (name, "adaptive-sync") == 0) {
+      oc->adaptive_sync = parse_adaptive_sync (value);
+    } else if (strcmp (name, "idle-refresh-rate") == 0) {
+      oc->idle_refresh_rate = MAX (g_ascii_strtod (value, NULL), 0.0);
+    } else if (strcmp (name, "idle-frames") == 0) {
+      oc->idle_frames = MAX (strtol (value, NULL, 10), 1);
+    } else if (strcmp (name, "buffer-count") == 0) {
+      if (strcmp (value, "auto") == 0) {
+        oc->buffer_count = 0;
+      } else {
+        oc->buffer_count = strtol (value, NULL, 10);
+        if (oc->buffer_count != 2 && oc->buffer_count != 3) {
+          g_critical ("Invalid buffer count '%s' for output %s", value, oc->name);
+          oc->buffer_count = 0;
+        }
+      }
     } else if (g_str_equal (name, "phys_width")) {
       oc->phys_width = strtol (value, NULL, 10);
     } else if (g_str_equal (name, "phys_height")) {
@@ -234,6 +398,33 @@ config_ini_handler (PhocConfig *config, const char *section, const char *name, c
   return 1;
 }
 
+/*
+ * Split "make%model%serial" sections once so matching outputs doesn't
+ * need to parse section names over and over.
+ */
+static void
+config_index_outputs (PhocConfig *config)
+{
+  for (GSList *l = config->outputs; l; l = l->next) {
+    PhocOutputConfig *oc = l->data;
+    g_auto (GStrv) vmm = NULL;
+
+    if (strchr (oc->name, '%') == NULL)
+      continue;
+
+    vmm = g_strsplit (oc->name, "%", 4);
+    if (g_strv_length (vmm) != 3) {
+      g_critical ("Output section '%s' is neither a connector nor make%%model%%serial",
+                  oc->name);
+      continue;
+    }
+
+    oc->vmm = g_steal_pointer (&vmm);
+    g_ptr_array_add (config->vmm_outputs, oc);
+  }
+}
+
+
 static PhocConfig *
 phoc_config_new_from_keyfile (GKeyFile *keyfile)
 {
@@ -243,7 +434,19 @@ phoc_config_new_from_keyfile (GKeyFile *keyfile)
 
   config->xwayland = true;
   config->xwayland_lazy = true;
+  config->xwayland_idle_timeout = PHOC_CONFIG_DEFAULT_XWAYLAND_IDLE_TIMEOUT;
+  config->damage_max_waste = PHOC_CONFIG_DEFAULT_DAMAGE_MAX_WASTE;
+  config->damage_max_rects = PHOC_CONFIG_DEFAULT_DAMAGE_MAX_RECTS;
+  config->tablet_motion = PHOC_TABLET_MOTION_COALESCE;
+  config->switch_debounce_ms = PHOC_CONFIG_DEFAULT_SWITCH_DEBOUNCE;
+  config->client_thumbnail_rate = PHOC_CONFIG_DEFAULT_CLIENT_THUMBNAIL_RATE;
+  config->client_subscriptions = PHOC_CONFIG_DEFAULT_CLIENT_SUBSCRIPTIONS;
+  config->client_thumbnail_memory = PHOC_CONFIG_DEFAULT_CLIENT_THUMBNAIL_MEMORY;
+  config->sched_priority = PHOC_CONFIG_DEFAULT_SCHED_PRIORITY;
+  config->stall_threshold_ms = PHOC_CONFIG_DEFAULT_STALL_THRESHOLD;
   config->keybindings = phoc_keybindings_new ();
+  config->outputs_by_name = g_hash_table_new (g_str_hash, g_str_equal);
+  config->vmm_outputs = g_ptr_array_new ();
 
   sections = g_key_file_get_groups (keyfile, NULL);
   for (int i = 0; i < g_strv_length (sections); i++) {
@@ -272,6 +475,8 @@ phoc_config_new_from_keyfile (GKeyFile *keyfile)
     }
   }
 
+  config_index_outputs (config);
+
   return config;
 }
 
@@ -354,37 +559,30 @@ phoc_config_new_from_data (const char *data)
 void
 phoc_config_destroy (PhocConfig *config)
 {
+  g_clear_pointer (&config->outputs_by_name, g_hash_table_destroy);
+  g_clear_pointer (&config->vmm_outputs, g_ptr_array_unref);
   g_slist_free_full (config->outputs, (GDestroyNotify)phoc_output_config_destroy);
   g_object_unref (config->keybindings);
 
+  g_free (config->cpu_affinity);
   g_free (config->config_path);
   g_free (config);
 }
 
 
 static gboolean
-output_is_match (PhocOutputConfig *oc, PhocOutput *output)
+vmm_field_match (const char *pattern, const char *value)
 {
-  g_auto (GStrv) vmm = NULL;
-
-  if (g_strcmp0 (oc->name, phoc_output_get_name (output)) == 0)
-    return TRUE;
-
-  /* "make%model%serial" match */
-  vmm = g_strsplit (oc->name, "%", 4);
-  if (g_strv_length (vmm) != 3)
-    return FALSE;
-
-  if (!(g_strcmp0 (vmm[0], "*") == 0 || g_strcmp0 (vmm[0], output->wlr_output->make) == 0))
-    return FALSE;
+  return g_str_equal (pattern, "*") || g_strcmp0 (pattern, value) == 0;
+}
 
-  if (!(g_strcmp0 (vmm[1], "*") == 0 || g_strcmp0 (vmm[1], output->wlr_output->model) == 0))
-    return FALSE;
 
-  if (!(g_strcmp0 (vmm[2], "*") == 0 || g_strcmp0 (vmm[2], output->wlr_output->serial) == 0))
-    return FALSE;
-
-  return TRUE;
+static gboolean
+output_is_vmm_match (PhocOutputConfig *oc, PhocOutput *output)
+{
+  return vmm_field_match (oc->vmm[0], output->wlr_output->make) &&
+    vmm_field_match (oc->vmm[1], output->wlr_output->model) &&
+    vmm_field_match (oc->vmm[2], output->wlr_output->serial);
 }
 
 /**
@@ -392,7 +590,9 @@ output_is_match (PhocOutputConfig *oc, PhocOutput *output)
  * config: The #PhocConfig
  * output: The output to get the configuration for
  *
- * Get intended configuration for the given output.
+ * Get intended configuration for the given output. A section matching
+ * the connector name takes precedence over "make%model%serial"
+ * sections.
  *
  * Returns: The intended output configuration or %NULL or not
  *     configuration is found.
@@ -400,14 +600,95 @@ output_is_match (PhocOutputConfig *oc, PhocOutput *output)
 PhocOutputConfig *
 phoc_config_get_output (PhocConfig *config, PhocOutput *output)
 {
+  PhocOutputConfig *oc;
+
   g_assert (PHOC_IS_OUTPUT (output));
 
-  for (GSList *l = config->outputs; l; l = l->next) {
-    PhocOutputConfig *oc = l->data;
+  oc = g_hash_table_lookup (config->outputs_by_name, phoc_output_get_name (output));
+  if (oc && oc->vmm == NULL)
+    return oc;
+
+  for (guint i = 0; i < config->vmm_outputs->len; i++) {
+    oc = g_ptr_array_index (config->vmm_outputs, i);
 
-    if (output_is_match (oc, output))
+    if (output_is_vmm_match (oc, output))
       return oc;
   }
 
   return NULL;
 }
+
+
+static gboolean
+output_mode_config_equal (GSList *modes, GSList *other)
+{
+  for (; modes && other; modes = modes->next, other = other->next) {
+    PhocOutputModeConfig *mode = modes->data, *other_mode = other->data;
+
+    if (memcmp (&mode->info, &other_mode->info, sizeof (mode->info)) != 0)
+      return FALSE;
+  }
+
+  return modes == NULL && other == NULL;
+}
+
+/**
+ * phoc_output_config_equal: (skip)
+ * @oc: (nullable): An output configuration
+ * @other: (nullable): Another output configuration
+ *
+ * Compares the settings of two output configurations ignoring the
+ * section name they were specified in.
+ *
+ * Returns: %TRUE if applying either one gives the same result
+ */
+gboolean
+phoc_output_config_equal (PhocOutputConfig *oc, PhocOutputConfig *other)
+{
+  if (oc == NULL || other == NULL)
+    return oc == other;
+
+  return oc->enable == other->enable &&
+    oc->transform == other->transform &&
+    oc->x == other->x &&
+    oc->y == other->y &&
+    oc->scale == other->scale &&
+    oc->scale_filter == other->scale_filter &&
+    oc->drm_panel_orientation == other->drm_panel_orientation &&
+    oc->render_format == other->render_format &&
+    oc->adaptive_sync == other->adaptive_sync &&
+    oc->idle_refresh_rate == other->idle_refresh_rate &&
+    oc->idle_frames == other->idle_frames &&
+    oc->buffer_count == other->buffer_count &&
+    oc->mode.width == other->mode.width &&
+    oc->mode.height == other->mode.height &&
+    oc->mode.refresh_rate == other->mode.refresh_rate &&
+    oc->phys_width == other->phys_width &&
+    oc->phys_height == other->phys_height &&
+    output_mode_config_equal (oc->modes, other->modes);
+}
+
+/**
+ * phoc_config_take_outputs: (skip)
+ * @config: The #PhocConfig
+ * @other: The #PhocConfig to take the output configurations from
+ *
+ * Replaces the output configurations of @config by the ones of
+ * @other, e.g. after reloading the config file. @other ends up with
+ * @config's previous output configurations.
+ */
+void
+phoc_config_take_outputs (PhocConfig *config, PhocConfig *other)
+{
+  GSList *outputs = config->outputs;
+  GHashTable *outputs_by_name = config->outputs_by_name;
+  GPtrArray *vmm_outputs = config->vmm_outputs;
+
+  config->outputs = other->outputs;
+  config->outputs_by_name = other->outputs_by_name;
+  config->vmm_outputs = other->vmm_outputs;
+
+  other->outputs = outputs;
+  other->outputs_by_name = outputs_by_name;
+  other->vmm_outputs = vmm_outputs;
+}
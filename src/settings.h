@@ -10,6 +10,69 @@
 G_BEGIN_DECLS
 
 #define PHOC_CONFIG_DEFAULT_SEAT_NAME "seat0"
+#define PHOC_CONFIG_DEFAULT_DAMAGE_MAX_WASTE 0.25
+#define PHOC_CONFIG_DEFAULT_DAMAGE_MAX_RECTS 8
+#define PHOC_CONFIG_DEFAULT_XWAYLAND_IDLE_TIMEOUT 10
+#define PHOC_CONFIG_DEFAULT_SWITCH_DEBOUNCE 100
+#define PHOC_CONFIG_DEFAULT_CLIENT_THUMBNAIL_RATE 120
+#define PHOC_CONFIG_DEFAULT_CLIENT_SUBSCRIPTIONS 256
+#define PHOC_CONFIG_DEFAULT_CLIENT_THUMBNAIL_MEMORY (256 * 1024 * 1024)
+#define PHOC_CONFIG_DEFAULT_SCHED_PRIORITY 2
+#define PHOC_CONFIG_DEFAULT_STALL_THRESHOLD 100
+
+/**
+ * PhocTouchMotionMode:
+ * @PHOC_TOUCH_MOTION_IMMEDIATE: Forward touch motion as it arrives
+ * @PHOC_TOUCH_MOTION_COALESCE: Forward the most recent motion per touch point once per frame
+ * @PHOC_TOUCH_MOTION_RESAMPLE: Like @PHOC_TOUCH_MOTION_COALESCE but predict the
+ *   position at presentation time
+ *
+ * How touch motion is delivered to clients.
+ */
+typedef enum {
+  PHOC_TOUCH_MOTION_IMMEDIATE = 0,
+  PHOC_TOUCH_MOTION_COALESCE,
+  PHOC_TOUCH_MOTION_RESAMPLE,
+} PhocTouchMotionMode;
+
+/**
+ * PhocPointerMotionMode:
+ * @PHOC_POINTER_MOTION_IMMEDIATE: Update pointer focus on every motion event
+ * @PHOC_POINTER_MOTION_COALESCE: Update pointer focus at most once per frame
+ *
+ * How pointer motion updates pointer focus.
+ */
+typedef enum {
+  PHOC_POINTER_MOTION_IMMEDIATE = 0,
+  PHOC_POINTER_MOTION_COALESCE,
+} PhocPointerMotionMode;
+
+/**
+ * PhocTabletMotionMode:
+ * @PHOC_TABLET_MOTION_IMMEDIATE: Process tablet tool axis events as they arrive
+ * @PHOC_TABLET_MOTION_COALESCE: Merge the axis events of each tool and process
+ *   them once per frame
+ *
+ * How tablet tool axis events are delivered to clients.
+ */
+typedef enum {
+  PHOC_TABLET_MOTION_IMMEDIATE = 0,
+  PHOC_TABLET_MOTION_COALESCE,
+} PhocTabletMotionMode;
+
+/**
+ * PhocSchedPolicy:
+ * @PHOC_SCHED_POLICY_OTHER: The default time sharing scheduler
+ * @PHOC_SCHED_POLICY_RR: Realtime round robin scheduling
+ * @PHOC_SCHED_POLICY_FIFO: Realtime first in first out scheduling
+ *
+ * How the compositor thread is scheduled.
+ */
+typedef enum {
+  PHOC_SCHED_POLICY_OTHER = 0,
+  PHOC_SCHED_POLICY_RR,
+  PHOC_SCHED_POLICY_FIFO,
+} PhocSchedPolicy;
 
 typedef struct _PhocOutputModeConfig {
   drmModeModeInfo info;
@@ -23,6 +86,11 @@ typedef struct _PhocOutputConfig {
   float                    scale;
   PhocOutputScaleFilter    scale_filter;
   bool                     drm_panel_orientation;
+  uint32_t                 render_format; /* DRM_FORMAT_INVALID for the default */
+  PhocOutputAdaptiveSync   adaptive_sync;
+  float                    idle_refresh_rate;
+  guint                    idle_frames;
+  guint                    buffer_count; /* 0 to trust the renderer's buffer age */
 
   struct PhocMode {
     int   width, height;
@@ -31,15 +99,43 @@ typedef struct _PhocOutputConfig {
   GSList                  *modes;
 
   guint                    phys_width, phys_height;
+
+  /* "make%model%serial" split up, %NULL for connector names */
+  GStrv                    vmm;
 } PhocOutputConfig;
 
 typedef struct _PhocConfig {
   bool             xwayland;
   bool             xwayland_lazy;
+  guint            xwayland_idle_timeout;
+
+  double           damage_max_waste;
+  guint            damage_max_rects;
+  gint64           frame_deadline_margin_us;
+  PhocTouchMotionMode touch_motion;
+  PhocPointerMotionMode pointer_motion;
+  PhocTabletMotionMode tablet_motion;
+  guint            switch_debounce_ms;
+  guint64          memory_warn_threshold;
+  guint            stall_threshold_ms;
+  guint            client_thumbnail_rate;
+  guint            client_subscriptions;
+  guint64          client_thumbnail_memory;
+  PhocSchedPolicy  sched_policy;
+  guint            sched_priority;
+  bool             sched_boost_animations;
+  char            *cpu_affinity;
+  bool             scaled_view_cache;
+  bool             layer_cache;
+  guint            view_cache_frames;
+  bool             scene_graph;
+  bool             prioritize_input;
 
   PhocKeybindings *keybindings;
 
   GSList          *outputs;
+  GHashTable      *outputs_by_name; /* section name → PhocOutputConfig */
+  GPtrArray       *vmm_outputs;     /* PhocOutputConfig matching make%model%serial */
 
   char            *config_path;
 } PhocConfig;
@@ -48,6 +144,8 @@ PhocConfig       *phoc_config_new_from_file (const char *config_path);
 PhocConfig       *phoc_config_new_from_data (const char *data);
 void              phoc_config_destroy       (PhocConfig *config);
 PhocOutputConfig *phoc_config_get_output    (PhocConfig *config, PhocOutput *output);
+void              phoc_config_take_outputs  (PhocConfig *config, PhocConfig *other);
+gboolean          phoc_output_config_equal  (PhocOutputConfig *oc, PhocOutputConfig *other);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocConfig, phoc_config_destroy)
 
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-stall-watchdog"
+
+#include "phoc-config.h"
+
+#include "stall-watchdog.h"
+#include "utils.h"
+
+#include <sys/types.h>
+
+#define STALL_LOG_INTERVAL_US G_USEC_PER_SEC
+#define STALL_TRACK "stalls"
+
+/**
+ * PhocStallWatchdog:
+ *
+ * Measures how long the compositor's main loop is busy and logs
+ * stalls longer than the threshold together with what caused them so
+ * dropped frames and input lag in the field can be tracked down
+ * without a profiler.
+ *
+ * Wayland dispatch is split into segments by a protocol logger: each
+ * client request starts a new segment and the longest segment of a
+ * stalling dispatch is blamed. Time before the first request goes to
+ * the event loop's own sources like input devices, timers and output
+ * events. Since GLib has no hook around dispatching individual
+ * sources, the time spent in all other GLib sources of a main loop
+ * iteration is measured as a whole via a poll function wrapper.
+ *
+ * All of this is a couple of clock reads per dispatch so the watchdog
+ * is cheap enough to stay enabled. Logging is rate limited and stalls
+ * are recorded on the timeline if one is being captured.
+ */
+struct _PhocStallWatchdog {
+  struct wl_display         *wl_display;
+  struct wl_protocol_logger *logger;
+  GMainContext              *context;
+  GPollFunc                  poll_func;
+  gint64                     threshold_us;
+  PhocTimelineTrace         *timeline_trace;
+
+  /* The main loop iteration since poll returned */
+  gint64                     iteration_start_us;
+  gint64                     wayland_us;
+
+  /* The Wayland dispatch in progress */
+  gint64                     dispatch_start_us;
+  struct {
+    gint64                   start_us;
+    const char              *interface; /* NULL when not a client request */
+    const char              *request;
+    guint32                  id;
+    pid_t                    pid;
+  } segment, worst;
+  gint64                     worst_us;
+
+  guint64                    n_stalls;
+  guint                      n_suppressed;
+  gint64                     last_log_us;
+};
+
+/* GPollFunc has no user data */
+static PhocStallWatchdog *poll_watchdog;
+
+
+static void
+report_stall (PhocStallWatchdog *self,
+              const char        *source,
+              const char        *culprit,
+              gint64             culprit_us,
+              gint64             start_us,
+              gint64             end_us)
+{
+  gint64 duration_us = end_us - start_us;
+
+  self->n_stalls++;
+
+  if (self->timeline_trace) {
+    phoc_timeline_trace_add_span (self->timeline_trace, STALL_TRACK, culprit ?: source,
+                                  start_us, end_us, NULL, 0);
+  }
+
+  if (end_us - self->last_log_us < STALL_LOG_INTERVAL_US) {
+    self->n_suppressed++;
+    return;
+  }
+
+  if (culprit) {
+    g_message ("Main loop stalled for %.1f ms in %s, %.1f ms of which in %s%s",
+               duration_us / 1000.0, source, culprit_us / 1000.0, culprit,
+               self->n_suppressed ? " (more stalls since last report)" : "");
+  } else {
+    g_message ("Main loop stalled for %.1f ms in %s%s",
+               duration_us / 1000.0, source,
+               self->n_suppressed ? " (more stalls since last report)" : "");
+  }
+
+  self->last_log_us = end_us;
+  self->n_suppressed = 0;
+}
+
+
+static void
+close_segment (PhocStallWatchdog *self, gint64 now)
+{
+  gint64 segment_us = now - self->segment.start_us;
+
+  if (segment_us <= self->worst_us)
+    return;
+
+  self->worst = self->segment;
+  self->worst_us = segment_us;
+}
+
+
+static void
+on_protocol_message (void                                    *user_data,
+                     enum wl_protocol_logger_type             direction,
+                     const struct wl_protocol_logger_message *message)
+{
+  PhocStallWatchdog *self = user_data;
+  gint64 now;
+
+  /* Events are only queued, the time goes to the request sending them */
+  if (direction != WL_PROTOCOL_LOGGER_REQUEST || !self->dispatch_start_us)
+    return;
+
+  now = g_get_monotonic_time ();
+  close_segment (self, now);
+
+  self->segment.start_us = now;
+  self->segment.interface = wl_resource_get_class (message->resource);
+  self->segment.request = message->message->name;
+  self->segment.id = wl_resource_get_id (message->resource);
+  wl_client_get_credentials (wl_resource_get_client (message->resource),
+                             &self->segment.pid, NULL, NULL);
+}
+
+
+static gint
+watchdog_poll (GPollFD *fds, guint nfds, gint timeout)
+{
+  PhocStallWatchdog *self = poll_watchdog;
+  gint64 now = g_get_monotonic_time ();
+  gint ret;
+
+  /* Everything since poll returned, except Wayland dispatch, ran GLib sources */
+  if (self->iteration_start_us) {
+    gint64 start_us = self->iteration_start_us + self->wayland_us;
+
+    if (now - start_us > self->threshold_us)
+      report_stall (self, "GLib sources", NULL, 0, start_us, now);
+  }
+
+  ret = self->poll_func (fds, nfds, timeout);
+
+  self->iteration_start_us = g_get_monotonic_time ();
+  self->wayland_us = 0;
+
+  return ret;
+}
+
+
+PhocStallWatchdog *
+phoc_stall_watchdog_new (struct wl_display *wl_display, guint threshold_ms)
+{
+  PhocStallWatchdog *self = g_new0 (PhocStallWatchdog, 1);
+
+  g_assert (poll_watchdog == NULL);
+
+  self->wl_display = wl_display;
+  self->threshold_us = threshold_ms * 1000;
+  self->logger = wl_display_add_protocol_logger (wl_display, on_protocol_message, self);
+
+  self->context = g_main_context_ref (g_main_context_default ());
+  self->poll_func = g_main_context_get_poll_func (self->context);
+  poll_watchdog = self;
+  g_main_context_set_poll_func (self->context, watchdog_poll);
+
+  return self;
+}
+
+
+void
+phoc_stall_watchdog_free (PhocStallWatchdog *self)
+{
+  g_main_context_set_poll_func (self->context, self->poll_func);
+  g_main_context_unref (self->context);
+  poll_watchdog = NULL;
+
+  wl_protocol_logger_destroy (self->logger);
+  g_free (self);
+}
+
+/**
+ * phoc_stall_watchdog_dispatch_begin:
+ * @self: The watchdog
+ *
+ * Marks the start of dispatching the Wayland event loop.
+ */
+void
+phoc_stall_watchdog_dispatch_begin (PhocStallWatchdog *self)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  self->dispatch_start_us = now;
+  self->segment.start_us = now;
+  self->segment.interface = NULL;
+  self->worst_us = 0;
+}
+
+/**
+ * phoc_stall_watchdog_dispatch_end:
+ * @self: The watchdog
+ *
+ * Marks the end of dispatching the Wayland event loop and reports a
+ * stall if it took longer than the threshold.
+ */
+void
+phoc_stall_watchdog_dispatch_end (PhocStallWatchdog *self)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 start_us = self->dispatch_start_us;
+  g_autofree char *culprit = NULL;
+
+  close_segment (self, now);
+  self->dispatch_start_us = 0;
+  self->wayland_us += now - start_us;
+
+  if (now - start_us <= self->threshold_us)
+    return;
+
+  if (self->worst.interface) {
+    /* The client might be gone already so go by its pid */
+    g_autofree char *name = phoc_utils_get_pid_name (self->worst.pid);
+
+    culprit = g_strdup_printf ("%s#%u.%s from %s", self->worst.interface, self->worst.id,
+                               self->worst.request, name);
+  } else {
+    culprit = g_strdup ("event loop sources");
+  }
+
+  report_stall (self, "Wayland dispatch", culprit, self->worst_us, start_us, now);
+}
+
+/**
+ * phoc_stall_watchdog_set_timeline_trace:
+ * @self: The watchdog
+ * @trace:(nullable): The timeline to record stalls on
+ *
+ * Records stalls on @trace. The trace must outlive the watchdog
+ * or be unset before it goes away.
+ */
+void
+phoc_stall_watchdog_set_timeline_trace (PhocStallWatchdog *self, PhocTimelineTrace *trace)
+{
+  g_assert (self);
+
+  self->timeline_trace = trace;
+}
+
+/**
+ * phoc_stall_watchdog_get_n_stalls:
+ * @self: The watchdog
+ *
+ * Returns: The number of stalls seen so far, including the ones not logged
+ */
+guint64
+phoc_stall_watchdog_get_n_stalls (PhocStallWatchdog *self)
+{
+  g_assert (self);
+
+  return self->n_stalls;
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "timeline-trace.h"
+
+#include <glib.h>
+#include <wayland-server-core.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PhocStallWatchdog PhocStallWatchdog;
+
+PhocStallWatchdog *phoc_stall_watchdog_new                (struct wl_display *wl_display,
+                                                           guint              threshold_ms);
+void               phoc_stall_watchdog_free               (PhocStallWatchdog *self);
+void               phoc_stall_watchdog_dispatch_begin     (PhocStallWatchdog *self);
+void               phoc_stall_watchdog_dispatch_end       (PhocStallWatchdog *self);
+void               phoc_stall_watchdog_set_timeline_trace (PhocStallWatchdog *self,
+                                                           PhocTimelineTrace *trace);
+guint64            phoc_stall_watchdog_get_n_stalls       (PhocStallWatchdog *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocStallWatchdog, phoc_stall_watchdog_free)
+
+G_END_DECLS
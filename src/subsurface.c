@@ -11,6 +11,7 @@
 #include "phoc-config.h"
 
 #include "subsurface.h"
+#include "view.h"
 
 
 enum {
@@ -98,6 +99,8 @@ subsurface_handle_destroy (struct wl_listener *listener, void *data)
 {
   PhocSubsurface *self = wl_container_of (listener, self, destroy);
 
+  /* The surface is gone even if we're held elsewhere */
+  phoc_view_invalidate_surfaces (phoc_view_child_get_view (PHOC_VIEW_CHILD (self)));
   g_object_unref (self);
 }
 
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-thread-priority"
+#define _GNU_SOURCE
+
+#include "phoc-config.h"
+
+#include "desktop.h"
+#include "output.h"
+#include "server.h"
+#include "thread-priority.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+/* The nice level used when realtime scheduling isn't permitted */
+#define FALLBACK_NICE -10
+
+/**
+ * PhocThreadPriority:
+ *
+ * Applies the scheduling policy and CPU affinity configured in
+ * `phoc.ini` to the compositor thread so it isn't starved by busy
+ * clients or moved to slow cores on big.LITTLE systems.
+ *
+ * Realtime policies need `CAP_SYS_NICE` or a suitable
+ * `RLIMIT_RTPRIO`. When they're not permitted we fall back to a
+ * raised nice level. In `animations` boost mode the realtime policy is
+ * only used while any output has frame callbacks, see
+ * [method@Output.has_frame_callbacks].
+ *
+ * Children don't inherit the policy, the nice level or the affinity.
+ * The scheduling latency actually observed is recorded in the
+ * `wakeup` metric of [class@FrameStats].
+ */
+struct _PhocThreadPriority {
+  GObject          parent;
+
+  PhocSchedPolicy  policy;
+  guint            priority;
+  gboolean         boost_animations;
+
+  gboolean         realtime_allowed;
+  gboolean         boosted;
+  int              initial_nice;
+
+  gboolean         has_affinity;
+  cpu_set_t        initial_cpus;
+};
+
+G_DEFINE_TYPE (PhocThreadPriority, phoc_thread_priority, G_TYPE_OBJECT)
+
+
+static gboolean
+parse_cpu (const char *str, guint *cpu)
+{
+  char *end;
+  guint64 val;
+
+  val = g_ascii_strtoull (str, &end, 10);
+  if (end == str || *end != '\0' || val >= CPU_SETSIZE)
+    return FALSE;
+
+  *cpu = val;
+  return TRUE;
+}
+
+/*
+ * Parse a list of CPUs like "0,4-7"
+ */
+static gboolean
+parse_cpu_list (const char *str, cpu_set_t *cpus)
+{
+  g_auto (GStrv) parts = g_strsplit (str, ",", -1);
+
+  CPU_ZERO (cpus);
+
+  for (int i = 0; parts[i]; i++) {
+    g_auto (GStrv) range = g_strsplit (g_strstrip (parts[i]), "-", 2);
+    guint first, last;
+
+    if (!parse_cpu (range[0], &first))
+      return FALSE;
+
+    last = first;
+    if (range[1] && !parse_cpu (range[1], &last))
+      return FALSE;
+
+    if (last < first)
+      return FALSE;
+
+    for (guint cpu = first; cpu <= last; cpu++)
+      CPU_SET (cpu, cpus);
+  }
+
+  return CPU_COUNT (cpus) > 0;
+}
+
+
+static void
+set_affinity (PhocThreadPriority *self, const char *cpu_list)
+{
+  cpu_set_t cpus;
+
+  if (!parse_cpu_list (cpu_list, &cpus)) {
+    g_warning ("Invalid cpu-affinity '%s'", cpu_list);
+    return;
+  }
+
+  if (sched_getaffinity (0, sizeof (self->initial_cpus), &self->initial_cpus) < 0) {
+    g_warning ("Failed to get CPU affinity: %s", g_strerror (errno));
+    return;
+  }
+
+  if (sched_setaffinity (0, sizeof (cpus), &cpus) < 0) {
+    g_warning ("Failed to set CPU affinity to '%s': %s", cpu_list, g_strerror (errno));
+    return;
+  }
+
+  self->has_affinity = TRUE;
+  g_message ("Compositor thread runs on CPUs %s", cpu_list);
+}
+
+
+static gboolean
+set_nice (PhocThreadPriority *self, gboolean boost)
+{
+  int level = self->initial_nice;
+
+  if (boost) {
+    /* -1 is a valid nice level so check errno */
+    errno = 0;
+    self->initial_nice = getpriority (PRIO_PROCESS, 0);
+    if (self->initial_nice == -1 && errno) {
+      g_warning ("Failed to get nice level: %s", g_strerror (errno));
+      self->initial_nice = 0;
+    }
+    level = FALLBACK_NICE;
+  }
+
+  /* Going back to the previous, higher nice level is always permitted */
+  if (setpriority (PRIO_PROCESS, 0, level) < 0) {
+    g_warning ("Failed to set nice level %d: %s", level, g_strerror (errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static void
+apply_boost (PhocThreadPriority *self, gboolean boost)
+{
+  struct sched_param param = { 0 };
+  int policy = SCHED_OTHER;
+
+  if (self->boosted == boost)
+    return;
+
+  if (self->realtime_allowed) {
+    if (boost) {
+      policy = self->policy == PHOC_SCHED_POLICY_RR ? SCHED_RR : SCHED_FIFO;
+      param.sched_priority = self->priority;
+    }
+
+    if (sched_setscheduler (0, policy | SCHED_RESET_ON_FORK, &param) == 0) {
+      g_debug ("%s realtime scheduling", boost ? "Enabled" : "Disabled");
+      self->boosted = boost;
+      return;
+    }
+
+    g_message ("Realtime scheduling not possible (%s), using nice level %d instead",
+               g_strerror (errno), FALLBACK_NICE);
+    self->realtime_allowed = FALSE;
+  }
+
+  if (set_nice (self, boost))
+    self->boosted = boost;
+  else
+    self->policy = PHOC_SCHED_POLICY_OTHER;
+}
+
+
+static void
+phoc_thread_priority_class_init (PhocThreadPriorityClass *klass)
+{
+}
+
+
+static void
+phoc_thread_priority_init (PhocThreadPriority *self)
+{
+}
+
+/**
+ * phoc_thread_priority_new:
+ * @config: The configuration
+ *
+ * Applies the scheduling configuration to the calling thread which
+ * is expected to be the compositor's main thread.
+ *
+ * Returns: (transfer full): A new thread priority object
+ */
+PhocThreadPriority *
+phoc_thread_priority_new (PhocConfig *config)
+{
+  PhocThreadPriority *self = g_object_new (PHOC_TYPE_THREAD_PRIORITY, NULL);
+  struct sched_param param = { 0 };
+
+  self->policy = config->sched_policy;
+  self->priority = config->sched_priority;
+  self->boost_animations = config->sched_boost_animations;
+
+  if (config->cpu_affinity)
+    set_affinity (self, config->cpu_affinity);
+
+  if (self->policy == PHOC_SCHED_POLICY_OTHER)
+    return self;
+
+  /* Keep children from inheriting the policy and a negative nice level */
+  if (sched_setscheduler (0, SCHED_OTHER | SCHED_RESET_ON_FORK, &param) < 0)
+    g_warning ("Failed to set scheduling policy: %s", g_strerror (errno));
+
+  self->realtime_allowed = TRUE;
+  if (!self->boost_animations)
+    apply_boost (self, TRUE);
+
+  return self;
+}
+
+/**
+ * phoc_thread_priority_update:
+ * @self: The thread priority
+ *
+ * In `animations` boost mode use the realtime policy while any
+ * output has frame callbacks and drop it once they're done.
+ */
+void
+phoc_thread_priority_update (PhocThreadPriority *self)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  gboolean animating = FALSE;
+  PhocOutput *output;
+
+  g_assert (PHOC_IS_THREAD_PRIORITY (self));
+
+  if (self->policy == PHOC_SCHED_POLICY_OTHER || !self->boost_animations)
+    return;
+
+  wl_list_for_each (output, &desktop->outputs, link) {
+    if (phoc_output_has_frame_callbacks (output)) {
+      animating = TRUE;
+      break;
+    }
+  }
+
+  apply_boost (self, animating);
+}
+
+/**
+ * phoc_thread_priority_parse_cpu_list:
+ * @str: A list of CPUs like `0,4-7`
+ *
+ * Parses a CPU list as used by the `cpu-affinity` config option.
+ *
+ * Returns: (transfer full) (nullable): The CPUs in ascending order
+ *   without duplicates or %NULL if @str isn't a valid CPU list
+ */
+GArray *
+phoc_thread_priority_parse_cpu_list (const char *str)
+{
+  GArray *array;
+  cpu_set_t cpus;
+
+  g_assert (str);
+
+  if (!parse_cpu_list (str, &cpus))
+    return NULL;
+
+  array = g_array_sized_new (FALSE, FALSE, sizeof (guint), CPU_COUNT (&cpus));
+  for (guint cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET (cpu, &cpus))
+      g_array_append_val (array, cpu);
+  }
+
+  return array;
+}
+
+/**
+ * phoc_thread_priority_restore_child:
+ * @self: The thread priority
+ *
+ * Restores the CPU affinity phoc was started with. Meant to be
+ * called in the child after fork so spawned processes can use all
+ * CPUs again.
+ */
+void
+phoc_thread_priority_restore_child (PhocThreadPriority *self)
+{
+  if (self->has_affinity)
+    sched_setaffinity (0, sizeof (self->initial_cpus), &self->initial_cpus);
+}
+
+/**
+ * phoc_thread_priority_is_boosted:
+ * @self: The thread priority
+ *
+ * Returns: %TRUE if the compositor thread currently uses a realtime
+ *   policy or the fallback nice level
+ */
+gboolean
+phoc_thread_priority_is_boosted (PhocThreadPriority *self)
+{
+  g_assert (PHOC_IS_THREAD_PRIORITY (self));
+
+  return self->boosted;
+}
+
+/**
+ * phoc_thread_priority_reset_current_thread:
+ *
+ * Threads inherit the compositor thread's policy and nice level.
+ * Worker threads call this so background work doesn't compete with
+ * the compositor thread. Lowering the priority is always permitted.
+ */
+void
+phoc_thread_priority_reset_current_thread (void)
+{
+  struct sched_param param = { 0 };
+
+  if (sched_getscheduler (0) != SCHED_OTHER)
+    sched_setscheduler (0, SCHED_OTHER, &param);
+
+  /* On Linux this only affects the calling thread */
+  if (getpriority (PRIO_PROCESS, 0) < 0)
+    setpriority (PRIO_PROCESS, 0, 0);
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "settings.h"
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_THREAD_PRIORITY (phoc_thread_priority_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocThreadPriority, phoc_thread_priority, PHOC, THREAD_PRIORITY, GObject)
+
+PhocThreadPriority *phoc_thread_priority_new           (PhocConfig         *config);
+void                phoc_thread_priority_update        (PhocThreadPriority *self);
+void                phoc_thread_priority_restore_child (PhocThreadPriority *self);
+gboolean            phoc_thread_priority_is_boosted    (PhocThreadPriority *self);
+
+void                phoc_thread_priority_reset_current_thread (void);
+GArray             *phoc_thread_priority_parse_cpu_list       (const char *str);
+
+G_END_DECLS
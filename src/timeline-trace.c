@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-timeline-trace"
+
+#include "phoc-config.h"
+
+#include "timeline-trace.h"
+
+/**
+ * PhocTimelineTrace:
+ *
+ * Records what the compositor did when, e.g. output frames, rendering,
+ * client commits, input dispatch and animation ticks, so timelines can
+ * be collected on devices without root or systemtap.
+ *
+ * Events are kept in memory with the oldest ones getting dropped once
+ * [const@TIMELINE_TRACE_MAX_EVENTS] is reached. They're saved in the
+ * Chrome JSON trace event format which can be loaded into Perfetto's
+ * UI or `chrome://tracing`. Each track (e.g. an output) shows up as
+ * a thread of its own.
+ */
+struct _PhocTimelineTrace {
+  GArray *events;
+  /* Where the next event goes once the ring is full */
+  guint   next;
+};
+
+typedef struct {
+  const char *track;
+  const char *name;
+  const char *arg_name;
+  gint64      start_us;
+  gint64      dur_us; /* < 0 for instant events */
+  gint64      arg;
+} PhocTimelineTraceEvent;
+
+
+static void
+add_event (PhocTimelineTrace *self, const PhocTimelineTraceEvent *event)
+{
+  if (self->events->len < PHOC_TIMELINE_TRACE_MAX_EVENTS) {
+    g_array_append_vals (self->events, event, 1);
+    return;
+  }
+
+  g_array_index (self->events, PhocTimelineTraceEvent, self->next) = *event;
+  self->next = (self->next + 1) % PHOC_TIMELINE_TRACE_MAX_EVENTS;
+}
+
+
+static void
+append_json_string (GString *str, const char *value)
+{
+  g_string_append_c (str, '"');
+  for (const char *p = value; *p; p++) {
+    switch (*p) {
+    case '"':
+      g_string_append (str, "\\\"");
+      break;
+    case '\\':
+      g_string_append (str, "\\\\");
+      break;
+    default:
+      if ((guchar)*p < 0x20)
+        g_string_append_printf (str, "\\u%04x", (guchar)*p);
+      else
+        g_string_append_c (str, *p);
+    }
+  }
+  g_string_append_c (str, '"');
+}
+
+
+static void
+append_thread_name (GString *str, guint tid, const char *name)
+{
+  g_string_append_printf (str, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                          "\"args\":{\"name\":", tid);
+  append_json_string (str, name);
+  g_string_append (str, "}},\n");
+}
+
+
+PhocTimelineTrace *
+phoc_timeline_trace_new (void)
+{
+  PhocTimelineTrace *self = g_new0 (PhocTimelineTrace, 1);
+
+  self->events = g_array_new (FALSE, FALSE, sizeof (PhocTimelineTraceEvent));
+
+  return self;
+}
+
+
+void
+phoc_timeline_trace_free (PhocTimelineTrace *self)
+{
+  g_array_unref (self->events);
+  g_free (self);
+}
+
+/**
+ * phoc_timeline_trace_add_span:
+ * @self: The trace
+ * @track: The track the span is shown on, e.g. an output's name
+ * @name: The span's name
+ * @start_us: When the span started in `CLOCK_MONOTONIC` microseconds
+ * @end_us: When the span ended in `CLOCK_MONOTONIC` microseconds
+ * @arg_name:(nullable): The name of @arg or %NULL if the span has no argument
+ * @arg: An additional value like the damaged area
+ *
+ * Records something the compositor did from @start_us to @end_us.
+ */
+void
+phoc_timeline_trace_add_span (PhocTimelineTrace *self,
+                              const char        *track,
+                              const char        *name,
+                              gint64             start_us,
+                              gint64             end_us,
+                              const char        *arg_name,
+                              gint64             arg)
+{
+  PhocTimelineTraceEvent event = {
+    .track = g_intern_string (track),
+    .name = g_intern_string (name),
+    .arg_name = g_intern_string (arg_name),
+    .start_us = start_us,
+    .dur_us = MAX (end_us - start_us, 0),
+    .arg = arg,
+  };
+
+  g_assert (self);
+
+  add_event (self, &event);
+}
+
+/**
+ * phoc_timeline_trace_add_instant:
+ * @self: The trace
+ * @track: The track the event is shown on
+ * @name: The event's name, e.g. the committing client's app id
+ * @time_us: When the event happened in `CLOCK_MONOTONIC` microseconds
+ *
+ * Records something without a duration happening at @time_us.
+ */
+void
+phoc_timeline_trace_add_instant (PhocTimelineTrace *self,
+                                 const char        *track,
+                                 const char        *name,
+                                 gint64             time_us)
+{
+  PhocTimelineTraceEvent event = {
+    .track = g_intern_string (track),
+    .name = g_intern_string (name ?: "unknown"),
+    .start_us = time_us,
+    .dur_us = -1,
+  };
+
+  g_assert (self);
+
+  add_event (self, &event);
+}
+
+/**
+ * phoc_timeline_trace_get_n_events:
+ * @self: The trace
+ *
+ * Returns: The number of events kept in memory
+ */
+guint
+phoc_timeline_trace_get_n_events (PhocTimelineTrace *self)
+{
+  g_assert (self);
+
+  return self->events->len;
+}
+
+/**
+ * phoc_timeline_trace_to_json:
+ * @self: The trace
+ *
+ * Formats the recorded events, oldest first, as Chrome JSON trace.
+ *
+ * Returns:(transfer full): The trace
+ */
+char *
+phoc_timeline_trace_to_json (PhocTimelineTrace *self)
+{
+  g_autoptr (GHashTable) tids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  GString *str = g_string_new ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  guint len = self->events->len;
+
+  g_string_append (str, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+                   "\"args\":{\"name\":\"phoc\"}},\n");
+
+  for (guint i = 0; i < len; i++) {
+    PhocTimelineTraceEvent *event;
+    guint tid;
+
+    event = &g_array_index (self->events, PhocTimelineTraceEvent, (self->next + i) % len);
+
+    tid = GPOINTER_TO_UINT (g_hash_table_lookup (tids, event->track));
+    if (!tid) {
+      tid = g_hash_table_size (tids) + 1;
+      g_hash_table_insert (tids, (gpointer)event->track, GUINT_TO_POINTER (tid));
+      append_thread_name (str, tid, event->track);
+    }
+
+    g_string_append (str, "{\"name\":");
+    append_json_string (str, event->name);
+    if (event->dur_us < 0) {
+      g_string_append_printf (str, ",\"ph\":\"i\",\"s\":\"t\",\"ts\":%" G_GINT64_FORMAT,
+                              event->start_us);
+    } else {
+      g_string_append_printf (str, ",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT
+                              ",\"dur\":%" G_GINT64_FORMAT, event->start_us, event->dur_us);
+    }
+    g_string_append_printf (str, ",\"pid\":1,\"tid\":%u", tid);
+    if (event->arg_name) {
+      g_string_append (str, ",\"args\":{");
+      append_json_string (str, event->arg_name);
+      g_string_append_printf (str, ":%" G_GINT64_FORMAT "}", event->arg);
+    }
+    g_string_append (str, i + 1 < len ? "},\n" : "}\n");
+  }
+
+  /* Drop the separator after the metadata if there were no events */
+  if (!len)
+    g_string_truncate (str, str->len - 2);
+
+  g_string_append (str, "]}\n");
+
+  return g_string_free (str, FALSE);
+}
+
+/**
+ * phoc_timeline_trace_save:
+ * @self: The trace
+ * @path: The file to save the trace to
+ * @err: Return location for an error
+ *
+ * Saves the trace to @path, see [method@TimelineTrace.to_json].
+ *
+ * Returns: %TRUE on success, otherwise %FALSE
+ */
+gboolean
+phoc_timeline_trace_save (PhocTimelineTrace *self, const char *path, GError **err)
+{
+  g_autofree char *contents = phoc_timeline_trace_to_json (self);
+
+  return g_file_set_contents (path, contents, -1, err);
+}
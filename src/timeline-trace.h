@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Events kept in memory, older ones get dropped */
+#define PHOC_TIMELINE_TRACE_MAX_EVENTS 65536
+
+typedef struct _PhocTimelineTrace PhocTimelineTrace;
+
+PhocTimelineTrace *phoc_timeline_trace_new         (void);
+void               phoc_timeline_trace_free        (PhocTimelineTrace *self);
+void               phoc_timeline_trace_add_span    (PhocTimelineTrace *self,
+                                                    const char        *track,
+                                                    const char        *name,
+                                                    gint64             start_us,
+                                                    gint64             end_us,
+                                                    const char        *arg_name,
+                                                    gint64             arg);
+void               phoc_timeline_trace_add_instant (PhocTimelineTrace *self,
+                                                    const char        *track,
+                                                    const char        *name,
+                                                    gint64             time_us);
+guint              phoc_timeline_trace_get_n_events (PhocTimelineTrace *self);
+char              *phoc_timeline_trace_to_json     (PhocTimelineTrace *self);
+gboolean           phoc_timeline_trace_save        (PhocTimelineTrace *self,
+                                                    const char        *path,
+                                                    GError           **err);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocTimelineTrace, phoc_timeline_trace_free)
+
+G_END_DECLS
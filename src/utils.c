@@ -14,9 +14,12 @@
 #include "output.h"
 #include "utils.h"
 
+#include <drm_fourcc.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_fractional_scale_v1.h>
 
 #include <inttypes.h>
+#include <sys/types.h>
 #include <math.h>
 #include <wlr/util/box.h>
 
@@ -174,36 +177,380 @@ phoc_utils_is_damaged (const struct wlr_box    *box,
   return !!pixman_region32_not_empty (out_damage);
 }
 
+/**
+ * phoc_utils_region_area:
+ * @region: The region
+ *
+ * Computes the number of pixels covered by a region.
+ *
+ * Returns: The region's area in pixels
+ */
+guint64
+phoc_utils_region_area (const pixman_region32_t *region)
+{
+  const pixman_box32_t *rects;
+  guint64 area = 0;
+  int nrects;
+
+  rects = pixman_region32_rectangles ((pixman_region32_t *)region, &nrects);
+  for (int i = 0; i < nrects; i++)
+    area += (guint64)(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+
+  return area;
+}
+
+/**
+ * phoc_utils_region_scale_inward:
+ * @dst: (out): The destination region
+ * @src: The region to scale
+ * @scale_x: The horizontal scale to apply
+ * @scale_y: The vertical scale to apply
+ *
+ * Scales @src rounding each rectangle's edges towards its
+ * center. Unlike `wlr_region_scale` the result never covers pixels
+ * that are only partially covered by @src which makes it suitable for
+ * scaling opaque regions. @dst and @src may be the same region.
+ */
+void
+phoc_utils_region_scale_inward (pixman_region32_t       *dst,
+                                const pixman_region32_t *src,
+                                float                    scale_x,
+                                float                    scale_y)
+{
+  const pixman_box32_t *src_rects;
+  g_autofree pixman_box32_t *dst_rects = NULL;
+  int nrects, n = 0;
+
+  if (scale_x == 1.0f && scale_y == 1.0f) {
+    pixman_region32_copy (dst, (pixman_region32_t *)src);
+    return;
+  }
+
+  src_rects = pixman_region32_rectangles ((pixman_region32_t *)src, &nrects);
+  dst_rects = g_new (pixman_box32_t, MAX (nrects, 1));
+
+  for (int i = 0; i < nrects; i++) {
+    pixman_box32_t box = {
+      .x1 = ceil (src_rects[i].x1 * scale_x),
+      .y1 = ceil (src_rects[i].y1 * scale_y),
+      .x2 = floor (src_rects[i].x2 * scale_x),
+      .y2 = floor (src_rects[i].y2 * scale_y),
+    };
+
+    if (box.x1 >= box.x2 || box.y1 >= box.y2)
+      continue;
+
+    dst_rects[n++] = box;
+  }
+
+  pixman_region32_fini (dst);
+  pixman_region32_init_rects (dst, dst_rects, n);
+}
+
+
+static guint64
+box_area (const pixman_box32_t *box)
+{
+  return (guint64)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+
+static pixman_box32_t
+box_union (const pixman_box32_t *a, const pixman_box32_t *b)
+{
+  return (pixman_box32_t) {
+    .x1 = MIN (a->x1, b->x1),
+    .y1 = MIN (a->y1, b->y1),
+    .x2 = MAX (a->x2, b->x2),
+    .y2 = MAX (a->y2, b->y2),
+  };
+}
+
+/* The area of the bounding box of two boxes not covered by either of them */
+static guint64
+box_union_waste (const pixman_box32_t *a, const pixman_box32_t *b, guint64 *union_area)
+{
+  pixman_box32_t u = box_union (a, b);
+  guint64 covered = box_area (a) + box_area (b);
+
+  *union_area = box_area (&u);
+  return *union_area > covered ? *union_area - covered : 0;
+}
+
+/**
+ * phoc_utils_region_simplify:
+ * @region: (inout): The region to simplify
+ * @max_waste: The fraction of a merged rectangle allowed to be outside of @region
+ * @max_rects: The maximum number of rectangles to keep or `0` for no limit
+ *
+ * Merges rectangles of @region into their bounding box as long as
+ * less than @max_waste of the bounding box's area wasn't part of
+ * @region. If there are still more then @max_rects rectangles left the
+ * ones wasting the least area are merged until the limit is met. The
+ * resulting region is always a superset of @region.
+ *
+ * This trades overdraw for fewer, larger draws when damage is fragmented.
+ *
+ * Returns: The number of rectangles saved
+ */
+guint
+phoc_utils_region_simplify (pixman_region32_t *region, double max_waste, guint max_rects)
+{
+  const pixman_box32_t *rects;
+  g_autofree pixman_box32_t *boxes = NULL;
+  int nrects, n, n_after;
+  gboolean merged;
+
+  rects = pixman_region32_rectangles (region, &nrects);
+  if (nrects <= 1)
+    return 0;
+
+  boxes = g_memdup2 (rects, nrects * sizeof (pixman_box32_t));
+  n = nrects;
+
+  do {
+    merged = FALSE;
+    for (int i = 0; i < n; i++) {
+      for (int j = i + 1; j < n; j++) {
+        guint64 union_area, waste;
+
+        waste = box_union_waste (&boxes[i], &boxes[j], &union_area);
+        if (waste > max_waste * union_area)
+          continue;
+
+        boxes[i] = box_union (&boxes[i], &boxes[j]);
+        boxes[j--] = boxes[--n];
+        merged = TRUE;
+      }
+    }
+  } while (merged);
+
+  while (max_rects && n > max_rects) {
+    guint64 best = G_MAXUINT64;
+    int best_i = 0, best_j = 1;
+
+    for (int i = 0; i < n; i++) {
+      for (int j = i + 1; j < n; j++) {
+        guint64 union_area, waste;
+
+        waste = box_union_waste (&boxes[i], &boxes[j], &union_area);
+        if (waste < best) {
+          best = waste;
+          best_i = i;
+          best_j = j;
+        }
+      }
+    }
+
+    boxes[best_i] = box_union (&boxes[best_i], &boxes[best_j]);
+    boxes[best_j] = boxes[--n];
+  }
+
+  if (n == nrects)
+    return 0;
+
+  pixman_region32_fini (region);
+  pixman_region32_init_rects (region, boxes, n);
+
+  n_after = pixman_region32_n_rects (region);
+  return nrects > n_after ? nrects - n_after : 0;
+}
+
 
+/**
+ * phoc_utils_wlr_surface_update_scales:
+ * @surface: The surface
+ * @content_scale: The scale the compositor draws the surface's content with
+ *
+ * Tells the client the scale it should render @surface at. This is the
+ * highest scale of the outputs the surface is on multiplied by
+ * @content_scale so surfaces the compositor shrinks (e.g. views scaled
+ * to fit the output) can be rendered at the size they're displayed at
+ * right away via fractional-scale-v1. The integer preferred buffer scale
+ * never goes below the output's scale as clients can't render at less
+ * than 1.
+ *
+ * On rotated outputs the client is also asked to hand in buffers that
+ * are already rotated. These can be scanned out directly and don't
+ * need to be rotated when rendering.
+ */
 void
-phoc_utils_wlr_surface_update_scales (struct wlr_surface *surface)
+phoc_utils_wlr_surface_update_scales (struct wlr_surface *surface, float content_scale)
 {
   float scale = 1.0;
+  enum wl_output_transform transform = WL_OUTPUT_TRANSFORM_NORMAL;
+  gboolean first = TRUE;
 
   struct wlr_surface_output *surface_output;
   wl_list_for_each (surface_output, &surface->current_outputs, link) {
     if (surface_output->output->scale > scale)
       scale = surface_output->output->scale;
+
+    /* Only ask for pre-rotated buffers if all outputs agree */
+    if (first)
+      transform = surface_output->output->transform;
+    else if (transform != surface_output->output->transform)
+      transform = WL_OUTPUT_TRANSFORM_NORMAL;
+    first = FALSE;
   }
 
-  wlr_fractional_scale_v1_notify_scale (surface, scale);
   wlr_surface_set_preferred_buffer_scale (surface, ceil (scale));
+  wlr_surface_set_preferred_buffer_transform (surface, transform);
+
+  if (content_scale > 0.0f && content_scale < 1.0f)
+    scale *= content_scale;
+
+  wlr_fractional_scale_v1_notify_scale (surface, scale);
 }
 
 
 void
-phoc_utils_wlr_surface_enter_output (struct wlr_surface *wlr_surface, struct wlr_output *wlr_output)
+phoc_utils_wlr_surface_enter_output (struct wlr_surface *wlr_surface,
+                                     struct wlr_output  *wlr_output,
+                                     float               content_scale)
 {
   wlr_surface_send_enter (wlr_surface, wlr_output);
 
-  phoc_utils_wlr_surface_update_scales (wlr_surface);
+  phoc_utils_wlr_surface_update_scales (wlr_surface, content_scale);
 }
 
 
 void
-phoc_utils_wlr_surface_leave_output (struct wlr_surface *wlr_surface, struct wlr_output *wlr_output)
+phoc_utils_wlr_surface_leave_output (struct wlr_surface *wlr_surface,
+                                     struct wlr_output  *wlr_output,
+                                     float               content_scale)
 {
   wlr_surface_send_leave (wlr_surface, wlr_output);
 
-  phoc_utils_wlr_surface_update_scales (wlr_surface);
+  phoc_utils_wlr_surface_update_scales (wlr_surface, content_scale);
+}
+
+/**
+ * phoc_utils_wlr_surface_get_single_pixel_color:
+ * @surface: The surface
+ * @color: (out): The surface's premultiplied color
+ *
+ * Checks whether @surface shows a single pixel stretched to the
+ * surface's size as e.g. buffers from wp-single-pixel-buffer-v1 do
+ * for backgrounds and letterboxing. Such surfaces can be drawn as a
+ * solid rectangle instead of sampling a 1x1 texture.
+ *
+ * Returns: %TRUE if @surface shows a single pixel
+ */
+gboolean
+phoc_utils_wlr_surface_get_single_pixel_color (struct wlr_surface      *surface,
+                                               struct wlr_render_color *color)
+{
+  struct wlr_buffer *source;
+  const guint8 *pixel;
+  uint32_t format;
+  size_t stride;
+  void *data;
+  gboolean ret = TRUE;
+
+  if (surface->buffer == NULL || surface->buffer->base.width != 1 ||
+      surface->buffer->base.height != 1)
+    return FALSE;
+
+  source = surface->buffer->source;
+  if (source == NULL)
+    return FALSE;
+
+  if (!wlr_buffer_begin_data_ptr_access (source, WLR_BUFFER_DATA_PTR_ACCESS_READ,
+                                         &data, &format, &stride))
+    return FALSE;
+
+  /* Little endian byte order, ARGB is premultiplied */
+  pixel = data;
+  switch (format) {
+  case DRM_FORMAT_ARGB8888:
+    *color = (struct wlr_render_color) {
+      pixel[2] / 255.0f, pixel[1] / 255.0f, pixel[0] / 255.0f, pixel[3] / 255.0f
+    };
+    break;
+  case DRM_FORMAT_XRGB8888:
+    *color = (struct wlr_render_color) {
+      pixel[2] / 255.0f, pixel[1] / 255.0f, pixel[0] / 255.0f, 1.0f
+    };
+    break;
+  default:
+    ret = FALSE;
+  }
+
+  wlr_buffer_end_data_ptr_access (source);
+  return ret;
+}
+
+/**
+ * phoc_utils_get_client_name:
+ * @wl_client: The client
+ *
+ * Get a name for @wl_client suitable for diagnostics. This is the
+ * client's process name or the PID if that can't be determined.
+ *
+ * Returns:(transfer full): The name
+ */
+char *
+phoc_utils_get_client_name (struct wl_client *wl_client)
+{
+  pid_t pid;
+
+  wl_client_get_credentials (wl_client, &pid, NULL, NULL);
+
+  return phoc_utils_get_pid_name (pid);
+}
+
+/**
+ * phoc_utils_get_pid_name:
+ * @pid: The process id
+ *
+ * Like [func@utils_get_client_name] but for clients that might
+ * be gone already.
+ *
+ * Returns:(transfer full): The process name or @pid if that can't be
+ * determined
+ */
+char *
+phoc_utils_get_pid_name (pid_t pid)
+{
+  g_autofree char *path = NULL;
+  g_autofree char *comm = NULL;
+
+  path = g_strdup_printf ("/proc/%d/comm", pid);
+  if (!g_file_get_contents (path, &comm, NULL, NULL))
+    return g_strdup_printf ("%d", pid);
+
+  return g_strdup (g_strstrip (comm));
+}
+
+/**
+ * phoc_utils_xcursor_manager_get_size:
+ * @manager:(nullable): The xcursor manager
+ *
+ * Get the size of the cursor images loaded by @manager for all
+ * scales.
+ *
+ * Returns: The size in bytes
+ */
+gsize
+phoc_utils_xcursor_manager_get_size (struct wlr_xcursor_manager *manager)
+{
+  struct wlr_xcursor_manager_theme *scaled_theme;
+  gsize size = 0;
+
+  if (!manager)
+    return 0;
+
+  wl_list_for_each (scaled_theme, &manager->scaled_themes, link) {
+    struct wlr_xcursor_theme *theme = scaled_theme->theme;
+
+    for (unsigned int i = 0; i < theme->cursor_count; i++) {
+      struct wlr_xcursor *cursor = theme->cursors[i];
+
+      for (unsigned int j = 0; j < cursor->image_count; j++)
+        size += (gsize)cursor->images[j]->width * cursor->images[j]->height * 4;
+    }
+  }
+
+  return size;
 }
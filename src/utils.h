@@ -7,10 +7,14 @@
 
 #pragma once
 
+#include "phoc-config.h"
 #include "output.h"
 
 #include <glib.h>
+#include <sys/types.h>
+#include <wlr/render/pass.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_xcursor_manager.h>
 
 G_BEGIN_DECLS
 
@@ -35,6 +39,19 @@ G_BEGIN_DECLS
  */
 #define PHOC_PRIV_CONTAINER(c, t, p)  (c)(PHOC_PRIV_CONTAINER_P(t,p))
 
+/**
+ * phoc_assert_hot:
+ * expr: The expression to check
+ *
+ * Like `g_assert()` but for code that runs for every item of every
+ * frame. Compiled out when building with `-Dhot-path-checks=false`.
+ */
+#ifdef PHOC_HOT_PATH_CHECKS
+# define phoc_assert_hot(expr) g_assert (expr)
+#else
+# define phoc_assert_hot(expr) G_STMT_START { (void) 0; } G_STMT_END
+#endif
+
 void       phoc_utils_fix_transform         (enum wl_output_transform *transform);
 float      phoc_utils_compute_scale         (int32_t phys_width, int32_t phys_height,
                                              int32_t width, int32_t height);
@@ -43,12 +60,28 @@ gboolean   phoc_utils_is_damaged            (const struct wlr_box    *box,
                                              const pixman_region32_t *damage,
                                              const struct wlr_box    *clip_box,
                                              pixman_region32_t       *out_damage);
+guint64    phoc_utils_region_area           (const pixman_region32_t *region);
+void       phoc_utils_region_scale_inward   (pixman_region32_t       *dst,
+                                             const pixman_region32_t *src,
+                                             float                    scale_x,
+                                             float                    scale_y);
+guint      phoc_utils_region_simplify       (pixman_region32_t       *region,
+                                             double                   max_waste,
+                                             guint                    max_rects);
 
-void       phoc_utils_wlr_surface_update_scales (struct wlr_surface *surface);
+void       phoc_utils_wlr_surface_update_scales (struct wlr_surface *surface,
+                                                 float               content_scale);
 void       phoc_utils_wlr_surface_enter_output  (struct wlr_surface *wlr_surface,
-                                                 struct wlr_output  *wlr_output);
+                                                 struct wlr_output  *wlr_output,
+                                                 float               content_scale);
 void       phoc_utils_wlr_surface_leave_output  (struct wlr_surface *wlr_surface,
-                                                 struct wlr_output  *wlr_output);
+                                                 struct wlr_output  *wlr_output,
+                                                 float               content_scale);
+gboolean   phoc_utils_wlr_surface_get_single_pixel_color (struct wlr_surface      *surface,
+                                                          struct wlr_render_color *color);
 
+char      *phoc_utils_get_client_name           (struct wl_client   *wl_client);
+char      *phoc_utils_get_pid_name              (pid_t               pid);
+gsize      phoc_utils_xcursor_manager_get_size  (struct wlr_xcursor_manager *manager);
 
 G_END_DECLS
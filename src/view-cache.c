@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-view-cache"
+
+#include "phoc-config.h"
+
+#include "render-private.h"
+#include "view-cache.h"
+
+#include <drm_fourcc.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/types/wlr_buffer.h>
+
+/**
+ * PhocViewCache:
+ *
+ * The surfaces of a view composited into a single texture. Views made
+ * up of many static subsurfaces (like a browser's UI) then cost a
+ * single draw call per damaged frame instead of one per surface.
+ *
+ * Like [type@LayerCache] whether the texture is up to date is
+ * determined by comparing render summaries, so any commit, move or
+ * resize of one of the view's surfaces drops it. It's only rebuilt
+ * from an idle callback once the summary didn't change for a given
+ * number of frames. The texture is kept in transformed output buffer
+ * coordinates so it's only valid for the output it got rendered for.
+ */
+struct _PhocViewCache {
+  struct wlr_renderer     *wlr_renderer;
+  struct wlr_allocator    *wlr_allocator;
+  PhocViewCacheUpdateFunc  update_func;
+  gpointer                 update_data;
+
+  PhocOutput              *output;
+  struct wlr_buffer       *buffer;
+  struct wlr_texture      *texture;
+  struct wlr_box           box;
+  pixman_region32_t        opaque;
+  /* What the texture shows */
+  GArray                  *summary;
+  gboolean                 valid;
+
+  /* What the last frame wanted to show and for how many frames */
+  GArray                  *last_summary;
+  guint                    n_stable_frames;
+  guint                    idle_id;
+};
+
+
+static struct wlr_buffer *
+create_buffer (PhocViewCache *self, int width, int height)
+{
+  struct wlr_drm_format_set fmt_set = {};
+  const struct wlr_drm_format *fmt;
+  struct wlr_buffer *buffer;
+
+  wlr_drm_format_set_add (&fmt_set, DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_INVALID);
+  fmt = wlr_drm_format_set_get (&fmt_set, DRM_FORMAT_ARGB8888);
+
+  buffer = wlr_allocator_create_buffer (self->wlr_allocator, width, height, fmt);
+  wlr_drm_format_set_finish (&fmt_set);
+
+  return buffer;
+}
+
+
+static void
+drop_texture (PhocViewCache *self)
+{
+  self->valid = FALSE;
+  g_clear_pointer (&self->texture, wlr_texture_destroy);
+  g_clear_pointer (&self->buffer, wlr_buffer_drop);
+}
+
+
+static gboolean
+on_idle_update (gpointer data)
+{
+  PhocViewCache *self = data;
+
+  self->idle_id = 0;
+  self->update_func (self, self->update_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+summary_copy (GArray *dest, GArray *src)
+{
+  g_array_set_size (dest, 0);
+  g_array_append_vals (dest, src->data, src->len);
+}
+
+/**
+ * phoc_view_cache_new:
+ * @wlr_renderer: The renderer to composite the surfaces with
+ * @wlr_allocator: The allocator for the cache's buffer
+ * @update_func: The function rendering the view's surfaces
+ * @data: The data passed to @update_func
+ *
+ * Returns:(transfer full): A new view cache
+ */
+PhocViewCache *
+phoc_view_cache_new (struct wlr_renderer     *wlr_renderer,
+                     struct wlr_allocator    *wlr_allocator,
+                     PhocViewCacheUpdateFunc  update_func,
+                     gpointer                 data)
+{
+  PhocViewCache *self = g_new0 (PhocViewCache, 1);
+
+  self->wlr_renderer = wlr_renderer;
+  self->wlr_allocator = wlr_allocator;
+  self->update_func = update_func;
+  self->update_data = data;
+
+  pixman_region32_init (&self->opaque);
+  self->summary = g_array_new (FALSE, FALSE, sizeof (PhocRenderSummaryItem));
+  self->last_summary = g_array_new (FALSE, FALSE, sizeof (PhocRenderSummaryItem));
+
+  return self;
+}
+
+
+void
+phoc_view_cache_free (PhocViewCache *self)
+{
+  g_clear_handle_id (&self->idle_id, g_source_remove);
+  drop_texture (self);
+  g_clear_weak_pointer (&self->output);
+  pixman_region32_fini (&self->opaque);
+  g_array_unref (self->summary);
+  g_array_unref (self->last_summary);
+  g_free (self);
+}
+
+/**
+ * phoc_view_cache_is_valid:
+ * @self: The view cache
+ * @output: The output the view is rendered on
+ * @summary: (element-type PhocRenderSummaryItem): The summary of the view's surfaces
+ * @n_frames: The number of frames the view needs to be unchanged
+ *
+ * Checks whether the cached texture shows @summary on @output. Meant
+ * to be invoked once per frame the view is drawn in. If the view changed the texture is
+ * dropped, if it didn't change for @n_frames frames an update is
+ * scheduled.
+ *
+ * Returns: %TRUE if the texture can be used instead of the view's surfaces
+ */
+gboolean
+phoc_view_cache_is_valid (PhocViewCache *self,
+                          PhocOutput    *output,
+                          GArray        *summary,
+                          guint          n_frames)
+{
+  if (self->valid && self->output == output &&
+      phoc_render_summary_equal (summary, self->summary)) {
+    return TRUE;
+  }
+
+  /* Don't keep a stale texture around */
+  if (self->texture)
+    drop_texture (self);
+
+  if (self->output == output && phoc_render_summary_equal (summary, self->last_summary)) {
+    self->n_stable_frames++;
+  } else {
+    g_set_weak_pointer (&self->output, output);
+    summary_copy (self->last_summary, summary);
+    self->n_stable_frames = 0;
+  }
+
+  if (self->n_stable_frames >= n_frames && !self->idle_id) {
+    self->idle_id = g_idle_add (on_idle_update, self);
+    g_source_set_name_by_id (self->idle_id, "[phoc] view cache update");
+  }
+
+  return FALSE;
+}
+
+/**
+ * phoc_view_cache_begin:
+ * @self: The view cache
+ * @box: The area to cache in transformed output buffer coordinates
+ *
+ * Starts rendering the view's surfaces into the cache. The buffer
+ * starts out fully transparent and its origin is at @box's origin.
+ *
+ * Returns:(transfer none)(nullable): The render pass to add the surfaces to
+ */
+struct wlr_render_pass *
+phoc_view_cache_begin (PhocViewCache *self, const struct wlr_box *box)
+{
+  struct wlr_render_pass *pass;
+
+  self->valid = FALSE;
+
+  if (self->buffer && (self->buffer->width != box->width || self->buffer->height != box->height))
+    drop_texture (self);
+
+  if (!self->buffer) {
+    self->buffer = create_buffer (self, box->width, box->height);
+    if (!self->buffer) {
+      g_warning_once ("Failed to allocate %dx%d buffer for view cache", box->width, box->height);
+      return NULL;
+    }
+  }
+  self->box = *box;
+
+  pass = wlr_renderer_begin_buffer_pass (self->wlr_renderer, self->buffer, NULL);
+  if (!pass)
+    return NULL;
+
+  wlr_render_pass_add_rect (pass, &(struct wlr_render_rect_options) {
+      .box = { .width = box->width, .height = box->height },
+      .color = { 0.0f, 0.0f, 0.0f, 0.0f },
+      .blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+    });
+
+  return pass;
+}
+
+/**
+ * phoc_view_cache_end:
+ * @self: The view cache
+ * @pass: The render pass returned by [method@ViewCache.begin]
+ * @summary: (element-type PhocRenderSummaryItem): The summary of the rendered surfaces
+ * @opaque: The area of the output's buffer the surfaces cover opaquely
+ *
+ * Submits the render pass. The texture is used for frames whose view
+ * matches @summary from now on.
+ *
+ * Returns: %TRUE if the cache is valid
+ */
+gboolean
+phoc_view_cache_end (PhocViewCache          *self,
+                     struct wlr_render_pass *pass,
+                     GArray                 *summary,
+                     pixman_region32_t      *opaque)
+{
+  if (!wlr_render_pass_submit (pass))
+    return FALSE;
+
+  if (!self->texture)
+    self->texture = wlr_texture_from_buffer (self->wlr_renderer, self->buffer);
+
+  summary_copy (self->summary, summary);
+  pixman_region32_copy (&self->opaque, opaque);
+  self->valid = !!self->texture;
+
+  return self->valid;
+}
+
+/**
+ * phoc_view_cache_get_output:
+ * @self: The view cache
+ *
+ * Returns:(transfer none)(nullable): The output the view was last seen on
+ */
+PhocOutput *
+phoc_view_cache_get_output (PhocViewCache *self)
+{
+  return self->output;
+}
+
+/**
+ * phoc_view_cache_get_texture:
+ * @self: The view cache
+ *
+ * Returns:(transfer none)(nullable): The composited surfaces
+ */
+struct wlr_texture *
+phoc_view_cache_get_texture (PhocViewCache *self)
+{
+  return self->texture;
+}
+
+/**
+ * phoc_view_cache_get_box:
+ * @self: The view cache
+ *
+ * Returns:(transfer none): Where the texture goes in transformed
+ *   output buffer coordinates
+ */
+const struct wlr_box *
+phoc_view_cache_get_box (PhocViewCache *self)
+{
+  return &self->box;
+}
+
+/**
+ * phoc_view_cache_get_opaque:
+ * @self: The view cache
+ *
+ * Returns:(transfer none): The area of the output's buffer the cached
+ *   surfaces cover opaquely in untransformed output buffer coordinates
+ */
+pixman_region32_t *
+phoc_view_cache_get_opaque (PhocViewCache *self)
+{
+  return &self->opaque;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "output.h"
+
+#include <glib.h>
+#include <pixman.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/wlr_renderer.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PhocViewCache PhocViewCache;
+
+/**
+ * PhocViewCacheUpdateFunc:
+ * @cache: The view cache
+ * @data: The user data
+ *
+ * Invoked from an idle callback when the view's surfaces stopped
+ * changing. Expected to render them via [method@ViewCache.begin] and
+ * [method@ViewCache.end].
+ */
+typedef void (*PhocViewCacheUpdateFunc) (PhocViewCache *cache, gpointer data);
+
+PhocViewCache          *phoc_view_cache_new         (struct wlr_renderer     *wlr_renderer,
+                                                     struct wlr_allocator    *wlr_allocator,
+                                                     PhocViewCacheUpdateFunc  update_func,
+                                                     gpointer                 data);
+void                    phoc_view_cache_free        (PhocViewCache           *self);
+gboolean                phoc_view_cache_is_valid    (PhocViewCache           *self,
+                                                     PhocOutput              *output,
+                                                     GArray                  *summary,
+                                                     guint                    n_frames);
+struct wlr_render_pass *phoc_view_cache_begin       (PhocViewCache           *self,
+                                                     const struct wlr_box    *box);
+gboolean                phoc_view_cache_end         (PhocViewCache           *self,
+                                                     struct wlr_render_pass  *pass,
+                                                     GArray                  *summary,
+                                                     pixman_region32_t       *opaque);
+PhocOutput             *phoc_view_cache_get_output  (PhocViewCache           *self);
+struct wlr_texture     *phoc_view_cache_get_texture (PhocViewCache           *self);
+const struct wlr_box   *phoc_view_cache_get_box     (PhocViewCache           *self);
+pixman_region32_t      *phoc_view_cache_get_opaque  (PhocViewCache           *self);
+
+G_END_DECLS
@@ -19,6 +19,7 @@ G_BEGIN_DECLS
  * @view: The [type@PhocView] this child belongs to
  * @parent: (nullable): The parent of this child if another child
  * @children: (nullable): children of this child
+ * @committed_box: Position relative to the view and size at the last commit
  *
  * A child of a [type@View], e.g. a [type@XdgPopup] or subsurface
  */
@@ -34,6 +35,7 @@ struct _PhocViewChild {
   struct wlr_surface           *wlr_surface;
   struct wl_list                link; // PhocViewPrivate::child_surfaces
   bool                          mapped;
+  struct wlr_box                committed_box;
 
   struct wl_listener            map;
   struct wl_listener            unmap;
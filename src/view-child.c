@@ -70,6 +70,78 @@ phoc_view_child_is_mapped (PhocViewChild *self)
 }
 
 
+static void
+get_committed_box (PhocViewChild *self, struct wlr_box *box)
+{
+  phoc_view_child_get_pos (self, &box->x, &box->y);
+  box->width = self->wlr_surface->current.width;
+  box->height = self->wlr_surface->current.height;
+}
+
+/*
+ * Damages the area a child surface covered at its last commit in all
+ * outputs.
+ */
+static void
+damage_committed_box (PhocViewChild *self)
+{
+  PhocView *view = self->view;
+  float scale = phoc_view_get_scale (view);
+  PhocOutput *output;
+
+  if (wlr_box_empty (&self->committed_box))
+    return;
+
+  wl_list_for_each (output, &view->desktop->outputs, link) {
+    struct wlr_box box = {
+      .x = view->box.x - output->layout_box.x + self->committed_box.x,
+      .y = view->box.y - output->layout_box.y + self->committed_box.y,
+      .width = self->committed_box.width,
+      .height = self->committed_box.height,
+    };
+
+    phoc_utils_scale_box (&box, scale);
+    phoc_output_damage_box (output, &box);
+  }
+}
+
+/*
+ * Checks if @self or any of its mapped children moved or got resized
+ * since the last commit and if so damages the old and new area.
+ * Children's positions are applied with their parent's commit so they
+ * need to be checked too.
+ *
+ * Returns: %TRUE if anything moved or got resized
+ */
+static gboolean
+update_committed_box (PhocViewChild *self)
+{
+  gboolean moved = FALSE;
+  struct wlr_box box;
+  PhocOutput *output;
+
+  get_committed_box (self, &box);
+  if (!wlr_box_equal (&box, &self->committed_box)) {
+    damage_committed_box (self);
+    self->committed_box = box;
+    wl_list_for_each (output, &self->view->desktop->outputs, link) {
+      phoc_output_damage_from_view_child (output, self->view, self->wlr_surface,
+                                          box.x, box.y, true);
+    }
+    moved = TRUE;
+  }
+
+  for (GSList *elem = self->children; elem; elem = elem->next) {
+    PhocViewChild *child = elem->data;
+
+    if (child->mapped)
+      moved |= update_committed_box (child);
+  }
+
+  return moved;
+}
+
+
 static void
 phoc_view_child_set_property (GObject      *object,
                               guint         property_id,
@@ -120,6 +192,7 @@ phoc_view_child_handle_map (struct wl_listener *listener, void *data)
 {
   PhocViewChild *self = wl_container_of (listener, self, map);
 
+  phoc_view_child_changed (self->view, TRUE);
   PHOC_VIEW_CHILD_GET_CLASS (self)->map (self);
 }
 
@@ -129,6 +202,7 @@ phoc_view_child_handle_unmap (struct wl_listener *listener, void *data)
 {
   PhocViewChild *self = wl_container_of (listener, self, unmap);
 
+  phoc_view_child_changed (self->view, TRUE);
   PHOC_VIEW_CHILD_GET_CLASS (self)->unmap (self);
 }
 
@@ -139,6 +213,7 @@ phoc_view_child_handle_new_subsurface (struct wl_listener *listener, void *data)
   PhocViewChild *self = wl_container_of (listener, self, new_subsurface);
   struct wlr_subsurface *wlr_subsurface = data;
 
+  phoc_view_child_changed (self->view, TRUE);
   phoc_view_child_subsurface_create (self, wlr_subsurface);
 }
 
@@ -148,6 +223,12 @@ phoc_view_child_handle_commit (struct wl_listener *listener, void *data)
 {
   PhocViewChild *self = wl_container_of (listener, self, commit);
 
+  if (!phoc_view_child_is_mapped (self) || !phoc_view_is_mapped (self->view)) {
+    /* Committing might have moved our subsurfaces */
+    phoc_view_invalidate_surfaces (self->view);
+    return;
+  }
+
   phoc_view_child_apply_damage (self);
 }
 
@@ -184,6 +265,7 @@ phoc_view_child_finalize (GObject *object)
 
   if (phoc_view_child_is_mapped (self) && phoc_view_is_mapped (self->view))
     phoc_view_child_damage_whole (self);
+  phoc_view_invalidate_surfaces (self->view);
 
   /* Remove from parent if it's also a PhocViewChild */
   if (self->parent != NULL) {
@@ -222,6 +304,7 @@ phoc_view_child_map_default (PhocViewChild *self)
   PhocView *view = self->view;
 
   self->mapped = true;
+  get_committed_box (self, &self->committed_box);
   phoc_view_child_damage_whole (self);
 
   struct wlr_box box;
@@ -232,7 +315,8 @@ phoc_view_child_map_default (PhocViewChild *self)
     bool intersects = wlr_output_layout_intersects (view->desktop->layout,
                                                     output->wlr_output, &box);
     if (intersects)
-      phoc_utils_wlr_surface_enter_output (self->wlr_surface, output->wlr_output);
+      phoc_utils_wlr_surface_enter_output (self->wlr_surface, output->wlr_output,
+                                           phoc_view_get_scale (view));
   }
 
   phoc_input_update_cursor_focus (input);
@@ -295,15 +379,33 @@ phoc_view_child_init (PhocViewChild *self)
  * phoc_view_child_apply_damage:
  * @self: A view child
  *
- * This is the equivalent of `phoc_view_apply_damage` but for [type@ViewChild].
+ * This is the equivalent of `phoc_view_apply_damage` but for
+ * [type@ViewChild]. Only the child's own buffer damage is added unless
+ * the child or one of its children moved or got resized, so commits of
+ * e.g. a video player's synchronized subsurface don't damage and
+ * traverse the whole view.
  */
 void
 phoc_view_child_apply_damage (PhocViewChild *self)
 {
+  PhocOutput *output;
+  gboolean moved;
+
   if (!self || !phoc_view_child_is_mapped (self) || !phoc_view_is_mapped (self->view))
     return;
 
-  phoc_view_apply_damage (self->view);
+  moved = update_committed_box (self);
+  if (!moved) {
+    /* Also schedules frames for pending frame callbacks */
+    wl_list_for_each (output, &self->view->desktop->outputs, link) {
+      phoc_output_damage_from_view_child (output, self->view, self->wlr_surface,
+                                          self->committed_box.x, self->committed_box.y,
+                                          false);
+    }
+  }
+
+  if (moved || pixman_region32_not_empty (&self->wlr_surface->buffer_damage))
+    phoc_view_child_changed (self->view, moved);
 }
 
 /**
@@ -327,12 +429,10 @@ phoc_view_child_damage_whole (PhocViewChild *self)
   phoc_view_child_get_pos (self, &sx, &sy);
 
   wl_list_for_each (output, &self->view->desktop->outputs, link) {
-    struct wlr_box output_box;
-    wlr_output_layout_get_box (self->view->desktop->layout, output->wlr_output, &output_box);
     phoc_output_damage_whole_surface (output,
                                       self->wlr_surface,
-                                      view_box.x + sx - output_box.x,
-                                      view_box.y + sy - output_box.y);
+                                      view_box.x + sx - output->layout_box.x,
+                                      view_box.y + sy - output->layout_box.y);
   }
 }
 
@@ -19,6 +19,8 @@
 
 #include "render-private.h"
 
+#include <wlr/util/region.h>
+
 #define PHOC_DECO_BORDER_WIDTH      4
 #define PHOC_DECO_TITLEBAR_HEIGHT  12
 #define PHOC_DECO_COLOR            ((struct wlr_render_color){ 0.2, 0.2, 0.2, 1.0 })
@@ -27,6 +29,11 @@
  * PhocViewDeco:
  *
  * The decoration for views using server side decorations
+ *
+ * The decoration only paints the frame around the view. The frame's
+ * region is cached and only recomputed when the view's geometry
+ * changes so frames where only the client's content got damaged
+ * don't touch the decoration at all.
  */
 
 enum {
@@ -43,6 +50,12 @@ struct _PhocViewDeco {
   guint           border_width;
   guint           titlebar_height;
   gboolean        mapped;
+
+  /* The view's box the frame was computed for */
+  struct wlr_box  view_box;
+  gboolean        frame_valid;
+  /* The area covered by the decoration in layout coordinates */
+  pixman_region32_t frame;
 };
 
 static void bling_interface_init (PhocBlingInterface *iface);
@@ -68,6 +81,27 @@ phoc_view_deco_bling_get_box (PhocBling *bling)
 }
 
 
+static pixman_region32_t *
+phoc_view_deco_get_frame (PhocViewDeco *self)
+{
+  struct wlr_box view_box, box;
+
+  phoc_view_get_box (self->view, &view_box);
+  if (self->frame_valid && wlr_box_equal (&view_box, &self->view_box))
+    return &self->frame;
+
+  self->view_box = view_box;
+  self->frame_valid = TRUE;
+  box = phoc_view_deco_bling_get_box (PHOC_BLING (self));
+  pixman_region32_fini (&self->frame);
+  pixman_region32_init_rect (&self->frame, box.x, box.y, box.width, box.height);
+  pixman_region32_subtract_rect (&self->frame, &self->frame, view_box.x, view_box.y,
+                                 view_box.width, view_box.height);
+
+  return &self->frame;
+}
+
+
 static void
 phoc_view_deco_damage_box (PhocViewDeco *self)
 {
@@ -83,12 +117,17 @@ phoc_view_deco_damage_box (PhocViewDeco *self)
     if (!intersects)
       continue;
 
-    damage_box.x -= output->lx;
-    damage_box.y -= output->ly;
-    phoc_utils_scale_box (&damage_box, output->wlr_output->scale);
+    pixman_region32_t damage;
+
+    /* The view damages its own box when it changes */
+    pixman_region32_init (&damage);
+    pixman_region32_copy (&damage, phoc_view_deco_get_frame (self));
+    pixman_region32_translate (&damage, -output->lx, -output->ly);
+    wlr_region_scale (&damage, &damage, output->wlr_output->scale);
 
-    if (wlr_damage_ring_add_box (&output->damage_ring, &damage_box))
+    if (wlr_damage_ring_add (&output->damage_ring, &damage))
       wlr_output_schedule_frame (output->wlr_output);
+    pixman_region32_fini (&damage);
   }
 }
 
@@ -97,14 +136,22 @@ phoc_view_deco_damage_box (PhocViewDeco *self)
 static void
 phoc_view_deco_bling_render (PhocBling *bling, PhocRenderContext *ctx)
 {
+  PhocViewDeco *self = PHOC_VIEW_DECO (bling);
   struct wlr_box box = phoc_view_deco_bling_get_box (bling);
+  float scale = ctx->scale;
+  pixman_region32_t damage;
 
   box.x -= ctx->output->lx;
   box.y -= ctx->output->ly;
-  phoc_utils_scale_box (&box, ctx->output->wlr_output->scale);
-
-  pixman_region32_t damage;
-  if (!phoc_utils_is_damaged (&box, ctx->damage, NULL, &damage)) {
+  phoc_utils_scale_box (&box, scale);
+
+  /* The view paints its own box, only the frame is ours */
+  pixman_region32_init (&damage);
+  pixman_region32_copy (&damage, phoc_view_deco_get_frame (self));
+  pixman_region32_translate (&damage, -ctx->output->lx, -ctx->output->ly);
+  wlr_region_scale (&damage, &damage, scale);
+  pixman_region32_intersect (&damage, &damage, ctx->damage);
+  if (!pixman_region32_not_empty (&damage)) {
     pixman_region32_fini (&damage);
     return;
   }
@@ -232,6 +279,17 @@ phoc_view_deco_dispose (GObject *object)
 }
 
 
+static void
+phoc_view_deco_finalize (GObject *object)
+{
+  PhocViewDeco *self = PHOC_VIEW_DECO (object);
+
+  pixman_region32_fini (&self->frame);
+
+  G_OBJECT_CLASS (phoc_view_deco_parent_class)->finalize (object);
+}
+
+
 static void
 phoc_view_deco_class_init (PhocViewDecoClass *klass)
 {
@@ -240,6 +298,7 @@ phoc_view_deco_class_init (PhocViewDecoClass *klass)
   object_class->get_property = phoc_view_deco_get_property;
   object_class->set_property = phoc_view_deco_set_property;
   object_class->dispose = phoc_view_deco_dispose;
+  object_class->finalize = phoc_view_deco_finalize;
 
   props[PROP_VIEW] =
     g_param_spec_object ("view", "", "",
@@ -255,6 +314,7 @@ phoc_view_deco_init (PhocViewDeco *self)
 {
   self->border_width = PHOC_DECO_BORDER_WIDTH;
   self->titlebar_height = PHOC_DECO_TITLEBAR_HEIGHT;
+  pixman_region32_init (&self->frame);
 }
 
 
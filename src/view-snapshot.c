@@ -0,0 +1,618 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-view-snapshot"
+
+#include "phoc-config.h"
+
+#include "phoc-animation.h"
+#include "render.h"
+#include "render-private.h"
+#include "server.h"
+#include "utils.h"
+#include "view-snapshot.h"
+
+#include <drm_fourcc.h>
+#include <float.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/types/wlr_buffer.h>
+
+#define PHOC_ANIM_DURATION_WINDOW_CLOSE 150 /* ms */
+/* The scale a closing view shrinks to */
+#define PHOC_VIEW_SNAPSHOT_CLOSE_SCALE 0.9
+
+enum {
+  PROP_0,
+  PROP_OUTPUT,
+  PROP_ALPHA,
+  PROP_SCALE,
+  PROP_LAST_PROP
+};
+static GParamSpec *props[PROP_LAST_PROP];
+
+/**
+ * PhocViewSnapshot:
+ *
+ * A copy of a view's surfaces on an output rendered into a single
+ * texture. It allows to animate views once the client's buffers are
+ * gone, e.g. when the view unmaps.
+ *
+ * While animating the snapshot is drawn where the view was in the
+ * stack of views and keeps a reference on itself. Texture and buffer
+ * are released once the animation is done or the output goes away.
+ */
+struct _PhocViewSnapshot {
+  GObject             parent;
+
+  PhocOutput         *output;
+  /* Output local layout coordinates of the captured surfaces */
+  struct wlr_box      box;
+  float               alpha;
+  float               scale;
+  /* The view right below the captured one, %NULL if there was none */
+  PhocView           *below;
+  gboolean            bottom;
+
+  struct wlr_buffer  *buffer;
+  struct wlr_texture *texture;
+  PhocTimedAnimation *animation;
+  gboolean            rendering;
+};
+
+static void phoc_view_snapshot_animatable_interface_init (PhocAnimatableInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (PhocViewSnapshot, phoc_view_snapshot, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (PHOC_TYPE_ANIMATABLE,
+                                                phoc_view_snapshot_animatable_interface_init))
+
+typedef struct {
+  PhocViewSnapshot       *snapshot;
+  struct wlr_render_pass *render_pass;
+} PhocViewSnapshotCaptureData;
+
+
+static guint
+phoc_view_snapshot_add_frame_callback (PhocAnimatable   *iface,
+                                       PhocFrameCallback callback,
+                                       gpointer          user_data,
+                                       GDestroyNotify    notify)
+{
+  PhocViewSnapshot *self = PHOC_VIEW_SNAPSHOT (iface);
+
+  if (!self->output)
+    return 0;
+
+  return phoc_output_add_frame_callback (self->output, iface, callback, user_data, notify);
+}
+
+
+static void
+phoc_view_snapshot_remove_frame_callback (PhocAnimatable *iface, guint id)
+{
+  PhocViewSnapshot *self = PHOC_VIEW_SNAPSHOT (iface);
+
+  if (!self->output)
+    return;
+
+  phoc_output_remove_frame_callback (self->output, id);
+}
+
+
+static void
+damage_box (PhocViewSnapshot *self)
+{
+  if (!self->output)
+    return;
+
+  /* The box covers the snapshot at any scale <= 1.0 */
+  phoc_output_damage_box (self->output, &self->box);
+}
+
+
+static void
+set_alpha (PhocViewSnapshot *self, float alpha)
+{
+  if (G_APPROX_VALUE (self->alpha, alpha, FLT_EPSILON))
+    return;
+
+  self->alpha = alpha;
+  damage_box (self);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_ALPHA]);
+}
+
+
+static void
+set_scale (PhocViewSnapshot *self, float scale)
+{
+  if (G_APPROX_VALUE (self->scale, scale, FLT_EPSILON))
+    return;
+
+  self->scale = scale;
+  damage_box (self);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_SCALE]);
+}
+
+
+static void
+phoc_view_snapshot_set_property (GObject      *object,
+                                 guint         property_id,
+                                 const GValue *value,
+                                 GParamSpec   *pspec)
+{
+  PhocViewSnapshot *self = PHOC_VIEW_SNAPSHOT (object);
+
+  switch (property_id) {
+  case PROP_OUTPUT:
+    g_set_weak_pointer (&self->output, g_value_get_object (value));
+    break;
+  case PROP_ALPHA:
+    set_alpha (self, g_value_get_float (value));
+    break;
+  case PROP_SCALE:
+    set_scale (self, g_value_get_float (value));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+phoc_view_snapshot_get_property (GObject    *object,
+                                 guint       property_id,
+                                 GValue     *value,
+                                 GParamSpec *pspec)
+{
+  PhocViewSnapshot *self = PHOC_VIEW_SNAPSHOT (object);
+
+  switch (property_id) {
+  case PROP_OUTPUT:
+    g_value_set_object (value, self->output);
+    break;
+  case PROP_ALPHA:
+    g_value_set_float (value, self->alpha);
+    break;
+  case PROP_SCALE:
+    g_value_set_float (value, self->scale);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+clear_texture (PhocViewSnapshot *self)
+{
+  g_clear_pointer (&self->texture, wlr_texture_destroy);
+  g_clear_pointer (&self->buffer, wlr_buffer_drop);
+}
+
+
+static void
+bounds_iterator (PhocOutput         *output,
+                 struct wlr_surface *surface,
+                 struct wlr_box     *box,
+                 float               scale,
+                 void               *data)
+{
+  pixman_region32_t *bounds = data;
+  struct wlr_box scaled = *box;
+
+  if (!wlr_surface_has_buffer (surface))
+    return;
+
+  phoc_utils_scale_box (&scaled, scale);
+  pixman_region32_union_rect (bounds, bounds, scaled.x, scaled.y, scaled.width, scaled.height);
+}
+
+
+static void
+capture_iterator (PhocOutput         *output,
+                  struct wlr_surface *surface,
+                  struct wlr_box     *box,
+                  float               scale,
+                  void               *data)
+{
+  PhocViewSnapshotCaptureData *capture = data;
+  PhocViewSnapshot *self = capture->snapshot;
+  struct wlr_texture *texture = wlr_surface_get_texture (surface);
+  struct wlr_box dst_box = *box;
+  struct wlr_fbox src_box;
+
+  if (!texture)
+    return;
+
+  wlr_surface_get_buffer_source_box (surface, &src_box);
+  phoc_utils_scale_box (&dst_box, scale);
+  dst_box.x -= self->box.x;
+  dst_box.y -= self->box.y;
+  phoc_utils_scale_box (&dst_box, output->wlr_output->scale);
+
+  wlr_render_pass_add_texture (capture->render_pass, &(struct wlr_render_texture_options) {
+      .texture = texture,
+      .src_box = src_box,
+      .dst_box = dst_box,
+      .transform = surface->current.transform,
+      .filter_mode = WLR_SCALE_FILTER_BILINEAR,
+    });
+}
+
+
+static struct wlr_buffer *
+create_buffer (struct wlr_allocator *wlr_allocator, int width, int height)
+{
+  struct wlr_drm_format_set fmt_set = {};
+  const struct wlr_drm_format *fmt;
+  struct wlr_buffer *buffer;
+
+  wlr_drm_format_set_add (&fmt_set, DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_INVALID);
+  fmt = wlr_drm_format_set_get (&fmt_set, DRM_FORMAT_ARGB8888);
+
+  buffer = wlr_allocator_create_buffer (wlr_allocator, width, height, fmt);
+  wlr_drm_format_set_finish (&fmt_set);
+
+  return buffer;
+}
+
+
+static gboolean
+capture (PhocViewSnapshot *self, PhocView *view)
+{
+  PhocRenderer *renderer = phoc_server_get_renderer (phoc_server_get_default ());
+  struct wlr_renderer *wlr_renderer = phoc_renderer_get_wlr_renderer (renderer);
+  struct wlr_allocator *wlr_allocator = phoc_renderer_get_wlr_allocator (renderer);
+  PhocViewSnapshotCaptureData capture_data = { .snapshot = self };
+  struct wlr_box buffer_box;
+  pixman_region32_t bounds;
+  pixman_box32_t *extents;
+
+  if (!wlr_allocator || !(phoc_renderer_get_caps (renderer) & PHOC_RENDERER_CAP_BUFFER_TARGETS))
+    return FALSE;
+
+  pixman_region32_init (&bounds);
+  phoc_output_view_for_each_surface (self->output, view, bounds_iterator, &bounds);
+  extents = pixman_region32_extents (&bounds);
+  self->box = (struct wlr_box) {
+    .x = extents->x1,
+    .y = extents->y1,
+    .width = extents->x2 - extents->x1,
+    .height = extents->y2 - extents->y1,
+  };
+  pixman_region32_fini (&bounds);
+
+  if (wlr_box_empty (&self->box))
+    return FALSE;
+
+  buffer_box = self->box;
+  phoc_utils_scale_box (&buffer_box, self->output->wlr_output->scale);
+  self->buffer = create_buffer (wlr_allocator, buffer_box.width, buffer_box.height);
+  if (!self->buffer) {
+    g_warning_once ("Failed to allocate %dx%d view snapshot", buffer_box.width, buffer_box.height);
+    return FALSE;
+  }
+
+  capture_data.render_pass = wlr_renderer_begin_buffer_pass (wlr_renderer, self->buffer, NULL);
+  if (!capture_data.render_pass)
+    return FALSE;
+
+  wlr_render_pass_add_rect (capture_data.render_pass, &(struct wlr_render_rect_options){
+      .box = { .width = buffer_box.width, .height = buffer_box.height },
+      .color = { 0 },
+      .blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+    });
+  phoc_output_view_for_each_surface (self->output, view, capture_iterator, &capture_data);
+
+  if (!wlr_render_pass_submit (capture_data.render_pass))
+    return FALSE;
+
+  self->texture = wlr_texture_from_buffer (wlr_renderer, self->buffer);
+  return !!self->texture;
+}
+
+
+static void
+stop_render (PhocViewSnapshot *self)
+{
+  PhocRenderer *renderer = phoc_server_get_renderer (phoc_server_get_default ());
+
+  if (!self->rendering)
+    return;
+
+  phoc_renderer_remove_view_snapshot (renderer, self);
+  self->rendering = FALSE;
+}
+
+
+static void
+on_animation_done (PhocViewSnapshot *self)
+{
+  damage_box (self);
+
+  stop_render (self);
+  clear_texture (self);
+  /* Disposes itself once done */
+  self->animation = NULL;
+
+  /* Drop the reference held while animating */
+  g_object_unref (self);
+}
+
+
+static void
+on_output_destroyed (PhocViewSnapshot *self)
+{
+  /* No more frames to animate on */
+  if (self->animation)
+    phoc_timed_animation_skip (self->animation);
+}
+
+
+static void
+phoc_view_snapshot_finalize (GObject *object)
+{
+  PhocViewSnapshot *self = PHOC_VIEW_SNAPSHOT (object);
+
+  stop_render (self);
+  clear_texture (self);
+  g_clear_weak_pointer (&self->below);
+  g_clear_weak_pointer (&self->output);
+
+  G_OBJECT_CLASS (phoc_view_snapshot_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_view_snapshot_animatable_interface_init (PhocAnimatableInterface *iface)
+{
+  iface->add_frame_callback = phoc_view_snapshot_add_frame_callback;
+  iface->remove_frame_callback = phoc_view_snapshot_remove_frame_callback;
+}
+
+
+static void
+phoc_view_snapshot_class_init (PhocViewSnapshotClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->get_property = phoc_view_snapshot_get_property;
+  object_class->set_property = phoc_view_snapshot_set_property;
+  object_class->finalize = phoc_view_snapshot_finalize;
+
+  /**
+   * PhocViewSnapshot:output:
+   *
+   * The output the snapshot is taken on and drawn to.
+   */
+  props[PROP_OUTPUT] =
+    g_param_spec_object ("output", "", "",
+                         PHOC_TYPE_OUTPUT,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  /**
+   * PhocViewSnapshot:alpha:
+   *
+   * The opacity the snapshot is drawn with.
+   */
+  props[PROP_ALPHA] =
+    g_param_spec_float ("alpha", "", "",
+                        0.0, 1.0, 1.0,
+                        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+  /**
+   * PhocViewSnapshot:scale:
+   *
+   * The scale the snapshot is drawn at around its center.
+   */
+  props[PROP_SCALE] =
+    g_param_spec_float ("scale", "", "",
+                        0.0, 1.0, 1.0,
+                        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+}
+
+
+static void
+phoc_view_snapshot_init (PhocViewSnapshot *self)
+{
+  self->alpha = 1.0;
+  self->scale = 1.0;
+}
+
+/**
+ * phoc_view_snapshot_new:
+ * @view: The mapped view to take the snapshot of
+ *
+ * Renders @view's surfaces on its output into a texture.
+ *
+ * Returns:(transfer full)(nullable): The snapshot or %NULL if the view
+ *   couldn't be captured
+ */
+PhocViewSnapshot *
+phoc_view_snapshot_new (PhocView *view)
+{
+  g_autoptr (PhocViewSnapshot) self = NULL;
+  PhocOutput *output;
+
+  g_assert (PHOC_IS_VIEW (view));
+
+  output = phoc_view_get_output (view);
+  if (!output || !view->wlr_surface)
+    return NULL;
+
+  self = g_object_new (PHOC_TYPE_VIEW_SNAPSHOT, "output", output, NULL);
+  if (!capture (self, view))
+    return NULL;
+
+  /* The stack's head is the topmost view */
+  if (view->desktop_link && view->desktop_link->next)
+    g_set_weak_pointer (&self->below, PHOC_VIEW (view->desktop_link->next->data));
+  else
+    self->bottom = TRUE;
+
+  return g_steal_pointer (&self);
+}
+
+/**
+ * phoc_view_snapshot_get_texture:
+ * @self: The snapshot
+ *
+ * Returns:(transfer none)(nullable): The snapshot's texture. %NULL once
+ *   an animation finished.
+ */
+struct wlr_texture *
+phoc_view_snapshot_get_texture (PhocViewSnapshot *self)
+{
+  g_assert (PHOC_IS_VIEW_SNAPSHOT (self));
+
+  return self->texture;
+}
+
+/**
+ * phoc_view_snapshot_get_output:
+ * @self: The snapshot
+ *
+ * Returns:(transfer none)(nullable): The output the snapshot was taken
+ *   on or %NULL if it went away
+ */
+PhocOutput *
+phoc_view_snapshot_get_output (PhocViewSnapshot *self)
+{
+  g_assert (PHOC_IS_VIEW_SNAPSHOT (self));
+
+  return self->output;
+}
+
+/**
+ * phoc_view_snapshot_get_box:
+ * @self: The snapshot
+ *
+ * Returns:(transfer none): The captured area in output local layout
+ *   coordinates
+ */
+const struct wlr_box *
+phoc_view_snapshot_get_box (PhocViewSnapshot *self)
+{
+  g_assert (PHOC_IS_VIEW_SNAPSHOT (self));
+
+  return &self->box;
+}
+
+/**
+ * phoc_view_snapshot_get_alpha:
+ * @self: The snapshot
+ *
+ * Returns: The opacity the snapshot is drawn with
+ */
+float
+phoc_view_snapshot_get_alpha (PhocViewSnapshot *self)
+{
+  g_assert (PHOC_IS_VIEW_SNAPSHOT (self));
+
+  return self->alpha;
+}
+
+/**
+ * phoc_view_snapshot_get_scale:
+ * @self: The snapshot
+ *
+ * Returns: The scale the snapshot is drawn at around its center
+ */
+float
+phoc_view_snapshot_get_scale (PhocViewSnapshot *self)
+{
+  g_assert (PHOC_IS_VIEW_SNAPSHOT (self));
+
+  return self->scale;
+}
+
+/**
+ * phoc_view_snapshot_is_stacked_on:
+ * @self: The snapshot
+ * @view: (nullable): A view in the stack of views or %NULL
+ *
+ * Checks whether the snapshot is drawn right above @view. If @view is
+ * %NULL checks whether it is drawn below all views.
+ *
+ * Returns: %TRUE if the snapshot is drawn right above @view
+ */
+gboolean
+phoc_view_snapshot_is_stacked_on (PhocViewSnapshot *self, PhocView *view)
+{
+  g_assert (PHOC_IS_VIEW_SNAPSHOT (self));
+
+  if (self->bottom)
+    return view == NULL;
+
+  return view && view == self->below && view->desktop_link != NULL;
+}
+
+/**
+ * phoc_view_snapshot_is_on_top:
+ * @self: The snapshot
+ *
+ * When the view that was below the captured view left the stack the
+ * snapshot isn't stacked on any view and goes on top of all views
+ * instead.
+ *
+ * Returns: %TRUE if the snapshot is drawn on top of all views
+ */
+gboolean
+phoc_view_snapshot_is_on_top (PhocViewSnapshot *self)
+{
+  g_assert (PHOC_IS_VIEW_SNAPSHOT (self));
+
+  if (self->bottom)
+    return FALSE;
+
+  return self->below == NULL || self->below->desktop_link == NULL;
+}
+
+/**
+ * phoc_view_snapshot_play_close:
+ * @self: The snapshot
+ *
+ * Fades out and shrinks the snapshot in place of the captured view.
+ * The snapshot keeps itself alive until the animation is done so
+ * callers can drop their reference right away.
+ */
+void
+phoc_view_snapshot_play_close (PhocViewSnapshot *self)
+{
+  PhocRenderer *renderer = phoc_server_get_renderer (phoc_server_get_default ());
+  g_autoptr (PhocPropertyEaser) easer = NULL;
+
+  g_assert (PHOC_IS_VIEW_SNAPSHOT (self));
+  g_return_if_fail (self->texture);
+  g_return_if_fail (self->animation == NULL);
+
+  easer = g_object_new (PHOC_TYPE_PROPERTY_EASER,
+                        "target", self,
+                        "easing", PHOC_EASING_EASE_OUT_QUAD,
+                        NULL);
+  phoc_property_easer_set_props (easer,
+                                 "alpha", 1.0, 0.0,
+                                 "scale", 1.0, PHOC_VIEW_SNAPSHOT_CLOSE_SCALE,
+                                 NULL);
+  self->animation = g_object_new (PHOC_TYPE_TIMED_ANIMATION,
+                                  "animatable", self,
+                                  "duration", PHOC_ANIM_DURATION_WINDOW_CLOSE,
+                                  "property-easer", easer,
+                                  "dispose-on-done", TRUE,
+                                  NULL);
+  g_signal_connect_swapped (self->animation, "done", G_CALLBACK (on_animation_done), self);
+  g_signal_connect_object (self->output, "output-destroyed",
+                           G_CALLBACK (on_output_destroyed), self,
+                           G_CONNECT_SWAPPED);
+
+  phoc_renderer_add_view_snapshot (renderer, self);
+  self->rendering = TRUE;
+  g_object_ref (self);
+  damage_box (self);
+  phoc_timed_animation_play (self->animation);
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "output.h"
+#include "view.h"
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_VIEW_SNAPSHOT (phoc_view_snapshot_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocViewSnapshot, phoc_view_snapshot, PHOC, VIEW_SNAPSHOT, GObject)
+
+PhocViewSnapshot   *phoc_view_snapshot_new         (PhocView         *view);
+struct wlr_texture *phoc_view_snapshot_get_texture (PhocViewSnapshot *self);
+PhocOutput         *phoc_view_snapshot_get_output  (PhocViewSnapshot *self);
+const struct wlr_box *phoc_view_snapshot_get_box   (PhocViewSnapshot *self);
+float               phoc_view_snapshot_get_alpha   (PhocViewSnapshot *self);
+float               phoc_view_snapshot_get_scale   (PhocViewSnapshot *self);
+gboolean            phoc_view_snapshot_is_stacked_on (PhocViewSnapshot *self,
+                                                      PhocView         *view);
+gboolean            phoc_view_snapshot_is_on_top   (PhocViewSnapshot *self);
+void                phoc_view_snapshot_play_close  (PhocViewSnapshot *self);
+
+G_END_DECLS
@@ -5,6 +5,7 @@
 #ifndef _POSIX_C_SOURCE
 #define _POSIX_C_SOURCE 200809L
 #endif
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wlr/types/wlr_subcompositor.h>
@@ -24,6 +25,7 @@
 #include "timed-animation.h"
 #include "view-child-private.h"
 #include "view-private.h"
+#include "view-snapshot.h"
 
 #define PHOC_ANIM_DURATION_WINDOW_FADE 150
 #define PHOC_MOVE_TO_CORNER_MARGIN 12
@@ -42,31 +44,74 @@ static GParamSpec *props[PROP_LAST_PROP];
 
 enum {
   SURFACE_DESTROY,
+  CONTENT_CHANGED,
   N_SIGNALS
 };
 static guint signals[N_SIGNALS] = { 0 };
 
+#define PHOC_VIEW_MAX_CACHED_OUTPUTS 4
+
 typedef struct _PhocViewPrivate {
-  char          *title;
-  char          *app_id;
-  GSettings     *settings;
-  pid_t          pid;
+  /*
+   * State read for every view in every frame comes first so a render
+   * pass touches as few cache lines as possible. Rarely used state
+   * goes to the end.
+   */
+  PhocViewRenderState render;
+
+  /* Flattened surface tree, PhocViewSurface */
+  GArray        *surfaces;
+  gboolean       surfaces_valid;
+
+  /* Outputs the view's box intersects, valid for the given layout serial */
+  PhocOutput    *outputs[PHOC_VIEW_MAX_CACHED_OUTPUTS];
+  guint          n_outputs;
+  guint          outputs_layout_serial;
+  gboolean       outputs_valid;
+
+  /* Bumped whenever the view's content might have changed */
+  guint64        content_serial;
+
+  /* Area covered by the view's surfaces, for quick hit test rejection */
+  struct wlr_box input_bounds;
+  gboolean       input_bounds_valid;
+
+  /* The view's geometry as of the last commit or configure */
+  struct wlr_box geometry;
+  gboolean       geometry_valid;
+
+  /* The root surface's size at the last commit */
+  int            committed_width;
+  int            committed_height;
+
+  /* Moved by an interactive move, the client wasn't told yet */
+  gboolean       interactive_move;
+
+  /* The area popups are constrained to and what it was derived from */
+  struct {
+    struct wlr_box box;
+    PhocOutput    *output;
+    struct wlr_box usable_area;
+    int            x, y, geom_x, geom_y;
+    guint          layout_serial;
+    gboolean       valid;
+  } popup_constraint;
 
-  float          alpha;
-  float          scale;
   PhocViewDeco  *deco;
   gboolean       decorated;
   PhocViewState  state;
   PhocViewTileDirection tile_direction;
   gboolean       always_on_top;
 
-  PhocOutput    *fullscreen_output;
+  char          *title;
+  char          *app_id;
+  GSettings     *settings;
+  pid_t          pid;
 
   gulong         notify_scale_to_fit_id;
   gboolean       scale_to_fit;
   char          *activation_token;
   int            activation_token_type;
-  GSList        *blings; /* PhocBlings */
 
   /* wlr-toplevel-management handling */
   struct wlr_foreign_toplevel_handle_v1 *toplevel_handle;
@@ -74,12 +119,21 @@ typedef struct _PhocViewPrivate {
   struct wl_listener toplevel_handle_request_activate;
   struct wl_listener toplevel_handle_request_fullscreen;
   struct wl_listener toplevel_handle_request_close;
+  /* Title and app-id changes are sent once per main loop iteration */
+  guint              toplevel_update_id;
 
   /* Subsurface and popups */
   struct wl_listener surface_new_subsurface;
   struct wl_list child_surfaces; // PhocViewChild::link
 } PhocViewPrivate;
 
+/* A surface of the view's surface tree, its position relative to the view's surface and size */
+typedef struct {
+  struct wlr_surface *wlr_surface;
+  int                 sx, sy;
+  int                 width, height;
+} PhocViewSurface;
+
 G_DEFINE_TYPE_WITH_PRIVATE (PhocView, phoc_view, G_TYPE_OBJECT)
 #define PHOC_VIEW_SELF(p) PHOC_PRIV_CONTAINER(PHOC_VIEW, PhocView, (p))
 
@@ -165,7 +219,7 @@ phoc_view_is_fullscreen (PhocView *self)
   g_assert (PHOC_IS_VIEW (self));
   priv = phoc_view_get_instance_private (self);
 
-  return (priv->fullscreen_output != NULL);
+  return (priv->render.fullscreen_output != NULL);
 }
 
 /**
@@ -185,7 +239,7 @@ phoc_view_get_fullscreen_output (PhocView *self)
   g_assert (PHOC_IS_VIEW (self));
   priv = phoc_view_get_instance_private (self);
 
-  return priv->fullscreen_output;
+  return priv->render.fullscreen_output;
 }
 
 void
@@ -198,8 +252,8 @@ phoc_view_get_box (PhocView *view, struct wlr_box *box)
 
   box->x = view->box.x;
   box->y = view->box.y;
-  box->width = view->box.width * priv->scale;
-  box->height = view->box.height * priv->scale;
+  box->width = view->box.width * priv->render.scale;
+  box->height = view->box.height * priv->render.scale;
 }
 
 
@@ -218,21 +272,36 @@ phoc_view_get_deco_part (PhocView *self, double sx, double sy)
 }
 
 
+typedef struct {
+  struct wlr_output *wlr_output;
+  float              scale;
+} PhocViewOutputData;
+
+
 static void
 surface_send_enter_iterator (struct wlr_surface *wlr_surface, int x, int y, void *data)
 {
-  struct wlr_output *wlr_output = data;
+  PhocViewOutputData *output_data = data;
 
-  phoc_utils_wlr_surface_enter_output (wlr_surface, wlr_output);
+  phoc_utils_wlr_surface_enter_output (wlr_surface, output_data->wlr_output, output_data->scale);
 }
 
 
 static void
 surface_send_leave_iterator (struct wlr_surface *wlr_surface, int x, int y, void *data)
 {
-  struct wlr_output *wlr_output = data;
+  PhocViewOutputData *output_data = data;
+
+  phoc_utils_wlr_surface_leave_output (wlr_surface, output_data->wlr_output, output_data->scale);
+}
+
+
+static void
+surface_update_scales_iterator (struct wlr_surface *wlr_surface, int x, int y, void *data)
+{
+  float *scale = data;
 
-  phoc_utils_wlr_surface_leave_output (wlr_surface, wlr_output);
+  phoc_utils_wlr_surface_update_scales (wlr_surface, *scale);
 }
 
 
@@ -248,6 +317,10 @@ view_update_output (PhocView *view, const struct wlr_box *before)
   struct wlr_box box;
   phoc_view_get_box (view, &box);
 
+  priv->n_outputs = 0;
+  priv->outputs_valid = TRUE;
+  priv->outputs_layout_serial = phoc_desktop_get_layout_serial (desktop);
+
   PhocOutput *output;
   wl_list_for_each (output, &desktop->outputs, link) {
     bool intersected, intersects;
@@ -257,14 +330,23 @@ view_update_output (PhocView *view, const struct wlr_box *before)
                                                           before);
     intersects = wlr_output_layout_intersects (desktop->layout, output->wlr_output, &box);
 
+    if (intersects) {
+      if (priv->n_outputs < PHOC_VIEW_MAX_CACHED_OUTPUTS)
+        priv->outputs[priv->n_outputs++] = output;
+      else
+        priv->outputs_valid = FALSE;
+    }
+
+    PhocViewOutputData output_data = { .wlr_output = output->wlr_output, .scale = priv->render.scale };
+
     if (intersected && !intersects) {
-      phoc_view_for_each_surface (view, surface_send_leave_iterator, output->wlr_output);
+      phoc_view_for_each_surface (view, surface_send_leave_iterator, &output_data);
       if (priv->toplevel_handle)
         wlr_foreign_toplevel_handle_v1_output_leave (priv->toplevel_handle, output->wlr_output);
     }
 
     if (!intersected && intersects) {
-      phoc_view_for_each_surface (view, surface_send_enter_iterator, output->wlr_output);
+      phoc_view_for_each_surface (view, surface_send_enter_iterator, &output_data);
 
       if (priv->toplevel_handle)
         wlr_foreign_toplevel_handle_v1_output_enter (priv->toplevel_handle, output->wlr_output);
@@ -284,8 +366,8 @@ view_save (PhocView *view)
   /* backup window state */
   struct wlr_box geom;
   phoc_view_get_geometry (view, &geom);
-  view->saved.x = view->box.x + geom.x * priv->scale;
-  view->saved.y = view->box.y + geom.y * priv->scale;
+  view->saved.x = view->box.x + geom.x * priv->render.scale;
+  view->saved.y = view->box.y + geom.y * priv->render.scale;
   view->saved.width = view->box.width;
   view->saved.height = view->box.height;
 }
@@ -331,7 +413,7 @@ phoc_view_activate (PhocView *self, bool activate)
     wlr_foreign_toplevel_handle_v1_set_activated (priv->toplevel_handle, activate);
 
   if (activate && phoc_view_is_fullscreen (self))
-    phoc_output_force_shell_reveal (priv->fullscreen_output, false);
+    phoc_output_force_shell_reveal (priv->render.fullscreen_output, false);
 }
 
 
@@ -346,6 +428,7 @@ phoc_view_resize (PhocView *self, uint32_t width, uint32_t height)
 void
 phoc_view_move_resize (PhocView *view, double x, double y, uint32_t width, uint32_t height)
 {
+  PhocViewPrivate *priv = phoc_view_get_instance_private (view);
   bool update_x = x != view->box.x;
   bool update_y = y != view->box.y;
   bool update_width = width != view->box.width;
@@ -354,6 +437,14 @@ phoc_view_move_resize (PhocView *view, double x, double y, uint32_t width, uint3
   view->pending_move_resize.update_x = false;
   view->pending_move_resize.update_y = false;
 
+  if (priv->interactive_move && !update_x && !update_y) {
+    /* The client still has the position from before the move */
+    priv->interactive_move = FALSE;
+    PHOC_VIEW_GET_CLASS (view)->move_resize (view, x, y, width, height);
+    return;
+  }
+  priv->interactive_move = FALSE;
+
   if (!update_x && !update_y) {
     phoc_view_resize (view, width, height);
     return;
@@ -401,10 +492,10 @@ phoc_view_get_maximized_box (PhocView *self, PhocOutput *output, struct wlr_box
   usable_area.x += output_box.x;
   usable_area.y += output_box.y;
 
-  box->x = usable_area.x / priv->scale;
-  box->y = usable_area.y / priv->scale;
-  box->width = usable_area.width / priv->scale;
-  box->height = usable_area.height / priv->scale;
+  box->x = usable_area.x / priv->render.scale;
+  box->y = usable_area.y / priv->render.scale;
+  box->width = usable_area.width / priv->render.scale;
+  box->height = usable_area.height / priv->render.scale;
 
   return TRUE;
 }
@@ -423,8 +514,8 @@ view_arrange_maximized (PhocView *self, PhocOutput *output)
     return;
 
   phoc_view_get_geometry (self, &geom);
-  box.x -= geom.x / priv->scale;
-  box.y -= geom.y / priv->scale;
+  box.x -= geom.x / priv->render.scale;
+  box.y -= geom.y / priv->render.scale;
 
   phoc_view_move_resize (self, box.x, box.y, box.width, box.height);
 }
@@ -481,10 +572,10 @@ phoc_view_get_tiled_box (PhocView               *self,
     g_error ("Invalid tiling direction %d", dir);
   }
 
-  box->x = x / priv->scale;
-  box->y = usable_area.y / priv->scale;
-  box->width = usable_area.width / 2 / priv->scale;
-  box->height = usable_area.height / priv->scale;
+  box->x = x / priv->render.scale;
+  box->y = usable_area.y / priv->render.scale;
+  box->width = usable_area.width / 2 / priv->render.scale;
+  box->height = usable_area.height / priv->render.scale;
 
   return TRUE;
 }
@@ -503,8 +594,8 @@ view_arrange_tiled (PhocView *self, PhocOutput *output)
     return;
 
   phoc_view_get_geometry (self, &geom);
-  box.x -= geom.x / priv->scale;
-  box.y -= geom.y / priv->scale;
+  box.x -= geom.x / priv->render.scale;
+  box.y -= geom.y / priv->render.scale;
 
   phoc_view_move_resize (self, box.x, box.y, box.width, box.height);
 }
@@ -579,8 +670,8 @@ phoc_view_restore (PhocView *self)
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_STATE]);
 
   if (!wlr_box_empty (&self->saved)) {
-    phoc_view_move_resize (self, self->saved.x - geom.x * priv->scale,
-                           self->saved.y - geom.y * priv->scale,
+    phoc_view_move_resize (self, self->saved.x - geom.x * priv->render.scale,
+                           self->saved.y - geom.y * priv->render.scale,
                            self->saved.width, self->saved.height);
   } else {
     phoc_view_resize (self, 0, 0);
@@ -634,7 +725,7 @@ phoc_view_set_fullscreen (PhocView *view, bool fullscreen, PhocOutput *output)
       output = phoc_view_get_output (view);
 
     if (was_fullscreen)
-      priv->fullscreen_output->fullscreen_view = NULL;
+      priv->render.fullscreen_output->fullscreen_view = NULL;
 
     struct wlr_box view_box;
     phoc_view_get_box (view, &view_box);
@@ -644,21 +735,21 @@ phoc_view_set_fullscreen (PhocView *view, bool fullscreen, PhocOutput *output)
     struct wlr_box output_box;
     wlr_output_layout_get_box (view->desktop->layout, output->wlr_output, &output_box);
     phoc_view_move_resize (view,
-                           output_box.x - view_geom.x * priv->scale,
-                           output_box.y - view_geom.y * priv->scale,
+                           output_box.x - view_geom.x * priv->render.scale,
+                           output_box.y - view_geom.y * priv->render.scale,
                            output_box.width,
                            output_box.height);
 
     output->fullscreen_view = view;
     phoc_output_force_shell_reveal (output, false);
-    priv->fullscreen_output = output;
+    priv->render.fullscreen_output = output;
     phoc_output_damage_whole (output);
   }
 
   if (was_fullscreen && !fullscreen) {
-    PhocOutput *phoc_output = priv->fullscreen_output;
-    priv->fullscreen_output->fullscreen_view = NULL;
-    priv->fullscreen_output = NULL;
+    PhocOutput *phoc_output = priv->render.fullscreen_output;
+    priv->render.fullscreen_output->fullscreen_view = NULL;
+    priv->render.fullscreen_output = NULL;
 
     phoc_output_damage_whole (phoc_output);
 
@@ -668,8 +759,8 @@ phoc_view_set_fullscreen (PhocView *view, bool fullscreen, PhocOutput *output)
       view_arrange_tiled (view, phoc_output);
     } else if (!wlr_box_empty (&view->saved)) {
       phoc_view_move_resize (view,
-                             view->saved.x - view_geom.x * priv->scale,
-                             view->saved.y - view_geom.y * priv->scale,
+                             view->saved.x - view_geom.x * priv->render.scale,
+                             view->saved.y - view_geom.y * priv->render.scale,
                              view->saved.width,
                              view->saved.height);
     } else {
@@ -681,7 +772,7 @@ phoc_view_set_fullscreen (PhocView *view, bool fullscreen, PhocOutput *output)
   }
 
   phoc_server_set_linux_dmabuf_surface_feedback (phoc_server_get_default (),
-                                                 view, priv->fullscreen_output, fullscreen);
+                                                 view, priv->render.fullscreen_output, fullscreen);
 }
 
 
@@ -747,7 +838,7 @@ phoc_view_move_to_corner (PhocView *self, PhocViewCorner corner)
     return;
 
   /* TODO: Simplify scale-to-fit vs geom before enabling */
-  if (!G_APPROX_VALUE (priv->scale, 1.0, FLT_EPSILON)) {
+  if (!G_APPROX_VALUE (priv->render.scale, 1.0, FLT_EPSILON)) {
     g_warning_once ("move-to-center not allowed for scale-to-fit-views");
     return;
   }
@@ -851,12 +942,12 @@ view_center (PhocView *view, PhocOutput *output)
   struct wlr_box usable_area = output->usable_area;
 
   double view_x = (double)(usable_area.width - box.width) / 2 +
-    usable_area.x + l_output->x - geom.x * priv->scale;
+    usable_area.x + l_output->x - geom.x * priv->render.scale;
   double view_y = (double)(usable_area.height - box.height) / 2 +
-    usable_area.y + l_output->y - geom.y * priv->scale;
+    usable_area.y + l_output->y - geom.y * priv->render.scale;
 
   g_debug ("moving view to %f %f", view_x, view_y);
-  phoc_view_move (view, view_x / priv->scale, view_y / priv->scale);
+  phoc_view_move (view, view_x / priv->render.scale, view_y / priv->render.scale);
 
   if (!desktop->maximize) {
     // TODO: fitting floating oversized windows requires more work (!228)
@@ -894,27 +985,10 @@ phoc_view_handle_surface_new_subsurface (struct wl_listener *listener, void *dat
   PhocView *self = PHOC_VIEW_SELF (priv);
   struct wlr_subsurface *wlr_subsurface = data;
 
+  phoc_view_invalidate_surfaces (self);
   phoc_subsurface_new (self, wlr_subsurface);
 }
 
-static gchar *
-munge_app_id (const gchar *app_id)
-{
-  gchar *id = g_strdup (app_id);
-  gint i;
-
-  g_strcanon (id,
-              "0123456789"
-              "abcdefghijklmnopqrstuvwxyz"
-              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-              "-",
-              '-');
-  for (i = 0; id[i] != '\0'; i++)
-    id[i] = g_ascii_tolower (id[i]);
-
-  return id;
-}
-
 static void
 view_update_scale (PhocView *view)
 {
@@ -931,27 +1005,34 @@ view_update_scale (PhocView *view)
   if (!output)
     return;
 
-  float scalex = 1.0f, scaley = 1.0f, oldscale = priv->scale;
+  float scalex = 1.0f, scaley = 1.0f, oldscale = priv->render.scale;
 
   if (priv->scale_to_fit || phoc_desktop_get_scale_to_fit (desktop)) {
     scalex = output->usable_area.width / (float)view->box.width;
     scaley = output->usable_area.height / (float)view->box.height;
     if (scaley < scalex)
-      priv->scale = scaley;
+      priv->render.scale = scaley;
     else
-      priv->scale = scalex;
+      priv->render.scale = scalex;
 
-    if (priv->scale < 0.5f)
-      priv->scale = 0.5f;
+    if (priv->render.scale < 0.5f)
+      priv->render.scale = 0.5f;
 
-    if (priv->scale > 1.0f || phoc_view_is_fullscreen (view))
-      priv->scale = 1.0f;
+    if (priv->render.scale > 1.0f || phoc_view_is_fullscreen (view))
+      priv->render.scale = 1.0f;
   } else {
-    priv->scale = 1.0;
+    priv->render.scale = 1.0;
   }
 
-  if (priv->scale != oldscale)
+  if (priv->render.scale != oldscale) {
+    /* The box changes with the scale */
+    priv->outputs_valid = FALSE;
+    priv->geometry_valid = FALSE;
     phoc_view_arrange (view, NULL, TRUE);
+    /* Let the client render at the size it's displayed at */
+    if (phoc_view_is_mapped (view))
+      phoc_view_for_each_surface (view, surface_update_scales_iterator, &priv->render.scale);
+  }
 }
 
 
@@ -970,6 +1051,8 @@ phoc_view_map (PhocView *self, struct wlr_surface *surface)
 
   g_assert (self->wlr_surface == NULL);
   self->wlr_surface = surface;
+  priv->surfaces_valid = FALSE;
+  priv->geometry_valid = FALSE;
 
   phoc_view_init_subsurfaces (self, self->wlr_surface);
   priv->surface_new_subsurface.notify = phoc_view_handle_surface_new_subsurface;
@@ -991,6 +1074,16 @@ phoc_view_map (PhocView *self, struct wlr_surface *surface)
   if (self->parent && phoc_view_is_always_on_top (self->parent))
     phoc_view_set_always_on_top (self, TRUE);
 
+  /* App settings changes are only applied to views on the desktop */
+  if (priv->settings)
+    phoc_view_set_scale_to_fit (self, g_settings_get_boolean (priv->settings, "scale-to-fit"));
+
+  /* Fullscreen before the first commit so there was no surface to send feedback to */
+  if (priv->render.fullscreen_output) {
+    phoc_server_set_linux_dmabuf_surface_feedback (phoc_server_get_default (),
+                                                   self, priv->render.fullscreen_output, true);
+  }
+
   phoc_desktop_insert_view (self->desktop, self);
   phoc_view_damage_whole (self);
   phoc_input_update_cursor_focus (input);
@@ -1005,19 +1098,14 @@ phoc_view_map (PhocView *self, struct wlr_surface *surface)
   if (phoc_desktop_get_enable_animations (self->desktop)
       && self->parent == NULL
       && !phoc_view_want_auto_maximize (self)) {
-    g_autoptr (PhocTimedAnimation) fade_anim = NULL;
-    g_autoptr (PhocPropertyEaser) easer = NULL;
-    easer = g_object_new (PHOC_TYPE_PROPERTY_EASER,
-                          "target", self,
-                          "easing", PHOC_EASING_EASE_OUT_QUAD,
-                          NULL);
-    phoc_property_easer_set_props (easer, "alpha", 0.0, 1.0, NULL);
-    fade_anim = g_object_new (PHOC_TYPE_TIMED_ANIMATION,
-                              "animatable", phoc_view_get_output (self),
-                              "duration", PHOC_ANIM_DURATION_WINDOW_FADE,
-                              "property-easer", easer,
-                              "dispose-on-done", TRUE,
-                              NULL);
+    PhocTimedAnimation *fade_anim;
+
+    fade_anim = phoc_timed_animation_acquire (PHOC_ANIMATABLE (phoc_view_get_output (self)),
+                                              G_OBJECT (self),
+                                              PHOC_EASING_EASE_OUT_QUAD,
+                                              PHOC_ANIM_DURATION_WINDOW_FADE);
+    phoc_property_easer_set_props (phoc_timed_animation_get_property_easer (fade_anim),
+                                   "alpha", 0.0, 1.0, NULL);
     phoc_timed_animation_play (fade_anim);
   }
 
@@ -1033,7 +1121,17 @@ phoc_view_unmap (PhocView *view)
 
   bool was_visible = phoc_desktop_view_is_visible (view->desktop, view);
 
+  /* The client's buffers go away so fade out a copy instead */
+  if (was_visible && phoc_desktop_get_enable_animations (view->desktop) && view->parent == NULL) {
+    g_autoptr (PhocViewSnapshot) snapshot = phoc_view_snapshot_new (view);
+
+    if (snapshot)
+      phoc_view_snapshot_play_close (snapshot);
+  }
+
   phoc_view_damage_whole (view);
+  priv->outputs_valid = FALSE;
+  priv->surfaces_valid = FALSE;
 
   wl_list_remove (&priv->surface_new_subsurface.link);
 
@@ -1042,9 +1140,9 @@ phoc_view_unmap (PhocView *view)
     g_object_unref (child);
 
   if (phoc_view_is_fullscreen (view)) {
-    phoc_output_damage_whole (priv->fullscreen_output);
-    priv->fullscreen_output->fullscreen_view = NULL;
-    priv->fullscreen_output = NULL;
+    phoc_output_damage_whole (priv->render.fullscreen_output);
+    priv->render.fullscreen_output->fullscreen_view = NULL;
+    priv->render.fullscreen_output = NULL;
   }
 
   phoc_desktop_remove_view (view->desktop, view);
@@ -1060,7 +1158,9 @@ phoc_view_unmap (PhocView *view)
 
   view->wlr_surface = NULL;
   view->box.width = view->box.height = 0;
+  priv->geometry_valid = FALSE;
 
+  g_clear_handle_id (&priv->toplevel_update_id, g_source_remove);
   if (priv->toplevel_handle) {
     priv->toplevel_handle->data = NULL;
     wlr_foreign_toplevel_handle_v1_destroy (priv->toplevel_handle);
@@ -1151,10 +1251,153 @@ phoc_view_setup (PhocView *view)
 void
 phoc_view_apply_damage (PhocView *view)
 {
+  PhocViewPrivate *priv = phoc_view_get_instance_private (view);
   PhocOutput *output;
 
-  wl_list_for_each (output, &view->desktop->outputs, link)
-    phoc_output_damage_from_view (output, view, false);
+  /* Surfaces might have been resized or moved */
+  priv->input_bounds_valid = FALSE;
+  priv->geometry_valid = FALSE;
+  priv->surfaces_valid = FALSE;
+  priv->content_serial++;
+
+  /*
+   * Only damage the outputs the view is on. Child surfaces like popups
+   * and subsurfaces can extend beyond the view's box so check all
+   * outputs then.
+   */
+  if (priv->outputs_valid &&
+      priv->outputs_layout_serial == phoc_desktop_get_layout_serial (view->desktop) &&
+      wl_list_empty (&priv->child_surfaces)) {
+    for (guint i = 0; i < priv->n_outputs; i++)
+      phoc_output_damage_from_view (priv->outputs[i], view, false);
+  } else {
+    wl_list_for_each (output, &view->desktop->outputs, link)
+      phoc_output_damage_from_view (output, view, false);
+  }
+
+  g_signal_emit (view, signals[CONTENT_CHANGED], 0);
+}
+
+typedef struct {
+  GArray   *surfaces;
+  guint     idx;
+  gboolean  changed;
+} PhocViewCompareSurfacesData;
+
+
+static void
+compare_surface_iterator (struct wlr_surface *wlr_surface, int sx, int sy, void *data)
+{
+  PhocViewCompareSurfacesData *compare = data;
+  PhocViewSurface *surface;
+
+  if (compare->changed)
+    return;
+
+  if (compare->idx >= compare->surfaces->len) {
+    compare->changed = TRUE;
+    return;
+  }
+
+  surface = &g_array_index (compare->surfaces, PhocViewSurface, compare->idx++);
+  if (surface->wlr_surface != wlr_surface || surface->sx != sx || surface->sy != sy ||
+      surface->width != wlr_surface->current.width ||
+      surface->height != wlr_surface->current.height)
+    compare->changed = TRUE;
+}
+
+/*
+ * Whether a commit of the view's root surface changed its size, the
+ * view's geometry or the position, size or stacking of its
+ * subsurfaces. These are applied with the root surface's commit.
+ */
+static gboolean
+root_commit_changed_layout (PhocView *self)
+{
+  PhocViewPrivate *priv = phoc_view_get_instance_private (self);
+  struct wlr_surface *wlr_surface = self->wlr_surface;
+  PhocViewCompareSurfacesData compare = { .surfaces = priv->surfaces };
+  gboolean changed = FALSE;
+  struct wlr_box geometry;
+
+  if (wlr_surface->current.width != priv->committed_width ||
+      wlr_surface->current.height != priv->committed_height) {
+    priv->committed_width = wlr_surface->current.width;
+    priv->committed_height = wlr_surface->current.height;
+    changed = TRUE;
+  }
+
+  if (changed || !priv->surfaces_valid || !priv->geometry_valid)
+    return TRUE;
+
+  PHOC_VIEW_GET_CLASS (self)->get_geometry (self, &geometry);
+  if (!wlr_box_equal (&geometry, &priv->geometry))
+    return TRUE;
+
+  PHOC_VIEW_GET_CLASS (self)->for_each_surface (self, compare_surface_iterator, &compare);
+
+  return compare.changed || compare.idx != priv->surfaces->len;
+}
+
+/**
+ * phoc_view_apply_commit_damage:
+ * @self: A view
+ *
+ * Like [method@View.apply_damage] but for a commit of the view's root
+ * surface. If the commit didn't change the root surface's size, the
+ * view's geometry or the position or size of its subsurfaces only the root
+ * surface's buffer damage is added and the view's cached surfaces,
+ * geometry and input bounds stay valid. Children damage themselves on
+ * their own commits.
+ */
+void
+phoc_view_apply_commit_damage (PhocView *self)
+{
+  PhocViewPrivate *priv = phoc_view_get_instance_private (self);
+  PhocOutput *output;
+
+  if (root_commit_changed_layout (self)) {
+    phoc_view_apply_damage (self);
+    return;
+  }
+
+  priv->content_serial++;
+
+  if (priv->outputs_valid &&
+      priv->outputs_layout_serial == phoc_desktop_get_layout_serial (self->desktop)) {
+    for (guint i = 0; i < priv->n_outputs; i++)
+      phoc_output_damage_from_view_root (priv->outputs[i], self);
+  } else {
+    wl_list_for_each (output, &self->desktop->outputs, link)
+      phoc_output_damage_from_view_root (output, self);
+  }
+
+  g_signal_emit (self, signals[CONTENT_CHANGED], 0);
+}
+
+/**
+ * phoc_view_child_changed:
+ * @self: A view
+ * @moved: Whether the child moved or got resized
+ *
+ * Invalidates what a child surface's commit, map or unmap can
+ * change. Unlike
+ * [method@View.apply_damage] this doesn't damage the view's surface
+ * tree, the child takes care of damaging itself.
+ */
+void
+phoc_view_child_changed (PhocView *self, gboolean moved)
+{
+  PhocViewPrivate *priv = phoc_view_get_instance_private (self);
+
+  if (moved) {
+    priv->input_bounds_valid = FALSE;
+    priv->geometry_valid = FALSE;
+    priv->surfaces_valid = FALSE;
+  }
+  priv->content_serial++;
+
+  g_signal_emit (self, signals[CONTENT_CHANGED], 0);
 }
 
 /**
@@ -1169,9 +1412,17 @@ phoc_view_apply_damage (PhocView *view)
 void
 phoc_view_damage_whole (PhocView *view)
 {
+  PhocViewPrivate *priv = phoc_view_get_instance_private (view);
   PhocOutput *output;
+
+  priv->input_bounds_valid = FALSE;
+  priv->geometry_valid = FALSE;
+  priv->content_serial++;
+
   wl_list_for_each (output, &view->desktop->outputs, link)
     phoc_output_damage_from_view (output, view, true);
+
+  g_signal_emit (view, signals[CONTENT_CHANGED], 0);
 }
 
 
@@ -1190,6 +1441,130 @@ view_update_position (PhocView *view, int x, int y)
   phoc_view_damage_whole (view);
 }
 
+/*
+ * The area the view covers in layout coordinates including popups and
+ * blings. Returns %FALSE if unknown.
+ */
+static gboolean
+get_damage_extents (PhocView *self, struct wlr_box *extents)
+{
+  struct wlr_box bounds;
+  float scale = phoc_view_get_scale (self);
+  int x2, y2;
+
+  if (!phoc_view_get_input_bounds (self, &bounds))
+    return FALSE;
+
+  /* Round outwards so scaled views don't leave stale edges behind */
+  extents->x = floor ((self->box.x + bounds.x) * scale);
+  extents->y = floor ((self->box.y + bounds.y) * scale);
+  extents->width = ceil ((self->box.x + bounds.x + bounds.width) * scale) - extents->x;
+  extents->height = ceil ((self->box.y + bounds.y + bounds.height) * scale) - extents->y;
+
+  for (GSList *l = phoc_view_get_blings (self); l; l = l->next) {
+    PhocBox box = phoc_bling_get_box (PHOC_BLING (l->data));
+
+    if (wlr_box_empty (&box))
+      continue;
+
+    x2 = MAX (extents->x + extents->width, box.x + box.width);
+    y2 = MAX (extents->y + extents->height, box.y + box.height);
+    extents->x = MIN (extents->x, box.x);
+    extents->y = MIN (extents->y, box.y);
+    extents->width = x2 - extents->x;
+    extents->height = y2 - extents->y;
+  }
+
+  return TRUE;
+}
+
+
+static void
+damage_extents (PhocView *self, const struct wlr_box *extents)
+{
+  PhocOutput *output;
+
+  wl_list_for_each (output, &self->desktop->outputs, link) {
+    struct wlr_box box = *extents;
+
+    if (!wlr_output_layout_intersects (self->desktop->layout, output->wlr_output, extents))
+      continue;
+
+    box.x -= output->lx;
+    box.y -= output->ly;
+    phoc_output_damage_box (output, &box);
+  }
+}
+
+/**
+ * phoc_view_move_interactive:
+ * @self: The view
+ * @x: The new x coordinate
+ * @y: The new y coordinate
+ *
+ * Moves @self during an interactive move. Unlike [method@View.move]
+ * the surface tree isn't walked to damage the view and the client
+ * isn't told about the new position (which would e.g. send a
+ * configure to X11 clients on every motion event). Only the area the
+ * view covered before and covers after the move is damaged. Call
+ * [method@View.end_interactive_move] when the move is done.
+ */
+void
+phoc_view_move_interactive (PhocView *self, double x, double y)
+{
+  PhocViewPrivate *priv;
+  struct wlr_box before, extents;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  if (self->box.x == x && self->box.y == y)
+    return;
+
+  if (!phoc_view_is_mapped (self) || !get_damage_extents (self, &extents)) {
+    phoc_view_move (self, x, y);
+    return;
+  }
+
+  self->pending_move_resize.update_x = false;
+  self->pending_move_resize.update_y = false;
+  self->pending_centering = false;
+
+  phoc_view_get_box (self, &before);
+  damage_extents (self, &extents);
+
+  self->box.x = x;
+  self->box.y = y;
+  priv->interactive_move = TRUE;
+  view_update_output (self, &before);
+
+  get_damage_extents (self, &extents);
+  damage_extents (self, &extents);
+}
+
+/**
+ * phoc_view_end_interactive_move:
+ * @self: The view
+ *
+ * Tells the client about the final position of an interactive move
+ * started by [method@View.move_interactive].
+ */
+void
+phoc_view_end_interactive_move (PhocView *self)
+{
+  PhocViewPrivate *priv;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  if (!priv->interactive_move)
+    return;
+
+  priv->interactive_move = FALSE;
+  PHOC_VIEW_GET_CLASS (self)->move (self, self->box.x, self->box.y);
+}
+
+
 void
 view_update_size (PhocView *view, int width, int height)
 {
@@ -1213,16 +1588,55 @@ view_update_size (PhocView *view, int width, int height)
 }
 
 
+static gboolean
+on_toplevel_update (gpointer data)
+{
+  PhocView *self = PHOC_VIEW (data);
+  PhocViewPrivate *priv = phoc_view_get_instance_private (self);
+  struct wlr_foreign_toplevel_handle_v1 *handle = priv->toplevel_handle;
+  const char *title = priv->title ?: "";
+  const char *app_id = priv->app_id ?: "";
+
+  priv->toplevel_update_id = 0;
+
+  if (!handle)
+    return G_SOURCE_REMOVE;
+
+  /* wlroots sends a single done for all of these */
+  if (g_strcmp0 (handle->title, title))
+    wlr_foreign_toplevel_handle_v1_set_title (handle, title);
+  if (g_strcmp0 (handle->app_id, app_id))
+    wlr_foreign_toplevel_handle_v1_set_app_id (handle, app_id);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+queue_toplevel_update (PhocView *self)
+{
+  PhocViewPrivate *priv = phoc_view_get_instance_private (self);
+
+  if (!priv->toplevel_handle || priv->toplevel_update_id)
+    return;
+
+  priv->toplevel_update_id = g_idle_add (on_toplevel_update, self);
+  g_source_set_name_by_id (priv->toplevel_update_id, "[phoc] foreign toplevel update");
+}
+
+
 void
 view_set_title (PhocView *view, const char *title)
 {
   PhocViewPrivate *priv = phoc_view_get_instance_private (view);
 
+  if (g_strcmp0 (priv->title, title) == 0)
+    return;
+
   g_free (priv->title);
   priv->title = g_strdup (title);
 
-  if (priv->toplevel_handle)
-    wlr_foreign_toplevel_handle_v1_set_title (priv->toplevel_handle, title ?: "");
+  queue_toplevel_update (view);
 }
 
 void
@@ -1251,7 +1665,7 @@ view_set_parent (PhocView *view, PhocView *parent)
   if (view->parent)
     toplevel_handle = phoc_view_get_toplevel_handle (view->parent);
 
-  if (priv->toplevel_handle)
+  if (priv->toplevel_handle && priv->toplevel_handle->parent != toplevel_handle)
     wlr_foreign_toplevel_handle_v1_set_parent (priv->toplevel_handle, toplevel_handle);
 }
 
@@ -1264,15 +1678,9 @@ bind_scale_to_fit_setting (PhocView *self)
   g_clear_object (&priv->settings);
 
   if (priv->app_id) {
-    g_autofree gchar *munged_app_id = munge_app_id (priv->app_id);
-    g_autofree gchar *path = g_strconcat ("/sm/puri/phoc/application/", munged_app_id, "/", NULL);
-    priv->settings = g_settings_new_with_path ("sm.puri.phoc.application", path);
-
-    g_settings_bind (priv->settings,
-                     "scale-to-fit",
-                     self,
-                     "scale-to-fit",
-                     G_SETTINGS_BIND_GET);
+    /* Shared between all views of the app, changes are applied by the desktop */
+    priv->settings = phoc_desktop_get_app_settings (self->desktop, priv->app_id);
+    phoc_view_set_scale_to_fit (self, g_settings_get_boolean (priv->settings, "scale-to-fit"));
   }
 }
 
@@ -1292,8 +1700,7 @@ phoc_view_set_app_id (PhocView *view, const char *app_id)
     bind_scale_to_fit_setting (view);
   }
 
-  if (priv->toplevel_handle)
-    wlr_foreign_toplevel_handle_v1_set_app_id (priv->toplevel_handle, app_id ?: "");
+  queue_toplevel_update (view);
 }
 
 static void
@@ -1385,10 +1792,10 @@ phoc_view_set_alpha (PhocView *self, float alpha)
   g_assert (PHOC_IS_VIEW (self));
   priv = phoc_view_get_instance_private (self);
 
-  if (G_APPROX_VALUE (priv->alpha, alpha, FLT_EPSILON))
+  if (G_APPROX_VALUE (priv->render.alpha, alpha, FLT_EPSILON))
     return;
 
-  priv->alpha = alpha;
+  priv->render.alpha = alpha;
   phoc_view_damage_whole (self);
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_ALPHA]);
 }
@@ -1460,6 +1867,8 @@ phoc_view_finalize (GObject *object)
   PhocView *self = PHOC_VIEW (object);
   PhocViewPrivate *priv = phoc_view_get_instance_private (self);
 
+  g_clear_handle_id (&priv->toplevel_update_id, g_source_remove);
+
   /* Unlink from our parent */
   if (self->parent) {
     wl_list_remove (&self->parent_link);
@@ -1481,12 +1890,15 @@ phoc_view_finalize (GObject *object)
 
   // Can happen if fullscreened while unmapped, and hasn't been mapped
   if (phoc_view_is_fullscreen (self))
-    priv->fullscreen_output->fullscreen_view = NULL;
+    priv->render.fullscreen_output->fullscreen_view = NULL;
 
-  g_clear_slist (&priv->blings, g_object_unref);
+  g_clear_slist (&priv->render.blings, g_object_unref);
   g_clear_pointer (&priv->title, g_free);
   g_clear_pointer (&priv->app_id, g_free);
+  if (priv->activation_token)
+    phoc_desktop_untrack_activation_token (self->desktop, self, priv->activation_token);
   g_clear_pointer (&priv->activation_token, g_free);
+  g_clear_pointer (&priv->surfaces, g_array_unref);
   g_clear_object (&priv->deco);
   g_clear_object (&priv->settings);
 
@@ -1515,8 +1927,8 @@ phoc_view_get_geometry_default (PhocView *self, struct wlr_box *geom)
 
   geom->x = 0;
   geom->y = 0;
-  geom->width = self->box.width * priv->scale;
-  geom->height = self->box.height * priv->scale;
+  geom->width = self->box.width * priv->render.scale;
+  geom->height = self->box.height * priv->render.scale;
 }
 
 
@@ -1687,6 +2099,21 @@ phoc_view_class_init (PhocViewClass *klass)
                   NULL, NULL, NULL,
                   G_TYPE_NONE,
                   0);
+
+  /**
+   * PhocView::content-changed:
+   *
+   * The content of the view might have changed, see
+   * [method@View.get_content_serial].
+   */
+  signals[CONTENT_CHANGED] =
+    g_signal_new ("content-changed",
+                  G_TYPE_FROM_CLASS (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL, NULL,
+                  G_TYPE_NONE,
+                  0);
 }
 
 
@@ -1696,12 +2123,13 @@ phoc_view_init (PhocView *self)
   PhocViewPrivate *priv;
 
   priv = phoc_view_get_instance_private (self);
-  priv->alpha = 1.0f;
-  priv->scale = 1.0f;
+  priv->render.alpha = 1.0f;
+  priv->render.scale = 1.0f;
   priv->state = PHOC_VIEW_STATE_FLOATING;
 
   wl_list_init (&priv->child_surfaces);
   wl_list_init (&self->stack);
+  priv->surfaces = g_array_new (FALSE, FALSE, sizeof (PhocViewSurface));
 
   self->desktop = phoc_server_get_desktop (phoc_server_get_default ());
 
@@ -1836,7 +2264,8 @@ phoc_view_get_scale_to_fit (PhocView *self)
  * @token: The activation token to use
  *
  * Sets the activation token that will be used when activate the view
- * once mapped. It will be cleared once the view got activated.
+ * once mapped. It will be cleared once the view got activated or the
+ * token expired.
  */
 void
 phoc_view_set_activation_token (PhocView *self, const char *token, int type)
@@ -1849,9 +2278,16 @@ phoc_view_set_activation_token (PhocView *self, const char *token, int type)
   if (g_strcmp0 (priv->activation_token, token) == 0)
     return;
 
+  if (priv->activation_token)
+    phoc_desktop_untrack_activation_token (self->desktop, self, priv->activation_token);
+
   g_free (priv->activation_token);
   priv->activation_token = g_strdup (token);
   priv->activation_token_type = type;
+
+  if (token)
+    phoc_desktop_track_activation_token (self->desktop, self, token);
+
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_ACTIVATION_TOKEN]);
 }
 
@@ -1914,7 +2350,7 @@ phoc_view_get_alpha (PhocView *self)
   g_assert (PHOC_IS_VIEW (self));
   priv = phoc_view_get_instance_private (self);
 
-  return priv->alpha;
+  return priv->render.alpha;
 }
 
 /**
@@ -1933,7 +2369,7 @@ phoc_view_get_scale (PhocView *self)
   g_assert (PHOC_IS_VIEW (self));
   priv = phoc_view_get_instance_private (self);
 
-  return priv->scale;
+  return priv->render.scale;
 }
 
 /**
@@ -1978,34 +2414,260 @@ phoc_view_is_decorated (PhocView *self)
 }
 
 
+static void
+collect_surface_iterator (struct wlr_surface *wlr_surface, int sx, int sy, void *data)
+{
+  GArray *surfaces = data;
+  PhocViewSurface surface = {
+    wlr_surface, sx, sy, wlr_surface->current.width, wlr_surface->current.height
+  };
+
+  g_array_append_val (surfaces, surface);
+}
+
+/**
+ * phoc_view_for_each_surface:
+ * @self: a view
+ * @iterator: (scope call): The callback invoked on each surface
+ * @user_data: Callback user data
+ *
+ * Iterate over the surfaces in the view's surface tree. The tree is
+ * walked once and cached until it is invalidated by a commit or a
+ * change in the tree's structure.
+ */
 void
 phoc_view_for_each_surface (PhocView                    *self,
                             wlr_surface_iterator_func_t  iterator,
                             void                        *user_data)
 {
+  PhocViewPrivate *priv;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  if (!priv->surfaces_valid) {
+    g_array_set_size (priv->surfaces, 0);
+    PHOC_VIEW_GET_CLASS (self)->for_each_surface (self, collect_surface_iterator, priv->surfaces);
+    priv->surfaces_valid = TRUE;
+  }
+
+  for (guint i = 0; i < priv->surfaces->len; i++) {
+    /* Copy as the iterator might end up rebuilding the array */
+    PhocViewSurface surface = g_array_index (priv->surfaces, PhocViewSurface, i);
+
+    iterator (surface.wlr_surface, surface.sx, surface.sy, user_data);
+  }
+}
+
+/**
+ * phoc_view_invalidate_surfaces:
+ * @self: a view
+ *
+ * Drops the cached flattened surface tree used by
+ * [method@View.for_each_surface]. Needs to be called whenever a
+ * surface is added to or removed from the view's surface tree or a
+ * surface's position within the tree might have changed.
+ */
+void
+phoc_view_invalidate_surfaces (PhocView *self)
+{
+  PhocViewPrivate *priv;
+
   g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
 
-  PHOC_VIEW_GET_CLASS (self)->for_each_surface (self, iterator, user_data);
+  priv->surfaces_valid = FALSE;
 }
 
+/**
+ * phoc_view_get_popup_constraint_box:
+ * @self: a view
+ * @box: (out): The constraint box in view coordinates
+ *
+ * Gets the usable area of the output the view's geometry starts on,
+ * relative to the view's position. Popups get unconstrained against
+ * it. Popups that reposition often (e.g. completions while typing)
+ * would otherwise look up the output in the layout every time so
+ * the result is cached until the view moves, the output layout
+ * changes or the output's usable area changes.
+ *
+ * Returns: %FALSE if the view isn't on any output
+ */
+gboolean
+phoc_view_get_popup_constraint_box (PhocView *self, struct wlr_box *box)
+{
+  PhocViewPrivate *priv;
+  PhocDesktop *desktop;
+  struct wlr_box geom, output_box;
+  guint layout_serial;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+  desktop = self->desktop;
+
+  phoc_view_get_geometry (self, &geom);
+  layout_serial = phoc_desktop_get_layout_serial (desktop);
+
+  if (priv->popup_constraint.valid &&
+      priv->popup_constraint.layout_serial == layout_serial &&
+      priv->popup_constraint.x == self->box.x &&
+      priv->popup_constraint.y == self->box.y &&
+      priv->popup_constraint.geom_x == geom.x &&
+      priv->popup_constraint.geom_y == geom.y &&
+      wlr_box_equal (&priv->popup_constraint.usable_area, &priv->popup_constraint.output->usable_area)) {
+    *box = priv->popup_constraint.box;
+    return TRUE;
+  }
+
+  priv->popup_constraint.valid = FALSE;
+
+  PhocOutput *output = phoc_desktop_layout_get_output (desktop,
+                                                       self->box.x + geom.x,
+                                                       self->box.y + geom.y);
+  if (output == NULL)
+    return FALSE;
+
+  wlr_output_layout_get_box (desktop->layout, output->wlr_output, &output_box);
+
+  priv->popup_constraint.box = (struct wlr_box) {
+    .x = output_box.x + output->usable_area.x - self->box.x,
+    .y = output_box.y + output->usable_area.y - self->box.y,
+    .width = output->usable_area.width,
+    .height = output->usable_area.height,
+  };
+  /* The output can only go away with a layout change */
+  priv->popup_constraint.output = output;
+  priv->popup_constraint.usable_area = output->usable_area;
+  priv->popup_constraint.x = self->box.x;
+  priv->popup_constraint.y = self->box.y;
+  priv->popup_constraint.geom_x = geom.x;
+  priv->popup_constraint.geom_y = geom.y;
+  priv->popup_constraint.layout_serial = layout_serial;
+  priv->popup_constraint.valid = TRUE;
+
+  *box = priv->popup_constraint.box;
+  return TRUE;
+}
 
+
+static void
+input_bounds_iterator (struct wlr_surface *wlr_surface, int sx, int sy, void *data)
+{
+  struct wlr_box *bounds = data;
+  int x2, y2;
+
+  if (wlr_surface->current.width <= 0 || wlr_surface->current.height <= 0)
+    return;
+
+  if (wlr_box_empty (bounds)) {
+    *bounds = (struct wlr_box) { sx, sy, wlr_surface->current.width, wlr_surface->current.height };
+    return;
+  }
+
+  x2 = MAX (bounds->x + bounds->width, sx + wlr_surface->current.width);
+  y2 = MAX (bounds->y + bounds->height, sy + wlr_surface->current.height);
+  bounds->x = MIN (bounds->x, sx);
+  bounds->y = MIN (bounds->y, sy);
+  bounds->width = x2 - bounds->x;
+  bounds->height = y2 - bounds->y;
+}
+
+/**
+ * phoc_view_get_input_bounds:
+ * @self: The view
+ * @bounds: (out): The bounds in surface local coordinates
+ *
+ * Get the area covered by all of the view's surfaces including
+ * subsurfaces and popups. Input at points outside of @bounds can't hit
+ * the view which allows to skip the more expensive lookup via
+ * [method@View.get_wlr_surface_at]. The result is cached until the
+ * view gets damaged.
+ *
+ * Returns: %FALSE if the bounds aren't known, e.g. due to server side
+ *  decorations. In that case @bounds isn't touched.
+ */
+gboolean
+phoc_view_get_input_bounds (PhocView *self, struct wlr_box *bounds)
+{
+  PhocViewPrivate *priv;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  if (priv->deco)
+    return FALSE;
+
+  if (!priv->input_bounds_valid) {
+    priv->input_bounds = (struct wlr_box) { 0 };
+    phoc_view_for_each_surface (self, input_bounds_iterator, &priv->input_bounds);
+    priv->input_bounds_valid = TRUE;
+  }
+
+  *bounds = priv->input_bounds;
+  return TRUE;
+}
+
+
+/**
+ * phoc_view_get_content_serial:
+ * @self: The view
+ *
+ * Get a serial that changes whenever the content of the view might
+ * have changed. This allows to cache things rendered from the view's
+ * surfaces like thumbnails.
+ *
+ * Returns: The content serial
+ */
+guint64
+phoc_view_get_content_serial (PhocView *self)
+{
+  PhocViewPrivate *priv;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  return priv->content_serial;
+}
+
+
+/**
+ * phoc_view_get_geometry:
+ * @self: The view
+ * @geom: (out): The view's geometry
+ *
+ * Gets the view's window geometry in surface local coordinates. The
+ * result is cached until the view commits or gets configured so it's
+ * cheap to use in render and hit test loops.
+ */
 void
 phoc_view_get_geometry (PhocView *self, struct wlr_box *geom)
 {
+  PhocViewPrivate *priv;
+
   g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
 
-  PHOC_VIEW_GET_CLASS (self)->get_geometry (self, geom);
+  if (!priv->geometry_valid) {
+    PHOC_VIEW_GET_CLASS (self)->get_geometry (self, &priv->geometry);
+    priv->geometry_valid = TRUE;
+  }
+
+  *geom = priv->geometry;
 }
 
 
 void
 phoc_view_move (PhocView *self, double x, double y)
 {
+  PhocViewPrivate *priv;
+
   g_assert (PHOC_IS_VIEW (self));
 
-  if (self->box.x == x && self->box.y == y)
+  priv = phoc_view_get_instance_private (self);
+  if (self->box.x == x && self->box.y == y && !priv->interactive_move)
     return;
 
+  priv->interactive_move = FALSE;
   self->pending_move_resize.update_x = false;
   self->pending_move_resize.update_y = false;
   self->pending_centering = false;
@@ -2067,6 +2729,25 @@ phoc_view_get_app_id (PhocView *self)
   return priv->app_id;
 }
 
+/**
+ * phoc_view_get_app_settings:
+ * @self: The view
+ *
+ * Get the per application settings of the view's app_id.
+ *
+ * Returns:(transfer none)(nullable): The settings
+ */
+GSettings *
+phoc_view_get_app_settings (PhocView *self)
+{
+  PhocViewPrivate *priv;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  return priv->settings;
+}
+
 
 pid_t
 phoc_view_get_pid (PhocView *self)
@@ -2099,7 +2780,7 @@ phoc_view_add_bling (PhocView *self, PhocBling *bling)
   g_assert (PHOC_IS_BLING (bling));
   priv = phoc_view_get_instance_private (self);
 
-  priv->blings = g_slist_prepend (priv->blings, g_object_ref (bling));
+  priv->render.blings = g_slist_prepend (priv->render.blings, g_object_ref (bling));
 }
 
 /**
@@ -2118,9 +2799,9 @@ phoc_view_remove_bling (PhocView *self, PhocBling *bling)
   g_assert (PHOC_IS_BLING (bling));
   priv = phoc_view_get_instance_private (self);
 
-  g_return_if_fail (g_slist_find (priv->blings, bling));
+  g_return_if_fail (g_slist_find (priv->render.blings, bling));
 
-  priv->blings = g_slist_remove (priv->blings, bling);
+  priv->render.blings = g_slist_remove (priv->render.blings, bling);
   g_object_unref (bling);
 }
 
@@ -2140,7 +2821,27 @@ phoc_view_get_blings (PhocView *self)
   g_assert (PHOC_IS_VIEW (self));
   priv = phoc_view_get_instance_private (self);
 
-  return priv->blings;
+  return priv->render.blings;
+}
+
+/**
+ * phoc_view_get_render_state:
+ * @self: The view
+ *
+ * Gets the state needed to render the view. The returned state is
+ * only valid until the view changes.
+ *
+ * Returns: (transfer none): The view's render state
+ */
+const PhocViewRenderState *
+phoc_view_get_render_state (PhocView *self)
+{
+  PhocViewPrivate *priv;
+
+  phoc_assert_hot (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  return &priv->render;
 }
 
 /**
@@ -45,6 +45,23 @@ typedef enum {
   PHOC_VIEW_CORNER_SOUTH_WEST,
 } PhocViewCorner;
 
+/**
+ * PhocViewRenderState:
+ * @alpha: The view's opacity
+ * @scale: The view's scale
+ * @fullscreen_output: (nullable): The output the view is fullscreen on
+ * @blings: (element-type PhocBling): The view's blings
+ *
+ * The view state needed to render it, kept together so the renderer
+ * can fetch it with a single call per view and frame.
+ */
+typedef struct _PhocViewRenderState {
+  float         alpha;
+  float         scale;
+  PhocOutput   *fullscreen_output;
+  GSList       *blings;
+} PhocViewRenderState;
+
 /**
  * PhocView:
  * @parent: The view's parent
@@ -74,6 +91,7 @@ struct _PhocView {
   PhocView       *parent;
   struct wl_list  stack;
   struct wl_list  parent_link;
+  GList          *desktop_link; /* PhocDesktop's stack of views */
 
   struct wlr_surface *wlr_surface; // set only when the surface is mapped
 };
@@ -153,6 +171,8 @@ void                  phoc_view_arrange (PhocView *self, PhocOutput *output, gbo
 void                  phoc_view_get_box (PhocView *view, struct wlr_box *box);
 void                  phoc_view_get_geometry (PhocView *self, struct wlr_box *box);
 void                  phoc_view_move (PhocView *self, double x, double y);
+void                  phoc_view_move_interactive (PhocView *self, double x, double y);
+void                  phoc_view_end_interactive_move (PhocView *self);
 bool                  phoc_view_move_to_next_output (PhocView *view, enum wlr_direction direction);
 void                  phoc_view_move_to_corner (PhocView *self, PhocViewCorner corner);
 void                  phoc_view_move_resize (PhocView *view,
@@ -173,14 +193,19 @@ void                  phoc_view_set_fullscreen (PhocView   *view,
 void                  phoc_view_close (PhocView *self);
 void                  phoc_view_set_app_id (PhocView *view, const char *app_id);
 const char           *phoc_view_get_app_id (PhocView *self);
+GSettings            *phoc_view_get_app_settings (PhocView *self);
 void                  phoc_view_for_each_surface (PhocView                   *self,
                                                   wlr_surface_iterator_func_t iterator,
                                                   gpointer                    user_data);
+void                  phoc_view_invalidate_surfaces (PhocView *self);
+gboolean              phoc_view_get_popup_constraint_box (PhocView *self, struct wlr_box *box);
 struct wlr_surface   *phoc_view_get_wlr_surface_at (PhocView *self,
                                                     double    sx,
                                                     double    sy,
                                                     double   *sub_x,
                                                     double   *sub_y);
+gboolean              phoc_view_get_input_bounds (PhocView *self, struct wlr_box *bounds);
+guint64               phoc_view_get_content_serial (PhocView *self);
 PhocView             *phoc_view_from_wlr_surface (struct wlr_surface *wlr_surface);
 PhocOutput           *phoc_view_get_output (PhocView *view);
 
@@ -211,6 +236,7 @@ gboolean              phoc_view_get_tiled_box (PhocView             *self,
 void                  phoc_view_add_bling (PhocView *self, PhocBling *bling);
 void                  phoc_view_remove_bling (PhocView *self, PhocBling *bling);
 GSList               *phoc_view_get_blings (PhocView *self);
+const PhocViewRenderState *phoc_view_get_render_state (PhocView *self);
 void                  phoc_view_add_child (PhocView *self, PhocViewChild *child);
 
 G_END_DECLS
@@ -68,36 +68,27 @@ static void
 popup_unconstrain (PhocXdgPopup* self)
 {
   PhocView *view = phoc_view_child_get_view (PHOC_VIEW_CHILD (self));
-  struct wlr_box geom;
-  struct wlr_box output_box;
-  struct wlr_box usable_area;
-  PhocOutput *output;
-
-  phoc_view_get_geometry (view,  &geom);
-  output = phoc_desktop_layout_get_output (view->desktop,
-                                           view->box.x + geom.x,
-                                           view->box.y + geom.y);
-  if (output == NULL) {
+  struct wlr_box constraint_box;
+
+  if (!phoc_view_get_popup_constraint_box (view, &constraint_box)) {
     g_warning ("No output found for view %p at %d,%d", view, view->box.x, view->box.y);
     wlr_xdg_surface_schedule_configure (self->wlr_popup->base);
     return;
   }
 
-  wlr_output_layout_get_box (view->desktop->layout, output->wlr_output, &output_box);
-  usable_area = output->usable_area;
-  usable_area.x += output_box.x;
-  usable_area.y += output_box.y;
-
-  /* the output box expressed in the coordinate system of the toplevel parent
-   * of the popup */
-  struct wlr_box output_toplevel_sx_box = {
-    .x = usable_area.x - view->box.x,
-    .y = usable_area.y - view->box.y,
-    .width = usable_area.width,
-    .height = usable_area.height,
-  };
-
-  wlr_xdg_popup_unconstrain_from_box (self->wlr_popup, &output_toplevel_sx_box);
+  wlr_xdg_popup_unconstrain_from_box (self->wlr_popup, &constraint_box);
+}
+
+
+/* Whether moving the popup moves other surfaces too */
+static gboolean
+popup_has_children (PhocXdgPopup *self)
+{
+  struct wlr_surface *surface = self->wlr_popup->base->surface;
+
+  return !wl_list_empty (&self->wlr_popup->base->popups) ||
+    !wl_list_empty (&surface->current.subsurfaces_below) ||
+    !wl_list_empty (&surface->current.subsurfaces_above);
 }
 
 
@@ -125,8 +116,13 @@ popup_handle_reposition (struct wl_listener *listener, void *data)
 {
   PhocXdgPopup *self = wl_container_of (listener, self, reposition);
 
+  /* Clear the old popup position */
+  if (!popup_has_children (self))
+    phoc_view_child_damage_whole (PHOC_VIEW_CHILD (self));
+
   self->repositioned = TRUE;
   popup_unconstrain (self);
+  phoc_view_invalidate_surfaces (phoc_view_child_get_view (PHOC_VIEW_CHILD (self)));
 }
 
 
@@ -139,9 +135,11 @@ popup_handle_surface_commit (struct wl_listener *listener, void *data)
     popup_unconstrain (self);
 
   if (self->repositioned) {
-    /* clear the old popup position */
-    /* TODO: this is too much damage */
-    phoc_view_damage_whole (phoc_view_child_get_view (PHOC_VIEW_CHILD (self)));
+    /* The old position was damaged on reposition already */
+    if (popup_has_children (self))
+      phoc_view_damage_whole (phoc_view_child_get_view (PHOC_VIEW_CHILD (self)));
+    else
+      phoc_view_child_damage_whole (PHOC_VIEW_CHILD (self));
     self->repositioned = FALSE;
   }
 }
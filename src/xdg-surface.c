@@ -63,6 +63,12 @@ typedef struct _PhocXdgSurface {
   struct wl_listener surface_commit;
 
   uint32_t pending_move_resize_configure_serial;
+  /* Latest move_resize while a configure was in flight */
+  gboolean deferred_move_resize;
+  struct {
+    double   x, y;
+    uint32_t width, height;
+  } deferred;
 
   PhocXdgToplevelDecoration *decoration;
 } PhocXdgSurface;
@@ -151,6 +157,25 @@ move_resize (PhocView *view, double x, double y, uint32_t width, uint32_t height
     return;
   }
 
+  /*
+   * Only keep one resize in flight so slow clients (e.g. during
+   * interactive resize) don't lag behind. The latest size is sent once
+   * the client committed the previous one.
+   */
+  if (self->pending_move_resize_configure_serial > wlr_xdg_surface->current.configure_serial &&
+      (width != view->pending_move_resize.width || height != view->pending_move_resize.height)) {
+    self->deferred_move_resize = TRUE;
+    self->deferred.x = x;
+    self->deferred.y = y;
+    self->deferred.width = width;
+    self->deferred.height = height;
+    /* The view is only ready once the deferred size got committed */
+    if (phoc_desktop_view_is_visible (view->desktop, view))
+      phoc_layout_transaction_add_view (phoc_desktop_get_layout_transaction (view->desktop), view);
+    return;
+  }
+  self->deferred_move_resize = FALSE;
+
   bool update_x = x != view->box.x;
   bool update_y = y != view->box.y;
 
@@ -176,6 +201,8 @@ move_resize (PhocView *view, double x, double y, uint32_t width, uint32_t height
   } else {
     self->pending_move_resize_configure_serial =
       wlr_xdg_toplevel_set_size (wlr_xdg_surface->toplevel, constrained_width, constrained_height);
+    if (phoc_desktop_view_is_visible (view->desktop, view))
+      phoc_layout_transaction_add_view (phoc_desktop_get_layout_transaction (view->desktop), view);
   }
 
   view_send_frame_done_if_not_visible (view);
@@ -317,7 +344,9 @@ handle_surface_commit (struct wl_listener *listener, void *data)
   if (!surface->surface->mapped)
     return;
 
-  phoc_view_apply_damage (view);
+  phoc_commit_stats_record (phoc_server_get_commit_stats (phoc_server_get_default ()),
+                            surface->surface, G_OBJECT (view));
+  phoc_view_apply_commit_damage (view);
 
   struct wlr_box size;
   get_size (view, &size);
@@ -342,8 +371,13 @@ handle_surface_commit (struct wl_listener *listener, void *data)
     }
     view_update_position (view, x, y);
 
-    if (pending_serial == surface->current.configure_serial)
+    if (pending_serial == surface->current.configure_serial) {
       self->pending_move_resize_configure_serial = 0;
+      if (!self->deferred_move_resize) {
+        phoc_layout_transaction_view_ready (phoc_desktop_get_layout_transaction (view->desktop),
+                                            view);
+      }
+    }
   }
 
   struct wlr_box geometry;
@@ -356,6 +390,17 @@ handle_surface_commit (struct wl_listener *listener, void *data)
                          view->box.y + (self->saved_geometry.y - geometry.y) * scale);
   }
   self->saved_geometry = geometry;
+
+  if (self->deferred_move_resize &&
+      self->pending_move_resize_configure_serial <= surface->current.configure_serial) {
+    move_resize (view, self->deferred.x, self->deferred.y,
+                 self->deferred.width, self->deferred.height);
+    /* No configure needed after all, the current size is the final one */
+    if (!self->pending_move_resize_configure_serial) {
+      phoc_layout_transaction_view_ready (phoc_desktop_get_layout_transaction (view->desktop),
+                                          view);
+    }
+  }
 }
 
 
@@ -682,6 +727,15 @@ phoc_xdg_surface_get_geometry (PhocXdgSurface *self, struct wlr_box *geom)
   wlr_xdg_surface_get_geometry (self->xdg_surface, geom);
 }
 
+
+struct wlr_xdg_surface *
+phoc_xdg_surface_get_wlr_xdg_surface (PhocXdgSurface *self)
+{
+  g_assert (PHOC_IS_XDG_SURFACE (self));
+
+  return self->xdg_surface;
+}
+
 void
 phoc_xdg_surface_set_decoration (PhocXdgSurface            *self,
                                  PhocXdgToplevelDecoration *decoration)
@@ -701,15 +755,6 @@ phoc_xdg_surface_get_decoration (PhocXdgSurface *self)
 }
 
 
-struct wlr_xdg_surface *
-phoc_xdg_surface_get_wlr_xdg_surface (PhocXdgSurface *self)
-{
-  g_assert (PHOC_IS_XDG_SURFACE (self));
-
-  return self->xdg_surface;
-}
-
-
 void
 phoc_handle_xdg_shell_surface (struct wl_listener *listener, void *data)
 {
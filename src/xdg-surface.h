@@ -20,6 +20,8 @@ G_DECLARE_FINAL_TYPE (PhocXdgSurface, phoc_xdg_surface, PHOC, XDG_SURFACE, PhocV
 
 PhocXdgSurface     *phoc_xdg_surface_new (struct wlr_xdg_surface *xdg_surface);
 void                phoc_xdg_surface_get_geometry (PhocXdgSurface *self, struct wlr_box *geom);
+struct wlr_xdg_surface *
+                    phoc_xdg_surface_get_wlr_xdg_surface (PhocXdgSurface *self);
 struct wlr_surface *phoc_xdg_surface_get_wlr_surface_at (PhocXdgSurface *self,
                                                          double           sx,
                                                          double           sy,
@@ -10,6 +10,7 @@
 
 #include "phoc-config.h"
 #include "cursor.h"
+#include "output.h"
 #include "seat.h"
 #include "server.h"
 #include "view-private.h"
@@ -24,6 +25,9 @@ enum {
 };
 static GParamSpec *props[PROP_LAST_PROP];
 
+/* Bumped whenever an X11 surface gets (un)mapped, reparented or destroyed */
+static guint children_serial = 1;
+
 /**
  * PhocXWaylandSurface
  *
@@ -49,8 +53,17 @@ typedef struct _PhocXWaylandSurface {
   struct wl_listener set_title;
   struct wl_listener set_class;
   struct wl_listener set_startup_id;
+  struct wl_listener set_parent;
 
   struct wl_listener surface_commit;
+
+  /* Mapped descendants as of children_serial */
+  GPtrArray         *mapped_children;
+  guint              mapped_children_serial;
+
+  /* The latest configure request not yet applied */
+  struct wlr_box     pending_configure;
+  guint              configure_id;
 } PhocXWaylandSurface;
 
 G_DEFINE_TYPE (PhocXWaylandSurface, phoc_xwayland_surface, PHOC_TYPE_VIEW)
@@ -94,6 +107,8 @@ move (PhocView *view, double x, double y)
 
   g_assert (PHOC_IS_XWAYLAND_SURFACE (view));
   xwayland_surface = PHOC_XWAYLAND_SURFACE (view)->xwayland_surface;
+  /* The compositor's geometry wins over queued client requests */
+  g_clear_handle_id (&PHOC_XWAYLAND_SURFACE (view)->configure_id, g_source_remove);
 
   if (!is_moveable (view))
     return;
@@ -141,6 +156,8 @@ resize (PhocView *view, uint32_t width, uint32_t height)
 
   g_assert (PHOC_IS_XWAYLAND_SURFACE (view));
   xwayland_surface = PHOC_XWAYLAND_SURFACE (view)->xwayland_surface;
+  /* The compositor's geometry wins over queued client requests */
+  g_clear_handle_id (&PHOC_XWAYLAND_SURFACE (view)->configure_id, g_source_remove);
 
   uint32_t constrained_width, constrained_height;
   apply_size_constraints(view, xwayland_surface, width, height, &constrained_width,
@@ -157,6 +174,8 @@ move_resize (PhocView *view, double x, double y, uint32_t width, uint32_t height
 
   g_assert (PHOC_IS_XWAYLAND_SURFACE (view));
   xwayland_surface = PHOC_XWAYLAND_SURFACE (view)->xwayland_surface;
+  /* The compositor's geometry wins over queued client requests */
+  g_clear_handle_id (&PHOC_XWAYLAND_SURFACE (view)->configure_id, g_source_remove);
 
   if (!is_moveable (view)) {
     x = view->box.x;
@@ -279,20 +298,63 @@ handle_destroy (struct wl_listener *listener, void *data)
 {
   PhocXWaylandSurface *self = wl_container_of (listener, self, destroy);
 
+  children_serial++;
+  g_clear_handle_id (&self->configure_id, g_source_remove);
   g_signal_emit_by_name (self, "surface-destroy");
   g_object_unref (self);
 }
 
+static void
+apply_configure (PhocXWaylandSurface *self)
+{
+  struct wlr_box *box = &self->pending_configure;
+
+  g_clear_handle_id (&self->configure_id, g_source_remove);
+
+  /* Doesn't damage if the position is unchanged */
+  view_update_position (PHOC_VIEW (self), box->x, box->y);
+
+  /* Always reply so the client gets its ConfigureNotify */
+  wlr_xwayland_surface_configure (self->xwayland_surface, box->x, box->y, box->width, box->height);
+}
+
+
+static gboolean
+on_configure_idle (gpointer data)
+{
+  PhocXWaylandSurface *self = data;
+
+  self->configure_id = 0;
+  apply_configure (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
 static void
 handle_request_configure (struct wl_listener *listener, void *data)
 {
   PhocXWaylandSurface *self =  wl_container_of (listener, self, request_configure);
-  struct wlr_xwayland_surface *xwayland_surface = self->xwayland_surface;
   struct wlr_xwayland_surface_configure_event *event = data;
 
-  view_update_position (PHOC_VIEW (self), event->x, event->y);
+  self->pending_configure = (struct wlr_box) {
+    .x = event->x,
+    .y = event->y,
+    .width = event->width,
+    .height = event->height,
+  };
 
-  wlr_xwayland_surface_configure (xwayland_surface, event->x, event->y, event->width, event->height);
+  /* Clients resizing in a loop only need their latest request applied */
+  if (self->configure_id) {
+    PhocOutput *output = phoc_view_get_output (PHOC_VIEW (self));
+
+    if (output)
+      phoc_frame_stats_add_configures_coalesced (phoc_output_get_frame_stats (output), 1);
+    return;
+  }
+
+  self->configure_id = g_idle_add (on_configure_idle, self);
+  g_source_set_name_by_id (self->configure_id, "[phoc] xwayland configure");
 }
 
 static PhocSeat *
@@ -412,6 +474,8 @@ handle_surface_commit (struct wl_listener *listener, void *data)
   PhocView *view = PHOC_VIEW (self);
   struct wlr_surface *wlr_surface = view->wlr_surface;
 
+  phoc_commit_stats_record (phoc_server_get_commit_stats (phoc_server_get_default ()),
+                            wlr_surface, G_OBJECT (view));
   phoc_view_apply_damage (view);
 
   int width = wlr_surface->current.width;
@@ -449,6 +513,8 @@ handle_map (struct wl_listener *listener, void *data)
   struct wlr_xwayland_surface *surface = self->xwayland_surface;
   PhocView *view = PHOC_VIEW (self);
 
+  children_serial++;
+
   view->box.x = surface->x;
   view->box.y = surface->y;
   view->box.width = surface->surface->current.width;
@@ -480,6 +546,7 @@ handle_unmap (struct wl_listener *listener, void *data)
   PhocXWaylandSurface *self = wl_container_of (listener, self, unmap);
   PhocView *view = PHOC_VIEW (self);
 
+  children_serial++;
   wl_list_remove (&self->surface_commit.link);
   phoc_view_unmap (view);
 }
@@ -503,11 +570,18 @@ handle_dissociate (struct wl_listener *listener, void *data)
 {
   PhocXWaylandSurface *self = wl_container_of (listener, self, dissociate);
 
+  children_serial++;
   wl_list_remove (&self->map.link);
   wl_list_remove (&self->unmap.link);
 }
 
 
+static void
+handle_set_parent (struct wl_listener *listener, void *data)
+{
+  children_serial++;
+}
+
 /* }}} */
 
 
@@ -563,6 +637,11 @@ phoc_xwayland_surface_constructed (GObject *object)
   self->set_startup_id.notify = handle_set_startup_id;
   wl_signal_add(&surface->events.set_startup_id, &self->set_startup_id);
 
+  self->set_parent.notify = handle_set_parent;
+  wl_signal_add (&surface->events.set_parent, &self->set_parent);
+
+  self->mapped_children = g_ptr_array_new ();
+
   wl_list_init (&self->map.link);
   wl_list_init (&self->unmap.link);
 }
@@ -573,6 +652,7 @@ phoc_xwayland_surface_finalize (GObject *object)
 {
   PhocXWaylandSurface *self = PHOC_XWAYLAND_SURFACE(object);
 
+  g_clear_handle_id (&self->configure_id, g_source_remove);
   wl_list_remove(&self->destroy.link);
   wl_list_remove(&self->request_configure.link);
   wl_list_remove(&self->request_move.link);
@@ -584,6 +664,8 @@ phoc_xwayland_surface_finalize (GObject *object)
   wl_list_remove(&self->set_title.link);
   wl_list_remove(&self->set_class.link);
   wl_list_remove(&self->set_startup_id.link);
+  wl_list_remove (&self->set_parent.link);
+  g_clear_pointer (&self->mapped_children, g_ptr_array_unref);
 
   self->xwayland_surface->data = NULL;
 
@@ -656,3 +738,43 @@ phoc_xwayland_surface_get_wlr_surface (PhocXWaylandSurface *self)
   g_assert (PHOC_IS_XWAYLAND_SURFACE (self));
   return self->xwayland_surface;
 }
+
+
+static void
+collect_mapped_children (GPtrArray *children, struct wlr_xwayland_surface *xsurface)
+{
+  struct wlr_xwayland_surface *child;
+
+  wl_list_for_each (child, &xsurface->children, parent_link) {
+    if (child->surface && child->surface->mapped)
+      g_ptr_array_add (children, child);
+
+    collect_mapped_children (children, child);
+  }
+}
+
+/**
+ * phoc_xwayland_surface_get_mapped_children:
+ * @self: The xwayland surface
+ *
+ * Gets the mapped descendants of @self in the order they should be
+ * rendered. The list is only rebuilt when X11 surfaces got mapped,
+ * unmapped, reparented or destroyed so this is cheap to call in every
+ * frame. The array is only valid until the next such change.
+ *
+ * Returns:(transfer none)(element-type struct wlr_xwayland_surface): The mapped children
+ */
+GPtrArray *
+phoc_xwayland_surface_get_mapped_children (PhocXWaylandSurface *self)
+{
+  g_assert (PHOC_IS_XWAYLAND_SURFACE (self));
+
+  if (self->mapped_children_serial == children_serial)
+    return self->mapped_children;
+
+  g_ptr_array_set_size (self->mapped_children, 0);
+  collect_mapped_children (self->mapped_children, self->xwayland_surface);
+  self->mapped_children_serial = children_serial;
+
+  return self->mapped_children;
+}
@@ -29,6 +29,7 @@ G_DECLARE_FINAL_TYPE (PhocXWaylandSurface, phoc_xwayland_surface, PHOC, XWAYLAND
 
 PhocXWaylandSurface *phoc_xwayland_surface_new (struct wlr_xwayland_surface *surface);
 struct wlr_xwayland_surface *phoc_xwayland_surface_get_wlr_surface (PhocXWaylandSurface *self);
+GPtrArray                   *phoc_xwayland_surface_get_mapped_children (PhocXWaylandSurface *self);
 
 G_END_DECLS
 
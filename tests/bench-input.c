@@ -0,0 +1,512 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "testlib.h"
+#include "testlib-layer-shell.h"
+
+#include "cursor.h"
+#include "input-trace.h"
+#include "seat.h"
+
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/interfaces/wlr_touch.h>
+
+#include <linux/input-event-codes.h>
+#include <math.h>
+#include <time.h>
+
+#define BENCH_TIMEOUT 120
+/* Events replayed per main loop iteration so the client keeps reading */
+#define BENCH_CHUNK 64
+#define BENCH_FRAME_MS 8
+/* A trace recorded via the debug D-Bus interface to replay instead of the synthetic one */
+#define BENCH_TRACE_ENV "PHOC_BENCH_INPUT_TRACE"
+
+
+typedef enum {
+  BENCH_METRIC_UPDATE_POSITION,
+  BENCH_METRIC_HIT_TEST,
+  BENCH_METRIC_GESTURES,
+  BENCH_METRIC_TOUCH,
+  BENCH_METRIC_KEY,
+  BENCH_METRIC_LAST,
+} BenchMetric;
+
+static const char *metric_names[BENCH_METRIC_LAST] = {
+  "update-position",
+  "hit-test",
+  "gestures",
+  "touch",
+  "key",
+};
+
+/* Typed after each round of the trace: some text and a modifier combination */
+static const guint32 bench_keys[] = {
+  KEY_P, KEY_H, KEY_O, KEY_C, KEY_SPACE, KEY_LEFTSHIFT, KEY_A, KEY_BACKSPACE, KEY_LEFTCTRL, KEY_C,
+};
+
+
+typedef struct {
+  const char *name;
+  guint       n_toplevels;
+  guint       n_layer_surfaces;
+} BenchScenario;
+
+
+typedef struct {
+  const BenchScenario *scenario;
+  PhocInputTrace      *trace;
+  guint                n_rounds;
+
+  /* Compositor side, only touched from the compositor thread */
+  PhocCursor          *cursor;
+  struct wlr_pointer   pointer;
+  struct wlr_touch     touch;
+  struct wlr_keyboard  keyboard;
+  guint                round;
+  guint                next_event;
+  GArray              *samples[BENCH_METRIC_LAST];
+
+  /* Set by the compositor once all events got replayed */
+  gint                 done;
+} BenchRun;
+
+
+static const struct wlr_pointer_impl pointer_impl = {
+  .name = "bench-pointer",
+};
+
+
+static const struct wlr_touch_impl touch_impl = {
+  .name = "bench-touch",
+};
+
+
+static const struct wlr_keyboard_impl keyboard_impl = {
+  .name = "bench-keyboard",
+};
+
+
+static gint64
+get_time_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void
+add_sample (BenchRun *run, BenchMetric metric, gint64 start_ns)
+{
+  gint64 duration_ns = get_time_ns () - start_ns;
+
+  g_array_append_val (run->samples[metric], duration_ns);
+}
+
+
+static void
+hit_test (BenchRun *run, double lx, double ly)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  gint64 start_ns = get_time_ns ();
+  PhocView *view;
+  double sx, sy;
+
+  phoc_desktop_wlr_surface_at (desktop, lx, ly, &sx, &sy, &view);
+  add_sample (run, BENCH_METRIC_HIT_TEST, start_ns);
+}
+
+
+static void
+replay_pointer_motion (BenchRun *run, const PhocInputTraceEvent *event)
+{
+  struct wlr_cursor *wlr_cursor = run->cursor->cursor;
+  struct wlr_pointer_motion_absolute_event motion = {
+    .pointer = &run->pointer,
+    .time_msec = event->time_msec,
+  };
+  gint64 start_ns;
+
+  if (event->type == PHOC_INPUT_TRACE_EVENT_POINTER_MOTION)
+    wlr_cursor_move (wlr_cursor, &run->pointer.base, event->x, event->y);
+  else
+    wlr_cursor_warp_absolute (wlr_cursor, &run->pointer.base, event->x, event->y);
+
+  start_ns = get_time_ns ();
+  phoc_cursor_handle_event (run->cursor, PHOC_EVENT_MOTION_NOTIFY, &motion, sizeof (motion));
+  add_sample (run, BENCH_METRIC_GESTURES, start_ns);
+
+  hit_test (run, wlr_cursor->x, wlr_cursor->y);
+
+  start_ns = get_time_ns ();
+  phoc_cursor_update_position (run->cursor, event->time_msec);
+  add_sample (run, BENCH_METRIC_UPDATE_POSITION, start_ns);
+}
+
+
+static void
+replay_pointer_button (BenchRun *run, const PhocInputTraceEvent *event)
+{
+  struct wlr_pointer_button_event button = {
+    .pointer = &run->pointer,
+    .time_msec = event->time_msec,
+    .button = event->code,
+    .state = event->state,
+  };
+  PhocEventType type = event->state ? PHOC_EVENT_BUTTON_PRESS : PHOC_EVENT_BUTTON_RELEASE;
+  gint64 start_ns;
+
+  start_ns = get_time_ns ();
+  phoc_cursor_handle_event (run->cursor, type, &button, sizeof (button));
+  add_sample (run, BENCH_METRIC_GESTURES, start_ns);
+}
+
+
+static void
+replay_touch (BenchRun *run, const PhocInputTraceEvent *event)
+{
+  gint64 start_ns;
+  double lx, ly;
+
+  if (event->type != PHOC_INPUT_TRACE_EVENT_TOUCH_UP) {
+    wlr_cursor_absolute_to_layout_coords (run->cursor->cursor, &run->touch.base,
+                                          event->x, event->y, &lx, &ly);
+    hit_test (run, lx, ly);
+  }
+
+  /* Like the seat drop events of touch points we don't know about */
+  if (event->type != PHOC_INPUT_TRACE_EVENT_TOUCH_DOWN &&
+      !phoc_cursor_is_active_touch_id (run->cursor, event->code))
+    return;
+
+  start_ns = get_time_ns ();
+  switch (event->type) {
+  case PHOC_INPUT_TRACE_EVENT_TOUCH_DOWN: {
+    struct wlr_touch_down_event down = {
+      .touch = &run->touch,
+      .time_msec = event->time_msec,
+      .touch_id = event->code,
+      .x = event->x,
+      .y = event->y,
+    };
+    phoc_cursor_handle_touch_down (run->cursor, &down);
+    break;
+  }
+  case PHOC_INPUT_TRACE_EVENT_TOUCH_MOTION: {
+    struct wlr_touch_motion_event motion = {
+      .touch = &run->touch,
+      .time_msec = event->time_msec,
+      .touch_id = event->code,
+      .x = event->x,
+      .y = event->y,
+    };
+    phoc_cursor_handle_touch_motion (run->cursor, &motion);
+    /* Include the processing of coalesced motion */
+    phoc_cursor_flush_touch_motions (run->cursor);
+    break;
+  }
+  case PHOC_INPUT_TRACE_EVENT_TOUCH_UP: {
+    struct wlr_touch_up_event up = {
+      .touch = &run->touch,
+      .time_msec = event->time_msec,
+      .touch_id = event->code,
+    };
+    phoc_cursor_handle_touch_up (run->cursor, &up);
+    break;
+  }
+  default:
+    g_assert_not_reached ();
+  }
+  add_sample (run, BENCH_METRIC_TOUCH, start_ns);
+}
+
+
+static void
+notify_key (BenchRun *run, guint32 time_msec, guint32 keycode, enum wl_keyboard_key_state state)
+{
+  struct wlr_keyboard_key_event key = {
+    .time_msec = time_msec,
+    .keycode = keycode,
+    .update_state = true,
+    .state = state,
+  };
+  gint64 start_ns;
+
+  start_ns = get_time_ns ();
+  wlr_keyboard_notify_key (&run->keyboard, &key);
+  add_sample (run, BENCH_METRIC_KEY, start_ns);
+}
+
+
+static void
+replay_keys (BenchRun *run, guint32 time_msec)
+{
+  /* Modifiers are held until the end so they apply to the following keys */
+  for (guint i = 0; i < G_N_ELEMENTS (bench_keys); i++) {
+    guint32 keycode = bench_keys[i];
+
+    notify_key (run, time_msec, keycode, WL_KEYBOARD_KEY_STATE_PRESSED);
+    if (keycode != KEY_LEFTSHIFT && keycode != KEY_LEFTCTRL)
+      notify_key (run, time_msec, keycode, WL_KEYBOARD_KEY_STATE_RELEASED);
+  }
+  notify_key (run, time_msec, KEY_LEFTCTRL, WL_KEYBOARD_KEY_STATE_RELEASED);
+  notify_key (run, time_msec, KEY_LEFTSHIFT, WL_KEYBOARD_KEY_STATE_RELEASED);
+}
+
+
+static gboolean
+on_replay_idle (gpointer data)
+{
+  BenchRun *run = data;
+  const PhocInputTraceEvent *events;
+  guint n_events;
+
+  events = phoc_input_trace_get_events (run->trace, &n_events);
+
+  for (guint i = 0; i < BENCH_CHUNK && run->round < run->n_rounds; i++) {
+    const PhocInputTraceEvent *event = &events[run->next_event];
+
+    switch (event->type) {
+    case PHOC_INPUT_TRACE_EVENT_POINTER_MOTION:
+    case PHOC_INPUT_TRACE_EVENT_POINTER_MOTION_ABSOLUTE:
+      replay_pointer_motion (run, event);
+      break;
+    case PHOC_INPUT_TRACE_EVENT_POINTER_BUTTON:
+      replay_pointer_button (run, event);
+      break;
+    case PHOC_INPUT_TRACE_EVENT_TOUCH_DOWN:
+    case PHOC_INPUT_TRACE_EVENT_TOUCH_MOTION:
+    case PHOC_INPUT_TRACE_EVENT_TOUCH_UP:
+      replay_touch (run, event);
+      break;
+    default:
+      g_warning ("Unknown event type %u", event->type);
+    }
+
+    if (++run->next_event == n_events) {
+      replay_keys (run, event->time_msec);
+      run->next_event = 0;
+      run->round++;
+    }
+  }
+
+  if (run->round < run->n_rounds)
+    return G_SOURCE_CONTINUE;
+
+  wlr_pointer_finish (&run->pointer);
+  wlr_touch_finish (&run->touch);
+  /* Removes the keyboard from the seat again */
+  wlr_keyboard_finish (&run->keyboard);
+  g_atomic_int_set (&run->done, TRUE);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+on_start_replay (gpointer data)
+{
+  BenchRun *run = data;
+  PhocServer *server = phoc_server_get_default ();
+  PhocSeat *seat = phoc_server_get_last_active_seat (server);
+
+  run->cursor = phoc_seat_get_cursor (seat);
+  wlr_pointer_init (&run->pointer, &pointer_impl, "bench-pointer");
+  wlr_touch_init (&run->touch, &touch_impl, "bench-touch");
+  /* Key events go through the seat so bindings and keymap handling are included */
+  wlr_keyboard_init (&run->keyboard, &keyboard_impl, "bench-keyboard");
+  phoc_seat_add_device (seat, &run->keyboard.base);
+
+  g_idle_add (on_replay_idle, run);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+bench_client_run (PhocTestClientGlobals *globals, gpointer data)
+{
+  BenchRun *run = data;
+  const BenchScenario *scenario = run->scenario;
+  g_autoptr (GPtrArray) toplevels = g_ptr_array_new ();
+  g_autoptr (GPtrArray) layer_surfaces = g_ptr_array_new ();
+  const guint32 anchors[] = {
+    ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP,
+    ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM,
+  };
+
+  for (guint i = 0; i < scenario->n_toplevels; i++) {
+    PhocTestXdgToplevelSurface *xs;
+
+    xs = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, NULL, 0xFF00FF00);
+    g_ptr_array_add (toplevels, xs);
+  }
+
+  for (guint i = 0; i < scenario->n_layer_surfaces; i++) {
+    PhocTestLayerSurface *ls;
+
+    ls = phoc_test_layer_surface_new (globals, 1024, 64, 0xFFFF0000,
+                                      anchors[i % G_N_ELEMENTS (anchors)], 0);
+    g_ptr_array_add (layer_surfaces, ls);
+  }
+  wl_display_roundtrip (globals->display);
+
+  g_main_context_invoke (NULL, on_start_replay, run);
+  /* Keep reading the input events sent to us */
+  while (!g_atomic_int_get (&run->done))
+    g_assert_cmpint (wl_display_roundtrip (globals->display), >=, 0);
+
+  g_ptr_array_foreach (layer_surfaces, (GFunc)phoc_test_layer_surface_free, NULL);
+  g_ptr_array_foreach (toplevels, (GFunc)phoc_test_xdg_toplevel_free, NULL);
+  wl_display_roundtrip (globals->display);
+
+  return TRUE;
+}
+
+
+static void
+add_touch_points (PhocInputTrace         *trace,
+                  PhocInputTraceEventType type,
+                  guint32                 time,
+                  guint                   n_fingers,
+                  double                  x,
+                  double                  y,
+                  double                  spread)
+{
+  for (guint f = 0; f < n_fingers; f++)
+    phoc_input_trace_add (trace, type, time, f, 0, x + f * spread, y);
+}
+
+
+static PhocInputTrace *
+synthesize_trace (void)
+{
+  PhocInputTrace *trace = phoc_input_trace_new ();
+  guint32 time = 0;
+
+  /* Move the pointer over the output and click */
+  for (int i = 0; i < 200; i++, time += BENCH_FRAME_MS) {
+    phoc_input_trace_add (trace, PHOC_INPUT_TRACE_EVENT_POINTER_MOTION_ABSOLUTE, time, 0, 0,
+                          i / 200.0, fmod (i * 0.37, 1.0));
+  }
+  phoc_input_trace_add (trace, PHOC_INPUT_TRACE_EVENT_POINTER_BUTTON, time, BTN_LEFT, 1, 0, 0);
+  phoc_input_trace_add (trace, PHOC_INPUT_TRACE_EVENT_POINTER_BUTTON, time, BTN_LEFT, 0, 0, 0);
+  for (int i = 0; i < 100; i++, time += BENCH_FRAME_MS)
+    phoc_input_trace_add (trace, PHOC_INPUT_TRACE_EVENT_POINTER_MOTION, time, 0, 0, -5, -3);
+
+  /* A one finger swipe and a two finger pinch */
+  for (guint n_fingers = 1; n_fingers <= 2; n_fingers++) {
+    add_touch_points (trace, PHOC_INPUT_TRACE_EVENT_TOUCH_DOWN, time, n_fingers, 0.4, 0.2, 0.1);
+    for (int i = 1; i <= 60; i++) {
+      double t = i / 60.0;
+
+      time += BENCH_FRAME_MS;
+      if (n_fingers == 1) {
+        add_touch_points (trace, PHOC_INPUT_TRACE_EVENT_TOUCH_MOTION, time, n_fingers,
+                          0.4, 0.2 + 0.6 * t, 0);
+      } else {
+        add_touch_points (trace, PHOC_INPUT_TRACE_EVENT_TOUCH_MOTION, time, n_fingers,
+                          0.4 - 0.2 * t, 0.5, 0.1 + 0.4 * t);
+      }
+    }
+    add_touch_points (trace, PHOC_INPUT_TRACE_EVENT_TOUCH_UP, time, n_fingers, 0, 0, 0);
+    time += BENCH_FRAME_MS;
+  }
+
+  return trace;
+}
+
+
+static gint
+compare_samples (gconstpointer a, gconstpointer b)
+{
+  gint64 sa = *(const gint64 *)a, sb = *(const gint64 *)b;
+
+  return (sa > sb) - (sa < sb);
+}
+
+
+static void
+bench_input (PhocTestFixture *fixture, gconstpointer data)
+{
+  const BenchScenario *scenario = data;
+  const char *trace_path = g_getenv (BENCH_TRACE_ENV);
+  g_autoptr (PhocInputTrace) trace = NULL;
+  g_autoptr (GError) err = NULL;
+  guint n_events;
+  BenchRun run = {
+    .scenario = scenario,
+    .n_rounds = g_test_thorough () ? 100 : 10,
+  };
+  PhocTestClientIface iface = {
+    .client_run  = bench_client_run,
+    .debug_flags = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  if (trace_path) {
+    trace = phoc_input_trace_new_from_file (trace_path, &err);
+    g_assert_no_error (err);
+  } else {
+    trace = synthesize_trace ();
+  }
+  run.trace = trace;
+  phoc_input_trace_get_events (trace, &n_events);
+  g_assert_cmpuint (n_events, >, 0);
+  for (int i = 0; i < BENCH_METRIC_LAST; i++)
+    run.samples[i] = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "1", TRUE);
+
+  phoc_test_client_run (BENCH_TIMEOUT, &iface, &run);
+  g_assert_true (run.done);
+
+  for (int i = 0; i < BENCH_METRIC_LAST; i++) {
+    GArray *samples = run.samples[i];
+    double p50, p99;
+
+    if (!samples->len) {
+      g_array_unref (samples);
+      continue;
+    }
+
+    g_array_sort (samples, compare_samples);
+    p50 = g_array_index (samples, gint64, (samples->len - 1) * 50 / 100) / 1000.0;
+    p99 = g_array_index (samples, gint64, (samples->len - 1) * 99 / 100) / 1000.0;
+
+    g_test_minimized_result (p99, "%s: %s p50 %.2fµs, p99 %.2fµs (%u samples)",
+                             scenario->name, metric_names[i], p50, p99, samples->len);
+    g_array_unref (samples);
+  }
+}
+
+
+static const BenchScenario scenarios[] = {
+  { .name = "empty" },
+  { .name = "toplevels", .n_toplevels = 16 },
+  { .name = "layer-surfaces", .n_toplevels = 4, .n_layer_surfaces = 2 },
+};
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  if (g_test_perf ()) {
+    for (guint i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+      g_autofree char *path = g_strdup_printf ("/phoc/bench/input/%s", scenarios[i].name);
+
+      g_test_add (path, PhocTestFixture, &scenarios[i],
+                  phoc_test_setup, bench_input, phoc_test_teardown);
+    }
+  }
+
+  return g_test_run ();
+}
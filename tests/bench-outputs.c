@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "testlib.h"
+#include "view-private.h"
+
+#include <time.h>
+
+#define BENCH_TIMEOUT 120
+/* Iterations of the surface iteration and damage measurements per frame */
+#define BENCH_ITERATIONS 10
+
+/*
+ * Outputs are configured via the `[output:HEADLESS-n]` sections in
+ * tests/phoc.ini so the scenarios only pick how many are created.
+ */
+typedef struct {
+  const char *name;
+  guint       n_outputs;
+  guint       n_toplevels;
+} BenchScenario;
+
+
+typedef struct _BenchRun BenchRun;
+
+typedef struct {
+  BenchRun           *run;
+  PhocOutput         *output;
+  struct wl_listener  frame_begin;
+  struct wl_listener  frame_end;
+  struct wl_listener  output_destroy;
+  gint64              frame_start_ns;
+} BenchOutput;
+
+
+struct _BenchRun {
+  const BenchScenario *scenario;
+  guint                n_frames;
+
+  /* Compositor side, only touched from the compositor thread */
+  GPtrArray           *outputs;
+  gboolean             views_placed;
+  guint                n_draws;
+  gint64               render_ns;
+  guint                n_measurements;
+  gint64               for_each_surface_ns;
+  gint64               apply_damage_ns;
+
+  /* Client side, only touched from the client thread */
+  double               client_elapsed;
+};
+
+
+static gint64
+get_thread_cpu_time_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void
+count_surface_iterator (PhocOutput         *output,
+                        struct wlr_surface *surface,
+                        struct wlr_box     *box,
+                        float               scale,
+                        void               *user_data)
+{
+  guint *n_surfaces = user_data;
+
+  (*n_surfaces)++;
+}
+
+/*
+ * Place the views on the output boundaries so each one is on two
+ * outputs and damage needs to be tracked on both.
+ */
+static void
+bench_place_views (BenchRun *run, PhocDesktop *desktop)
+{
+  GQueue *views = phoc_desktop_get_views (desktop);
+  guint i = 0;
+
+  if (run->views_placed || g_queue_get_length (views) < run->scenario->n_toplevels)
+    return;
+
+  for (GList *l = views->head; l; l = l->next, i++) {
+    BenchOutput *bench_output = g_ptr_array_index (run->outputs, i % run->outputs->len);
+    PhocOutput *output = bench_output->output;
+    int width, height;
+
+    wlr_output_effective_resolution (output->wlr_output, &width, &height);
+    phoc_view_move (PHOC_VIEW (l->data), output->lx + width / 2, output->ly + height / 4);
+  }
+  run->views_placed = TRUE;
+}
+
+
+static void
+bench_measure (BenchRun *run, PhocDesktop *desktop)
+{
+  GQueue *views = phoc_desktop_get_views (desktop);
+  guint n_surfaces = 0;
+  gint64 start_ns;
+
+  if (!run->views_placed)
+    return;
+
+  start_ns = get_thread_cpu_time_ns ();
+  for (guint i = 0; i < BENCH_ITERATIONS; i++) {
+    for (guint j = 0; j < run->outputs->len; j++) {
+      BenchOutput *bench_output = g_ptr_array_index (run->outputs, j);
+
+      phoc_output_for_each_surface (bench_output->output, count_surface_iterator, &n_surfaces,
+                                    TRUE);
+    }
+  }
+  run->for_each_surface_ns += get_thread_cpu_time_ns () - start_ns;
+
+  start_ns = get_thread_cpu_time_ns ();
+  for (guint i = 0; i < BENCH_ITERATIONS; i++) {
+    for (GList *l = views->head; l; l = l->next)
+      phoc_view_apply_damage (PHOC_VIEW (l->data));
+  }
+  run->apply_damage_ns += get_thread_cpu_time_ns () - start_ns;
+
+  g_assert_cmpuint (n_surfaces, >=, run->scenario->n_toplevels * BENCH_ITERATIONS);
+  run->n_measurements++;
+}
+
+
+static void
+handle_frame_begin (struct wl_listener *listener, void *data)
+{
+  BenchOutput *bench_output = wl_container_of (listener, bench_output, frame_begin);
+
+  bench_output->frame_start_ns = get_thread_cpu_time_ns ();
+}
+
+
+static void
+handle_frame_end (struct wl_listener *listener, void *data)
+{
+  BenchOutput *bench_output = wl_container_of (listener, bench_output, frame_end);
+  BenchRun *run = bench_output->run;
+  PhocDesktop *desktop = bench_output->output->desktop;
+
+  run->render_ns += get_thread_cpu_time_ns () - bench_output->frame_start_ns;
+  run->n_draws++;
+
+  /* Measure once per frame of the first output */
+  if (bench_output != g_ptr_array_index (run->outputs, 0))
+    return;
+
+  bench_place_views (run, desktop);
+  bench_measure (run, desktop);
+}
+
+
+static void
+bench_output_free (BenchOutput *bench_output)
+{
+  if (bench_output->output) {
+    wl_list_remove (&bench_output->frame_begin.link);
+    wl_list_remove (&bench_output->frame_end.link);
+    wl_list_remove (&bench_output->output_destroy.link);
+  }
+  g_free (bench_output);
+}
+
+
+static void
+handle_output_destroy (struct wl_listener *listener, void *data)
+{
+  BenchOutput *bench_output = wl_container_of (listener, bench_output, output_destroy);
+
+  wl_list_remove (&bench_output->frame_begin.link);
+  wl_list_remove (&bench_output->frame_end.link);
+  wl_list_remove (&bench_output->output_destroy.link);
+  bench_output->output = NULL;
+}
+
+
+static gboolean
+bench_server_prepare (PhocServer *server, gpointer data)
+{
+  BenchRun *run = data;
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output;
+
+  g_assert_cmpint (wl_list_length (&desktop->outputs), ==, run->scenario->n_outputs);
+
+  wl_list_for_each (output, &desktop->outputs, link) {
+    struct wlr_output *wlr_output = output->wlr_output;
+    BenchOutput *bench_output = g_new0 (BenchOutput, 1);
+
+    bench_output->run = run;
+    bench_output->output = output;
+
+    /*
+     * The output's frame handler does the repaint via phoc_output_draw (),
+     * so wrap it by putting listeners in front of and after it.
+     */
+    bench_output->frame_begin.notify = handle_frame_begin;
+    wl_list_insert (&wlr_output->events.frame.listener_list, &bench_output->frame_begin.link);
+    bench_output->frame_end.notify = handle_frame_end;
+    wl_signal_add (&wlr_output->events.frame, &bench_output->frame_end);
+    bench_output->output_destroy.notify = handle_output_destroy;
+    wl_signal_add (&wlr_output->events.destroy, &bench_output->output_destroy);
+
+    g_ptr_array_add (run->outputs, bench_output);
+  }
+
+  return TRUE;
+}
+
+
+static void
+frame_handle_done (void *data, struct wl_callback *callback, uint32_t time)
+{
+  gboolean *done = data;
+
+  *done = TRUE;
+  wl_callback_destroy (callback);
+}
+
+
+static const struct wl_callback_listener frame_listener = {
+  .done = frame_handle_done,
+};
+
+
+static gboolean
+bench_client_run (PhocTestClientGlobals *globals, gpointer data)
+{
+  BenchRun *run = data;
+  g_autoptr (GPtrArray) toplevels = g_ptr_array_new ();
+  g_autoptr (GTimer) timer = NULL;
+
+  for (guint i = 0; i < run->scenario->n_toplevels; i++) {
+    PhocTestXdgToplevelSurface *xs;
+
+    xs = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, NULL, 0xFF00FF00);
+    g_ptr_array_add (toplevels, xs);
+  }
+  wl_display_roundtrip (globals->display);
+
+  timer = g_timer_new ();
+  for (guint frame = 0; frame < run->n_frames; frame++) {
+    PhocTestXdgToplevelSurface *first = g_ptr_array_index (toplevels, 0);
+    struct wl_callback *callback = wl_surface_frame (first->wl_surface);
+    gboolean done = FALSE;
+
+    wl_callback_add_listener (callback, &frame_listener, &done);
+    /* Commit the surface with the frame callback last */
+    for (int i = toplevels->len - 1; i >= 0; i--) {
+      PhocTestXdgToplevelSurface *xs = g_ptr_array_index (toplevels, i);
+
+      wl_surface_attach (xs->wl_surface, xs->buffer.wl_buffer, 0, 0);
+      wl_surface_damage_buffer (xs->wl_surface, 0, 0, xs->buffer.width, xs->buffer.height);
+      wl_surface_commit (xs->wl_surface);
+    }
+
+    while (!done)
+      g_assert_cmpint (wl_display_dispatch (globals->display), >=, 0);
+  }
+  run->client_elapsed = g_timer_elapsed (timer, NULL);
+
+  g_ptr_array_foreach (toplevels, (GFunc)phoc_test_xdg_toplevel_free, NULL);
+  wl_display_roundtrip (globals->display);
+
+  return TRUE;
+}
+
+
+static void
+bench_outputs (PhocTestFixture *fixture, gconstpointer data)
+{
+  const BenchScenario *scenario = data;
+  g_autoptr (GPtrArray) outputs = g_ptr_array_new_with_free_func ((GDestroyNotify)bench_output_free);
+  g_autofree char *n_outputs = g_strdup_printf ("%u", scenario->n_outputs);
+  BenchRun run = {
+    .scenario = scenario,
+    .n_frames = g_test_thorough () ? 1000 : 100,
+    .outputs = outputs,
+  };
+  PhocTestClientIface iface = {
+    .server_prepare = bench_server_prepare,
+    .client_run     = bench_client_run,
+    .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+  double fps, render_us, for_each_us, damage_us;
+
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+  g_setenv ("WLR_HEADLESS_OUTPUTS", n_outputs, TRUE);
+
+  phoc_test_client_run (BENCH_TIMEOUT, &iface, &run);
+  g_assert_cmpuint (run.n_draws, >, 0);
+  g_assert_cmpuint (run.n_measurements, >, 0);
+
+  fps = run.n_frames / run.client_elapsed;
+  render_us = (double)run.render_ns / 1000 / run.n_draws;
+  for_each_us = (double)run.for_each_surface_ns / 1000 / (run.n_measurements * BENCH_ITERATIONS);
+  damage_us = (double)run.apply_damage_ns / 1000 / (run.n_measurements * BENCH_ITERATIONS);
+
+  g_test_maximized_result (fps, "%s: %.1f frames per second", scenario->name, fps);
+  g_test_minimized_result (render_us, "%s: %.1fµs CPU time per output frame",
+                           scenario->name, render_us);
+  g_test_minimized_result (for_each_us, "%s: %.1fµs per surface iteration over all outputs",
+                           scenario->name, for_each_us);
+  g_test_minimized_result (damage_us, "%s: %.1fµs applying damage of all views",
+                           scenario->name, damage_us);
+}
+
+
+static const BenchScenario scenarios[] = {
+  { .name = "1-output", .n_outputs = 1, .n_toplevels = 8 },
+  { .name = "2-outputs", .n_outputs = 2, .n_toplevels = 8 },
+  /* A convergent setup: the built-in panel plus three monitors */
+  { .name = "4-outputs", .n_outputs = 4, .n_toplevels = 8 },
+};
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  if (g_test_perf ()) {
+    for (guint i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+      g_autofree char *path = g_strdup_printf ("/phoc/bench/outputs/%s", scenarios[i].name);
+
+      g_test_add (path, PhocTestFixture, &scenarios[i],
+                  phoc_test_setup, bench_outputs, phoc_test_teardown);
+    }
+  }
+
+  return g_test_run ();
+}
@@ -0,0 +1,503 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "testlib.h"
+#include "testlib-layer-shell.h"
+
+#include <time.h>
+
+#define BENCH_TIMEOUT 120
+#define BENCH_CONFIG                               \
+  "[core]\n"                                       \
+  "xwayland=false\n"                               \
+  "[output:HEADLESS-1]\n"                          \
+  "mode=1024x768@1000Hz\n"
+/* Height of the band that moves over the animated surfaces */
+#define BENCH_BAND_HEIGHT 16
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+/* Only count allocations of the compositor thread while it handles a frame */
+static __thread gboolean count_allocs;
+static guint64 n_allocs;
+
+
+void *
+malloc (size_t size)
+{
+  if (G_UNLIKELY (count_allocs))
+    n_allocs++;
+  return __libc_malloc (size);
+}
+
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+  if (G_UNLIKELY (count_allocs))
+    n_allocs++;
+  return __libc_calloc (nmemb, size);
+}
+
+
+void *
+realloc (void *ptr, size_t size)
+{
+  if (G_UNLIKELY (count_allocs))
+    n_allocs++;
+  return __libc_realloc (ptr, size);
+}
+
+
+typedef struct {
+  const char *name;
+  guint       n_toplevels;
+  guint       n_layer_surfaces;
+  /* Depth of a subsurface tree with three children per node */
+  guint       subsurface_depth;
+  /* Damage the whole surface instead of a moving band */
+  gboolean    full_damage;
+  /* Damage that many bands spread over the surface, 1 if unset */
+  guint       n_bands;
+  /*
+   * Give toplevels ARGB buffers that are marked opaque via the opaque
+   * region like toolkits do
+   */
+  gboolean    opaque_region;
+  /*
+   * Play a video at that rate: only a synchronized subsurface gets new
+   * content, the toplevel commits without damage to apply it
+   */
+  guint       video_fps;
+} BenchScenario;
+
+
+typedef struct {
+  const BenchScenario *scenario;
+  guint                n_frames;
+
+  /* Compositor side, only touched from the compositor thread */
+  PhocOutput          *output;
+  struct wl_listener   frame_begin;
+  struct wl_listener   frame_end;
+  struct wl_listener   output_destroy;
+  gint64               frame_start_ns;
+  guint64              frame_start_allocs;
+  guint                n_draws;
+  gint64               cpu_ns;
+  guint64              allocs;
+
+  /* Client side, only touched from the client thread */
+  double               client_elapsed;
+} BenchRun;
+
+
+typedef struct {
+  struct wl_surface    *wl_surface;
+  struct wl_subsurface *wl_subsurface;
+  PhocTestBuffer       *buffer;
+  PhocTestBuffer        own_buffer;
+  guint32               width, height;
+} BenchSurface;
+
+
+static gint64
+get_thread_cpu_time_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void
+handle_frame_begin (struct wl_listener *listener, void *data)
+{
+  BenchRun *run = wl_container_of (listener, run, frame_begin);
+
+  run->frame_start_ns = get_thread_cpu_time_ns ();
+  run->frame_start_allocs = n_allocs;
+  count_allocs = TRUE;
+}
+
+
+static void
+handle_frame_end (struct wl_listener *listener, void *data)
+{
+  BenchRun *run = wl_container_of (listener, run, frame_end);
+
+  count_allocs = FALSE;
+  run->cpu_ns += get_thread_cpu_time_ns () - run->frame_start_ns;
+  run->allocs += n_allocs - run->frame_start_allocs;
+  run->n_draws++;
+}
+
+
+static void
+handle_output_destroy (struct wl_listener *listener, void *data)
+{
+  BenchRun *run = wl_container_of (listener, run, output_destroy);
+
+  wl_list_remove (&run->frame_begin.link);
+  wl_list_remove (&run->frame_end.link);
+  wl_list_remove (&run->output_destroy.link);
+  run->output = NULL;
+}
+
+
+static gboolean
+bench_server_prepare (PhocServer *server, gpointer data)
+{
+  BenchRun *run = data;
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  struct wlr_output *wlr_output;
+
+  /* Full and scattered damage scenarios use a maximized toplevel covering the output */
+  phoc_desktop_set_auto_maximize (desktop,
+                                  run->scenario->full_damage || run->scenario->n_bands > 1);
+
+  g_assert_cmpint (wl_list_length (&desktop->outputs), ==, 1);
+  run->output = wl_container_of (desktop->outputs.next, run->output, link);
+  wlr_output = run->output->wlr_output;
+
+  /*
+   * The output's frame handler does the repaint via phoc_output_draw (),
+   * so wrap it by putting listeners in front of and after it.
+   */
+  run->frame_begin.notify = handle_frame_begin;
+  wl_list_insert (&wlr_output->events.frame.listener_list, &run->frame_begin.link);
+  run->frame_end.notify = handle_frame_end;
+  wl_signal_add (&wlr_output->events.frame, &run->frame_end);
+  run->output_destroy.notify = handle_output_destroy;
+  wl_signal_add (&wlr_output->events.destroy, &run->output_destroy);
+
+  return TRUE;
+}
+
+
+static void
+bench_surface_fill (BenchSurface *surface, guint32 color)
+{
+  for (int i = 0; i < surface->width * surface->height * 4; i += 4)
+    *(guint32 *)(surface->buffer->shm_data + i) = color;
+}
+
+
+static void
+bench_surface_animate (BenchSurface *surface, guint frame, gboolean full_damage, guint n_bands)
+{
+  guint32 band_height = MIN (BENCH_BAND_HEIGHT, surface->height);
+  guint32 range = surface->height - band_height + 1;
+  guint32 color = 0xFF000000 | (frame * 0x010203);
+
+  if (full_damage) {
+    bench_surface_fill (surface, color);
+    wl_surface_damage_buffer (surface->wl_surface, 0, 0, surface->width, surface->height);
+  } else {
+    for (guint band = 0; band < MAX (n_bands, 1); band++) {
+      guint32 y = (frame * 4 + band * range / MAX (n_bands, 1)) % range;
+
+      for (guint32 row = y; row < y + band_height; row++) {
+        for (guint32 col = 0; col < surface->width; col++)
+          *(guint32 *)(surface->buffer->shm_data + row * surface->buffer->stride + col * 4) = color;
+      }
+      wl_surface_damage_buffer (surface->wl_surface, 0, y, surface->width, band_height);
+    }
+  }
+
+  wl_surface_attach (surface->wl_surface, surface->buffer->wl_buffer, 0, 0);
+  wl_surface_commit (surface->wl_surface);
+}
+
+
+static void
+bench_add_subsurface_tree (PhocTestClientGlobals *globals,
+                           GPtrArray             *surfaces,
+                           struct wl_surface     *parent,
+                           guint32                size,
+                           guint                  depth)
+{
+  if (!depth)
+    return;
+
+  for (int i = 0; i < 3; i++) {
+    BenchSurface *surface = g_new0 (BenchSurface, 1);
+
+    surface->width = surface->height = size / 3;
+    surface->buffer = &surface->own_buffer;
+    surface->wl_surface = wl_compositor_create_surface (globals->compositor);
+    surface->wl_subsurface = wl_subcompositor_get_subsurface (globals->subcompositor,
+                                                              surface->wl_surface,
+                                                              parent);
+    wl_subsurface_set_position (surface->wl_subsurface, i * surface->width, surface->height);
+    wl_subsurface_set_desync (surface->wl_subsurface);
+    phoc_test_client_create_shm_buffer (globals, surface->buffer,
+                                        surface->width, surface->height,
+                                        WL_SHM_FORMAT_XRGB8888);
+    bench_surface_fill (surface, 0xFF0000FF * (depth % 2));
+    wl_surface_attach (surface->wl_surface, surface->buffer->wl_buffer, 0, 0);
+    wl_surface_commit (surface->wl_surface);
+    g_ptr_array_add (surfaces, surface);
+
+    bench_add_subsurface_tree (globals, surfaces, surface->wl_surface, surface->width, depth - 1);
+  }
+}
+
+
+/* Replace the toplevel's XRGB buffer by an ARGB one declared opaque */
+static void
+bench_surface_use_opaque_region (PhocTestClientGlobals *globals, BenchSurface *surface)
+{
+  struct wl_region *region;
+
+  surface->buffer = &surface->own_buffer;
+  phoc_test_client_create_shm_buffer (globals, surface->buffer,
+                                      surface->width, surface->height,
+                                      WL_SHM_FORMAT_ARGB8888);
+  bench_surface_fill (surface, 0xFF00FF00);
+
+  region = wl_compositor_create_region (globals->compositor);
+  wl_region_add (region, 0, 0, surface->width, surface->height);
+  wl_surface_set_opaque_region (surface->wl_surface, region);
+  wl_region_destroy (region);
+
+  wl_surface_attach (surface->wl_surface, surface->buffer->wl_buffer, 0, 0);
+  wl_surface_damage_buffer (surface->wl_surface, 0, 0, surface->width, surface->height);
+  wl_surface_commit (surface->wl_surface);
+}
+
+
+static BenchSurface *
+bench_add_video_subsurface (PhocTestClientGlobals *globals, BenchSurface *parent)
+{
+  BenchSurface *surface = g_new0 (BenchSurface, 1);
+
+  surface->width = parent->width / 2;
+  surface->height = parent->height / 2;
+  surface->buffer = &surface->own_buffer;
+  surface->wl_surface = wl_compositor_create_surface (globals->compositor);
+  /* Subsurfaces are synchronized by default */
+  surface->wl_subsurface = wl_subcompositor_get_subsurface (globals->subcompositor,
+                                                            surface->wl_surface,
+                                                            parent->wl_surface);
+  wl_subsurface_set_position (surface->wl_subsurface, parent->width / 4, parent->height / 4);
+  phoc_test_client_create_shm_buffer (globals, surface->buffer,
+                                      surface->width, surface->height,
+                                      WL_SHM_FORMAT_XRGB8888);
+  bench_surface_fill (surface, 0xFF000000);
+  wl_surface_attach (surface->wl_surface, surface->buffer->wl_buffer, 0, 0);
+  wl_surface_commit (surface->wl_surface);
+  wl_surface_commit (parent->wl_surface);
+
+  return surface;
+}
+
+
+static void
+bench_surface_free (BenchSurface *surface)
+{
+  /* Only subsurfaces are created here, the others are owned by testlib */
+  if (surface->wl_subsurface) {
+    wl_subsurface_destroy (surface->wl_subsurface);
+    wl_surface_destroy (surface->wl_surface);
+  }
+  if (surface->buffer == &surface->own_buffer)
+    phoc_test_buffer_free (&surface->own_buffer);
+  g_free (surface);
+}
+
+
+static void
+frame_handle_done (void *data, struct wl_callback *callback, uint32_t time)
+{
+  gboolean *done = data;
+
+  *done = TRUE;
+  wl_callback_destroy (callback);
+}
+
+
+static const struct wl_callback_listener frame_listener = {
+  .done = frame_handle_done,
+};
+
+
+static gboolean
+bench_client_run (PhocTestClientGlobals *globals, gpointer data)
+{
+  BenchRun *run = data;
+  const BenchScenario *scenario = run->scenario;
+  g_autoptr (GPtrArray) surfaces = g_ptr_array_new_with_free_func ((GDestroyNotify)bench_surface_free);
+  g_autoptr (GPtrArray) toplevels = g_ptr_array_new ();
+  g_autoptr (GPtrArray) layer_surfaces = g_ptr_array_new ();
+  g_autoptr (GTimer) timer = NULL;
+  struct wl_surface *frame_surface;
+  BenchSurface *video = NULL;
+  gint64 start_us;
+  const guint32 anchors[] = {
+    ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP,
+    ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM,
+    ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT,
+    ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
+  };
+
+  g_assert_nonnull (globals->subcompositor);
+
+  for (guint i = 0; i < scenario->n_toplevels; i++) {
+    PhocTestXdgToplevelSurface *xs;
+    BenchSurface *surface = g_new0 (BenchSurface, 1);
+
+    xs = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, NULL, 0xFF00FF00);
+    g_ptr_array_add (toplevels, xs);
+
+    surface->wl_surface = xs->wl_surface;
+    surface->buffer = &xs->buffer;
+    surface->width = xs->buffer.width;
+    surface->height = xs->buffer.height;
+    g_ptr_array_add (surfaces, surface);
+
+    if (scenario->opaque_region)
+      bench_surface_use_opaque_region (globals, surface);
+
+    if (i == 0)
+      bench_add_subsurface_tree (globals, surfaces, xs->wl_surface, surface->width,
+                                 scenario->subsurface_depth);
+
+    if (i == 0 && scenario->video_fps) {
+      video = bench_add_video_subsurface (globals, surface);
+      g_ptr_array_add (surfaces, video);
+    }
+  }
+
+  for (guint i = 0; i < scenario->n_layer_surfaces; i++) {
+    guint32 anchor = anchors[i % G_N_ELEMENTS (anchors)];
+    gboolean vertical = anchor & (ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+                                  ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM);
+    PhocTestLayerSurface *ls;
+    BenchSurface *surface = g_new0 (BenchSurface, 1);
+
+    ls = phoc_test_layer_surface_new (globals, vertical ? 1024 : 64, vertical ? 64 : 768,
+                                      0xFFFF0000, anchor, 0);
+    g_ptr_array_add (layer_surfaces, ls);
+
+    surface->wl_surface = ls->wl_surface;
+    surface->buffer = &ls->buffer;
+    surface->width = ls->width;
+    surface->height = ls->height;
+    g_ptr_array_add (surfaces, surface);
+  }
+  wl_display_roundtrip (globals->display);
+
+  g_assert_cmpint (surfaces->len, >, 0);
+  frame_surface = ((BenchSurface *)surfaces->pdata[0])->wl_surface;
+
+  timer = g_timer_new ();
+  start_us = g_get_monotonic_time ();
+  for (guint frame = 0; frame < run->n_frames; frame++) {
+    struct wl_callback *callback = wl_surface_frame (frame_surface);
+    gboolean done = FALSE;
+
+    wl_callback_add_listener (callback, &frame_listener, &done);
+    if (video) {
+      /* The new video frame gets applied by the parent's commit */
+      bench_surface_animate (video, frame, TRUE, 1);
+      wl_surface_commit (frame_surface);
+    } else {
+      /* Commit the surface with the frame callback last */
+      for (int i = surfaces->len - 1; i >= 0; i--)
+        bench_surface_animate (surfaces->pdata[i], frame, scenario->full_damage,
+                               scenario->n_bands);
+    }
+
+    while (!done)
+      g_assert_cmpint (wl_display_dispatch (globals->display), >=, 0);
+
+    if (scenario->video_fps) {
+      gint64 next_us = start_us + (frame + 1) * G_USEC_PER_SEC / scenario->video_fps;
+      gint64 now_us = g_get_monotonic_time ();
+
+      if (next_us > now_us)
+        g_usleep (next_us - now_us);
+    }
+  }
+  run->client_elapsed = g_timer_elapsed (timer, NULL);
+
+  g_clear_pointer (&surfaces, g_ptr_array_unref);
+  g_ptr_array_foreach (layer_surfaces, (GFunc)phoc_test_layer_surface_free, NULL);
+  g_ptr_array_foreach (toplevels, (GFunc)phoc_test_xdg_toplevel_free, NULL);
+  wl_display_roundtrip (globals->display);
+
+  return TRUE;
+}
+
+
+static void
+bench_render (PhocTestFixture *fixture, gconstpointer data)
+{
+  const BenchScenario *scenario = data;
+  BenchRun run = {
+    .scenario = scenario,
+    .n_frames = g_test_thorough () ? 3000 : 300,
+  };
+  PhocTestClientIface iface = {
+    .server_prepare = bench_server_prepare,
+    .client_run     = bench_client_run,
+    .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+    .config         = phoc_config_new_from_data (BENCH_CONFIG),
+  };
+  double fps, cpu_us, allocs;
+
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "1", TRUE);
+
+  phoc_test_client_run (BENCH_TIMEOUT, &iface, &run);
+  g_assert_cmpuint (run.n_draws, >, 0);
+
+  fps = run.n_frames / run.client_elapsed;
+  cpu_us = (double)run.cpu_ns / 1000 / run.n_draws;
+  allocs = (double)run.allocs / run.n_draws;
+
+  g_test_maximized_result (fps, "%s: %.1f frames per second", scenario->name, fps);
+  g_test_minimized_result (cpu_us, "%s: %.1fµs CPU time per frame", scenario->name, cpu_us);
+  g_test_minimized_result (allocs, "%s: %.1f allocations per frame", scenario->name, allocs);
+}
+
+
+static const BenchScenario scenarios[] = {
+  { .name = "toplevels", .n_toplevels = 16 },
+  /* Stresses the per view traversal of the render pass */
+  { .name = "many-toplevels", .n_toplevels = 64 },
+  { .name = "layer-surfaces", .n_toplevels = 1, .n_layer_surfaces = 4 },
+  { .name = "subsurfaces", .n_toplevels = 1, .subsurface_depth = 3 },
+  { .name = "damage", .n_toplevels = 1, .full_damage = TRUE },
+  /* Damage that used to get merged into large boxes */
+  { .name = "scattered-damage", .n_toplevels = 1, .n_bands = 12 },
+  /* Opaque ARGB content that doesn't need blending */
+  { .name = "opaque-region", .n_toplevels = 4, .opaque_region = TRUE },
+  /* A video player's synchronized subsurface */
+  { .name = "video", .n_toplevels = 1, .video_fps = 60 },
+};
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  if (g_test_perf ()) {
+    for (guint i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+      g_autofree char *path = g_strdup_printf ("/phoc/bench/render/%s", scenarios[i].name);
+
+      g_test_add (path, PhocTestFixture, &scenarios[i],
+                  phoc_test_setup, bench_render, phoc_test_teardown);
+    }
+  }
+
+  return g_test_run ();
+}
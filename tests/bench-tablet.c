@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "testlib.h"
+
+#include "cursor.h"
+#include "seat.h"
+#include "server.h"
+#include "tablet.h"
+
+#include <wlr/interfaces/wlr_tablet_tool.h>
+#include <wlr/types/wlr_tablet_v2.h>
+
+#include <math.h>
+#include <time.h>
+
+#define BENCH_TIMEOUT 120
+/* Axis events per output frame, about 480Hz at 60Hz refresh */
+#define BENCH_EVENTS_PER_FRAME 8
+#define BENCH_APP_ID "mobi.phosh.BenchTablet"
+
+
+typedef struct {
+  const char           *name;
+  PhocTabletMotionMode  mode;
+  gboolean              full_rate;
+} BenchScenario;
+
+
+typedef struct {
+  const BenchScenario *scenario;
+  guint                n_frames;
+
+  /* Compositor side, only touched from the compositor thread */
+  PhocCursor          *cursor;
+  PhocOutput          *output;
+  struct wlr_tablet    tablet;
+  struct wlr_tablet_tool tool;
+  PhocTablet          *phoc_tablet;
+  struct wl_listener   frame_begin;
+  struct wl_listener   frame_end;
+  guint                frame;
+  guint32              time_msec;
+  gint64               frame_start_ns;
+  gint64               emit_ns;
+  gint64               frame_ns;
+
+  /* Set by the compositor once all events got sent */
+  gint                 done;
+} BenchRun;
+
+
+static const struct wlr_tablet_impl tablet_impl = {
+  .name = "bench-tablet",
+};
+
+
+static gint64
+get_thread_cpu_time_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void
+emit_proximity (BenchRun *run, enum wlr_tablet_tool_proximity_state state)
+{
+  struct wlr_tablet_tool_proximity_event proximity = {
+    .tablet = &run->tablet,
+    .tool = &run->tool,
+    .time_msec = run->time_msec,
+    .x = 0.5,
+    .y = 0.5,
+    .state = state,
+  };
+
+  wl_signal_emit_mutable (&run->tablet.events.proximity, &proximity);
+}
+
+
+static void
+emit_axis_events (BenchRun *run)
+{
+  gint64 start_ns = get_thread_cpu_time_ns ();
+
+  /* A stylus drawing circles while changing pressure and tilt */
+  for (guint i = 0; i < BENCH_EVENTS_PER_FRAME; i++) {
+    double t = (run->frame * BENCH_EVENTS_PER_FRAME + i) / 100.0;
+    struct wlr_tablet_tool_axis_event axis = {
+      .tablet = &run->tablet,
+      .tool = &run->tool,
+      .time_msec = run->time_msec,
+      .updated_axes = WLR_TABLET_TOOL_AXIS_X | WLR_TABLET_TOOL_AXIS_Y |
+        WLR_TABLET_TOOL_AXIS_PRESSURE | WLR_TABLET_TOOL_AXIS_TILT_X | WLR_TABLET_TOOL_AXIS_TILT_Y,
+      .x = 0.5 + 0.3 * cos (t),
+      .y = 0.5 + 0.3 * sin (t),
+      .pressure = 0.5 + 0.5 * sin (3 * t),
+      .tilt_x = 30 * cos (t),
+      .tilt_y = 30 * sin (t),
+    };
+
+    wl_signal_emit_mutable (&run->tablet.events.axis, &axis);
+    run->time_msec += 2;
+  }
+
+  run->emit_ns += get_thread_cpu_time_ns () - start_ns;
+}
+
+
+static gboolean
+on_finish (gpointer data)
+{
+  BenchRun *run = data;
+
+  wl_list_remove (&run->frame_begin.link);
+  wl_list_remove (&run->frame_end.link);
+
+  emit_proximity (run, WLR_TABLET_TOOL_PROXIMITY_OUT);
+  wl_signal_emit_mutable (&run->tool.events.destroy, &run->tool);
+
+  wlr_cursor_detach_input_device (run->cursor->cursor, &run->tablet.base);
+  wlr_tablet_finish (&run->tablet);
+  g_clear_object (&run->phoc_tablet);
+
+  g_atomic_int_set (&run->done, TRUE);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+handle_frame_begin (struct wl_listener *listener, void *data)
+{
+  BenchRun *run = wl_container_of (listener, run, frame_begin);
+
+  run->frame_start_ns = get_thread_cpu_time_ns ();
+  /* Events arrive before the output's frame handler flushes coalesced ones */
+  emit_axis_events (run);
+}
+
+
+static void
+handle_frame_end (struct wl_listener *listener, void *data)
+{
+  BenchRun *run = wl_container_of (listener, run, frame_end);
+
+  run->frame_ns += get_thread_cpu_time_ns () - run->frame_start_ns;
+
+  if (++run->frame < run->n_frames) {
+    wlr_output_schedule_frame (run->output->wlr_output);
+    return;
+  }
+
+  /* Not from within the frame signal */
+  g_idle_add (on_finish, run);
+}
+
+
+static gboolean
+on_start (gpointer data)
+{
+  BenchRun *run = data;
+  PhocServer *server = phoc_server_get_default ();
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocSeat *seat = phoc_server_get_last_active_seat (server);
+  struct wlr_output *wlr_output;
+
+  run->cursor = phoc_seat_get_cursor (seat);
+  run->output = wl_container_of (desktop->outputs.next, run->output, link);
+  wlr_output = run->output->wlr_output;
+
+  /* The seat only picks up libinput tablets so wire up ours like it does */
+  wlr_tablet_init (&run->tablet, &tablet_impl, "bench-tablet");
+  run->phoc_tablet = phoc_tablet_new (&run->tablet.base, seat);
+  run->phoc_tablet->tablet_v2 = wlr_tablet_create (desktop->tablet_v2, seat->seat,
+                                                   &run->tablet.base);
+  wlr_cursor_attach_input_device (run->cursor->cursor, &run->tablet.base);
+
+  run->tool = (struct wlr_tablet_tool) {
+    .type = WLR_TABLET_TOOL_TYPE_PEN,
+    .pressure = true,
+    .tilt = true,
+  };
+  wl_signal_init (&run->tool.events.destroy);
+  emit_proximity (run, WLR_TABLET_TOOL_PROXIMITY_IN);
+
+  /* Wrap the output's frame handler like the outputs benchmark does */
+  run->frame_begin.notify = handle_frame_begin;
+  wl_list_insert (&wlr_output->events.frame.listener_list, &run->frame_begin.link);
+  run->frame_end.notify = handle_frame_end;
+  wl_signal_add (&wlr_output->events.frame, &run->frame_end);
+  wlr_output_schedule_frame (wlr_output);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+bench_server_prepare (PhocServer *server, gpointer data)
+{
+  BenchRun *run = data;
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  g_autoptr (GSettings) settings = NULL;
+
+  /* Picked up when the tool comes into proximity */
+  phoc_server_get_config (server)->tablet_motion = run->scenario->mode;
+
+  settings = phoc_desktop_get_app_settings (desktop, BENCH_APP_ID);
+  g_settings_set_boolean (settings, "tablet-full-rate", run->scenario->full_rate);
+
+  return TRUE;
+}
+
+
+static gboolean
+bench_client_run (PhocTestClientGlobals *globals, gpointer data)
+{
+  BenchRun *run = data;
+  PhocTestXdgToplevelSurface *xs;
+
+  xs = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, NULL, 0xFF00FF00);
+  xdg_toplevel_set_app_id (xs->xdg_toplevel, BENCH_APP_ID);
+  wl_surface_commit (xs->wl_surface);
+  wl_display_roundtrip (globals->display);
+
+  g_main_context_invoke (NULL, on_start, run);
+  /* Keep reading the events sent to us */
+  while (!g_atomic_int_get (&run->done))
+    g_assert_cmpint (wl_display_roundtrip (globals->display), >=, 0);
+
+  phoc_test_xdg_toplevel_free (xs);
+  wl_display_roundtrip (globals->display);
+
+  return TRUE;
+}
+
+
+static void
+bench_tablet (PhocTestFixture *fixture, gconstpointer data)
+{
+  const BenchScenario *scenario = data;
+  BenchRun run = {
+    .scenario = scenario,
+    .n_frames = g_test_thorough () ? 1000 : 100,
+  };
+  PhocTestClientIface iface = {
+    .server_prepare = bench_server_prepare,
+    .client_run     = bench_client_run,
+    .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+  guint n_events;
+  double event_us, frame_us;
+
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "1", TRUE);
+
+  phoc_test_client_run (BENCH_TIMEOUT, &iface, &run);
+  g_assert_true (run.done);
+
+  n_events = run.n_frames * BENCH_EVENTS_PER_FRAME;
+  event_us = (double)run.emit_ns / 1000 / n_events;
+  frame_us = (double)run.frame_ns / 1000 / run.n_frames;
+
+  g_test_minimized_result (event_us, "%s: %.2fµs CPU time per axis event (%u events)",
+                           scenario->name, event_us, n_events);
+  g_test_minimized_result (frame_us, "%s: %.1fµs CPU time per frame with %d axis events",
+                           scenario->name, frame_us, BENCH_EVENTS_PER_FRAME);
+}
+
+
+static const BenchScenario scenarios[] = {
+  { .name = "coalesce", .mode = PHOC_TABLET_MOTION_COALESCE },
+  { .name = "immediate", .mode = PHOC_TABLET_MOTION_IMMEDIATE },
+  /* The app under the tool opted into every event */
+  { .name = "full-rate", .mode = PHOC_TABLET_MOTION_COALESCE, .full_rate = TRUE },
+};
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  if (g_test_perf ()) {
+    for (guint i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+      g_autofree char *path = g_strdup_printf ("/phoc/bench/tablet/%s", scenarios[i].name);
+
+      g_test_add (path, PhocTestFixture, &scenarios[i],
+                  phoc_test_setup, bench_tablet, phoc_test_teardown);
+    }
+  }
+
+  return g_test_run ();
+}
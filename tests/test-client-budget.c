@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "client-budget.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef struct {
+  struct wl_display *display;
+  struct wl_client  *client;
+  int                fd;
+} BudgetFixture;
+
+
+static void
+budget_fixture_setup (BudgetFixture *fixture, gconstpointer unused)
+{
+  int fds[2];
+
+  g_assert_no_errno (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds));
+
+  fixture->display = wl_display_create ();
+  fixture->client = wl_client_create (fixture->display, fds[0]);
+  g_assert_nonnull (fixture->client);
+  fixture->fd = fds[1];
+}
+
+
+static void
+budget_fixture_teardown (BudgetFixture *fixture, gconstpointer unused)
+{
+  g_clear_pointer (&fixture->client, wl_client_destroy);
+  g_clear_pointer (&fixture->display, wl_display_destroy);
+  close (fixture->fd);
+}
+
+
+static void
+test_phoc_client_budget_held (BudgetFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (PhocClientBudget) budget = phoc_client_budget_new (0, 2, 1000);
+  struct wl_client *client = fixture->client;
+
+  g_assert_true (phoc_client_budget_acquire (budget, client,
+                                             PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1));
+  g_assert_true (phoc_client_budget_acquire (budget, client,
+                                             PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1));
+
+  /* Over budget */
+  g_test_expect_message ("phoc-client-budget", G_LOG_LEVEL_WARNING, "*exceeds its subscriptions*");
+  g_assert_false (phoc_client_budget_acquire (budget, client,
+                                              PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1));
+  g_test_assert_expected_messages ();
+  g_assert_cmpuint (phoc_client_budget_get_usage (budget, client,
+                                                  PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS), ==, 2);
+
+  /* Releasing makes room again and only warns once */
+  phoc_client_budget_release (budget, client, PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1);
+  g_assert_true (phoc_client_budget_acquire (budget, client,
+                                             PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1));
+  g_assert_false (phoc_client_budget_acquire (budget, client,
+                                              PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1));
+
+  /* Memory is accounted in bytes */
+  g_assert_true (phoc_client_budget_acquire (budget, client,
+                                             PHOC_CLIENT_RESOURCE_THUMBNAIL_MEMORY, 600));
+  g_test_expect_message ("phoc-client-budget", G_LOG_LEVEL_WARNING,
+                         "*exceeds its thumbnail-memory*");
+  g_assert_false (phoc_client_budget_acquire (budget, client,
+                                              PHOC_CLIENT_RESOURCE_THUMBNAIL_MEMORY, 600));
+  g_test_assert_expected_messages ();
+  phoc_client_budget_release (budget, client, PHOC_CLIENT_RESOURCE_THUMBNAIL_MEMORY, 600);
+  g_assert_true (phoc_client_budget_acquire (budget, client,
+                                             PHOC_CLIENT_RESOURCE_THUMBNAIL_MEMORY, 600));
+
+  /* The budget goes away with the client, releasing afterwards is fine */
+  g_clear_pointer (&fixture->client, wl_client_destroy);
+  phoc_client_budget_release (budget, client, PHOC_CLIENT_RESOURCE_THUMBNAIL_MEMORY, 600);
+}
+
+
+static void
+test_phoc_client_budget_rate (BudgetFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (PhocClientBudget) budget = phoc_client_budget_new (3, 0, 0);
+  struct wl_client *client = fixture->client;
+
+  for (int i = 0; i < 3; i++) {
+    g_assert_true (phoc_client_budget_acquire (budget, client,
+                                               PHOC_CLIENT_RESOURCE_THUMBNAILS, 1));
+  }
+
+  g_test_expect_message ("phoc-client-budget", G_LOG_LEVEL_WARNING, "*exceeds its thumbnails*");
+  g_assert_false (phoc_client_budget_acquire (budget, client,
+                                              PHOC_CLIENT_RESOURCE_THUMBNAILS, 1));
+  g_test_assert_expected_messages ();
+
+  /* Rates aren't released */
+  phoc_client_budget_release (budget, client, PHOC_CLIENT_RESOURCE_THUMBNAILS, 1);
+  g_assert_cmpuint (phoc_client_budget_get_usage (budget, client,
+                                                  PHOC_CLIENT_RESOURCE_THUMBNAILS), ==, 3);
+
+  /* Limits of 0 are unlimited */
+  for (int i = 0; i < 1000; i++) {
+    g_assert_true (phoc_client_budget_acquire (budget, client,
+                                               PHOC_CLIENT_RESOURCE_SUBSCRIPTIONS, 1));
+  }
+}
+
+
+static void
+test_phoc_client_budget_variant (BudgetFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (PhocClientBudget) budget = phoc_client_budget_new (3, 2, 1000);
+  g_autoptr (GVariant) variant = NULL;
+  g_autoptr (GVariant) limits = NULL;
+  g_autoptr (GVariant) clients = NULL;
+  g_autoptr (GVariant) client = NULL;
+  g_autoptr (GVariant) usage = NULL;
+  guint64 value;
+
+  g_assert_true (phoc_client_budget_acquire (budget, fixture->client,
+                                             PHOC_CLIENT_RESOURCE_THUMBNAIL_MEMORY, 100));
+
+  variant = g_variant_ref_sink (phoc_client_budget_to_variant (budget));
+
+  limits = g_variant_lookup_value (variant, "limits", G_VARIANT_TYPE ("a{st}"));
+  g_assert_nonnull (limits);
+  g_assert_true (g_variant_lookup (limits, "thumbnail-memory", "t", &value));
+  g_assert_cmpuint (value, ==, 1000);
+
+  clients = g_variant_lookup_value (variant, "clients", G_VARIANT_TYPE ("aa{sv}"));
+  g_assert_nonnull (clients);
+  g_assert_cmpuint (g_variant_n_children (clients), ==, 1);
+  client = g_variant_get_child_value (clients, 0);
+  usage = g_variant_lookup_value (client, "usage", G_VARIANT_TYPE ("a{st}"));
+  g_assert_true (g_variant_lookup (usage, "thumbnail-memory", "t", &value));
+  g_assert_cmpuint (value, ==, 100);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/phoc/client-budget/held", BudgetFixture, NULL,
+              budget_fixture_setup, test_phoc_client_budget_held, budget_fixture_teardown);
+  g_test_add ("/phoc/client-budget/rate", BudgetFixture, NULL,
+              budget_fixture_setup, test_phoc_client_budget_rate, budget_fixture_teardown);
+  g_test_add ("/phoc/client-budget/variant", BudgetFixture, NULL,
+              budget_fixture_setup, test_phoc_client_budget_variant, budget_fixture_teardown);
+
+  return g_test_run ();
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "damage-heatmap.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TILE PHOC_DAMAGE_HEATMAP_TILE_SIZE
+
+
+static void
+test_phoc_damage_heatmap_count (void)
+{
+  g_autoptr (PhocDamageHeatmap) heatmap = phoc_damage_heatmap_new ();
+  pixman_region32_t damage;
+
+  pixman_region32_init_rect (&damage, 0, 0, TILE, TILE);
+  /* Overlapping rects count once per frame */
+  pixman_region32_union_rect (&damage, &damage, TILE / 2, 0, TILE, TILE);
+
+  phoc_damage_heatmap_add_damage (heatmap, &damage, 4 * TILE, 2 * TILE);
+  phoc_damage_heatmap_add_damage (heatmap, &damage, 4 * TILE, 2 * TILE);
+  g_assert_cmpuint (phoc_damage_heatmap_get_frames (heatmap), ==, 2);
+
+  g_assert_cmpuint (phoc_damage_heatmap_get_count (heatmap, 0, 0), ==, 2);
+  g_assert_cmpuint (phoc_damage_heatmap_get_count (heatmap, TILE, 0), ==, 2);
+  g_assert_cmpuint (phoc_damage_heatmap_get_count (heatmap, 2 * TILE, 0), ==, 0);
+  g_assert_cmpuint (phoc_damage_heatmap_get_count (heatmap, 0, TILE), ==, 0);
+  /* Outside of the output */
+  g_assert_cmpuint (phoc_damage_heatmap_get_count (heatmap, 4 * TILE, 0), ==, 0);
+
+  /* A size change resets the counts */
+  phoc_damage_heatmap_add_damage (heatmap, &damage, 8 * TILE, 2 * TILE);
+  g_assert_cmpuint (phoc_damage_heatmap_get_frames (heatmap), ==, 1);
+  g_assert_cmpuint (phoc_damage_heatmap_get_count (heatmap, 0, 0), ==, 1);
+
+  phoc_damage_heatmap_reset (heatmap);
+  g_assert_cmpuint (phoc_damage_heatmap_get_frames (heatmap), ==, 0);
+  g_assert_cmpuint (phoc_damage_heatmap_get_count (heatmap, 0, 0), ==, 0);
+
+  pixman_region32_fini (&damage);
+}
+
+
+static void
+test_phoc_damage_heatmap_save (void)
+{
+  g_autoptr (PhocDamageHeatmap) heatmap = phoc_damage_heatmap_new ();
+  g_autofree char *path = NULL;
+  g_autofree char *contents = NULL;
+  g_autoptr (GError) err = NULL;
+  const char *header = "P5\n2 1\n255\n";
+  pixman_region32_t damage;
+  gsize len;
+  int fd;
+
+  fd = g_file_open_tmp ("phoc-heatmap-XXXXXX.pgm", &path, &err);
+  g_assert_no_error (err);
+  close (fd);
+
+  g_assert_false (phoc_damage_heatmap_save (heatmap, path, &err));
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED);
+  g_clear_error (&err);
+
+  pixman_region32_init_rect (&damage, 0, 0, TILE, TILE);
+  phoc_damage_heatmap_add_damage (heatmap, &damage, 2 * TILE, TILE);
+  g_assert_true (phoc_damage_heatmap_save (heatmap, path, &err));
+  g_assert_no_error (err);
+
+  g_assert_true (g_file_get_contents (path, &contents, &len, &err));
+  g_assert_cmpuint (len, ==, strlen (header) + 2);
+  g_assert_cmpmem (contents, strlen (header), header, strlen (header));
+  g_assert_cmpuint ((guint8)contents[len - 2], ==, 255);
+  g_assert_cmpuint ((guint8)contents[len - 1], ==, 0);
+
+  g_unlink (path);
+  pixman_region32_fini (&damage);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/damage-heatmap/count", test_phoc_damage_heatmap_count);
+  g_test_add_func ("/phoc/damage-heatmap/save", test_phoc_damage_heatmap_save);
+
+  return g_test_run ();
+}
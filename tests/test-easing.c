@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "anim/easing.h"
+
+#define N_SAMPLES 10000
+#define MAX_LUT_ERROR 0.005
+
+
+static void
+test_phoc_easing_lut_accuracy (void)
+{
+  g_autoptr (GEnumClass) klass = g_type_class_ref (PHOC_TYPE_EASING);
+
+  for (guint e = 0; e < klass->n_values; e++) {
+    PhocEasing easing = klass->values[e].value;
+    double max_error = 0.0;
+
+    for (int i = 0; i <= N_SAMPLES; i++) {
+      double value = (double) i / N_SAMPLES;
+      double error = ABS (phoc_easing_ease_lut (easing, value) - phoc_easing_ease (easing, value));
+
+      max_error = MAX (max_error, error);
+    }
+
+    g_test_message ("%s: max error %f", klass->values[e].value_nick, max_error);
+    g_assert_cmpfloat (max_error, <, MAX_LUT_ERROR);
+
+    /* The ends are exact */
+    g_assert_cmpfloat (phoc_easing_ease_lut (easing, 0.0), ==, phoc_easing_ease (easing, 0.0));
+    g_assert_cmpfloat (phoc_easing_ease_lut (easing, 1.0), ==, phoc_easing_ease (easing, 1.0));
+  }
+}
+
+
+static double
+bench_easing (double (*ease) (PhocEasing, double), PhocEasing easing, guint rounds)
+{
+  g_autoptr (GTimer) timer = g_timer_new ();
+  volatile double sum = 0.0;
+
+  for (guint r = 0; r < rounds; r++) {
+    for (int i = 0; i <= N_SAMPLES; i++)
+      sum += ease (easing, (double) i / N_SAMPLES);
+  }
+
+  return g_timer_elapsed (timer, NULL);
+}
+
+
+static void
+test_phoc_easing_lut_bench (void)
+{
+  g_autoptr (GEnumClass) klass = g_type_class_ref (PHOC_TYPE_EASING);
+  guint rounds = g_test_thorough () ? 1000 : 100;
+
+  for (guint e = 0; e < klass->n_values; e++) {
+    PhocEasing easing = klass->values[e].value;
+    double analytic, lut;
+
+    /* Fill the table outside of the measurement */
+    phoc_easing_ease_lut (easing, 0.5);
+
+    analytic = bench_easing (phoc_easing_ease, easing, rounds);
+    lut = bench_easing (phoc_easing_ease_lut, easing, rounds);
+
+    g_test_minimized_result (lut, "%s: analytic %fs, lut %fs",
+                             klass->values[e].value_nick, analytic, lut);
+  }
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/easing/lut/accuracy", test_phoc_easing_lut_accuracy);
+  if (g_test_perf ())
+    g_test_add_func ("/phoc/easing/lut/bench", test_phoc_easing_lut_bench);
+
+  return g_test_run ();
+}
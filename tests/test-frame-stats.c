@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "frame-stats.h"
+
+
+static void
+test_phoc_frame_stats_samples (void)
+{
+  g_autoptr (PhocFrameStats) stats = phoc_frame_stats_new ();
+  guint32 samples[PHOC_FRAME_STATS_N_SAMPLES];
+  guint n;
+
+  n = phoc_frame_stats_get_samples (stats, PHOC_FRAME_STATS_METRIC_RENDER,
+                                    samples, G_N_ELEMENTS (samples));
+  g_assert_cmpuint (n, ==, 0);
+
+  for (int i = 0; i < 10; i++)
+    phoc_frame_stats_record (stats, PHOC_FRAME_STATS_METRIC_RENDER, i);
+
+  n = phoc_frame_stats_get_samples (stats, PHOC_FRAME_STATS_METRIC_RENDER,
+                                    samples, G_N_ELEMENTS (samples));
+  g_assert_cmpuint (n, ==, 10);
+  for (int i = 0; i < 10; i++)
+    g_assert_cmpuint (samples[i], ==, i);
+
+  /* Other metrics are unaffected */
+  n = phoc_frame_stats_get_samples (stats, PHOC_FRAME_STATS_METRIC_SUBMIT,
+                                    samples, G_N_ELEMENTS (samples));
+  g_assert_cmpuint (n, ==, 0);
+
+  /* Only the most recent samples are kept, oldest first */
+  for (int i = 0; i < PHOC_FRAME_STATS_N_SAMPLES + 5; i++)
+    phoc_frame_stats_record (stats, PHOC_FRAME_STATS_METRIC_SUBMIT, i);
+
+  n = phoc_frame_stats_get_samples (stats, PHOC_FRAME_STATS_METRIC_SUBMIT,
+                                    samples, G_N_ELEMENTS (samples));
+  g_assert_cmpuint (n, ==, PHOC_FRAME_STATS_N_SAMPLES);
+  g_assert_cmpuint (samples[0], ==, 5);
+  g_assert_cmpuint (samples[n - 1], ==, PHOC_FRAME_STATS_N_SAMPLES + 4);
+
+  /* Fetching less samples gives the most recent ones */
+  n = phoc_frame_stats_get_samples (stats, PHOC_FRAME_STATS_METRIC_SUBMIT, samples, 2);
+  g_assert_cmpuint (n, ==, 2);
+  g_assert_cmpuint (samples[0], ==, PHOC_FRAME_STATS_N_SAMPLES + 3);
+  g_assert_cmpuint (samples[1], ==, PHOC_FRAME_STATS_N_SAMPLES + 4);
+}
+
+
+static void
+test_phoc_frame_stats_histogram (void)
+{
+  g_autoptr (PhocFrameStats) stats = phoc_frame_stats_new ();
+  guint64 buckets[PHOC_FRAME_STATS_N_BUCKETS];
+
+  phoc_frame_stats_record (stats, PHOC_FRAME_STATS_METRIC_COMMIT, -1);
+  phoc_frame_stats_record (stats, PHOC_FRAME_STATS_METRIC_COMMIT, 1);
+  phoc_frame_stats_record (stats, PHOC_FRAME_STATS_METRIC_COMMIT, 2);
+  phoc_frame_stats_record (stats, PHOC_FRAME_STATS_METRIC_COMMIT, 3);
+  phoc_frame_stats_record (stats, PHOC_FRAME_STATS_METRIC_COMMIT, 1000);
+  phoc_frame_stats_record (stats, PHOC_FRAME_STATS_METRIC_COMMIT, G_MAXINT64);
+
+  phoc_frame_stats_get_histogram (stats, PHOC_FRAME_STATS_METRIC_COMMIT, buckets);
+  g_assert_cmpuint (buckets[0], ==, 2);
+  g_assert_cmpuint (buckets[1], ==, 2);
+  /* 512 <= 1000 < 1024 */
+  g_assert_cmpuint (buckets[9], ==, 1);
+  g_assert_cmpuint (buckets[PHOC_FRAME_STATS_N_BUCKETS - 1], ==, 1);
+}
+
+
+static void
+test_phoc_frame_stats_percentile (void)
+{
+  g_autoptr (PhocFrameStats) stats = phoc_frame_stats_new ();
+
+  g_assert_cmpuint (phoc_frame_stats_get_percentile (stats, PHOC_FRAME_STATS_METRIC_INPUT_LATENCY,
+                                                     50), ==, 0);
+
+  /* Record out of order to make sure samples get sorted */
+  for (int i = 100; i > 0; i--)
+    phoc_frame_stats_record (stats, PHOC_FRAME_STATS_METRIC_INPUT_LATENCY, i * 10);
+
+  g_assert_cmpuint (phoc_frame_stats_get_percentile (stats, PHOC_FRAME_STATS_METRIC_INPUT_LATENCY,
+                                                     0), ==, 10);
+  g_assert_cmpuint (phoc_frame_stats_get_percentile (stats, PHOC_FRAME_STATS_METRIC_INPUT_LATENCY,
+                                                     50), ==, 500);
+  g_assert_cmpuint (phoc_frame_stats_get_percentile (stats, PHOC_FRAME_STATS_METRIC_INPUT_LATENCY,
+                                                     99), ==, 990);
+  g_assert_cmpuint (phoc_frame_stats_get_percentile (stats, PHOC_FRAME_STATS_METRIC_INPUT_LATENCY,
+                                                     100), ==, 1000);
+}
+
+
+static void
+test_phoc_frame_stats_variant (void)
+{
+  g_autoptr (PhocFrameStats) stats = phoc_frame_stats_new ();
+  g_autoptr (GVariant) variant = NULL;
+  g_autoptr (GVariant) render = NULL;
+  guint64 missed;
+  guint32 max;
+
+  phoc_frame_stats_record (stats, PHOC_FRAME_STATS_METRIC_RENDER, 100);
+  phoc_frame_stats_record (stats, PHOC_FRAME_STATS_METRIC_RENDER, 300);
+  phoc_frame_stats_add_missed_vblanks (stats, 2);
+  phoc_frame_stats_add_missed_vblanks (stats, 1);
+  g_assert_cmpuint (phoc_frame_stats_get_missed_vblanks (stats), ==, 3);
+  phoc_frame_stats_add_arranges_coalesced (stats, 4);
+  g_assert_cmpuint (phoc_frame_stats_get_arranges_coalesced (stats), ==, 4);
+  phoc_frame_stats_add_configures_coalesced (stats, 5);
+  g_assert_cmpuint (phoc_frame_stats_get_configures_coalesced (stats), ==, 5);
+  phoc_frame_stats_add_frame (stats, 100, 2);
+  phoc_frame_stats_add_frame (stats, 50, 1);
+  g_assert_cmpuint (phoc_frame_stats_get_frames (stats), ==, 2);
+  g_assert_cmpuint (phoc_frame_stats_get_damaged_pixels (stats), ==, 150);
+  g_assert_cmpuint (phoc_frame_stats_get_texture_draws (stats), ==, 3);
+
+  variant = g_variant_ref_sink (phoc_frame_stats_to_variant (stats));
+  g_assert_true (g_variant_lookup (variant, "missed-vblanks", "t", &missed));
+  g_assert_cmpuint (missed, ==, 3);
+  g_assert_true (g_variant_lookup (variant, "arranges-coalesced", "t", &missed));
+  g_assert_cmpuint (missed, ==, 4);
+  g_assert_true (g_variant_lookup (variant, "configures-coalesced", "t", &missed));
+  g_assert_cmpuint (missed, ==, 5);
+  g_assert_true (g_variant_lookup (variant, "damaged-pixels", "t", &missed));
+  g_assert_cmpuint (missed, ==, 150);
+
+  render = g_variant_lookup_value (variant, "render", G_VARIANT_TYPE_VARDICT);
+  g_assert_nonnull (render);
+  g_assert_true (g_variant_lookup (render, "max", "u", &max));
+  g_assert_cmpuint (max, ==, 300);
+  g_assert_true (g_variant_lookup (render, "p50", "u", &max));
+  g_assert_cmpuint (max, ==, 100);
+
+  phoc_frame_stats_reset (stats);
+  g_assert_cmpuint (phoc_frame_stats_get_missed_vblanks (stats), ==, 0);
+  g_assert_cmpuint (phoc_frame_stats_get_arranges_coalesced (stats), ==, 0);
+  g_assert_cmpuint (phoc_frame_stats_get_configures_coalesced (stats), ==, 0);
+  g_assert_cmpuint (phoc_frame_stats_get_frames (stats), ==, 0);
+}
+
+
+static void
+test_phoc_frame_stats_scanout (void)
+{
+  g_autoptr (PhocFrameStats) stats = phoc_frame_stats_new ();
+  g_autoptr (GVariant) variant = NULL;
+  g_autoptr (GVariant) scanout = NULL;
+  guint64 count;
+
+  phoc_frame_stats_record_scanout (stats, PHOC_SCANOUT_RESULT_ACCEPTED);
+  phoc_frame_stats_record_scanout (stats, PHOC_SCANOUT_RESULT_OVERLAY_LAYER);
+  phoc_frame_stats_record_scanout (stats, PHOC_SCANOUT_RESULT_OVERLAY_LAYER);
+
+  g_assert_cmpuint (phoc_frame_stats_get_scanout_count (stats, PHOC_SCANOUT_RESULT_ACCEPTED),
+                    ==, 1);
+  g_assert_cmpuint (phoc_frame_stats_get_scanout_count (stats, PHOC_SCANOUT_RESULT_OVERLAY_LAYER),
+                    ==, 2);
+  g_assert_cmpuint (phoc_frame_stats_get_scanout_count (stats, PHOC_SCANOUT_RESULT_NO_BUFFER),
+                    ==, 0);
+
+  variant = g_variant_ref_sink (phoc_frame_stats_to_variant (stats));
+  scanout = g_variant_lookup_value (variant, "scanout", G_VARIANT_TYPE ("a{st}"));
+  g_assert_nonnull (scanout);
+  g_assert_true (g_variant_lookup (scanout, "overlay-layer", "t", &count));
+  g_assert_cmpuint (count, ==, 2);
+
+  phoc_frame_stats_reset (stats);
+  g_assert_cmpuint (phoc_frame_stats_get_scanout_count (stats, PHOC_SCANOUT_RESULT_ACCEPTED),
+                    ==, 0);
+}
+
+
+static void
+test_phoc_frame_stats_cursor (void)
+{
+  g_autoptr (PhocFrameStats) stats = phoc_frame_stats_new ();
+  g_autoptr (GVariant) variant = NULL;
+  g_autoptr (GVariant) cursor = NULL;
+  guint64 count;
+
+  phoc_frame_stats_record_cursor (stats, PHOC_CURSOR_PLANE_RESULT_HARDWARE);
+  phoc_frame_stats_record_cursor (stats, PHOC_CURSOR_PLANE_RESULT_REJECTED);
+  phoc_frame_stats_record_cursor (stats, PHOC_CURSOR_PLANE_RESULT_REJECTED);
+
+  g_assert_cmpuint (phoc_frame_stats_get_cursor_count (stats, PHOC_CURSOR_PLANE_RESULT_HARDWARE),
+                    ==, 1);
+  g_assert_cmpuint (phoc_frame_stats_get_cursor_count (stats, PHOC_CURSOR_PLANE_RESULT_REJECTED),
+                    ==, 2);
+  g_assert_cmpuint (phoc_frame_stats_get_cursor_count (stats, PHOC_CURSOR_PLANE_RESULT_LOCKED),
+                    ==, 0);
+
+  variant = g_variant_ref_sink (phoc_frame_stats_to_variant (stats));
+  cursor = g_variant_lookup_value (variant, "cursor", G_VARIANT_TYPE ("a{st}"));
+  g_assert_nonnull (cursor);
+  g_assert_true (g_variant_lookup (cursor, "rejected", "t", &count));
+  g_assert_cmpuint (count, ==, 2);
+
+  phoc_frame_stats_reset (stats);
+  g_assert_cmpuint (phoc_frame_stats_get_cursor_count (stats, PHOC_CURSOR_PLANE_RESULT_REJECTED),
+                    ==, 0);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/frame-stats/samples", test_phoc_frame_stats_samples);
+  g_test_add_func ("/phoc/frame-stats/histogram", test_phoc_frame_stats_histogram);
+  g_test_add_func ("/phoc/frame-stats/percentile", test_phoc_frame_stats_percentile);
+  g_test_add_func ("/phoc/frame-stats/variant", test_phoc_frame_stats_variant);
+  g_test_add_func ("/phoc/frame-stats/scanout", test_phoc_frame_stats_scanout);
+  g_test_add_func ("/phoc/frame-stats/cursor", test_phoc_frame_stats_cursor);
+
+  return g_test_run ();
+}
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "event.h"
+#include "gesture-swipe.h"
+#include "gesture-zoom.h"
+#include "touch.h"
+
+#include <wlr/interfaces/wlr_touch.h>
+
+#define TRACE_FRAME_MS 8
+#define TRACE_N_FRAMES 60
+
+
+typedef struct {
+  struct wlr_touch touch;
+  PhocTouch       *device;
+  GArray          *trace;
+} GestureFixture;
+
+
+/* A single recorded touch event, positions in layout coordinates */
+typedef struct {
+  PhocEventType type;
+  guint32       time_msec;
+  int           touch_id;
+  double        lx, ly;
+} TracePoint;
+
+
+static const struct wlr_touch_impl touch_impl = {
+  .name = "test-touch",
+};
+
+
+static void
+fixture_setup (GestureFixture *fixture, gconstpointer unused)
+{
+  wlr_touch_init (&fixture->touch, &touch_impl, "test-touch");
+  fixture->device = phoc_touch_new (&fixture->touch.base, NULL);
+  fixture->trace = g_array_new (FALSE, FALSE, sizeof (TracePoint));
+}
+
+
+static void
+fixture_teardown (GestureFixture *fixture, gconstpointer unused)
+{
+  g_array_unref (fixture->trace);
+  wlr_touch_finish (&fixture->touch);
+  g_assert_finalize_object (fixture->device);
+}
+
+
+static void
+trace_add (GArray *trace, PhocEventType type, guint32 time, int id, double lx, double ly)
+{
+  TracePoint point = { type, time, id, lx, ly };
+
+  g_array_append_val (trace, point);
+}
+
+/*
+ * Record a trace of @n_fingers moving from (@x, @y) by (@dx, @dy)
+ * with the fingers spread apart horizontally by @spread growing by
+ * @dspread over the trace.
+ */
+static void
+record_trace (GArray *trace,
+              guint   n_fingers,
+              double  x,
+              double  y,
+              double  dx,
+              double  dy,
+              double  spread,
+              double  dspread)
+{
+  guint32 time = trace->len ? g_array_index (trace, TracePoint, trace->len - 1).time_msec : 0;
+
+  for (guint f = 0; f < n_fingers; f++)
+    trace_add (trace, PHOC_EVENT_TOUCH_BEGIN, time, f, x + f * spread, y);
+
+  for (int i = 1; i <= TRACE_N_FRAMES; i++) {
+    double t = (double) i / TRACE_N_FRAMES;
+
+    time += TRACE_FRAME_MS;
+    for (guint f = 0; f < n_fingers; f++) {
+      trace_add (trace, PHOC_EVENT_TOUCH_UPDATE, time, f,
+                 x + dx * t + f * (spread + dspread * t), y + dy * t);
+    }
+  }
+
+  for (guint f = 0; f < n_fingers; f++)
+    trace_add (trace, PHOC_EVENT_TOUCH_END, time, f, x + dx + f * (spread + dspread), y + dy);
+}
+
+
+static void
+replay_trace (GestureFixture *fixture, PhocGesture **gestures, guint n_gestures)
+{
+  for (guint i = 0; i < fixture->trace->len; i++) {
+    TracePoint *point = &g_array_index (fixture->trace, TracePoint, i);
+    PhocEvent event;
+
+    switch (point->type) {
+    case PHOC_EVENT_TOUCH_BEGIN: {
+      struct wlr_touch_down_event down = {
+        .touch = &fixture->touch,
+        .time_msec = point->time_msec,
+        .touch_id = point->touch_id,
+      };
+      phoc_event_init (&event, point->type, &down, sizeof (down));
+      break;
+    }
+    case PHOC_EVENT_TOUCH_UPDATE: {
+      struct wlr_touch_motion_event motion = {
+        .touch = &fixture->touch,
+        .time_msec = point->time_msec,
+        .touch_id = point->touch_id,
+      };
+      phoc_event_init (&event, point->type, &motion, sizeof (motion));
+      break;
+    }
+    case PHOC_EVENT_TOUCH_END: {
+      struct wlr_touch_up_event up = {
+        .touch = &fixture->touch,
+        .time_msec = point->time_msec,
+        .touch_id = point->touch_id,
+      };
+      phoc_event_init (&event, point->type, &up, sizeof (up));
+      break;
+    }
+    default:
+      g_assert_not_reached ();
+    }
+
+    for (guint g = 0; g < n_gestures; g++)
+      phoc_gesture_handle_event (gestures[g], &event, point->lx, point->ly);
+  }
+}
+
+
+static void
+on_swipe (PhocGestureSwipe *swipe, double vx, double vy, double *velocity)
+{
+  velocity[0] = vx;
+  velocity[1] = vy;
+}
+
+
+static void
+on_scale_changed (PhocGestureZoom *zoom, double scale, double *last_scale)
+{
+  *last_scale = scale;
+}
+
+
+static void
+test_phoc_gesture_swipe (GestureFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (PhocGestureSwipe) swipe = phoc_gesture_swipe_new ();
+  double velocity[2] = { 0.0, 0.0 };
+  guint64 n_stack_before, n_stack, n_heap_before, n_heap;
+
+  g_signal_connect (swipe, "swipe", G_CALLBACK (on_swipe), velocity);
+
+  /* One finger moving 480px to the right in 480ms */
+  record_trace (fixture->trace, 1, 100, 100, 480, 0, 0, 0);
+  phoc_event_get_allocation_stats (&n_stack_before, &n_heap_before);
+  replay_trace (fixture, (PhocGesture *[]){ PHOC_GESTURE (swipe) }, 1);
+  phoc_event_get_allocation_stats (&n_stack, &n_heap);
+
+  /* Tracking the finger doesn't allocate any events */
+  g_assert_cmpuint (n_stack - n_stack_before, ==, fixture->trace->len);
+  g_assert_cmpuint (n_heap - n_heap_before, ==, 0);
+
+  g_assert_cmpfloat_with_epsilon (velocity[0], 1000.0, 1.0);
+  g_assert_cmpfloat_with_epsilon (velocity[1], 0.0, 1.0);
+  g_assert_false (phoc_gesture_is_active (PHOC_GESTURE (swipe)));
+}
+
+
+static void
+test_phoc_gesture_zoom (GestureFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (PhocGestureZoom) zoom = phoc_gesture_zoom_new ();
+  double scale = 0.0;
+
+  g_signal_connect (zoom, "scale-changed", G_CALLBACK (on_scale_changed), &scale);
+
+  /* Two fingers moving apart from 100px to 200px */
+  record_trace (fixture->trace, 2, 100, 100, 0, 0, 100, 100);
+  replay_trace (fixture, (PhocGesture *[]){ PHOC_GESTURE (zoom) }, 1);
+
+  g_assert_cmpfloat_with_epsilon (scale, 2.0, 0.001);
+  g_assert_false (phoc_gesture_is_active (PHOC_GESTURE (zoom)));
+}
+
+
+static void
+test_phoc_gesture_bench (GestureFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (PhocGestureSwipe) swipe = phoc_gesture_swipe_new ();
+  g_autoptr (PhocGestureZoom) zoom = phoc_gesture_zoom_new ();
+  PhocGesture *gestures[] = { PHOC_GESTURE (swipe), PHOC_GESTURE (zoom) };
+  guint rounds = g_test_thorough () ? 10000 : 1000;
+  g_autoptr (GTimer) timer = NULL;
+  double elapsed;
+  guint64 n_stack_before, n_stack, n_heap_before, n_heap;
+
+  /* Swipes, pinches and a three finger gesture with a denied finger */
+  record_trace (fixture->trace, 1, 100, 100, 480, 0, 0, 0);
+  record_trace (fixture->trace, 2, 100, 100, 0, 0, 100, 100);
+  record_trace (fixture->trace, 2, 100, 100, 200, 200, 200, -100);
+  record_trace (fixture->trace, 3, 100, 100, 0, 300, 50, 0);
+
+  phoc_event_get_allocation_stats (&n_stack_before, &n_heap_before);
+  timer = g_timer_new ();
+  for (guint r = 0; r < rounds; r++)
+    replay_trace (fixture, gestures, G_N_ELEMENTS (gestures));
+  elapsed = g_timer_elapsed (timer, NULL);
+  phoc_event_get_allocation_stats (&n_stack, &n_heap);
+  n_stack -= n_stack_before;
+  n_heap -= n_heap_before;
+
+  g_assert_cmpuint (n_stack, ==, rounds * fixture->trace->len);
+  g_assert_cmpuint (n_heap, ==, 0);
+  g_test_minimized_result (elapsed, "%" G_GUINT64_FORMAT " events in %fs, %fµs per event, "
+                           "%.0f stack events and %.0f heap events per second",
+                           n_stack, elapsed, elapsed * G_USEC_PER_SEC / n_stack,
+                           n_stack / elapsed, n_heap / elapsed);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/phoc/gesture/swipe", GestureFixture, NULL,
+              fixture_setup, test_phoc_gesture_swipe, fixture_teardown);
+  g_test_add ("/phoc/gesture/zoom", GestureFixture, NULL,
+              fixture_setup, test_phoc_gesture_zoom, fixture_teardown);
+  if (g_test_perf ()) {
+    g_test_add ("/phoc/gesture/bench", GestureFixture, NULL,
+                fixture_setup, test_phoc_gesture_bench, fixture_teardown);
+  }
+
+  return g_test_run ();
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "input-trace.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+
+static void
+test_phoc_input_trace_save_load (void)
+{
+  g_autoptr (PhocInputTrace) trace = phoc_input_trace_new ();
+  g_autoptr (PhocInputTrace) loaded = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *path = NULL;
+  const PhocInputTraceEvent *events;
+  int fd;
+  guint n;
+
+  fd = g_file_open_tmp ("phoc-test-input-trace-XXXXXX", &path, &err);
+  g_assert_no_error (err);
+  close (fd);
+
+  phoc_input_trace_add (trace, PHOC_INPUT_TRACE_EVENT_TOUCH_DOWN, 10, 1, 0, 0.25, 0.5);
+  phoc_input_trace_add (trace, PHOC_INPUT_TRACE_EVENT_POINTER_BUTTON, 20, 0x110, 1, 0, 0);
+  phoc_input_trace_add (trace, PHOC_INPUT_TRACE_EVENT_POINTER_MOTION, 30, 0, 0, -5, 3);
+
+  g_assert_true (phoc_input_trace_save (trace, path, &err));
+  g_assert_no_error (err);
+
+  loaded = phoc_input_trace_new_from_file (path, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (loaded);
+
+  events = phoc_input_trace_get_events (loaded, &n);
+  g_assert_cmpuint (n, ==, 3);
+  g_assert_cmpint (events[0].type, ==, PHOC_INPUT_TRACE_EVENT_TOUCH_DOWN);
+  g_assert_cmpuint (events[0].time_msec, ==, 10);
+  g_assert_cmpuint (events[0].code, ==, 1);
+  g_assert_cmpfloat (events[0].x, ==, 0.25);
+  g_assert_cmpfloat (events[0].y, ==, 0.5);
+  g_assert_cmpint (events[1].type, ==, PHOC_INPUT_TRACE_EVENT_POINTER_BUTTON);
+  g_assert_cmpuint (events[1].code, ==, 0x110);
+  g_assert_cmpuint (events[1].state, ==, 1);
+  g_assert_cmpfloat (events[2].x, ==, -5);
+  g_assert_cmpfloat (events[2].y, ==, 3);
+
+  /* Not a trace */
+  g_assert_true (g_file_set_contents (path, "not a trace", -1, &err));
+  g_assert_no_error (err);
+  g_assert_null (phoc_input_trace_new_from_file (path, &err));
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+
+  g_unlink (path);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/input-trace/save-load", test_phoc_input_trace_save_load);
+
+  return g_test_run ();
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "keymap-cache.h"
+
+static const char *layouts[] = {
+  "us", "de", "fr", "gb", "es", "it", "se", "no", "dk", "fi", NULL
+};
+
+
+static void
+test_phoc_keymap_cache_lookup (void)
+{
+  g_autoptr (PhocKeymapCache) cache = phoc_keymap_cache_new ();
+  struct xkb_keymap *keymap1, *keymap2;
+
+  keymap1 = phoc_keymap_cache_lookup (cache, "us", NULL, NULL);
+  g_assert_nonnull (keymap1);
+  g_assert_cmpuint (phoc_keymap_cache_get_size (cache), ==, 1);
+
+  /* Same names, same keymap */
+  keymap2 = phoc_keymap_cache_lookup (cache, "us", NULL, NULL);
+  g_assert_true (keymap1 == keymap2);
+  g_assert_cmpuint (phoc_keymap_cache_get_size (cache), ==, 1);
+  xkb_keymap_unref (keymap2);
+
+  /* Options are part of the key */
+  keymap2 = phoc_keymap_cache_lookup (cache, "us", NULL, "compose:ralt");
+  g_assert_nonnull (keymap2);
+  g_assert_true (keymap1 != keymap2);
+  g_assert_cmpuint (phoc_keymap_cache_get_size (cache), ==, 2);
+  xkb_keymap_unref (keymap2);
+
+  xkb_keymap_unref (keymap1);
+}
+
+
+static void
+test_phoc_keymap_cache_bounded (void)
+{
+  g_autoptr (PhocKeymapCache) cache = phoc_keymap_cache_new ();
+  struct xkb_keymap *keymap, *first;
+
+  g_assert_cmpuint (G_N_ELEMENTS (layouts) - 1, >, PHOC_KEYMAP_CACHE_MAX_SIZE);
+
+  first = phoc_keymap_cache_lookup (cache, layouts[0], NULL, NULL);
+  g_assert_nonnull (first);
+
+  for (guint i = 1; layouts[i]; i++) {
+    keymap = phoc_keymap_cache_lookup (cache, layouts[i], NULL, NULL);
+    g_assert_nonnull (keymap);
+    xkb_keymap_unref (keymap);
+
+    /* Recently used keymaps stay cached */
+    keymap = phoc_keymap_cache_lookup (cache, layouts[0], NULL, NULL);
+    g_assert_true (keymap == first);
+    xkb_keymap_unref (keymap);
+
+    g_assert_cmpuint (phoc_keymap_cache_get_size (cache), <=, PHOC_KEYMAP_CACHE_MAX_SIZE);
+  }
+  g_assert_cmpuint (phoc_keymap_cache_get_size (cache), ==, PHOC_KEYMAP_CACHE_MAX_SIZE);
+
+  xkb_keymap_unref (first);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/keymap-cache/lookup", test_phoc_keymap_cache_lookup);
+  g_test_add_func ("/phoc/keymap-cache/bounded", test_phoc_keymap_cache_bounded);
+
+  return g_test_run ();
+}
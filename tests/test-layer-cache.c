@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "layer-cache.h"
+#include "output.h"
+#include "testlib.h"
+#include "testlib-layer-shell.h"
+
+#define GREEN 0xFF00FF00
+#define RED   0xFFFF0000
+
+#define ANCHOR_ALL (ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |    \
+                    ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM | \
+                    ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |   \
+                    ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT)
+
+
+static PhocOutput *
+get_output (PhocServer *server)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output;
+
+  g_assert_cmpint (wl_list_length (&desktop->outputs), ==, 1);
+  output = wl_container_of (desktop->outputs.next, output, link);
+
+  return output;
+}
+
+
+static guint32
+get_pixel (PhocTestBuffer *buffer, guint32 x, guint32 y)
+{
+  return *(guint32 *)(buffer->shm_data + y * buffer->stride + x * 4) & 0x00FFFFFF;
+}
+
+
+static void
+fill_buffer (PhocTestBuffer *buffer, guint32 color)
+{
+  for (int i = 0; i < buffer->width * buffer->height * 4; i += 4)
+    *(guint32 *)(buffer->shm_data + i) = color;
+}
+
+
+static gboolean
+damage_output (PhocServer *server, gpointer data)
+{
+  phoc_output_damage_whole (get_output (server));
+
+  return TRUE;
+}
+
+
+static gboolean
+has_layer_cache (PhocServer *server, gpointer data)
+{
+  PhocLayerCache *cache = phoc_output_get_layer_cache (get_output (server));
+
+  return cache && phoc_layer_cache_get_texture (cache);
+}
+
+
+static gboolean
+wait_for_layer_cache (PhocTestClientGlobals *globals)
+{
+  gboolean cached = FALSE;
+
+  /* Built once the layers stayed the same for two frames */
+  for (int i = 0; i < 5 && !cached; i++) {
+    phoc_test_client_invoke_server (globals, damage_output, NULL);
+    phoc_test_client_capture_output (globals, &globals->output);
+    cached = phoc_test_client_invoke_server (globals, has_layer_cache, NULL);
+  }
+
+  return cached;
+}
+
+
+static gboolean
+test_client_layer_cache (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestLayerSurface *ls;
+  PhocTestBuffer *screenshot;
+
+  ls = phoc_test_layer_surface_new_on_layer (globals, ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND,
+                                             0, 0, GREEN, ANCHOR_ALL, 0);
+  g_assert_nonnull (ls);
+
+  g_assert_true (wait_for_layer_cache (globals));
+
+  /* The cache shows the layer */
+  phoc_test_client_invoke_server (globals, damage_output, NULL);
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, 0, 0), ==, GREEN & 0x00FFFFFF);
+  g_assert_true (phoc_test_client_invoke_server (globals, has_layer_cache, NULL));
+
+  /* A commit isn't hidden behind the stale cache */
+  fill_buffer (&ls->buffer, RED);
+  wl_surface_attach (ls->wl_surface, ls->buffer.wl_buffer, 0, 0);
+  wl_surface_damage_buffer (ls->wl_surface, 0, 0, ls->width, ls->height);
+  wl_surface_commit (ls->wl_surface);
+  wl_display_roundtrip (globals->display);
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, 0, 0), ==, RED & 0x00FFFFFF);
+
+  /* The cache catches up once the layer is stable again */
+  g_assert_true (wait_for_layer_cache (globals));
+  phoc_test_client_invoke_server (globals, damage_output, NULL);
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, 0, 0), ==, RED & 0x00FFFFFF);
+
+  phoc_test_layer_surface_free (ls);
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_layer_cache_disabled (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestLayerSurface *ls;
+
+  ls = phoc_test_layer_surface_new_on_layer (globals, ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND,
+                                             0, 0, GREEN, ANCHOR_ALL, 0);
+  g_assert_nonnull (ls);
+
+  g_assert_false (wait_for_layer_cache (globals));
+
+  phoc_test_layer_surface_free (ls);
+
+  return TRUE;
+}
+
+
+static void
+test_layer_cache (void)
+{
+  PhocTestClientIface iface = {
+   .client_run     = test_client_layer_cache,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+   .config         = phoc_config_new_from_data ("[core]\n"
+                                                "xwayland = false\n"
+                                                "layer-cache = true\n"),
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+static void
+test_layer_cache_disabled (void)
+{
+  PhocTestClientIface iface = {
+   .client_run     = test_client_layer_cache_disabled,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+   .config         = phoc_config_new_from_data ("[core]\n"
+                                                "xwayland = false\n"),
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/layer-cache/drop-on-commit", test_layer_cache);
+  g_test_add_func ("/phoc/layer-cache/disabled", test_layer_cache_disabled);
+
+  return g_test_run ();
+}
@@ -171,6 +171,52 @@ test_layer_shell_exclusive_zone (void)
 }
 
 
+static gboolean
+test_client_layer_shell_render_budget (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestLayerSurface *ls_green;
+
+  ls_green = phoc_test_layer_surface_new (globals, WIDTH, HEIGHT, 0xFF00FF00,
+                                          ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP, 0);
+  g_assert_nonnull (ls_green);
+  phoc_assert_screenshot (globals, "test-layer-shell-anchor-1.png");
+
+  /* A static layer surface must not cause any repaints */
+  phoc_test_client_begin_render_budget (globals);
+  phoc_assert_render_budget (globals, 0, 0, 0);
+
+  /*
+   * The repainted area includes the damage of the previous frames the
+   * buffer missed so make sure every buffer saw the surface's damage
+   */
+  for (int i = 0; i < 4; i++) {
+    wl_surface_attach (ls_green->wl_surface, ls_green->buffer.wl_buffer, 0, 0);
+    wl_surface_damage (ls_green->wl_surface, 0, 0, WIDTH, HEIGHT);
+    wl_surface_commit (ls_green->wl_surface);
+    phoc_test_client_begin_render_budget (globals);
+  }
+
+  /* Damaging the surface repaints it once and nothing else */
+  wl_surface_attach (ls_green->wl_surface, ls_green->buffer.wl_buffer, 0, 0);
+  wl_surface_damage (ls_green->wl_surface, 0, 0, WIDTH, HEIGHT);
+  wl_surface_commit (ls_green->wl_surface);
+  phoc_assert_render_budget (globals, 1, WIDTH * HEIGHT, 1);
+
+  phoc_test_layer_surface_free (ls_green);
+
+  phoc_assert_screenshot (globals, "empty.png");
+  return TRUE;
+}
+
+static void
+test_layer_shell_render_budget (void)
+{
+  PhocTestClientIface iface = { .client_run = test_client_layer_shell_render_budget };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
 static gboolean
 test_client_layer_shell_set_layer (PhocTestClientGlobals *globals, gpointer data)
 {
@@ -221,6 +267,7 @@ main (gint argc, gchar *argv[])
   PHOC_TEST_ADD ("/phoc/layer-shell/anchor", test_layer_shell_anchor);
   PHOC_TEST_ADD ("/phoc/layer-shell/exclusive_zone", test_layer_shell_exclusive_zone);
   PHOC_TEST_ADD ("/phoc/layer-shell/set_layer", test_layer_shell_set_layer);
+  PHOC_TEST_ADD ("/phoc/layer-shell/render_budget", test_layer_shell_render_budget);
 
   return g_test_run();
 }
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "layout-transaction.h"
+#include "testlib.h"
+#include "testlib-layer-shell.h"
+
+#define GREEN 0xFF00FF00
+#define RED   0xFFFF0000
+#define BLUE  0xFF0000FF
+
+#define PANEL_HEIGHT 50
+
+
+static guint32
+get_pixel (PhocTestBuffer *buffer, guint32 x, guint32 y)
+{
+  return *(guint32 *)(buffer->shm_data + y * buffer->stride + x * 4) & 0x00FFFFFF;
+}
+
+
+static void
+on_done (gpointer data)
+{
+  gboolean *done = data;
+
+  *done = TRUE;
+}
+
+
+static void
+test_layout_transaction_empty (void)
+{
+  g_autoptr (PhocLayoutTransaction) transaction = phoc_layout_transaction_new ();
+  gboolean done = FALSE;
+
+  g_signal_connect_swapped (transaction, "done", G_CALLBACK (on_done), &done);
+
+  /* Nothing configured, nothing to hold */
+  phoc_layout_transaction_begin (transaction);
+  phoc_layout_transaction_begin (transaction);
+  phoc_layout_transaction_end (transaction);
+  g_assert_false (phoc_layout_transaction_is_holding (transaction));
+  phoc_layout_transaction_end (transaction);
+  g_assert_false (phoc_layout_transaction_is_holding (transaction));
+  g_assert_false (done);
+}
+
+
+static gboolean
+test_client_layout_transaction_hold (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *xs;
+  PhocTestLayerSurface *panel;
+  PhocTestBuffer *screenshot;
+  guint32 full_height;
+
+  xs = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "held", GREEN);
+  g_assert_nonnull (xs);
+  full_height = xs->height;
+
+  /* The panel's exclusive zone shrinks the maximized toplevel */
+  panel = phoc_test_layer_surface_new (globals, 0, PANEL_HEIGHT, RED,
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
+                                       PANEL_HEIGHT);
+  g_assert_nonnull (panel);
+  g_assert_cmpint (xs->height, <, full_height);
+
+  /*
+   * The toplevel didn't commit its new size yet. It keeps its old
+   * content while the rest of the output is still updated.
+   */
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, 0, 0), ==, GREEN & 0x00FFFFFF);
+  g_assert_cmphex (get_pixel (screenshot, 0, screenshot->height - 1), ==, RED & 0x00FFFFFF);
+
+  /* Once it committed its new size it's shown as is */
+  phoc_test_xdg_update_buffer (globals, xs, BLUE);
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, 0, 0), ==, BLUE & 0x00FFFFFF);
+  g_assert_cmphex (get_pixel (screenshot, 0, screenshot->height - 1), ==, RED & 0x00FFFFFF);
+
+  phoc_test_layer_surface_free (panel);
+  phoc_test_xdg_toplevel_free (xs);
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_layout_transaction_server_prepare (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+
+  g_assert_nonnull (desktop);
+  phoc_desktop_set_auto_maximize (desktop, TRUE);
+  return TRUE;
+}
+
+
+static void
+test_layout_transaction_hold (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_layout_transaction_server_prepare,
+   .client_run     = test_client_layout_transaction_hold,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/layout-transaction/empty", test_layout_transaction_empty);
+  g_test_add_func ("/phoc/layout-transaction/hold", test_layout_transaction_hold);
+
+  return g_test_run ();
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "log.h"
+
+#include <unistd.h>
+
+
+static char *
+dump_ring (void)
+{
+  g_autoptr (GString) out = g_string_new (NULL);
+  char buf[4096];
+  int fds[2];
+  gssize n;
+
+  g_assert_no_errno (pipe (fds));
+  phoc_log_ring_dump (fds[1]);
+  close (fds[1]);
+
+  while ((n = read (fds[0], buf, sizeof (buf))) > 0)
+    g_string_append_len (out, buf, n);
+  close (fds[0]);
+
+  return g_string_free (g_steal_pointer (&out), FALSE);
+}
+
+
+static void
+test_phoc_log_ring (void)
+{
+  g_autofree char *dump = NULL;
+  g_auto (GStrv) lines = NULL;
+
+#ifndef PHOC_ENABLE_HOT_DEBUG
+  g_test_skip ("Hot debug messages are compiled out");
+  return;
+#endif
+
+  phoc_log_init (TRUE);
+  g_assert_cmpuint (phoc_log_hot_domains & PHOC_LOG_HOT_INPUT, !=, 0);
+
+  dump = dump_ring ();
+  g_assert_cmpstr (dump, ==, "");
+  g_clear_pointer (&dump, g_free);
+
+  for (int i = 0; i < 300; i++)
+    phoc_debug_hot (PHOC_LOG_HOT_INPUT, "message %d", i);
+
+  dump = dump_ring ();
+  lines = g_strsplit (dump, "\n", -1);
+  /* The ring holds the last 256 messages, plus the empty string after the last newline */
+  g_assert_cmpuint (g_strv_length (lines), ==, 257);
+  g_assert_true (g_str_has_suffix (lines[0], " message 44"));
+  g_assert_true (g_str_has_suffix (lines[255], " message 299"));
+  g_assert_cmpstr (lines[256], ==, "");
+}
+
+
+static void
+test_phoc_log_disabled (void)
+{
+  g_autofree char *dump = NULL;
+  int evaluated = 0;
+
+  /* Set up an empty ring, then disable all hot domains */
+  phoc_log_init (TRUE);
+  g_unsetenv ("G_MESSAGES_DEBUG");
+  phoc_log_init (FALSE);
+  g_assert_cmpuint (phoc_log_hot_domains, ==, PHOC_LOG_HOT_NONE);
+
+  /* Arguments of disabled domains aren't evaluated… */
+  phoc_debug_hot (PHOC_LOG_HOT_LAYERS, "%d", evaluated++);
+  phoc_debug_hot (PHOC_LOG_HOT_INPUT, "%d", evaluated++);
+  g_assert_cmpint (evaluated, ==, 0);
+
+  /* …and nothing gets recorded */
+  dump = dump_ring ();
+  g_assert_cmpstr (dump, ==, "");
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/log/ring", test_phoc_log_ring);
+  g_test_add_func ("/phoc/log/disabled", test_phoc_log_disabled);
+
+  return g_test_run ();
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "output.h"
+#include "testlib.h"
+#include "testlib-layer-shell.h"
+
+#define GREEN 0xFF00FF00
+#define RED   0xFFFF0000
+
+#define PANEL_HEIGHT 50
+
+
+static PhocOutput *
+get_output (PhocServer *server)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output;
+
+  g_assert_cmpint (wl_list_length (&desktop->outputs), ==, 1);
+  output = wl_container_of (desktop->outputs.next, output, link);
+
+  return output;
+}
+
+
+static gboolean
+check_map_point (PhocServer *server, gpointer data)
+{
+  PhocOutput *output = get_output (server);
+  struct wlr_box *box = &output->layout_box;
+  double lx, ly;
+
+  /* Nothing to map when not zoomed in */
+  lx = box->x;
+  ly = box->y;
+  phoc_output_magnifier_map_point (output, &lx, &ly);
+  g_assert_cmpfloat_with_epsilon (lx, box->x, 0.001);
+  g_assert_cmpfloat_with_epsilon (ly, box->y, 0.001);
+
+  /* Zoom into the bottom right quarter */
+  phoc_output_set_magnifier_zoom (output, 2.0);
+  phoc_output_set_magnifier_focus (output, box->x + box->width, box->y + box->height);
+
+  lx = box->x;
+  ly = box->y;
+  phoc_output_magnifier_map_point (output, &lx, &ly);
+  g_assert_cmpfloat_with_epsilon (lx, box->x + box->width / 2.0, 0.001);
+  g_assert_cmpfloat_with_epsilon (ly, box->y + box->height / 2.0, 0.001);
+
+  lx = box->x + box->width;
+  ly = box->y + box->height;
+  phoc_output_magnifier_map_point (output, &lx, &ly);
+  g_assert_cmpfloat_with_epsilon (lx, box->x + box->width, 0.001);
+  g_assert_cmpfloat_with_epsilon (ly, box->y + box->height, 0.001);
+
+  phoc_output_set_magnifier_zoom (output, 1.0);
+
+  return TRUE;
+}
+
+
+static gboolean
+view_at_output_origin (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output = get_output (server);
+  double zoom = *(double *)data;
+  struct wlr_surface *surface;
+  PhocView *view = NULL;
+  double sx, sy;
+
+  phoc_output_set_magnifier_zoom (output, zoom);
+  phoc_output_set_magnifier_focus (output,
+                                   output->layout_box.x + output->layout_box.width,
+                                   output->layout_box.y + output->layout_box.height);
+
+  surface = phoc_desktop_wlr_surface_at (desktop,
+                                         output->layout_box.x,
+                                         output->layout_box.y,
+                                         &sx, &sy, &view);
+  g_assert_nonnull (surface);
+
+  phoc_output_set_magnifier_zoom (output, 1.0);
+
+  return view != NULL;
+}
+
+
+static gboolean
+test_client_magnifier_input (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *xs;
+  PhocTestLayerSurface *panel;
+  double zoom;
+
+  g_assert_true (phoc_test_client_invoke_server (globals, check_map_point, NULL));
+
+  xs = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "magnified", GREEN);
+  g_assert_nonnull (xs);
+  panel = phoc_test_layer_surface_new (globals, 0, PANEL_HEIGHT, RED,
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
+                                       PANEL_HEIGHT);
+  g_assert_nonnull (panel);
+
+  /* The panel covers the output's top left corner */
+  zoom = 1.0;
+  g_assert_false (phoc_test_client_invoke_server (globals, view_at_output_origin, &zoom));
+
+  /* Zoomed in the corner shows the toplevel so input must go there */
+  zoom = 2.0;
+  g_assert_true (phoc_test_client_invoke_server (globals, view_at_output_origin, &zoom));
+
+  phoc_test_layer_surface_free (panel);
+  phoc_test_xdg_toplevel_free (xs);
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_magnifier_server_prepare (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+
+  g_assert_nonnull (desktop);
+  phoc_desktop_set_auto_maximize (desktop, TRUE);
+  return TRUE;
+}
+
+
+static void
+test_magnifier_input (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_magnifier_server_prepare,
+   .client_run     = test_client_magnifier_input,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/magnifier/input", test_magnifier_input);
+
+  return g_test_run ();
+}
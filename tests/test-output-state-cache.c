@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "output-state-cache.h"
+
+#include <glib/gstdio.h>
+
+typedef struct {
+  char                  *dir;
+  char                  *path;
+  struct wlr_output      output;
+  struct wlr_output_mode modes[2];
+} CacheFixture;
+
+
+static void
+cache_fixture_setup (CacheFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GError) err = NULL;
+
+  fixture->dir = g_dir_make_tmp ("phoc-output-state-cache-XXXXXX", &err);
+  g_assert_no_error (err);
+  fixture->path = g_build_filename (fixture->dir, "outputs.ini", NULL);
+
+  /* Only the bits of a monitor the cache looks at */
+  fixture->output.make = "Purism";
+  fixture->output.model = "Monitor";
+  fixture->output.serial = "0001";
+  wl_list_init (&fixture->output.modes);
+  fixture->modes[0] = (struct wlr_output_mode) { .width = 1920, .height = 1080, .refresh = 60000 };
+  fixture->modes[1] = (struct wlr_output_mode) { .width = 1280, .height = 720, .refresh = 60000 };
+  for (guint i = 0; i < G_N_ELEMENTS (fixture->modes); i++)
+    wl_list_insert (fixture->output.modes.prev, &fixture->modes[i].link);
+
+  fixture->output.enabled = true;
+  fixture->output.current_mode = &fixture->modes[0];
+  fixture->output.scale = 1.5;
+  fixture->output.transform = WL_OUTPUT_TRANSFORM_NORMAL;
+}
+
+
+static void
+cache_fixture_teardown (CacheFixture *fixture, gconstpointer unused)
+{
+  g_unlink (fixture->path);
+  g_rmdir (fixture->dir);
+  g_free (fixture->path);
+  g_free (fixture->dir);
+}
+
+
+static void
+test_phoc_output_state_cache_identity (CacheFixture *fixture, gconstpointer unused)
+{
+  g_autofree char *identity = NULL;
+
+  identity = phoc_output_state_cache_get_identity (&fixture->output);
+  g_assert_cmpstr (identity, ==, "Purism|Monitor|0001");
+  g_clear_pointer (&identity, g_free);
+
+  fixture->output.serial = NULL;
+  identity = phoc_output_state_cache_get_identity (&fixture->output);
+  g_assert_cmpstr (identity, ==, "Purism|Monitor|");
+  g_clear_pointer (&identity, g_free);
+
+  /* Nothing to tell monitors apart */
+  fixture->output.make = NULL;
+  fixture->output.model = NULL;
+  identity = phoc_output_state_cache_get_identity (&fixture->output);
+  g_assert_null (identity);
+}
+
+
+static void
+test_phoc_output_state_cache_restore (CacheFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (PhocOutputStateCache) cache = NULL;
+  struct wlr_output_state pending;
+  const char *identity = "Purism|Monitor|0001";
+
+  cache = phoc_output_state_cache_new (fixture->path);
+
+  wlr_output_state_init (&pending);
+  g_assert_false (phoc_output_state_cache_restore (cache, identity, &fixture->output, &pending));
+  g_assert_cmpint (pending.committed, ==, 0);
+
+  phoc_output_state_cache_store (cache, identity, &fixture->output);
+  g_clear_pointer (&cache, phoc_output_state_cache_free);
+  g_assert_true (g_file_test (fixture->path, G_FILE_TEST_EXISTS));
+
+  /* Restored from the file */
+  cache = phoc_output_state_cache_new (fixture->path);
+  g_assert_true (phoc_output_state_cache_restore (cache, identity, &fixture->output, &pending));
+  g_assert_true (pending.mode == &fixture->modes[0]);
+  g_assert_cmpfloat (pending.scale, ==, 1.5);
+  g_assert_cmpint (pending.transform, ==, WL_OUTPUT_TRANSFORM_NORMAL);
+  wlr_output_state_finish (&pending);
+
+  /* Other monitors aren't affected */
+  wlr_output_state_init (&pending);
+  g_assert_false (phoc_output_state_cache_restore (cache, "Purism|Monitor|0002",
+                                                   &fixture->output, &pending));
+  wlr_output_state_finish (&pending);
+}
+
+
+static void
+test_phoc_output_state_cache_update (CacheFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (PhocOutputStateCache) cache = NULL;
+  struct wlr_output_state pending;
+  const char *identity = "Purism|Monitor|0001";
+
+  cache = phoc_output_state_cache_new (fixture->path);
+  phoc_output_state_cache_store (cache, identity, &fixture->output);
+
+  /* Rotation and mode changes replace the cached state */
+  fixture->output.current_mode = &fixture->modes[1];
+  fixture->output.transform = WL_OUTPUT_TRANSFORM_90;
+  phoc_output_state_cache_store (cache, identity, &fixture->output);
+
+  wlr_output_state_init (&pending);
+  g_assert_true (phoc_output_state_cache_restore (cache, identity, &fixture->output, &pending));
+  g_assert_true (pending.mode == &fixture->modes[1]);
+  g_assert_cmpint (pending.transform, ==, WL_OUTPUT_TRANSFORM_90);
+  wlr_output_state_finish (&pending);
+
+  /* The cached mode went away */
+  wl_list_remove (&fixture->modes[1].link);
+  wlr_output_state_init (&pending);
+  g_assert_false (phoc_output_state_cache_restore (cache, identity, &fixture->output, &pending));
+  wlr_output_state_finish (&pending);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/phoc/output-state-cache/identity", CacheFixture, NULL,
+              cache_fixture_setup, test_phoc_output_state_cache_identity, cache_fixture_teardown);
+  g_test_add ("/phoc/output-state-cache/restore", CacheFixture, NULL,
+              cache_fixture_setup, test_phoc_output_state_cache_restore, cache_fixture_teardown);
+  g_test_add ("/phoc/output-state-cache/update", CacheFixture, NULL,
+              cache_fixture_setup, test_phoc_output_state_cache_update, cache_fixture_teardown);
+
+  return g_test_run ();
+}
@@ -7,6 +7,8 @@
 #include "testlib.h"
 #include "gtk-shell-client-protocol.h"
 
+#include <unistd.h>
+
 typedef struct _PhocTestThumbnail
 {
   char* title;
@@ -293,6 +295,208 @@ test_phosh_private_startup_tracker_simple (void)
   phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
 }
 
+
+typedef struct {
+  guint    n_views;
+  gboolean done;
+  char    *app_id;
+  guint    commit_rate;
+  guint    full_damage_percent;
+  guint    buffer_width, buffer_height;
+} PhocTestCommitStats;
+
+
+static void
+commit_stats_handle_view (void                              *data,
+                          struct phosh_private_commit_stats *commit_stats,
+                          const char                        *app_id,
+                          int32_t                            pid,
+                          uint32_t                           commit_rate,
+                          uint32_t                           damage_per_commit,
+                          uint32_t                           full_damage_percent,
+                          uint32_t                           buffer_width,
+                          uint32_t                           buffer_height)
+{
+  PhocTestCommitStats *stats = data;
+
+  stats->n_views++;
+  g_free (stats->app_id);
+  stats->app_id = g_strdup (app_id);
+  stats->commit_rate = commit_rate;
+  stats->full_damage_percent = full_damage_percent;
+  stats->buffer_width = buffer_width;
+  stats->buffer_height = buffer_height;
+  g_assert_cmpint (pid, ==, getpid ());
+}
+
+
+static void
+commit_stats_handle_done (void *data, struct phosh_private_commit_stats *commit_stats)
+{
+  PhocTestCommitStats *stats = data;
+
+  stats->done = TRUE;
+}
+
+
+static const struct phosh_private_commit_stats_listener commit_stats_listener = {
+  .view = commit_stats_handle_view,
+  .done = commit_stats_handle_done,
+};
+
+
+static gboolean
+test_client_phosh_private_commit_stats_simple (PhocTestClientGlobals *globals, gpointer unused)
+{
+  struct phosh_private_commit_stats *commit_stats;
+  PhocTestXdgToplevelSurface *toplevel;
+  PhocTestCommitStats stats = { 0 };
+
+  g_assert_cmpint (phosh_private_get_version (globals->phosh), >=, 8);
+  commit_stats = phosh_private_get_commit_stats (globals->phosh);
+  phosh_private_commit_stats_add_listener (commit_stats, &commit_stats_listener, &stats);
+
+  phosh_private_commit_stats_list (commit_stats);
+  wl_display_roundtrip (globals->display);
+  g_assert_true (stats.done);
+  g_assert_cmpint (stats.n_views, ==, 0);
+
+  toplevel = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "commit-stats", 0xFF00FF00);
+
+  stats.done = FALSE;
+  phosh_private_commit_stats_list (commit_stats);
+  wl_display_roundtrip (globals->display);
+  g_assert_true (stats.done);
+  g_assert_cmpint (stats.n_views, ==, 1);
+  /* The toplevel attached a fully damaged buffer */
+  g_assert_cmpint (stats.full_damage_percent, >, 0);
+  g_assert_cmpint (stats.buffer_width, ==, toplevel->buffer.width);
+  g_assert_cmpint (stats.buffer_height, ==, toplevel->buffer.height);
+
+  phosh_private_commit_stats_destroy (commit_stats);
+  phoc_test_xdg_toplevel_free (toplevel);
+  g_free (stats.app_id);
+
+  return TRUE;
+}
+
+static void
+test_phosh_private_commit_stats_simple (void)
+{
+  PhocTestClientIface iface = {
+   .client_run = test_client_phosh_private_commit_stats_simple,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+static gboolean
+test_client_phosh_private_overview_simple (PhocTestClientGlobals *globals, gpointer unused)
+{
+  struct phosh_private_overview *overview;
+  PhocTestXdgToplevelSurface *toplevel;
+
+  g_assert_cmpint (phosh_private_get_version (globals->phosh), >=, 9);
+  toplevel = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "overview", 0xFF00FF00);
+
+  overview = phosh_private_get_overview (globals->phosh, globals->output.output);
+  phosh_private_overview_place_view (overview, toplevel->foreign_toplevel->handle, 10, 10, 50, 100);
+  wl_display_roundtrip (globals->display);
+  /* Moving is fine */
+  phosh_private_overview_place_view (overview, toplevel->foreign_toplevel->handle, 20, 20, 50, 100);
+  wl_display_roundtrip (globals->display);
+  phosh_private_overview_remove_view (overview, toplevel->foreign_toplevel->handle);
+  /* Removing twice is fine */
+  phosh_private_overview_remove_view (overview, toplevel->foreign_toplevel->handle);
+  wl_display_roundtrip (globals->display);
+
+  /* Destroying the overview with a placed toplevel drops it */
+  phosh_private_overview_place_view (overview, toplevel->foreign_toplevel->handle, 0, 0, 50, 100);
+  phosh_private_overview_destroy (overview);
+  wl_display_roundtrip (globals->display);
+
+  /* The output can get a new overview once the old one is gone */
+  overview = phosh_private_get_overview (globals->phosh, globals->output.output);
+  wl_display_roundtrip (globals->display);
+  g_assert_cmpint (wl_display_get_error (globals->display), ==, 0);
+  phosh_private_overview_destroy (overview);
+
+  phoc_test_xdg_toplevel_free (toplevel);
+
+  return TRUE;
+}
+
+static void
+test_phosh_private_overview_simple (void)
+{
+  PhocTestClientIface iface = {
+   .client_run = test_client_phosh_private_overview_simple,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+static gboolean
+test_client_phosh_private_commit_stats_rate (PhocTestClientGlobals *globals, gpointer unused)
+{
+  struct phosh_private_commit_stats *commit_stats;
+  PhocTestXdgToplevelSurface *toplevel;
+  PhocTestCommitStats stats = { 0 };
+  const guint n_commits = 20;
+
+  commit_stats = phosh_private_get_commit_stats (globals->phosh);
+  phosh_private_commit_stats_add_listener (commit_stats, &commit_stats_listener, &stats);
+
+  toplevel = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "commit-stats", 0xFF00FF00);
+
+  /* A burst of commits within the first interval */
+  for (guint i = 0; i < n_commits; i++)
+    wl_surface_commit (toplevel->wl_surface);
+  wl_display_roundtrip (globals->display);
+
+  /* The rate is only updated once an interval is over */
+  g_usleep (1.1 * G_USEC_PER_SEC);
+  wl_surface_commit (toplevel->wl_surface);
+  wl_display_roundtrip (globals->display);
+
+  phosh_private_commit_stats_list (commit_stats);
+  wl_display_roundtrip (globals->display);
+  g_assert_true (stats.done);
+  g_assert_cmpint (stats.n_views, ==, 1);
+  /* The burst plus the toplevel's initial commits spread over more than a second */
+  g_assert_cmpint (stats.commit_rate, >=, n_commits / 2);
+  g_assert_cmpint (stats.commit_rate, <=, n_commits + 4);
+
+  /* A client that stopped committing has no rate */
+  g_usleep (2.1 * G_USEC_PER_SEC);
+  stats.done = FALSE;
+  phosh_private_commit_stats_list (commit_stats);
+  wl_display_roundtrip (globals->display);
+  g_assert_true (stats.done);
+  g_assert_cmpint (stats.commit_rate, ==, 0);
+
+  phosh_private_commit_stats_destroy (commit_stats);
+  phoc_test_xdg_toplevel_free (toplevel);
+  g_free (stats.app_id);
+
+  return TRUE;
+}
+
+static void
+test_phosh_private_commit_stats_rate (void)
+{
+  PhocTestClientIface iface = {
+   .client_run = test_client_phosh_private_commit_stats_rate,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -301,5 +505,8 @@ main (gint argc, gchar *argv[])
   PHOC_TEST_ADD ("/phoc/phosh/thumbnail/simple", test_phosh_private_thumbnail_simple);
   PHOC_TEST_ADD ("/phoc/phosh/kbevents/simple", test_phosh_private_kbevents_simple);
   PHOC_TEST_ADD ("/phoc/phosh/startup-tracker/simple", test_phosh_private_startup_tracker_simple);
+  PHOC_TEST_ADD ("/phoc/phosh/commit-stats/simple", test_phosh_private_commit_stats_simple);
+  PHOC_TEST_ADD ("/phoc/phosh/commit-stats/rate", test_phosh_private_commit_stats_rate);
+  PHOC_TEST_ADD ("/phoc/phosh/overview/simple", test_phosh_private_overview_simple);
   return g_test_run ();
 }
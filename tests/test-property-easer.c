@@ -194,6 +194,71 @@ test_phoc_property_easer_props_variant (void)
 }
 
 
+static void
+on_notify_count (guint *count)
+{
+  (*count)++;
+}
+
+
+static void
+test_phoc_property_easer_unchanged (void)
+{
+  g_autoptr (PhocTestObj) obj = phoc_test_obj_new ();
+  g_autoptr (PhocPropertyEaser) easer = phoc_property_easer_new (G_OBJECT (obj));
+  guint count = 0;
+  int cmp_i;
+
+  phoc_property_easer_set_props (easer, "prop-i", 0, 2, NULL);
+  g_signal_connect_swapped (obj, "notify::prop-i", G_CALLBACK (on_notify_count), &count);
+
+  /* Values that round to the same int don't set the property again */
+  phoc_property_easer_set_progress (easer, 0.1);
+  phoc_property_easer_set_progress (easer, 0.2);
+  phoc_property_easer_set_progress (easer, 0.3);
+  g_assert_cmpint (count, ==, 0);
+
+  phoc_property_easer_set_progress (easer, 0.6);
+  g_assert_cmpint (count, ==, 1);
+
+  /* The ends of the interval are always applied */
+  g_object_set (obj, "prop-i", 5, NULL);
+  count = 0;
+  phoc_property_easer_set_progress (easer, 1.0);
+  g_object_get (obj, "prop-i", &cmp_i, NULL);
+  g_assert_cmpint (cmp_i, ==, 2);
+  g_assert_cmpint (count, ==, 1);
+}
+
+
+static void
+test_phoc_property_easer_reset (void)
+{
+  g_autoptr (PhocTestObj) obj1 = phoc_test_obj_new ();
+  g_autoptr (PhocTestObj) obj2 = phoc_test_obj_new ();
+  g_autoptr (PhocPropertyEaser) easer = phoc_property_easer_new (G_OBJECT (obj1));
+  int cmp_i;
+  float cmp_f;
+
+  phoc_property_easer_set_easing (easer, PHOC_EASING_EASE_IN_CUBIC);
+  phoc_property_easer_set_props (easer, "prop-i", 0, 10, NULL);
+  phoc_property_easer_set_progress (easer, 1.0);
+
+  phoc_property_easer_reset (easer, G_OBJECT (obj2));
+  g_assert_cmpint (phoc_property_easer_get_easing (easer), ==, PHOC_EASING_NONE);
+
+  /* Only the new target's properties are eased */
+  phoc_property_easer_set_props (easer, "prop-f", 0.0, 100.0, NULL);
+  phoc_property_easer_set_progress (easer, 0.5);
+  g_object_get (obj2, "prop-i", &cmp_i, "prop-f", &cmp_f, NULL);
+  g_assert_cmpint (cmp_i, ==, 0);
+  g_assert_cmpfloat_with_epsilon (cmp_f, 50.0, FLT_EPSILON);
+
+  g_object_get (obj1, "prop-i", &cmp_i, NULL);
+  g_assert_cmpint (cmp_i, ==, 10);
+}
+
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -201,6 +266,8 @@ main (gint argc, gchar *argv[])
 
   g_test_add_func("/phoc/propety-easer/va-list", test_phoc_property_easer_props_va_list);
   g_test_add_func("/phoc/propety-easer/variant", test_phoc_property_easer_props_variant);
+  g_test_add_func("/phoc/propety-easer/unchanged", test_phoc_property_easer_unchanged);
+  g_test_add_func("/phoc/propety-easer/reset", test_phoc_property_easer_reset);
 
   return g_test_run();
 }
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "raster-pool.h"
+
+#include <wlr/render/pixman.h>
+
+typedef struct {
+  GThread *thread;
+} DrawData;
+
+typedef struct {
+  struct wlr_renderer *wlr_renderer;
+  PhocRasterPool      *pool;
+  struct wlr_texture  *texture;
+  GError              *err;
+  gboolean             done;
+} PoolFixture;
+
+
+static void
+pool_fixture_setup (PoolFixture *fixture, gconstpointer unused)
+{
+  fixture->wlr_renderer = wlr_pixman_renderer_create ();
+  g_assert_nonnull (fixture->wlr_renderer);
+  fixture->pool = phoc_raster_pool_new (fixture->wlr_renderer);
+}
+
+
+static void
+pool_fixture_teardown (PoolFixture *fixture, gconstpointer unused)
+{
+  g_clear_pointer (&fixture->texture, wlr_texture_destroy);
+  g_clear_error (&fixture->err);
+  g_clear_object (&fixture->pool);
+  g_clear_pointer (&fixture->wlr_renderer, wlr_renderer_destroy);
+}
+
+
+static void
+draw_fill (cairo_t *cr, int width, int height, gpointer data)
+{
+  DrawData *draw_data = data;
+
+  draw_data->thread = g_thread_self ();
+  cairo_set_source_rgba (cr, 1.0, 0.0, 0.0, 1.0);
+  cairo_paint (cr);
+}
+
+
+static void
+on_drawn (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  PoolFixture *fixture = user_data;
+
+  fixture->texture = phoc_raster_pool_draw_finish (PHOC_RASTER_POOL (source_object), res,
+                                                   &fixture->err);
+  fixture->done = TRUE;
+}
+
+
+static void
+wait_for_drawn (PoolFixture *fixture)
+{
+  while (!fixture->done)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+
+static void
+test_phoc_raster_pool_draw (PoolFixture *fixture, gconstpointer unused)
+{
+  DrawData draw_data = {};
+
+  phoc_raster_pool_draw_async (fixture->pool, 32, 16, draw_fill, &draw_data, NULL,
+                               NULL, on_drawn, fixture);
+  wait_for_drawn (fixture);
+
+  g_assert_no_error (fixture->err);
+  g_assert_nonnull (fixture->texture);
+  g_assert_cmpint (fixture->texture->width, ==, 32);
+  g_assert_cmpint (fixture->texture->height, ==, 16);
+
+  /* Drawn off the main thread */
+  g_assert_nonnull (draw_data.thread);
+  g_assert_true (draw_data.thread != g_thread_self ());
+}
+
+
+static void
+test_phoc_raster_pool_cancel (PoolFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GCancellable) cancellable = g_cancellable_new ();
+  DrawData draw_data = {};
+
+  g_cancellable_cancel (cancellable);
+  phoc_raster_pool_draw_async (fixture->pool, 32, 16, draw_fill, &draw_data, NULL,
+                               cancellable, on_drawn, fixture);
+  wait_for_drawn (fixture);
+
+  g_assert_error (fixture->err, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_null (fixture->texture);
+  /* Nothing got drawn */
+  g_assert_null (draw_data.thread);
+}
+
+
+static void
+test_phoc_raster_pool_error (PoolFixture *fixture, gconstpointer unused)
+{
+  DrawData draw_data = {};
+
+  /* Larger than cairo's image surfaces can be */
+  phoc_raster_pool_draw_async (fixture->pool, 40000, 1, draw_fill, &draw_data, NULL,
+                               NULL, on_drawn, fixture);
+  wait_for_drawn (fixture);
+
+  g_assert_error (fixture->err, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_assert_null (fixture->texture);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/phoc/raster-pool/draw", PoolFixture, NULL,
+              pool_fixture_setup, test_phoc_raster_pool_draw, pool_fixture_teardown);
+  g_test_add ("/phoc/raster-pool/cancel", PoolFixture, NULL,
+              pool_fixture_setup, test_phoc_raster_pool_cancel, pool_fixture_teardown);
+  g_test_add ("/phoc/raster-pool/error", PoolFixture, NULL,
+              pool_fixture_setup, test_phoc_raster_pool_error, pool_fixture_teardown);
+
+  return g_test_run ();
+}
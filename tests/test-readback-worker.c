@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "readback-worker.h"
+#include "render-private.h"
+
+#include <drm_fourcc.h>
+#include <GLES2/gl2.h>
+#include <wlr/backend/headless.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/drm_format_set.h>
+
+#define N_JOBS 8
+
+typedef struct {
+  struct wl_display  *wl_display;
+  struct wlr_backend *backend;
+  PhocRenderer       *renderer;
+  PhocReadbackWorker *worker;
+  struct wlr_buffer  *buffer;
+} ReadbackFixture;
+
+typedef struct {
+  guint n_done;
+  guint n_ok;
+  guint n_closed;
+  GBytes *pixels;
+} ReadbackResults;
+
+
+static void
+fixture_setup (ReadbackFixture *fixture, gconstpointer unused)
+{
+  struct wlr_drm_format_set formats = { 0 };
+  const struct wlr_drm_format *format;
+  g_autoptr (GError) err = NULL;
+
+  /* The worker needs EGL, the other tests run on pixman */
+  g_setenv ("WLR_RENDERER", "gles2", TRUE);
+
+  fixture->wl_display = wl_display_create ();
+  fixture->backend = wlr_headless_backend_create (fixture->wl_display);
+  fixture->renderer = phoc_renderer_new (fixture->backend, &err);
+  if (fixture->renderer == NULL) {
+    g_debug ("No EGL renderer: %s", err->message);
+    g_test_skip ("No EGL renderer");
+    return;
+  }
+
+  fixture->worker = phoc_readback_worker_new (phoc_renderer_get_egl (fixture->renderer));
+  if (fixture->worker == NULL) {
+    g_test_skip ("Threaded readback not supported");
+    return;
+  }
+
+  wlr_drm_format_set_add (&formats, DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_LINEAR);
+  format = wlr_drm_format_set_get (&formats, DRM_FORMAT_ARGB8888);
+  fixture->buffer = wlr_allocator_create_buffer (phoc_renderer_get_wlr_allocator (fixture->renderer),
+                                                 16, 16, format);
+  wlr_drm_format_set_finish (&formats);
+  if (fixture->buffer == NULL)
+    g_test_skip ("Can't allocate dmabufs");
+}
+
+
+static void
+fixture_teardown (ReadbackFixture *fixture, gconstpointer unused)
+{
+  g_clear_pointer (&fixture->buffer, wlr_buffer_drop);
+  g_clear_object (&fixture->worker);
+  g_clear_object (&fixture->renderer);
+  g_clear_pointer (&fixture->backend, wlr_backend_destroy);
+  g_clear_pointer (&fixture->wl_display, wl_display_destroy);
+}
+
+
+static void
+on_read_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  PhocReadbackWorker *worker = PHOC_READBACK_WORKER (source_object);
+  ReadbackResults *results = user_data;
+  g_autoptr (GBytes) pixels = NULL;
+  g_autoptr (GError) err = NULL;
+
+  pixels = phoc_readback_worker_read_finish (worker, res, &err);
+  if (pixels) {
+    g_assert_cmpuint (g_bytes_get_size (pixels), ==, 16 * 16 * 4);
+    g_clear_pointer (&results->pixels, g_bytes_unref);
+    results->pixels = g_steal_pointer (&pixels);
+    results->n_ok++;
+  } else {
+    g_assert_error (err, G_IO_ERROR, G_IO_ERROR_CLOSED);
+    results->n_closed++;
+  }
+  results->n_done++;
+}
+
+
+static void
+test_phoc_readback_worker_read (ReadbackFixture *fixture, gconstpointer unused)
+{
+  ReadbackResults results = { 0 };
+
+  if (fixture->buffer == NULL)
+    return;
+
+  phoc_readback_worker_read_async (fixture->worker, fixture->buffer, DRM_FORMAT_ARGB8888,
+                                   EGL_NO_SYNC_KHR, NULL, on_read_done, &results);
+  while (results.n_done < 1)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (results.n_ok, ==, 1);
+  g_clear_pointer (&results.pixels, g_bytes_unref);
+}
+
+
+static void
+fill_buffer (ReadbackFixture *fixture, const float color[4])
+{
+  struct wlr_renderer *renderer = phoc_renderer_get_wlr_renderer (fixture->renderer);
+  struct wlr_egl *egl = phoc_renderer_get_egl (fixture->renderer);
+
+  g_assert_true (wlr_renderer_begin_with_buffer (renderer, fixture->buffer));
+  wlr_renderer_clear (renderer, color);
+  wlr_renderer_end (renderer);
+
+  /* The worker reads from its own context */
+  g_assert_true (wlr_egl_make_current (egl));
+  glFinish ();
+  wlr_egl_unset_current (egl);
+}
+
+
+static void
+read_first_pixel (ReadbackFixture *fixture, uint32_t format, guint8 pixel[4])
+{
+  ReadbackResults results = { 0 };
+
+  phoc_readback_worker_read_async (fixture->worker, fixture->buffer, format, EGL_NO_SYNC_KHR,
+                                   NULL, on_read_done, &results);
+  while (results.n_done < 1)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (results.n_ok, ==, 1);
+  memcpy (pixel, g_bytes_get_data (results.pixels, NULL), 4);
+  g_bytes_unref (results.pixels);
+}
+
+
+static void
+test_phoc_readback_worker_format (ReadbackFixture *fixture, gconstpointer unused)
+{
+  guint8 pixel[4];
+
+  if (fixture->buffer == NULL)
+    return;
+
+  fill_buffer (fixture, (float[]){ 1.0, 0.0, 0.0, 1.0 });
+
+  /* Converted from RGBA if the driver can't read BGRA */
+  read_first_pixel (fixture, DRM_FORMAT_ARGB8888, pixel);
+  g_assert_cmphex (pixel[0], ==, 0x00);
+  g_assert_cmphex (pixel[1], ==, 0x00);
+  g_assert_cmphex (pixel[2], ==, 0xff);
+  g_assert_cmphex (pixel[3], ==, 0xff);
+
+  /* Read as is */
+  read_first_pixel (fixture, DRM_FORMAT_ABGR8888, pixel);
+  g_assert_cmphex (pixel[0], ==, 0xff);
+  g_assert_cmphex (pixel[1], ==, 0x00);
+  g_assert_cmphex (pixel[2], ==, 0x00);
+  g_assert_cmphex (pixel[3], ==, 0xff);
+}
+
+
+static void
+test_phoc_readback_worker_shutdown (ReadbackFixture *fixture, gconstpointer unused)
+{
+  ReadbackResults results = { 0 };
+
+  if (fixture->buffer == NULL)
+    return;
+
+  for (int i = 0; i < N_JOBS; i++) {
+    phoc_readback_worker_read_async (fixture->worker, fixture->buffer, DRM_FORMAT_ARGB8888,
+                                     EGL_NO_SYNC_KHR, NULL, on_read_done, &results);
+  }
+
+  /* Queued jobs fail, the one in progress finishes */
+  phoc_readback_worker_shutdown (fixture->worker);
+  while (results.n_done < N_JOBS)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpuint (results.n_ok + results.n_closed, ==, N_JOBS);
+  g_clear_pointer (&results.pixels, g_bytes_unref);
+
+  /* Later jobs fail right away */
+  results = (ReadbackResults) { 0 };
+  phoc_readback_worker_read_async (fixture->worker, fixture->buffer, DRM_FORMAT_ARGB8888,
+                                   EGL_NO_SYNC_KHR, NULL, on_read_done, &results);
+  while (results.n_done < 1)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpuint (results.n_closed, ==, 1);
+
+  /* Shutting down again is a noop */
+  phoc_readback_worker_shutdown (fixture->worker);
+
+  /* The worker may outlive the renderer once shut down */
+  g_clear_pointer (&fixture->buffer, wlr_buffer_drop);
+  g_clear_object (&fixture->renderer);
+  g_clear_object (&fixture->worker);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/phoc/readback-worker/read", ReadbackFixture, NULL,
+              fixture_setup, test_phoc_readback_worker_read, fixture_teardown);
+  g_test_add ("/phoc/readback-worker/format", ReadbackFixture, NULL,
+              fixture_setup, test_phoc_readback_worker_format, fixture_teardown);
+  g_test_add ("/phoc/readback-worker/shutdown", ReadbackFixture, NULL,
+              fixture_setup, test_phoc_readback_worker_shutdown, fixture_teardown);
+
+  return g_test_run ();
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "testlib.h"
+
+#include <wlr/render/wlr_texture.h>
+
+#define GREEN 0xFF00FF00
+#define BLUE  0xFF0000FF
+
+
+static guint32
+get_pixel (PhocTestBuffer *buffer, guint32 x, guint32 y)
+{
+  return *(guint32 *)(buffer->shm_data + y * buffer->stride + x * 4) & 0x00FFFFFF;
+}
+
+
+static gboolean
+get_scaled_texture_width (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocRenderer *renderer = phoc_server_get_renderer (server);
+  struct wlr_texture *texture;
+  PhocOutput *output;
+  PhocView *view;
+
+  g_assert_cmpint (wl_list_length (&desktop->outputs), ==, 1);
+  output = wl_container_of (desktop->outputs.next, output, link);
+  g_assert_cmpint (g_queue_get_length (phoc_desktop_get_views (desktop)), ==, 1);
+  view = g_queue_peek_head (phoc_desktop_get_views (desktop));
+
+  texture = phoc_renderer_get_scaled_texture (renderer, view->wlr_surface, output);
+  *(guint32 *)data = texture ? texture->width : 0;
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_scaled_texture (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *xs;
+  PhocTestBuffer *screenshot;
+  guint32 width, height, scaled_width;
+
+  xs = phoc_test_xdg_toplevel_new (globals, 0, 0, "scaled");
+  g_assert_nonnull (xs);
+
+  /* Twice the output's size so the view gets scaled down to fit */
+  width = globals->output.width * 2;
+  height = globals->output.height * 2;
+  phoc_test_client_create_shm_buffer (globals, &xs->buffer, width, height,
+                                      WL_SHM_FORMAT_XRGB8888);
+  for (int i = 0; i < width * height * 4; i += 4)
+    *(guint32 *)(xs->buffer.shm_data + i) = GREEN;
+  wl_surface_attach (xs->wl_surface, xs->buffer.wl_buffer, 0, 0);
+  wl_surface_damage (xs->wl_surface, 0, 0, width, height);
+  wl_surface_commit (xs->wl_surface);
+  wl_display_roundtrip (globals->display);
+
+  /* The first frame samples the full resolution buffer and schedules the copy… */
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, screenshot->width / 2, screenshot->height / 2),
+                   ==, GREEN & 0x00FFFFFF);
+
+  /* …which is then used */
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, screenshot->width / 2, screenshot->height / 2),
+                   ==, GREEN & 0x00FFFFFF);
+  phoc_test_client_invoke_server (globals, get_scaled_texture_width, &scaled_width);
+  g_assert_cmpuint (scaled_width, >, 0);
+  g_assert_cmpuint (scaled_width, <=, globals->output.width);
+
+  /* Not scaled down anymore so the copy is dropped */
+  phoc_test_xdg_update_buffer (globals, xs, BLUE);
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, 0, 0), ==, BLUE & 0x00FFFFFF);
+  phoc_test_xdg_update_buffer (globals, xs, GREEN);
+  phoc_test_client_invoke_server (globals, get_scaled_texture_width, &scaled_width);
+  g_assert_cmpuint (scaled_width, ==, 0);
+
+  phoc_test_xdg_toplevel_free (xs);
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_scaled_texture_server_prepare (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+
+  g_assert_nonnull (desktop);
+  phoc_desktop_set_auto_maximize (desktop, TRUE);
+  phoc_desktop_set_scale_to_fit (desktop, TRUE);
+  return TRUE;
+}
+
+
+static void
+test_scaled_texture (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_scaled_texture_server_prepare,
+   .client_run     = test_client_scaled_texture,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+   .config         = phoc_config_new_from_data ("[core]\n"
+                                                "xwayland = false\n"
+                                                "scaled-view-cache = true\n"),
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/scaled-texture/scaled-view", test_scaled_texture);
+
+  return g_test_run ();
+}
@@ -48,6 +48,35 @@ test_phoc_server_setup_args (void)
   g_assert_cmpstr (phoc_server_get_session_exec (server), ==, "/bin/bash");
 }
 
+static void
+test_phoc_server_startup_phases (void)
+{
+  PhocConfig *config = phoc_config_new_from_file (TEST_PHOC_INI);
+  g_autoptr(PhocServer) server = phoc_server_get_default ();
+  g_autoptr(GVariant) phases = NULL;
+  const char *expected[] = { "backend", "renderer", "desktop", "input", "backend-started", "setup" };
+  gint64 last_us = -1;
+
+  g_assert_true (phoc_server_setup(server, config, NULL, NULL,
+                                   PHOC_SERVER_FLAG_NONE,
+                                   PHOC_SERVER_DEBUG_FLAG_NONE));
+
+  /* Phases are only recorded once */
+  phoc_server_mark_startup_phase (server, "setup");
+
+  phases = g_variant_ref_sink (phoc_server_startup_phases_to_variant (server));
+  g_assert_cmpuint (g_variant_n_children (phases), ==, G_N_ELEMENTS (expected));
+  for (int i = 0; i < G_N_ELEMENTS (expected); i++) {
+    const char *name;
+    gint64 us;
+
+    g_variant_get_child (phases, i, "(&sx)", &name, &us);
+    g_assert_cmpstr (name, ==, expected[i]);
+    g_assert_cmpint (us, >=, last_us);
+    last_us = us;
+  }
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -56,6 +85,7 @@ main (gint argc, gchar *argv[])
   g_test_add_func("/phoc/server/get_default", test_phoc_server_get_default);
   g_test_add_func("/phoc/server/setup", test_phoc_server_setup);
   g_test_add_func("/phoc/server/setup-args", test_phoc_server_setup_args);
+  g_test_add_func("/phoc/server/startup-phases", test_phoc_server_startup_phases);
 
   return g_test_run();
 }
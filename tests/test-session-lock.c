@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "seat.h"
+#include "session-lock.h"
+#include "testlib.h"
+
+#include "ext-session-lock-v1-client-protocol.h"
+
+#define GREEN 0xFF00FF00
+#define BLACK 0xFF000000
+
+/* A second connection that locks the session */
+typedef struct {
+  struct wl_display                  *display;
+  struct wl_registry                 *registry;
+  struct ext_session_lock_manager_v1 *manager;
+  struct ext_session_lock_v1         *lock;
+  gboolean                            locked;
+  gboolean                            finished;
+} LockClient;
+
+
+static guint32
+get_pixel (PhocTestBuffer *buffer, guint32 x, guint32 y)
+{
+  return *(guint32 *)(buffer->shm_data + y * buffer->stride + x * 4) & 0x00FFFFFF;
+}
+
+
+static void
+lock_handle_locked (void *data, struct ext_session_lock_v1 *lock)
+{
+  LockClient *client = data;
+
+  client->locked = TRUE;
+}
+
+
+static void
+lock_handle_finished (void *data, struct ext_session_lock_v1 *lock)
+{
+  LockClient *client = data;
+
+  client->finished = TRUE;
+}
+
+
+static const struct ext_session_lock_v1_listener lock_listener = {
+  .locked = lock_handle_locked,
+  .finished = lock_handle_finished,
+};
+
+
+static void
+registry_handle_global (void               *data,
+                        struct wl_registry *registry,
+                        uint32_t            name,
+                        const char         *interface,
+                        uint32_t            version)
+{
+  LockClient *client = data;
+
+  if (g_str_equal (interface, ext_session_lock_manager_v1_interface.name)) {
+    client->manager = wl_registry_bind (registry, name,
+                                        &ext_session_lock_manager_v1_interface, 1);
+  }
+}
+
+
+static void
+registry_handle_global_remove (void *data, struct wl_registry *registry, uint32_t name)
+{
+}
+
+
+static const struct wl_registry_listener registry_listener = {
+  .global = registry_handle_global,
+  .global_remove = registry_handle_global_remove,
+};
+
+
+static LockClient *
+lock_client_new (void)
+{
+  LockClient *client = g_new0 (LockClient, 1);
+
+  client->display = wl_display_connect (NULL);
+  g_assert_nonnull (client->display);
+  client->registry = wl_display_get_registry (client->display);
+  wl_registry_add_listener (client->registry, &registry_listener, client);
+  wl_display_roundtrip (client->display);
+  g_assert_nonnull (client->manager);
+
+  client->lock = ext_session_lock_manager_v1_lock (client->manager);
+  ext_session_lock_v1_add_listener (client->lock, &lock_listener, client);
+  wl_display_roundtrip (client->display);
+
+  return client;
+}
+
+/* Goes away without unlocking if the lock is still around */
+static void
+lock_client_free (LockClient *client)
+{
+  g_clear_pointer ((struct wl_proxy **)&client->lock, wl_proxy_destroy);
+  g_clear_pointer (&client->manager, ext_session_lock_manager_v1_destroy);
+  g_clear_pointer (&client->registry, wl_registry_destroy);
+  g_clear_pointer (&client->display, wl_display_disconnect);
+  g_free (client);
+}
+
+
+static void
+frame_handle_done (void *data, struct wl_callback *callback, uint32_t time)
+{
+  gboolean *done = data;
+
+  *done = TRUE;
+  wl_callback_destroy (callback);
+}
+
+
+static const struct wl_callback_listener frame_listener = {
+  .done = frame_handle_done,
+};
+
+
+static gboolean
+is_locked (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+
+  return phoc_session_lock_is_locked (phoc_desktop_get_session_lock (desktop));
+}
+
+
+static gboolean
+has_single_client (PhocServer *server, gpointer data)
+{
+  return wl_list_length (wl_display_get_client_list (phoc_server_get_wl_display (server))) == 1;
+}
+
+
+static gboolean
+view_gets_no_input (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocSessionLock *session_lock = phoc_desktop_get_session_lock (desktop);
+  PhocSeat *seat = phoc_server_get_last_active_seat (server);
+  PhocView *view = g_queue_peek_head (phoc_desktop_get_views (desktop));
+  struct wl_client *client = wl_resource_get_client (view->wlr_surface->resource);
+
+  g_assert_false (phoc_session_lock_allow_client (session_lock, client));
+  g_assert_false (phoc_seat_allow_input (seat, view->wlr_surface->resource));
+  g_assert_true (seat->seat->keyboard_state.focused_surface != view->wlr_surface);
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_session_lock (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *xs;
+  PhocTestBuffer *screenshot;
+  LockClient *lock_client;
+  struct wl_callback *callback;
+  gboolean done = FALSE;
+
+  xs = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "locked", GREEN);
+  g_assert_nonnull (xs);
+
+  lock_client = lock_client_new ();
+  g_assert_true (phoc_test_client_invoke_server (globals, is_locked, NULL));
+
+  /* Locked once the output presented a frame that hides the toplevel */
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, 0, 0), ==, BLACK & 0x00FFFFFF);
+  wl_display_roundtrip (lock_client->display);
+  g_assert_true (lock_client->locked);
+  g_assert_false (lock_client->finished);
+
+  /* No input… */
+  phoc_test_client_invoke_server (globals, view_gets_no_input, NULL);
+
+  /* …and no frame callbacks for anyone but the lock client */
+  callback = wl_surface_frame (xs->wl_surface);
+  wl_callback_add_listener (callback, &frame_listener, &done);
+  wl_surface_commit (xs->wl_surface);
+  phoc_test_client_capture_output (globals, &globals->output);
+  phoc_test_client_capture_output (globals, &globals->output);
+  wl_display_roundtrip (globals->display);
+  g_assert_false (done);
+
+  /* The lock client going away doesn't unlock… */
+  lock_client_free (lock_client);
+  while (!phoc_test_client_invoke_server (globals, has_single_client, NULL))
+    wl_display_roundtrip (globals->display);
+  g_assert_true (phoc_test_client_invoke_server (globals, is_locked, NULL));
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, 0, 0), ==, BLACK & 0x00FFFFFF);
+
+  /* …but a new one can take over and unlock */
+  lock_client = lock_client_new ();
+  g_assert_true (lock_client->locked);
+  ext_session_lock_v1_unlock_and_destroy (lock_client->lock);
+  lock_client->lock = NULL;
+  wl_display_roundtrip (lock_client->display);
+  g_assert_false (phoc_test_client_invoke_server (globals, is_locked, NULL));
+
+  /* Frame callbacks flow again */
+  phoc_test_client_capture_output (globals, &globals->output);
+  wl_display_roundtrip (globals->display);
+  g_assert_true (done);
+
+  lock_client_free (lock_client);
+  phoc_test_xdg_toplevel_free (xs);
+
+  return TRUE;
+}
+
+
+static void
+test_session_lock (void)
+{
+  PhocTestClientIface iface = {
+   .client_run     = test_client_session_lock,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/session-lock/lock", test_session_lock);
+
+  return g_test_run ();
+}
@@ -10,6 +10,8 @@
 
 #include "testlib.h"
 
+#include <drm_fourcc.h>
+
 
 static void
 test_phoc_config_defaults (void)
@@ -18,6 +20,24 @@ test_phoc_config_defaults (void)
 
   g_assert_true (config->xwayland);
   g_assert_true (config->xwayland_lazy);
+  g_assert_cmpuint (config->xwayland_idle_timeout, ==, PHOC_CONFIG_DEFAULT_XWAYLAND_IDLE_TIMEOUT);
+  g_assert_cmpfloat (config->damage_max_waste, ==, PHOC_CONFIG_DEFAULT_DAMAGE_MAX_WASTE);
+  g_assert_cmpuint (config->damage_max_rects, ==, PHOC_CONFIG_DEFAULT_DAMAGE_MAX_RECTS);
+  g_assert_cmpint (config->frame_deadline_margin_us, ==, 0);
+  g_assert_cmpint (config->touch_motion, ==, PHOC_TOUCH_MOTION_IMMEDIATE);
+  g_assert_cmpint (config->pointer_motion, ==, PHOC_POINTER_MOTION_IMMEDIATE);
+  g_assert_cmpuint (config->switch_debounce_ms, ==, PHOC_CONFIG_DEFAULT_SWITCH_DEBOUNCE);
+  g_assert_cmpuint (config->memory_warn_threshold, ==, 0);
+  g_assert_cmpuint (config->client_thumbnail_rate, ==, PHOC_CONFIG_DEFAULT_CLIENT_THUMBNAIL_RATE);
+  g_assert_cmpuint (config->client_subscriptions, ==, PHOC_CONFIG_DEFAULT_CLIENT_SUBSCRIPTIONS);
+  g_assert_cmpuint (config->client_thumbnail_memory, ==, PHOC_CONFIG_DEFAULT_CLIENT_THUMBNAIL_MEMORY);
+  g_assert_cmpint (config->sched_policy, ==, PHOC_SCHED_POLICY_OTHER);
+  g_assert_cmpuint (config->sched_priority, ==, PHOC_CONFIG_DEFAULT_SCHED_PRIORITY);
+  g_assert_false (config->sched_boost_animations);
+  g_assert_null (config->cpu_affinity);
+  g_assert_false (config->scaled_view_cache);
+  g_assert_false (config->layer_cache);
+  g_assert_cmpuint (config->view_cache_frames, ==, 0);
   g_assert_cmpint (g_slist_length (config->outputs), ==, 0);
   g_assert_null (config->config_path);
 }
@@ -43,6 +63,167 @@ test_phoc_config_output (void)
 }
 
 
+static void
+test_phoc_config_output_index (void)
+{
+  g_autoptr (PhocConfig) config = phoc_config_new_from_data (
+    "[output:X11-1]\n"
+    "scale = 2\n"
+    "[output:A Vendor%*%1234]\n"
+    "scale = 3\n");
+  g_autoptr (PhocConfig) reloaded = phoc_config_new_from_data (
+    "[output:X11-1]\n"
+    "scale = 2\n"
+    "[output:A Vendor%*%1234]\n"
+    "scale = 4\n");
+  PhocOutputConfig *oc, *other;
+
+  oc = g_hash_table_lookup (config->outputs_by_name, "X11-1");
+  g_assert_nonnull (oc);
+  g_assert_null (oc->vmm);
+
+  g_assert_cmpint (config->vmm_outputs->len, ==, 1);
+  oc = g_ptr_array_index (config->vmm_outputs, 0);
+  g_assert_cmpstr (oc->vmm[0], ==, "A Vendor");
+  g_assert_cmpstr (oc->vmm[1], ==, "*");
+  g_assert_cmpstr (oc->vmm[2], ==, "1234");
+
+  other = g_hash_table_lookup (reloaded->outputs_by_name, "A Vendor%*%1234");
+  g_assert_false (phoc_output_config_equal (oc, other));
+  g_assert_true (phoc_output_config_equal (g_hash_table_lookup (config->outputs_by_name, "X11-1"),
+                                           g_hash_table_lookup (reloaded->outputs_by_name, "X11-1")));
+  g_assert_true (phoc_output_config_equal (NULL, NULL));
+  g_assert_false (phoc_output_config_equal (oc, NULL));
+
+  phoc_config_take_outputs (config, reloaded);
+  oc = g_ptr_array_index (config->vmm_outputs, 0);
+  g_assert_cmpfloat (oc->scale, ==, 4);
+  oc = g_ptr_array_index (reloaded->vmm_outputs, 0);
+  g_assert_cmpfloat (oc->scale, ==, 3);
+}
+
+
+static void
+test_phoc_config_render_format (void)
+{
+  g_autoptr (PhocConfig) config = phoc_config_new_from_data (
+    "[output:X11-1]\n"
+    "render-format = rgb565\n"
+    "[output:X11-2]\n"
+    "scale = 2\n");
+  PhocOutputConfig *oc;
+
+  g_assert_cmpint (g_slist_length (config->outputs), ==, 2);
+  for (GSList *l = config->outputs; l; l = l->next) {
+    oc = l->data;
+
+    if (g_str_equal (oc->name, "X11-1"))
+      g_assert_cmpuint (oc->render_format, ==, DRM_FORMAT_RGB565);
+    else
+      g_assert_cmpuint (oc->render_format, ==, DRM_FORMAT_INVALID);
+  }
+}
+
+
+static void
+test_phoc_config_adaptive_sync (void)
+{
+  g_autoptr (PhocConfig) config = phoc_config_new_from_data (
+    "[output:X11-1]\n"
+    "adaptive-sync = auto\n"
+    "[output:X11-2]\n"
+    "adaptive-sync = on\n"
+    "[output:X11-3]\n"
+    "scale = 2\n");
+  PhocOutputConfig *oc;
+
+  g_assert_cmpint (g_slist_length (config->outputs), ==, 3);
+  for (GSList *l = config->outputs; l; l = l->next) {
+    oc = l->data;
+
+    if (g_str_equal (oc->name, "X11-1"))
+      g_assert_cmpint (oc->adaptive_sync, ==, PHOC_OUTPUT_ADAPTIVE_SYNC_AUTO);
+    else if (g_str_equal (oc->name, "X11-2"))
+      g_assert_cmpint (oc->adaptive_sync, ==, PHOC_OUTPUT_ADAPTIVE_SYNC_ON);
+    else
+      g_assert_cmpint (oc->adaptive_sync, ==, PHOC_OUTPUT_ADAPTIVE_SYNC_OFF);
+  }
+}
+
+
+static void
+test_phoc_config_buffer_count (void)
+{
+  g_autoptr (PhocConfig) config = NULL;
+  PhocOutputConfig *oc;
+
+  g_test_expect_message ("phoc-settings", G_LOG_LEVEL_CRITICAL, "Invalid buffer count '4'*");
+  config = phoc_config_new_from_data (
+    "[output:X11-1]\n"
+    "buffer-count = 3\n"
+    "[output:X11-2]\n"
+    "buffer-count = auto\n"
+    "[output:X11-3]\n"
+    "buffer-count = 4\n"
+    "[output:X11-4]\n"
+    "scale = 2\n");
+  g_test_assert_expected_messages ();
+
+  g_assert_cmpint (g_slist_length (config->outputs), ==, 4);
+  for (GSList *l = config->outputs; l; l = l->next) {
+    oc = l->data;
+
+    if (g_str_equal (oc->name, "X11-1"))
+      g_assert_cmpuint (oc->buffer_count, ==, 3);
+    else
+      g_assert_cmpuint (oc->buffer_count, ==, 0);
+  }
+}
+
+
+static void
+test_phoc_config_idle_refresh_rate (void)
+{
+  g_autoptr (PhocConfig) config = phoc_config_new_from_data (
+    "[output:X11-1]\n"
+    "idle-refresh-rate = 60\n"
+    "[output:X11-2]\n"
+    "idle-refresh-rate = 30.5\n"
+    "idle-frames = 0\n"
+    "[output:X11-3]\n"
+    "scale = 2\n");
+  PhocOutputConfig *oc;
+
+  g_assert_cmpint (g_slist_length (config->outputs), ==, 3);
+  for (GSList *l = config->outputs; l; l = l->next) {
+    oc = l->data;
+
+    if (g_str_equal (oc->name, "X11-1")) {
+      g_assert_cmpfloat (oc->idle_refresh_rate, ==, 60.0);
+      g_assert_cmpuint (oc->idle_frames, ==, 60);
+    } else if (g_str_equal (oc->name, "X11-2")) {
+      g_assert_cmpfloat (oc->idle_refresh_rate, ==, 30.5);
+      /* At least one frame */
+      g_assert_cmpuint (oc->idle_frames, ==, 1);
+    } else {
+      g_assert_cmpfloat (oc->idle_refresh_rate, ==, 0.0);
+      g_assert_cmpuint (oc->idle_frames, ==, 60);
+    }
+  }
+}
+
+
+static void
+test_phoc_config_view_cache_frames (void)
+{
+  g_autoptr (PhocConfig) config = phoc_config_new_from_data (
+    "[core]\n"
+    "view-cache-frames = 10\n");
+
+  g_assert_cmpuint (config->view_cache_frames, ==, 10);
+}
+
+
 static void
 test_phoc_config_modelines (void)
 {
@@ -67,6 +248,12 @@ main (gint argc, gchar *argv[])
 
   g_test_add_func ("/phoc/config/simple", test_phoc_config_defaults);
   g_test_add_func ("/phoc/config/output", test_phoc_config_output);
+  g_test_add_func ("/phoc/config/output-index", test_phoc_config_output_index);
+  g_test_add_func ("/phoc/config/render-format", test_phoc_config_render_format);
+  g_test_add_func ("/phoc/config/adaptive-sync", test_phoc_config_adaptive_sync);
+  g_test_add_func ("/phoc/config/buffer-count", test_phoc_config_buffer_count);
+  g_test_add_func ("/phoc/config/idle-refresh-rate", test_phoc_config_idle_refresh_rate);
+  g_test_add_func ("/phoc/config/view-cache-frames", test_phoc_config_view_cache_frames);
   g_test_add_func ("/phoc/config/modelines", test_phoc_config_modelines);
 
   return g_test_run();
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "stall-watchdog.h"
+
+
+static void
+test_phoc_stall_watchdog_dispatch (void)
+{
+  struct wl_display *wl_display = wl_display_create ();
+  g_autoptr (PhocStallWatchdog) watchdog = phoc_stall_watchdog_new (wl_display, 1);
+
+  g_assert_cmpuint (phoc_stall_watchdog_get_n_stalls (watchdog), ==, 0);
+
+  phoc_stall_watchdog_dispatch_begin (watchdog);
+  phoc_stall_watchdog_dispatch_end (watchdog);
+  g_assert_cmpuint (phoc_stall_watchdog_get_n_stalls (watchdog), ==, 0);
+
+  g_test_expect_message ("phoc-stall-watchdog", G_LOG_LEVEL_MESSAGE,
+                         "*in Wayland dispatch*in event loop sources*");
+  phoc_stall_watchdog_dispatch_begin (watchdog);
+  g_usleep (5000);
+  phoc_stall_watchdog_dispatch_end (watchdog);
+  g_test_assert_expected_messages ();
+  g_assert_cmpuint (phoc_stall_watchdog_get_n_stalls (watchdog), ==, 1);
+
+  /* Counted but not logged again right away */
+  phoc_stall_watchdog_dispatch_begin (watchdog);
+  g_usleep (5000);
+  phoc_stall_watchdog_dispatch_end (watchdog);
+  g_assert_cmpuint (phoc_stall_watchdog_get_n_stalls (watchdog), ==, 2);
+
+  g_clear_pointer (&watchdog, phoc_stall_watchdog_free);
+  wl_display_destroy (wl_display);
+}
+
+
+static gboolean
+on_idle_sleep (gpointer data)
+{
+  g_usleep (5000);
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+test_phoc_stall_watchdog_glib (void)
+{
+  struct wl_display *wl_display = wl_display_create ();
+  g_autoptr (PhocStallWatchdog) watchdog = phoc_stall_watchdog_new (wl_display, 1);
+
+  /* Start measuring from the next poll on */
+  g_main_context_iteration (NULL, FALSE);
+
+  g_idle_add (on_idle_sleep, NULL);
+  g_test_expect_message ("phoc-stall-watchdog", G_LOG_LEVEL_MESSAGE, "*in GLib sources*");
+  g_main_context_iteration (NULL, FALSE);
+  g_main_context_iteration (NULL, FALSE);
+  g_test_assert_expected_messages ();
+  g_assert_cmpuint (phoc_stall_watchdog_get_n_stalls (watchdog), ==, 1);
+
+  g_clear_pointer (&watchdog, phoc_stall_watchdog_free);
+  wl_display_destroy (wl_display);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/stall-watchdog/dispatch", test_phoc_stall_watchdog_dispatch);
+  g_test_add_func ("/phoc/stall-watchdog/glib", test_phoc_stall_watchdog_glib);
+
+  return g_test_run ();
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "thread-priority.h"
+
+
+static void
+assert_cpu_list (const char *str, const guint *expected, guint n_expected)
+{
+  g_autoptr (GArray) cpus = phoc_thread_priority_parse_cpu_list (str);
+
+  g_assert_nonnull (cpus);
+  g_assert_cmpmem (cpus->data, cpus->len * sizeof (guint), expected, n_expected * sizeof (guint));
+}
+
+
+static void
+test_phoc_thread_priority_parse_cpu_list (void)
+{
+  assert_cpu_list ("0", (guint[]){ 0 }, 1);
+  assert_cpu_list ("3", (guint[]){ 3 }, 1);
+  assert_cpu_list ("0,2", (guint[]){ 0, 2 }, 2);
+  assert_cpu_list ("4-7", (guint[]){ 4, 5, 6, 7 }, 4);
+  assert_cpu_list ("0,4-7", (guint[]){ 0, 4, 5, 6, 7 }, 5);
+  assert_cpu_list ("2-2", (guint[]){ 2 }, 1);
+  /* Whitespace around entries is fine */
+  assert_cpu_list (" 1 , 3 ", (guint[]){ 1, 3 }, 2);
+  /* Duplicates and overlaps are merged, order doesn't matter */
+  assert_cpu_list ("5,1-3,2", (guint[]){ 1, 2, 3, 5 }, 4);
+}
+
+
+static void
+test_phoc_thread_priority_parse_cpu_list_invalid (void)
+{
+  const char *invalid[] = {
+    "",
+    ",",
+    "a",
+    "1,",
+    "-1",
+    "1-",
+    "3-1",
+    "1-2-3",
+    "0x1",
+    "1.5",
+    "99999",
+    "0-99999",
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS (invalid); i++) {
+    g_autoptr (GArray) cpus = phoc_thread_priority_parse_cpu_list (invalid[i]);
+
+    g_assert_null (cpus);
+  }
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/thread-priority/parse-cpu-list",
+                   test_phoc_thread_priority_parse_cpu_list);
+  g_test_add_func ("/phoc/thread-priority/parse-cpu-list/invalid",
+                   test_phoc_thread_priority_parse_cpu_list_invalid);
+
+  return g_test_run ();
+}
@@ -111,6 +111,90 @@ phoc_test_obj_new (void)
 }
 
 
+/* An animatable that only ticks when told so via phoc_test_animatable_frame() */
+#define PHOC_TYPE_TEST_ANIMATABLE (phoc_test_animatable_get_type ())
+G_DECLARE_FINAL_TYPE (PhocTestAnimatable, phoc_test_animatable, PHOC, TEST_ANIMATABLE, GObject)
+
+struct _PhocTestAnimatable {
+  GObject               parent;
+
+  guint                 n_callbacks;
+  /* The most recently added frame callback */
+  guint                 callback_id;
+  PhocFrameCallback     callback;
+  gpointer              callback_data;
+};
+
+static void phoc_test_animatable_interface_init (PhocAnimatableInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (PhocTestAnimatable, phoc_test_animatable, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (PHOC_TYPE_ANIMATABLE,
+                                                phoc_test_animatable_interface_init))
+
+
+static guint
+phoc_test_animatable_add_frame_callback (PhocAnimatable    *animatable,
+                                         PhocFrameCallback  callback,
+                                         gpointer           user_data,
+                                         GDestroyNotify     notify)
+{
+  PhocTestAnimatable *self = PHOC_TEST_ANIMATABLE (animatable);
+
+  self->callback_id = ++self->n_callbacks;
+  self->callback = callback;
+  self->callback_data = user_data;
+
+  return self->callback_id;
+}
+
+
+static void
+phoc_test_animatable_remove_frame_callback (PhocAnimatable *animatable, guint id)
+{
+  PhocTestAnimatable *self = PHOC_TEST_ANIMATABLE (animatable);
+
+  if (self->callback_id != id)
+    return;
+
+  self->callback_id = 0;
+  self->callback = NULL;
+  self->callback_data = NULL;
+}
+
+
+static void
+phoc_test_animatable_interface_init (PhocAnimatableInterface *iface)
+{
+  iface->add_frame_callback = phoc_test_animatable_add_frame_callback;
+  iface->remove_frame_callback = phoc_test_animatable_remove_frame_callback;
+}
+
+
+static void
+phoc_test_animatable_class_init (PhocTestAnimatableClass *klass)
+{
+}
+
+
+static void
+phoc_test_animatable_init (PhocTestAnimatable *self)
+{
+}
+
+
+/* Times are in µs */
+static void
+phoc_test_animatable_frame (PhocTestAnimatable *self, guint64 last_frame, guint64 frame_time)
+{
+  g_assert_nonnull (self->callback);
+
+  if (self->callback (PHOC_ANIMATABLE (self), last_frame, frame_time, self->callback_data))
+    return;
+
+  phoc_test_animatable_remove_frame_callback (PHOC_ANIMATABLE (self), self->callback_id);
+}
+
+
 static void
 test_phoc_timed_animation_simple (void)
 {
@@ -120,6 +204,7 @@ test_phoc_timed_animation_simple (void)
   g_assert_cmpint (phoc_timed_animation_get_state (anim), ==,
                    PHOC_TIMED_ANIMATION_IDLE);
   g_assert_false (phoc_timed_animation_get_dispose_on_done (anim));
+  g_assert_cmpint (phoc_timed_animation_get_max_fps (anim), ==, 0);
 
   g_assert_finalize_object (anim);
 }
@@ -152,6 +237,179 @@ test_phoc_timed_animation_dispose_on_done (void)
 }
 
 
+static void
+on_done (PhocTimedAnimation *anim, guint *count)
+{
+  (*count)++;
+}
+
+
+static void
+on_tick (PhocTimedAnimation *anim, guint *count)
+{
+  (*count)++;
+}
+
+
+static PhocTimedAnimation *
+new_linear_animation (PhocTestAnimatable *animatable, PhocTestObj *obj, int max_fps)
+{
+  g_autoptr (PhocPropertyEaser) easer = phoc_property_easer_new (G_OBJECT (obj));
+  PhocTimedAnimation *anim;
+
+  phoc_property_easer_set_easing (easer, PHOC_EASING_NONE);
+  phoc_property_easer_set_props (easer, "prop-f", 0.0, 1.0, NULL);
+  anim = g_object_new (PHOC_TYPE_TIMED_ANIMATION,
+                       "animatable", animatable,
+                       "duration", 1000,
+                       "max-fps", max_fps,
+                       "property-easer", easer,
+                       NULL);
+  g_assert_cmpint (phoc_timed_animation_get_max_fps (anim), ==, max_fps);
+
+  return anim;
+}
+
+
+#define FRAME_US 16667 /* 60Hz */
+
+static void
+test_phoc_timed_animation_max_fps (void)
+{
+  g_autoptr (PhocTestObj) capped_obj = phoc_test_obj_new ();
+  g_autoptr (PhocTestObj) full_obj = phoc_test_obj_new ();
+  PhocTestAnimatable *animatable = g_object_new (PHOC_TYPE_TEST_ANIMATABLE, NULL);
+  PhocTimedAnimation *capped, *full;
+  guint capped_ticks = 0, full_ticks = 0;
+  guint64 now = G_USEC_PER_SEC;
+  float f;
+
+  capped = new_linear_animation (animatable, capped_obj, 30);
+  g_signal_connect (capped, "tick", G_CALLBACK (on_tick), &capped_ticks);
+  full = new_linear_animation (animatable, full_obj, 0);
+  g_signal_connect (full, "tick", G_CALLBACK (on_tick), &full_ticks);
+
+  phoc_timed_animation_play (capped);
+  phoc_timed_animation_play (full);
+
+  /* Both start on the first frame */
+  phoc_test_animatable_frame (animatable, now, now);
+  g_assert_cmpuint (capped_ticks, ==, 1);
+  g_assert_cmpuint (full_ticks, ==, 1);
+
+  /* At 60Hz the capped animation skips every other frame… */
+  phoc_test_animatable_frame (animatable, now, now + FRAME_US);
+  g_assert_cmpuint (capped_ticks, ==, 1);
+  g_assert_cmpuint (full_ticks, ==, 2);
+  g_object_get (capped_obj, "prop-f", &f, NULL);
+  g_assert_cmpfloat (f, ==, 0.0);
+  g_object_get (full_obj, "prop-f", &f, NULL);
+  g_assert_cmpfloat_with_epsilon (f, 0.016, 0.0001);
+
+  /* …but the skipped frame still counts towards its progress */
+  phoc_test_animatable_frame (animatable, now + FRAME_US, now + 2 * FRAME_US);
+  g_assert_cmpuint (capped_ticks, ==, 2);
+  g_assert_cmpuint (full_ticks, ==, 3);
+  g_object_get (capped_obj, "prop-f", &f, NULL);
+  g_assert_cmpfloat_with_epsilon (f, 0.033, 0.0001);
+  g_object_get (full_obj, "prop-f", &f, NULL);
+  g_assert_cmpfloat_with_epsilon (f, 0.032, 0.0001);
+
+  phoc_timed_animation_skip (capped);
+  phoc_timed_animation_skip (full);
+  g_assert_finalize_object (capped);
+  g_assert_finalize_object (full);
+  g_assert_finalize_object (animatable);
+}
+
+
+static void
+test_phoc_timed_animation_acquire (void)
+{
+  g_autoptr (PhocTestObj) obj = phoc_test_obj_new ();
+  PhocTestAnimatable *animatable = g_object_new (PHOC_TYPE_TEST_ANIMATABLE, NULL);
+  PhocTimedAnimation *anim, *reused;
+  guint count = 0;
+  float f;
+
+  anim = phoc_timed_animation_acquire (PHOC_ANIMATABLE (animatable), G_OBJECT (obj),
+                                       PHOC_EASING_EASE_OUT_QUAD, 100);
+  g_assert_true (phoc_timed_animation_get_animatable (anim) == PHOC_ANIMATABLE (animatable));
+  g_assert_cmpint (phoc_timed_animation_get_duration (anim), ==, 100);
+  phoc_property_easer_set_props (phoc_timed_animation_get_property_easer (anim),
+                                 "prop-f", 0.0, 1.0, NULL);
+  g_signal_connect (anim, "done", G_CALLBACK (on_done), &count);
+  phoc_timed_animation_play (anim);
+  g_assert_cmpint (phoc_timed_animation_get_state (anim), ==, PHOC_TIMED_ANIMATION_PLAYING);
+
+  /* The animatable going away finishes the animation… */
+  g_assert_finalize_object (animatable);
+  g_assert_cmpuint (count, ==, 1);
+  g_object_get (obj, "prop-f", &f, NULL);
+  g_assert_cmpfloat (f, ==, 1.0);
+
+  /* …and hands it back to the pool without any handlers */
+  animatable = g_object_new (PHOC_TYPE_TEST_ANIMATABLE, NULL);
+  reused = phoc_timed_animation_acquire (PHOC_ANIMATABLE (animatable), G_OBJECT (obj),
+                                         PHOC_EASING_NONE, 50);
+  g_assert_true (reused == anim);
+  g_assert_cmpint (phoc_timed_animation_get_duration (reused), ==, 50);
+  phoc_timed_animation_play (reused);
+  phoc_timed_animation_skip (reused);
+  g_assert_cmpuint (count, ==, 1);
+  g_assert_null (phoc_timed_animation_get_animatable (reused));
+
+  g_assert_finalize_object (animatable);
+  phoc_timed_animation_clear_pool ();
+}
+
+
+static void
+test_phoc_timed_animation_power_saving (void)
+{
+  g_autoptr (PhocTestObj) obj = phoc_test_obj_new ();
+  PhocTestAnimatable *animatable = g_object_new (PHOC_TYPE_TEST_ANIMATABLE, NULL);
+  PhocTimedAnimation *anim;
+  guint64 now = G_USEC_PER_SEC;
+  float f;
+
+  anim = new_linear_animation (animatable, obj, 0);
+
+  /* Latched when starting to play */
+  phoc_timed_animation_set_power_saving (TRUE);
+  g_assert_false (phoc_timed_animation_get_power_saving (anim));
+  phoc_timed_animation_play (anim);
+  g_assert_true (phoc_timed_animation_get_power_saving (anim));
+
+  /* Runs at half the duration… */
+  phoc_test_animatable_frame (animatable, now, now);
+  phoc_test_animatable_frame (animatable, now, now + 250 * 1000);
+  g_object_get (obj, "prop-f", &f, NULL);
+  g_assert_cmpfloat_with_epsilon (f, 0.5, 0.0001);
+
+  /* …and keeps doing so when power saving ends midway */
+  phoc_timed_animation_set_power_saving (FALSE);
+  g_assert_true (phoc_timed_animation_get_power_saving (anim));
+  phoc_test_animatable_frame (animatable, now + 250 * 1000, now + 350 * 1000);
+  g_object_get (obj, "prop-f", &f, NULL);
+  g_assert_cmpfloat_with_epsilon (f, 0.7, 0.0001);
+  phoc_timed_animation_skip (anim);
+
+  /* The next run picks up the change */
+  now += G_USEC_PER_SEC;
+  phoc_timed_animation_play (anim);
+  g_assert_false (phoc_timed_animation_get_power_saving (anim));
+  phoc_test_animatable_frame (animatable, now, now);
+  phoc_test_animatable_frame (animatable, now, now + 250 * 1000);
+  g_object_get (obj, "prop-f", &f, NULL);
+  g_assert_cmpfloat_with_epsilon (f, 0.25, 0.0001);
+  phoc_timed_animation_skip (anim);
+
+  g_assert_finalize_object (anim);
+  g_assert_finalize_object (animatable);
+}
+
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -160,6 +418,10 @@ main (gint argc, gchar *argv[])
   g_test_add_func("/phoc/timed-animation/simple", test_phoc_timed_animation_simple);
   g_test_add_func("/phoc/timed-animation/dispose_on_done",
                   test_phoc_timed_animation_dispose_on_done);
+  g_test_add_func("/phoc/timed-animation/acquire", test_phoc_timed_animation_acquire);
+  g_test_add_func("/phoc/timed-animation/max-fps", test_phoc_timed_animation_max_fps);
+  g_test_add_func("/phoc/timed-animation/power-saving",
+                  test_phoc_timed_animation_power_saving);
 
   return g_test_run();
 }
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "timeline-trace.h"
+
+#include <string.h>
+
+
+static void
+test_phoc_timeline_trace_to_json (void)
+{
+  g_autoptr (PhocTimelineTrace) trace = phoc_timeline_trace_new ();
+  g_autofree char *json = NULL;
+
+  json = phoc_timeline_trace_to_json (trace);
+  g_assert_cmpstr (json, ==,
+                   "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                   "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+                   "\"args\":{\"name\":\"phoc\"}}]}\n");
+  g_clear_pointer (&json, g_free);
+
+  phoc_timeline_trace_add_span (trace, "DSI-1", "frame", 100, 150, "damage", 42);
+  phoc_timeline_trace_add_instant (trace, "commits", "org.\"gnome\".Calls", 120);
+  phoc_timeline_trace_add_span (trace, "DSI-1", "render", 110, 105, NULL, 0);
+  g_assert_cmpuint (phoc_timeline_trace_get_n_events (trace), ==, 3);
+
+  json = phoc_timeline_trace_to_json (trace);
+  g_assert_cmpstr (json, ==,
+                   "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                   "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+                   "\"args\":{\"name\":\"phoc\"}},\n"
+                   "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                   "\"args\":{\"name\":\"DSI-1\"}},\n"
+                   "{\"name\":\"frame\",\"ph\":\"X\",\"ts\":100,\"dur\":50,\"pid\":1,\"tid\":1,"
+                   "\"args\":{\"damage\":42}},\n"
+                   "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,"
+                   "\"args\":{\"name\":\"commits\"}},\n"
+                   "{\"name\":\"org.\\\"gnome\\\".Calls\",\"ph\":\"i\",\"s\":\"t\",\"ts\":120,"
+                   "\"pid\":1,\"tid\":2},\n"
+                   "{\"name\":\"render\",\"ph\":\"X\",\"ts\":110,\"dur\":0,\"pid\":1,\"tid\":1}\n"
+                   "]}\n");
+}
+
+
+static void
+test_phoc_timeline_trace_ring (void)
+{
+  g_autoptr (PhocTimelineTrace) trace = phoc_timeline_trace_new ();
+  g_autofree char *json = NULL;
+
+  for (gint64 i = 0; i < PHOC_TIMELINE_TRACE_MAX_EVENTS + 2; i++)
+    phoc_timeline_trace_add_instant (trace, "input", "touch", i);
+
+  g_assert_cmpuint (phoc_timeline_trace_get_n_events (trace), ==, PHOC_TIMELINE_TRACE_MAX_EVENTS);
+
+  /* The two oldest events got dropped */
+  json = phoc_timeline_trace_to_json (trace);
+  g_assert_null (strstr (json, "\"ts\":1,"));
+  g_assert_nonnull (strstr (json, "{\"name\":\"touch\",\"ph\":\"i\",\"s\":\"t\",\"ts\":2,"));
+  g_assert_true (g_str_has_suffix (json, "\"ts\":65537,\"pid\":1,\"tid\":1}\n]}\n"));
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/timeline-trace/to-json", test_phoc_timeline_trace_to_json);
+  g_test_add_func ("/phoc/timeline-trace/ring", test_phoc_timeline_trace_ring);
+
+  return g_test_run ();
+}
@@ -44,12 +44,112 @@ test_phoc_utils_compute_scale (void)
   g_assert_cmpfloat (scale, ==, 1.0);
 }
 
+
+static void
+test_phoc_utils_region_area (void)
+{
+  pixman_region32_t region;
+
+  pixman_region32_init (&region);
+  g_assert_cmpuint (phoc_utils_region_area (&region), ==, 0);
+
+  pixman_region32_union_rect (&region, &region, 0, 0, 10, 10);
+  g_assert_cmpuint (phoc_utils_region_area (&region), ==, 100);
+
+  /* Overlapping area is only counted once */
+  pixman_region32_union_rect (&region, &region, 5, 5, 10, 10);
+  g_assert_cmpuint (phoc_utils_region_area (&region), ==, 175);
+
+  pixman_region32_fini (&region);
+}
+
+
+static void
+test_phoc_utils_region_scale_inward (void)
+{
+  pixman_region32_t region, scaled;
+  pixman_box32_t *extents;
+
+  pixman_region32_init_rect (&region, 1, 1, 3, 3);
+  pixman_region32_init (&scaled);
+
+  /* Integer scales are exact */
+  phoc_utils_region_scale_inward (&scaled, &region, 2.0, 2.0);
+  extents = pixman_region32_extents (&scaled);
+  g_assert_cmpint (extents->x1, ==, 2);
+  g_assert_cmpint (extents->y1, ==, 2);
+  g_assert_cmpint (extents->x2, ==, 8);
+  g_assert_cmpint (extents->y2, ==, 8);
+
+  /* Fractional scales round towards the inside */
+  phoc_utils_region_scale_inward (&scaled, &region, 1.5, 1.5);
+  extents = pixman_region32_extents (&scaled);
+  g_assert_cmpint (extents->x1, ==, 2);
+  g_assert_cmpint (extents->y1, ==, 2);
+  g_assert_cmpint (extents->x2, ==, 6);
+  g_assert_cmpint (extents->y2, ==, 6);
+
+  /* Rectangles that become empty are dropped */
+  pixman_region32_fini (&region);
+  pixman_region32_init_rect (&region, 1, 1, 1, 1);
+  phoc_utils_region_scale_inward (&scaled, &region, 0.5, 0.5);
+  g_assert_false (pixman_region32_not_empty (&scaled));
+
+  /* In place */
+  pixman_region32_fini (&region);
+  pixman_region32_init_rect (&region, 0, 0, 4, 4);
+  phoc_utils_region_scale_inward (&region, &region, 0.75, 0.75);
+  g_assert_cmpuint (phoc_utils_region_area (&region), ==, 9);
+
+  pixman_region32_fini (&scaled);
+  pixman_region32_fini (&region);
+}
+
+
+static void
+test_phoc_utils_region_simplify (void)
+{
+  pixman_region32_t region;
+  pixman_box32_t *extents;
+
+  pixman_region32_init (&region);
+
+  /* Nothing to merge */
+  g_assert_cmpuint (phoc_utils_region_simplify (&region, 0.25, 8), ==, 0);
+  pixman_region32_union_rect (&region, &region, 0, 0, 10, 10);
+  g_assert_cmpuint (phoc_utils_region_simplify (&region, 0.25, 8), ==, 0);
+
+  /* Close rectangles get merged */
+  pixman_region32_union_rect (&region, &region, 12, 0, 10, 10);
+  g_assert_cmpint (pixman_region32_n_rects (&region), ==, 2);
+  g_assert_cmpuint (phoc_utils_region_simplify (&region, 0.25, 8), ==, 1);
+  g_assert_cmpint (pixman_region32_n_rects (&region), ==, 1);
+  g_assert_cmpuint (phoc_utils_region_area (&region), ==, 220);
+
+  /* Distant ones only when exceeding the limit */
+  pixman_region32_union_rect (&region, &region, 100, 100, 10, 10);
+  g_assert_cmpuint (phoc_utils_region_simplify (&region, 0.25, 8), ==, 0);
+  g_assert_cmpint (pixman_region32_n_rects (&region), ==, 2);
+  g_assert_cmpuint (phoc_utils_region_simplify (&region, 0.25, 1), ==, 1);
+  g_assert_cmpint (pixman_region32_n_rects (&region), ==, 1);
+  extents = pixman_region32_extents (&region);
+  g_assert_cmpint (extents->x1, ==, 0);
+  g_assert_cmpint (extents->y1, ==, 0);
+  g_assert_cmpint (extents->x2, ==, 110);
+  g_assert_cmpint (extents->y2, ==, 110);
+
+  pixman_region32_fini (&region);
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/phoc/utils/compute_scale", test_phoc_utils_compute_scale);
+  g_test_add_func ("/phoc/utils/region_area", test_phoc_utils_region_area);
+  g_test_add_func ("/phoc/utils/region_scale_inward", test_phoc_utils_region_scale_inward);
+  g_test_add_func ("/phoc/utils/region_simplify", test_phoc_utils_region_simplify);
 
   return g_test_run ();
 }
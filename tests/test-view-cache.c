@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "testlib.h"
+
+#define GREEN 0xFF00FF00
+#define RED   0xFFFF0000
+#define BLUE  0xFF0000FF
+
+#define SUB_POS  10
+#define SUB_SIZE 50
+
+
+static guint32
+get_pixel (PhocTestBuffer *buffer, guint32 x, guint32 y)
+{
+  return *(guint32 *)(buffer->shm_data + y * buffer->stride + x * 4) & 0x00FFFFFF;
+}
+
+
+static void
+fill_buffer (PhocTestBuffer *buffer, guint32 color)
+{
+  for (int i = 0; i < buffer->width * buffer->height * 4; i += 4)
+    *(guint32 *)(buffer->shm_data + i) = color;
+}
+
+
+static gboolean
+damage_output (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output;
+
+  g_assert_cmpint (wl_list_length (&desktop->outputs), ==, 1);
+  output = wl_container_of (desktop->outputs.next, output, link);
+  phoc_output_damage_whole (output);
+
+  return TRUE;
+}
+
+
+static gboolean
+has_view_cache (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocRenderer *renderer = phoc_server_get_renderer (server);
+  PhocView *view;
+
+  g_assert_cmpint (g_queue_get_length (phoc_desktop_get_views (desktop)), ==, 1);
+  view = g_queue_peek_head (phoc_desktop_get_views (desktop));
+
+  return !!phoc_renderer_get_view_cache_texture (renderer, view);
+}
+
+
+static gboolean
+test_client_view_cache (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *xs;
+  PhocTestBuffer *screenshot;
+  PhocTestBuffer sub_buffer = {};
+  struct wl_surface *sub_surface;
+  struct wl_subsurface *subsurface;
+  gboolean cached = FALSE;
+
+  xs = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "cached", GREEN);
+  g_assert_nonnull (xs);
+
+  sub_surface = wl_compositor_create_surface (globals->compositor);
+  subsurface = wl_subcompositor_get_subsurface (globals->subcompositor, sub_surface,
+                                                xs->wl_surface);
+  wl_subsurface_set_position (subsurface, SUB_POS, SUB_POS);
+  wl_subsurface_set_desync (subsurface);
+  phoc_test_client_create_shm_buffer (globals, &sub_buffer, SUB_SIZE, SUB_SIZE,
+                                      WL_SHM_FORMAT_XRGB8888);
+  fill_buffer (&sub_buffer, RED);
+  wl_surface_attach (sub_surface, sub_buffer.wl_buffer, 0, 0);
+  wl_surface_damage_buffer (sub_surface, 0, 0, SUB_SIZE, SUB_SIZE);
+  wl_surface_commit (sub_surface);
+  wl_surface_commit (xs->wl_surface);
+  wl_display_roundtrip (globals->display);
+
+  /* Cached once the view stayed the same for a frame */
+  for (int i = 0; i < 5 && !cached; i++) {
+    phoc_test_client_invoke_server (globals, damage_output, NULL);
+    phoc_test_client_capture_output (globals, &globals->output);
+    cached = phoc_test_client_invoke_server (globals, has_view_cache, NULL);
+  }
+  g_assert_true (cached);
+
+  /* The cache shows both surfaces */
+  phoc_test_client_invoke_server (globals, damage_output, NULL);
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, 0, 0), ==, GREEN & 0x00FFFFFF);
+  g_assert_cmphex (get_pixel (screenshot, SUB_POS, SUB_POS), ==, RED & 0x00FFFFFF);
+  g_assert_true (phoc_test_client_invoke_server (globals, has_view_cache, NULL));
+
+  /* A commit drops the cache so the new content is drawn right away */
+  fill_buffer (&sub_buffer, BLUE);
+  wl_surface_attach (sub_surface, sub_buffer.wl_buffer, 0, 0);
+  wl_surface_damage_buffer (sub_surface, 0, 0, SUB_SIZE, SUB_SIZE);
+  wl_surface_commit (sub_surface);
+  wl_display_roundtrip (globals->display);
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, SUB_POS, SUB_POS), ==, BLUE & 0x00FFFFFF);
+  g_assert_false (phoc_test_client_invoke_server (globals, has_view_cache, NULL));
+
+  wl_subsurface_destroy (subsurface);
+  wl_surface_destroy (sub_surface);
+  phoc_test_buffer_free (&sub_buffer);
+  phoc_test_xdg_toplevel_free (xs);
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_view_cache_server_prepare (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+
+  g_assert_nonnull (desktop);
+  phoc_desktop_set_auto_maximize (desktop, TRUE);
+  return TRUE;
+}
+
+
+static void
+test_view_cache (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_view_cache_server_prepare,
+   .client_run     = test_client_view_cache,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+   .config         = phoc_config_new_from_data ("[core]\n"
+                                                "xwayland = false\n"
+                                                "view-cache-frames = 1\n"),
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/view-cache/drop-on-commit", test_view_cache);
+
+  return g_test_run ();
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "testlib.h"
+#include "testlib-layer-shell.h"
+
+#include <wlr/types/wlr_output.h>
+
+#define GREEN 0xFF00FF00
+#define RED   0xFFFF0000
+#define BLUE  0xFF0000FF
+
+#define PANEL_HEIGHT 50
+
+
+static guint32
+get_pixel (PhocTestBuffer *buffer, guint32 x, guint32 y)
+{
+  return *(guint32 *)(buffer->shm_data + y * buffer->stride + x * 4) & 0x00FFFFFF;
+}
+
+
+static gboolean
+has_closing_views (PhocServer *server, gpointer data)
+{
+  return phoc_renderer_has_view_snapshots (phoc_server_get_renderer (server), NULL);
+}
+
+
+static gboolean
+destroy_output (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output;
+
+  g_assert_cmpint (wl_list_length (&desktop->outputs), ==, 1);
+  output = wl_container_of (desktop->outputs.next, output, link);
+  wlr_output_destroy (output->wlr_output);
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_view_snapshot_close (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *xs_below, *xs;
+  PhocTestLayerSurface *panel;
+  PhocTestBuffer *screenshot;
+
+  xs_below = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "below", GREEN);
+  g_assert_nonnull (xs_below);
+  xs = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "closing", BLUE);
+  g_assert_nonnull (xs);
+
+  /* Overlaps the maximized toplevels */
+  panel = phoc_test_layer_surface_new (globals, 0, PANEL_HEIGHT, RED,
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
+                                       0);
+  g_assert_nonnull (panel);
+
+  /* The closing toplevel fades out where it was in the stack… */
+  phoc_test_xdg_toplevel_free (xs);
+  g_assert_true (phoc_test_client_invoke_server (globals, has_closing_views, NULL));
+
+  /* …so it stays below the layer surface */
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, 0, 0), ==, RED & 0x00FFFFFF);
+
+  phoc_test_layer_surface_free (panel);
+  phoc_test_xdg_toplevel_free (xs_below);
+
+  /* Snapshots don't outlive their output */
+  phoc_test_client_invoke_server (globals, destroy_output, NULL);
+  g_assert_false (phoc_test_client_invoke_server (globals, has_closing_views, NULL));
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_view_snapshot_server_prepare (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+
+  g_assert_nonnull (desktop);
+  phoc_desktop_set_auto_maximize (desktop, TRUE);
+  return TRUE;
+}
+
+
+static void
+test_view_snapshot_close (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_view_snapshot_server_prepare,
+   .client_run     = test_client_view_snapshot_close,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/view-snapshot/close", test_view_snapshot_close);
+
+  return g_test_run ();
+}
@@ -6,6 +6,8 @@
  * Author: Guido Günther <agx@sigxcpu.org>
  */
 
+#include "cursor.h"
+#include "seat.h"
 #include "testlib.h"
 
 #include "xdg-shell-client-protocol.h"
@@ -72,6 +74,203 @@ test_client_xdg_shell_toplevel_maximized (PhocTestClientGlobals *globals, gpoint
 }
 
 
+static gboolean
+check_view_geometry (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  struct wlr_box *expected = data;
+  struct wlr_box geometry;
+  PhocView *view;
+
+  g_assert_cmpint (g_queue_get_length (phoc_desktop_get_views (desktop)), ==, 1);
+  view = g_queue_peek_head (phoc_desktop_get_views (desktop));
+
+  phoc_view_get_geometry (view, &geometry);
+  g_assert_cmpint (geometry.x, ==, expected->x);
+  g_assert_cmpint (geometry.y, ==, expected->y);
+  g_assert_cmpint (geometry.width, ==, expected->width);
+  g_assert_cmpint (geometry.height, ==, expected->height);
+
+  return TRUE;
+}
+
+
+static void
+attach_sub_buffer (PhocTestClientGlobals *globals,
+                   struct wl_surface     *wl_surface,
+                   PhocTestBuffer        *buffer,
+                   guint32                size)
+{
+  PhocTestBuffer new_buffer = {};
+
+  phoc_test_client_create_shm_buffer (globals, &new_buffer, size, size, WL_SHM_FORMAT_XRGB8888);
+  for (int i = 0; i < new_buffer.width * new_buffer.height * 4; i += 4)
+    *(guint32 *)(new_buffer.shm_data + i) = 0xFFFF0000;
+
+  wl_surface_attach (wl_surface, new_buffer.wl_buffer, 0, 0);
+  wl_surface_damage_buffer (wl_surface, 0, 0, size, size);
+  wl_surface_commit (wl_surface);
+
+  /* The old buffer isn't attached anymore */
+  phoc_test_buffer_free (buffer);
+  *buffer = new_buffer;
+}
+
+
+#define GEOMETRY_SIZE 100
+#define GEOMETRY_SUB_POS 50
+
+static gboolean
+test_client_xdg_shell_subsurface_geometry (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *xs;
+  PhocTestBuffer sub_buffer = {};
+  struct wl_surface *sub_surface;
+  struct wl_subsurface *subsurface;
+  struct wlr_box expected = { 0, 0, GEOMETRY_SIZE, GEOMETRY_SIZE };
+
+  xs = phoc_test_xdg_toplevel_new_with_buffer (globals, GEOMETRY_SIZE, GEOMETRY_SIZE,
+                                               NULL, 0xFF00FF00);
+  g_assert_nonnull (xs);
+
+  /* A synchronized subsurface within the toplevel's bounds */
+  sub_surface = wl_compositor_create_surface (globals->compositor);
+  subsurface = wl_subcompositor_get_subsurface (globals->subcompositor, sub_surface,
+                                                xs->wl_surface);
+  wl_subsurface_set_position (subsurface, GEOMETRY_SUB_POS, GEOMETRY_SUB_POS);
+  attach_sub_buffer (globals, sub_surface, &sub_buffer, 20);
+  wl_surface_commit (xs->wl_surface);
+  wl_display_roundtrip (globals->display);
+  phoc_test_client_invoke_server (globals, check_view_geometry, &expected);
+
+  /* Growing it without moving it extends the geometry */
+  attach_sub_buffer (globals, sub_surface, &sub_buffer, 80);
+  wl_surface_commit (xs->wl_surface);
+  wl_display_roundtrip (globals->display);
+  expected.width = expected.height = GEOMETRY_SUB_POS + 80;
+  phoc_test_client_invoke_server (globals, check_view_geometry, &expected);
+
+  /* Same for a desynchronized one */
+  wl_subsurface_set_desync (subsurface);
+  attach_sub_buffer (globals, sub_surface, &sub_buffer, 90);
+  wl_display_roundtrip (globals->display);
+  expected.width = expected.height = GEOMETRY_SUB_POS + 90;
+  phoc_test_client_invoke_server (globals, check_view_geometry, &expected);
+
+  wl_subsurface_destroy (subsurface);
+  wl_surface_destroy (sub_surface);
+  phoc_test_buffer_free (&sub_buffer);
+  phoc_test_xdg_toplevel_free (xs);
+
+  return TRUE;
+}
+
+
+#define POPUP_SIZE 50
+
+static gboolean
+move_cursor_to_popup (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocCursor *cursor = phoc_seat_get_cursor (phoc_server_get_last_active_seat (server));
+  struct wlr_box box;
+  PhocView *view;
+
+  view = g_queue_peek_head (phoc_desktop_get_views (desktop));
+  g_assert_nonnull (view);
+  phoc_view_get_box (view, &box);
+
+  /* Where the popup will show up, outside of the toplevel */
+  wlr_cursor_warp_closest (cursor->cursor, NULL,
+                           box.x + GEOMETRY_SIZE + POPUP_SIZE / 2,
+                           box.y + GEOMETRY_SIZE + POPUP_SIZE / 2);
+  phoc_cursor_update_focus (cursor);
+  g_assert_null (cursor->wlr_surface);
+
+  return TRUE;
+}
+
+
+static gboolean
+check_popup_pointer_focus (PhocServer *server, gpointer data)
+{
+  PhocSeat *seat = phoc_server_get_last_active_seat (server);
+  struct wlr_surface *focus = seat->seat->pointer_state.focused_surface;
+  struct wlr_xdg_surface *xdg_surface;
+
+  g_assert_nonnull (focus);
+  xdg_surface = wlr_xdg_surface_try_from_wlr_surface (focus);
+  g_assert_nonnull (xdg_surface);
+  g_assert_cmpint (xdg_surface->role, ==, WLR_XDG_SURFACE_ROLE_POPUP);
+
+  return TRUE;
+}
+
+
+static void
+popup_surface_configure (void *data, struct xdg_surface *xdg_surface, uint32_t serial)
+{
+  gboolean *configured = data;
+
+  xdg_surface_ack_configure (xdg_surface, serial);
+  *configured = TRUE;
+}
+
+
+static const struct xdg_surface_listener popup_surface_listener = {
+  .configure = popup_surface_configure,
+};
+
+
+static gboolean
+test_client_xdg_shell_popup_input (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *xs;
+  PhocTestBuffer popup_buffer = {};
+  struct wl_surface *popup_surface;
+  struct xdg_surface *popup_xdg_surface;
+  struct xdg_positioner *positioner;
+  struct xdg_popup *popup;
+  gboolean configured = FALSE;
+
+  xs = phoc_test_xdg_toplevel_new_with_buffer (globals, GEOMETRY_SIZE, GEOMETRY_SIZE,
+                                               NULL, 0xFF00FF00);
+  g_assert_nonnull (xs);
+
+  /* Nothing there yet, this also has the view cache its input bounds */
+  phoc_test_client_invoke_server (globals, move_cursor_to_popup, NULL);
+
+  /* A popup extending beyond the toplevel's bottom right corner */
+  positioner = xdg_wm_base_create_positioner (globals->xdg_shell);
+  xdg_positioner_set_size (positioner, POPUP_SIZE, POPUP_SIZE);
+  xdg_positioner_set_anchor_rect (positioner, 0, 0, GEOMETRY_SIZE, GEOMETRY_SIZE);
+  xdg_positioner_set_anchor (positioner, XDG_POSITIONER_ANCHOR_BOTTOM_RIGHT);
+  xdg_positioner_set_gravity (positioner, XDG_POSITIONER_GRAVITY_BOTTOM_RIGHT);
+
+  popup_surface = wl_compositor_create_surface (globals->compositor);
+  popup_xdg_surface = xdg_wm_base_get_xdg_surface (globals->xdg_shell, popup_surface);
+  xdg_surface_add_listener (popup_xdg_surface, &popup_surface_listener, &configured);
+  popup = xdg_surface_get_popup (popup_xdg_surface, xs->xdg_surface, positioner);
+  xdg_positioner_destroy (positioner);
+  wl_surface_commit (popup_surface);
+  wl_display_roundtrip (globals->display);
+  g_assert_true (configured);
+
+  /* Mapping the popup must move pointer focus to it */
+  attach_sub_buffer (globals, popup_surface, &popup_buffer, POPUP_SIZE);
+  wl_display_roundtrip (globals->display);
+  phoc_test_client_invoke_server (globals, check_popup_pointer_focus, NULL);
+
+  xdg_popup_destroy (popup);
+  xdg_surface_destroy (popup_xdg_surface);
+  wl_surface_destroy (popup_surface);
+  phoc_test_buffer_free (&popup_buffer);
+  phoc_test_xdg_toplevel_free (xs);
+
+  return TRUE;
+}
+
+
 static gboolean
 test_client_xdg_shell_server_prepare (PhocServer *server, gpointer data)
 {
@@ -121,6 +320,32 @@ test_xdg_shell_toplevel_maximized (void)
 }
 
 
+static void
+test_xdg_shell_subsurface_geometry (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_xdg_shell_server_prepare,
+   .client_run     = test_client_xdg_shell_subsurface_geometry,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, GINT_TO_POINTER (FALSE));
+}
+
+
+static void
+test_xdg_shell_popup_input (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_xdg_shell_server_prepare,
+   .client_run     = test_client_xdg_shell_popup_input,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, GINT_TO_POINTER (FALSE));
+}
+
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -129,6 +354,8 @@ main (gint argc, gchar *argv[])
   PHOC_TEST_ADD ("/phoc/xdg-shell/simple", test_xdg_shell_normal);
   PHOC_TEST_ADD ("/phoc/xdg-shell/auto-maximize", test_xdg_shell_auto_maximized);
   PHOC_TEST_ADD ("/phoc/xdg-shell/toplevel-maximize", test_xdg_shell_toplevel_maximized);
+  PHOC_TEST_ADD ("/phoc/xdg-shell/subsurface-geometry", test_xdg_shell_subsurface_geometry);
+  PHOC_TEST_ADD ("/phoc/xdg-shell/popup-input", test_xdg_shell_popup_input);
 
   return g_test_run();
 }
@@ -46,6 +46,17 @@ PhocTestLayerSurface *
 phoc_test_layer_surface_new (PhocTestClientGlobals *globals,
                              guint32 width, guint32 height, guint32 color,
                              guint32 anchor, guint32 exclusive_zone)
+{
+  return phoc_test_layer_surface_new_on_layer (globals, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY,
+                                               width, height, color, anchor, exclusive_zone);
+}
+
+
+PhocTestLayerSurface *
+phoc_test_layer_surface_new_on_layer (PhocTestClientGlobals         *globals,
+                                      enum zwlr_layer_shell_v1_layer layer,
+                                      guint32 width, guint32 height, guint32 color,
+                                      guint32 anchor, guint32 exclusive_zone)
 {
   PhocTestLayerSurface *ls = g_malloc0 (sizeof(PhocTestLayerSurface));
 
@@ -55,7 +66,7 @@ phoc_test_layer_surface_new (PhocTestClientGlobals *globals,
   ls->layer_surface = zwlr_layer_shell_v1_get_layer_surface (globals->layer_shell,
                                                              ls->wl_surface,
                                                              NULL,
-                                                             ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY,
+                                                             layer,
                                                              "phoc-test");
   g_assert_nonnull (ls->wl_surface);
   zwlr_layer_surface_v1_set_size (ls->layer_surface, width, height);
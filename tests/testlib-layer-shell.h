@@ -25,6 +25,13 @@ PhocTestLayerSurface *phoc_test_layer_surface_new   (PhocTestClientGlobals *glob
                                                      guint32 color,
                                                      guint32 anchor,
                                                      guint32 exclusive_zone);
+PhocTestLayerSurface *phoc_test_layer_surface_new_on_layer (PhocTestClientGlobals         *globals,
+                                                            enum zwlr_layer_shell_v1_layer layer,
+                                                            guint32 width,
+                                                            guint32 height,
+                                                            guint32 color,
+                                                            guint32 anchor,
+                                                            guint32 exclusive_zone);
 void                   phoc_test_layer_surface_free (PhocTestLayerSurface *layer_surface);
 
 G_END_DECLS
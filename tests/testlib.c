@@ -6,6 +6,7 @@
 
 #include "testlib.h"
 #include "server.h"
+#include "frame-stats.h"
 #include <wayland-client.h>
 
 #include <cairo.h>
@@ -17,6 +18,15 @@ struct task_data {
   gpointer data;
 };
 
+typedef struct {
+  GMutex              mutex;
+  GCond               cond;
+  gboolean            done;
+  PhocTestServerFunc  func;
+  gpointer            data;
+  gboolean            ret;
+} ServerRequest;
+
 static bool
 abgr_to_argb (PhocTestBuffer *buffer)
 {
@@ -297,6 +307,8 @@ static void registry_handle_global(void *data, struct wl_registry *registry,
 
   if (!g_strcmp0 (interface, wl_compositor_interface.name)) {
     globals->compositor = wl_registry_bind (registry, name, &wl_compositor_interface, 4);
+  } else if (!g_strcmp0 (interface, wl_subcompositor_interface.name)) {
+    globals->subcompositor = wl_registry_bind (registry, name, &wl_subcompositor_interface, 1);
   } else if (!g_strcmp0 (interface, wl_shm_interface.name)) {
     globals->shm = wl_registry_bind (registry, name, &wl_shm_interface, 1);
     wl_shm_add_listener (globals->shm, &shm_listener, globals);
@@ -322,7 +334,7 @@ static void registry_handle_global(void *data, struct wl_registry *registry,
     zwlr_foreign_toplevel_manager_v1_add_listener (globals->foreign_toplevel_manager,
                                                    &foreign_toplevel_manager_listener, globals);
   } else if (!g_strcmp0 (interface, phosh_private_interface.name)) {
-    globals->phosh = wl_registry_bind (registry, name, &phosh_private_interface, 6);
+    globals->phosh = wl_registry_bind (registry, name, &phosh_private_interface, 9);
   } else if (!g_strcmp0 (interface, gtk_shell1_interface.name)) {
     globals->gtk_shell1 = wl_registry_bind (registry, name, &gtk_shell1_interface, 3);
   } else if (!g_strcmp0 (interface, zphoc_layer_shell_effects_v1_interface.name)) {
@@ -381,6 +393,7 @@ wl_client_run (GTask *task, gpointer source,
   g_clear_pointer (&globals.layer_shell, zwlr_layer_shell_v1_destroy);
   wl_proxy_destroy ((struct wl_proxy *)globals.xdg_shell);
   g_clear_pointer (&globals.shm, wl_shm_destroy);
+  g_clear_pointer (&globals.subcompositor, wl_subcompositor_destroy);
   g_clear_pointer (&globals.compositor, wl_compositor_destroy);
   g_clear_pointer (&globals.output.output, wl_output_destroy);
 
@@ -605,6 +618,143 @@ phoc_test_client_capture_output (PhocTestClientGlobals *globals,
   return &output->screenshot.buffer;
 }
 
+static gboolean
+on_invoke_server (gpointer data)
+{
+  ServerRequest *req = data;
+  gboolean ret;
+
+  ret = req->func (phoc_server_get_default (), req->data);
+
+  g_mutex_lock (&req->mutex);
+  req->ret = ret;
+  req->done = TRUE;
+  g_cond_signal (&req->cond);
+  g_mutex_unlock (&req->mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * phoc_test_client_invoke_server:
+ * @globals: The client globals
+ * @func: The function to run
+ * @data: The data passed to @func
+ *
+ * Runs @func in the compositor's main context once the compositor
+ * handled all outstanding requests and waits for it to finish. This
+ * allows to check compositor state that isn't visible to clients.
+ *
+ * Returns: The return value of @func
+ */
+gboolean
+phoc_test_client_invoke_server (PhocTestClientGlobals *globals,
+                                PhocTestServerFunc     func,
+                                gpointer               data)
+{
+  ServerRequest req = { .func = func, .data = data };
+
+  wl_display_roundtrip (globals->display);
+
+  g_mutex_init (&req.mutex);
+  g_cond_init (&req.cond);
+
+  g_main_context_invoke (NULL, on_invoke_server, &req);
+
+  g_mutex_lock (&req.mutex);
+  while (!req.done)
+    g_cond_wait (&req.cond, &req.mutex);
+  g_mutex_unlock (&req.mutex);
+
+  g_mutex_clear (&req.mutex);
+  g_cond_clear (&req.cond);
+
+  return req.ret;
+}
+
+static gboolean
+outputs_idle (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output;
+
+  wl_list_for_each (output, &desktop->outputs, link) {
+    if (phoc_output_has_pending_frame (output))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static gboolean
+read_render_stats (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocTestRenderStats *stats = data;
+  PhocOutput *output;
+
+  *stats = (PhocTestRenderStats) { 0 };
+  wl_list_for_each (output, &desktop->outputs, link) {
+    PhocFrameStats *frame_stats = phoc_output_get_frame_stats (output);
+
+    stats->frames += phoc_frame_stats_get_frames (frame_stats);
+    stats->damaged_pixels += phoc_frame_stats_get_damaged_pixels (frame_stats);
+    stats->textures += phoc_frame_stats_get_texture_draws (frame_stats);
+  }
+
+  return TRUE;
+}
+
+/*
+ * Reads the render stats of all outputs once the compositor handled
+ * all requests and the resulting frames got presented.
+ */
+static void
+get_render_stats (PhocTestClientGlobals *globals, PhocTestRenderStats *stats)
+{
+  while (!phoc_test_client_invoke_server (globals, outputs_idle, NULL))
+    wl_display_roundtrip (globals->display);
+
+  phoc_test_client_invoke_server (globals, read_render_stats, stats);
+}
+
+/**
+ * phoc_test_client_begin_render_budget:
+ * @globals: The client globals
+ *
+ * Starts a render budget. Frames that are still outstanding are
+ * rendered before the budget starts.
+ */
+void
+phoc_test_client_begin_render_budget (PhocTestClientGlobals *globals)
+{
+  get_render_stats (globals, &globals->render_budget_start);
+}
+
+/**
+ * phoc_test_client_end_render_budget:
+ * @globals: The client globals
+ * @used: (out): What got rendered since the budget started
+ *
+ * Ends the render budget started with
+ * [func@test_client_begin_render_budget]. Usually
+ * [func@assert_render_budget] is used instead.
+ */
+void
+phoc_test_client_end_render_budget (PhocTestClientGlobals *globals, PhocTestRenderStats *used)
+{
+  PhocTestRenderStats now;
+
+  get_render_stats (globals, &now);
+
+  used->frames = now.frames - globals->render_budget_start.frames;
+  used->damaged_pixels = now.damaged_pixels - globals->render_budget_start.damaged_pixels;
+  used->textures = now.textures - globals->render_budget_start.textures;
+
+  globals->render_budget_start = now;
+}
+
 /**
  *
  * phoc_test_buffer_equal:
@@ -967,7 +1117,8 @@ phoc_test_setup (PhocTestFixture *fixture, gconstpointer data)
   g_assert_no_error (err);
 
   g_setenv ("XDG_RUNTIME_DIR", fixture->tmpdir, TRUE);
-  g_setenv ("DISPLAY", display, TRUE);
+  if (display)
+    g_setenv ("DISPLAY", display, TRUE);
   g_setenv ("WLR_BACKENDS", "x11", TRUE);
 }
 
@@ -1021,7 +1172,8 @@ phoc_test_teardown (PhocTestFixture *fixture, gconstpointer unused)
   g_test_dbus_down (fixture->bus);
   g_clear_object (&fixture->bus);
 
-  g_setenv ("DISPLAY", display, TRUE);
+  if (display)
+    g_setenv ("DISPLAY", display, TRUE);
   phoc_test_remove_tree (file);
   g_free (fixture->tmpdir);
 }
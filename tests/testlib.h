@@ -21,6 +21,21 @@ G_BEGIN_DECLS
 
 typedef struct _PhocTestWlGlobals PhocTestClientGlobals;
 
+/**
+ * PhocTestRenderStats:
+ * @frames: The number of frames rendered
+ * @damaged_pixels: The number of pixels repainted
+ * @textures: The number of textures drawn
+ *
+ * What the compositor rendered on all outputs. Used to check render
+ * budgets, see [func@assert_render_budget].
+ */
+typedef struct _PhocTestRenderStats {
+  guint64 frames;
+  guint64 damaged_pixels;
+  guint64 textures;
+} PhocTestRenderStats;
+
 typedef struct _PhocTestBuffer {
   struct wl_buffer *wl_buffer;
   guint8 *shm_data;
@@ -45,6 +60,7 @@ typedef struct _PhocTestOutput {
 typedef struct _PhocTestWlGlobals {
   struct wl_display *display;
   struct wl_compositor *compositor;
+  struct wl_subcompositor *subcompositor;
   struct wl_shm *shm;
   struct xdg_wm_base *xdg_shell;
   struct zwlr_layer_shell_v1 *layer_shell;
@@ -59,6 +75,8 @@ typedef struct _PhocTestWlGlobals {
   PhocTestOutput output;
 
   guint32 formats;
+  /* Render stats when the current render budget started */
+  PhocTestRenderStats render_budget_start;
 } PhocTestClientGlobals;
 
 typedef struct _PhocTestForeignToplevel {
@@ -110,6 +128,12 @@ PhocTestBuffer *phoc_test_client_capture_output (PhocTestClientGlobals *globals,
                                                  PhocTestOutput *output);
 PhocTestForeignToplevel *phoc_test_client_get_foreign_toplevel_handle (PhocTestClientGlobals *globals,
                                                                        const char *title);
+gboolean phoc_test_client_invoke_server (PhocTestClientGlobals *globals,
+                                         PhocTestServerFunc     func,
+                                         gpointer               data);
+void phoc_test_client_begin_render_budget (PhocTestClientGlobals *globals);
+void phoc_test_client_end_render_budget   (PhocTestClientGlobals *globals,
+                                           PhocTestRenderStats   *used);
 
 /* Test surfaces */
 PhocTestXdgToplevelSurface *
@@ -178,6 +202,30 @@ void     phoc_test_buffer_free (PhocTestBuffer *buffer);
     } \
   } G_STMT_END
 
+/**
+ * phoc_assert_render_budget:
+ * @g: The client global object
+ * @f: The maximum number of frames
+ * @d: The maximum number of damaged pixels
+ * @t: The maximum number of texture draws
+ *
+ * Checks that what the compositor rendered since
+ * [func@test_client_begin_render_budget] stays within the given
+ * budget. This allows to catch repaint and damage regressions
+ * like [func@assert_screenshot] catches rendering regressions.
+ */
+#define phoc_assert_render_budget(g, f, d, t) G_STMT_START {            \
+    PhocTestRenderStats __used;                                         \
+    phoc_test_client_end_render_budget ((g), &__used);                  \
+    g_test_message ("Render budget: %" G_GUINT64_FORMAT " frames, "     \
+                    "%" G_GUINT64_FORMAT " damaged pixels, "            \
+                    "%" G_GUINT64_FORMAT " textures",                   \
+                    __used.frames, __used.damaged_pixels, __used.textures); \
+    g_assert_cmpuint (__used.frames, <=, (f));                          \
+    g_assert_cmpuint (__used.damaged_pixels, <=, (d));                  \
+    g_assert_cmpuint (__used.textures, <=, (t));                        \
+  } G_STMT_END
+
 
 /* Test setup and fixtures */
 void phoc_test_setup (PhocTestFixture *fixture, gconstpointer data);